@@ -27,6 +27,7 @@
 #include<opencv2/core/core.hpp>
 
 #include<System.h>
+#include<DatasetReader.h>
 #include "ImuTypes.h"
 
 using namespace std;
@@ -64,7 +65,6 @@ int main(int argc, char *argv[])
     vector< vector<double> > vTimestampsImu;
     vector<int> nImages;
     vector<int> nImu;
-    vector<int> first_imu(num_seq,0);
 
     vstrImageFilenames.resize(num_seq);
     vTimestampsCam.resize(num_seq);
@@ -101,13 +101,6 @@ int main(int argc, char *argv[])
             cerr << "ERROR: Failed to load images or IMU for sequence" << seq << endl;
             return 1;
         }
-
-        // Find first imu to be considered, supposing imu measurements start first
-
-        while(vTimestampsImu[seq][first_imu[seq]]<=vTimestampsCam[seq][0])
-            first_imu[seq]++;
-        first_imu[seq]--; // first imu measurement to be considered
-
     }
 
     // Vector for tracking time statistics
@@ -120,6 +113,10 @@ int main(int argc, char *argv[])
     ORB_SLAM3::System SLAM(argv[1],argv[2],ORB_SLAM3::System::IMU_MONOCULAR, true);
     float imageScale = SLAM.GetImageScale();
 
+    // Reads the images ahead of the tracking, at the rate of the timestamps unless Dataset.RealTime is 0
+    ORB_SLAM3::DatasetReader reader(argv[2]);
+    reader.SetImageScale(imageScale);
+
     double t_resize = 0.f;
     double t_track = 0.f;
 
@@ -127,62 +124,33 @@ int main(int argc, char *argv[])
     for (seq = 0; seq<num_seq; seq++)
     {
 
-        // Main loop
-        cv::Mat im;
-        vector<ORB_SLAM3::IMU::Point> vImuMeas;
+        // Main loop, the images are read and resized ahead by the reader, with the IMU measurements
+        // from the previous frame
         proccIm = 0;
-        for(int ni=0; ni<nImages[seq]; ni++, proccIm++)
+        reader.SetSequence(vstrImageFilenames[seq], vector<string>(), vTimestampsCam[seq], cv::IMREAD_UNCHANGED);
+        reader.SetImu(vTimestampsImu[seq], vAcc[seq], vGyro[seq]);
+        reader.Start();
+
+        ORB_SLAM3::DatasetFrame frame;
+        while(reader.Next(frame))
         {
-            // Read image from file
-            im = cv::imread(vstrImageFilenames[seq][ni],cv::IMREAD_UNCHANGED); //CV_LOAD_IMAGE_UNCHANGED);
+            const int ni = frame.nIndex;
+            proccIm++;
 
-            double tframe = vTimestampsCam[seq][ni];
+            double tframe = frame.timestamp;
 
-            if(im.empty())
+            if(!frame.strFailed.empty())
             {
                 cerr << endl << "Failed to load image at: "
-                     <<  vstrImageFilenames[seq][ni] << endl;
+                     <<  frame.strFailed << endl;
                 return 1;
             }
 
-            if(imageScale != 1.f)
-            {
-#ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_Start_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_Start_Resize = std::chrono::monotonic_clock::now();
-    #endif
-#endif
-                int width = im.cols * imageScale;
-                int height = im.rows * imageScale;
-                cv::resize(im, im, cv::Size(width, height));
 #ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_End_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_End_Resize = std::chrono::monotonic_clock::now();
-    #endif
-                t_resize = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t_End_Resize - t_Start_Resize).count();
+            t_resize = frame.tResize;
+            if(imageScale != 1.f)
                 SLAM.InsertResizeTime(t_resize);
 #endif
-            }
-
-            // Load imu measurements from previous frame
-            vImuMeas.clear();
-
-            if(ni>0)
-            {
-                // cout << "t_cam " << tframe << endl;
-
-                while(vTimestampsImu[seq][first_imu[seq]]<=vTimestampsCam[seq][ni])
-                {
-                    vImuMeas.push_back(ORB_SLAM3::IMU::Point(vAcc[seq][first_imu[seq]].x,vAcc[seq][first_imu[seq]].y,vAcc[seq][first_imu[seq]].z,
-                                                             vGyro[seq][first_imu[seq]].x,vGyro[seq][first_imu[seq]].y,vGyro[seq][first_imu[seq]].z,
-                                                             vTimestampsImu[seq][first_imu[seq]]));
-                    first_imu[seq]++;
-                }
-            }
 
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
@@ -192,7 +160,7 @@ int main(int argc, char *argv[])
 
             // Pass the image to the SLAM system
             // cout << "tframe = " << tframe << endl;
-            SLAM.TrackMonocular(im,tframe,vImuMeas); // TODO change to monocular_inertial
+            SLAM.TrackMonocular(frame.im,tframe,frame.vImuMeas); // TODO change to monocular_inertial
 
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -210,16 +178,6 @@ int main(int argc, char *argv[])
             // std::cout << "ttrack: " << ttrack << std::endl;
 
             vTimesTrack[ni]=ttrack;
-
-            // Wait to load the next frame
-            double T=0;
-            if(ni<nImages[seq]-1)
-                T = vTimestampsCam[seq][ni+1]-tframe;
-            else if(ni>0)
-                T = tframe-vTimestampsCam[seq][ni-1];
-
-            if(ttrack<T)
-                usleep((T-ttrack)*1e6); // 1e6
         }
         if(seq < num_seq - 1)
         {
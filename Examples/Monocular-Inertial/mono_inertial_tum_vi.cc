@@ -26,6 +26,7 @@
 #include<opencv2/core/core.hpp>
 
 #include<System.h>
+#include<DatasetReader.h>
 #include "ImuTypes.h"
 
 using namespace std;
@@ -65,7 +66,6 @@ int main(int argc, char **argv)
     vector< vector<double> > vTimestampsImu;
     vector<int> nImages;
     vector<int> nImu;
-    vector<int> first_imu(num_seq,0);
 
     vstrImageFilenames.resize(num_seq);
     vTimestampsCam.resize(num_seq);
@@ -96,12 +96,6 @@ int main(int argc, char **argv)
             return 1;
         }
 
-        // Find first imu to be considered, supposing imu measurements start first
-
-        while(vTimestampsImu[seq][first_imu[seq]]<=vTimestampsCam[seq][0])
-            first_imu[seq]++;
-        first_imu[seq]--; // first imu measurement to be considered
-
     }
 
     // Vector for tracking time statistics
@@ -119,6 +113,11 @@ int main(int argc, char **argv)
     ORB_SLAM3::System SLAM(argv[1],argv[2],ORB_SLAM3::System::IMU_MONOCULAR, true, 0, file_name);
     float imageScale = SLAM.GetImageScale();
 
+    // Reads the images ahead of the tracking, at the rate of the timestamps unless Dataset.RealTime is 0
+    ORB_SLAM3::DatasetReader reader(argv[2]);
+    reader.SetImageScale(imageScale);
+    reader.SetClahe(3.0, cv::Size(8, 8));
+
     double t_resize = 0.f;
     double t_track = 0.f;
 
@@ -126,75 +125,34 @@ int main(int argc, char **argv)
     for (seq = 0; seq<num_seq; seq++)
     {
 
-        // Main loop
-        cv::Mat im;
-        vector<ORB_SLAM3::IMU::Point> vImuMeas;
+        // Main loop, the images are read, resized and equalized ahead by the reader, with the IMU
+        // measurements from the previous frame
         proccIm = 0;
-        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(3.0, cv::Size(8, 8));
-        for(int ni=0; ni<nImages[seq]; ni++, proccIm++)
-        {
-
-            // Read image from file
-            im = cv::imread(vstrImageFilenames[seq][ni],cv::IMREAD_GRAYSCALE); //,cv::IMREAD_GRAYSCALE);
-
-            // clahe
-            clahe->apply(im,im);
+        reader.SetSequence(vstrImageFilenames[seq], vector<string>(), vTimestampsCam[seq], cv::IMREAD_GRAYSCALE);
+        reader.SetImu(vTimestampsImu[seq], vAcc[seq], vGyro[seq]);
+        reader.Start();
 
+        ORB_SLAM3::DatasetFrame frame;
+        while(reader.Next(frame))
+        {
+            const int ni = frame.nIndex;
+            proccIm++;
 
-            // cout << "mat type: " << im.type() << endl;
-            double tframe = vTimestampsCam[seq][ni];
+            double tframe = frame.timestamp;
 
-            if(im.empty())
+            if(!frame.strFailed.empty())
             {
                 cerr << endl << "Failed to load image at: "
-                     <<  vstrImageFilenames[seq][ni] << endl;
+                     <<  frame.strFailed << endl;
                 return 1;
             }
 
-
-            // Load imu measurements from previous frame
-            vImuMeas.clear();
-
-            if(ni>0)
-            {
-                // cout << "t_cam " << tframe << endl;
-
-                while(vTimestampsImu[seq][first_imu[seq]]<=vTimestampsCam[seq][ni])
-                {
-                    vImuMeas.push_back(ORB_SLAM3::IMU::Point(vAcc[seq][first_imu[seq]].x,vAcc[seq][first_imu[seq]].y,vAcc[seq][first_imu[seq]].z,
-                                                             vGyro[seq][first_imu[seq]].x,vGyro[seq][first_imu[seq]].y,vGyro[seq][first_imu[seq]].z,
-                                                             vTimestampsImu[seq][first_imu[seq]]));
-                    // cout << "t_imu = " << fixed << vImuMeas.back().t << endl;
-                    first_imu[seq]++;
-                }
-            }
-
-            if(imageScale != 1.f)
-            {
 #ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_Start_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_Start_Resize = std::chrono::monotonic_clock::now();
-    #endif
-#endif
-                int width = im.cols * imageScale;
-                int height = im.rows * imageScale;
-                cv::resize(im, im, cv::Size(width, height));
-#ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_End_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_End_Resize = std::chrono::monotonic_clock::now();
-    #endif
-                t_resize = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t_End_Resize - t_Start_Resize).count();
+            t_resize = frame.tResize;
+            if(imageScale != 1.f)
                 SLAM.InsertResizeTime(t_resize);
 #endif
-            }
 
-            // cout << "first imu: " << first_imu[seq] << endl;
-            /*cout << "first imu time: " << fixed << vTimestampsImu[first_imu] << endl;
-            cout << "size vImu: " << vImuMeas.size() << endl;*/
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
     #else
@@ -203,7 +161,7 @@ int main(int argc, char **argv)
 
             // Pass the image to the SLAM system
             // cout << "tframe = " << tframe << endl;
-            SLAM.TrackMonocular(im,tframe,vImuMeas); // TODO change to monocular_inertial
+            SLAM.TrackMonocular(frame.im,tframe,frame.vImuMeas); // TODO change to monocular_inertial
 
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -221,17 +179,6 @@ int main(int argc, char **argv)
             // std::cout << "ttrack: " << ttrack << std::endl;
 
             vTimesTrack[ni]=ttrack;
-
-            // Wait to load the next frame
-            double T=0;
-            if(ni<nImages[seq]-1)
-                T = vTimestampsCam[seq][ni+1]-tframe;
-            else if(ni>0)
-                T = tframe-vTimestampsCam[seq][ni-1];
-
-            if(ttrack<T)
-                usleep((T-ttrack)*1e6); // 1e6
-
         }
         if(seq < num_seq - 1)
         {
@@ -24,6 +24,7 @@
 #include<opencv2/core/core.hpp>
 
 #include<System.h>
+#include<DatasetReader.h>
 
 using namespace std;
 
@@ -84,57 +85,38 @@ int main(int argc, char **argv)
     ORB_SLAM3::System SLAM(argv[1],argv[2],ORB_SLAM3::System::MONOCULAR, true); // true for visualization enabled
     float imageScale = SLAM.GetImageScale();
 
+    // Reads the images ahead of the tracking, at the rate of the timestamps unless Dataset.RealTime is 0
+    ORB_SLAM3::DatasetReader reader(argv[2]);
+    reader.SetImageScale(imageScale);
+
     double t_resize = 0.f;
     double t_track = 0.f;
 
     for (seq = 0; seq<num_seq; seq++)
     {
 
-        // Main loop
-        cv::Mat im;
-        int proccIm = 0;
-        for(int ni=0; ni<nImages[seq]; ni++, proccIm++)
-        {
-
-            // Read image from file
-            // cout << vstrImageFilenames[seq][ni] << endl;
-            im = cv::imread(vstrImageFilenames[seq][ni],cv::IMREAD_UNCHANGED); //,CV_LOAD_IMAGE_UNCHANGED);
+        // Main loop, the images are read and resized ahead by the reader
+        reader.SetSequence(vstrImageFilenames[seq], vector<string>(), vTimestampsCam[seq], cv::IMREAD_UNCHANGED);
+        reader.Start();
 
-            // BLUR IMAGE
-            // cv::blur(im, im, cv::Size(15, 15));
-
-            // im = cv::imread("/home/giuseppe/Dataset/mav0/cam0/data/1403636579813555456.png"  ,cv::IMREAD_UNCHANGED); //,CV_LOAD_IMAGE_UNCHANGED);
-            double tframe = vTimestampsCam[seq][ni];
+        ORB_SLAM3::DatasetFrame frame;
+        while(reader.Next(frame))
+        {
+            const int ni = frame.nIndex;
+            double tframe = frame.timestamp;
 
-            if(im.empty())
+            if(!frame.strFailed.empty())
             {
                 cerr << "Failed to load image at: "
-                     <<  vstrImageFilenames[seq][ni] << endl;
+                     <<  frame.strFailed << endl;
                 return 1;
             }
 
-            if(imageScale != 1.f)
-            {
 #ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_Start_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_Start_Resize = std::chrono::monotonic_clock::now();
-    #endif
-#endif
-                int width = im.cols * imageScale;
-                int height = im.rows * imageScale;
-                cv::resize(im, im, cv::Size(width, height));
-#ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_End_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_End_Resize = std::chrono::monotonic_clock::now();
-    #endif
-                t_resize = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t_End_Resize - t_Start_Resize).count();
+            t_resize = frame.tResize;
+            if(imageScale != 1.f)
                 SLAM.InsertResizeTime(t_resize);
 #endif
-            }
 
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
@@ -143,8 +125,7 @@ int main(int argc, char **argv)
     #endif
 
             // Pass the image to the SLAM system
-            // cout << "tframe = " << tframe << endl;
-            SLAM.TrackMonocular(im,tframe); // TODO change to monocular_inertial
+            SLAM.TrackMonocular(frame.im,tframe);
 
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -160,21 +141,6 @@ int main(int argc, char **argv)
             double ttrack= std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count();
 
             vTimesTrack[ni]=ttrack;
-
-            // Wait to load the next frame
-            double T=0;
-            if(ni<nImages[seq]-1)
-                T = vTimestampsCam[seq][ni+1]-tframe;
-            else if(ni>0)
-                T = tframe-vTimestampsCam[seq][ni-1];
-
-            //std::cout << "T: " << T << std::endl;
-            //std::cout << "ttrack: " << ttrack << std::endl;
-
-            if(ttrack<T) {
-                //std::cout << "usleep: " << (dT-ttrack) << std::endl;
-                usleep((T-ttrack)*1e6); // 1e6
-            }
         }
 
         if(seq < num_seq - 1)
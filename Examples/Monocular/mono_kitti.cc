@@ -25,6 +25,7 @@
 #include<opencv2/core/core.hpp>
 
 #include"System.h"
+#include"DatasetReader.h"
 
 using namespace std;
 
@@ -62,52 +63,30 @@ int main(int argc, char **argv)
     double t_resize = 0.f;
     double t_track = 0.f;
 
-    cv::Mat im;
-    for(int ni=0; ni<nImages; ni++)
-    {
-        // Read image from file
-        im = cv::imread(vstrImageFilenames[ni],cv::IMREAD_UNCHANGED); //,cv::IMREAD_UNCHANGED);
-
-        // Sharpening image
-        // cv::Mat frame;
-        // cv::GaussianBlur(im, frame, cv::Size(0, 0), 3);
-        // cv::addWeighted(im, 1.5, frame, -0.5, 0, frame);
-        // im = frame;
-
-        // Blurring image
-        // cv::GaussianBlur(im, im, cv::Size(10, 10), 0);
-        // cv::blur(im, im, cv::Size(15, 15));
+    // The images are read and resized ahead by the reader, at the rate of the timestamps unless
+    // Dataset.RealTime is 0
+    ORB_SLAM3::DatasetReader reader(argv[2]);
+    reader.SetImageScale(imageScale);
+    reader.SetSequence(vstrImageFilenames, vector<string>(), vTimestamps, cv::IMREAD_UNCHANGED);
+    reader.Start();
 
-        double tframe = vTimestamps[ni];
+    ORB_SLAM3::DatasetFrame frame;
+    while(reader.Next(frame))
+    {
+        const int ni = frame.nIndex;
+        double tframe = frame.timestamp;
 
-        if(im.empty())
+        if(!frame.strFailed.empty())
         {
-            cerr << endl << "Failed to load image at: " << vstrImageFilenames[ni] << endl;
+            cerr << endl << "Failed to load image at: " << frame.strFailed << endl;
             return 1;
         }
 
-        if(imageScale != 1.f)
-        {
 #ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-            std::chrono::steady_clock::time_point t_Start_Resize = std::chrono::steady_clock::now();
-    #else
-            std::chrono::monotonic_clock::time_point t_Start_Resize = std::chrono::monotonic_clock::now();
-    #endif
-#endif
-            int width = im.cols * imageScale;
-            int height = im.rows * imageScale;
-            cv::resize(im, im, cv::Size(width, height));
-#ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-            std::chrono::steady_clock::time_point t_End_Resize = std::chrono::steady_clock::now();
-    #else
-            std::chrono::monotonic_clock::time_point t_End_Resize = std::chrono::monotonic_clock::now();
-    #endif
-            t_resize = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t_End_Resize - t_Start_Resize).count();
+        t_resize = frame.tResize;
+        if(imageScale != 1.f)
             SLAM.InsertResizeTime(t_resize);
 #endif
-        }
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
@@ -116,7 +95,7 @@ int main(int argc, char **argv)
 #endif
 
         // Pass the image to the SLAM system
-        SLAM.TrackMonocular(im,tframe,vector<ORB_SLAM3::IMU::Point>(), vstrImageFilenames[ni]);
+        SLAM.TrackMonocular(frame.im,tframe,vector<ORB_SLAM3::IMU::Point>(), vstrImageFilenames[ni]);
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -132,16 +111,6 @@ int main(int argc, char **argv)
         double ttrack= std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count();
 
         vTimesTrack[ni]=ttrack;
-
-        // Wait to load the next frame
-        double T=0;
-        if(ni<nImages-1)
-            T = vTimestamps[ni+1]-tframe;
-        else if(ni>0)
-            T = tframe-vTimestamps[ni-1];
-
-        if(ttrack<T)
-            usleep((T-ttrack)*1e6);
     }
 
     // Stop all threads
@@ -26,6 +26,7 @@
 #include<opencv2/core/core.hpp>
 
 #include"System.h"
+#include"DatasetReader.h"
 #include "Converter.h"
 
 using namespace std;
@@ -92,6 +93,11 @@ int main(int argc, char **argv)
     ORB_SLAM3::System SLAM(argv[1],argv[2],ORB_SLAM3::System::MONOCULAR,false, 0, file_name);
     float imageScale = SLAM.GetImageScale();
 
+    // Reads the images ahead of the tracking, at the rate of the timestamps unless Dataset.RealTime is 0
+    ORB_SLAM3::DatasetReader reader(argv[2]);
+    reader.SetImageScale(imageScale);
+    reader.SetClahe(3.0, cv::Size(8, 8));
+
     double t_resize = 0.f;
     double t_track = 0.f;
 
@@ -99,53 +105,29 @@ int main(int argc, char **argv)
     for (seq = 0; seq<num_seq; seq++)
     {
 
-        // Main loop
-        cv::Mat im;
+        // Main loop, the images are read, resized and equalized ahead by the reader
         proccIm = 0;
-        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(3.0, cv::Size(8, 8));
-        for(int ni=0; ni<nImages[seq]; ni++, proccIm++)
-        {
+        reader.SetSequence(vstrImageFilenames[seq], vector<string>(), vTimestampsCam[seq], cv::IMREAD_GRAYSCALE);
+        reader.Start();
 
-            // Read image from file
-            im = cv::imread(vstrImageFilenames[seq][ni],cv::IMREAD_GRAYSCALE); //,cv::IMREAD_GRAYSCALE);
-
-            // BLUR IMAGE
-            // cv::blur(im, im, cv::Size(15, 15));
+        ORB_SLAM3::DatasetFrame frame;
+        while(reader.Next(frame))
+        {
+            const int ni = frame.nIndex;
+            proccIm++;
 
-            if(imageScale != 1.f)
-            {
-#ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_Start_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_Start_Resize = std::chrono::monotonic_clock::now();
-    #endif
-#endif
-                int width = im.cols * imageScale;
-                int height = im.rows * imageScale;
-                cv::resize(im, im, cv::Size(width, height));
 #ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_End_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_End_Resize = std::chrono::monotonic_clock::now();
-    #endif
-                t_resize = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t_End_Resize - t_Start_Resize).count();
+            t_resize = frame.tResize;
+            if(imageScale != 1.f)
                 SLAM.InsertResizeTime(t_resize);
 #endif
-            }
-
-            // clahe
-            clahe->apply(im,im);
-
 
-            // cout << "mat type: " << im.type() << endl;
-            double tframe = vTimestampsCam[seq][ni];
+            double tframe = frame.timestamp;
 
-            if(im.empty())
+            if(!frame.strFailed.empty())
             {
                 cerr << endl << "Failed to load image at: "
-                     <<  vstrImageFilenames[seq][ni] << endl;
+                     <<  frame.strFailed << endl;
                 return 1;
             }
 #ifdef COMPILEDWITHC11
@@ -155,7 +137,7 @@ int main(int argc, char **argv)
 #endif
 
             // Pass the image to the SLAM system
-            SLAM.TrackMonocular(im,tframe); // TODO change to monocular_inertial
+            SLAM.TrackMonocular(frame.im,tframe); // TODO change to monocular_inertial
 
 #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -172,17 +154,6 @@ int main(int argc, char **argv)
             ttrack_tot += ttrack;
 
             vTimesTrack[ni]=ttrack;
-
-            // Wait to load the next frame
-            double T=0;
-            if(ni<nImages[seq]-1)
-                T = vTimestampsCam[seq][ni+1]-tframe;
-            else if(ni>0)
-                T = tframe-vTimestampsCam[seq][ni-1];
-
-            if(ttrack<T)
-                usleep((T-ttrack)*1e6); // 1e6
-
         }
         if(seq < num_seq - 1)
         {
@@ -24,6 +24,7 @@
 #include<opencv2/core/core.hpp>
 
 #include<System.h>
+#include<DatasetReader.h>
 
 using namespace std;
 
@@ -70,30 +71,34 @@ int main(int argc, char **argv)
     cout << "Start processing sequence ..." << endl;
     cout << "Images in the sequence: " << nImages << endl << endl;
 
-    // Main loop
-    cv::Mat imRGB, imD;
+    // The images and depthmaps are read and resized ahead by the reader, at the rate of the timestamps
+    // unless Dataset.RealTime is 0
+    vector<string> vstrImagePathsRGB(nImages), vstrImagePathsD(nImages);
     for(int ni=0; ni<nImages; ni++)
     {
-        // Read image and depthmap from file
-        imRGB = cv::imread(string(argv[3])+"/"+vstrImageFilenamesRGB[ni],cv::IMREAD_UNCHANGED); //,cv::IMREAD_UNCHANGED);
-        imD = cv::imread(string(argv[3])+"/"+vstrImageFilenamesD[ni],cv::IMREAD_UNCHANGED); //,cv::IMREAD_UNCHANGED);
-        double tframe = vTimestamps[ni];
+        vstrImagePathsRGB[ni] = string(argv[3])+"/"+vstrImageFilenamesRGB[ni];
+        vstrImagePathsD[ni] = string(argv[3])+"/"+vstrImageFilenamesD[ni];
+    }
+
+    ORB_SLAM3::DatasetReader reader(argv[2]);
+    reader.SetImageScale(imageScale);
+    reader.SetSequence(vstrImagePathsRGB, vstrImagePathsD, vTimestamps, cv::IMREAD_UNCHANGED);
+    reader.Start();
+
+    // Main loop
+    ORB_SLAM3::DatasetFrame frame;
+    while(reader.Next(frame))
+    {
+        const int ni = frame.nIndex;
+        double tframe = frame.timestamp;
 
-        if(imRGB.empty())
+        if(!frame.strFailed.empty())
         {
             cerr << endl << "Failed to load image at: "
-                 << string(argv[3]) << "/" << vstrImageFilenamesRGB[ni] << endl;
+                 << frame.strFailed << endl;
             return 1;
         }
 
-        if(imageScale != 1.f)
-        {
-            int width = imRGB.cols * imageScale;
-            int height = imRGB.rows * imageScale;
-            cv::resize(imRGB, imRGB, cv::Size(width, height));
-            cv::resize(imD, imD, cv::Size(width, height));
-        }
-
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 #else
@@ -101,7 +106,7 @@ int main(int argc, char **argv)
 #endif
 
         // Pass the image to the SLAM system
-        SLAM.TrackRGBD(imRGB,imD,tframe);
+        SLAM.TrackRGBD(frame.im,frame.im2,tframe);
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -112,16 +117,6 @@ int main(int argc, char **argv)
         double ttrack= std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count();
 
         vTimesTrack[ni]=ttrack;
-
-        // Wait to load the next frame
-        double T=0;
-        if(ni<nImages-1)
-            T = vTimestamps[ni+1]-tframe;
-        else if(ni>0)
-            T = tframe-vTimestamps[ni-1];
-
-        if(ttrack<T)
-            usleep((T-ttrack)*1e6);
     }
 
     // Stop all threads
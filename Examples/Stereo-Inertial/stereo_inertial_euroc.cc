@@ -28,6 +28,7 @@
 
 
 #include<System.h>
+#include<DatasetReader.h>
 #include "ImuTypes.h"
 #include "Optimizer.h"
 
@@ -66,7 +67,6 @@ int main(int argc, char **argv)
     vector< vector<double> > vTimestampsImu;
     vector<int> nImages;
     vector<int> nImu;
-    vector<int> first_imu(num_seq,0);
 
     vstrImageLeft.resize(num_seq);
     vstrImageRight.resize(num_seq);
@@ -106,11 +106,6 @@ int main(int argc, char **argv)
             return 1;
         }
 
-        // Find first imu to be considered, supposing imu measurements start first
-
-        while(vTimestampsImu[seq][first_imu[seq]]<=vTimestampsCam[seq][0])
-            first_imu[seq]++;
-        first_imu[seq]--; // first imu measurement to be considered
     }
 
     // Read rectification parameters
@@ -131,49 +126,32 @@ int main(int argc, char **argv)
     // Create SLAM system. It initializes all system threads and gets ready to process frames.
     ORB_SLAM3::System SLAM(argv[1],argv[2],ORB_SLAM3::System::IMU_STEREO, false);
 
-    cv::Mat imLeft, imRight;
+    // Reads the images ahead of the tracking, at the rate of the timestamps unless Dataset.RealTime is 0
+    ORB_SLAM3::DatasetReader reader(argv[2]);
+
     for (seq = 0; seq<num_seq; seq++)
     {
-        // Seq loop
-        vector<ORB_SLAM3::IMU::Point> vImuMeas;
+        // Seq loop, each frame comes with the IMU measurements from the previous frame
         double t_rect = 0.f;
         double t_resize = 0.f;
         double t_track = 0.f;
-        int num_rect = 0;
-        int proccIm = 0;
-        for(int ni=0; ni<nImages[seq]; ni++, proccIm++)
-        {
-            // Read left and right images from file
-            imLeft = cv::imread(vstrImageLeft[seq][ni],cv::IMREAD_UNCHANGED);
-            imRight = cv::imread(vstrImageRight[seq][ni],cv::IMREAD_UNCHANGED);
+        reader.SetSequence(vstrImageLeft[seq], vstrImageRight[seq], vTimestampsCam[seq], cv::IMREAD_UNCHANGED);
+        reader.SetImu(vTimestampsImu[seq], vAcc[seq], vGyro[seq]);
+        reader.Start();
 
-            if(imLeft.empty())
-            {
-                cerr << endl << "Failed to load image at: "
-                     << string(vstrImageLeft[seq][ni]) << endl;
-                return 1;
-            }
+        ORB_SLAM3::DatasetFrame frame;
+        while(reader.Next(frame))
+        {
+            const int ni = frame.nIndex;
 
-            if(imRight.empty())
+            if(!frame.strFailed.empty())
             {
                 cerr << endl << "Failed to load image at: "
-                     << string(vstrImageRight[seq][ni]) << endl;
+                     << frame.strFailed << endl;
                 return 1;
             }
 
-            double tframe = vTimestampsCam[seq][ni];
-
-            // Load imu measurements from previous frame
-            vImuMeas.clear();
-
-            if(ni>0)
-                while(vTimestampsImu[seq][first_imu[seq]]<=vTimestampsCam[seq][ni]) // while(vTimestampsImu[first_imu]<=vTimestampsCam[ni])
-                {
-                    vImuMeas.push_back(ORB_SLAM3::IMU::Point(vAcc[seq][first_imu[seq]].x,vAcc[seq][first_imu[seq]].y,vAcc[seq][first_imu[seq]].z,
-                                                             vGyro[seq][first_imu[seq]].x,vGyro[seq][first_imu[seq]].y,vGyro[seq][first_imu[seq]].z,
-                                                             vTimestampsImu[seq][first_imu[seq]]));
-                    first_imu[seq]++;
-                }
+            double tframe = frame.timestamp;
 
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
@@ -182,7 +160,7 @@ int main(int argc, char **argv)
     #endif
 
             // Pass the images to the SLAM system
-            SLAM.TrackStereo(imLeft,imRight,tframe,vImuMeas);
+            SLAM.TrackStereo(frame.im,frame.im2,tframe,frame.vImuMeas);
 
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -198,16 +176,6 @@ int main(int argc, char **argv)
             double ttrack= std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count();
 
             vTimesTrack[ni]=ttrack;
-
-            // Wait to load the next frame
-            double T=0;
-            if(ni<nImages[seq]-1)
-                T = vTimestampsCam[seq][ni+1]-tframe;
-            else if(ni>0)
-                T = tframe-vTimestampsCam[seq][ni-1];
-
-            if(ttrack<T)
-                usleep((T-ttrack)*1e6); // 1e6
         }
 
         if(seq < num_seq - 1)
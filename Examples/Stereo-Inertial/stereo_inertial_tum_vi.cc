@@ -26,6 +26,7 @@
 #include<opencv2/core/core.hpp>
 
 #include<System.h>
+#include<DatasetReader.h>
 #include "ImuTypes.h"
 
 using namespace std;
@@ -61,7 +62,6 @@ int main(int argc, char **argv)
     vector< vector<double> > vTimestampsImu;
     vector<int> nImages;
     vector<int> nImu;
-    vector<int> first_imu(num_seq,0);
 
     vstrImageLeftFilenames.resize(num_seq);
     vstrImageRightFilenames.resize(num_seq);
@@ -99,12 +99,6 @@ int main(int argc, char **argv)
             return 1;
         }
 
-        // Find first imu to be considered, supposing imu measurements start first
-
-        while(vTimestampsImu[seq][first_imu[seq]]<=vTimestampsCam[seq][0])
-            first_imu[seq]++;
-        first_imu[seq]--; // first imu measurement to be considered
-
     }
 
     // Vector for tracking time statistics
@@ -122,6 +116,11 @@ int main(int argc, char **argv)
     ORB_SLAM3::System SLAM(argv[1],argv[2],ORB_SLAM3::System::IMU_STEREO, true, 0, file_name);
     float imageScale = SLAM.GetImageScale();
 
+    // Reads the images ahead of the tracking, at the rate of the timestamps unless Dataset.RealTime is 0
+    ORB_SLAM3::DatasetReader reader(argv[2]);
+    reader.SetImageScale(imageScale);
+    reader.SetClahe(3.0, cv::Size(8, 8));
+
     double t_resize = 0.f;
     double t_track = 0.f;
 
@@ -129,78 +128,34 @@ int main(int argc, char **argv)
     for (seq = 0; seq<num_seq; seq++)
     {
 
-        // Main loop
-        cv::Mat imLeft, imRight;
-        vector<ORB_SLAM3::IMU::Point> vImuMeas;
+        // Main loop, the images are read, resized and equalized ahead by the reader, with the IMU
+        // measurements from the previous frame
         proccIm = 0;
-        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(3.0, cv::Size(8, 8));
-        for(int ni=0; ni<nImages[seq]; ni++, proccIm++)
-        {
+        reader.SetSequence(vstrImageLeftFilenames[seq], vstrImageRightFilenames[seq], vTimestampsCam[seq], cv::IMREAD_GRAYSCALE);
+        reader.SetImu(vTimestampsImu[seq], vAcc[seq], vGyro[seq]);
+        reader.Start();
 
-            // Read image from file
-            imLeft = cv::imread(vstrImageLeftFilenames[seq][ni],cv::IMREAD_GRAYSCALE);
-            imRight = cv::imread(vstrImageRightFilenames[seq][ni],cv::IMREAD_GRAYSCALE);
+        ORB_SLAM3::DatasetFrame frame;
+        while(reader.Next(frame))
+        {
+            const int ni = frame.nIndex;
+            proccIm++;
 
-            if(imageScale != 1.f)
-            {
 #ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_Start_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_Start_Resize = std::chrono::monotonic_clock::now();
-    #endif
-#endif
-                int width = imLeft.cols * imageScale;
-                int height = imLeft.rows * imageScale;
-                cv::resize(imLeft, imLeft, cv::Size(width, height));
-                cv::resize(imRight, imRight, cv::Size(width, height));
-#ifdef REGISTER_TIMES
-    #ifdef COMPILEDWITHC11
-                std::chrono::steady_clock::time_point t_End_Resize = std::chrono::steady_clock::now();
-    #else
-                std::chrono::monotonic_clock::time_point t_End_Resize = std::chrono::monotonic_clock::now();
-    #endif
-                t_resize = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t_End_Resize - t_Start_Resize).count();
+            t_resize = frame.tResize;
+            if(imageScale != 1.f)
                 SLAM.InsertResizeTime(t_resize);
 #endif
-            }
 
-            // clahe
-            clahe->apply(imLeft,imLeft);
-            clahe->apply(imRight,imRight);
+            double tframe = frame.timestamp;
 
-            double tframe = vTimestampsCam[seq][ni];
-
-            if(imLeft.empty() || imRight.empty())
+            if(!frame.strFailed.empty())
             {
                 cerr << endl << "Failed to load image at: "
-                     <<  vstrImageLeftFilenames[seq][ni] << endl;
+                     <<  frame.strFailed << endl;
                 return 1;
             }
 
-
-            // Load imu measurements from previous frame
-            vImuMeas.clear();
-
-            if(ni>0)
-            {
-                // cout << "t_cam " << tframe << endl;
-
-                while(vTimestampsImu[seq][first_imu[seq]]<=vTimestampsCam[seq][ni])
-                {
-                    // vImuMeas.push_back(ORB_SLAM3::IMU::Point(vAcc[first_imu],vGyro[first_imu],vTimestampsImu[first_imu]));
-                    vImuMeas.push_back(ORB_SLAM3::IMU::Point(vAcc[seq][first_imu[seq]].x,vAcc[seq][first_imu[seq]].y,vAcc[seq][first_imu[seq]].z,
-                                                             vGyro[seq][first_imu[seq]].x,vGyro[seq][first_imu[seq]].y,vGyro[seq][first_imu[seq]].z,
-                                                             vTimestampsImu[seq][first_imu[seq]]));
-                    // cout << "t_imu = " << fixed << vImuMeas.back().t << endl;
-                    first_imu[seq]++;
-                }
-            }
-
-            /*cout << "first imu: " << first_imu[seq] << endl;
-            cout << "first imu time: " << fixed << vTimestampsImu[seq][0] << endl;
-            cout << "size vImu: " << vImuMeas.size() << endl;*/
-
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
     #else
@@ -208,7 +163,7 @@ int main(int argc, char **argv)
     #endif
 
             // Pass the image to the SLAM system
-            SLAM.TrackStereo(imLeft,imRight,tframe,vImuMeas);
+            SLAM.TrackStereo(frame.im,frame.im2,tframe,frame.vImuMeas);
 
     #ifdef COMPILEDWITHC11
             std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
@@ -226,16 +181,6 @@ int main(int argc, char **argv)
             // std::cout << "ttrack: " << ttrack << std::endl;
 
             vTimesTrack[ni]=ttrack;
-
-            // Wait to load the next frame
-            double T=0;
-            if(ni<nImages[seq]-1)
-                T = vTimestampsCam[seq][ni+1]-tframe;
-            else if(ni>0)
-                T = tframe-vTimestampsCam[seq][ni-1];
-
-            if(ttrack<T)
-                usleep((T-ttrack)*1e6); // 1e6
         }
         if(seq < num_seq - 1)
         {
@@ -0,0 +1,162 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// Observations of the map points and covisibility of the keyframes in FlatMap against the std::map
+// they replaced: build, copy (as GetObservations/GetConnectedKFs do), iteration, lookups and erase,
+// with the time, the number of heap allocations and the bytes allocated of each.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "FlatContainers.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+static size_t snAllocations = 0;
+static size_t snBytes = 0;
+
+void* operator new(size_t n)
+{
+    snAllocations++;
+    snBytes += n;
+    void* p = malloc(n);
+    if(!p)
+        throw bad_alloc();
+    return p;
+}
+
+// Not inlined: GCC 12 at -O2 sees the free of a pointer from operator new in the callers and warns
+// (-Wmismatched-new-delete), although both are replaced here
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+struct KeyFrame;
+
+// Number of keys of each container and the keys themselves, keyframe addresses
+struct Workload
+{
+    vector<vector<KeyFrame*> > vvKeys;
+    vector<KeyFrame*> vLookups;
+};
+
+static Workload MakeWorkload(const int nContainers, const int nMin, const int nMax, const int nKFs, mt19937 &rng)
+{
+    static vector<char> vKFs(nKFs*64);
+    uniform_int_distribution<int> size(nMin, nMax), kf(0, nKFs-1);
+    Workload w;
+    w.vvKeys.resize(nContainers);
+    for(int i=0; i<nContainers; i++)
+    {
+        const int n = size(rng);
+        for(int j=0; j<n; j++)
+            w.vvKeys[i].push_back(reinterpret_cast<KeyFrame*>(&vKFs[64*kf(rng)]));
+    }
+    for(int i=0; i<nContainers; i++)
+        w.vLookups.push_back(reinterpret_cast<KeyFrame*>(&vKFs[64*kf(rng)]));
+    return w;
+}
+
+struct Timer
+{
+    chrono::steady_clock::time_point t0;
+    size_t nAlloc0;
+    size_t nBytes0;
+    Timer() : t0(chrono::steady_clock::now()), nAlloc0(snAllocations), nBytes0(snBytes) {}
+    void Print(const char* name)
+    {
+        const double ms = chrono::duration_cast<chrono::duration<double,milli> >(chrono::steady_clock::now()-t0).count();
+        printf("  %-11s %9.2f ms %10zu allocations %8.1f MB\n", name, ms, snAllocations-nAlloc0, (snBytes-nBytes0)/1048576.0);
+        t0 = chrono::steady_clock::now();
+        nAlloc0 = snAllocations;
+        nBytes0 = snBytes;
+    }
+};
+
+template<typename MapType>
+static void Run(const char* name, const Workload &w, const typename MapType::mapped_type &value)
+{
+    printf("%s\n", name);
+    const size_t n = w.vvKeys.size();
+    long int nSum = 0;
+
+    Timer t;
+    vector<MapType> vMaps(n);
+    for(size_t i=0; i<n; i++)
+        for(KeyFrame* pKF : w.vvKeys[i])
+            vMaps[i].insert(make_pair(pKF, value));
+    t.Print("build");
+
+    {
+        vector<MapType> vCopies(vMaps);
+        nSum += vCopies.back().size();
+        t.Print("copy");
+    }
+    t = Timer();
+
+    for(int rep=0; rep<10; rep++)
+        for(size_t i=0; i<n; i++)
+            for(typename MapType::const_iterator it = vMaps[i].begin(); it != vMaps[i].end(); ++it)
+                nSum += reinterpret_cast<size_t>(it->first) & 1;
+    t.Print("iterate x10");
+
+    for(int rep=0; rep<10; rep++)
+        for(size_t i=0; i<n; i++)
+            nSum += vMaps[i].count(w.vLookups[(i+rep)%n]);
+    t.Print("find x10");
+
+    for(size_t i=0; i<n; i++)
+        vMaps[i].erase(w.vvKeys[i].front());
+    t.Print("erase");
+
+    vMaps.clear();
+    t.Print("destroy");
+    printf("  (checksum %ld)\n", nSum);
+}
+
+int main()
+{
+    mt19937 rng(26);
+
+    // Map points: 2-20 observations out of 2000 keyframes
+    const Workload observations = MakeWorkload(200000, 2, 20, 2000, rng);
+    const tuple<int,int> index(0, -1);
+    printf("Observations of 200000 map points (2-20 each)\n");
+    Run<map<KeyFrame*,tuple<int,int> > >("std::map", observations, index);
+    Run<FlatMap<KeyFrame*,tuple<int,int>,8> >("FlatMap<8>", observations, index);
+
+    // Keyframes: 10-60 covisible keyframes
+    const Workload connections = MakeWorkload(5000, 10, 60, 2000, rng);
+    printf("\nConnections of 5000 keyframes (10-60 each)\n");
+    Run<map<KeyFrame*,int> >("std::map", connections, 15);
+    Run<FlatMap<KeyFrame*,int,32> >("FlatMap<32>", connections, 15);
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// Linear solvers of the global BA on reduced camera systems with the structure of a keyframe graph
+// (each keyframe covisible with the next ones, plus loop edges, rank 3 terms with the translation
+// scaled by the scene depth): sparse Cholesky with scalar and block
+// AMD ordering against PCG in exact and inexact mode.
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "Thirdparty/g2o/g2o/core/sparse_block_matrix.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_pcg.h"
+
+using namespace std;
+
+typedef Eigen::Matrix<double,6,6> Matrix6d;
+
+static double Seconds(const chrono::steady_clock::time_point &t0)
+{
+    return chrono::duration_cast<chrono::duration<double> >(chrono::steady_clock::now()-t0).count();
+}
+
+// Average time of nSolves solves (ms), the first one included, and relative residual of the last one
+template<typename Solver>
+static void Time(const char* name, Solver &solver, const g2o::SparseBlockMatrix<Matrix6d> &A, const Eigen::VectorXd &b,
+                 const int nSolves)
+{
+    solver.init();
+    Eigen::VectorXd x(b.size()), rhs(b);
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    bool bOk = true;
+    for(int i=0; i<nSolves; i++)
+        bOk = solver.solve(A, x.data(), rhs.data()) && bOk;
+    const double ms = 1e3*Seconds(t0)/nSolves;
+
+    Eigen::VectorXd Ax = Eigen::VectorXd::Zero(b.size());
+    double* pAx = Ax.data();
+    A.multiplySymmetricUpperTriangle(pAx, x.data());
+    printf("  %-22s %9.2f ms/solve   residual %.1e%s\n", name, ms, (Ax-b).norm()/b.norm(), bOk ? "" : "   FAILED");
+}
+
+int main()
+{
+    const int vnKFs[] = {200, 1000, 3000};
+    const int nCovisible = 10;
+    mt19937 rng(34);
+
+    for(const int nKFs : vnKFs)
+    {
+        uniform_int_distribution<int> randomKF(0, nKFs-1);
+        uniform_real_distribution<double> depth(1.0, 50.0);
+        vector<int> vBlockIndices(nKFs);
+        for(int i=0; i<nKFs; i++)
+            vBlockIndices[i] = 6*(i+1);
+
+        g2o::SparseBlockMatrix<Matrix6d> A(&vBlockIndices[0], &vBlockIndices[0], nKFs, nKFs);
+        int nEdges = 0;
+        for(int i=0; i<nKFs; i++)
+        {
+            vector<int> vOthers;
+            for(int j=i+1; j<=i+nCovisible && j<nKFs; j++)
+                vOthers.push_back(j);
+            if(i%20 == 0)
+                vOthers.push_back(randomKF(rng));
+
+            for(const int j : vOthers)
+            {
+                if(j == i)
+                    continue;
+                // Relative pose residual of rank 3, translation scaled by the depth of the scene
+                Eigen::Matrix<double,3,6> Ji = Eigen::Matrix<double,3,6>::Random(), Jj = Eigen::Matrix<double,3,6>::Random();
+                Ji.rightCols<3>() /= depth(rng);
+                Jj.rightCols<3>() /= depth(rng);
+                const int a = min(i,j), c = max(i,j);
+                const Eigen::Matrix<double,3,6> &Ja = a == i ? Ji : Jj, &Jc = a == i ? Jj : Ji;
+                *A.block(a, a, true) += Ja.transpose()*Ja;
+                *A.block(c, c, true) += Jc.transpose()*Jc;
+                *A.block(a, c, true) += Ja.transpose()*Jc;
+                nEdges++;
+            }
+        }
+        // Gauge fixed by a prior on the first keyframe
+        *A.block(0, 0, true) += Matrix6d::Identity();
+
+        const Eigen::VectorXd b = Eigen::VectorXd::Random(6*nKFs);
+        printf("%d keyframes, %d covisibility edges\n", nKFs, nEdges);
+
+        g2o::LinearSolverEigen<Matrix6d> cholesky;
+        cholesky.setBlockOrdering(false);
+        Time("Cholesky, scalar AMD", cholesky, A, b, 5);
+
+        g2o::LinearSolverEigen<Matrix6d> blockCholesky;
+        blockCholesky.setBlockOrdering(true);
+        Time("Cholesky, block AMD", blockCholesky, A, b, 5);
+
+        g2o::LinearSolverPCG<Matrix6d> pcg;
+        Time("PCG", pcg, A, b, 5);
+        printf("  %-22s %9d iterations\n", "", pcg.iterations());
+
+        g2o::LinearSolverPCG<Matrix6d> inexact;
+        inexact.setInexact(true);
+        Time("PCG, inexact", inexact, A, b, 5);
+        printf("  %-22s %9d iterations\n", "", inexact.iterations());
+    }
+
+    return 0;
+}
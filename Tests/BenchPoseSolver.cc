@@ -0,0 +1,215 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// PoseSolver against the g2o graph of Optimizer::PoseOptimization on recorded frames: the PoseFrames.txt
+// written by a run of the system built with REGISTER_POSE_FRAMES (Optimizer.h). Time per frame of both
+// and their agreement (pose and outliers of each observation).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include "CameraModels/Pinhole.h"
+#include "CameraModels/KannalaBrandt8.h"
+#include "PoseSolverRuns.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+typedef chrono::steady_clock Clock;
+
+static double Milliseconds(const Clock::time_point &t0, const Clock::time_point &t1)
+{
+    return chrono::duration_cast<chrono::duration<double,milli> >(t1 - t0).count();
+}
+
+static Sophus::SE3d ReadPose(istream &is)
+{
+    double qx, qy, qz, qw, tx, ty, tz;
+    is >> qx >> qy >> qz >> qw >> tx >> ty >> tz;
+    return Sophus::SE3d(Eigen::Quaterniond(qw, qx, qy, qz).normalized(), Eigen::Vector3d(tx, ty, tz));
+}
+
+// The frames of a run share their cameras, which live until the end of the benchmark
+static GeometricCamera* ReadCamera(istream &is)
+{
+    static vector<GeometricCamera*> vpCameras;
+
+    unsigned int type;
+    size_t nParams;
+    is >> type >> nParams;
+    vector<float> vParams(nParams);
+    for(size_t i=0; i<nParams; i++)
+        is >> vParams[i];
+
+    for(size_t c=0; c<vpCameras.size(); c++)
+    {
+        GeometricCamera* pCamera = vpCameras[c];
+        bool bSame = pCamera->GetType() == type && pCamera->size() == nParams;
+        for(size_t i=0; bSame && i<nParams; i++)
+            bSame = pCamera->getParameter(i) == vParams[i];
+        if(bSame)
+            return pCamera;
+    }
+
+    if(type == GeometricCamera::CAM_FISHEYE)
+        vpCameras.push_back(new KannalaBrandt8(vParams));
+    else
+        vpCameras.push_back(new Pinhole(vParams));
+    return vpCameras.back();
+}
+
+// Frame recorded by Optimizer::PoseOptimization
+struct RecordedFrame
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    vector<PoseObservation> vObs;
+    PoseCalibration calib;
+    Sophus::SE3d Tcw0;
+};
+
+static bool ReadFrames(const string &strFile, vector<RecordedFrame, Eigen::aligned_allocator<RecordedFrame> > &vFrames)
+{
+    ifstream f(strFile.c_str());
+    if(!f.is_open())
+        return false;
+
+    string strLine, strTag;
+    while(getline(f, strLine))
+    {
+        istringstream ss(strLine);
+        ss >> strTag;
+        if(strTag != "frame")
+            return false;
+
+        RecordedFrame frame;
+        size_t nObs;
+        ss >> nObs >> frame.calib.fx >> frame.calib.fy >> frame.calib.cx >> frame.calib.cy >> frame.calib.bf;
+        frame.calib.pCamera2 = static_cast<GeometricCamera*>(NULL);
+
+        // camera, camera2 (rig) and pose
+        while(getline(f, strLine))
+        {
+            istringstream ssLine(strLine);
+            ssLine >> strTag;
+            if(strTag == "camera")
+                frame.calib.pCamera = ReadCamera(ssLine);
+            else if(strTag == "camera2")
+            {
+                frame.calib.pCamera2 = ReadCamera(ssLine);
+                frame.calib.Trl = ReadPose(ssLine);
+            }
+            else if(strTag == "pose")
+            {
+                frame.Tcw0 = ReadPose(ssLine);
+                break;
+            }
+        }
+
+        frame.vObs.resize(nObs);
+        for(size_t i=0; i<nObs && getline(f, strLine); i++)
+        {
+            PoseObservation &obs = frame.vObs[i];
+            istringstream ssObs(strLine);
+            ssObs >> obs.type >> obs.invSigma2 >> obs.u >> obs.v >> obs.ur >> obs.Xw[0] >> obs.Xw[1] >> obs.Xw[2];
+        }
+
+        if(!f)
+            return false;
+
+        // PoseOptimization returns before optimizing these ones
+        if(nObs >= 3)
+            vFrames.push_back(frame);
+    }
+    return true;
+}
+
+static double Percentile(vector<double> v, const double p)
+{
+    sort(v.begin(), v.end());
+    return v[min(v.size()-1, static_cast<size_t>(p*v.size()))];
+}
+
+int main(int argc, char **argv)
+{
+    const string strFile = argc > 1 ? argv[1] : "PoseFrames.txt";
+
+    vector<RecordedFrame, Eigen::aligned_allocator<RecordedFrame> > vFrames;
+    if(!ReadFrames(strFile, vFrames) || vFrames.empty())
+    {
+        printf("Usage: BenchPoseSolver [PoseFrames.txt]\n"
+               "Frames written by the system built with REGISTER_POSE_FRAMES (Optimizer.h), %s not read\n", strFile.c_str());
+        return 1;
+    }
+
+    size_t nObs = 0;
+    vector<double> vTimeSolver, vTimeG2o;
+    double maxTrans = 0, maxRot = 0;
+    int nOutlierDiffs = 0, nFrameDiffs = 0, nOutliers = 0;
+    for(size_t f=0; f<vFrames.size(); f++)
+    {
+        const RecordedFrame &frame = vFrames[f];
+        nObs += frame.vObs.size();
+
+        Sophus::SE3d TSolver, TG2o;
+        vector<bool> vbOutlierSolver(frame.vObs.size(), false), vbOutlierG2o(frame.vObs.size(), false);
+        const Clock::time_point t0 = Clock::now();
+        RunPoseSolver(frame.vObs, frame.calib, frame.Tcw0, TSolver, vbOutlierSolver);
+        const Clock::time_point t1 = Clock::now();
+        RunPoseG2o(frame.vObs, frame.calib, frame.Tcw0, TG2o, vbOutlierG2o);
+        const Clock::time_point t2 = Clock::now();
+
+        vTimeSolver.push_back(Milliseconds(t0, t1));
+        vTimeG2o.push_back(Milliseconds(t1, t2));
+
+        maxTrans = max(maxTrans, (TSolver.translation()-TG2o.translation()).norm());
+        maxRot = max(maxRot, Eigen::AngleAxisd(TSolver.rotationMatrix().transpose()*TG2o.rotationMatrix()).angle());
+
+        int nDiffs = 0;
+        for(size_t i=0; i<frame.vObs.size(); i++)
+        {
+            nDiffs += vbOutlierSolver[i] != vbOutlierG2o[i] ? 1 : 0;
+            nOutliers += vbOutlierG2o[i] ? 1 : 0;
+        }
+        nOutlierDiffs += nDiffs;
+        nFrameDiffs += nDiffs > 0 ? 1 : 0;
+    }
+
+    double tSolver_ms = 0, tG2o_ms = 0;
+    for(size_t f=0; f<vFrames.size(); f++)
+    {
+        tSolver_ms += vTimeSolver[f];
+        tG2o_ms += vTimeG2o[f];
+    }
+
+    printf("%zu recorded frames of %s, %.1f observations per frame, %d outliers (g2o)\n",
+           vFrames.size(), strFile.c_str(), static_cast<double>(nObs)/vFrames.size(), nOutliers);
+    printf("  PoseSolver  mean %.3f ms  median %.3f ms  p99 %.3f ms\n",
+           tSolver_ms/vFrames.size(), Percentile(vTimeSolver, 0.5), Percentile(vTimeSolver, 0.99));
+    printf("  g2o         mean %.3f ms  median %.3f ms  p99 %.3f ms\n",
+           tG2o_ms/vFrames.size(), Percentile(vTimeG2o, 0.5), Percentile(vTimeG2o, 0.99));
+    printf("  max pose difference %.2e m %.2e rad\n", maxTrans, maxRot);
+    printf("  outlier classification differs in %d observations of %d frames\n", nOutlierDiffs, nFrameDiffs);
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// Cost of the IMU preintegration at 1 kHz: integration of each sample and of a batch, replay after a
+// bias change (Reintegrate) and merge of two keyframe intervals with the same bias (MergePrevious, Append)
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "ImuTypes.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+static double Seconds(const chrono::steady_clock::time_point &t0)
+{
+    return chrono::duration_cast<chrono::duration<double> >(chrono::steady_clock::now()-t0).count();
+}
+
+int main()
+{
+    const IMU::Calib calib(Sophus::SE3f(), 1.7e-4f*1000.f, 2.0e-3f*1000.f, 1.9e-5f, 3.0e-3f);
+    const IMU::Bias bias(0.02f, -0.01f, 0.05f, 0.001f, -0.002f, 0.003f);
+    const IMU::Bias newBias(0.03f, -0.01f, 0.04f, 0.002f, -0.002f, 0.001f);
+
+    // 1 kHz, keyframes every 0.5 s
+    const int nKFSamples = 500;
+    const int nIntervals = 200;
+    mt19937 rng(38);
+    normal_distribution<float> noise(0.f, 0.05f);
+    vector<Eigen::Vector3f> vAcc(nKFSamples), vGyro(nKFSamples);
+    vector<float> vDt(nKFSamples, 0.001f);
+    for(int i=0; i<nKFSamples; i++)
+    {
+        const float t = 0.001f*i;
+        vAcc[i] = Eigen::Vector3f(0.3f*sin(t), 9.81f+0.2f*cos(2.f*t), 0.1f*sin(3.f*t)) + Eigen::Vector3f(noise(rng), noise(rng), noise(rng));
+        vGyro[i] = Eigen::Vector3f(0.1f*cos(t), 0.2f*sin(t), 0.05f) + Eigen::Vector3f(noise(rng), noise(rng), noise(rng));
+    }
+
+    float fSink = 0.f;
+    printf("IMU at 1 kHz, %d samples per keyframe interval, %d intervals\n", nKFSamples, nIntervals);
+
+    vector<IMU::Preintegrated*> vpPre(nIntervals);
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    for(int k=0; k<nIntervals; k++)
+    {
+        vpPre[k] = new IMU::Preintegrated(bias, calib);
+        for(int i=0; i<nKFSamples; i++)
+            vpPre[k]->IntegrateNewMeasurement(vAcc[i], vGyro[i], vDt[i]);
+        fSink += vpPre[k]->dP(0);
+    }
+    printf("  IntegrateNewMeasurement   %8.1f ns/sample\n", 1e9*Seconds(t0)/(nIntervals*nKFSamples));
+
+    t0 = chrono::steady_clock::now();
+    for(int k=0; k<nIntervals; k++)
+    {
+        IMU::Preintegrated pre(bias, calib);
+        pre.IntegrateNewMeasurements(vAcc, vGyro, vDt);
+        fSink += pre.dP(0);
+    }
+    printf("  IntegrateNewMeasurements  %8.1f ns/sample\n", 1e9*Seconds(t0)/(nIntervals*nKFSamples));
+
+    t0 = chrono::steady_clock::now();
+    for(int k=0; k<nIntervals; k++)
+    {
+        vpPre[k]->SetNewBias(newBias);
+        vpPre[k]->Reintegrate();
+        fSink += vpPre[k]->dP(0);
+    }
+    printf("  Reintegrate               %8.1f us/interval\n", 1e6*Seconds(t0)/nIntervals);
+
+    t0 = chrono::steady_clock::now();
+    for(int k=0; k+1<nIntervals; k+=2)
+    {
+        IMU::Preintegrated merged(vpPre[k+1]);
+        merged.MergePrevious(vpPre[k]);
+        fSink += merged.dP(0);
+    }
+    printf("  MergePrevious             %8.1f us/merge\n", 1e6*Seconds(t0)/(nIntervals/2));
+
+    t0 = chrono::steady_clock::now();
+    for(int k=0; k+1<nIntervals; k+=2)
+    {
+        IMU::Preintegrated appended(vpPre[k]);
+        appended.Append(vpPre[k+1]);
+        fSink += appended.dP(0);
+    }
+    printf("  Append                    %8.1f us/merge\n", 1e6*Seconds(t0)/(nIntervals/2));
+
+    for(int k=0; k<nIntervals; k++)
+        delete vpPre[k];
+    printf("  (checksum %f)\n", fSink);
+
+    return 0;
+}
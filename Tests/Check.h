@@ -0,0 +1,65 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <cmath>
+#include <iostream>
+
+// Checks of the unit tests. A failed check prints its location and the test goes on, main returns
+// TEST_RESULT() so that ctest sees the failure.
+
+namespace ORB_SLAM3
+{
+
+inline int& TestFailures()
+{
+    static int nFailures = 0;
+    return nFailures;
+}
+
+} //namespace ORB_SLAM3
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" << #cond << ") failed" << std::endl; \
+            ORB_SLAM3::TestFailures()++; \
+        } \
+    } while(0)
+
+#define CHECK_NEAR(a, b, tol) \
+    do { \
+        const double va = (a), vb = (b); \
+        if(!(std::fabs(va-vb) <= (tol))) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_NEAR(" << #a << ", " << #b << ") failed: " \
+                      << va << " vs " << vb << " (tolerance " << (tol) << ")" << std::endl; \
+            ORB_SLAM3::TestFailures()++; \
+        } \
+    } while(0)
+
+#define TEST_RESULT() (ORB_SLAM3::TestFailures() == 0 ? 0 : 1)
+
+// Exit code of a test without the data it needs (SKIP_RETURN_CODE of ctest)
+#define TEST_SKIPPED 77
+
+#endif // TESTS_CHECK_H
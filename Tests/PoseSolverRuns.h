@@ -0,0 +1,192 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TESTS_POSESOLVERRUNS_H
+#define TESTS_POSESOLVERRUNS_H
+
+#include <cmath>
+#include <vector>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_dense.h"
+
+#include "PoseSolver.h"
+#include "OptimizableTypes.h"
+
+// Motion-only optimization of Optimizer::PoseOptimization with PoseSolver and with the g2o graph it
+// replaced, shared by TestPoseSolverG2o (synthetic frames) and BenchPoseSolver (recorded frames).
+
+namespace ORB_SLAM3
+{
+
+// Observation of a frame, type as in PoseSolver
+struct PoseObservation
+{
+    Eigen::Vector3f Xw;
+    double u, v, ur;
+    float invSigma2;
+    int type;
+};
+
+// Cameras of the frame, pCamera2 is NULL without a rig
+struct PoseCalibration
+{
+    GeometricCamera* pCamera;
+    GeometricCamera* pCamera2;
+    Sophus::SE3d Trl;
+    float fx, fy, cx, cy, bf;
+};
+
+// Schedule of Optimizer::PoseOptimization
+inline int RunPoseSolver(const std::vector<PoseObservation> &vObs, const PoseCalibration &calib, const Sophus::SE3d &Tcw0,
+                         Sophus::SE3d &Tcw, std::vector<bool> &vbOutlier)
+{
+    static PoseSolver solver;
+    solver.Clear();
+    solver.SetCalibration(calib.pCamera, calib.fx, calib.fy, calib.cx, calib.cy, calib.bf);
+    if(calib.pCamera2)
+        solver.SetRightCamera(calib.pCamera2, calib.Trl.cast<float>());
+    solver.SetHuberDeltas(sqrt(5.991), sqrt(7.815));
+
+    for(size_t i=0; i<vObs.size(); i++)
+    {
+        const PoseObservation &obs = vObs[i];
+        if(obs.type == PoseSolver::MONOCULAR)
+            solver.AddMonocular(obs.Xw, obs.u, obs.v, obs.invSigma2, i);
+        else if(obs.type == PoseSolver::STEREO)
+            solver.AddStereo(obs.Xw, obs.u, obs.v, obs.ur, obs.invSigma2, i);
+        else
+            solver.AddMonocularRight(obs.Xw, obs.u, obs.v, obs.invSigma2, i);
+    }
+
+    int nBad = 0;
+    for(int it=0; it<4; it++)
+    {
+        Tcw = Tcw0;
+        solver.Optimize(Tcw, 10, it<3);
+        nBad = solver.ClassifyOutliers(Tcw, 5.991f, 7.815f, vbOutlier);
+
+        if(solver.Size()<10)
+            break;
+    }
+    return vObs.size()-nBad;
+}
+
+// Graph of Optimizer::PoseOptimization before PoseSolver
+inline int RunPoseG2o(const std::vector<PoseObservation> &vObs, const PoseCalibration &calib, const Sophus::SE3d &Tcw0,
+                      Sophus::SE3d &Tcw, std::vector<bool> &vbOutlier)
+{
+    g2o::SparseOptimizer optimizer;
+    g2o::BlockSolver_6_3::LinearSolverType * linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
+    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+
+    g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
+    vSE3->setId(0);
+    optimizer.addVertex(vSE3);
+
+    std::vector<g2o::OptimizableGraph::Edge*> vpEdges(vObs.size());
+    std::vector<double> vChi2Th(vObs.size());
+    for(size_t i=0; i<vObs.size(); i++)
+    {
+        const PoseObservation &obs = vObs[i];
+        g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+        if(obs.type == PoseSolver::STEREO)
+        {
+            g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
+            e->setVertex(0, vSE3);
+            e->setMeasurement(Eigen::Vector3d(obs.u, obs.v, obs.ur));
+            e->setInformation(Eigen::Matrix3d::Identity()*obs.invSigma2);
+            e->fx = calib.fx;
+            e->fy = calib.fy;
+            e->cx = calib.cx;
+            e->cy = calib.cy;
+            e->bf = calib.bf;
+            e->Xw = obs.Xw.cast<double>();
+            rk->setDelta(sqrt(7.815));
+            e->setRobustKernel(rk);
+            vpEdges[i] = e;
+            vChi2Th[i] = 7.815;
+        }
+        else if(obs.type == PoseSolver::MONOCULAR)
+        {
+            EdgeSE3ProjectXYZOnlyPose* e = new EdgeSE3ProjectXYZOnlyPose();
+            e->setVertex(0, vSE3);
+            e->setMeasurement(Eigen::Vector2d(obs.u, obs.v));
+            e->setInformation(Eigen::Matrix2d::Identity()*obs.invSigma2);
+            e->pCamera = calib.pCamera;
+            e->Xw = obs.Xw.cast<double>();
+            rk->setDelta(sqrt(5.991));
+            e->setRobustKernel(rk);
+            vpEdges[i] = e;
+            vChi2Th[i] = 5.991;
+        }
+        else
+        {
+            EdgeSE3ProjectXYZOnlyPoseToBody* e = new EdgeSE3ProjectXYZOnlyPoseToBody();
+            e->setVertex(0, vSE3);
+            e->setMeasurement(Eigen::Vector2d(obs.u, obs.v));
+            e->setInformation(Eigen::Matrix2d::Identity()*obs.invSigma2);
+            e->pCamera = calib.pCamera2;
+            e->Xw = obs.Xw.cast<double>();
+            e->mTrl = g2o::SE3Quat(calib.Trl.unit_quaternion(), calib.Trl.translation());
+            rk->setDelta(sqrt(5.991));
+            e->setRobustKernel(rk);
+            vpEdges[i] = e;
+            vChi2Th[i] = 5.991;
+        }
+        optimizer.addEdge(vpEdges[i]);
+    }
+
+    int nBad = 0;
+    for(int it=0; it<4; it++)
+    {
+        vSE3->setEstimate(g2o::SE3Quat(Tcw0.unit_quaternion(), Tcw0.translation()));
+        optimizer.initializeOptimization(0);
+        optimizer.optimize(10);
+
+        nBad = 0;
+        for(size_t i=0; i<vpEdges.size(); i++)
+        {
+            g2o::OptimizableGraph::Edge* e = vpEdges[i];
+            if(vbOutlier[i])
+                e->computeError();
+
+            vbOutlier[i] = e->chi2() > vChi2Th[i];
+            e->setLevel(vbOutlier[i] ? 1 : 0);
+            nBad += vbOutlier[i] ? 1 : 0;
+
+            if(it==2)
+                e->setRobustKernel(0);
+        }
+
+        if(optimizer.edges().size()<10)
+            break;
+    }
+
+    const g2o::SE3Quat SE3quat = vSE3->estimate();
+    Tcw = Sophus::SE3d(SE3quat.rotation(), SE3quat.translation());
+    return vObs.size()-nBad;
+}
+
+} //namespace ORB_SLAM3
+
+#endif // TESTS_POSESOLVERRUNS_H
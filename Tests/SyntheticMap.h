@@ -0,0 +1,231 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TESTS_SYNTHETICMAP_H
+#define TESTS_SYNTHETICMAP_H
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "Atlas.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "Map.h"
+#include "MapPoint.h"
+#include "ORBVocabulary.h"
+#include "CameraModels/Pinhole.h"
+
+// Atlas with keyframes and points but without images, for the tests of the modules that work on a
+// built map. The keyframes move along x, each one sees POINTS_PER_KEYFRAME points and shares
+// three quarters of them with the next one. The descriptors of a block of points are drawn around
+// one centre, so the keyframes have different BoW vectors in a small vocabulary trained on them.
+
+namespace ORB_SLAM3
+{
+
+struct SyntheticMap
+{
+    static const int POINTS_PER_KEYFRAME = 40;
+    static const int POINTS_PER_BLOCK = 10;
+    static const int DESCRIPTOR_SIZE = 32;
+
+    Atlas* pAtlas;
+    Map* pMap;
+    ORBVocabulary* pVoc;
+    KeyFrameDatabase* pKFDB;
+    GeometricCamera* pCamera;
+
+    std::vector<KeyFrame*> vpKeyFrames;
+    std::vector<MapPoint*> vpMapPoints;
+
+    // Position and descriptor of each point, also before it is created
+    std::vector<Eigen::Vector3f> vPositions;
+    std::vector<cv::Mat> vDescriptors;
+
+    SyntheticMap(const int nKeyFrames, const int nCentres, const unsigned int seed);
+    ~SyntheticMap();
+
+    // Frame without image with the keypoints and descriptors of the points vnPoints seen from Tcw
+    void MakeFrame(const Sophus::SE3f &Tcw, const std::vector<int> &vnPoints, Frame &F) const;
+};
+
+inline SyntheticMap::SyntheticMap(const int nKeyFrames, const int nCentres, const unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+    std::normal_distribution<float> noise(0.f, 0.01f);
+
+    const int nPoints = (nKeyFrames-1)*(POINTS_PER_KEYFRAME/4) + POINTS_PER_KEYFRAME;
+
+    std::vector<cv::Mat> vCentres(nCentres);
+    for(int c=0; c<nCentres; c++)
+    {
+        vCentres[c] = cv::Mat(1, DESCRIPTOR_SIZE, CV_32F);
+        for(int j=0; j<DESCRIPTOR_SIZE; j++)
+            vCentres[c].at<float>(j) = uniform(rng);
+    }
+
+    vPositions.resize(nPoints);
+    vDescriptors.resize(nPoints);
+    cv::Mat trainingDescriptors;
+    for(int p=0; p<nPoints; p++)
+    {
+        vPositions[p] = Eigen::Vector3f(0.05f*p - 1.f + uniform(rng), 2.f*uniform(rng) - 1.f, 3.f + 3.f*uniform(rng));
+        vDescriptors[p] = vCentres[(p/POINTS_PER_BLOCK) % nCentres].clone();
+        for(int j=0; j<DESCRIPTOR_SIZE; j++)
+            vDescriptors[p].at<float>(j) += noise(rng);
+        trainingDescriptors.push_back(vDescriptors[p]);
+    }
+
+    pVoc = new ORBVocabulary(6, 2);
+    pVoc->create(std::vector<cv::Mat>(1, trainingDescriptors));
+    pKFDB = new KeyFrameDatabase(*pVoc);
+
+    pAtlas = new Atlas(0);
+    pMap = pAtlas->GetCurrentMap();
+    pCamera = pAtlas->AddCamera(new Pinhole(std::vector<float>{450.f, 450.f, 320.f, 240.f}));
+
+    vpMapPoints.resize(nPoints, static_cast<MapPoint*>(NULL));
+    for(int k=0; k<nKeyFrames; k++)
+    {
+        const Sophus::SE3f Tcw(Eigen::Matrix3f::Identity(), Eigen::Vector3f(-0.5f*k, 0.f, 0.f));
+        std::vector<int> vnPoints;
+        for(int p=k*(POINTS_PER_KEYFRAME/4); p<k*(POINTS_PER_KEYFRAME/4)+POINTS_PER_KEYFRAME; p++)
+            vnPoints.push_back(p);
+
+        Frame F;
+        MakeFrame(Tcw, vnPoints, F);
+        F.mnId = k;
+        F.mTimeStamp = k;
+        F.ComputeBoW();
+
+        KeyFrame* pKF = new KeyFrame(F, pMap, pKFDB);
+        pAtlas->AddKeyFrame(pKF);
+
+        for(size_t i=0; i<vnPoints.size(); i++)
+        {
+            const int p = vnPoints[i];
+            if(!vpMapPoints[p])
+            {
+                vpMapPoints[p] = new MapPoint(vPositions[p], pKF, pMap);
+                pAtlas->AddMapPoint(vpMapPoints[p]);
+            }
+            vpMapPoints[p]->AddObservation(pKF, i);
+            pKF->AddMapPoint(vpMapPoints[p], i);
+        }
+        vpKeyFrames.push_back(pKF);
+    }
+
+    for(MapPoint* pMP : vpMapPoints)
+    {
+        pMP->ComputeDistinctiveDescriptors();
+        pMP->UpdateNormalAndDepth();
+    }
+
+    for(KeyFrame* pKF : vpKeyFrames)
+    {
+        pKF->UpdateConnections();
+        pKFDB->add(pKF);
+    }
+}
+
+inline SyntheticMap::~SyntheticMap()
+{
+    // The maps do not delete their keyframes and points (Map::~Map), they are left to the end of the test
+    delete pAtlas;
+    delete pKFDB;
+    delete pVoc;
+}
+
+inline void SyntheticMap::MakeFrame(const Sophus::SE3f &Tcw, const std::vector<int> &vnPoints, Frame &F) const
+{
+    F.mpORBvocabulary = pVoc;
+    F.mpCamera = pCamera;
+    F.mpCamera2 = static_cast<GeometricCamera*>(NULL);
+    F.Nleft = -1;
+    F.Nright = -1;
+    F.mnId = 0;
+    F.mTimeStamp = 0;
+    F.mnDataset = 0;
+
+    F.fx = pCamera->getParameter(0);
+    F.fy = pCamera->getParameter(1);
+    F.cx = pCamera->getParameter(2);
+    F.cy = pCamera->getParameter(3);
+    F.invfx = 1.f/F.fx;
+    F.invfy = 1.f/F.fy;
+    F.mK_ = pCamera->toK_();
+    F.mDistCoef = cv::Mat::zeros(4, 1, CV_32F);
+    F.mbf = 0.f;
+    F.mb = 0.f;
+    F.mThDepth = 0.f;
+
+    F.mnMinX = 0.f;
+    F.mnMaxX = 640.f;
+    F.mnMinY = 0.f;
+    F.mnMaxY = 480.f;
+    F.mfGridElementWidthInv = FRAME_GRID_COLS/(F.mnMaxX-F.mnMinX);
+    F.mfGridElementHeightInv = FRAME_GRID_ROWS/(F.mnMaxY-F.mnMinY);
+
+    F.mnScaleLevels = 8;
+    F.mfScaleFactor = 1.2f;
+    F.mfLogScaleFactor = std::log(F.mfScaleFactor);
+    F.mvScaleFactors.resize(F.mnScaleLevels);
+    F.mvInvScaleFactors.resize(F.mnScaleLevels);
+    F.mvLevelSigma2.resize(F.mnScaleLevels);
+    F.mvInvLevelSigma2.resize(F.mnScaleLevels);
+    for(int l=0; l<F.mnScaleLevels; l++)
+    {
+        F.mvScaleFactors[l] = std::pow(F.mfScaleFactor, l);
+        F.mvInvScaleFactors[l] = 1.f/F.mvScaleFactors[l];
+        F.mvLevelSigma2[l] = F.mvScaleFactors[l]*F.mvScaleFactors[l];
+        F.mvInvLevelSigma2[l] = 1.f/F.mvLevelSigma2[l];
+    }
+
+    const int N = vnPoints.size();
+    F.N = N;
+    F.mvKeysUn.resize(N);
+    F.mvuRight.assign(N, -1.f);
+    F.mvDepth.assign(N, -1.f);
+    F.mvpMapPoints.assign(N, static_cast<MapPoint*>(NULL));
+    F.mvbOutlier.assign(N, false);
+    F.mDescriptors = cv::Mat(N, DESCRIPTOR_SIZE, CV_32F);
+    for(int i=0; i<N; i++)
+    {
+        const int p = vnPoints[i];
+        const Eigen::Vector3f Xc = Tcw*vPositions[p];
+        const Eigen::Vector2f uv = Xc[2] > 0.f ? pCamera->project(Xc) : Eigen::Vector2f(-1.f, -1.f);
+        F.mvKeysUn[i] = cv::KeyPoint(uv[0], uv[1], 31.f, -1.f, 0.f, 0);
+        vDescriptors[p].copyTo(F.mDescriptors.row(i));
+
+        const int posX = std::round((uv[0]-F.mnMinX)*F.mfGridElementWidthInv);
+        const int posY = std::round((uv[1]-F.mnMinY)*F.mfGridElementHeightInv);
+        if(posX >= 0 && posX < FRAME_GRID_COLS && posY >= 0 && posY < FRAME_GRID_ROWS)
+            F.mGrid[posX][posY].push_back(i);
+    }
+    F.mvKeys = F.mvKeysUn;
+
+    F.SetPose(Tcw);
+}
+
+} //namespace ORB_SLAM3
+
+#endif // TESTS_SYNTHETICMAP_H
@@ -0,0 +1,145 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// Two atlases with their own checkpointers in the same process: the checkpoints of one must not hide
+// the changes of the other from its next checkpoint (the change epochs are per map).
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <opencv2/core/core.hpp>
+
+#include "Atlas.h"
+#include "AtlasCheckpointer.h"
+#include "AtlasFile.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "ORBextractor.h"
+#include "CameraModels/Pinhole.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+static size_t FileSize(const string &strFile)
+{
+    ifstream f(strFile.c_str(), ios::binary | ios::ate);
+    return f ? static_cast<size_t>(f.tellg()) : 0;
+}
+
+// Map with one keyframe of a random image and points on some of its features
+static MapPoint* BuildMap(Atlas &atlas, ORBextractor* pExtractor, const int seed)
+{
+    vector<float> vCamParams = {458.654f, 457.296f, 367.215f, 248.375f};
+    GeometricCamera* pCam = atlas.AddCamera(new Pinhole(vCamParams));
+
+    cv::Mat im(480, 752, CV_8U);
+    cv::theRNG().state = seed;
+    cv::randu(im, cv::Scalar(0), cv::Scalar(255));
+    cv::Mat distCoef = cv::Mat::zeros(4, 1, CV_32F);
+
+    Frame F(im, 0.0, pExtractor, static_cast<ORBVocabulary*>(NULL), pCam, distCoef, 0.f, 0.f);
+    F.SetPose(Sophus::SE3f());
+
+    Map* pMap = atlas.GetCurrentMap();
+    KeyFrame* pKF = new KeyFrame(F, pMap, static_cast<KeyFrameDatabase*>(NULL));
+    pMap->AddKeyFrame(pKF);
+    pMap->mvpKeyFrameOrigins.push_back(pKF);
+
+    MapPoint* pFirst = static_cast<MapPoint*>(NULL);
+    for(int i=0; i<min(F.N, 50); i++)
+    {
+        MapPoint* pMP = new MapPoint(Eigen::Vector3f(0.01f*i, -0.01f*i, 5.f), pKF, pMap);
+        pMP->AddObservation(pKF, i);
+        pKF->AddMapPoint(pMP, i);
+        pMap->AddMapPoint(pMP);
+        if(!pFirst)
+            pFirst = pMP;
+    }
+    return pFirst;
+}
+
+int main()
+{
+    char tmpl[] = "/tmp/orbslam3_checkpointer_XXXXXX";
+    if(!mkdtemp(tmpl))
+    {
+        cerr << "Unable to create a temporary folder" << endl;
+        return 1;
+    }
+    const string strDir(tmpl);
+    const string strFileA = strDir + "/a.osa", strFileB = strDir + "/b.osa";
+    const string strJournalA = AtlasCheckpointer::JournalFile(strFileA);
+
+    ORBextractor extractor(500, 1.2f, 8, 20, 7);
+    Atlas atlasA(0), atlasB(0);
+    MapPoint* pMPA = BuildMap(atlasA, &extractor, 1);
+    MapPoint* pMPB = BuildMap(atlasB, &extractor, 2);
+    CHECK(pMPA != NULL && pMPB != NULL);
+    if(!pMPA || !pMPB)
+        return 1;
+
+    AtlasCheckpointer checkpointerA(&atlasA, strFileA, 1.0, "ORBvoc.txt", "checksum", static_cast<TaskScheduler*>(NULL), false);
+    AtlasCheckpointer checkpointerB(&atlasB, strFileB, 1.0, "ORBvoc.txt", "checksum", static_cast<TaskScheduler*>(NULL), false);
+
+    // Everything
+    CHECK(checkpointerA.Checkpoint());
+    CHECK(checkpointerB.Checkpoint());
+
+    // Nothing changed: only the map headers and the atlas section
+    size_t nSize = FileSize(strJournalA);
+    CHECK(checkpointerA.Checkpoint());
+    const size_t nEmptyRecord = FileSize(strJournalA) - nSize;
+
+    // A point of A changes, then B checkpoints twice before A does
+    pMPA->SetWorldPos(Eigen::Vector3f(1.f, 2.f, 6.f));
+    pMPB->SetWorldPos(Eigen::Vector3f(1.f, 2.f, 6.f));
+    CHECK(checkpointerB.Checkpoint());
+    CHECK(checkpointerB.Checkpoint());
+
+    nSize = FileSize(strJournalA);
+    CHECK(checkpointerA.Checkpoint());
+    const size_t nChangedRecord = FileSize(strJournalA) - nSize;
+    // Records start aligned, their size in the file changes with the padding before them
+    const size_t nAlign = AtlasFile::SECTION_ALIGNMENT;
+    CHECK(nChangedRecord > nEmptyRecord + nAlign);
+
+    // And only once
+    nSize = FileSize(strJournalA);
+    CHECK(checkpointerA.Checkpoint());
+    CHECK(FileSize(strJournalA) - nSize < nEmptyRecord + nAlign);
+
+    // The checkpoint of A is loaded
+    string strVocName, strVocChecksum;
+    Atlas* pLoaded = AtlasCheckpointer::Load(strFileA, strVocName, strVocChecksum);
+    CHECK(pLoaded != NULL);
+    CHECK(strVocChecksum == "checksum");
+    delete pLoaded;
+
+    const string vstrFiles[] = {strFileA, strJournalA, strFileB, AtlasCheckpointer::JournalFile(strFileB)};
+    for(const string &s : vstrFiles)
+        remove(s.c_str());
+    rmdir(strDir.c_str());
+
+    return TEST_RESULT();
+}
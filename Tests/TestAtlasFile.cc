@@ -0,0 +1,156 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// Round trip of the chunked atlas format and replay of a checkpoint journal whose last record was cut
+// by a crash. The maps need keyframes to be saved, so the records carry the atlas section only
+// (vocabulary, cameras and id counters), which is enough to tell them apart.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Atlas.h"
+#include "AtlasFile.h"
+#include "CameraModels/Pinhole.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+static size_t FileSize(const string &strFile)
+{
+    ifstream f(strFile.c_str(), ios::binary | ios::ate);
+    return f ? static_cast<size_t>(f.tellg()) : 0;
+}
+
+// Vocabulary checksum of the atlas loaded from the journal, "" if nothing could be loaded
+static string LoadJournal(const string &strJournal)
+{
+    vector<string> vstrJournals(1, strJournal);
+    string strVocName, strVocChecksum;
+    Atlas* pAtlas = AtlasFile::LoadCheckpoint(strJournal + ".missing", vstrJournals, strVocName, strVocChecksum);
+    if(!pAtlas)
+        return string();
+    CHECK(strVocName == "ORBvoc.txt");
+    CHECK(pAtlas->GetAllCameras().size() == 1);
+    delete pAtlas;
+    return strVocChecksum;
+}
+
+int main()
+{
+    char tmpl[] = "/tmp/orbslam3_atlasfile_XXXXXX";
+    if(!mkdtemp(tmpl))
+    {
+        cerr << "Unable to create a temporary folder" << endl;
+        return 1;
+    }
+    const string strDir(tmpl);
+
+    Atlas atlas;
+    vector<float> vCamParams = {458.654f, 457.296f, 367.215f, 248.375f};
+    GeometricCamera* pCam = atlas.AddCamera(new Pinhole(vCamParams));
+    atlas.SetNextFrameId(1234);
+
+    // Save and load
+    const string strFile = strDir + "/atlas.osa";
+    CHECK(AtlasFile::Save(strFile, &atlas, "ORBvoc.txt", "checksum0"));
+    CHECK(AtlasFile::IsAtlasFile(strFile));
+    {
+        string strVocName, strVocChecksum;
+        Atlas* pLoaded = AtlasFile::Load(strFile, strVocName, strVocChecksum);
+        CHECK(pLoaded != NULL);
+        if(pLoaded)
+        {
+            CHECK(strVocName == "ORBvoc.txt");
+            CHECK(strVocChecksum == "checksum0");
+            CHECK(pLoaded->GetNextFrameId() >= 1234);
+            vector<GeometricCamera*> vpCams = pLoaded->GetAllCameras();
+            CHECK(vpCams.size() == 1);
+            if(vpCams.size() == 1)
+            {
+                CHECK(vpCams[0]->GetType() == GeometricCamera::CAM_PINHOLE);
+                CHECK(vpCams[0]->GetId() == pCam->GetId());
+                CHECK(vpCams[0]->size() == vCamParams.size());
+                for(size_t i=0; i<vCamParams.size(); i++)
+                    CHECK(vpCams[0]->getParameter(i) == vCamParams[i]);
+            }
+            delete pLoaded;
+        }
+    }
+
+    // A file without the magic is not loaded
+    const string strBad = strDir + "/bad.osa";
+    {
+        ofstream f(strBad.c_str(), ios::binary);
+        f << "not an atlas file";
+    }
+    CHECK(!AtlasFile::IsAtlasFile(strBad));
+    {
+        string strVocName, strVocChecksum;
+        CHECK(AtlasFile::Load(strBad, strVocName, strVocChecksum) == NULL);
+    }
+
+    // Journal with three records, the last one is cut
+    const string strJournal = strDir + "/atlas.osj";
+    vector<AtlasFile::MapDelta> vDeltas;
+    const vector<uint64_t> vnErasedMaps;
+    CHECK(AtlasFile::AppendCheckpoint(strJournal, &atlas, vDeltas, vnErasedMaps, "ORBvoc.txt", "checksum1"));
+    const size_t nFirst = FileSize(strJournal);
+    CHECK(AtlasFile::AppendCheckpoint(strJournal, &atlas, vDeltas, vnErasedMaps, "ORBvoc.txt", "checksum2"));
+    const size_t nSecond = FileSize(strJournal);
+    CHECK(AtlasFile::AppendCheckpoint(strJournal, &atlas, vDeltas, vnErasedMaps, "ORBvoc.txt", "checksum3"));
+    const size_t nThird = FileSize(strJournal);
+    CHECK(nFirst > 0 && nSecond > nFirst && nThird > nSecond);
+
+    CHECK(LoadJournal(strJournal) == "checksum3");
+
+    // The base file is compacted with the journal
+    const string strCompacted = strDir + "/compacted.osa";
+    vector<string> vstrJournals(1, strJournal);
+    CHECK(AtlasFile::Compact(strFile, vstrJournals, strCompacted));
+    {
+        string strVocName, strVocChecksum;
+        Atlas* pLoaded = AtlasFile::Load(strCompacted, strVocName, strVocChecksum);
+        CHECK(pLoaded != NULL);
+        CHECK(strVocChecksum == "checksum3");
+        delete pLoaded;
+    }
+
+    // Crash while the third record was written: the first two are replayed
+    CHECK(truncate(strJournal.c_str(), (nSecond+nThird)/2) == 0);
+    CHECK(LoadJournal(strJournal) == "checksum2");
+
+    // Only the header of the second record was left
+    CHECK(truncate(strJournal.c_str(), nFirst + 8) == 0);
+    CHECK(LoadJournal(strJournal) == "checksum1");
+
+    // Nothing complete
+    CHECK(truncate(strJournal.c_str(), nFirst/2) == 0);
+    CHECK(LoadJournal(strJournal).empty());
+
+    const string vstrFiles[] = {strFile, strBad, strJournal, strCompacted};
+    for(const string &s : vstrFiles)
+        remove(s.c_str());
+    rmdir(strDir.c_str());
+
+    return TEST_RESULT();
+}
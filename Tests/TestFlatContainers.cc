@@ -0,0 +1,241 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// SmallVector, FlatMap and FlatSet against the standard containers
+
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "FlatContainers.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+// Counts the live objects, so that a missing or double destruction shows up
+struct Counted
+{
+    static int nAlive;
+    int value;
+    std::string payload;
+
+    Counted(int v = 0): value(v), payload(to_string(v)) { nAlive++; }
+    Counted(const Counted &other): value(other.value), payload(other.payload) { nAlive++; }
+    Counted(Counted &&other): value(other.value), payload(std::move(other.payload)) { nAlive++; }
+    ~Counted() { nAlive--; }
+    Counted& operator=(const Counted &other) { value = other.value; payload = other.payload; return *this; }
+    Counted& operator=(Counted &&other) { value = other.value; payload = std::move(other.payload); return *this; }
+};
+
+int Counted::nAlive = 0;
+
+template<size_t N>
+static bool Equal(const SmallVector<Counted,N> &v, const vector<int> &ref)
+{
+    if(v.size() != ref.size())
+        return false;
+    for(size_t i=0; i<ref.size(); i++)
+        if(v[i].value != ref[i] || v[i].payload != to_string(ref[i]))
+            return false;
+    return true;
+}
+
+static void TestSmallVector()
+{
+    {
+        SmallVector<Counted,4> v;
+        vector<int> ref;
+
+        // Inline while the size is at most N
+        for(int i=0; i<4; i++)
+        {
+            v.push_back(Counted(i));
+            ref.push_back(i);
+        }
+        CHECK(v.capacity() == 4);
+        CHECK(Equal(v, ref));
+
+        // Moved to the heap
+        v.push_back(Counted(4));
+        ref.push_back(4);
+        CHECK(v.capacity() > 4);
+        CHECK(Equal(v, ref));
+
+        // Element of the vector itself pushed when it grows
+        SmallVector<Counted,2> w;
+        w.push_back(Counted(7));
+        w.push_back(Counted(8));
+        w.push_back(w[0]);
+        CHECK(w.size() == 3 && w[2].value == 7 && w[2].payload == "7");
+
+        v.insert(v.begin()+2, Counted(10));
+        ref.insert(ref.begin()+2, 10);
+        CHECK(Equal(v, ref));
+
+        v.erase(v.begin()+1, v.begin()+3);
+        ref.erase(ref.begin()+1, ref.begin()+3);
+        CHECK(Equal(v, ref));
+
+        // Copy and move, inline and on the heap
+        SmallVector<Counted,4> copy(v);
+        CHECK(Equal(copy, ref));
+        SmallVector<Counted,4> moved(std::move(copy));
+        CHECK(Equal(moved, ref));
+        CHECK(copy.size() == 0);
+
+        SmallVector<Counted,4> small;
+        small.push_back(Counted(1));
+        SmallVector<Counted,4> movedSmall(std::move(small));
+        CHECK(movedSmall.size() == 1 && movedSmall[0].value == 1);
+
+        moved = movedSmall;
+        CHECK(moved.size() == 1 && moved[0].value == 1);
+        moved = std::move(v);
+        CHECK(Equal(moved, ref));
+    }
+    CHECK(Counted::nAlive == 0);
+
+    // Random operations against std::vector
+    {
+        mt19937 rng(1);
+        SmallVector<Counted,3> v;
+        vector<int> ref;
+        for(int it=0; it<20000; it++)
+        {
+            const int op = uniform_int_distribution<int>(0,3)(rng);
+            const int value = uniform_int_distribution<int>(0,1000)(rng);
+            if(op == 0 || ref.empty())
+            {
+                v.push_back(Counted(value));
+                ref.push_back(value);
+            }
+            else if(op == 1)
+            {
+                const int idx = uniform_int_distribution<int>(0,ref.size())(rng);
+                v.insert(v.begin()+idx, Counted(value));
+                ref.insert(ref.begin()+idx, value);
+            }
+            else if(op == 2)
+            {
+                const int idx = uniform_int_distribution<int>(0,ref.size()-1)(rng);
+                v.erase(v.begin()+idx);
+                ref.erase(ref.begin()+idx);
+            }
+            else
+            {
+                v.pop_back();
+                ref.pop_back();
+            }
+            if(ref.size() > 40)
+            {
+                v.clear();
+                ref.clear();
+            }
+            if(!Equal(v, ref))
+            {
+                CHECK(Equal(v, ref));
+                break;
+            }
+        }
+    }
+    CHECK(Counted::nAlive == 0);
+}
+
+static void TestFlatMap()
+{
+    mt19937 rng(2);
+    FlatMap<int,int,4> m;
+    map<int,int> ref;
+    for(int it=0; it<20000; it++)
+    {
+        const int key = uniform_int_distribution<int>(0,50)(rng);
+        const int op = uniform_int_distribution<int>(0,3)(rng);
+        if(op == 0)
+        {
+            m[key] = it;
+            ref[key] = it;
+        }
+        else if(op == 1)
+        {
+            const bool bInserted = m.insert(make_pair(key, it)).second;
+            CHECK(bInserted == ref.insert(make_pair(key, it)).second);
+        }
+        else if(op == 2)
+        {
+            CHECK(m.erase(key) == ref.erase(key));
+        }
+        else
+        {
+            CHECK(m.count(key) == ref.count(key));
+            FlatMap<int,int,4>::const_iterator itm = static_cast<const FlatMap<int,int,4>&>(m).find(key);
+            if(itm != m.end())
+                CHECK(itm->second == ref[key]);
+        }
+
+        // Same elements, ordered by key
+        bool bEqual = m.size() == ref.size();
+        map<int,int>::const_iterator itRef = ref.begin();
+        for(FlatMap<int,int,4>::const_iterator itm = m.begin(); bEqual && itm != m.end(); ++itm, ++itRef)
+            bEqual = itm->first == itRef->first && itm->second == itRef->second;
+        if(!bEqual)
+        {
+            CHECK(bEqual);
+            break;
+        }
+    }
+
+    // Erase by iterator
+    FlatMap<int,int,4> m2;
+    for(int i=0; i<10; i++)
+        m2[i] = i;
+    m2.erase(m2.find(3));
+    CHECK(m2.size() == 9 && m2.count(3) == 0 && m2.count(4) == 1);
+}
+
+static void TestFlatSet()
+{
+    mt19937 rng(3);
+    FlatSet<int,4> s;
+    set<int> ref;
+    for(int it=0; it<20000; it++)
+    {
+        const int key = uniform_int_distribution<int>(0,50)(rng);
+        if(uniform_int_distribution<int>(0,1)(rng))
+            CHECK(s.insert(key).second == ref.insert(key).second);
+        else
+            CHECK(s.erase(key) == ref.erase(key));
+    }
+    CHECK(vector<int>(s.begin(), s.end()) == vector<int>(ref.begin(), ref.end()));
+
+    const int values[] = {5, 1, 5, 3};
+    FlatSet<int,2> fromRange(values, values+4);
+    CHECK(fromRange.size() == 3 && *fromRange.begin() == 1);
+}
+
+int main()
+{
+    TestSmallVector();
+    TestFlatMap();
+    TestFlatSet();
+    return TEST_RESULT();
+}
@@ -0,0 +1,136 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// Saved inverted file of KeyFrameDatabase: EncodeInvertedFile and PostLoad give back the posting lists
+// of add(), a data that is not valid is built again with add() without leaving a partial index, and the
+// keyframes without words in the data are added.
+// The posting lists are compared through their encoding, the ids of each word sorted.
+
+#include <string>
+#include <vector>
+
+#include "SyntheticMap.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+static string EncodeAdded(const ORBVocabulary &voc, const vector<KeyFrame*> &vpKFs)
+{
+    KeyFrameDatabase database(voc);
+    for(KeyFrame* pKF : vpKFs)
+        database.add(pKF);
+
+    string strData;
+    database.EncodeInvertedFile(strData);
+    return strData;
+}
+
+static string EncodePostLoaded(const ORBVocabulary &voc, const vector<KeyFrame*> &vpKFs, const string &strInvertedFile)
+{
+    KeyFrameDatabase database(voc);
+    database.PostLoad(vpKFs, strInvertedFile);
+
+    string strData;
+    database.EncodeInvertedFile(strData);
+    return strData;
+}
+
+static string Varint(unsigned long value)
+{
+    string strData;
+    while(value >= 0x80)
+    {
+        strData.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    strData.push_back(static_cast<char>(value));
+    return strData;
+}
+
+// The data without its first value, the vocabulary size
+static string SkipVocabularySize(const string &strData)
+{
+    size_t i = 0;
+    while(i < strData.size() && (static_cast<unsigned char>(strData[i]) & 0x80))
+        i++;
+    return strData.substr(i+1);
+}
+
+static void TestRoundTrip(SyntheticMap &map)
+{
+    string strData;
+    map.pKFDB->EncodeInvertedFile(strData);
+    CHECK(strData == EncodeAdded(*map.pVoc, map.vpKeyFrames));
+    CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, strData) == strData);
+
+    // Not the data of an empty index
+    CHECK(strData != EncodeAdded(*map.pVoc, vector<KeyFrame*>()));
+
+    // Keyframes of the data that are not loaded are skipped
+    const vector<KeyFrame*> vpLoaded(map.vpKeyFrames.begin(), map.vpKeyFrames.begin()+10);
+    CHECK(EncodePostLoaded(*map.pVoc, vpLoaded, strData) == EncodeAdded(*map.pVoc, vpLoaded));
+}
+
+// Keyframes created after the data was written are added
+static void TestMissingKeyFrames(SyntheticMap &map)
+{
+    const vector<KeyFrame*> vpSaved(map.vpKeyFrames.begin(), map.vpKeyFrames.begin()+12);
+    const string strData = EncodeAdded(*map.pVoc, vpSaved);
+    const string strExpected = EncodeAdded(*map.pVoc, map.vpKeyFrames);
+    CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, strData) == strExpected);
+
+    // Also without any keyframe in the data
+    CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, EncodeAdded(*map.pVoc, vector<KeyFrame*>())) == strExpected);
+}
+
+// Not valid data: the index is the one of add(), with each keyframe once in its words
+static void TestFallback(SyntheticMap &map)
+{
+    string strData;
+    map.pKFDB->EncodeInvertedFile(strData);
+    const string strExpected = EncodeAdded(*map.pVoc, map.vpKeyFrames);
+
+    // Every truncation, also the empty data
+    for(size_t n=0; n<strData.size(); n++)
+        CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, strData.substr(0, n)) == strExpected);
+
+    // Garbage
+    CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, string(16, '\xff')) == strExpected);
+    CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, "garbage data") == strExpected);
+
+    // Written with another vocabulary
+    const string strBody = SkipVocabularySize(strData);
+    CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, Varint(map.pVoc->size()+1) + strBody) == strExpected);
+    CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, Varint(map.pVoc->size()-1) + strBody) == strExpected);
+
+    // Word out of the vocabulary after valid keyframes
+    string strWord = Varint(map.pVoc->size()) + Varint(1) + Varint(map.vpKeyFrames[0]->mnId);
+    strWord += Varint(1) + Varint(map.pVoc->size()) + Varint(1) + Varint(map.vpKeyFrames[0]->mnId);
+    CHECK(EncodePostLoaded(*map.pVoc, map.vpKeyFrames, strWord) == strExpected);
+}
+
+int main()
+{
+    SyntheticMap map(20, 12, 44);
+
+    TestRoundTrip(map);
+    TestMissingKeyFrames(map);
+    TestFallback(map);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,134 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// g2o::LinearSolverPCG on a sparse block system with the structure of a pose graph, against a dense
+// Cholesky factorization
+
+#include <random>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "Thirdparty/g2o/g2o/core/sparse_block_matrix.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_pcg.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+typedef Eigen::Matrix<double,6,6> Matrix6d;
+
+int main()
+{
+    // Chain of 60 poses with loop edges, each edge adds J'J to the blocks of its two poses
+    const int nPoses = 60;
+    mt19937 rng(8);
+    uniform_int_distribution<int> randomPose(0, nPoses-1);
+
+    vector<pair<int,int> > vEdges;
+    for(int i=0; i+1<nPoses; i++)
+        vEdges.push_back(make_pair(i, i+1));
+    for(int i=0; i<20; i++)
+    {
+        const int a = randomPose(rng), b = randomPose(rng);
+        if(a != b)
+            vEdges.push_back(make_pair(min(a,b), max(a,b)));
+    }
+
+    Eigen::MatrixXd dense = Eigen::MatrixXd::Zero(6*nPoses, 6*nPoses);
+    for(size_t e=0; e<vEdges.size(); e++)
+    {
+        const Matrix6d Ja = Matrix6d::Random(), Jb = Matrix6d::Random();
+        const int a = vEdges[e].first, b = vEdges[e].second;
+        dense.block<6,6>(6*a,6*a) += Ja.transpose()*Ja;
+        dense.block<6,6>(6*b,6*b) += Jb.transpose()*Jb;
+        dense.block<6,6>(6*a,6*b) += Ja.transpose()*Jb;
+        dense.block<6,6>(6*b,6*a) += Jb.transpose()*Ja;
+    }
+    // Gauge fixed by a prior on the first pose
+    dense.block<6,6>(0,0) += Matrix6d::Identity();
+
+    vector<int> vBlockIndices(nPoses);
+    for(int i=0; i<nPoses; i++)
+        vBlockIndices[i] = 6*(i+1);
+
+    // Upper triangle, as the block solvers of g2o give it
+    g2o::SparseBlockMatrix<Matrix6d> A(&vBlockIndices[0], &vBlockIndices[0], nPoses, nPoses);
+    for(int c=0; c<nPoses; c++)
+        for(int r=0; r<=c; r++)
+        {
+            const Matrix6d block = dense.block<6,6>(6*r,6*c);
+            if(r == c || !block.isZero())
+                *A.block(r, c, true) = block;
+        }
+
+    const Eigen::VectorXd b = Eigen::VectorXd::Random(6*nPoses);
+    const Eigen::VectorXd xRef = dense.ldlt().solve(b);
+
+    // Exact mode
+    {
+        g2o::LinearSolverPCG<Matrix6d> solver;
+        solver.init();
+        solver.setTolerance(1e-10);
+        Eigen::VectorXd x(6*nPoses);
+        Eigen::VectorXd rhs = b;
+        CHECK(solver.solve(A, x.data(), rhs.data()));
+        CHECK(solver.iterations() > 0 && solver.iterations() <= 6*nPoses);
+        CHECK((dense*x-b).norm() <= 1e-8*b.norm());
+        CHECK((x-xRef).norm() <= 1e-6*xRef.norm());
+    }
+
+    // Inexact mode: the residual is reduced by the forcing term min(0.1, sqrt(|b|)) only
+    {
+        g2o::LinearSolverPCG<Matrix6d> solver;
+        solver.init();
+        solver.setInexact(true);
+        Eigen::VectorXd x(6*nPoses);
+        Eigen::VectorXd rhs = b;
+        CHECK(solver.solve(A, x.data(), rhs.data()));
+        CHECK(solver.residual() <= 0.1);
+        CHECK_NEAR((dense*x-b).norm()/b.norm(), solver.residual(), 1e-9);
+        // A descent direction of the quadratic, as Levenberg-Marquardt needs
+        CHECK(x.dot(b) > 0.0);
+    }
+
+    // Zero right hand side
+    {
+        g2o::LinearSolverPCG<Matrix6d> solver;
+        solver.init();
+        Eigen::VectorXd x = Eigen::VectorXd::Ones(6*nPoses);
+        Eigen::VectorXd rhs = Eigen::VectorXd::Zero(6*nPoses);
+        CHECK(solver.solve(A, x.data(), rhs.data()));
+        CHECK(x.isZero());
+    }
+
+    // A missing diagonal block is rejected
+    {
+        g2o::SparseBlockMatrix<Matrix6d> B(&vBlockIndices[0], &vBlockIndices[0], 2, 2);
+        *B.block(0, 0, true) = Matrix6d::Identity();
+        *B.block(0, 1, true) = Matrix6d::Identity()*0.1;
+        g2o::LinearSolverPCG<Matrix6d> solver;
+        solver.init();
+        Eigen::VectorXd x(12);
+        Eigen::VectorXd rhs = Eigen::VectorXd::Ones(12);
+        CHECK(!solver.solve(B, x.data(), rhs.data()));
+    }
+
+    return TEST_RESULT();
+}
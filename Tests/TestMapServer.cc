@@ -0,0 +1,273 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// Map server on a synthetic atlas, through LocalMapTransport and through its socket: replies to the
+// maps, relocalization and local map requests, records sent once per session, error reply to the
+// malformed requests.
+
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include "MapServer.h"
+#include "SyntheticMap.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+static string EncodeLocalMapRequest(const vector<unsigned long> &vnKFIds, const int nCovisibles)
+{
+    ostringstream os(ios::binary);
+    {
+        boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+        oa << vnKFIds;
+        oa << nCovisibles;
+    }
+    return os.str();
+}
+
+struct LocalMapReply
+{
+    vector<unsigned long> vnLocalKFs, vnLocalMPs;
+    vector<KeyFrameRecord> vKeyFrames;
+    vector<MapPointRecord> vMapPoints;
+};
+
+static bool RequestLocalMap(MapServer &server, MapServer::Session &session, const vector<unsigned long> &vnKFIds,
+                            const int nCovisibles, LocalMapReply &reply)
+{
+    string strReply;
+    if(!server.HandleRequest(session, MapServer::LOCAL_MAP_REQUEST, EncodeLocalMapRequest(vnKFIds, nCovisibles), strReply))
+        return false;
+
+    istringstream is(strReply, ios::binary);
+    boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+    ia >> reply.vnLocalKFs;
+    ia >> reply.vnLocalMPs;
+    ia >> reply.vKeyFrames;
+    ia >> reply.vMapPoints;
+    return true;
+}
+
+// Keyframes pKF and its nCovisibles best covisibles, with their points
+static void ExpectedLocalMap(KeyFrame* pKF, const int nCovisibles, set<unsigned long> &sKFIds, set<unsigned long> &sMPIds)
+{
+    vector<KeyFrame*> vpKFs = pKF->GetBestCovisibilityKeyFrames(nCovisibles);
+    vpKFs.push_back(pKF);
+    for(KeyFrame* pKFi : vpKFs)
+    {
+        sKFIds.insert(pKFi->mnId);
+        const vector<MapPoint*> vpMPs = pKFi->GetMapPointMatches();
+        for(MapPoint* pMP : vpMPs)
+            if(pMP)
+                sMPIds.insert(pMP->mnId);
+    }
+}
+
+static void TestClient(SyntheticMap &map, MapServer &server)
+{
+    LocalMapTransport transport(&server);
+    MapClient client(&transport);
+
+    vector<MapInfo> vMaps;
+    CHECK(client.GetMaps(vMaps));
+    CHECK(vMaps.size() == 1);
+    if(vMaps.size() == 1)
+    {
+        CHECK(vMaps[0].nId == map.pMap->GetId());
+        CHECK(vMaps[0].nKeyFrames == map.vpKeyFrames.size());
+        CHECK(vMaps[0].nMapPoints == map.vpMapPoints.size());
+    }
+
+    // A frame with the descriptors of a keyframe finds it, with its points
+    KeyFrame* pQuery = map.vpKeyFrames[5];
+    vector<const KeyFrameRecord*> vpCandidates;
+    BowVector bowVec;
+    FeatureVector featVec;
+    CHECK(client.DetectRelocalizationCandidates(pQuery->mDescriptors, -1, vpCandidates, bowVec, featVec));
+    CHECK(bowVec == pQuery->mBowVec);
+    CHECK(featVec == pQuery->mFeatVec);
+
+    bool bFound = false;
+    for(const KeyFrameRecord* pRecord : vpCandidates)
+    {
+        if(pRecord->nId != pQuery->mnId)
+            continue;
+        bFound = true;
+        CHECK(pRecord->nMapId == map.pMap->GetId());
+        CHECK(pRecord->vKeysUn.size() == pQuery->mvKeysUn.size());
+        CHECK(cv::norm(pRecord->descriptors, pQuery->mDescriptors, cv::NORM_INF) == 0);
+        CHECK((pRecord->Tcw.translation() - pQuery->GetPose().translation()).norm() < 1e-6f);
+
+        const vector<MapPoint*> vpMPs = pQuery->GetMapPointMatches();
+        CHECK(pRecord->vnMapPointIds.size() == vpMPs.size());
+        for(size_t i=0; i<vpMPs.size() && i<pRecord->vnMapPointIds.size(); i++)
+        {
+            CHECK(pRecord->vnMapPointIds[i] == static_cast<long>(vpMPs[i]->mnId));
+            const MapPointRecord* pMPRecord = client.GetMapPoint(vpMPs[i]->mnId);
+            CHECK(pMPRecord != NULL);
+            if(pMPRecord)
+                CHECK((pMPRecord->pos - vpMPs[i]->GetWorldPos()).norm() < 1e-6f);
+        }
+    }
+    CHECK(bFound);
+
+    // Only in a map that does not exist
+    vpCandidates.clear();
+    CHECK(client.DetectRelocalizationCandidates(pQuery->mDescriptors, map.pMap->GetId()+100, vpCandidates, bowVec, featVec));
+    CHECK(vpCandidates.empty());
+
+    // Local map of a keyframe with its two best covisibles
+    KeyFrame* pKF = map.vpKeyFrames[10];
+    set<unsigned long> sKFIds, sMPIds;
+    ExpectedLocalMap(pKF, 2, sKFIds, sMPIds);
+
+    vector<const KeyFrameRecord*> vpKeyFrames;
+    vector<const MapPointRecord*> vpMapPoints;
+    CHECK(client.GetLocalMap(vector<unsigned long>(1, pKF->mnId), 2, vpKeyFrames, vpMapPoints));
+    set<unsigned long> sReceivedKFs, sReceivedMPs;
+    for(const KeyFrameRecord* pRecord : vpKeyFrames)
+        sReceivedKFs.insert(pRecord->nId);
+    for(const MapPointRecord* pRecord : vpMapPoints)
+        sReceivedMPs.insert(pRecord->nId);
+    CHECK(sKFIds.size() == 3);
+    CHECK(sReceivedKFs == sKFIds);
+    CHECK(sReceivedMPs == sMPIds);
+
+    // The records already received are not sent again, but the client still has them
+    CHECK(client.GetLocalMap(vector<unsigned long>(1, pKF->mnId), 2, vpKeyFrames, vpMapPoints));
+    CHECK(vpKeyFrames.size() == sKFIds.size());
+    CHECK(vpMapPoints.size() == sMPIds.size());
+}
+
+static void TestSession(SyntheticMap &map, MapServer &server)
+{
+    MapServer::Session session;
+
+    KeyFrame* pKF = map.vpKeyFrames[10];
+    set<unsigned long> sKFIds, sMPIds;
+    ExpectedLocalMap(pKF, 2, sKFIds, sMPIds);
+
+    LocalMapReply reply;
+    CHECK(RequestLocalMap(server, session, vector<unsigned long>(1, pKF->mnId), 2, reply));
+    CHECK(reply.vKeyFrames.size() == sKFIds.size());
+    CHECK(reply.vMapPoints.size() == sMPIds.size());
+
+    // Same request: the ids again, no record
+    CHECK(RequestLocalMap(server, session, vector<unsigned long>(1, pKF->mnId), 2, reply));
+    CHECK(set<unsigned long>(reply.vnLocalKFs.begin(), reply.vnLocalKFs.end()) == sKFIds);
+    CHECK(set<unsigned long>(reply.vnLocalMPs.begin(), reply.vnLocalMPs.end()) == sMPIds);
+    CHECK(reply.vKeyFrames.empty());
+    CHECK(reply.vMapPoints.empty());
+
+    // Overlapping request: only the records not sent before
+    KeyFrame* pNext = map.vpKeyFrames[12];
+    set<unsigned long> sNextKFIds, sNextMPIds;
+    ExpectedLocalMap(pNext, 2, sNextKFIds, sNextMPIds);
+    CHECK(RequestLocalMap(server, session, vector<unsigned long>(1, pNext->mnId), 2, reply));
+
+    set<unsigned long> sSentKFs(sKFIds), sSentMPs(sMPIds);
+    for(const KeyFrameRecord &record : reply.vKeyFrames)
+        CHECK(sSentKFs.insert(record.nId).second);
+    for(const MapPointRecord &record : reply.vMapPoints)
+        CHECK(sSentMPs.insert(record.nId).second);
+    for(const unsigned long nId : sNextKFIds)
+        CHECK(sSentKFs.count(nId));
+    for(const unsigned long nId : sNextMPIds)
+        CHECK(sSentMPs.count(nId));
+
+    // Another session gets the records again
+    MapServer::Session otherSession;
+    CHECK(RequestLocalMap(server, otherSession, vector<unsigned long>(1, pKF->mnId), 2, reply));
+    CHECK(reply.vKeyFrames.size() == sKFIds.size());
+
+    // Unknown keyframes are skipped
+    CHECK(RequestLocalMap(server, otherSession, vector<unsigned long>(1, 1000000), 2, reply));
+    CHECK(reply.vnLocalKFs.empty());
+}
+
+static void TestMalformed(MapServer &server)
+{
+    MapServer::Session session;
+    LocalMapTransport transport(&server);
+    string strReply;
+
+    CHECK(!server.HandleRequest(session, MapServer::RELOCALIZATION_REQUEST, "xyz", strReply));
+    CHECK(!server.HandleRequest(session, MapServer::BOW_REQUEST, string(), strReply));
+    CHECK(!server.HandleRequest(session, 42, string(), strReply));
+    CHECK(!transport.Request(MapServer::LOCAL_MAP_REQUEST, "xyz", strReply));
+
+    // Request cut in the middle
+    const string strRequest = EncodeLocalMapRequest(vector<unsigned long>(8, 1), 2);
+    CHECK(!transport.Request(MapServer::LOCAL_MAP_REQUEST, strRequest.substr(0, strRequest.size()/2), strReply));
+
+    // The transport goes on after them
+    CHECK(transport.Request(MapServer::LOCAL_MAP_REQUEST, strRequest, strReply));
+}
+
+// Error reply through the socket, the connection stays usable
+static void TestSocket(SyntheticMap &map, MapServer &server)
+{
+    const string strSocket = "/tmp/orbslam3_mapserver_" + to_string(getpid()) + ".sock";
+    CHECK(server.Listen(strSocket));
+    thread serverThread(&MapServer::Run, &server);
+
+    {
+        SocketMapTransport transport;
+        CHECK(transport.Connect(strSocket));
+
+        string strReply;
+        CHECK(!transport.Request(MapServer::RELOCALIZATION_REQUEST, "xyz", strReply));
+        CHECK(!transport.Request(42, string(), strReply));
+
+        MapClient client(&transport);
+        vector<MapInfo> vMaps;
+        CHECK(client.GetMaps(vMaps));
+        CHECK(vMaps.size() == 1);
+
+        vector<const KeyFrameRecord*> vpKeyFrames;
+        vector<const MapPointRecord*> vpMapPoints;
+        CHECK(client.GetLocalMap(vector<unsigned long>(1, map.vpKeyFrames[3]->mnId), 2, vpKeyFrames, vpMapPoints));
+        CHECK(vpKeyFrames.size() == 3);
+    }
+
+    server.RequestFinish();
+    serverThread.join();
+    CHECK(server.isFinished());
+}
+
+int main()
+{
+    SyntheticMap map(20, 12, 45);
+    MapServer server(map.pAtlas, map.pVoc, map.pKFDB);
+
+    TestClient(map, server);
+    TestSession(map, server);
+    TestMalformed(server);
+    TestSocket(map, server);
+
+    return TEST_RESULT();
+}
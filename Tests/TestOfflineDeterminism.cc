@@ -0,0 +1,170 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+// Offline mode (System.Offline: 1) gives the same result on every run: a monocular EuRoC sequence is
+// processed twice and the poses of every frame and the keyframe trajectory are compared bit for bit.
+// Each run is a child process forked from the same state, so both see the same memory layout.
+//
+// Needs the environment variables
+//   ORB_SLAM3_TEST_VOCABULARY  vocabulary file
+//   ORB_SLAM3_TEST_SETTINGS    monocular settings with System.Offline: 1
+//   ORB_SLAM3_TEST_SEQUENCE    EuRoC sequence folder (with mav0)
+//   ORB_SLAM3_TEST_TIMESTAMPS  timestamps file of the sequence
+// and is skipped without them.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <opencv2/core/core.hpp>
+
+#include "System.h"
+#include "DatasetReader.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+static void LoadImages(const string &strImagePath, const string &strPathTimes, vector<string> &vstrImages, vector<double> &vTimeStamps)
+{
+    ifstream fTimes(strPathTimes.c_str());
+    string s;
+    while(getline(fTimes, s))
+    {
+        if(s.empty())
+            continue;
+        stringstream ss(s);
+        vstrImages.push_back(strImagePath + "/" + s + ".png");
+        double t;
+        ss >> t;
+        vTimeStamps.push_back(t/1e9);
+    }
+}
+
+// Processes the sequence in a child process. The pose of every frame is written in binary to strFile
+// and the keyframe trajectory to strFile.kf.
+static bool RunSequence(const string &strVoc, const string &strSettings, const vector<string> &vstrImages,
+                        const vector<double> &vTimestamps, const string &strFile)
+{
+    const pid_t pid = fork();
+    if(pid < 0)
+        return false;
+
+    if(pid == 0)
+    {
+        System SLAM(strVoc, strSettings, System::MONOCULAR, false);
+
+        DatasetReader reader(strSettings);
+        reader.SetImageScale(SLAM.GetImageScale());
+        reader.SetSequence(vstrImages, vector<string>(), vTimestamps, cv::IMREAD_UNCHANGED);
+        reader.Start();
+
+        ofstream f(strFile.c_str(), ios::binary);
+        DatasetFrame frame;
+        while(reader.Next(frame))
+        {
+            if(!frame.strFailed.empty())
+            {
+                cerr << "Failed to load image at: " << frame.strFailed << endl;
+                _exit(1);
+            }
+            const Sophus::SE3f Tcw = SLAM.TrackMonocular(frame.im, frame.timestamp);
+            const Eigen::Matrix<float,3,4> T = Tcw.matrix3x4();
+            f.write(reinterpret_cast<const char*>(T.data()), sizeof(float)*12);
+        }
+        f.close();
+
+        SLAM.Shutdown();
+        SLAM.SaveKeyFrameTrajectoryEuRoC(strFile + ".kf");
+        // Without the destructors, the result is already written
+        _exit(f ? 0 : 1);
+    }
+
+    int status;
+    if(waitpid(pid, &status, 0) != pid)
+        return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static string ReadFile(const string &strFile)
+{
+    ifstream f(strFile.c_str(), ios::binary);
+    return string(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+}
+
+int main()
+{
+    const char* pVoc = getenv("ORB_SLAM3_TEST_VOCABULARY");
+    const char* pSettings = getenv("ORB_SLAM3_TEST_SETTINGS");
+    const char* pSequence = getenv("ORB_SLAM3_TEST_SEQUENCE");
+    const char* pTimestamps = getenv("ORB_SLAM3_TEST_TIMESTAMPS");
+    if(!pVoc || !pSettings || !pSequence || !pTimestamps)
+    {
+        cout << "ORB_SLAM3_TEST_VOCABULARY, ORB_SLAM3_TEST_SETTINGS, ORB_SLAM3_TEST_SEQUENCE and ORB_SLAM3_TEST_TIMESTAMPS not set, skipped" << endl;
+        return TEST_SKIPPED;
+    }
+
+    {
+        cv::FileStorage fsSettings(pSettings, cv::FileStorage::READ);
+        cv::FileNode node = fsSettings["System.Offline"];
+        if(!fsSettings.isOpened() || node.empty() || static_cast<int>(node) == 0)
+        {
+            cerr << pSettings << " must have System.Offline: 1" << endl;
+            return 1;
+        }
+    }
+
+    vector<string> vstrImages;
+    vector<double> vTimestamps;
+    LoadImages(string(pSequence) + "/mav0/cam0/data", pTimestamps, vstrImages, vTimestamps);
+    CHECK(!vstrImages.empty());
+
+    char tmpl[] = "/tmp/orbslam3_determinism_XXXXXX";
+    if(!mkdtemp(tmpl))
+    {
+        cerr << "Unable to create a temporary folder" << endl;
+        return 1;
+    }
+    const string strDir(tmpl);
+    const string strFirst = strDir + "/first.bin";
+    const string strSecond = strDir + "/second.bin";
+
+    CHECK(RunSequence(pVoc, pSettings, vstrImages, vTimestamps, strFirst));
+    CHECK(RunSequence(pVoc, pSettings, vstrImages, vTimestamps, strSecond));
+
+    const string strPoses1 = ReadFile(strFirst), strPoses2 = ReadFile(strSecond);
+    CHECK(strPoses1.size() == vstrImages.size()*12*sizeof(float));
+    CHECK(strPoses1 == strPoses2);
+
+    const string strKFs1 = ReadFile(strFirst + ".kf"), strKFs2 = ReadFile(strSecond + ".kf");
+    CHECK(!strKFs1.empty());
+    CHECK(strKFs1 == strKFs2);
+
+    const string vstrFiles[] = {strFirst, strSecond, strFirst + ".kf", strSecond + ".kf"};
+    for(const string &s : vstrFiles)
+        remove(s.c_str());
+    rmdir(strDir.c_str());
+
+    return TEST_RESULT();
+}
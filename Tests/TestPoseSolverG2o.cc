@@ -0,0 +1,404 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// PoseSolver and InertialPoseSolver against the g2o graphs they replace in Optimizer::PoseOptimization
+// and PoseInertialOptimizationLastKeyFrame, on the same synthetic frames: pose, outliers and time.
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_gauss_newton.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_dense.h"
+
+#include "PoseSolver.h"
+#include "ImuTypes.h"
+#include "G2oTypes.h"
+#include "OptimizableTypes.h"
+#include "CameraModels/Pinhole.h"
+#include "PoseSolverRuns.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+static const float fx = 450.f, fy = 450.f, cx = 320.f, cy = 240.f, bf = 40.f;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(const Clock::time_point &t0, const Clock::time_point &t1)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1 - t0).count();
+}
+
+static double RotationError(const Eigen::Matrix3d &R1, const Eigen::Matrix3d &R2)
+{
+    return Eigen::AngleAxisd(R1.transpose()*R2).angle();
+}
+
+static Eigen::Matrix3d Exp(const double x, const double y, const double z)
+{
+    return Sophus::SO3d::exp(Eigen::Vector3d(x,y,z)).matrix();
+}
+
+// Point in front of the camera Tcw, in world coordinates
+static Eigen::Vector3d RandomPoint(mt19937 &rng, const Sophus::SE3d &Tcw)
+{
+    normal_distribution<double> n(0.0, 1.0);
+    const Eigen::Vector3d Xc(2.0*n(rng), 1.5*n(rng), 3.0+5.0*fabs(n(rng)));
+    return Tcw.inverse()*Xc;
+}
+
+static void SimulateFrame(mt19937 &rng, const Sophus::SE3d &Tcw, const Sophus::SE3d &Trl, const bool bRig,
+                          vector<PoseObservation> &vObs)
+{
+    normal_distribution<double> pixelNoise(0.0, 0.5);
+    uniform_real_distribution<double> randomPixel(0.0, 480.0);
+
+    const int nPoints = 300;
+    const int nOutliers = 30;
+    vObs.resize(nPoints+nOutliers);
+    for(int i=0; i<nPoints+nOutliers; i++)
+    {
+        PoseObservation &obs = vObs[i];
+        const Eigen::Vector3d Xw = RandomPoint(rng, Tcw);
+        obs.Xw = Xw.cast<float>();
+        obs.invSigma2 = 1.f;
+        obs.type = bRig ? (i%2 == 0 ? PoseSolver::MONOCULAR : PoseSolver::MONOCULAR_RIGHT) :
+                          (i%2 == 0 ? PoseSolver::STEREO : PoseSolver::MONOCULAR);
+
+        const Eigen::Vector3d Xc = obs.type == PoseSolver::MONOCULAR_RIGHT ? Trl*(Tcw*Xw) : Tcw*Xw;
+        obs.u = fx*Xc[0]/Xc[2] + cx + pixelNoise(rng);
+        obs.v = fy*Xc[1]/Xc[2] + cy + pixelNoise(rng);
+        obs.ur = obs.u - bf/Xc[2] + pixelNoise(rng);
+
+        // The last ones are wrong matches
+        if(i >= nPoints)
+        {
+            obs.u = randomPixel(rng);
+            obs.v = randomPixel(rng);
+            obs.ur = obs.u - 5.0;
+        }
+    }
+}
+
+static void ComparePoseSolver(const bool bRig)
+{
+    mt19937 rng(bRig ? 12 : 11);
+    Pinhole camera(vector<float>{fx, fy, cx, cy});
+    Pinhole cameraRight(vector<float>{fx, fy, cx, cy});
+    const Sophus::SE3d Trl(Exp(0.0, 0.01, 0.0), Eigen::Vector3d(-0.1, 0.0, 0.0));
+    const PoseCalibration calib = {&camera, bRig ? &cameraRight : static_cast<GeometricCamera*>(NULL), Trl, fx, fy, cx, cy, bf};
+
+    const int nFrames = 50;
+    double tSolver_ms = 0, tG2o_ms = 0, maxTrans = 0, maxRot = 0;
+    int nInlierDiffs = 0;
+    for(int f=0; f<nFrames; f++)
+    {
+        const Sophus::SE3d Tcw(Exp(0.1*f, -0.2, 0.05), Eigen::Vector3d(0.3, -0.1*f, 1.0));
+        vector<PoseObservation> vObs;
+        SimulateFrame(rng, Tcw, Trl, bRig, vObs);
+
+        // Initial pose from the motion model
+        const Sophus::SE3d Tcw0(Exp(0.03, 0.02, -0.04)*Tcw.rotationMatrix(), Tcw.translation() + Eigen::Vector3d(0.1, -0.05, 0.08));
+
+        Sophus::SE3d TSolver, TG2o;
+        vector<bool> vbOutlierSolver(vObs.size(), false), vbOutlierG2o(vObs.size(), false);
+        const Clock::time_point t0 = Clock::now();
+        const int nInliersSolver = RunPoseSolver(vObs, calib, Tcw0, TSolver, vbOutlierSolver);
+        const Clock::time_point t1 = Clock::now();
+        const int nInliersG2o = RunPoseG2o(vObs, calib, Tcw0, TG2o, vbOutlierG2o);
+        const Clock::time_point t2 = Clock::now();
+
+        tSolver_ms += Milliseconds(t0, t1);
+        tG2o_ms += Milliseconds(t1, t2);
+        maxTrans = max(maxTrans, (TSolver.translation()-TG2o.translation()).norm());
+        maxRot = max(maxRot, RotationError(TSolver.rotationMatrix(), TG2o.rotationMatrix()));
+        nInlierDiffs += abs(nInliersSolver - nInliersG2o);
+
+        CHECK((TSolver.translation()-Tcw.translation()).norm() < 0.01);
+    }
+
+    printf("PoseSolver%s vs g2o (%d frames): %.3f ms vs %.3f ms, max difference %.2e m %.2e rad, %d inliers\n",
+           bRig ? " (rig)" : "", nFrames, tSolver_ms/nFrames, tG2o_ms/nFrames, maxTrans, maxRot, nInlierDiffs);
+
+    CHECK(maxTrans < 1e-4);
+    CHECK(maxRot < 1e-4);
+    CHECK(nInlierDiffs == 0);
+}
+
+typedef InertialPoseSolver::State State;
+
+// Motion from s1 during nMeas steps of dt, integrated with the same scheme as IMU::Preintegrated
+static void Simulate(const State &s1, const int nMeas, const float dt, mt19937 &rng, IMU::Preintegrated &preint, State &s2)
+{
+    normal_distribution<double> n(0.0, 1.0);
+    const Eigen::Vector3d g(0, 0, -IMU::GRAVITY_VALUE);
+    s2 = s1;
+    for(int i=0; i<nMeas; i++)
+    {
+        const Eigen::Vector3f acc = (s2.Rwb.transpose()*(-g) + Eigen::Vector3d(0.5*n(rng), 0.5*n(rng), 0.5*n(rng))).cast<float>();
+        const Eigen::Vector3f gyro(0.2*n(rng), 0.2*n(rng), 0.2*n(rng));
+        preint.IntegrateNewMeasurement(acc, gyro, dt);
+
+        const Eigen::Vector3d accW = g + s2.Rwb*acc.cast<double>();
+        s2.twb += s2.vwb*dt + 0.5*accW*dt*dt;
+        s2.vwb += accW*dt;
+        s2.Rwb = s2.Rwb*Sophus::SO3d::exp(gyro.cast<double>()*dt).matrix();
+    }
+}
+
+// Pose vertex of the IMU state with the cameras of the rig
+static VertexPose* NewVertexPose(const State &state, const Sophus::SE3d &Tcb, const Sophus::SE3d &Trl,
+                                 GeometricCamera* pCamera, GeometricCamera* pCamera2)
+{
+    const Sophus::SE3d Tbw = Sophus::SE3d(state.Rwb, state.twb).inverse();
+    const Sophus::SE3d Tc1w = Tcb*Tbw;
+    const Sophus::SE3d Tc2w = Trl*Tc1w;
+    const Sophus::SE3d Tbc1 = Tcb.inverse();
+    const Sophus::SE3d Tbc2 = (Trl*Tcb).inverse();
+
+    vector<Eigen::Matrix3d> vRcw, vRbc;
+    vector<Eigen::Vector3d> vtcw, vtbc;
+    vRcw.push_back(Tc1w.rotationMatrix());
+    vRcw.push_back(Tc2w.rotationMatrix());
+    vtcw.push_back(Tc1w.translation());
+    vtcw.push_back(Tc2w.translation());
+    vRbc.push_back(Tbc1.rotationMatrix());
+    vRbc.push_back(Tbc2.rotationMatrix());
+    vtbc.push_back(Tbc1.translation());
+    vtbc.push_back(Tbc2.translation());
+
+    ImuCamPose pose;
+    pose.SetParam(vRcw, vtcw, vRbc, vtbc, bf);
+    pose.pCamera.push_back(pCamera);
+    pose.pCamera.push_back(pCamera2);
+    pose.its = 0;
+
+    VertexPose* VP = new VertexPose();
+    VP->setEstimate(pose);
+    return VP;
+}
+
+static void CompareInertialPoseSolver()
+{
+    mt19937 rng(13);
+    Pinhole camera(vector<float>{fx, fy, cx, cy});
+    Pinhole cameraRight(vector<float>{fx, fy, cx, cy});
+    const Sophus::SE3f Tcb(Sophus::SO3f::exp(Eigen::Vector3f(0.01f, -0.02f, 0.03f)), Eigen::Vector3f(0.05f, 0.01f, -0.02f));
+    const Sophus::SE3f Trl(Sophus::SO3f(), Eigen::Vector3f(-0.1f, 0.f, 0.f));
+    const IMU::Calib calib(Tcb.inverse(), 1.7e-2f, 2.0e-1f, 1.9e-5f, 3.0e-3f);
+
+    const int nFrames = 20;
+    const float chi2Mono[4]={12,7.5,5.991,5.991};
+    const float chi2Stereo[4]={15.6,9.8,7.815,7.815};
+    double tSolver_ms = 0, tG2o_ms = 0, maxTrans = 0, maxRot = 0, maxVel = 0;
+    int nOutlierDiffs = 0;
+    for(int f=0; f<nFrames; f++)
+    {
+        // Last keyframe (fixed) and frame
+        State sKF;
+        sKF.Rwb = Exp(0.1, 0.2*f, -0.1);
+        sKF.twb = Eigen::Vector3d(1.0, 2.0, 0.5*f);
+        sKF.vwb = Eigen::Vector3d(0.5, 0.1, 0.0);
+        sKF.bg.setZero();
+        sKF.ba.setZero();
+
+        IMU::Preintegrated preint(IMU::Bias(), calib);
+        State sF;
+        Simulate(sKF, 20, 0.005f, rng, preint, sF);
+        const Eigen::Matrix3d InfoG = preint.C.block<3,3>(9,9).cast<double>().inverse();
+        const Eigen::Matrix3d InfoA = preint.C.block<3,3>(12,12).cast<double>().inverse();
+
+        const Sophus::SE3d Tcw = Tcb.cast<double>()*Sophus::SE3d(sF.Rwb, sF.twb).inverse();
+        vector<PoseObservation> vObs;
+        SimulateFrame(rng, Tcw, Trl.cast<double>(), false, vObs);
+
+        // Initial state predicted from the keyframe
+        State s0 = sF;
+        s0.Rwb = sF.Rwb*Exp(0.01, -0.01, 0.02);
+        s0.twb += Eigen::Vector3d(0.02, -0.01, 0.01);
+        s0.vwb += Eigen::Vector3d(0.05, 0.0, -0.02);
+
+        const Clock::time_point t0 = Clock::now();
+
+        InertialPoseSolver solver;
+        solver.SetCamera(&camera, Tcb, bf);
+        solver.SetHuberDeltas(sqrt(5.991), sqrt(7.815), 5.f);
+        for(size_t i=0; i<vObs.size(); i++)
+        {
+            const PoseObservation &obs = vObs[i];
+            if(obs.type == PoseSolver::STEREO)
+                solver.AddStereo(obs.Xw, obs.u, obs.v, obs.ur, 1.f, i);
+            else
+                solver.AddMonocular(obs.Xw, obs.u, obs.v, 1.f, 0, false, i);
+        }
+        solver.SetState(s0);
+        solver.SetPrevious(sKF);
+        solver.SetInertial(&preint, InfoG, InfoA);
+
+        vector<bool> vbOutlierSolver(vObs.size(), false);
+        for(int it=0; it<4; it++)
+        {
+            solver.Optimize(10, it<3);
+            solver.ClassifyOutliers(chi2Mono[it], 1.5f*chi2Mono[it], chi2Stereo[it], vbOutlierSolver);
+        }
+        const State sSolver = solver.GetState();
+
+        const Clock::time_point t1 = Clock::now();
+
+        // Graph of Optimizer::PoseInertialOptimizationLastKeyFrame before InertialPoseSolver
+        g2o::SparseOptimizer optimizer;
+        g2o::BlockSolverX::LinearSolverType * linearSolver = new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
+        g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
+        optimizer.setAlgorithm(new g2o::OptimizationAlgorithmGaussNewton(solver_ptr));
+
+        VertexPose* VP = NewVertexPose(s0, Tcb.cast<double>(), Trl.cast<double>(), &camera, &cameraRight);
+        VertexVelocity* VV = new VertexVelocity();
+        VertexGyroBias* VG = new VertexGyroBias();
+        VertexAccBias* VA = new VertexAccBias();
+        VV->setEstimate(s0.vwb);
+        VG->setEstimate(s0.bg);
+        VA->setEstimate(s0.ba);
+        VertexPose* VPk = NewVertexPose(sKF, Tcb.cast<double>(), Trl.cast<double>(), &camera, &cameraRight);
+        VertexVelocity* VVk = new VertexVelocity();
+        VertexGyroBias* VGk = new VertexGyroBias();
+        VertexAccBias* VAk = new VertexAccBias();
+        VVk->setEstimate(sKF.vwb);
+        VGk->setEstimate(sKF.bg);
+        VAk->setEstimate(sKF.ba);
+        g2o::OptimizableGraph::Vertex* vpVertices[8] = {VP, VV, VG, VA, VPk, VVk, VGk, VAk};
+        for(int i=0; i<8; i++)
+        {
+            vpVertices[i]->setId(i);
+            vpVertices[i]->setFixed(i>=4);
+            optimizer.addVertex(vpVertices[i]);
+        }
+
+        vector<g2o::OptimizableGraph::Edge*> vpEdges(vObs.size());
+        vector<bool> vbStereo(vObs.size());
+        for(size_t i=0; i<vObs.size(); i++)
+        {
+            const PoseObservation &obs = vObs[i];
+            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+            vbStereo[i] = obs.type == PoseSolver::STEREO;
+            if(vbStereo[i])
+            {
+                EdgeStereoOnlyPose* e = new EdgeStereoOnlyPose(obs.Xw);
+                e->setVertex(0, VP);
+                e->setMeasurement(Eigen::Vector3d(obs.u, obs.v, obs.ur));
+                e->setInformation(Eigen::Matrix3d::Identity());
+                rk->setDelta(sqrt(7.815));
+                e->setRobustKernel(rk);
+                vpEdges[i] = e;
+            }
+            else
+            {
+                EdgeMonoOnlyPose* e = new EdgeMonoOnlyPose(obs.Xw, 0);
+                e->setVertex(0, VP);
+                e->setMeasurement(Eigen::Vector2d(obs.u, obs.v));
+                e->setInformation(Eigen::Matrix2d::Identity());
+                rk->setDelta(sqrt(5.991));
+                e->setRobustKernel(rk);
+                vpEdges[i] = e;
+            }
+            optimizer.addEdge(vpEdges[i]);
+        }
+
+        EdgeInertial* ei = new EdgeInertial(&preint);
+        ei->setVertex(0, VPk);
+        ei->setVertex(1, VVk);
+        ei->setVertex(2, VGk);
+        ei->setVertex(3, VAk);
+        ei->setVertex(4, VP);
+        ei->setVertex(5, VV);
+        optimizer.addEdge(ei);
+
+        EdgeGyroRW* egr = new EdgeGyroRW();
+        egr->setVertex(0, VGk);
+        egr->setVertex(1, VG);
+        egr->setInformation(InfoG);
+        optimizer.addEdge(egr);
+
+        EdgeAccRW* ear = new EdgeAccRW();
+        ear->setVertex(0, VAk);
+        ear->setVertex(1, VA);
+        ear->setInformation(InfoA);
+        optimizer.addEdge(ear);
+
+        vector<bool> vbOutlierG2o(vObs.size(), false);
+        for(int it=0; it<4; it++)
+        {
+            optimizer.initializeOptimization(0);
+            optimizer.optimize(10);
+
+            for(size_t i=0; i<vpEdges.size(); i++)
+            {
+                g2o::OptimizableGraph::Edge* e = vpEdges[i];
+                if(vbOutlierG2o[i])
+                    e->computeError();
+
+                const double chi2 = e->chi2();
+                if(vbStereo[i])
+                    vbOutlierG2o[i] = chi2 > chi2Stereo[it];
+                else
+                    vbOutlierG2o[i] = chi2 > chi2Mono[it] || !static_cast<EdgeMonoOnlyPose*>(e)->isDepthPositive();
+                e->setLevel(vbOutlierG2o[i] ? 1 : 0);
+
+                if(it==2)
+                    e->setRobustKernel(0);
+            }
+        }
+
+        const Clock::time_point t2 = Clock::now();
+
+        tSolver_ms += Milliseconds(t0, t1);
+        tG2o_ms += Milliseconds(t1, t2);
+        maxTrans = max(maxTrans, (sSolver.twb - VP->estimate().twb).norm());
+        maxRot = max(maxRot, RotationError(sSolver.Rwb, VP->estimate().Rwb));
+        maxVel = max(maxVel, (sSolver.vwb - VV->estimate()).norm());
+        for(size_t i=0; i<vObs.size(); i++)
+            nOutlierDiffs += vbOutlierSolver[i] != vbOutlierG2o[i] ? 1 : 0;
+
+        CHECK((sSolver.twb - sF.twb).norm() < 0.01);
+    }
+
+    printf("InertialPoseSolver vs g2o (%d frames): %.3f ms vs %.3f ms, max difference %.2e m %.2e rad %.2e m/s, %d outliers\n",
+           nFrames, tSolver_ms/nFrames, tG2o_ms/nFrames, maxTrans, maxRot, maxVel, nOutlierDiffs);
+
+    CHECK(maxTrans < 1e-4);
+    CHECK(maxRot < 1e-4);
+    CHECK(maxVel < 1e-4);
+    CHECK(nOutlierDiffs == 0);
+}
+
+int main()
+{
+    ComparePoseSolver(false);
+    ComparePoseSolver(true);
+    CompareInertialPoseSolver();
+
+    return TEST_RESULT();
+}
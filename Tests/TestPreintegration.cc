@@ -0,0 +1,110 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Preintegrated::Append and MergePrevious (composition of two preintegrations with the same bias,
+// integration of the measurements otherwise) against integrating all the measurements in sequence
+
+#include <random>
+#include <vector>
+
+#include "ImuTypes.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+// Largest difference between two preintegrations, relative to the magnitude of each quantity
+static double Difference(const IMU::Preintegrated &a, const IMU::Preintegrated &b)
+{
+    double d = 0.0;
+    d = max(d, (double)((a.dR-b.dR).norm()));
+    d = max(d, (double)((a.dV-b.dV).norm()/max(1.f, b.dV.norm())));
+    d = max(d, (double)((a.dP-b.dP).norm()/max(1.f, b.dP.norm())));
+    d = max(d, (double)((a.JRg-b.JRg).norm()/max(1.f, b.JRg.norm())));
+    d = max(d, (double)((a.JVg-b.JVg).norm()/max(1.f, b.JVg.norm())));
+    d = max(d, (double)((a.JVa-b.JVa).norm()/max(1.f, b.JVa.norm())));
+    d = max(d, (double)((a.JPg-b.JPg).norm()/max(1.f, b.JPg.norm())));
+    d = max(d, (double)((a.JPa-b.JPa).norm()/max(1.f, b.JPa.norm())));
+    d = max(d, (double)((a.C-b.C).norm()/b.C.norm()));
+    d = max(d, (double)((a.avgA-b.avgA).norm()/max(1.f, b.avgA.norm())));
+    d = max(d, (double)((a.avgW-b.avgW).norm()/max(1.f, b.avgW.norm())));
+    d = max(d, (double)fabs(a.dT-b.dT));
+    return d;
+}
+
+int main()
+{
+    const IMU::Calib calib(Sophus::SE3f(), 1.7e-4f*200.f, 2.0e-3f*200.f, 1.9e-5f, 3.0e-3f);
+    const IMU::Bias bias(0.02f, -0.01f, 0.05f, 0.001f, -0.002f, 0.003f);
+    const IMU::Bias otherBias(0.03f, -0.01f, 0.04f, 0.002f, -0.002f, 0.001f);
+
+    // Smooth motion with noise, 200 Hz
+    mt19937 rng(4);
+    normal_distribution<float> noise(0.f, 0.05f);
+    const int nMeas = 400;
+    const float dt = 0.005f;
+    vector<Eigen::Vector3f> vAcc(nMeas), vGyro(nMeas);
+    vector<float> vDt(nMeas, dt);
+    for(int i=0; i<nMeas; i++)
+    {
+        const float t = i*dt;
+        vAcc[i] = Eigen::Vector3f(0.5f*sin(t), 9.81f+0.3f*cos(2*t), 0.2f*t) + Eigen::Vector3f(noise(rng), noise(rng), noise(rng));
+        vGyro[i] = Eigen::Vector3f(0.3f*cos(t), -0.2f, 0.5f*sin(3*t)) + 0.1f*Eigen::Vector3f(noise(rng), noise(rng), noise(rng));
+    }
+
+    IMU::Preintegrated sequential(bias, calib);
+    for(int i=0; i<nMeas; i++)
+        sequential.IntegrateNewMeasurement(vAcc[i], vGyro[i], vDt[i]);
+
+    // The block of measurements is the same as one by one
+    {
+        IMU::Preintegrated block(bias, calib);
+        block.IntegrateNewMeasurements(vAcc, vGyro, vDt);
+        CHECK(Difference(block, sequential) < 1e-5);
+    }
+
+    const int splits[] = {1, 57, 200, 399};
+    for(const int k : splits)
+    {
+        IMU::Preintegrated first(bias, calib), second(bias, calib);
+        for(int i=0; i<k; i++)
+            first.IntegrateNewMeasurement(vAcc[i], vGyro[i], vDt[i]);
+        for(int i=k; i<nMeas; i++)
+            second.IntegrateNewMeasurement(vAcc[i], vGyro[i], vDt[i]);
+
+        // Same bias: composed
+        IMU::Preintegrated appended(&first);
+        appended.Append(&second);
+        CHECK(Difference(appended, sequential) < 1e-4);
+
+        IMU::Preintegrated merged(&second);
+        merged.MergePrevious(&first);
+        CHECK(Difference(merged, sequential) < 1e-4);
+
+        // Another bias in the second part: its measurements are integrated again with the first bias
+        IMU::Preintegrated secondOther(otherBias, calib);
+        for(int i=k; i<nMeas; i++)
+            secondOther.IntegrateNewMeasurement(vAcc[i], vGyro[i], vDt[i]);
+        IMU::Preintegrated appendedOther(&first);
+        appendedOther.Append(&secondOther);
+        CHECK(Difference(appendedOther, sequential) < 1e-5);
+    }
+
+    return TEST_RESULT();
+}
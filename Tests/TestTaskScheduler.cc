@@ -0,0 +1,262 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TaskScheduler.h"
+#include "Check.h"
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+// Ends the test if a case does not finish in time: a deadlock would hang ctest otherwise
+class Watchdog
+{
+public:
+    Watchdog(const string &strCase, const int seconds): mbDone(false)
+    {
+        mThread = thread([this, strCase, seconds]
+        {
+            unique_lock<mutex> lock(mMutex);
+            if(!mCond.wait_for(lock, chrono::seconds(seconds), [this]{ return mbDone; }))
+            {
+                fprintf(stderr, "%s did not finish in %d s\n", strCase.c_str(), seconds);
+                _Exit(1);
+            }
+        });
+    }
+
+    ~Watchdog()
+    {
+        {
+            unique_lock<mutex> lock(mMutex);
+            mbDone = true;
+        }
+        mCond.notify_all();
+        mThread.join();
+    }
+
+private:
+    thread mThread;
+    mutex mMutex;
+    condition_variable mCond;
+    bool mbDone;
+};
+
+static bool VisitedOnce(const vector<atomic<int> > &vCount, const int first, const int last)
+{
+    for(size_t i=0; i<vCount.size(); i++)
+    {
+        const int expected = static_cast<int>(i) >= first && static_cast<int>(i) < last ? 1 : 0;
+        if(vCount[i] != expected)
+            return false;
+    }
+    return true;
+}
+
+static void TestParallelFor()
+{
+    Watchdog watchdog("ParallelFor", 60);
+    TaskScheduler scheduler(4);
+
+    const int vGrains[] = {1, 3, 16, 100, 5000};
+    for(const int nGrain : vGrains)
+    {
+        vector<atomic<int> > vCount(1100);
+        for(size_t i=0; i<vCount.size(); i++)
+            vCount[i] = 0;
+
+        scheduler.ParallelFor(7, 1007, [&vCount](int i){ vCount[i]++; }, TaskScheduler::LOCAL_MAPPING, nGrain);
+        CHECK(VisitedOnce(vCount, 7, 1007));
+
+        // Empty and reversed ranges
+        scheduler.ParallelFor(50, 50, [&vCount](int i){ vCount[i]++; }, TaskScheduler::LOCAL_MAPPING, nGrain);
+        scheduler.ParallelFor(60, 20, [&vCount](int i){ vCount[i]++; }, TaskScheduler::LOCAL_MAPPING, nGrain);
+        CHECK(VisitedOnce(vCount, 7, 1007));
+    }
+
+    // A grain below 1 is taken as 1
+    vector<atomic<int> > vCount(10);
+    for(size_t i=0; i<vCount.size(); i++)
+        vCount[i] = 0;
+    scheduler.ParallelFor(0, 10, [&vCount](int i){ vCount[i]++; }, TaskScheduler::TRACKING, 0);
+    CHECK(VisitedOnce(vCount, 0, 10));
+}
+
+// Tasks that submit and wait for other tasks, with fewer workers than waiting tasks
+static void TestNestedWait()
+{
+    Watchdog watchdog("Nested Wait and ParallelFor", 60);
+
+    for(int nThreads=1; nThreads<=3; nThreads++)
+    {
+        TaskScheduler scheduler(nThreads);
+        atomic<int> nInner(0);
+
+        vector<future<void> > vOuter;
+        for(int t=0; t<8; t++)
+        {
+            vOuter.push_back(scheduler.Submit([&scheduler, &nInner]
+            {
+                scheduler.ParallelFor(0, 100, [&scheduler, &nInner](int i)
+                {
+                    if(i%25 == 0)
+                    {
+                        // Two levels of nesting
+                        future<void> result = scheduler.Submit([&scheduler, &nInner]
+                        {
+                            scheduler.ParallelFor(0, 10, [&nInner](int){ nInner++; }, TaskScheduler::LOCAL_MAPPING, 2);
+                        }, TaskScheduler::LOCAL_MAPPING);
+                        scheduler.Wait(result, TaskScheduler::LOCAL_MAPPING);
+                    }
+                    nInner++;
+                }, TaskScheduler::LOCAL_MAPPING, 10);
+            }, TaskScheduler::LOCAL_MAPPING));
+        }
+
+        for(size_t t=0; t<vOuter.size(); t++)
+            scheduler.Wait(vOuter[t], TaskScheduler::LOCAL_MAPPING);
+
+        CHECK(nInner == 8*(100 + 4*10));
+    }
+}
+
+static void TestException()
+{
+    Watchdog watchdog("Exception", 60);
+    TaskScheduler scheduler(2);
+
+    future<void> result = scheduler.Submit([]{ throw runtime_error("task failed"); }, TaskScheduler::LOOP_CLOSING);
+    bool bThrown = false;
+    try
+    {
+        scheduler.Wait(result, TaskScheduler::LOOP_CLOSING);
+    }
+    catch(const runtime_error &e)
+    {
+        bThrown = string(e.what()) == "task failed";
+    }
+    CHECK(bThrown);
+
+    // The exception of a task run by a worker waiting inside another task
+    future<void> outer = scheduler.Submit([&scheduler]
+    {
+        future<void> inner = scheduler.Submit([]{ throw logic_error("inner task failed"); }, TaskScheduler::LOOP_CLOSING);
+        scheduler.Wait(inner, TaskScheduler::LOOP_CLOSING);
+    }, TaskScheduler::LOOP_CLOSING);
+    bThrown = false;
+    try
+    {
+        scheduler.Wait(outer, TaskScheduler::LOOP_CLOSING);
+    }
+    catch(const logic_error &e)
+    {
+        bThrown = string(e.what()) == "inner task failed";
+    }
+    CHECK(bThrown);
+
+    // The scheduler goes on after the exceptions
+    atomic<int> nRun(0);
+    scheduler.ParallelFor(0, 100, [&nRun](int){ nRun++; }, TaskScheduler::LOOP_CLOSING);
+    CHECK(nRun == 100);
+}
+
+// A thread waiting at a priority runs queued tasks of that priority or higher, never lower ones
+static void TestWaitPriority()
+{
+    Watchdog watchdog("Wait priority", 60);
+    TaskScheduler scheduler(1);
+
+    // The only worker is kept busy until the gate opens, so the queued tasks can only be run by Wait
+    atomic<bool> bStarted(false), bGate(false);
+    future<void> blocking = scheduler.Submit([&bStarted, &bGate]
+    {
+        bStarted = true;
+        while(!bGate)
+            this_thread::sleep_for(chrono::milliseconds(1));
+    }, TaskScheduler::LOCAL_MAPPING);
+    while(!bStarted)
+        this_thread::sleep_for(chrono::milliseconds(1));
+
+    const thread::id mainId = this_thread::get_id();
+    atomic<bool> bHigherInMain(false), bSameInMain(false), bLowerInMain(false);
+    future<void> lower = scheduler.Submit([&]{ bLowerInMain = this_thread::get_id() == mainId; }, TaskScheduler::GLOBAL_BA);
+    future<void> same = scheduler.Submit([&]{ bSameInMain = this_thread::get_id() == mainId; }, TaskScheduler::LOCAL_MAPPING);
+    future<void> higher = scheduler.Submit([&]{ bHigherInMain = this_thread::get_id() == mainId; }, TaskScheduler::TRACKING);
+
+    // Opened while the main thread waits with the lower priority task still queued
+    thread opener([&bGate]
+    {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        bGate = true;
+    });
+
+    scheduler.Wait(blocking, TaskScheduler::LOCAL_MAPPING);
+    CHECK(bHigherInMain);
+    CHECK(bSameInMain);
+
+    opener.join();
+    scheduler.Wait(higher, TaskScheduler::LOCAL_MAPPING);
+    scheduler.Wait(same, TaskScheduler::LOCAL_MAPPING);
+
+    // Run by the worker once the gate opened, even if the main thread waits for it now
+    lower.wait();
+    CHECK(!bLowerInMain);
+}
+
+static void TestDestructorDrains()
+{
+    Watchdog watchdog("Destructor", 60);
+    atomic<int> nRun(0);
+    {
+        TaskScheduler scheduler(2);
+        for(int i=0; i<500; i++)
+        {
+            // The queue of the destroyed scheduler still grows while it drains
+            scheduler.Submit([&scheduler, &nRun]
+            {
+                this_thread::sleep_for(chrono::microseconds(50));
+                scheduler.Submit([&nRun]{ nRun++; }, TaskScheduler::GLOBAL_BA);
+                nRun++;
+            }, static_cast<TaskScheduler::ePriority>(i%TaskScheduler::NUM_PRIORITIES));
+        }
+    }
+    CHECK(nRun == 1000);
+}
+
+int main()
+{
+    TestParallelFor();
+    TestNestedWait();
+    TestException();
+    TestWaitPriority();
+    TestDestructorDrains();
+
+    return TEST_RESULT();
+}
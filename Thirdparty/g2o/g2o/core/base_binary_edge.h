@@ -53,6 +53,8 @@ namespace g2o {
       typedef typename BaseEdge<D,E>::Measurement Measurement;
       typedef typename Matrix<double, D, Di>::AlignedMapType JacobianXiOplusType;
       typedef typename Matrix<double, D, Dj>::AlignedMapType JacobianXjOplusType;
+      typedef Matrix<float, D, Di> JacobianXiOplusFloatType;
+      typedef Matrix<float, D, Dj> JacobianXjOplusFloatType;
       typedef typename BaseEdge<D,E>::ErrorVector ErrorVector;
       typedef typename BaseEdge<D,E>::InformationType InformationType;
 
@@ -88,7 +90,14 @@ namespace g2o {
       //! returns the result of the linearization in the manifold space for the node xj
       const JacobianXjOplusType& jacobianOplusXj() const { return _jacobianOplusXj;}
 
+      /**
+       * Jacobians of linearizeOplus() in single precision, for the mixed precision mode. Returns
+       * false if the edge does not have them, then the double ones are computed and cast.
+       */
+      virtual bool linearizeOplusFloat(JacobianXiOplusFloatType& /*A*/, JacobianXjOplusFloatType& /*B*/) { return false; }
+
       virtual void constructQuadraticForm() ;
+      virtual void linearizeAndConstructQuadraticFormFloat(JacobianWorkspace& jacobianWorkspace) ;
 
       virtual void mapHessianMemory(double* d, int i, int j, bool rowMajor);
 
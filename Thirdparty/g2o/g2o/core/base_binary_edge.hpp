@@ -66,56 +66,110 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
   bool toNotFixed = !(to->fixed());
 
   if (fromNotFixed || toNotFixed) {
-#ifdef G2O_OPENMP
-    from->lockQuadraticForm();
-    to->lockQuadraticForm();
-#endif
     const InformationType& omega = _information;
     Matrix<double, D, 1> omega_r = - omega * _error;
+    InformationType weightedOmega;
     if (this->robustKernel() == 0) {
-      if (fromNotFixed) {
-        Matrix<double, VertexXiType::Dimension, D> AtO = A.transpose() * omega;
-        from->b().noalias() += A.transpose() * omega_r;
-        from->A().noalias() += AtO*A;
-        if (toNotFixed ) {
-          if (_hessianRowMajor) // we have to write to the block as transposed
-            _hessianTransposed.noalias() += B.transpose() * AtO.transpose();
-          else
-            _hessian.noalias() += AtO * B;
-        }
-      } 
-      if (toNotFixed) {
-        to->b().noalias() += B.transpose() * omega_r;
-        to->A().noalias() += B.transpose() * omega * B;
-      }
+      weightedOmega = omega;
     } else { // robust (weighted) error according to some kernel
       double error = this->chi2();
       Eigen::Vector3d rho;
       this->robustKernel()->robustify(error, rho);
-      InformationType weightedOmega = this->robustInformation(rho);
+      weightedOmega = this->robustInformation(rho);
       //std::cout << PVAR(rho.transpose()) << std::endl;
       //std::cout << PVAR(weightedOmega) << std::endl;
-
       omega_r *= rho[1];
-      if (fromNotFixed) {
-        from->b().noalias() += A.transpose() * omega_r;
-        from->A().noalias() += A.transpose() * weightedOmega * A;
-        if (toNotFixed ) {
-          if (_hessianRowMajor) // we have to write to the block as transposed
-            _hessianTransposed.noalias() += B.transpose() * weightedOmega * A;
-          else
-            _hessian.noalias() += A.transpose() * weightedOmega * B;
-        }
-      } 
-      if (toNotFixed) {
-        to->b().noalias() += B.transpose() * omega_r;
-        to->A().noalias() += B.transpose() * weightedOmega * B;
+    }
+
+    // only one vertex is locked at a time, the off-diagonal block belongs to the vertex with
+    // the highest index in the hessian
+    if (fromNotFixed) {
+      Matrix<double, VertexXiType::Dimension, D> AtO = A.transpose() * weightedOmega;
+      from->lockQuadraticForm();
+      from->b().noalias() += A.transpose() * omega_r;
+      from->A().noalias() += AtO*A;
+      from->unlockQuadraticForm();
+      if (toNotFixed ) {
+        OptimizableGraph::Vertex* blockOwner = from->hessianIndex() > to->hessianIndex() ? static_cast<OptimizableGraph::Vertex*>(from) : static_cast<OptimizableGraph::Vertex*>(to);
+        blockOwner->lockQuadraticForm();
+        if (_hessianRowMajor) // we have to write to the block as transposed
+          _hessianTransposed.noalias() += B.transpose() * AtO.transpose();
+        else
+          _hessian.noalias() += AtO * B;
+        blockOwner->unlockQuadraticForm();
       }
     }
-#ifdef G2O_OPENMP
-    to->unlockQuadraticForm();
+    if (toNotFixed) {
+      to->lockQuadraticForm();
+      to->b().noalias() += B.transpose() * omega_r;
+      to->A().noalias() += B.transpose() * weightedOmega * B;
+      to->unlockQuadraticForm();
+    }
+  }
+}
+
+template <int D, typename E, typename VertexXiType, typename VertexXjType>
+void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeAndConstructQuadraticFormFloat(JacobianWorkspace& jacobianWorkspace)
+{
+  VertexXiType* from = static_cast<VertexXiType*>(_vertices[0]);
+  VertexXjType* to   = static_cast<VertexXjType*>(_vertices[1]);
+
+  bool fromNotFixed = !(from->fixed());
+  bool toNotFixed = !(to->fixed());
+
+  if (! (fromNotFixed || toNotFixed))
+    return;
+
+  // the robust kernel is evaluated in double, as the chi2 it depends on
+  InformationType weightedOmega;
+  double rhoPrime = 1.;
+  if (this->robustKernel() == 0) {
+    weightedOmega = _information;
+  } else {
+    Eigen::Vector3d rho;
+    this->robustKernel()->robustify(this->chi2(), rho);
+    weightedOmega = this->robustInformation(rho);
+    rhoPrime = rho[1];
+  }
+
+  JacobianXiOplusFloatType A;
+  JacobianXjOplusFloatType B;
+  if (! linearizeOplusFloat(A, B)) {
+    linearizeOplus(jacobianWorkspace);
+    A = jacobianOplusXi().template cast<float>();
+    B = jacobianOplusXj().template cast<float>();
+  }
+  const Matrix<float, D, D> omega = weightedOmega.template cast<float>();
+  const Matrix<float, D, 1> omega_r = (- rhoPrime * (_information * _error)).template cast<float>();
+
+  // same blocks as constructQuadraticForm()
+  if (fromNotFixed) {
+    const Matrix<float, Di, D> AtO = A.transpose() * omega;
+    const Matrix<float, Di, 1> bi = A.transpose() * omega_r;
+    const Matrix<float, Di, Di> Hii = AtO * A;
+    from->lockQuadraticForm();
+    from->b() += bi.template cast<double>();
+    from->A() += Hii.template cast<double>();
     from->unlockQuadraticForm();
-#endif
+    if (toNotFixed ) {
+      const Matrix<float, Di, Dj> Hij = AtO * B;
+      OptimizableGraph::Vertex* blockOwner = from->hessianIndex() > to->hessianIndex() ? static_cast<OptimizableGraph::Vertex*>(from) : static_cast<OptimizableGraph::Vertex*>(to);
+      blockOwner->lockQuadraticForm();
+      if (_hessianRowMajor) // we have to write to the block as transposed
+        _hessianTransposed += Hij.transpose().template cast<double>();
+      else
+        _hessian += Hij.template cast<double>();
+      blockOwner->unlockQuadraticForm();
+    }
+  }
+  if (toNotFixed) {
+    const Matrix<float, Dj, D> BtO = B.transpose() * omega;
+    const Matrix<float, Dj, 1> bj = B.transpose() * omega_r;
+    const Matrix<float, Dj, Dj> Hjj = BtO * B;
+    to->lockQuadraticForm();
+    to->b() += bj.template cast<double>();
+    to->A() += Hjj.template cast<double>();
+    to->unlockQuadraticForm();
   }
 }
 
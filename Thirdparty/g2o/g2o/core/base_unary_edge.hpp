@@ -50,9 +50,7 @@ void BaseUnaryEdge<D, E, VertexXiType>::constructQuadraticForm()
 
   bool istatus = !from->fixed();
   if (istatus) {
-#ifdef G2O_OPENMP
     from->lockQuadraticForm();
-#endif
     if (this->robustKernel()) {
       double error = this->chi2();
       Eigen::Vector3d rho;
@@ -65,9 +63,7 @@ void BaseUnaryEdge<D, E, VertexXiType>::constructQuadraticForm()
       from->b().noalias() -= A.transpose() * omega * _error;
       from->A().noalias() += A.transpose() * omega * A;
     }
-#ifdef G2O_OPENMP
     from->unlockQuadraticForm();
-#endif
   }
 }
 
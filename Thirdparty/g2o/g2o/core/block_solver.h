@@ -32,6 +32,7 @@
 #include "sparse_block_matrix.h"
 #include "sparse_block_matrix_diagonal.h"
 #include "openmp_mutex.h"
+#include "parallel_executor.h"
 #include "../../config.h"
 
 namespace g2o {
@@ -147,6 +148,26 @@ namespace g2o {
 
       void deallocate();
 
+      /**
+       * build the system with the threads of the parallel executor of the optimizer.
+       * The vertices lock their quadratic form while the edges add their blocks.
+       */
+      bool buildSystemParallel(ParallelExecutor* executor);
+      void linearizeEdgeChunk(int chunk);
+      void clearVertexQuadraticForm(int vertexIndex);
+      void copyVertexQuadraticForm(int vertexIndex);
+
+      /**
+       * subtract the contribution of a landmark from the Schur complement and the coefficients,
+       * or from a buffer with the layout of _schurBlockOffsets if schurBuffer is not null
+       */
+      void marginalizeLandmark(int landmarkIndex, double* schurBuffer);
+      void buildSchurBufferLayout();
+      void buildLandmarkChunks(int numThreads);
+      void marginalizeLandmarkChunk(int chunk);
+      void addSchurBuffers(int poseIndex);
+      void computeLandmarkIncrement(int landmarkIndex);
+
       SparseBlockMatrix<PoseMatrixType>* _Hpp;
       SparseBlockMatrix<LandmarkMatrixType>* _Hll;
       SparseBlockMatrix<PoseLandmarkMatrixType>* _Hpl;
@@ -168,6 +189,15 @@ namespace g2o {
 
       bool _doSchur;
 
+      int _edgeChunkSize;
+      // offset of each block of _HschurTransposedCCS in the buffers of the parallel Schur complement,
+      // followed by the coefficients
+      std::vector<int> _schurColumnStart;
+      std::vector<int> _schurBlockOffsets;
+      int _schurBlocksSize;
+      std::vector<int> _landmarkChunkBegin;
+      std::vector<std::vector<double> > _schurBuffers;
+
       double* _coefficients;
       double* _bschur;
 
@@ -28,6 +28,8 @@
 #include <Eigen/LU>
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
+#include <functional>
 
 #include "../stuff/timeutil.h"
 #include "../stuff/macros.h"
@@ -58,6 +60,8 @@ BlockSolver<Traits>::BlockSolver(LinearSolverType* linearSolver) :
   _numLandmarks=0;
   _sizePoses=0;
   _sizeLandmarks=0;
+  _edgeChunkSize=0;
+  _schurBlocksSize=0;
   _doSchur=true;
 }
 
@@ -290,6 +294,7 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
   _Hschur->takePatternFromHash(*schurMatrixLookup);
   delete schurMatrixLookup;
   _Hschur->fillSparseBlockMatrixCCSTransposed(*_HschurTransposedCCS);
+  buildSchurBufferLayout();
 
   return true;
 }
@@ -375,60 +380,20 @@ bool BlockSolver<Traits>::solve(){
 
   //_DInvSchur->clear();
   memset (_coefficients, 0, _sizePoses*sizeof(double));
+  ParallelExecutor* executor = _optimizer->parallelExecutor();
+  const bool parallelSchur = executor && executor->numThreads() > 1 && _numLandmarks > 100;
+  if (parallelSchur) {
+    // each chunk of landmarks accumulates its part of the Schur complement in its own buffer,
+    // the buffers are then added column by column
+    buildLandmarkChunks(executor->numThreads());
+    executor->parallelFor(0, static_cast<int>(_landmarkChunkBegin.size()) - 1, std::bind(&BlockSolver<Traits>::marginalizeLandmarkChunk, this, std::placeholders::_1), 1);
+    executor->parallelFor(0, _numPoses, std::bind(&BlockSolver<Traits>::addSchurBuffers, this, std::placeholders::_1), 4);
+  } else {
 # ifdef G2O_OPENMP
 # pragma omp parallel for default (shared) schedule(dynamic, 10)
 # endif
-  for (int landmarkIndex = 0; landmarkIndex < static_cast<int>(_Hll->blockCols().size()); ++landmarkIndex) {
-    const typename SparseBlockMatrix<LandmarkMatrixType>::IntBlockMap& marginalizeColumn = _Hll->blockCols()[landmarkIndex];
-    assert(marginalizeColumn.size() == 1 && "more than one block in _Hll column");
-
-    // calculate inverse block for the landmark
-    const LandmarkMatrixType * D = marginalizeColumn.begin()->second;
-    assert (D && D->rows()==D->cols() && "Error in landmark matrix");
-    LandmarkMatrixType& Dinv = _DInvSchur->diagonal()[landmarkIndex];
-    Dinv = D->inverse();
-
-    LandmarkVectorType  db(D->rows());
-    for (int j=0; j<D->rows(); ++j) {
-      db[j]=_b[_Hll->rowBaseOfBlock(landmarkIndex) + _sizePoses + j];
-    }
-    db=Dinv*db;
-
-    assert((size_t)landmarkIndex < _HplCCS->blockCols().size() && "Index out of bounds");
-    const typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn& landmarkColumn = _HplCCS->blockCols()[landmarkIndex];
-
-    for (typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it_outer = landmarkColumn.begin();
-        it_outer != landmarkColumn.end(); ++it_outer) {
-      int i1 = it_outer->row;
-
-      const PoseLandmarkMatrixType* Bi = it_outer->block;
-      assert(Bi);
-
-      PoseLandmarkMatrixType BDinv = (*Bi)*(Dinv);
-      assert(_HplCCS->rowBaseOfBlock(i1) < _sizePoses && "Index out of bounds");
-      typename PoseVectorType::MapType Bb(&_coefficients[_HplCCS->rowBaseOfBlock(i1)], Bi->rows());
-#    ifdef G2O_OPENMP
-      ScopedOpenMPMutex mutexLock(&_coefficientsMutex[i1]);
-#    endif
-      Bb.noalias() += (*Bi)*db;
-
-      assert(i1 >= 0 && i1 < static_cast<int>(_HschurTransposedCCS->blockCols().size()) && "Index out of bounds");
-      typename SparseBlockMatrixCCS<PoseMatrixType>::SparseColumn::iterator targetColumnIt = _HschurTransposedCCS->blockCols()[i1].begin();
-
-      typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::RowBlock aux(i1, 0);
-      typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it_inner = lower_bound(landmarkColumn.begin(), landmarkColumn.end(), aux);
-      for (; it_inner != landmarkColumn.end(); ++it_inner) {
-        int i2 = it_inner->row;
-        const PoseLandmarkMatrixType* Bj = it_inner->block;
-        assert(Bj); 
-        while (targetColumnIt->row < i2 /*&& targetColumnIt != _HschurTransposedCCS->blockCols()[i1].end()*/)
-          ++targetColumnIt;
-        assert(targetColumnIt != _HschurTransposedCCS->blockCols()[i1].end() && targetColumnIt->row == i2 && "invalid iterator, something wrong with the matrix structure");
-        PoseMatrixType* Hi1i2 = targetColumnIt->block;//_Hschur->block(i1,i2);
-        assert(Hi1i2);
-        (*Hi1i2).noalias() -= BDinv*Bj->transpose();
-      }
-    }
+    for (int landmarkIndex = 0; landmarkIndex < static_cast<int>(_Hll->blockCols().size()); ++landmarkIndex)
+      marginalizeLandmark(landmarkIndex, 0);
   }
   //cerr << "Solve [marginalize] = " <<  get_monotonic_time()-t << endl;
 
@@ -458,6 +423,11 @@ bool BlockSolver<Traits>::solve(){
 
   // _x contains the solution for the poses, now applying it to the landmarks to get the new part of the
   // solution;
+  if (parallelSchur) {
+    executor->parallelFor(0, _numLandmarks, std::bind(&BlockSolver<Traits>::computeLandmarkIncrement, this, std::placeholders::_1), 64);
+    return true;
+  }
+
   double* xp = _x;
   double* cp = _coefficients;
 
@@ -501,6 +471,10 @@ bool BlockSolver<Traits>::computeMarginals(SparseBlockMatrix<MatrixXd>& spinv, c
 template <typename Traits>
 bool BlockSolver<Traits>::buildSystem()
 {
+  ParallelExecutor* executor = _optimizer->parallelExecutor();
+  if (executor && executor->numThreads() > 1 && _optimizer->activeEdges().size() > 100)
+    return buildSystemParallel(executor);
+
   // clear b vector
 # ifdef G2O_OPENMP
 # pragma omp parallel for default (shared) if (_optimizer->indexMapping().size() > 1000)
@@ -518,6 +492,7 @@ bool BlockSolver<Traits>::buildSystem()
 
   // resetting the terms for the pairwise constraints
   // built up the current system by storing the Hessian blocks in the edges and vertices
+  const bool mixedPrecision = _optimizer->mixedPrecision();
 # ifndef G2O_OPENMP
   // no threading, we do not need to copy the workspace
   JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
@@ -528,6 +503,10 @@ bool BlockSolver<Traits>::buildSystem()
 # endif
   for (int k = 0; k < static_cast<int>(_optimizer->activeEdges().size()); ++k) {
     OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
+    if (mixedPrecision) {
+      e->linearizeAndConstructQuadraticFormFloat(jacobianWorkspace);
+      continue;
+    }
     e->linearizeOplus(jacobianWorkspace); // jacobian of the nodes' oplus (manifold)
     e->constructQuadraticForm();
 #  ifndef NDEBUG
@@ -560,6 +539,214 @@ bool BlockSolver<Traits>::buildSystem()
 }
 
 
+template <typename Traits>
+bool BlockSolver<Traits>::buildSystemParallel(ParallelExecutor* executor)
+{
+  const int numVertices = static_cast<int>(_optimizer->indexMapping().size());
+  executor->parallelFor(0, numVertices, std::bind(&BlockSolver<Traits>::clearVertexQuadraticForm, this, std::placeholders::_1), 64);
+  _Hpp->clear();
+  if (_doSchur) {
+    _Hll->clear();
+    _Hpl->clear();
+  }
+
+  // the edges keep their order, which is usually the order of the landmarks and the one with
+  // the best locality. Each chunk uses its own copy of the workspace.
+  const int numEdges = static_cast<int>(_optimizer->activeEdges().size());
+  _edgeChunkSize = std::max(32, numEdges / (4 * executor->numThreads()));
+  const int numChunks = (numEdges + _edgeChunkSize - 1) / _edgeChunkSize;
+  executor->parallelFor(0, numChunks, std::bind(&BlockSolver<Traits>::linearizeEdgeChunk, this, std::placeholders::_1), 1);
+
+  executor->parallelFor(0, numVertices, std::bind(&BlockSolver<Traits>::copyVertexQuadraticForm, this, std::placeholders::_1), 64);
+
+  return 0;
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::linearizeEdgeChunk(int chunk)
+{
+  JacobianWorkspace jacobianWorkspace = _optimizer->jacobianWorkspace();
+  const bool mixedPrecision = _optimizer->mixedPrecision();
+  const int first = chunk * _edgeChunkSize;
+  const int last = std::min(first + _edgeChunkSize, static_cast<int>(_optimizer->activeEdges().size()));
+  for (int k = first; k < last; ++k) {
+    OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
+    if (mixedPrecision) {
+      e->linearizeAndConstructQuadraticFormFloat(jacobianWorkspace);
+    } else {
+      e->linearizeOplus(jacobianWorkspace);
+      e->constructQuadraticForm();
+    }
+  }
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::clearVertexQuadraticForm(int vertexIndex)
+{
+  OptimizableGraph::Vertex* v = _optimizer->indexMapping()[vertexIndex];
+  v->clearQuadraticForm();
+  v->setQuadraticFormLocking(true);
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::copyVertexQuadraticForm(int vertexIndex)
+{
+  OptimizableGraph::Vertex* v = _optimizer->indexMapping()[vertexIndex];
+  v->setQuadraticFormLocking(false);
+  int iBase = v->colInHessian();
+  if (v->marginalized())
+    iBase += _sizePoses;
+  v->copyB(_b + iBase);
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::marginalizeLandmark(int landmarkIndex, double* schurBuffer)
+{
+  const typename SparseBlockMatrix<LandmarkMatrixType>::IntBlockMap& marginalizeColumn = _Hll->blockCols()[landmarkIndex];
+  assert(marginalizeColumn.size() == 1 && "more than one block in _Hll column");
+
+  // calculate inverse block for the landmark
+  const LandmarkMatrixType * D = marginalizeColumn.begin()->second;
+  assert (D && D->rows()==D->cols() && "Error in landmark matrix");
+  LandmarkMatrixType& Dinv = _DInvSchur->diagonal()[landmarkIndex];
+  Dinv = D->inverse();
+
+  LandmarkVectorType  db(D->rows());
+  for (int j=0; j<D->rows(); ++j) {
+    db[j]=_b[_Hll->rowBaseOfBlock(landmarkIndex) + _sizePoses + j];
+  }
+  db=Dinv*db;
+
+  assert((size_t)landmarkIndex < _HplCCS->blockCols().size() && "Index out of bounds");
+  const typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn& landmarkColumn = _HplCCS->blockCols()[landmarkIndex];
+
+  // without buffer the result goes directly to the Schur complement and the coefficients
+  double* coefficients = schurBuffer ? schurBuffer + _schurBlocksSize : _coefficients;
+
+  for (typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it_outer = landmarkColumn.begin();
+      it_outer != landmarkColumn.end(); ++it_outer) {
+    int i1 = it_outer->row;
+
+    const PoseLandmarkMatrixType* Bi = it_outer->block;
+    assert(Bi);
+
+    PoseLandmarkMatrixType BDinv = (*Bi)*(Dinv);
+    assert(_HplCCS->rowBaseOfBlock(i1) < _sizePoses && "Index out of bounds");
+    typename PoseVectorType::MapType Bb(&coefficients[_HplCCS->rowBaseOfBlock(i1)], Bi->rows());
+#    ifdef G2O_OPENMP
+    ScopedOpenMPMutex mutexLock(&_coefficientsMutex[i1]);
+#    endif
+    Bb.noalias() += (*Bi)*db;
+
+    assert(i1 >= 0 && i1 < static_cast<int>(_HschurTransposedCCS->blockCols().size()) && "Index out of bounds");
+    typename SparseBlockMatrixCCS<PoseMatrixType>::SparseColumn& targetColumn = _HschurTransposedCCS->blockCols()[i1];
+    typename SparseBlockMatrixCCS<PoseMatrixType>::SparseColumn::iterator targetColumnIt = targetColumn.begin();
+
+    typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::RowBlock aux(i1, 0);
+    typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it_inner = lower_bound(landmarkColumn.begin(), landmarkColumn.end(), aux);
+    for (; it_inner != landmarkColumn.end(); ++it_inner) {
+      int i2 = it_inner->row;
+      const PoseLandmarkMatrixType* Bj = it_inner->block;
+      assert(Bj); 
+      while (targetColumnIt->row < i2 /*&& targetColumnIt != _HschurTransposedCCS->blockCols()[i1].end()*/)
+        ++targetColumnIt;
+      assert(targetColumnIt != targetColumn.end() && targetColumnIt->row == i2 && "invalid iterator, something wrong with the matrix structure");
+      PoseMatrixType* Hi1i2 = targetColumnIt->block;//_Hschur->block(i1,i2);
+      assert(Hi1i2);
+      if (schurBuffer) {
+        double* bufferBlock = schurBuffer + _schurBlockOffsets[_schurColumnStart[i1] + (targetColumnIt - targetColumn.begin())];
+        Eigen::Map<PoseMatrixType> bufferHi1i2(bufferBlock, Hi1i2->rows(), Hi1i2->cols());
+        bufferHi1i2.noalias() -= BDinv*Bj->transpose();
+      } else {
+        (*Hi1i2).noalias() -= BDinv*Bj->transpose();
+      }
+    }
+  }
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::buildSchurBufferLayout()
+{
+  _schurColumnStart.resize(_numPoses + 1);
+  _schurBlockOffsets.clear();
+  _schurBlocksSize = 0;
+  for (int i1 = 0; i1 < _numPoses; ++i1) {
+    _schurColumnStart[i1] = _schurBlockOffsets.size();
+    const typename SparseBlockMatrixCCS<PoseMatrixType>::SparseColumn& column = _HschurTransposedCCS->blockCols()[i1];
+    for (size_t k = 0; k < column.size(); ++k) {
+      _schurBlockOffsets.push_back(_schurBlocksSize);
+      _schurBlocksSize += column[k].block->size();
+    }
+  }
+  _schurColumnStart[_numPoses] = _schurBlockOffsets.size();
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::buildLandmarkChunks(int numThreads)
+{
+  // one chunk per thread, balanced by the number of Schur blocks each landmark updates
+  const int numChunks = std::max(1, std::min(numThreads, _numLandmarks));
+  std::vector<double> cost(_numLandmarks + 1, 0.);
+  for (int landmarkIndex = 0; landmarkIndex < _numLandmarks; ++landmarkIndex) {
+    const double n = static_cast<double>(_HplCCS->blockCols()[landmarkIndex].size());
+    cost[landmarkIndex + 1] = cost[landmarkIndex] + n * (n + 1) / 2 + 1;
+  }
+  _landmarkChunkBegin.resize(numChunks + 1);
+  int landmarkIndex = 0;
+  for (int c = 0; c < numChunks; ++c) {
+    _landmarkChunkBegin[c] = landmarkIndex;
+    const double target = cost[_numLandmarks] * (c + 1) / numChunks;
+    while (landmarkIndex < _numLandmarks && cost[landmarkIndex + 1] <= target)
+      ++landmarkIndex;
+  }
+  _landmarkChunkBegin[numChunks] = _numLandmarks;
+  _schurBuffers.resize(numChunks);
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::marginalizeLandmarkChunk(int chunk)
+{
+  std::vector<double>& buffer = _schurBuffers[chunk];
+  buffer.assign(_schurBlocksSize + _sizePoses, 0.);
+  for (int landmarkIndex = _landmarkChunkBegin[chunk]; landmarkIndex < _landmarkChunkBegin[chunk + 1]; ++landmarkIndex)
+    marginalizeLandmark(landmarkIndex, &buffer[0]);
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::addSchurBuffers(int poseIndex)
+{
+  const typename SparseBlockMatrixCCS<PoseMatrixType>::SparseColumn& column = _HschurTransposedCCS->blockCols()[poseIndex];
+  typename PoseVectorType::MapType Bb(&_coefficients[_HplCCS->rowBaseOfBlock(poseIndex)], _HplCCS->rowsOfBlock(poseIndex));
+  for (size_t c = 0; c < _schurBuffers.size(); ++c) {
+    const double* buffer = &_schurBuffers[c][0];
+    for (size_t k = 0; k < column.size(); ++k) {
+      PoseMatrixType* Hi1i2 = column[k].block;
+      const double* bufferBlock = buffer + _schurBlockOffsets[_schurColumnStart[poseIndex] + k];
+      (*Hi1i2) += Eigen::Map<const PoseMatrixType>(bufferBlock, Hi1i2->rows(), Hi1i2->cols());
+    }
+    Bb += typename PoseVectorType::ConstMapType(buffer + _schurBlocksSize + _HplCCS->rowBaseOfBlock(poseIndex), Bb.rows());
+  }
+}
+
+template <typename Traits>
+void BlockSolver<Traits>::computeLandmarkIncrement(int landmarkIndex)
+{
+  // xl = Dinv * (bl - Bt * xp)
+  const int base = _Hll->rowBaseOfBlock(landmarkIndex) + _sizePoses;
+  const LandmarkMatrixType& Dinv = _DInvSchur->diagonal()[landmarkIndex];
+  typename LandmarkVectorType::MapType cl(_coefficients + base, Dinv.rows());
+  cl = typename LandmarkVectorType::ConstMapType(_b + base, Dinv.rows());
+
+  const typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn& landmarkColumn = _HplCCS->blockCols()[landmarkIndex];
+  for (typename SparseBlockMatrixCCS<PoseLandmarkMatrixType>::SparseColumn::const_iterator it = landmarkColumn.begin(); it != landmarkColumn.end(); ++it) {
+    typename PoseVectorType::ConstMapType xp(_x + _HplCCS->rowBaseOfBlock(it->row), it->block->rows());
+    cl.noalias() -= it->block->transpose() * xp;
+  }
+
+  typename LandmarkVectorType::MapType xl(_x + base, Dinv.rows());
+  xl.noalias() = Dinv*cl;
+}
+
 template <typename Traits>
 bool BlockSolver<Traits>::setLambda(double lambda, bool backup)
 {
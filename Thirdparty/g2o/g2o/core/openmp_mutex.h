@@ -29,6 +29,8 @@
 
 #include "../../config.h"
 
+#include <mutex>
+
 #ifdef G2O_OPENMP
 #include <omp.h>
 #else
@@ -78,6 +80,25 @@ namespace g2o {
 
 #endif
 
+  /**
+   * \brief Mutex of the quadratic form of a vertex when the system is built by the threads
+   * of a ParallelExecutor. It only locks when enabled, so the serial solver does not pay for it.
+   */
+  class QuadraticFormMutex
+  {
+    public:
+      QuadraticFormMutex() : _enabled(false) {}
+      //! copies get their own mutex, disabled
+      QuadraticFormMutex(const QuadraticFormMutex&) : _enabled(false) {}
+      QuadraticFormMutex& operator=(const QuadraticFormMutex&) { return *this;}
+      void setEnabled(bool enabled) { _enabled = enabled;}
+      void lock() { if (_enabled) _mutex.lock();}
+      void unlock() { if (_enabled) _mutex.unlock();}
+    protected:
+      std::mutex _mutex;
+      bool _enabled;
+  };
+
   /**
    * \brief lock a mutex within a scope
    */
@@ -335,6 +335,15 @@ namespace g2o {
          * unlock the block of the hessian and the b vector associated with this vertex
          */
         void unlockQuadraticForm() { _quadraticFormMutex.unlock();}
+        /**
+         * enable the lock of the quadratic form, needed while several threads build the system
+         * (the OpenMP build always locks)
+         */
+#ifdef G2O_OPENMP
+        void setQuadraticFormLocking(bool) {}
+#else
+        void setQuadraticFormLocking(bool enabled) { _quadraticFormMutex.setEnabled(enabled);}
+#endif
 
         //! read the vertex from a stream, i.e., the internal state of the vertex
         virtual bool read(std::istream& is) = 0;
@@ -352,7 +361,11 @@ namespace g2o {
         bool _marginalized;
         int _dimension;
         int _colInHessian;
+#ifdef G2O_OPENMP
         OpenMPMutex _quadraticFormMutex;
+#else
+        QuadraticFormMutex _quadraticFormMutex;
+#endif
 
         CacheContainer* _cacheContainer;
 
@@ -437,6 +450,17 @@ namespace g2o {
          */
         virtual void constructQuadraticForm() = 0;
 
+        /**
+         * linearizeOplus() and constructQuadraticForm() in single precision: the Jacobians and their
+         * products with the information matrix are computed in float and then added to the double
+         * precision blocks. Edges without a single precision version use the double one.
+         */
+        virtual void linearizeAndConstructQuadraticFormFloat(JacobianWorkspace& jacobianWorkspace)
+        {
+          linearizeOplus(jacobianWorkspace);
+          constructQuadraticForm();
+        }
+
         /**
          * maps the internal matrix to some external memory location,
          * you need to provide the memory before calling constructQuadraticForm
@@ -0,0 +1,57 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef G2O_PARALLEL_EXECUTOR_H
+#define G2O_PARALLEL_EXECUTOR_H
+
+#include <functional>
+
+namespace g2o {
+
+  /**
+   * \brief Runs the loops of the optimizer in several threads.
+   *
+   * The application provides the threads (e.g., its own thread pool) by implementing this
+   * interface and passing it to SparseOptimizer::setParallelExecutor(). The edges of a graph
+   * optimized in parallel must compute their Jacobians analytically, the numeric
+   * differentiation of the base edges perturbs the estimate of the shared vertices.
+   */
+  class ParallelExecutor
+  {
+    public:
+      virtual ~ParallelExecutor() {}
+      /**
+       * call f(i) for every i in [first, last) in chunks of grain indices, the call
+       * returns when all of them are done
+       */
+      virtual void parallelFor(int first, int last, const std::function<void(int)>& f, int grain = 1) = 0;
+      //! maximum number of threads running the chunks of a parallelFor
+      virtual int numThreads() const = 0;
+  };
+
+}
+
+#endif
@@ -48,7 +48,7 @@ namespace g2o{
 
 
   SparseOptimizer::SparseOptimizer() :
-    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false)
+    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false), _parallelExecutor(0), _mixedPrecision(false)
   {
     _graphActions.resize(AT_NUM_ELEMENTS);
   }
@@ -67,12 +67,16 @@ namespace g2o{
         (*(*it))(this);
     }
 
+    if (_parallelExecutor && _activeEdges.size() > 50) {
+      _parallelExecutor->parallelFor(0, _activeEdges.size(), std::bind(&SparseOptimizer::computeActiveError, this, std::placeholders::_1), 64);
+    } else {
 #   ifdef G2O_OPENMP
 #   pragma omp parallel for default (shared) if (_activeEdges.size() > 50)
 #   endif
-    for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
-      OptimizableGraph::Edge* e = _activeEdges[k];
-      e->computeError();
+      for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
+        OptimizableGraph::Edge* e = _activeEdges[k];
+        e->computeError();
+      }
     }
 
 #  ifndef NDEBUG
@@ -87,6 +91,11 @@ namespace g2o{
 
   }
 
+  void SparseOptimizer::computeActiveError(int k)
+  {
+    _activeEdges[k]->computeError();
+  }
+
   double SparseOptimizer::activeChi2( ) const
   {
     double chi = 0.0;
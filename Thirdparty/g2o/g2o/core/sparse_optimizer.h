@@ -32,6 +32,7 @@
 #include "optimizable_graph.h"
 #include "sparse_block_matrix.h"
 #include "batch_stats.h"
+#include "parallel_executor.h"
 
 #include <map>
 
@@ -278,6 +279,20 @@ namespace g2o {
     
     bool computeBatchStatistics() const { return _computeBatchStatistics;}
 
+    /**
+     * threads used to compute the errors and to build and solve the system, 0 (default) for
+     * the serial version. The executor is not owned by the optimizer.
+     */
+    void setParallelExecutor(ParallelExecutor* executor) { _parallelExecutor = executor;}
+    ParallelExecutor* parallelExecutor() const { return _parallelExecutor;}
+
+    /**
+     * mixed precision: the Hessian blocks of the edges are computed in single precision,
+     * the system is accumulated and solved in double precision. Off by default.
+     */
+    void setMixedPrecision(bool mixedPrecision) { _mixedPrecision = mixedPrecision;}
+    bool mixedPrecision() const { return _mixedPrecision;}
+
     /**** callbacks ****/
     //! add an action to be executed before the error vectors are computed
     bool addComputeErrorAction(HyperGraphAction* action);
@@ -295,6 +310,9 @@ namespace g2o {
     EdgeContainer _activeEdges;        ///< sorted according to EdgeIDCompare
 
     void sortVectorContainers();
+
+    //! error of the k-th active edge, body of the parallel computeActiveErrors()
+    void computeActiveError(int k);
  
     OptimizationAlgorithm* _algorithm;
 
@@ -306,6 +324,9 @@ namespace g2o {
 
     BatchStatisticsContainer _batchStatistics;   ///< global statistics of the optimizer, e.g., timing, num-non-zeros
     bool _computeBatchStatistics;
+
+    ParallelExecutor* _parallelExecutor;
+    bool _mixedPrecision;
   };
 } // end namespace
 
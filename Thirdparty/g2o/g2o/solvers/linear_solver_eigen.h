@@ -36,6 +36,7 @@
 
 #include "../core/eigen_types.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -96,7 +97,7 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
       if (_init)
         _sparseMatrix.resize(A.rows(), A.cols());
       fillSparseMatrix(A, !_init);
-      if (_init) // compute the symbolic composition once
+      if (_init && ! samePatternAsAnalyzed()) // compute the symbolic composition once
         computeSymbolicDecomposition(A);
       _init = false;
 
@@ -125,7 +126,7 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
 
     //! do the AMD ordering on the blocks or on the scalar matrix
     bool blockOrdering() const { return _blockOrdering;}
-    void setBlockOrdering(bool blockOrdering) { _blockOrdering = blockOrdering;}
+    void setBlockOrdering(bool blockOrdering) { _blockOrdering = blockOrdering; _analyzedOuterIndex.clear();}
 
     //! write a debug dump of the system matrix if it is not SPD in solve
     virtual bool writeDebug() const { return _writeDebug;}
@@ -137,6 +138,24 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
     bool _writeDebug;
     SparseMatrix _sparseMatrix;
     CholeskyDecomposition _cholesky;
+    //! pattern of the last symbolic decomposition, kept across init() calls
+    std::vector<int> _analyzedOuterIndex;
+    std::vector<int> _analyzedInnerIndex;
+
+    /**
+     * true if the pattern of _sparseMatrix is the one of the last symbolic decomposition,
+     * which can then be reused although the solver was initialized again (e.g., a graph
+     * which is kept between optimizations)
+     */
+    bool samePatternAsAnalyzed() const
+    {
+      const int cols = _sparseMatrix.cols();
+      const int nnz = _sparseMatrix.nonZeros();
+      if (static_cast<int>(_analyzedOuterIndex.size()) != cols + 1 || static_cast<int>(_analyzedInnerIndex.size()) != nnz)
+        return false;
+      return std::equal(_analyzedOuterIndex.begin(), _analyzedOuterIndex.end(), _sparseMatrix.outerIndexPtr()) &&
+        std::equal(_analyzedInnerIndex.begin(), _analyzedInnerIndex.end(), _sparseMatrix.innerIndexPtr());
+    }
 
     /**
      * compute the symbolic decompostion of the matrix only once.
@@ -195,6 +214,8 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
         _cholesky.analyzePatternWithPermutation(_sparseMatrix, scalarP);
 
       }
+      _analyzedOuterIndex.assign(_sparseMatrix.outerIndexPtr(), _sparseMatrix.outerIndexPtr() + _sparseMatrix.cols() + 1);
+      _analyzedInnerIndex.assign(_sparseMatrix.innerIndexPtr(), _sparseMatrix.innerIndexPtr() + _sparseMatrix.nonZeros());
       G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
       if (globalStats)
         globalStats->timeSymbolicDecomposition = get_monotonic_time() - t;
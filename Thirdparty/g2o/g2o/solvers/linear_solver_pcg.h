@@ -0,0 +1,131 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef G2O_LINEAR_SOLVER_PCG_H
+#define G2O_LINEAR_SOLVER_PCG_H
+
+#include "../core/linear_solver.h"
+#include "../core/batch_stats.h"
+#include "../core/matrix_operations.h"
+#include "../stuff/timeutil.h"
+
+#include "../core/eigen_types.h"
+
+#include <Eigen/StdVector>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace g2o {
+
+/**
+ * \brief linear solver using preconditioned conjugate gradient with a block-Jacobi preconditioner
+ *
+ * Only needs products of A with a vector, hence there is no fill-in and the
+ * cost of an iteration is linear in the number of non-zero blocks. Suited for
+ * the large reduced camera systems of global BA and for pose graphs, where the
+ * Cholesky factor gets dense.
+ *
+ * In inexact mode the tolerance of each solve is relative to the norm of the
+ * right hand side (the gradient), tightening as the optimization converges
+ * (truncated Newton). The Levenberg-Marquardt algorithm then takes cheap
+ * approximate steps far from the minimum and accurate ones close to it.
+ */
+template <typename MatrixType>
+class LinearSolverPCG : public LinearSolver<MatrixType>
+{
+  public:
+    typedef std::vector< MatrixType, Eigen::aligned_allocator<MatrixType> > MatrixVector;
+
+    LinearSolverPCG() :
+      LinearSolver<MatrixType>(),
+      _tolerance(1e-6), _maxIter(-1), _inexact(false), _maxForcingTerm(0.1),
+      _iterations(0), _residual(-1.)
+    {
+    }
+
+    virtual ~LinearSolverPCG()
+    {
+    }
+
+    virtual bool init()
+    {
+      _residual = -1.;
+      _iterations = 0;
+      return true;
+    }
+
+    bool solve(const SparseBlockMatrix<MatrixType>& A, double* x, double* b);
+
+    //! relative reduction of the residual to stop the iterations (exact mode)
+    double tolerance() const { return _tolerance;}
+    void setTolerance(double tolerance) { _tolerance = tolerance;}
+
+    //! maximum number of iterations per solve, -1 for the dimension of the system
+    int maxIterations() const { return _maxIter;}
+    void setMaxIterations(int maxIter) { _maxIter = maxIter;}
+
+    //! tolerance of each solve min(maxForcingTerm, sqrt(|b|)) instead of tolerance()
+    bool inexact() const { return _inexact;}
+    void setInexact(bool inexact) { _inexact = inexact;}
+    double maxForcingTerm() const { return _maxForcingTerm;}
+    void setMaxForcingTerm(double eta) { _maxForcingTerm = eta;}
+
+    //! iterations and relative residual of the last solve
+    int iterations() const { return _iterations;}
+    double residual() const { return _residual;}
+
+  protected:
+    double _tolerance;
+    int _maxIter;
+    bool _inexact;
+    double _maxForcingTerm;
+
+    int _iterations;
+    double _residual;
+
+    //! diagonal blocks, their inverse (preconditioner) and offsets
+    std::vector<const MatrixType*> _diag;
+    MatrixVector _J;
+    std::vector<int> _diagOffsets;
+    //! strictly upper triangular blocks and their row/column offsets
+    std::vector<const MatrixType*> _offDiag;
+    std::vector<std::pair<int, int> > _offDiagOffsets;
+
+    //! dest = A * src with the blocks collected by collectBlocks()
+    void multiply(const double* src, double* dest) const;
+    //! dest = J * src (block-Jacobi preconditioner)
+    void precondition(const double* src, double* dest) const;
+    bool collectBlocks(const SparseBlockMatrix<MatrixType>& A);
+};
+
+} // end namespace
+
+#include "linear_solver_pcg.hpp"
+
+#endif
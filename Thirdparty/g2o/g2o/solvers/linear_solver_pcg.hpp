@@ -0,0 +1,153 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+namespace g2o {
+
+template <typename MatrixType>
+bool LinearSolverPCG<MatrixType>::collectBlocks(const SparseBlockMatrix<MatrixType>& A)
+{
+  // the blocks are collected in every solve, the Levenberg-Marquardt damping
+  // and the Schur complement may have reallocated them
+  const size_t n = A.blockCols().size();
+  _diag.assign(n, static_cast<const MatrixType*>(0));
+  _diagOffsets.resize(n);
+  _J.resize(n);
+  _offDiag.clear();
+  _offDiagOffsets.clear();
+
+  for (size_t c = 0; c < n; ++c) {
+    const int colBase = A.colBaseOfBlock(c);
+    _diagOffsets[c] = colBase;
+    const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
+    for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+      const int r = it->first;
+      if (r > static_cast<int>(c)) // only upper triangle
+        break;
+      if (r == static_cast<int>(c)) {
+        _diag[c] = it->second;
+      } else {
+        _offDiag.push_back(it->second);
+        _offDiagOffsets.push_back(std::make_pair(A.rowBaseOfBlock(r), colBase));
+      }
+    }
+    if (! _diag[c])
+      return false;
+    _J[c] = _diag[c]->inverse();
+  }
+  return true;
+}
+
+template <typename MatrixType>
+void LinearSolverPCG<MatrixType>::multiply(const double* src, double* dest) const
+{
+  const int size = _diagOffsets.empty() ? 0 : _diagOffsets.back() + _diag.back()->cols();
+  Eigen::Map<VectorXD> destVec(dest, size);
+  const Eigen::Map<const VectorXD> srcVec(src, size);
+  destVec.setZero();
+  for (size_t i = 0; i < _diag.size(); ++i)
+    internal::axpy(*_diag[i], srcVec, _diagOffsets[i], destVec, _diagOffsets[i]);
+  for (size_t i = 0; i < _offDiag.size(); ++i) {
+    const int rowBase = _offDiagOffsets[i].first;
+    const int colBase = _offDiagOffsets[i].second;
+    internal::axpy(*_offDiag[i], srcVec, colBase, destVec, rowBase);
+    internal::atxpy(*_offDiag[i], srcVec, rowBase, destVec, colBase);
+  }
+}
+
+template <typename MatrixType>
+void LinearSolverPCG<MatrixType>::precondition(const double* src, double* dest) const
+{
+  const int size = _diagOffsets.empty() ? 0 : _diagOffsets.back() + _diag.back()->cols();
+  Eigen::Map<VectorXD> destVec(dest, size);
+  const Eigen::Map<const VectorXD> srcVec(src, size);
+  for (size_t i = 0; i < _J.size(); ++i) {
+    const int base = _diagOffsets[i];
+    destVec.segment(base, _J[i].rows()) = _J[i] * srcVec.segment(base, _J[i].cols());
+  }
+}
+
+template <typename MatrixType>
+bool LinearSolverPCG<MatrixType>::solve(const SparseBlockMatrix<MatrixType>& A, double* x, double* b)
+{
+  double t = get_monotonic_time();
+  const int n = A.rows();
+  VectorXD::MapType xvec(x, n);
+  VectorXD::ConstMapType bvec(b, n);
+  xvec.setZero();
+  _iterations = 0;
+  _residual = 0.;
+
+  if (! collectBlocks(A))
+    return false;
+
+  const double bNorm = bvec.norm();
+  if (bNorm == 0.)
+    return true;
+
+  double eta = _tolerance;
+  if (_inexact)
+    eta = std::min(_maxForcingTerm, std::sqrt(bNorm));
+  const double threshold = eta * eta * bNorm * bNorm;
+  const int maxIter = _maxIter < 0 ? n : std::min(_maxIter, n);
+
+  // x0 = 0, hence r0 = b
+  VectorXD r = bvec;
+  VectorXD z(n);
+  VectorXD p(n);
+  VectorXD q(n);
+  precondition(r.data(), z.data());
+  p = z;
+  double rz = r.dot(z);
+  double rr = r.squaredNorm();
+
+  while (rr > threshold && _iterations < maxIter) {
+    multiply(p.data(), q.data());
+    const double pq = p.dot(q);
+    if (! (pq > 0.)) // A is not positive definite along p, keep the last iterate
+      break;
+    const double alpha = rz / pq;
+    xvec += alpha * p;
+    r -= alpha * q;
+    rr = r.squaredNorm();
+    ++_iterations;
+
+    precondition(r.data(), z.data());
+    const double rzNew = r.dot(z);
+    p = z + (rzNew / rz) * p;
+    rz = rzNew;
+  }
+  _residual = std::sqrt(rr) / bNorm;
+
+  G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
+  if (globalStats) {
+    globalStats->timeNumericDecomposition = get_monotonic_time() - t;
+    globalStats->iterationsLinearSolver = _iterations;
+  }
+
+  return xvec.allFinite();
+}
+
+} // end namespace
@@ -273,6 +273,54 @@ void EdgeStereoSE3ProjectXYZ::linearizeOplus() {
   _jacobianOplusXj(2,5) = _jacobianOplusXj(0,5)-bf/z_2;
 }
 
+bool EdgeStereoSE3ProjectXYZ::linearizeOplusFloat(Matrix<float,3,3> & A, Matrix<float,3,6> & B) {
+  const VertexSE3Expmap * vj = static_cast<const VertexSE3Expmap *>(_vertices[1]);
+  const SE3Quat & T = vj->estimate();
+  const VertexSBAPointXYZ* vi = static_cast<const VertexSBAPointXYZ*>(_vertices[0]);
+  const Matrix3f R = T.rotation().toRotationMatrix().cast<float>();
+  const Vector3f xyz_trans = R*vi->estimate().cast<float>() + T.translation().cast<float>();
+
+  const float fx_ = fx, fy_ = fy, bf_ = bf;
+  const float x = xyz_trans[0];
+  const float y = xyz_trans[1];
+  const float z = xyz_trans[2];
+  const float z_2 = z*z;
+
+  A(0,0) = -fx_*R(0,0)/z+fx_*x*R(2,0)/z_2;
+  A(0,1) = -fx_*R(0,1)/z+fx_*x*R(2,1)/z_2;
+  A(0,2) = -fx_*R(0,2)/z+fx_*x*R(2,2)/z_2;
+
+  A(1,0) = -fy_*R(1,0)/z+fy_*y*R(2,0)/z_2;
+  A(1,1) = -fy_*R(1,1)/z+fy_*y*R(2,1)/z_2;
+  A(1,2) = -fy_*R(1,2)/z+fy_*y*R(2,2)/z_2;
+
+  A(2,0) = A(0,0)-bf_*R(2,0)/z_2;
+  A(2,1) = A(0,1)-bf_*R(2,1)/z_2;
+  A(2,2) = A(0,2)-bf_*R(2,2)/z_2;
+
+  B(0,0) =  x*y/z_2 *fx_;
+  B(0,1) = -(1+(x*x/z_2)) *fx_;
+  B(0,2) = y/z *fx_;
+  B(0,3) = -1.f/z *fx_;
+  B(0,4) = 0;
+  B(0,5) = x/z_2 *fx_;
+
+  B(1,0) = (1+y*y/z_2) *fy_;
+  B(1,1) = -x*y/z_2 *fy_;
+  B(1,2) = -x/z *fy_;
+  B(1,3) = 0;
+  B(1,4) = -1.f/z *fy_;
+  B(1,5) = y/z_2 *fy_;
+
+  B(2,0) = B(0,0)-bf_*y/z_2;
+  B(2,1) = B(0,1)+bf_*x/z_2;
+  B(2,2) = B(0,2);
+  B(2,3) = B(0,3);
+  B(2,4) = 0;
+  B(2,5) = B(0,5)-bf_/z_2;
+  return true;
+}
+
 
 //Only Pose
 
@@ -168,6 +168,8 @@ public:
 
 
   virtual void linearizeOplus();
+  // Jacobians in float, for the mixed precision mode
+  virtual bool linearizeOplusFloat(Matrix<float,3,3> & A, Matrix<float,3,6> & B);
 
   Vector3d cam_project(const Vector3d & trans_xyz, const float &bf) const;
 
@@ -28,6 +28,7 @@
 
 #include <set>
 #include <mutex>
+#include <atomic>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/export.hpp>
 
@@ -42,6 +43,8 @@ class KeyFrameDatabase;
 class Frame;
 class KannalaBrandt8;
 class Pinhole;
+class TaskScheduler;
+class MappedFile;
 
 //BOOST_CLASS_EXPORT_GUID(Pinhole, "Pinhole")
 //BOOST_CLASS_EXPORT_GUID(KannalaBrandt8, "KannalaBrandt8")
@@ -60,15 +63,30 @@ class Atlas
         //ar & mspMaps;
         ar & mvpBackupMaps;
         ar & mvpCameras;
-        // Need to save/load the static Id from Frame, KeyFrame, MapPoint and Map
-        ar & Map::nNextId;
-        ar & Frame::nNextId;
-        ar & KeyFrame::nNextId;
-        ar & MapPoint::nNextId;
-        ar & GeometricCamera::nNextId;
+        // Need to save/load the static Id from KeyFrame, MapPoint and Map, and the frame Id of this atlas
+        long unsigned int nNextMapId = Map::nNextId;
+        long unsigned int nNextFrameId = mnNextFrameId;
+        long unsigned int nNextKFId = KeyFrame::nNextId;
+        long unsigned int nNextMPId = MapPoint::nNextId;
+        long unsigned int nNextCamId = GeometricCamera::nNextId;
+        ar & nNextMapId;
+        ar & nNextFrameId;
+        ar & nNextKFId;
+        ar & nNextMPId;
+        ar & nNextCamId;
         ar & mnLastInitKFidMap;
+        if(Archive::is_loading::value)
+        {
+            AdvanceNextId(Map::nNextId, nNextMapId);
+            mnNextFrameId = nNextFrameId;
+            AdvanceNextId(KeyFrame::nNextId, nNextKFId);
+            AdvanceNextId(MapPoint::nNextId, nNextMPId);
+            AdvanceNextId(GeometricCamera::nNextId, nNextCamId);
+        }
     }
 
+    friend class AtlasFile;
+
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
@@ -125,7 +143,8 @@ public:
 
     // Function for garantee the correction of serialization of this object
     void PreSave();
-    void PostLoad();
+    // With a scheduler the references inside each map are rebuilt in parallel
+    void PostLoad(TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL));
 
     map<long unsigned int, KeyFrame*> GetAtlasKeyframes();
 
@@ -139,6 +158,15 @@ public:
 
     long unsigned int GetNumLivedMP();
 
+    // Frame ids are counted per atlas, the tracking needs them consecutive
+    long unsigned int NewFrameId();
+    long unsigned int GetNextFrameId();
+    void SetNextFrameId(long unsigned int nId);
+
+    // The KeyFrame, MapPoint, Map and camera ids are shared by all the systems of the process,
+    // a loaded counter can only move them forward
+    static void AdvanceNextId(std::atomic<long unsigned int> &nNextId, long unsigned int nId);
+
 protected:
 
     std::set<Map*> mspMaps;
@@ -152,6 +180,8 @@ protected:
 
     unsigned long int mnLastInitKFidMap;
 
+    std::atomic<long unsigned int> mnNextFrameId;
+
     Viewer* mpViewer;
     bool mHasViewer;
 
@@ -159,6 +189,12 @@ protected:
     KeyFrameDatabase* mpKeyFrameDB;
     ORBVocabulary* mpORBVocabulary;
 
+    // Atlas file mapped in memory, the descriptors of the loaded keyframes point into it
+    MappedFile* mpMappedFile;
+
+    // Inverted file of the keyframe database read from the atlas file (KeyFrameDatabase::EncodeInvertedFile)
+    std::string mBackupInvertedFile;
+
     // Mutex
     std::mutex mMutexAtlas;
 
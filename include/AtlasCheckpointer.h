@@ -0,0 +1,104 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef ATLASCHECKPOINTER_H
+#define ATLASCHECKPOINTER_H
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+class Atlas;
+class TaskScheduler;
+
+// Periodic checkpoints of the atlas while the system runs. Each checkpoint appends to the journal
+// (<file>.journal) only the keyframes and points changed since the previous one, found by the epoch
+// of their map they store when they change (MarkChanged), and the ids of the ones removed. When the journal grows
+// bigger than the base file (<file>) it is moved aside and compacted into a new base file in another
+// thread. After a crash, Load rebuilds the atlas of the last complete checkpoint.
+class AtlasCheckpointer
+{
+public:
+    // With bResume the atlas was loaded from these checkpoint files, otherwise they are started again
+    AtlasCheckpointer(Atlas* pAtlas, const std::string &strFile, const double period, const std::string &strVocName,
+                      const std::string &strVocChecksum, TaskScheduler* pScheduler, const bool bResume);
+    ~AtlasCheckpointer();
+
+    // Main function, a checkpoint every period (seconds) and a last one when finished
+    void Run();
+
+    void RequestFinish();
+    bool isFinished();
+
+    // Returns false if the record could not be written, the next checkpoint saves everything then
+    bool Checkpoint();
+
+    static std::string JournalFile(const std::string &strFile);
+    // Journal being compacted into the base file
+    static std::string CompactingFile(const std::string &strFile);
+
+    static Atlas* Load(const std::string &strFile, std::string &strVocName, std::string &strVocChecksum,
+                       TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL));
+
+    // The journal is compacted when it is bigger than the base file and than this size
+    static const size_t MIN_COMPACTION_SIZE = 64 << 20;
+
+protected:
+    typedef std::map<unsigned long, std::vector<unsigned long> > IdsByMap;
+
+    // Sorted ids of the keyframes and points of each map with keyframes
+    void CollectIds(IdsByMap &mKeyFrameIds, IdsByMap &mMapPointIds);
+
+    void StartCompaction();
+    void Compact();
+
+    Atlas* mpAtlas;
+    std::string mStrFile;
+    double mPeriod;
+    std::string mStrVocName;
+    std::string mStrVocChecksum;
+    TaskScheduler* mpScheduler;
+
+    // Save every object in the next checkpoint
+    bool mbFull;
+
+    // Objects in the last checkpoint, to find the ones removed
+    IdsByMap mmRecordedKeyFrames;
+    IdsByMap mmRecordedMapPoints;
+
+    std::thread* mptCompaction;
+    std::mutex mMutexCompaction;
+    bool mbCompacting;
+
+    std::mutex mMutexFinish;
+    std::condition_variable mCondFinish;
+    bool mbFinishRequested;
+    bool mbFinished;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // ATLASCHECKPOINTER_H
@@ -0,0 +1,243 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef ATLASFILE_H
+#define ATLASFILE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+class Atlas;
+class Map;
+class KeyFrame;
+class MapPoint;
+class MappedFile;
+class TaskScheduler;
+
+// Chunked binary format of the atlas (.osa files).
+//   header:   magic, format version, number of sections and position of the index table
+//   sections: ATLAS (vocabulary, cameras and id counters), then for each map a MAP section with
+//             the fields of the map, followed by KEYFRAMES and MAPPOINTS sections with contiguous
+//             blocks of up to KEYFRAMES_PER_SECTION / MAPPOINTS_PER_SECTION objects. Each KEYFRAMES
+//             section is followed by a DESCRIPTORS section with the raw descriptor matrices of its
+//             keyframes (version 2, in version 1 they are inside the keyframe records). The INVERTED_FILE
+//             section has the keyframe database (KeyFrameDatabase::EncodeInvertedFile), so it is not
+//             rebuilt from the BoW vectors of the keyframes.
+//   index:    type, map id, number of objects, offset and size of every section
+// The objects of a section are encoded with their boost serialization in an archive of their own,
+// so the sections are decoded independently (in parallel with a scheduler). Files without the magic
+// are the single boost archive of previous versions and are loaded by System as before.
+// Sections start at multiples of SECTION_ALIGNMENT and the descriptor matrices inside them too, so
+// they can be used in place when the file is mapped in memory.
+//
+// A checkpoint journal is a sequence of records with this same layout (offsets from the start of the
+// record), appended one after the other at aligned positions. Each record has the MAP sections of
+// the current maps, the keyframes and points changed since the previous record, the ERASED sections
+// with the ids of the ones removed and the ATLAS section. The header of a record is completed at the
+// end of its write, so a record cut by a crash is ignored with the ones after it.
+class AtlasFile
+{
+public:
+    enum eSectionType{
+        ATLAS_SECTION=0,
+        MAP_SECTION=1,
+        KEYFRAMES_SECTION=2,
+        MAPPOINTS_SECTION=3,
+        DESCRIPTORS_SECTION=4,
+        ERASED_KEYFRAMES_SECTION=5,
+        ERASED_MAPPOINTS_SECTION=6,
+        ERASED_MAP_SECTION=7,
+        INVERTED_FILE_SECTION=8
+    };
+
+    // Changes of a map since the previous checkpoint
+    struct MapDelta
+    {
+        Map* pMap;
+        // Objects in the map, only the references to them are saved
+        std::set<KeyFrame*> spKeyFrames;
+        std::set<MapPoint*> spMapPoints;
+        // New or changed
+        std::vector<KeyFrame*> vpKeyFrames;
+        std::vector<MapPoint*> vpMapPoints;
+        // Ids of the objects removed from the map
+        std::vector<uint64_t> vnErasedKeyFrames;
+        std::vector<uint64_t> vnErasedMapPoints;
+    };
+
+    struct SectionEntry
+    {
+        uint32_t nType;
+        uint32_t nObjects;
+        uint64_t nMapId;
+        uint64_t nOffset;
+        uint64_t nSize;
+    };
+
+    // Descriptors of one keyframe, the offset is from the beginning of the section
+    struct DescriptorRecord
+    {
+        uint64_t nKFId;
+        int32_t nRows;
+        int32_t nCols;
+        int32_t nType;
+        uint32_t nReserved;
+        uint64_t nOffset;
+    };
+
+    static const char MAGIC[8];
+    // Files with a higher version are rejected
+    static const uint32_t VERSION = 2;
+
+    static const size_t SECTION_ALIGNMENT = 64;
+
+    static const int KEYFRAMES_PER_SECTION = 128;
+    static const int MAPPOINTS_PER_SECTION = 4096;
+
+    static bool IsAtlasFile(const std::string &strFile);
+
+    // Flushes a file, or a directory after a rename in it, to the disk
+    static bool Sync(const std::string &strPath);
+
+    // Each map is locked (map update mutex) only while it is converted to ids (Map::PreSave) and
+    // encoded, the file is written by another thread meanwhile. Tracking can go on during the save,
+    // Local Mapping must be stopped or finished because it changes the covisibility graph out of
+    // that lock.
+    static bool Save(const std::string &strFile, Atlas* pAtlas, const std::string &strVocName, const std::string &strVocChecksum,
+                     TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL));
+
+    // Returns the atlas ready for Atlas::PostLoad, NULL if the file could not be read. The file is
+    // mapped in memory to decode it. With bMapDescriptors the mapping is kept by the atlas and the
+    // keyframe descriptors point into it: they are paged in when a matcher reads them and, being
+    // clean file pages, the kernel can drop them again under memory pressure. Otherwise they are
+    // copied and the file is unmapped.
+    static Atlas* Load(const std::string &strFile, std::string &strVocName, std::string &strVocChecksum,
+                       TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL), const bool bMapDescriptors = false);
+
+    // Appends a record to the journal. Each map is locked (map update mutex, shared) while its changed
+    // objects are converted to ids and encoded, so Tracking goes on and only the threads correcting the
+    // map wait. Returns false if the record could not be written completely.
+    static bool AppendCheckpoint(const std::string &strJournal, Atlas* pAtlas, std::vector<MapDelta> &vDeltas,
+                                 const std::vector<uint64_t> &vnErasedMaps, const std::string &strVocName,
+                                 const std::string &strVocChecksum, TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL));
+
+    // Atlas of a base file (it can be missing) with the journals replayed in order, ready for
+    // Atlas::PostLoad. NULL if there is nothing to load.
+    static Atlas* LoadCheckpoint(const std::string &strBase, const std::vector<std::string> &vstrJournals, std::string &strVocName,
+                                 std::string &strVocChecksum, TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL));
+
+    // Writes in strOut the base file with the journals replayed. Only the encoded objects are handled,
+    // the id counters of the system are not changed, so it can run in the background.
+    static bool Compact(const std::string &strBase, const std::vector<std::string> &vstrJournals, const std::string &strOut,
+                        TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL));
+
+protected:
+    // Latest contents of every map of a base file and its journals, by id
+    struct AtlasState;
+
+    static bool ReadState(const std::string &strBase, const std::vector<std::string> &vstrJournals, AtlasState &state,
+                          TaskScheduler* pScheduler, const bool bBackground);
+    static void ApplyRecord(const MappedFile &file, const uint32_t nVersion, const std::vector<SectionEntry> &vIndex,
+                            AtlasState &state, TaskScheduler* pScheduler, const bool bBackground);
+    static Atlas* BuildAtlas(AtlasState &state, std::string &strVocName, std::string &strVocChecksum);
+    static bool WriteState(const std::string &strFile, AtlasState &state, TaskScheduler* pScheduler);
+    static void ClearState(AtlasState &state);
+
+    // Cameras, id counters and vocabulary of the atlas
+    static std::string* EncodeAtlasSection(Atlas* pAtlas, const std::string &strVocName, const std::string &strVocChecksum);
+    static void DecodeAtlasSection(const char* pData, const size_t nSize, Atlas* pAtlas, std::string &strVocName, std::string &strVocChecksum);
+};
+
+// Read-only mapping of a whole file (private, so writes to the pages never reach the file)
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const std::string &strFile);
+    void Close();
+
+    const char* Data() const;
+    size_t Size() const;
+
+    // Access pattern hints for the kernel readahead
+    void AdviseSequential();
+    void AdviseRandom();
+
+protected:
+    char* mpData;
+    size_t mnSize;
+};
+
+// Appends the sections to the file in its own thread, the caller goes on encoding the next ones.
+// Close writes the index table and the final header.
+class AtlasFileWriter
+{
+public:
+    AtlasFileWriter();
+    ~AtlasFileWriter();
+
+    // With bAppend the sections are written as a new record at the end of the file (journal)
+    bool Open(const std::string &strFile, const bool bAppend = false);
+
+    // The writer takes the ownership of pData
+    void Push(const AtlasFile::eSectionType type, const unsigned long int nMapId, const unsigned int nObjects, std::string* pData);
+
+    // Waits for the pending sections. Returns false if a write failed.
+    bool Close();
+
+protected:
+    struct PendingSection
+    {
+        AtlasFile::SectionEntry entry;
+        std::string* pData;
+    };
+
+    void Run();
+
+    std::ofstream mFile;
+    std::string mStrFile;
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::deque<PendingSection> mdPending;
+    bool mbClosing;
+
+    std::vector<AtlasFile::SectionEntry> mvIndex;
+    // Start of the record in the file, the offsets are from it
+    uint64_t mnBase;
+    uint64_t mnOffset;
+    bool mbFailed;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // ATLASFILE_H
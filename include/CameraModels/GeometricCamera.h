@@ -20,6 +20,8 @@
 #define CAMERAMODELS_GEOMETRICCAMERA_H
 
 #include <vector>
+#include <atomic>
+#include <mutex>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -69,6 +71,8 @@ namespace ORB_SLAM3 {
         virtual cv::Point3f unproject(const cv::Point2f &p2D) = 0;
 
         virtual Eigen::Matrix<double,2,3> projectJac(const Eigen::Vector3d& v3D) = 0;
+        // Single precision, for the mixed precision bundle adjustment
+        virtual Eigen::Matrix<float,2,3> projectJac(const Eigen::Vector3f& v3D) = 0;
 
         virtual bool ReconstructWithTwoViews(const std::vector<cv::KeyPoint>& vKeys1, const std::vector<cv::KeyPoint>& vKeys2, const std::vector<int> &vMatches12,
                                              Sophus::SE3f &T21, std::vector<cv::Point3f> &vP3D, std::vector<bool> &vbTriangulated) = 0;
@@ -79,7 +83,34 @@ namespace ORB_SLAM3 {
         virtual bool epipolarConstrain(GeometricCamera* otherCamera, const cv::KeyPoint& kp1, const cv::KeyPoint& kp2, const Eigen::Matrix3f& R12, const Eigen::Vector3f& t12, const float sigmaLevel, const float unc) = 0;
 
         float getParameter(const int i){return mvParameters[i];}
-        void setParameter(const float p, const size_t i){mvParameters[i] = p;}
+        void setParameter(const float p, const size_t i)
+        {
+            mvParameters[i] = p;
+            std::unique_lock<std::mutex> lock(mMutexBounds);
+            mBoundsSize = cv::Size();
+        }
+
+        // Bounds of the undistorted image (minX, maxX, minY, maxY) computed by the first Frame with this image
+        // size, distortion and K, so the next frames do not undistort the corners again
+        bool GetImageBounds(const cv::Size &size, const cv::Mat &distCoef, const cv::Mat &K, float vBounds[4])
+        {
+            std::unique_lock<std::mutex> lock(mMutexBounds);
+            if(size != mBoundsSize || !SameMat(distCoef, mBoundsDistCoef) || !SameMat(K, mBoundsK))
+                return false;
+            for(int i=0; i<4; i++)
+                vBounds[i] = mvBounds[i];
+            return true;
+        }
+
+        void SetImageBounds(const cv::Size &size, const cv::Mat &distCoef, const cv::Mat &K, const float vBounds[4])
+        {
+            std::unique_lock<std::mutex> lock(mMutexBounds);
+            mBoundsSize = size;
+            mBoundsDistCoef = distCoef.clone();
+            mBoundsK = K.clone();
+            for(int i=0; i<4; i++)
+                mvBounds[i] = vBounds[i];
+        }
 
         size_t size(){return mvParameters.size();}
 
@@ -95,14 +126,26 @@ namespace ORB_SLAM3 {
         const static unsigned int CAM_PINHOLE = 0;
         const static unsigned int CAM_FISHEYE = 1;
 
-        static long unsigned int nNextId;
+        static std::atomic<long unsigned int> nNextId;
 
     protected:
+        static bool SameMat(const cv::Mat &a, const cv::Mat &b)
+        {
+            return a.size() == b.size() && a.type() == b.type() && (a.empty() || cv::norm(a, b, cv::NORM_INF) == 0.0);
+        }
+
         std::vector<float> mvParameters;
 
         unsigned int mnId;
 
         unsigned int mnType;
+
+        // Image bounds of the frames, empty size if they are not computed
+        std::mutex mMutexBounds;
+        cv::Size mBoundsSize;
+        cv::Mat mBoundsDistCoef;
+        cv::Mat mBoundsK;
+        float mvBounds[4];
     };
 }
 
@@ -73,6 +73,7 @@ namespace ORB_SLAM3 {
         cv::Point3f unproject(const cv::Point2f &p2D);
 
         Eigen::Matrix<double,2,3> projectJac(const Eigen::Vector3d& v3D);
+        Eigen::Matrix<float,2,3> projectJac(const Eigen::Vector3f& v3D);
 
 
         bool ReconstructWithTwoViews(const std::vector<cv::KeyPoint>& vKeys1, const std::vector<cv::KeyPoint>& vKeys2, const std::vector<int> &vMatches12,
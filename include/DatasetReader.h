@@ -0,0 +1,131 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef DATASETREADER_H
+#define DATASETREADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "ImuTypes.h"
+
+namespace ORB_SLAM3
+{
+
+// Images of one frame of a dataset, decoded ahead of the tracking
+struct DatasetFrame
+{
+    int nIndex;
+    double timestamp;
+    // Left, RGB or the only image
+    cv::Mat im;
+    // Right or depth image, empty if the sequence has only one
+    cv::Mat im2;
+    // IMU measurements up to this frame since the previous one
+    std::vector<IMU::Point> vImuMeas;
+    // File that could not be read, empty if all were
+    std::string strFailed;
+    // Time spent resizing the images (ms)
+    double tResize;
+};
+
+// Reader of the image sequences of the Examples. A pool of threads reads and decodes (imread, resize,
+// CLAHE) the next frames into a bounded ring buffer, so the disk and the decoding are not in the time
+// of the tracking. In real time mode Next returns the frames at the rate of their timestamps, as the
+// examples did with usleep after tracking each frame; otherwise they are returned as soon as they are
+// decoded (offline batch processing).
+class DatasetReader
+{
+public:
+    DatasetReader(const int nThreads = 2, const int nBufferSize = 16, const bool bRealTime = true);
+    // Parameters from the settings file: Dataset.DecodeThreads, Dataset.BufferSize, Dataset.RealTime (by default
+    // off with System.Offline)
+    DatasetReader(const std::string &strSettingsFile);
+    ~DatasetReader();
+
+    // Images of the sequence, vstrImages2 are the second images of the frames (right or depth) or empty.
+    // It stops the previous sequence.
+    void SetSequence(const std::vector<std::string> &vstrImages, const std::vector<std::string> &vstrImages2,
+                     const std::vector<double> &vTimestamps, const int flags = cv::IMREAD_UNCHANGED);
+    // IMU measurements of the sequence, each frame gets the ones since the previous frame
+    void SetImu(const std::vector<double> &vTimestampsImu, const std::vector<cv::Point3f> &vAcc, const std::vector<cv::Point3f> &vGyro);
+    void SetImageScale(const float scale);
+    // Contrast equalization (TUM-VI), after the resize
+    void SetClahe(const double clipLimit, const cv::Size &tileGridSize);
+
+    // Starts decoding the sequence
+    void Start();
+    // Next frame of the sequence, false at its end or if the reader is not started or is stopped
+    bool Next(DatasetFrame &frame);
+    void Stop();
+
+    int Size() const;
+    bool IsRealTime() const;
+
+protected:
+    void Init(const int nThreads, const int nBufferSize, const bool bRealTime);
+    void Decode();
+    void DecodeFrame(const int idx, DatasetFrame &frame, cv::Ptr<cv::CLAHE> &clahe);
+
+    int mnThreads;
+    int mnBufferSize;
+    bool mbRealTime;
+
+    // Sequence
+    std::vector<std::string> mvstrImages;
+    std::vector<std::string> mvstrImages2;
+    std::vector<double> mvTimestamps;
+    int mFlags;
+    std::vector<double> mvTimestampsImu;
+    std::vector<cv::Point3f> mvAcc;
+    std::vector<cv::Point3f> mvGyro;
+    // IMU measurements of each frame [first, last)
+    std::vector<int> mvFirstImu;
+    std::vector<int> mvLastImu;
+    float mImageScale;
+    double mClaheClipLimit;
+    cv::Size mClaheTileGridSize;
+
+    // Ring buffer, frame i goes to slot i % mnBufferSize
+    std::vector<DatasetFrame> mvBuffer;
+    std::vector<int> mvSlotFrame;
+    int mnNextDecode;
+    int mnNextReturn;
+    bool mbStop;
+    std::mutex mMutex;
+    std::condition_variable mCondDecoded;
+    std::condition_variable mCondReturned;
+    std::vector<std::thread*> mvptWorkers;
+
+    // Real time pacing
+    std::chrono::steady_clock::time_point mLastReturn;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // DATASETREADER_H
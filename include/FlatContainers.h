@@ -0,0 +1,400 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef FLATCONTAINERS_H
+#define FLATCONTAINERS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ORB_SLAM3
+{
+
+// Contiguous vector that keeps the first N elements inside the object itself.
+// Only when the size grows over N the elements are moved to the heap, so small
+// containers (observations of a MapPoint, edges of a KeyFrame) never allocate.
+template<typename T, std::size_t N>
+class SmallVector
+{
+    static_assert(N > 0, "SmallVector needs a non-zero inline capacity");
+
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+
+    SmallVector(): mpData(InlineData()), mnSize(0), mnCapacity(N) {}
+
+    SmallVector(const SmallVector &other): mpData(InlineData()), mnSize(0), mnCapacity(N)
+    {
+        reserve(other.mnSize);
+        std::uninitialized_copy(other.begin(), other.end(), mpData);
+        mnSize = other.mnSize;
+    }
+
+    SmallVector(SmallVector &&other): mpData(InlineData()), mnSize(0), mnCapacity(N)
+    {
+        MoveFrom(other);
+    }
+
+    template<typename InputIt>
+    SmallVector(InputIt first, InputIt last): mpData(InlineData()), mnSize(0), mnCapacity(N)
+    {
+        for(; first!=last; ++first)
+            push_back(*first);
+    }
+
+    ~SmallVector()
+    {
+        clear();
+        if(!IsInline())
+            ::operator delete(mpData);
+    }
+
+    SmallVector& operator=(const SmallVector &other)
+    {
+        if(this != &other)
+        {
+            clear();
+            reserve(other.mnSize);
+            std::uninitialized_copy(other.begin(), other.end(), mpData);
+            mnSize = other.mnSize;
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector &&other)
+    {
+        if(this != &other)
+        {
+            clear();
+            if(!IsInline())
+            {
+                ::operator delete(mpData);
+                mpData = InlineData();
+                mnCapacity = N;
+            }
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    iterator begin() { return mpData; }
+    iterator end() { return mpData + mnSize; }
+    const_iterator begin() const { return mpData; }
+    const_iterator end() const { return mpData + mnSize; }
+
+    size_type size() const { return mnSize; }
+    size_type capacity() const { return mnCapacity; }
+    bool empty() const { return mnSize == 0; }
+
+    T* data() { return mpData; }
+    const T* data() const { return mpData; }
+
+    reference operator[](size_type i) { return mpData[i]; }
+    const_reference operator[](size_type i) const { return mpData[i]; }
+    reference front() { return mpData[0]; }
+    const_reference front() const { return mpData[0]; }
+    reference back() { return mpData[mnSize-1]; }
+    const_reference back() const { return mpData[mnSize-1]; }
+
+    void reserve(size_type n)
+    {
+        if(n <= mnCapacity)
+            return;
+
+        T* pNewData = static_cast<T*>(::operator new(n * sizeof(T)));
+        for(size_type i=0; i<mnSize; i++)
+        {
+            new (pNewData + i) T(std::move(mpData[i]));
+            mpData[i].~T();
+        }
+        if(!IsInline())
+            ::operator delete(mpData);
+
+        mpData = pNewData;
+        mnCapacity = n;
+    }
+
+    void push_back(const T &value)
+    {
+        emplace_back(value);
+    }
+
+    void push_back(T &&value)
+    {
+        emplace_back(std::move(value));
+    }
+
+    template<typename... Args>
+    reference emplace_back(Args&&... args)
+    {
+        if(mnSize == mnCapacity)
+        {
+            // The argument may live inside the buffer, build it before growing
+            T tmp(std::forward<Args>(args)...);
+            reserve(2*mnCapacity);
+            new (mpData + mnSize) T(std::move(tmp));
+        }
+        else
+            new (mpData + mnSize) T(std::forward<Args>(args)...);
+        return mpData[mnSize++];
+    }
+
+    void pop_back()
+    {
+        mpData[--mnSize].~T();
+    }
+
+    iterator insert(const_iterator pos, const T &value)
+    {
+        const size_type idx = pos - mpData;
+        emplace_back(value);
+        std::rotate(mpData + idx, mpData + mnSize - 1, mpData + mnSize);
+        return mpData + idx;
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        return erase(pos, pos+1);
+    }
+
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        iterator itFirst = mpData + (first - mpData);
+        iterator itLast = mpData + (last - mpData);
+        iterator itNewEnd = std::move(itLast, end(), itFirst);
+        while(end() != itNewEnd)
+            pop_back();
+        return itFirst;
+    }
+
+    void clear()
+    {
+        while(mnSize > 0)
+            pop_back();
+    }
+
+private:
+
+    T* InlineData() { return reinterpret_cast<T*>(&mInline[0]); }
+    bool IsInline() const { return mpData == reinterpret_cast<const T*>(&mInline[0]); }
+
+    // Expects this to be empty and using the inline buffer
+    void MoveFrom(SmallVector &other)
+    {
+        if(other.IsInline())
+        {
+            for(size_type i=0; i<other.mnSize; i++)
+                new (mpData + i) T(std::move(other.mpData[i]));
+            mnSize = other.mnSize;
+            other.clear();
+        }
+        else
+        {
+            mpData = other.mpData;
+            mnSize = other.mnSize;
+            mnCapacity = other.mnCapacity;
+            other.mpData = other.InlineData();
+            other.mnSize = 0;
+            other.mnCapacity = N;
+        }
+    }
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type mInline[N];
+    T* mpData;
+    size_type mnSize;
+    size_type mnCapacity;
+};
+
+// Sorted associative container on top of SmallVector. Keeps the std::map interface
+// used in the code (find, count, operator[], erase, ordered iteration by key) but
+// elements are contiguous, so iterating and copying small maps is cheap.
+template<typename K, typename V, std::size_t N, typename Compare = std::less<K> >
+class FlatMap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K,V> value_type;
+    typedef SmallVector<value_type,N> container_type;
+    typedef typename container_type::iterator iterator;
+    typedef typename container_type::const_iterator const_iterator;
+    typedef std::size_t size_type;
+
+    iterator begin() { return mvElements.begin(); }
+    iterator end() { return mvElements.end(); }
+    const_iterator begin() const { return mvElements.begin(); }
+    const_iterator end() const { return mvElements.end(); }
+
+    size_type size() const { return mvElements.size(); }
+    bool empty() const { return mvElements.empty(); }
+    void clear() { mvElements.clear(); }
+    void reserve(size_type n) { mvElements.reserve(n); }
+
+    iterator lower_bound(const K &key)
+    {
+        return std::lower_bound(mvElements.begin(), mvElements.end(), key, KeyCompare());
+    }
+
+    const_iterator lower_bound(const K &key) const
+    {
+        return std::lower_bound(mvElements.begin(), mvElements.end(), key, KeyCompare());
+    }
+
+    iterator find(const K &key)
+    {
+        iterator it = lower_bound(key);
+        if(it != end() && !Compare()(key, it->first))
+            return it;
+        return end();
+    }
+
+    const_iterator find(const K &key) const
+    {
+        const_iterator it = lower_bound(key);
+        if(it != end() && !Compare()(key, it->first))
+            return it;
+        return end();
+    }
+
+    size_type count(const K &key) const
+    {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    std::pair<iterator,bool> insert(const value_type &value)
+    {
+        iterator it = lower_bound(value.first);
+        if(it != end() && !Compare()(value.first, it->first))
+            return std::make_pair(it, false);
+        return std::make_pair(mvElements.insert(it, value), true);
+    }
+
+    V& operator[](const K &key)
+    {
+        iterator it = lower_bound(key);
+        if(it == end() || Compare()(key, it->first))
+            it = mvElements.insert(it, value_type(key, V()));
+        return it->second;
+    }
+
+    size_type erase(const K &key)
+    {
+        iterator it = find(key);
+        if(it == end())
+            return 0;
+        mvElements.erase(it);
+        return 1;
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        return mvElements.erase(pos);
+    }
+
+private:
+    struct KeyCompare
+    {
+        bool operator()(const value_type &a, const K &b) const { return Compare()(a.first, b); }
+    };
+
+    container_type mvElements;
+};
+
+// Sorted set on top of SmallVector, see FlatMap.
+template<typename K, std::size_t N, typename Compare = std::less<K> >
+class FlatSet
+{
+public:
+    typedef K key_type;
+    typedef K value_type;
+    typedef SmallVector<K,N> container_type;
+    typedef typename container_type::const_iterator iterator;
+    typedef typename container_type::const_iterator const_iterator;
+    typedef std::size_t size_type;
+
+    FlatSet() {}
+
+    template<typename InputIt>
+    FlatSet(InputIt first, InputIt last)
+    {
+        for(; first!=last; ++first)
+            insert(*first);
+    }
+
+    const_iterator begin() const { return mvElements.begin(); }
+    const_iterator end() const { return mvElements.end(); }
+
+    size_type size() const { return mvElements.size(); }
+    bool empty() const { return mvElements.empty(); }
+    void clear() { mvElements.clear(); }
+    void reserve(size_type n) { mvElements.reserve(n); }
+
+    const_iterator find(const K &key) const
+    {
+        const_iterator it = std::lower_bound(mvElements.begin(), mvElements.end(), key, Compare());
+        if(it != end() && !Compare()(key, *it))
+            return it;
+        return end();
+    }
+
+    size_type count(const K &key) const
+    {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    std::pair<const_iterator,bool> insert(const K &key)
+    {
+        const_iterator it = std::lower_bound(mvElements.begin(), mvElements.end(), key, Compare());
+        if(it != end() && !Compare()(key, *it))
+            return std::make_pair(it, false);
+        return std::make_pair(const_iterator(mvElements.insert(it, key)), true);
+    }
+
+    size_type erase(const K &key)
+    {
+        const_iterator it = find(key);
+        if(it == end())
+            return 0;
+        mvElements.erase(it);
+        return 1;
+    }
+
+    const_iterator erase(const_iterator pos)
+    {
+        return mvElements.erase(pos);
+    }
+
+private:
+    container_type mvElements;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // FLATCONTAINERS_H
@@ -0,0 +1,116 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef GLOBALBAPROBLEM_H
+#define GLOBALBAPROBLEM_H
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "MapPoint.h"
+#include "Optimizer.h"
+
+#include "Thirdparty/g2o/g2o/core/sparse_optimizer.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+
+namespace ORB_SLAM3
+{
+
+class KeyFrame;
+class Map;
+class TaskScheduler;
+
+// Global bundle adjustment of the Loop Closing that can be stopped and resumed. The g2o graph and the
+// estimates of a stopped run are kept: the next run only adds or removes the keyframes and points that
+// changed in the map, rebuilds the edges of the points whose observations changed, and moves the partial
+// solution with the corrections applied to the map meanwhile (e.g. the essential graph of a new loop).
+// The result is stored in mTcwGBA/mPosGBA as in Optimizer::GlobalBundleAdjustemnt and the graph of a run
+// that finished is released.
+class GlobalBAProblem
+{
+public:
+    GlobalBAProblem();
+    ~GlobalBAProblem();
+
+    // Returns false if it was stopped through pbStopFlag, the next call resumes from where it was.
+    bool Optimize(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                  TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL),
+                  Optimizer::eLinearSolver linearSolverType = Optimizer::LINEAR_SOLVER_CHOLESKY);
+
+    // Drop the graph at the start of the next run. Call it when keyframes or points may have been deleted
+    // (reset), it does not wait for a running optimization.
+    void Clear();
+
+protected:
+    struct KeyFrameEntry
+    {
+        g2o::VertexSE3Expmap* pVertex;
+        // Pose of the keyframe in the map when the estimate was last synchronized
+        Sophus::SE3f TcwSync;
+        unsigned long nStamp;
+    };
+
+    typedef std::unordered_map<KeyFrame*, KeyFrameEntry, std::hash<KeyFrame*>, std::equal_to<KeyFrame*>,
+        Eigen::aligned_allocator<std::pair<KeyFrame* const, KeyFrameEntry> > > KeyFrameEntryMap;
+
+    struct PointEntry
+    {
+        g2o::VertexSBAPointXYZ* pVertex;
+        Eigen::Vector3f PosSync;
+        unsigned int nObsVersion;
+        bool bDirty;
+        std::vector<g2o::OptimizableGraph::Edge*> vEdges;
+        unsigned long nStamp;
+    };
+
+    void Synchronize(Map* pMap, const bool bRobust);
+    void AddPointEdges(MapPoint* pMP, PointEntry &entry, Map* pMap, const bool bRobust);
+    void RemovePointEdges(PointEntry &entry);
+    // Removes the keyframe vertex, the points with edges to it are built again
+    void RemoveKeyFrameVertex(KeyFrameEntry &entry);
+    void ClearGraph();
+    void SetLinearSolver(Optimizer::eLinearSolver linearSolverType, const size_t nKFs);
+
+    std::mutex mMutexProblem;
+
+    g2o::SparseOptimizer mOptimizer;
+
+    KeyFrameEntryMap mmKeyFrames;
+    std::unordered_map<MapPoint*, PointEntry> mmPoints;
+    std::unordered_map<int, MapPoint*> mmPointOfVertex;
+
+    std::atomic<bool> mbClearRequested;
+
+    Map* mpMap;
+    // The last run was stopped, its estimates are the starting point of the next one
+    bool mbPartial;
+    bool mbRobust;
+    // Linear solver in use, it depends on the size of the map with LINEAR_SOLVER_AUTO
+    Optimizer::eLinearSolver mLinearSolverType;
+    unsigned long mnStamp;
+    int mnNextVertexId;
+    // Iterations run on the current estimates (statistics)
+    int mnIterations;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // GLOBALBAPROBLEM_H
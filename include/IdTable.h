@@ -0,0 +1,72 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef IDTABLE_H
+#define IDTABLE_H
+
+#include <algorithm>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Objects of a map indexed by their id. The ids of the keyframes (or points) of one map are
+// close to each other, so a vector from the lowest to the highest id replaces the std::map
+// lookups when the references are rebuilt after loading a map. Unknown ids give NULL.
+template<class T>
+class IdTable
+{
+public:
+    IdTable(): mnFirstId(0) {}
+
+    void Build(const std::vector<T*> &vpObjects)
+    {
+        mvpObjects.clear();
+        if(vpObjects.empty())
+            return;
+
+        long unsigned int minId = vpObjects[0]->mnId, maxId = vpObjects[0]->mnId;
+        for(size_t i=1; i<vpObjects.size(); i++)
+        {
+            minId = std::min(minId, static_cast<long unsigned int>(vpObjects[i]->mnId));
+            maxId = std::max(maxId, static_cast<long unsigned int>(vpObjects[i]->mnId));
+        }
+
+        mnFirstId = minId;
+        mvpObjects.assign(maxId-minId+1, static_cast<T*>(NULL));
+        for(size_t i=0; i<vpObjects.size(); i++)
+            mvpObjects[vpObjects[i]->mnId-mnFirstId] = vpObjects[i];
+    }
+
+    T* Get(const long unsigned int id) const
+    {
+        if(id<mnFirstId || id-mnFirstId>=mvpObjects.size())
+            return static_cast<T*>(NULL);
+        return mvpObjects[id-mnFirstId];
+    }
+
+private:
+    long unsigned int mnFirstId;
+    std::vector<T*> mvpObjects;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // IDTABLE_H
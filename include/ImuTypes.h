@@ -177,8 +177,14 @@ public:
     void CopyFrom(Preintegrated* pImuPre);
     void Initialize(const Bias &b_);
     void IntegrateNewMeasurement(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const float &dt);
+    // Block of consecutive measurements, the random walk of the bias is added once for all of them
+    void IntegrateNewMeasurements(const std::vector<Eigen::Vector3f> &vAcc, const std::vector<Eigen::Vector3f> &vAngVel,
+                                  const std::vector<float> &vDt);
     void Reintegrate();
     void MergePrevious(Preintegrated* pPrev);
+    // Integrates the measurements of pNext after the current ones. If pNext was integrated with the same
+    // original bias its deltas, jacobians and covariance are composed without integrating again.
+    void Append(Preintegrated* pNext);
     void SetNewBias(const Bias &bu_);
     IMU::Bias GetDeltaBias(const Bias &b_);
 
@@ -248,6 +254,11 @@ private:
     std::vector<integrable> mvMeasurements;
 
     std::mutex mMutex;
+
+    // One step of the integration, without storing the measurement nor adding the random walk of the bias
+    void IntegrateMeasurement(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const float dt);
+    // Exact composition with pNext, integrated after this one with the same original bias
+    void Compose(Preintegrated* pNext);
 };
 
 // Lie Algebra Functions
@@ -41,8 +41,13 @@
 
 #include "GeometricCamera.h"
 #include "SerializationUtils.h"
+#include "FlatContainers.h"
+#include "SharedMutex.h"
+#include "IdTable.h"
 
 #include <mutex>
+#include <atomic>
+#include <chrono>
 
 #include <boost/serialization/base_object.hpp>
 #include <boost/serialization/vector.hpp>
@@ -135,7 +140,8 @@ class KeyFrame
         serializeVectorKeyPoints<Archive>(ar, mvKeysUn, version);
         ar & const_cast<vector<float>& >(mvuRight);
         ar & const_cast<vector<float>& >(mvDepth);
-        serializeMatrix<Archive>(ar,mDescriptors,version);
+        if(!(ar.get_flags() & ARCHIVE_DESCRIPTORS_APART))
+            serializeMatrix<Archive>(ar,mDescriptors,version);
         // BOW
         ar & mBowVec;
         ar & mFeatVec;
@@ -203,6 +209,11 @@ class KeyFrame
     }
 
 public:
+    // Covisibility weights and spanning tree/loop/merge edges. They are small and walked
+    // very often, so they are stored in flat containers with inline capacity.
+    typedef FlatMap<KeyFrame*,int,32> ConnectionMap;
+    typedef FlatSet<KeyFrame*,4> EdgeSet;
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     KeyFrame();
     KeyFrame(Frame &F, Map* pMap, KeyFrameDatabase* pKFDB);
@@ -243,18 +254,18 @@ public:
     void AddChild(KeyFrame* pKF);
     void EraseChild(KeyFrame* pKF);
     void ChangeParent(KeyFrame* pKF);
-    std::set<KeyFrame*> GetChilds();
+    EdgeSet GetChilds();
     KeyFrame* GetParent();
     bool hasChild(KeyFrame* pKF);
     void SetFirstConnection(bool bFirst);
 
     // Loop Edges
     void AddLoopEdge(KeyFrame* pKF);
-    std::set<KeyFrame*> GetLoopEdges();
+    EdgeSet GetLoopEdges();
 
     // Merge Edges
     void AddMergeEdge(KeyFrame* pKF);
-    set<KeyFrame*> GetMergeEdges();
+    EdgeSet GetMergeEdges();
 
     // MapPoint observation functions
     int GetNumberMPs();
@@ -307,7 +318,9 @@ public:
     bool ProjectPointUnDistort(MapPoint* pMP, cv::Point2f &kp, float &u, float &v);
 
     void PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP, set<GeometricCamera*>& spCam);
-    void PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsigned int, MapPoint*>& mpMPid, map<unsigned int, GeometricCamera*>& mpCamId);
+    // Stores the checkpoint epoch of its map, the keyframe is saved again in the next checkpoint
+    void MarkChanged();
+    void PostLoad(const IdTable<KeyFrame>& KFTable, const IdTable<MapPoint>& MPTable, map<unsigned int, GeometricCamera*>& mpCamId);
 
 
     void SetORBVocabulary(ORBVocabulary* pORBVoc);
@@ -318,10 +331,19 @@ public:
     // The following variables are accesed from only 1 thread or never change (no mutex needed).
 public:
 
-    static long unsigned int nNextId;
+    static std::atomic<long unsigned int> nNextId;
     long unsigned int mnId;
     const long unsigned int mnFrameId;
 
+    // Checkpoint epoch of the last change (0 for the loaded keyframes)
+    // Written by the mapping threads and read by the checkpointer without locks
+    std::atomic<unsigned long> mnChangeEpoch;
+
+#ifdef REGISTER_TIMES
+    // When the keyframe was inserted in the Local Mapping queue
+    std::chrono::steady_clock::time_point mTimeInsertLM;
+#endif
+
     const double mTimeStamp;
 
     // Grid (to speed up feature matching)
@@ -473,7 +495,7 @@ protected:
     // Grid over the image to speed up feature matching
     std::vector< std::vector <std::vector<size_t> > > mGrid;
 
-    std::map<KeyFrame*,int> mConnectedKeyFrameWeights;
+    ConnectionMap mConnectedKeyFrameWeights;
     std::vector<KeyFrame*> mvpOrderedConnectedKeyFrames;
     std::vector<int> mvOrderedWeights;
     // For save relation without pointer, this is necessary for save/load function
@@ -482,9 +504,9 @@ protected:
     // Spanning Tree and Loop Edges
     bool mbFirstConnection;
     KeyFrame* mpParent;
-    std::set<KeyFrame*> mspChildrens;
-    std::set<KeyFrame*> mspLoopEdges;
-    std::set<KeyFrame*> mspMergeEdges;
+    EdgeSet mspChildrens;
+    EdgeSet mspLoopEdges;
+    EdgeSet mspMergeEdges;
     // For save relation without pointer, this is necessary for save/load function
     long long int mBackupParentId;
     std::vector<long unsigned int> mvBackupChildrensId;
@@ -512,11 +534,15 @@ protected:
     Eigen::Matrix3f mK_;
 
     // Mutex
-    std::mutex mMutexPose; // for pose, velocity and biases
-    std::mutex mMutexConnections;
-    std::mutex mMutexFeatures;
+    SharedMutex mMutexPose; // for pose, velocity and biases
+    SharedMutex mMutexConnections;
+    SharedMutex mMutexFeatures;
     std::mutex mMutexMap;
 
+    static LockStats mStatsMutexPose;
+    static LockStats mStatsMutexConnections;
+    static LockStats mStatsMutexFeatures;
+
 public:
     GeometricCamera* mpCamera, *mpCamera2;
 
@@ -23,6 +23,7 @@
 #include <vector>
 #include <list>
 #include <set>
+#include <string>
 
 #include "KeyFrame.h"
 #include "Frame.h"
@@ -46,14 +47,6 @@ class Map;
 
 class KeyFrameDatabase
 {
-    friend class boost::serialization::access;
-
-    template<class Archive>
-    void serialize(Archive& ar, const unsigned int version)
-    {
-        ar & mvBackupInvertedFileId;
-    }
-
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
@@ -77,9 +70,18 @@ public:
 
     // Relocalization
     std::vector<KeyFrame*> DetectRelocalizationCandidates(Frame* F, Map* pMap);
-
-    void PreSave();
-    void PostLoad(map<long unsigned int, KeyFrame*> mpKFid);
+    // Same query for a BoW vector, candidates of every map if pMap is NULL. The scores are kept in
+    // the query and not in the keyframes, so several queries can run at the same time.
+    std::vector<KeyFrame*> DetectRelocalizationCandidates(const BowVector &vBowVec, Map* pMap);
+
+    // Compact copy of the inverted file for the atlas file: the vocabulary size, the sorted ids of the
+    // keyframes in the database and, for each word with keyframes, the word and its sorted keyframe
+    // ids, all of them delta-encoded as variable length integers.
+    void EncodeInvertedFile(std::string &strData);
+    // Inverted file of the loaded keyframes from EncodeInvertedFile data, without going through their
+    // BoW vectors. Keyframes missing from the data (or all of them, if it is empty or from another
+    // vocabulary) are added as usual.
+    void PostLoad(const std::vector<KeyFrame*> &vpKFs, const std::string &strInvertedFile);
     void SetORBVocabulary(ORBVocabulary* pORBVoc);
 
 protected:
@@ -90,9 +92,6 @@ protected:
    // Inverted file
    std::vector<list<KeyFrame*> > mvInvertedFile;
 
-   // For save relation without pointer, this is necessary for save/load function
-   std::vector<list<long unsigned int> > mvBackupInvertedFileId;
-
    // Mutex
    std::mutex mMutex;
 
@@ -0,0 +1,105 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LOCALBAPROBLEM_H
+#define LOCALBAPROBLEM_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "MapPoint.h"
+
+#include "Thirdparty/g2o/g2o/core/sparse_optimizer.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+
+namespace ORB_SLAM3
+{
+
+class KeyFrame;
+class Map;
+class TaskScheduler;
+
+// Local bundle adjustment of the Local Mapping with a g2o graph kept from one keyframe to the next.
+// Consecutive windows share most of their keyframes and points, so only the vertices of the keyframes
+// and points entering or leaving the window are created or destroyed, and only the edges of the points
+// whose observations changed are built again. The window, robust kernels and outlier rejection are the
+// ones of Optimizer::LocalBundleAdjustment.
+class LocalBAProblem
+{
+public:
+    LocalBAProblem();
+    ~LocalBAProblem();
+
+    void Optimize(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges,
+                  TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL));
+
+    // Remove all the vertices and edges. Call it when keyframes or points may have been deleted (reset).
+    void Clear();
+
+protected:
+    enum eEdgeType{
+        MONOCULAR=0,
+        STEREO=1,
+        MONOCULAR_RIGHT=2
+    };
+
+    struct ObservationEdge
+    {
+        g2o::OptimizableGraph::Edge* pEdge;
+        KeyFrame* pKF;
+        eEdgeType type;
+    };
+
+    struct PointEntry
+    {
+        g2o::VertexSBAPointXYZ* pVertex;
+        // Observations used to build the edges and their version in the point
+        MapPoint::ObservationMap observations;
+        unsigned int nObsVersion;
+        bool bDirty;
+        std::vector<ObservationEdge> vEdges;
+        unsigned long nWindow;
+    };
+
+    struct KeyFrameEntry
+    {
+        g2o::VertexSE3Expmap* pVertex;
+        unsigned long nWindow;
+    };
+
+    void AddPointEdges(MapPoint* pMP, PointEntry &entry, Map* pMap);
+    void RemovePointEdges(PointEntry &entry);
+    // Removes the keyframe vertex, the points with edges to it are built again
+    void RemoveKeyFrameVertex(KeyFrameEntry &entry);
+
+    g2o::SparseOptimizer mOptimizer;
+
+    std::unordered_map<KeyFrame*, KeyFrameEntry> mmKeyFrames;
+    std::unordered_map<MapPoint*, PointEntry> mmPoints;
+    std::unordered_map<int, MapPoint*> mmPointOfVertex;
+
+    Map* mpMap;
+    // Stamp of the current window, entries with an older one are removed
+    unsigned long mnWindow;
+    int mnNextVertexId;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // LOCALBAPROBLEM_H
@@ -26,8 +26,11 @@
 #include "Tracking.h"
 #include "KeyFrameDatabase.h"
 #include "Settings.h"
+#include "TaskScheduler.h"
 
 #include <mutex>
+#include <condition_variable>
+#include <memory>
 
 
 namespace ORB_SLAM3
@@ -37,17 +40,25 @@ class System;
 class Tracking;
 class LoopClosing;
 class Atlas;
+class LocalBAProblem;
+struct RedundancySnapshot;
 
 class LocalMapping
 {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     LocalMapping(System* pSys, Atlas* pAtlas, const float bMonocular, bool bInertial, const string &_strSeqName=std::string());
+    ~LocalMapping();
 
     void SetLoopCloser(LoopClosing* pLoopCloser);
 
     void SetTracker(Tracking* pTracker);
 
+    void SetScheduler(TaskScheduler* pScheduler);
+    // With the scheduler the bundle adjustments build their system in parallel, the order of the sums
+    // then changes from run to run (off in offline mode)
+    void SetParallelBA(const bool bSet);
+
     // Main function
     void Run();
 
@@ -71,6 +82,15 @@ public:
     void RequestFinish();
     bool isFinished();
 
+    // Blocks until Run has returned after RequestFinish
+    void WaitUntilFinished();
+
+    // Blocks until the queue is empty and Local Mapping waits for keyframes (or is stopped)
+    void WaitUntilIdle();
+
+    // Blocks until Local Mapping has stopped after RequestStop (or has finished)
+    void WaitUntilStopped();
+
     int KeyframesInQueue(){
         unique_lock<std::mutex> lock(mMutexNewKFs);
         return mlNewKeyFrames.size();
@@ -113,6 +133,9 @@ public:
 
 #ifdef REGISTER_TIMES
     vector<double> vdKFInsert_ms;
+    // From the insertion of the keyframe in the queue until it is processed, and until its local BA starts
+    vector<double> vdKFQueue_ms;
+    vector<double> vdKFToLBA_ms;
     vector<double> vdMPCulling_ms;
     vector<double> vdMPCreation_ms;
     vector<double> vdLBA_ms;
@@ -131,6 +154,9 @@ public:
 #endif
 protected:
 
+    // Scheduler for the bundle adjustments, NULL if they are not parallel
+    TaskScheduler* BAScheduler();
+
     bool CheckNewKeyFrames();
     void ProcessNewKeyFrame();
     void CreateNewMapPoints();
@@ -138,6 +164,17 @@ protected:
     void MapPointCulling();
     void SearchInNeighbors();
     void KeyFrameCulling();
+    // Number of close points of each candidate of KeyFrameCulling and how many of them are seen in at least
+    // other 3 keyframes at the same or finer scale, on a snapshot of the observations. The candidates
+    // [first,last) are added to the snapshot: their points are read, then counted, in parallel.
+    void AddToRedundancySnapshot(const vector<KeyFrame*> &vpKFs, const int first, const int last, RedundancySnapshot &snapshot,
+                                 vector<int> &vnRedundantObs, vector<int> &vnMPs);
+    // After a cull the points of the culled keyframe are read again, the candidates in [first,last) that
+    // see them are counted again
+    void UpdateRedundancySnapshot(const vector<KeyFrame*> &vpKFs, const vector<MapPoint*> &vpCulledMPs, const int first,
+                                  const int last, RedundancySnapshot &snapshot, vector<int> &vnRedundantObs, vector<int> &vnMPs);
+    // f(i) for i in [0,n), in the scheduler if there is one
+    void ParallelForCulling(const int n, const std::function<void(int)> &f);
 
     System *mpSystem;
 
@@ -149,17 +186,26 @@ protected:
     bool mbResetRequestedActiveMap;
     Map* mpMapToReset;
     std::mutex mMutexReset;
+    // The reset requests wait on it until ResetIfRequested is done
+    std::condition_variable mCondReset;
 
     bool CheckFinish();
     void SetFinish();
     bool mbFinishRequested;
     bool mbFinished;
     std::mutex mMutexFinish;
+    // Notified when mbFinished is set
+    std::condition_variable mCondFinish;
 
     Atlas* mpAtlas;
 
     LoopClosing* mpLoopCloser;
     Tracking* mpTracker;
+    TaskScheduler* mpScheduler;
+    bool mbParallelBA;
+
+    // Graph of the local BA, kept between keyframes
+    std::unique_ptr<LocalBAProblem> mpLocalBAProblem;
 
     std::list<KeyFrame*> mlNewKeyFrames;
 
@@ -169,12 +215,20 @@ protected:
 
     std::mutex mMutexNewKFs;
 
+    // Run waits on it for a new keyframe or for a request (mbWakeUp), WaitUntilIdle for mbIdle
+    void WakeUp();
+    std::condition_variable mCondNewKFs;
+    bool mbWakeUp;
+    bool mbIdle;
+
     bool mbAbortBA;
 
     bool mbStopped;
     bool mbStopRequested;
     bool mbNotStop;
     std::mutex mMutexStop;
+    // Notified when mbStopped is set
+    std::condition_variable mCondStop;
 
     bool mbAcceptKeyFrames;
     std::mutex mMutexAccept;
@@ -27,10 +27,13 @@
 #include "Tracking.h"
 
 #include "KeyFrameDatabase.h"
+#include "TaskScheduler.h"
 
 #include <boost/algorithm/string.hpp>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <memory>
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 namespace ORB_SLAM3
@@ -40,6 +43,8 @@ class Tracking;
 class LocalMapping;
 class KeyFrameDatabase;
 class Map;
+class GlobalBAProblem;
+class ORBmatcher;
 
 
 class LoopClosing
@@ -53,11 +58,26 @@ public:
 public:
 
     LoopClosing(Atlas* pAtlas, KeyFrameDatabase* pDB, ORBVocabulary* pVoc,const bool bFixScale, const bool bActiveLC);
+    ~LoopClosing();
 
     void SetTracker(Tracking* pTracker);
 
     void SetLocalMapper(LocalMapping* pLocalMapper);
 
+    void SetScheduler(TaskScheduler* pScheduler);
+
+    // With bNonBlocking (default) the result of the GBA is prepared while Local Mapping and Tracking run and
+    // published at once. Otherwise Local Mapping is stopped while the map is updated.
+    void SetNonBlockingGBAUpdate(const bool bNonBlocking);
+
+    // With the scheduler (more than one worker) the BoW candidates of loop and merge detection are
+    // verified in parallel, one task per candidate
+    void SetParallelPlaceRecognition(const bool bSet);
+
+    // With the scheduler the global bundle adjustment builds its system in parallel, the order of the sums
+    // then changes from run to run (off in offline mode)
+    void SetParallelBA(const bool bSet);
+
     // Main function
     void Run();
 
@@ -82,6 +102,12 @@ public:
 
     bool isFinished();
 
+    // Blocks until Run has returned after RequestFinish and no Global BA is running
+    void WaitUntilFinished();
+
+    // Blocks until the queue is empty, Loop Closing waits for keyframes and no Global BA is running
+    void WaitUntilIdle();
+
     Viewer* mpViewer;
 
 #ifdef REGISTER_TIMES
@@ -106,6 +132,7 @@ public:
 
     vector<double> vdGBA_ms;
     vector<double> vdUpdateMap_ms;
+    vector<double> vdGBAPublish_ms;
     vector<double> vdFGBATotal_ms;
     vector<int> vnGBAKFs;
     vector<int> vnGBAMPs;
@@ -133,6 +160,48 @@ protected:
                                 set<MapPoint*> &spMatchedMPinOrigin, vector<MapPoint*> &vpMapPoints,
                                 vector<MapPoint*> &vpMatchedMapPoints);
 
+    // Geometric verification of one BoW candidate: Sim3 RANSAC, refinement by projection and Sim3
+    // optimization, and check with the covisibles of the current keyframe
+    struct BoWCandidateResult
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        BoWCandidateResult(): pMatchedKF(static_cast<KeyFrame*>(NULL)), nProjOptMatches(0), nNumCoincidences(0),
+                              nStage(0), nMatchesStage(0) {}
+
+        KeyFrame* pMatchedKF;
+        // Matches after the Sim3 optimization, 0 if the candidate was rejected
+        int nProjOptMatches;
+        int nNumCoincidences;
+        g2o::Sim3 g2oScw;
+        std::vector<MapPoint*> vpMapPoints;
+        std::vector<MapPoint*> vpMatchedMapPoints;
+        int nStage;
+        int nMatchesStage;
+    };
+    typedef std::vector<BoWCandidateResult, Eigen::aligned_allocator<BoWCandidateResult> > BoWCandidateResults;
+
+    // nSeed is the seed of the Sim3 RANSAC, it depends only on the query keyframe and the candidate index
+    void VerifyBoWCandidate(KeyFrame* pKFi, const std::set<KeyFrame*> &spConnectedKeyFrames, BoWCandidateResult &result,
+                            const unsigned int nSeed);
+    void VerifyBoWCandidateAt(const std::vector<KeyFrame*> &vpBowCand, const std::set<KeyFrame*> &spConnectedKeyFrames,
+                              BoWCandidateResults &vResults, const int i);
+
+    // SearchByBoW of the current keyframe against pKF. The candidates of loop and merge detection and
+    // their covisibles overlap, the matches are kept until the next query keyframe.
+    int SearchByBoWCached(ORBmatcher &matcher, KeyFrame* pKF, std::vector<MapPoint*> &vpMatches);
+
+    struct BoWMatches
+    {
+        int nMatches;
+        std::vector<MapPoint*> vpMatches;
+    };
+    std::map<KeyFrame*, BoWMatches> mmBoWMatchesCache;
+    // Query keyframe of the cached matches
+    long unsigned int mnBoWCacheKFId;
+    std::mutex mMutexBoWCache;
+    bool mbParallelPlaceRecognition;
+
 
     void SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap, vector<MapPoint*> &vpMapPoints);
     void SearchAndFuse(const vector<KeyFrame*> &vConectedKFs, vector<MapPoint*> &vpMapPoints);
@@ -149,12 +218,16 @@ protected:
     bool mbResetActiveMapRequested;
     Map* mpMapToReset;
     std::mutex mMutexReset;
+    // The reset requests wait on it until ResetIfRequested is done
+    std::condition_variable mCondReset;
 
     bool CheckFinish();
     void SetFinish();
     bool mbFinishRequested;
     bool mbFinished;
     std::mutex mMutexFinish;
+    // Notified when mbFinished is set
+    std::condition_variable mCondFinish;
 
     Atlas* mpAtlas;
     Tracking* mpTracker;
@@ -164,10 +237,19 @@ protected:
 
     LocalMapping *mpLocalMapper;
 
+    TaskScheduler* mpScheduler;
+    bool mbParallelBA;
+
     std::list<KeyFrame*> mlpLoopKeyFrameQueue;
 
     std::mutex mMutexLoopQueue;
 
+    // Run waits on it for a new keyframe or for a request (mbWakeUp), WaitUntilIdle for mbIdle
+    void WakeUp();
+    std::condition_variable mCondLoopQueue;
+    bool mbWakeUp;
+    bool mbIdle;
+
     // Loop detector parameters
     float mnCovisibilityConsistencyTh;
 
@@ -217,7 +299,48 @@ protected:
     bool mbFinishedGBA;
     bool mbStopGBA;
     std::mutex mMutexGBA;
+    // Notified when a Global BA ends
+    std::condition_variable mCondGBA;
     std::thread* mpThreadGBA;
+    // GBA task when it runs in the shared scheduler
+    std::future<void> mGBAResult;
+    // Visual GBA, a run stopped by a new loop is resumed by the next one. The graph is released when a
+    // run finishes.
+    std::unique_ptr<GlobalBAProblem> mpGlobalBAProblem;
+
+    // Run the GBA as a low priority task (or in its own thread without scheduler)
+    void LaunchGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoopKF);
+
+    // Corrected state of the map after a GBA (shadow buffer), prepared while the map is in use
+    struct GBAKeyFrameUpdate
+    {
+        KeyFrame* pKF;
+        // Pose when the update was prepared, the correction is relative to it
+        Sophus::SE3f TcwPrepared;
+    };
+
+    struct GBAMapPointUpdate
+    {
+        MapPoint* pMP;
+        Eigen::Vector3f PosPrepared;
+        Eigen::Vector3f PosCorrected;
+    };
+
+    struct GBAUpdate
+    {
+        std::vector<GBAKeyFrameUpdate> vKeyFrames;
+        std::vector<GBAMapPointUpdate> vMapPoints;
+        // Keyframes and points with larger ids were created after the preparation started
+        long unsigned int nFirstNewKFid;
+        long unsigned int nFirstNewMPid;
+    };
+
+    // Propagates the GBA through the spanning tree into the update without stopping Local Mapping.
+    // Returns false if the GBA was stopped or another one launched (nFullBAIdx) in the meantime.
+    bool PrepareGBAUpdate(Map* pActiveMap, unsigned long nLoopKF, int nFullBAIdx, GBAUpdate &update);
+    // Applies the update under the map mutex, including the keyframes and points created while preparing it
+    void PublishGBAUpdate(Map* pActiveMap, unsigned long nLoopKF, const GBAUpdate &update);
+    bool mbNonBlockingGBAUpdate;
 
     // Fix scale in the stereo/RGB-D case
     bool mbFixScale;
@@ -57,6 +57,8 @@
 #include<Eigen/Dense>
 #include<Eigen/Sparse>
 
+#include <random>
+
 namespace ORB_SLAM3{
     class MLPnPsolver {
     public:
@@ -69,6 +71,9 @@ namespace ORB_SLAM3{
         void SetRansacParameters(double probability = 0.99, int minInliers = 8, int maxIterations = 300, int minSet = 6, float epsilon = 0.4,
                                  float th2 = 5.991);
 
+        // Seed of the random sets of this solver, solvers with the same seed and input give the same result
+        void SetSeed(const unsigned int seed);
+
         //Find metod is necessary?
 
         bool iterate(int nIterations, bool &bNoMore, vector<bool> &vbInliers, int &nInliers, Eigen::Matrix4f &Tout);
@@ -200,6 +205,14 @@ namespace ORB_SLAM3{
         //vector<cv::Point3f> mvP3Dw;
         points_t mvP3Dw;
 
+        // Correspondences in columns, the hypotheses are scored with vector operations
+        Eigen::Matrix<float,3,Eigen::Dynamic> mP3Dw;
+        Eigen::Matrix<float,2,Eigen::Dynamic> mP2D;
+        Eigen::Array<float,1,Eigen::Dynamic> mMaxError;
+        // Buffers of CheckInliers
+        Eigen::Matrix<float,3,Eigen::Dynamic> mP3Dc;
+        Eigen::Array<float,1,Eigen::Dynamic> mError2;
+
         // Index in Frame
         vector<size_t> mvKeyPointIndices;
 
@@ -227,6 +240,9 @@ namespace ORB_SLAM3{
         // Indices for random selection [0 .. N-1]
         vector<size_t> mvAllIndices;
 
+        // Generator of the random sets, own to each solver
+        std::mt19937 mRng;
+
         // RANSAC probability
         double mRansacProb;
 
@@ -22,10 +22,13 @@
 
 #include "MapPoint.h"
 #include "KeyFrame.h"
+#include "MapPointStore.h"
+#include "SharedMutex.h"
 
 #include <set>
 #include <pangolin/pangolin.h>
 #include <mutex>
+#include <atomic>
 
 #include <boost/serialization/base_object.hpp>
 
@@ -36,6 +39,7 @@ namespace ORB_SLAM3
 class MapPoint;
 class KeyFrame;
 class Atlas;
+class TaskScheduler;
 class KeyFrameDatabase;
 
 class Map
@@ -67,6 +71,26 @@ class Map
         ar & mbIMU_BA2;
     }
 
+    // Fields of the map without its keyframes and points, they are stored in their own sections of
+    // the chunked atlas file (AtlasFile)
+    template<class Archive>
+    void serializeHeader(Archive &ar, const unsigned int version)
+    {
+        ar & mnId;
+        ar & mnInitKFid;
+        ar & mnMaxKFid;
+        ar & mnBigChangeIdx;
+        ar & mvBackupKeyFrameOriginsId;
+        ar & mnBackupKFinitialID;
+        ar & mnBackupKFlowerID;
+        ar & mbImuInitialized;
+        ar & mbIsInertial;
+        ar & mbIMU_BA1;
+        ar & mbIMU_BA2;
+    }
+
+    friend class AtlasFile;
+
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     Map();
@@ -85,11 +109,21 @@ public:
     std::vector<MapPoint*> GetAllMapPoints();
     std::vector<MapPoint*> GetReferenceMapPoints();
 
+    // Storage of the points of this map, with their data in columns (MapPointStore::View for bulk reads)
+    MapPointStore* GetMapPointStore();
+
     long unsigned int MapPointsInMap();
     long unsigned  KeyFramesInMap();
 
     long unsigned int GetId();
 
+    // Checkpoint epoch of the map, its keyframes and points store it when they change (MarkChanged).
+    // Each atlas checkpointer starts a new epoch in the maps of its atlas, the other systems of the
+    // process have their own maps.
+    unsigned long GetCheckpointEpoch();
+    // Starts a new epoch, returns the previous one
+    unsigned long NextCheckpointEpoch();
+
     long unsigned int GetInitKFid();
     void SetInitKFid(long unsigned int initKFif);
     long unsigned int GetMaxKFid();
@@ -131,14 +165,27 @@ public:
     unsigned int GetLowerKFID();
 
     void PreSave(std::set<GeometricCamera*> &spCams);
-    void PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long unsigned int, KeyFrame*>& mpKeyFrameId*/, map<unsigned int, GeometricCamera*> &mpCams);
+    // Ids of the references of the given objects and of the fields of the map, for a checkpoint of the
+    // running system (AtlasCheckpointer). Only the objects in spKFs/spMPs are referenced. Call it with
+    // mMutexMapUpdate locked (shared is enough).
+    void PreSaveObjects(const std::vector<KeyFrame*> &vpKFs, const std::vector<MapPoint*> &vpMPs, std::set<KeyFrame*> &spKFs,
+                        std::set<MapPoint*> &spMPs, std::set<GeometricCamera*> &spCams);
+    // With a scheduler the references of the keyframes and points are rebuilt in parallel
+    void PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long unsigned int, KeyFrame*>& mpKeyFrameId*/, map<unsigned int, GeometricCamera*> &mpCams,
+                  TaskScheduler* pScheduler = static_cast<TaskScheduler*>(NULL));
 
     void printReprojectionError(list<KeyFrame*> &lpLocalWindowKFs, KeyFrame* mpCurrentKF, string &name, string &name_folder);
 
     vector<KeyFrame*> mvpKeyFrameOrigins;
     vector<unsigned long int> mvBackupKeyFrameOriginsId;
     KeyFrame* mpFirstRegionKF;
-    std::mutex mMutexMapUpdate;
+    // Exclusive for the threads changing the map (LocalMapping BA write-back, loop and merge
+    // corrections, GBA, Tracking::Track when it initializes a map or creates a keyframe with its
+    // points). Shared for the readers that need a consistent map: Tracking::Track while it tracks a
+    // frame, the checkpoint encoding (AtlasFile, AtlasCheckpointer thread) and the map server
+    // requests (MapServer::GetLocalMap). These readers overlap with each other; the writers still
+    // serialize against all of them and against each other.
+    SharedMutex mMutexMapUpdate;
 
     // This avoid that two points are created simultaneously in separate threads (id conflict)
     std::mutex mMutexPointCreation;
@@ -149,7 +196,8 @@ public:
     static const int THUMB_WIDTH = 512;
     static const int THUMB_HEIGHT = 512;
 
-    static long unsigned int nNextId;
+    static std::atomic<long unsigned int> nNextId;
+    static LockStats mStatsMutexMapUpdate;
 
     // DEBUG: show KFs which are used in LBA
     std::set<long unsigned int> msOptKFs;
@@ -157,11 +205,16 @@ public:
 
 protected:
 
+    // Ids of the origins, initial and lower keyframes
+    void PreSaveHeader();
+
     long unsigned int mnId;
 
-    std::set<MapPoint*> mspMapPoints;
     std::set<KeyFrame*> mspKeyFrames;
 
+    // The points of the map, there is no other set of them
+    MapPointStore mPointStore;
+
     // Save/load, the set structure is broken in libboost 1.58 for ubuntu 16.04, a vector is serializated
     std::vector<MapPoint*> mvpBackupMapPoints;
     std::vector<KeyFrame*> mvpBackupKeyFrames;
@@ -198,6 +251,8 @@ protected:
     bool mbIMU_BA1;
     bool mbIMU_BA2;
 
+    std::atomic<unsigned long> mnCheckpointEpoch;
+
     // Mutex
     std::mutex mMutexMap;
 
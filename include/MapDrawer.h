@@ -32,6 +32,7 @@ namespace ORB_SLAM3
 {
 
 class Settings;
+class MapRenderer;
 
 class MapDrawer
 {
@@ -49,6 +50,13 @@ public:
     void SetCurrentCameraPose(const Sophus::SE3f &Tcw);
     void SetReferenceKeyFrame(KeyFrame *pKF);
     void GetCurrentOpenGLCameraMatrix(pangolin::OpenGlMatrix &M, pangolin::OpenGlMatrix &MOw);
+    // Pose of the current camera in the world (Twc)
+    Sophus::SE3f GetCurrentCameraPose();
+
+    // Draw the active map from vertex buffers with incremental updates (MapRenderer)
+    void EnableVertexBuffers();
+    // Apply the changes of the map to the vertex buffers, from the viewer thread before drawing
+    void UpdateVertexBuffers();
 
 private:
 
@@ -63,6 +71,9 @@ private:
 
     Sophus::SE3f mCameraPose;
 
+    // NULL if the map is drawn in immediate mode
+    MapRenderer* mpRenderer;
+
     std::mutex mMutexCamera;
 
     float mfFrameColors[6][3] = {{0.0f, 0.0f, 1.0f},
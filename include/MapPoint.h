@@ -26,9 +26,14 @@
 #include "Converter.h"
 
 #include "SerializationUtils.h"
+#include "FlatContainers.h"
+#include "MapPointStore.h"
+#include "SharedMutex.h"
+#include "IdTable.h"
 
 #include <opencv2/core/core.hpp>
 #include <mutex>
+#include <atomic>
 
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/array.hpp>
@@ -40,6 +45,7 @@ namespace ORB_SLAM3
 class KeyFrame;
 class Map;
 class Frame;
+class MapClient;
 
 class MapPoint
 {
@@ -83,13 +89,32 @@ class MapPoint
         //serializeMatrix(ar,mNormalVectorMerge,version);
 
         // Protected variables
-        ar & boost::serialization::make_array(mWorldPos.data(), mWorldPos.size());
-        ar & boost::serialization::make_array(mNormalVector.data(), mNormalVector.size());
+        Eigen::Vector3f pos, normal;
+        if(Archive::is_saving::value)
+        {
+            pos = GetWorldPos();
+            normal = GetNormal();
+        }
+        ar & boost::serialization::make_array(pos.data(), pos.size());
+        ar & boost::serialization::make_array(normal.data(), normal.size());
+        if(Archive::is_loading::value)
+        {
+            // Loaded points are not in a map yet, the data goes to the own copy
+            mOwnWorldPos.Store(pos.data());
+            mOwnNormalVector = normal;
+        }
         //ar & BOOST_SERIALIZATION_NVP(mBackupObservationsId);
         //ar & mObservations;
         ar & mBackupObservationsId1;
         ar & mBackupObservationsId2;
-        serializeMatrix(ar,mDescriptor,version);
+        if(Archive::is_saving::value)
+        {
+            // Local Mapping computes it again out of the map lock (checkpoints of the running system)
+            cv::Mat descriptor = GetDescriptor();
+            serializeMatrix(ar,descriptor,version);
+        }
+        else
+            serializeMatrix(ar,mDescriptor,version);
         ar & mBackupRefKFId;
         //ar & mnVisible;
         //ar & mnFound;
@@ -97,13 +122,39 @@ class MapPoint
         ar & mbBad;
         ar & mBackupReplacedId;
 
-        ar & mfMinDistance;
-        ar & mfMaxDistance;
+        ar & *mpfMinDistance;
+        ar & *mpfMaxDistance;
 
     }
 
+    // Sets the data of the points received from a map server
+    friend class MapClient;
+
 
 public:
+    // Keyframes observing the point and the (left,right) index of the keypoint in each one.
+    // Most points are seen by a handful of keyframes, those are kept inline without allocations.
+    typedef FlatMap<KeyFrame*,std::tuple<int,int>,8> ObservationMap;
+
+    // Read-only access to the observations without copying them. The features mutex of the
+    // point is held while the view is alive, so keep it short and do not call methods that lock
+    // the point or the observing keyframes (use GetObservations() for that).
+    class ObservationsView
+    {
+    public:
+        ObservationsView(SharedMutex &mutex, const ObservationMap &observations):
+            mLock(mutex), mObservations(observations) {}
+
+        ObservationMap::const_iterator begin() const { return mObservations.begin(); }
+        ObservationMap::const_iterator end() const { return mObservations.end(); }
+        size_t size() const { return mObservations.size(); }
+        bool empty() const { return mObservations.empty(); }
+
+    private:
+        std::shared_lock<SharedMutex> mLock;
+        const ObservationMap &mObservations;
+    };
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     MapPoint();
 
@@ -119,7 +170,10 @@ public:
 
     KeyFrame* GetReferenceKeyFrame();
 
-    std::map<KeyFrame*,std::tuple<int,int>> GetObservations();
+    ObservationMap GetObservations();
+    ObservationsView GetObservationsView();
+    // Incremented every time the observations change, read it before copying them
+    unsigned int GetObservationsVersion();
     int Observations();
 
     void AddObservation(KeyFrame* pKF,int idx);
@@ -155,14 +209,26 @@ public:
     Map* GetMap();
     void UpdateMap(Map* pMap);
 
+    // Moves the data of the point into its slot in the storage of its map, or back to the own copy of
+    // the point. Called by MapPointStore::Add and MapPointStore::Erase.
+    MapPointStore::Handle AttachToStore(MapPointStore* pStore);
+    void DetachFromStore(MapPointStore* pStore);
+    MapPointStore::Handle GetStoreHandle();
+
     void PrintObservations();
 
-    void PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP);
-    void PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsigned int, MapPoint*>& mpMPid);
+    // Without bEraseUnsaved the observations of keyframes out of spKF are skipped, not erased
+    void PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP, const bool bEraseUnsaved = true);
+    // Stores the checkpoint epoch of its map, the point is saved again in the next checkpoint
+    void MarkChanged();
+    void PostLoad(const IdTable<KeyFrame>& KFTable, const IdTable<MapPoint>& MPTable);
 
 public:
     long unsigned int mnId;
-    static long unsigned int nNextId;
+    static std::atomic<long unsigned int> nNextId;
+    // Checkpoint epoch of the last change (0 for the loaded points)
+    // Written by the mapping threads and read by the checkpointer without locks
+    std::atomic<unsigned long> mnChangeEpoch;
     long int mnFirstKFid;
     long int mnFirstFrame;
     int nObs;
@@ -209,19 +275,23 @@ public:
 
 protected:    
 
-     // Position in absolute coordinates
-     Eigen::Vector3f mWorldPos;
+     // Point the data pointers to the own copy
+     void UseOwnData();
+
+     // Position in absolute coordinates, read without locks
+     std::atomic<SeqLockedFloats<3>*> mpWorldPos;
 
      // Keyframes observing the point and associated index in keyframe
-     std::map<KeyFrame*,std::tuple<int,int> > mObservations;
+     ObservationMap mObservations;
+     unsigned int mnObsVersion;
      // For save relation without pointer, this is necessary for save/load function
      std::map<long unsigned int, int> mBackupObservationsId1;
      std::map<long unsigned int, int> mBackupObservationsId2;
 
      // Mean viewing direction
-     Eigen::Vector3f mNormalVector;
+     Eigen::Vector3f* mpNormalVector;
 
-     // Best descriptor to fast matching
+     // Best descriptor to fast matching (header over the row of the store while the point is in a map)
      cv::Mat mDescriptor;
 
      // Reference KeyFrame
@@ -239,16 +309,32 @@ protected:
      long long int mBackupReplacedId;
 
      // Scale invariance distances
-     float mfMinDistance;
-     float mfMaxDistance;
+     float* mpfMinDistance;
+     float* mpfMaxDistance;
 
      Map* mpMap;
 
+     // Slot of the point in the storage of its map (NULL if the point is not in a map). The data
+     // pointers above point to the columns of the slot, or to the own copy below.
+     // Written with both mutexes held, any of them is enough to read it.
+     MapPointStore* mpStore;
+     MapPointStore::Handle mStoreHandle;
+     std::atomic<unsigned int>* mpnStoreNotified;
+
+     // Own copy of the data while the point is out of any map
+     SeqLockedFloats<3> mOwnWorldPos;
+     Eigen::Vector3f mOwnNormalVector;
+     float mfOwnMinDistance;
+     float mfOwnMaxDistance;
+
      // Mutex
-     std::mutex mMutexPos;
-     std::mutex mMutexFeatures;
+     SharedMutex mMutexPos;
+     SharedMutex mMutexFeatures;
      std::mutex mMutexMap;
 
+     static LockStats mStatsMutexPos;
+     static LockStats mStatsMutexFeatures;
+
 };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,192 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MAPPOINTSTORE_H
+#define MAPPOINTSTORE_H
+
+#include "SharedMutex.h"
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Core>
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+namespace ORB_SLAM3
+{
+
+class MapPoint;
+
+// Structure-of-arrays storage of the MapPoints of one Map, the set of points of the map. Each point
+// owns a slot, identified by a stable integer index plus a generation counter which is increased when
+// the slot is released, so stale handles are detected instead of aliasing a new point. The slot holds
+// the position, normal, depth bounds and descriptor of the point in contiguous columns. The columns are
+// allocated in blocks that are never moved, the point keeps pointers to its slot and its accessors read
+// and write it under the locks of the point (the position, through a seqlock, without them). A point out
+// of any map keeps its own copy of the data, it is moved in and out of the slot when the point is added
+// or erased. Bulk consumers read the positions column of all the slots with a View. Consumers with a copy
+// of the geometry (MapUpdateCollector) register as listeners and take the slots changed since their
+// previous call (points added, removed or moved).
+class MapPointStore
+{
+public:
+    struct Handle
+    {
+        Handle(): mnIdx(INVALID_IDX), mnGeneration(0) {}
+        Handle(unsigned int idx, unsigned int gen): mnIdx(idx), mnGeneration(gen) {}
+
+        bool IsNull() const { return mnIdx == INVALID_IDX; }
+
+        unsigned int mnIdx;
+        unsigned int mnGeneration;
+    };
+
+    static const unsigned int INVALID_IDX = 0xFFFFFFFF;
+
+    // One bit per listener in the notification masks of the points
+    static const int MAX_LISTENERS = 32;
+
+    // Slots per block of the columns
+    static const unsigned int BLOCK_BITS = 10;
+    static const unsigned int BLOCK_SIZE = 1 << BLOCK_BITS;
+
+    // Pointers to the data of one slot (or to the own copy of a point out of any map)
+    struct SlotData
+    {
+        SeqLockedFloats<3>* pPosition;
+        Eigen::Vector3f* pNormal;
+        float* pMinDistance;
+        float* pMaxDistance;
+        // Listeners that have not been notified of a move since they took their changes
+        std::atomic<unsigned int>* pnNotified;
+        // Header over the row of the descriptors block, empty if the descriptor is not in the store
+        cv::Mat descriptor;
+    };
+
+    // Read-only access to the slots and to the positions column. The store mutex is held while the view
+    // is alive, do not call MapPoint methods from it (the points lock themselves first and the store after).
+    // The other columns are written under the locks of each point, read them through the point.
+    class View
+    {
+    public:
+        View(std::mutex &mutex, const MapPointStore &store): mLock(mutex), mStore(store) {}
+
+        // Number of slots, empty slots have a NULL point
+        size_t slots() const { return mStore.mvpPoints.size(); }
+        size_t size() const { return mStore.mnNumPoints; }
+
+        MapPoint* point(size_t i) const { return mStore.mvpPoints[i]; }
+        Eigen::Vector3f position(size_t i) const;
+
+    private:
+        std::unique_lock<std::mutex> mLock;
+        const MapPointStore &mStore;
+    };
+
+    MapPointStore();
+    ~MapPointStore();
+
+    // Reserve a slot for the point and move its data into it. Adding a point that is already in the
+    // store returns its current handle.
+    Handle Add(MapPoint* pMP);
+    // Release the slot of the point (if it is in this store), the point takes back its data
+    void Erase(MapPoint* pMP);
+    // Release all the slots
+    void Clear();
+
+    bool IsValid(const Handle &handle);
+    MapPoint* GetMapPoint(const Handle &handle);
+
+    size_t Size();
+    std::vector<MapPoint*> GetAllMapPoints();
+
+    View GetView();
+
+    // Returns -1 if there are already MAX_LISTENERS
+    int AddListener();
+    void RemoveListener(const int nListener);
+    // Slots changed since the previous call of the listener, with the current positions of their points
+    // (vbValid is false if the slot was released). With bAll, in the first call and after a Clear they
+    // are all the valid slots and it returns true: the copy of the listener has to be dropped.
+    bool TakeChanges(const int nListener, const bool bAll, std::vector<unsigned int> &vnSlots,
+                     std::vector<bool> &vbValid, std::vector<Eigen::Vector3f> &vPositions, size_t &nSlots);
+    // Move of the point, from the listeners in nListeners (the ones that have not been notified
+    // since they took their changes). The lock of the point is held by the caller.
+    void NotifyMoved(const Handle &handle, const unsigned int nListeners);
+
+protected:
+    friend class MapPoint;
+
+    struct Block
+    {
+        SeqLockedFloats<3> vPositions[BLOCK_SIZE];
+        Eigen::Vector3f vNormals[BLOCK_SIZE];
+        float vMinDistances[BLOCK_SIZE];
+        float vMaxDistances[BLOCK_SIZE];
+        std::atomic<unsigned int> vnNotified[BLOCK_SIZE];
+        // One row per slot, allocated with the layout of the first descriptor of the store
+        cv::Mat descriptors;
+    };
+
+    struct Listener
+    {
+        bool bActive;
+        bool bFull;
+        std::vector<unsigned int> vnChangedSlots;
+        // Slots already in vnChangedSlots
+        std::vector<bool> vbQueued;
+    };
+
+    // Called by the point with its locks held. Insert reserves the slot (or returns the current one),
+    // writes the position and the descriptor and returns the pointers to the slot; the point copies the
+    // rest of its data before releasing its locks. Remove releases the slot, the point has taken back
+    // its data before.
+    Handle Insert(MapPoint* pMP, const Eigen::Vector3f &pos, const cv::Mat &descriptor, SlotData &slot);
+    void Remove(MapPoint* pMP);
+    // Row of the slot for a descriptor with that layout, empty if the handle is not valid or all the
+    // descriptors of the store have another layout (all the points of a map come from the same extractor)
+    cv::Mat GetDescriptorRow(const Handle &handle, const int cols, const int type);
+
+    bool IsValidNoLock(const Handle &handle) const;
+    cv::Mat GetDescriptorRowNoLock(const unsigned int idx, const int cols, const int type);
+    void QueueNoLock(const unsigned int idx, const unsigned int nListeners);
+
+    std::vector<MapPoint*> mvpPoints;
+    std::vector<unsigned int> mvGenerations;
+    std::vector<std::unique_ptr<Block> > mvpBlocks;
+
+    // Layout of the descriptors column, set by the first descriptor (-1 before it)
+    int mnDescriptorCols;
+    int mnDescriptorType;
+
+    std::vector<unsigned int> mvFreeSlots;
+    std::unordered_map<MapPoint*, unsigned int> mmPointSlot;
+    size_t mnNumPoints;
+
+    Listener mListeners[MAX_LISTENERS];
+
+    std::mutex mMutexStore;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // MAPPOINTSTORE_H
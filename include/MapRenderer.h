@@ -0,0 +1,86 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef MAPRENDERER_H
+#define MAPRENDERER_H
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <pangolin/pangolin.h>
+
+#include "MapUpdate.h"
+
+namespace ORB_SLAM3
+{
+
+class Atlas;
+
+// Draws the active map from vertex buffers that only receive the changes of the map (MapUpdate),
+// instead of sending every point and keyframe in immediate mode each frame. The buffers are
+// created in the first Update, all the methods are called from the thread with the GL context.
+class MapRenderer
+{
+public:
+    MapRenderer(Atlas* pAtlas, const float keyFrameSize);
+
+    // Apply the changes of the active map to the buffers
+    void Update();
+
+    void DrawMapPoints(const float pointSize);
+    void DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph, const bool bDrawInertialGraph, const bool bDrawOptLba,
+                       const float keyFrameLineWidth, const float graphLineWidth);
+
+protected:
+    void UpdatePoints();
+    void UpdateKeyFrames();
+
+    MapUpdateCollector mCollector;
+    MapUpdate mUpdate;
+
+    float mKeyFrameSize;
+
+    // Copy of the point slots, the buffer is indexed by slot and grows by doubling
+    std::vector<Eigen::Vector3f> mvPointPositions;
+    std::vector<bool> mvbPointValid;
+    pangolin::GlBuffer mPointBuffer;
+    // Valid slots, built again when a point is added or removed
+    pangolin::GlBuffer mPointIndexBuffer;
+    size_t mnPointIndices;
+
+    std::vector<Eigen::Vector3f> mvReferencePoints;
+
+    // Frustums in world coordinates (16 vertices per keyframe) with the colors of the LBA debug mode.
+    // The first keyframe of the map is drawn apart, with a wider line.
+    pangolin::GlBuffer mKeyFrameBuffer;
+    pangolin::GlBuffer mKeyFrameColorBuffer;
+    size_t mnKeyFrameVertices;
+    std::vector<Eigen::Vector3f> mvFirstKeyFrameLines;
+
+    pangolin::GlBuffer mGraphBuffer;
+    size_t mnGraphVertices;
+    pangolin::GlBuffer mInertialBuffer;
+    size_t mnInertialVertices;
+    bool mbImuInitialized;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // MAPRENDERER_H
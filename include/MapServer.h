@@ -0,0 +1,273 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef MAPSERVER_H
+#define MAPSERVER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Core>
+#include "sophus/se3.hpp"
+
+#include "ORBVocabulary.h"
+
+namespace ORB_SLAM3
+{
+
+class Atlas;
+class Frame;
+class KeyFrame;
+class KeyFrameDatabase;
+class Map;
+class MapPoint;
+
+// Data of a keyframe sent to the clients of the map server, enough to relocalize against it (BoW
+// matching and PnP) and to project its points
+struct KeyFrameRecord
+{
+    unsigned long nId;
+    unsigned long nMapId;
+    Sophus::SE3f Tcw;
+    std::vector<cv::KeyPoint> vKeysUn;
+    cv::Mat descriptors;
+    FeatureVector featVec;
+    // Point of each keypoint, -1 if there is none
+    std::vector<long> vnMapPointIds;
+    // Best covisible keyframes
+    std::vector<unsigned long> vnCovisibleIds;
+
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int version);
+};
+
+struct MapPointRecord
+{
+    unsigned long nId;
+    unsigned long nMapId;
+    Eigen::Vector3f pos;
+    Eigen::Vector3f normal;
+    cv::Mat descriptor;
+    // Scale invariance distances (MapPoint::GetMinDistanceInvariance, GetMaxDistanceInvariance)
+    float fMinDistance;
+    float fMaxDistance;
+
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int version);
+};
+
+struct MapInfo
+{
+    unsigned long nId;
+    unsigned long nKeyFrames;
+    unsigned long nMapPoints;
+
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int version)
+    {
+        ar & nId & nKeyFrames & nMapPoints;
+    }
+};
+
+// Serves one loaded atlas, with its vocabulary and keyframe database, to several clients, so each
+// robot does not keep its own copy. The clients send their descriptors for the relocalization queries
+// (the BoW vectors are computed here) and get the keyframes and points of their local map. A System in
+// client mode (System.MapServerClient) tracks in localization mode with the objects built from them.
+// Each client has a session with the objects already sent to it, they are sent once. The requests
+// and replies are boost binary archives; a client talks to the server through a MapTransport: a
+// Unix domain socket (MapServer::Listen) or the in-process LocalMapTransport.
+class MapServer
+{
+public:
+    enum eRequestType{
+        MAPS_REQUEST=0,
+        RELOCALIZATION_REQUEST=1,
+        LOCAL_MAP_REQUEST=2,
+        BOW_REQUEST=3
+    };
+
+    // Objects already sent to a client
+    struct Session
+    {
+        std::set<unsigned long> spKeyFrameIds;
+        std::set<unsigned long> spMapPointIds;
+    };
+
+    MapServer(Atlas* pAtlas, ORBVocabulary* pVoc, KeyFrameDatabase* pKFDB);
+    ~MapServer();
+
+    // Reply to an encoded request. Returns false if it could not be decoded.
+    bool HandleRequest(Session &session, const uint32_t nType, const std::string &strRequest, std::string &strReply);
+
+    // Socket for the clients, Run accepts them until RequestFinish
+    bool Listen(const std::string &strSocket);
+    void Run();
+
+    void RequestFinish();
+    bool isFinished();
+
+protected:
+    void GetMaps(std::vector<MapInfo> &vMaps);
+    void DetectRelocalizationCandidates(const cv::Mat &descriptors, const long nMapId, std::vector<unsigned long> &vnCandidates,
+                                        BowVector &bowVec, FeatureVector &featVec);
+    // Keyframes and their nCovisibles best covisibles, with their points. Only the objects not sent to
+    // the session are encoded, the ids of all of them are returned.
+    void GetLocalMap(Session &session, const std::vector<unsigned long> &vnKFIds, const int nCovisibles,
+                     std::vector<unsigned long> &vnLocalKFs, std::vector<unsigned long> &vnLocalMPs,
+                     std::vector<KeyFrameRecord> &vKeyFrames, std::vector<MapPointRecord> &vMapPoints);
+
+    // The index is built again for an id above the ones indexed (keyframes added by a running system), once
+    // per request at most (bIndexUpdated)
+    KeyFrame* GetKeyFrame(const unsigned long nId, bool &bIndexUpdated);
+    Map* GetMap(const long nId);
+    // Keyframes by id
+    void UpdateKeyFrameIndex();
+
+    // One client connection, until it closes or the server finishes
+    void ServeClient(int fd);
+    // Joins the threads of the clients that closed their connection
+    void JoinFinishedClients();
+
+    Atlas* mpAtlas;
+    ORBVocabulary* mpVoc;
+    KeyFrameDatabase* mpKeyFrameDB;
+
+    std::mutex mMutexIndex;
+    std::map<unsigned long, KeyFrame*> mmKeyFrames;
+    // Largest id ever indexed, the ids of the keyframes grow
+    unsigned long mnMaxIndexedId;
+
+    std::string mStrSocket;
+    int mnListenFd;
+    std::vector<std::thread*> mvptClients;
+    std::mutex mMutexClients;
+    std::set<std::thread::id> msFinishedClients;
+
+    std::mutex mMutexFinish;
+    bool mbFinishRequested;
+    bool mbFinished;
+};
+
+// Channel from a client to the server
+class MapTransport
+{
+public:
+    virtual ~MapTransport(){}
+    virtual bool Request(const uint32_t nType, const std::string &strRequest, std::string &strReply) = 0;
+};
+
+// Stand-in of the socket inside the process of the server, for tests and single machine setups. The
+// requests are encoded and decoded as with the socket.
+class LocalMapTransport : public MapTransport
+{
+public:
+    LocalMapTransport(MapServer* pServer);
+    bool Request(const uint32_t nType, const std::string &strRequest, std::string &strReply);
+
+protected:
+    MapServer* mpServer;
+    MapServer::Session mSession;
+};
+
+// Connection to the socket of a server in another process
+class SocketMapTransport : public MapTransport
+{
+public:
+    SocketMapTransport();
+    ~SocketMapTransport();
+
+    bool Connect(const std::string &strSocket);
+    void Close();
+
+    bool Request(const uint32_t nType, const std::string &strRequest, std::string &strReply);
+
+protected:
+    int mnFd;
+};
+
+// Queries of a client of the map server. The keyframes and points received are kept, the server sends
+// each of them once.
+// Tracking in client mode works with KeyFrame and MapPoint objects built from the records, added to a
+// map of the client. They are built the first time they are needed, with the camera and the scale
+// levels of the frame being tracked (the clients run the camera settings of the served atlas), and
+// keep the pose and position of the first reply: the served atlas is not expected to change. They
+// have the observations between them, not the covisibility graph nor the spanning tree, the
+// covisible keyframes come from the records (GetCovisibles).
+class MapClient
+{
+public:
+    MapClient(MapTransport* pTransport);
+
+    bool GetMaps(std::vector<MapInfo> &vMaps);
+
+    // Candidates in the map nMapId (-1 for every map) for the descriptors of a frame, with the BoW
+    // vectors of the frame for the matching with them
+    bool DetectRelocalizationCandidates(const cv::Mat &descriptors, const long nMapId, std::vector<const KeyFrameRecord*> &vpCandidates,
+                                        BowVector &bowVec, FeatureVector &featVec);
+
+    // Keyframes and their nCovisibles best covisibles, with the points they see
+    bool GetLocalMap(const std::vector<unsigned long> &vnKFIds, const int nCovisibles, std::vector<const KeyFrameRecord*> &vpKeyFrames,
+                     std::vector<const MapPointRecord*> &vpMapPoints);
+
+    const KeyFrameRecord* GetKeyFrame(const unsigned long nId) const;
+    const MapPointRecord* GetMapPoint(const unsigned long nId) const;
+
+    // BoW vectors of a frame, computed by the server
+    bool ComputeBoW(const cv::Mat &descriptors, BowVector &bowVec, FeatureVector &featVec);
+
+    // Object versions of the queries for Tracking, the new objects are added to pMap. Only the frame F
+    // is used for the BoW vectors and the camera of the new keyframes.
+    bool ComputeBoW(Frame &F);
+    bool DetectRelocalizationCandidates(Frame &F, Map* pMap, std::vector<KeyFrame*> &vpCandidates);
+    // nCovisibles best covisibles of each keyframe of vpKFs, the missing ones are requested in one
+    // local map request
+    bool GetCovisibles(const std::vector<KeyFrame*> &vpKFs, const int nCovisibles, Frame &F, Map* pMap,
+                       std::vector<std::vector<KeyFrame*> > &vvpCovisibles);
+
+    // Forgets the objects, not the records, once the map holding them has been cleared (reset)
+    void ClearObjects();
+
+protected:
+    // Keeps the keyframes and points of a reply
+    void StoreRecords(std::vector<KeyFrameRecord> &vKeyFrames, std::vector<MapPointRecord> &vMapPoints);
+
+    // Object of a received keyframe with its points, NULL if the record is missing
+    KeyFrame* GetKeyFrameObject(const unsigned long nId, Frame &F, Map* pMap);
+    MapPoint* GetMapPointObject(const MapPointRecord &record, KeyFrame* pRefKF, Map* pMap);
+
+    MapTransport* mpTransport;
+
+    std::map<unsigned long, KeyFrameRecord> mmKeyFrames;
+    std::map<unsigned long, MapPointRecord> mmMapPoints;
+
+    // Objects built from the records, by the id on the server (also the id of the object)
+    std::map<unsigned long, KeyFrame*> mmpKeyFrames;
+    std::map<unsigned long, MapPoint*> mmpMapPoints;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // MAPSERVER_H
@@ -0,0 +1,86 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef MAPSTREAMER_H
+#define MAPSTREAMER_H
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MapUpdate.h"
+
+namespace ORB_SLAM3
+{
+
+class Atlas;
+class MapDrawer;
+
+// Headless counterpart of the viewer: every period it sends the changes of the active map (MapUpdate)
+// and the current camera pose to a file and/or to the clients of a Unix domain socket, for a viewer in
+// another process or machine. Each message is a MessageHeader (SocketUtils.h) with the type, as in
+// MapServer, followed by a boost binary archive, without header, of the MapUpdate and the camera pose
+// (Twc). The type is FULL_UPDATE when the receiver has to drop its copy. A new client makes the next
+// update full for everyone.
+class MapStreamer
+{
+public:
+    enum eMessageType{
+        INCREMENTAL_UPDATE=0,
+        FULL_UPDATE=1
+    };
+
+    MapStreamer(Atlas* pAtlas, MapDrawer* pMapDrawer, const double period);
+    ~MapStreamer();
+
+    bool OpenFile(const std::string &strFile);
+    bool Listen(const std::string &strSocket);
+
+    // Main function, an update every period (seconds) until RequestFinish
+    void Run();
+
+    void RequestFinish();
+    bool isFinished();
+
+protected:
+    void AcceptClients();
+    void Send(const MapUpdate &update);
+
+    MapDrawer* mpMapDrawer;
+    MapUpdateCollector mCollector;
+    double mPeriod;
+
+    std::ofstream mFile;
+
+    std::string mStrSocket;
+    int mnListenFd;
+    std::vector<int> mvnClientFds;
+
+    std::mutex mMutexFinish;
+    std::condition_variable mCondFinish;
+    bool mbFinishRequested;
+    bool mbFinished;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // MAPSTREAMER_H
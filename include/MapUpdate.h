@@ -0,0 +1,115 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MAPUPDATE_H
+#define MAPUPDATE_H
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+namespace ORB_SLAM3
+{
+
+class Atlas;
+class Map;
+class MapPoint;
+class MapPointStore;
+
+// Geometry of the active map that changed since the previous update, for the consumers that keep
+// their own copy of it (MapRenderer in the viewer, MapStreamer). The points are the slots of the
+// MapPointStore of the map; the keyframes are small and are sent complete when any of them changes.
+struct MapUpdate
+{
+    enum eKeyFrameType{
+        KF_FIRST=0,
+        KF_LBA_OPTIMIZED=1,
+        KF_LBA_FIXED=2,
+        KF_OTHER=3
+    };
+
+    MapUpdate();
+
+    void Clear();
+
+    long nMapId;
+    // Full update: the copy of the consumer has to be dropped before applying it
+    bool bFull;
+
+    // Changed point slots, an invalid slot has been released (bad point)
+    unsigned long nPointSlots;
+    std::vector<unsigned int> vnPointSlots;
+    std::vector<Eigen::Vector3f> vPointPositions;
+    std::vector<bool> vbPointValid;
+
+    // Reference points of the tracking, sent in every update
+    std::vector<Eigen::Vector3f> vReferencePoints;
+
+    // Keyframes, valid if bKeyFrames
+    bool bKeyFrames;
+    std::vector<unsigned long> vnKeyFrameIds;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > vKeyFramePoses;
+    std::vector<int> vnKeyFrameTypes;
+    // Endpoints of the covisibility graph, spanning tree and loop edges, and of the inertial links
+    std::vector<Eigen::Vector3f> vGraphLines;
+    std::vector<Eigen::Vector3f> vInertialLines;
+    bool bImuInitialized;
+
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int version);
+};
+
+// Builds the updates of the active map of the atlas, each consumer owns its collector
+class MapUpdateCollector
+{
+public:
+    MapUpdateCollector(Atlas* pAtlas);
+    ~MapUpdateCollector();
+
+    // Fills the update with the changes since the previous call. Returns false if there is no map.
+    bool Collect(MapUpdate &update);
+
+    // The next update will be full
+    void Reset();
+
+protected:
+    void CollectPoints(Map* pMap, MapUpdate &update);
+    void CollectKeyFrames(Map* pMap, MapUpdate &update);
+
+    Atlas* mpAtlas;
+
+    bool mbFull;
+    long mnLastMapId;
+
+    // Listener in the point store of the map
+    MapPointStore* mpStore;
+    int mnListener;
+
+    // Signature of the keyframes of the last update
+    int mnLastChangeIdx;
+    int mnLastBigChangeIdx;
+    unsigned long mnLastKeyFrames;
+    unsigned long mnLastMaxKFid;
+    bool mbLastImuInitialized;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // MAPUPDATE_H
@@ -35,8 +35,12 @@ namespace ORB_SLAM3
 #ifdef USE_DBOW2
     typedef DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>
     ORBVocabulary;
+    typedef DBoW2::BowVector BowVector;
+    typedef DBoW2::FeatureVector FeatureVector;
 #else
     typedef DBoW3::Vocabulary ORBVocabulary;
+    typedef DBoW3::BowVector BowVector;
+    typedef DBoW3::FeatureVector FeatureVector;
 #endif
 } //namespace ORB_SLAM
 
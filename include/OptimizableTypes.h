@@ -110,6 +110,8 @@ public:
     }
 
     virtual void linearizeOplus();
+    // Jacobians in float, for the mixed precision mode
+    virtual bool linearizeOplusFloat(Eigen::Matrix<float,2,3> &A, Eigen::Matrix<float,2,6> &B);
 
     GeometricCamera* pCamera;
 };
@@ -25,15 +25,21 @@
 #include "KeyFrame.h"
 #include "LoopClosing.h"
 #include "Frame.h"
+#include "TaskScheduler.h"
 
 #include <math.h>
 
+// Flag to write the observations and initial pose of every PoseOptimization to PoseFrames.txt, to replay
+// them with Tests/BenchPoseSolver.
+//#define REGISTER_POSE_FRAMES
+
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 #include "Thirdparty/g2o/g2o/core/sparse_block_matrix.h"
 #include "Thirdparty/g2o/g2o/core/block_solver.h"
 #include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
 #include "Thirdparty/g2o/g2o/core/optimization_algorithm_gauss_newton.h"
 #include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_pcg.h"
 #include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
 #include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
 #include "Thirdparty/g2o/g2o/solvers/linear_solver_dense.h"
@@ -43,18 +49,67 @@ namespace ORB_SLAM3
 
 class LoopClosing;
 
+// Runs the parallel loops of g2o (linearization, Schur complement) in the workers of the scheduler
+class G2oSchedulerExecutor : public g2o::ParallelExecutor
+{
+public:
+    G2oSchedulerExecutor(TaskScheduler* pScheduler, const TaskScheduler::ePriority priority): mpScheduler(pScheduler), mPriority(priority) {}
+
+    virtual void parallelFor(int first, int last, const std::function<void(int)>& f, int grain)
+    {
+        mpScheduler->ParallelFor(first, last, f, mPriority, grain);
+    }
+
+    // The calling thread also runs chunks
+    virtual int numThreads() const
+    {
+        return mpScheduler->NumThreads() + 1;
+    }
+
+private:
+    TaskScheduler* mpScheduler;
+    TaskScheduler::ePriority mPriority;
+};
+
 class Optimizer
 {
 public:
 
+    // Linear solver of the reduced camera system (bundle adjustment) or of the pose graph (essential graph)
+    enum eLinearSolver{
+        LINEAR_SOLVER_CHOLESKY=0,       // Sparse Cholesky, AMD ordering of the scalar matrix
+        LINEAR_SOLVER_BLOCK_CHOLESKY=1, // Sparse Cholesky, AMD ordering of the blocks (the pose blocks are not split)
+        LINEAR_SOLVER_PCG=2,            // Conjugate gradient with block-Jacobi preconditioner
+        LINEAR_SOLVER_PCG_INEXACT=3,    // PCG with a tolerance relative to the gradient norm (inexact LM steps)
+        LINEAR_SOLVER_AUTO=4            // Cholesky for small maps, inexact PCG for large ones
+    };
+
+    // Keyframes from which LINEAR_SOLVER_AUTO solves with inexact PCG. Below it the Cholesky factor of the
+    // reduced camera system is sparse enough to be faster.
+    static const size_t PCG_MIN_KEYFRAMES = 500;
+
+    template<class BlockSolverType>
+    static typename BlockSolverType::LinearSolverType* CreateLinearSolver(eLinearSolver type, const size_t nKFs);
+
+    // Mixed precision bundle adjustment (local, global and inertial): the Hessian blocks of the reprojection
+    // edges are computed in float, the reduced system is accumulated and solved in double. Off by default
+    // (Optimizer.MixedPrecision in the settings file). The setting is process-wide: with several systems in
+    // one process the last one constructed sets it for all of them.
+    static void SetMixedPrecision(const bool bMixedPrecision);
+    static bool MixedPrecision();
+
+    // With pScheduler the Hessian and the Schur complement are built by the workers of the scheduler
     void static BundleAdjustment(const std::vector<KeyFrame*> &vpKF, const std::vector<MapPoint*> &vpMP,
                                  int nIterations = 5, bool *pbStopFlag=NULL, const unsigned long nLoopKF=0,
-                                 const bool bRobust = true);
+                                 const bool bRobust = true, TaskScheduler* pScheduler=NULL,
+                                 eLinearSolver linearSolverType=LINEAR_SOLVER_CHOLESKY);
     void static GlobalBundleAdjustemnt(Map* pMap, int nIterations=5, bool *pbStopFlag=NULL,
-                                       const unsigned long nLoopKF=0, const bool bRobust = true);
-    void static FullInertialBA(Map *pMap, int its, const bool bFixLocal=false, const unsigned long nLoopKF=0, bool *pbStopFlag=NULL, bool bInit=false, float priorG = 1e2, float priorA=1e6, Eigen::VectorXd *vSingVal = NULL, bool *bHess=NULL);
+                                       const unsigned long nLoopKF=0, const bool bRobust = true, TaskScheduler* pScheduler=NULL,
+                                       eLinearSolver linearSolverType=LINEAR_SOLVER_CHOLESKY);
+    void static FullInertialBA(Map *pMap, int its, const bool bFixLocal=false, const unsigned long nLoopKF=0, bool *pbStopFlag=NULL, bool bInit=false, float priorG = 1e2, float priorA=1e6, Eigen::VectorXd *vSingVal = NULL, bool *bHess=NULL, TaskScheduler* pScheduler=NULL,
+                               eLinearSolver linearSolverType=LINEAR_SOLVER_CHOLESKY);
 
-    void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges);
+    void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, TaskScheduler* pScheduler=NULL);
 
     int static PoseOptimization(Frame* pFrame);
     int static PoseInertialOptimizationLastKeyFrame(Frame* pFrame, bool bRecInit = false);
@@ -65,7 +120,7 @@ public:
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
                                        const map<KeyFrame *, set<KeyFrame *> > &LoopConnections,
-                                       const bool &bFixScale);
+                                       const bool &bFixScale, eLinearSolver linearSolverType=LINEAR_SOLVER_CHOLESKY);
     void static OptimizeEssentialGraph(KeyFrame* pCurKF, vector<KeyFrame*> &vpFixedKFs, vector<KeyFrame*> &vpFixedCorrectedKFs,
                                        vector<KeyFrame*> &vpNonFixedKFs, vector<MapPoint*> &vpNonCorrectedMPs);
 
@@ -73,7 +128,8 @@ public:
     void static OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections);
+                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections,
+                                       eLinearSolver linearSolverType=LINEAR_SOLVER_CHOLESKY);
 
 
     // if bFixScale is true, optimize SE3 (stereo,rgbd), Sim3 otherwise (mono) (NEW)
@@ -83,7 +139,7 @@ public:
 
     // For inertial systems
 
-    void static LocalInertialBA(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge = false, bool bRecInit = false);
+    void static LocalInertialBA(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge = false, bool bRecInit = false, TaskScheduler* pScheduler=NULL);
     void static MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbStopFlag, Map *pMap, LoopClosing::KeyFrameAndPose &corrPoses);
 
     // Local BA in welding area when two maps are merged
@@ -101,6 +157,26 @@ public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 };
 
+template<class BlockSolverType>
+typename BlockSolverType::LinearSolverType* Optimizer::CreateLinearSolver(eLinearSolver type, const size_t nKFs)
+{
+    typedef typename BlockSolverType::PoseMatrixType PoseMatrixType;
+
+    if(type == LINEAR_SOLVER_AUTO)
+        type = nKFs >= PCG_MIN_KEYFRAMES ? LINEAR_SOLVER_PCG_INEXACT : LINEAR_SOLVER_CHOLESKY;
+
+    if(type == LINEAR_SOLVER_PCG || type == LINEAR_SOLVER_PCG_INEXACT)
+    {
+        g2o::LinearSolverPCG<PoseMatrixType>* linearSolver = new g2o::LinearSolverPCG<PoseMatrixType>();
+        linearSolver->setInexact(type == LINEAR_SOLVER_PCG_INEXACT);
+        return linearSolver;
+    }
+
+    g2o::LinearSolverEigen<PoseMatrixType>* linearSolver = new g2o::LinearSolverEigen<PoseMatrixType>();
+    linearSolver->setBlockOrdering(type == LINEAR_SOLVER_BLOCK_CHOLESKY);
+    return linearSolver;
+}
+
 } //namespace ORB_SLAM3
 
 #endif // OPTIMIZER_H
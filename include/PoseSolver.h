@@ -0,0 +1,242 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef POSESOLVER_H
+#define POSESOLVER_H
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include "sophus/se3.hpp"
+
+namespace ORB_SLAM3
+{
+
+class GeometricCamera;
+
+namespace IMU
+{
+class Preintegrated;
+}
+
+// Levenberg-Marquardt solver for the pose of one frame with its map points fixed (motion-only BA).
+// It reproduces the g2o setup of Optimizer::PoseOptimization (SE3 left increment, Huber kernel,
+// same damping strategy) with fixed-size matrices. The observations are stored as one array per
+// field and the buffers are kept between calls, so a solver reused from frame to frame does not
+// allocate memory once it has seen the largest frame.
+class PoseSolver
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    enum eObservationType{
+        MONOCULAR=0,
+        STEREO=1,
+        MONOCULAR_RIGHT=2
+    };
+
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+    typedef Eigen::Matrix<double,6,1> Vector6d;
+    typedef Eigen::Matrix<double,3,6> Matrix36d;
+
+    PoseSolver();
+
+    // Remove the observations, the memory is kept
+    void Clear();
+
+    // Camera of the monocular observations and calibration of the stereo (rectified) ones
+    void SetCalibration(GeometricCamera* pCamera, const float fx, const float fy, const float cx, const float cy, const float bf);
+    // Second camera of a rig, Trl goes from the first (body) camera to this one
+    void SetRightCamera(GeometricCamera* pCamera, const Sophus::SE3f &Trl);
+    void SetHuberDeltas(const float deltaMono, const float deltaStereo);
+
+    // idx is the index of the keypoint in the frame, used to report outliers
+    void AddMonocular(const Eigen::Vector3f &Xw, const float u, const float v, const float invSigma2, const int idx);
+    void AddStereo(const Eigen::Vector3f &Xw, const float u, const float v, const float ur, const float invSigma2, const int idx);
+    void AddMonocularRight(const Eigen::Vector3f &Xw, const float u, const float v, const float invSigma2, const int idx);
+
+    // Iterations starting at Tcw with the observations classified as inliers. The Huber kernel
+    // is applied if bRobust. Returns false if there were no inliers.
+    bool Optimize(Sophus::SE3d &Tcw, const int nIterations, const bool bRobust);
+
+    // Chi-square test of every observation at Tcw (without robust kernel). The result is stored
+    // for the next optimization and in vbOutlier. Returns the number of outliers.
+    int ClassifyOutliers(const Sophus::SE3d &Tcw, const float chi2Mono, const float chi2Stereo, std::vector<bool> &vbOutlier);
+
+    size_t Size() const;
+
+protected:
+    // Residual and Jacobian (w.r.t. the left increment [omega, upsilon]) of every inlier. Returns the
+    // chi2 of the inliers, with the robust kernel if bRobust.
+    double Linearize(const Sophus::SE3d &Tcw, const bool bRobust);
+    void BuildSystem(Matrix6d &H, Vector6d &b) const;
+    double RobustChi2(const Sophus::SE3d &Tcw, const bool bRobust) const;
+
+    // Residual of observation i for the camera pose (Rcw,tcw), the unused row of the monocular ones is zero
+    void ComputeError(const size_t i, const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw, Eigen::Vector3d &e) const;
+    void ComputeErrorAndJacobian(const size_t i, const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw,
+                                 Eigen::Vector3d &e, Matrix36d &J) const;
+    double RobustWeight(const size_t i, const double chi2, double &rho) const;
+
+    void Add(const eObservationType type, const Eigen::Vector3f &Xw, const float u, const float v, const float ur,
+             const float invSigma2, const int idx);
+
+    // Observations
+    std::vector<Eigen::Vector3d> mvXw;
+    std::vector<Eigen::Vector3d> mvObs;
+    std::vector<double> mvInvSigma2;
+    std::vector<unsigned char> mvType;
+    std::vector<unsigned char> mvbInlier;
+    std::vector<int> mvIdx;
+
+    // Linearization of the inliers at the current estimate
+    std::vector<Matrix36d, Eigen::aligned_allocator<Matrix36d> > mvJ;
+    std::vector<Eigen::Vector3d> mvE;
+    std::vector<double> mvW;
+    size_t mnActive;
+
+    GeometricCamera* mpCamera;
+    GeometricCamera* mpCamera2;
+    Eigen::Matrix3d mRrl;
+    Eigen::Vector3d mtrl;
+    double fx, fy, cx, cy, mbf;
+    double mDeltaMono, mDeltaStereo;
+};
+
+// Gauss-Newton solver for the inertial motion-only optimization of one frame
+// (Optimizer::PoseInertialOptimizationLastKeyFrame and LastFrame). The state of the frame is its
+// IMU pose, velocity and biases (15 DoF). The preintegration links it to the previous state, which
+// is fixed (last keyframe) or optimized too with the prior left by its own optimization (last
+// frame). Errors, Jacobians, kernels and steps are those of the g2o graph (G2oTypes), the
+// visual observations are stored as in PoseSolver.
+class InertialPoseSolver
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+    typedef Eigen::Matrix<double,9,9> Matrix9d;
+    typedef Eigen::Matrix<double,15,15> Matrix15d;
+    typedef Eigen::Matrix<double,30,30> Matrix30d;
+    typedef Eigen::Matrix<double,30,1> Vector30d;
+    typedef Eigen::Matrix<double,3,6> Matrix36d;
+
+    // IMU pose, velocity and biases of a frame
+    struct State
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        Eigen::Matrix3d Rwb;
+        Eigen::Vector3d twb;
+        Eigen::Vector3d vwb;
+        Eigen::Vector3d bg;
+        Eigen::Vector3d ba;
+    };
+
+    InertialPoseSolver();
+
+    // Remove the observations and the previous state, the memory is kept
+    void Clear();
+
+    // Tcb goes from the IMU to the (left) camera, Trl from the left camera to the right one of a rig
+    void SetCamera(GeometricCamera* pCamera, const Sophus::SE3f &Tcb, const float bf);
+    void SetRightCamera(GeometricCamera* pCamera, const Sophus::SE3f &Trl);
+    void SetHuberDeltas(const float deltaMono, const float deltaStereo, const float deltaPrior);
+
+    // cam is 0 (left) or 1 (right of a rig). Close points (bClose) have a looser outlier test.
+    void AddMonocular(const Eigen::Vector3f &Xw, const float u, const float v, const float invSigma2, const int cam,
+                      const bool bClose, const int idx);
+    void AddStereo(const Eigen::Vector3f &Xw, const float u, const float v, const float ur, const float invSigma2, const int idx);
+
+    // Preintegration from the previous state to the frame and information of the bias random walks
+    void SetInertial(IMU::Preintegrated* pInt, const Eigen::Matrix3d &InfoG, const Eigen::Matrix3d &InfoA);
+    // Previous state, fixed unless it has a prior. H is the information of the prior at priorState.
+    void SetPrevious(const State &prevState);
+    void SetPrior(const State &priorState, const Matrix15d &H);
+
+    void SetState(const State &state);
+    const State& GetState() const;
+
+    // Gauss-Newton iterations from the current state with the observations classified as inliers.
+    // The Huber kernel is applied to the visual errors if bRobust. Returns false if a step failed.
+    bool Optimize(const int nIterations, const bool bRobust);
+
+    // Chi-square test of every visual observation at the current state, monocular points behind the
+    // camera are outliers too. The result is stored for the next optimization and in vbOutlier.
+    // Returns the number of outliers.
+    int ClassifyOutliers(const float chi2Mono, const float chi2Close, const float chi2Stereo, std::vector<bool> &vbOutlier);
+    // Accept again the observations below the given thresholds. Returns the number of outliers left.
+    int RecoverOutliers(const float chi2Mono, const float chi2Stereo, std::vector<bool> &vbOutlier);
+
+    // Hessian at the current state of all the errors without robust kernel: [previous, frame] (30x30)
+    // if the previous state is optimized, only the frame block (15x15) otherwise
+    Eigen::MatrixXd GetHessian() const;
+
+    // Number of visual observations
+    size_t Size() const;
+
+protected:
+    void UpdateCameraPoses();
+
+    // Visual residual of observation i (the unused row of the monocular ones is zero)
+    void ComputeError(const size_t i, Eigen::Vector3d &e) const;
+    void ComputeErrorAndJacobian(const size_t i, Eigen::Vector3d &e, Matrix36d &J) const;
+    bool IsDepthPositive(const size_t i) const;
+
+    // Normal equations [previous, frame] of the visual, inertial, bias random walk and prior
+    // errors. Each block is [rotation, translation, velocity, gyro bias, acc bias].
+    void BuildSystem(Matrix30d &H, Vector30d &b, const bool bRobust, const bool bRobustPrior) const;
+    void InertialError(Eigen::Matrix<double,9,1> &e, Eigen::Matrix<double,9,30> &J) const;
+    void PriorError(Eigen::Matrix<double,15,1> &e, Matrix15d &J) const;
+
+    static void Update(const Eigen::Matrix<double,15,1> &dx, State &state);
+
+    // Observations
+    std::vector<Eigen::Vector3d> mvXw;
+    std::vector<Eigen::Vector3d> mvObs;
+    std::vector<double> mvInvSigma2;
+    std::vector<unsigned char> mvType;
+    std::vector<unsigned char> mvCam;
+    std::vector<unsigned char> mvbClose;
+    std::vector<unsigned char> mvbInlier;
+    std::vector<int> mvIdx;
+
+    // Cameras, the poses Tcw follow the current state
+    int mnCameras;
+    GeometricCamera* mpCameras[2];
+    Eigen::Matrix3d mRcb[2], mRcw[2];
+    Eigen::Vector3d mtcb[2], mtcw[2];
+    double mbf;
+    double mDeltaMono, mDeltaStereo, mDeltaPrior;
+
+    // Inertial terms
+    IMU::Preintegrated* mpInt;
+    Matrix9d mInfoInertial;
+    Eigen::Matrix3d mInfoG, mInfoA;
+
+    State mState;
+    State mPrevState;
+    bool mbPrevFixed;
+    State mPriorState;
+    Matrix15d mInfoPrior;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // POSESOLVER_H
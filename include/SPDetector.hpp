@@ -6,6 +6,8 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <SuperPoint.hpp>
 
 namespace SuperPointSLAM
@@ -32,7 +34,28 @@ public:
      * @param _use_cuda whether the model operates in cpu or gpu.
      */
     SPDetector(std::string _weight_dir, bool _use_cuda);
-    // SPDetector(std::shared_ptr<SuperPoint::SuperPoint> _model) : model(_model){};
+
+    /**
+     * @brief Construct a new SPDetector::SPDetector object on a model 
+     * that is already loaded. The model is only read by detect(), 
+     * so the detectors of every extractor (and of every SLAM system 
+     * in the process) can share it.
+     * 
+     * @param _model SuperPoint model returned by LoadModel().
+     * @param _use_cuda whether the model operates in cpu or gpu.
+     */
+    SPDetector(std::shared_ptr<SuperPoint> _model, bool _use_cuda);
+
+    /**
+     * @brief Load the weights in _weight_dir, move them to the device 
+     * and make the model evaluation mode. The models are cached by path 
+     * and device, so the weights are read once while any detector uses them.
+     * 
+     * @param _weight_dir the PATH that contains pretrained weight.
+     * @param _use_cuda whether the model operates in cpu or gpu.
+     * @return std::shared_ptr<SuperPoint> 
+     */
+    static std::shared_ptr<SuperPoint> LoadModel(const std::string &_weight_dir, bool _use_cuda);
     
     ~SPDetector(){}
 
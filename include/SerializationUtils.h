@@ -33,6 +33,10 @@
 namespace ORB_SLAM3
 {
 
+// Flag of the boost archives of the chunked atlas file (AtlasFile): the keyframe descriptors
+// are stored in sections of their own, out of the keyframe records
+const unsigned int ARCHIVE_DESCRIPTORS_APART = 0x100;
+
 template <class Archive>
 void serializeSophusSE3(Archive &ar, Sophus::SE3f &T, const unsigned int version)
 {
@@ -0,0 +1,155 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SHAREDMUTEX_H
+#define SHAREDMUTEX_H
+
+// MAP_SHARED_LOCKS (CMake option, ON by default) takes shared (reader) locks in the read
+// paths of the map (map update mutex, KeyFrame and MapPoint accessors) and reads the
+// MapPoint positions lock-free. Without it every lock is exclusive.
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <ostream>
+
+namespace ORB_SLAM3
+{
+
+// Contention counters of one mutex (or of the same mutex member in all the instances of a
+// class). Only the slow path, when the lock could not be taken at the first try, is counted.
+class LockStats
+{
+public:
+    // The counters are registered with a name and live until the end of the program
+    LockStats(const std::string &name);
+
+    void AddWait(const bool bShared, const unsigned long long nWaitNs);
+    void Reset();
+
+    static void PrintAll(std::ostream &os);
+    static void ResetAll();
+
+    const std::string mName;
+
+    std::atomic<unsigned long long> mnContendedExclusive;
+    std::atomic<unsigned long long> mnContendedShared;
+    std::atomic<unsigned long long> mnWaitNs;
+    std::atomic<unsigned long long> mnMaxWaitNs;
+};
+
+// Reader-writer mutex with contention counters. It can be used with std::unique_lock
+// (writers) and std::shared_lock (readers).
+class SharedMutex
+{
+public:
+    SharedMutex(LockStats* pStats = static_cast<LockStats*>(NULL)): mpStats(pStats) {}
+
+    SharedMutex(const SharedMutex&) = delete;
+    SharedMutex& operator=(const SharedMutex&) = delete;
+
+    void lock()
+    {
+        if(!mMutex.try_lock())
+            LockSlow(false);
+    }
+
+    bool try_lock() { return mMutex.try_lock(); }
+    void unlock() { mMutex.unlock(); }
+
+    void lock_shared()
+    {
+#ifdef MAP_SHARED_LOCKS
+        if(!mMutex.try_lock_shared())
+            LockSlow(true);
+#else
+        lock();
+#endif
+    }
+
+    bool try_lock_shared()
+    {
+#ifdef MAP_SHARED_LOCKS
+        return mMutex.try_lock_shared();
+#else
+        return mMutex.try_lock();
+#endif
+    }
+
+    void unlock_shared()
+    {
+#ifdef MAP_SHARED_LOCKS
+        mMutex.unlock_shared();
+#else
+        mMutex.unlock();
+#endif
+    }
+
+private:
+    void LockSlow(const bool bShared);
+
+    std::shared_timed_mutex mMutex;
+    LockStats* mpStats;
+};
+
+// Sequence lock for a small array of floats. Writers must be serialized by the caller
+// (they hold the exclusive lock of the owner), readers never block nor write shared memory,
+// they retry if a write happened while they were copying.
+template<int N>
+class SeqLockedFloats
+{
+public:
+    SeqLockedFloats(): mnSeq(0)
+    {
+        for(int i=0; i<N; i++)
+            mData[i].store(0.f, std::memory_order_relaxed);
+    }
+
+    void Store(const float* pData)
+    {
+        const unsigned int seq = mnSeq.load(std::memory_order_relaxed);
+        mnSeq.store(seq+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(int i=0; i<N; i++)
+            mData[i].store(pData[i], std::memory_order_relaxed);
+        mnSeq.store(seq+2, std::memory_order_release);
+    }
+
+    void Load(float* pData) const
+    {
+        unsigned int seq0, seq1;
+        do
+        {
+            seq0 = mnSeq.load(std::memory_order_acquire);
+            for(int i=0; i<N; i++)
+                pData[i] = mData[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq1 = mnSeq.load(std::memory_order_relaxed);
+        } while((seq0 & 1) || seq0 != seq1);
+    }
+
+private:
+    std::atomic<unsigned int> mnSeq;
+    std::atomic<float> mData[N];
+};
+
+} //namespace ORB_SLAM3
+
+#endif // SHAREDMUTEX_H
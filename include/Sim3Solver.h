@@ -22,6 +22,7 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <random>
 
 #include "KeyFrame.h"
 
@@ -39,6 +40,9 @@ public:
 
     void SetRansacParameters(double probability = 0.99, int minInliers = 6 , int maxIterations = 300);
 
+    // Seed of the random sets of this solver, solvers with the same seed and input give the same result
+    void SetSeed(const unsigned int seed);
+
     Eigen::Matrix4f find(std::vector<bool> &vbInliers12, int &nInliers);
 
     Eigen::Matrix4f iterate(int nIterations, bool &bNoMore, std::vector<bool> &vbInliers, int &nInliers);
@@ -57,6 +61,10 @@ protected:
 
     void CheckInliers();
 
+    // Squared reprojection error of every column of P3Dc (camera coordinates) against P2D
+    void ReprojectionErrors(const Eigen::Matrix<float,3,Eigen::Dynamic> &P3Dc, const Eigen::Matrix<float,2,Eigen::Dynamic> &P2D,
+                            GeometricCamera* pCamera, Eigen::Array<float,1,Eigen::Dynamic> &error2);
+
     void Project(const std::vector<Eigen::Vector3f> &vP3Dw, std::vector<Eigen::Vector2f> &vP2D, Eigen::Matrix4f Tcw, GeometricCamera* pCamera);
     void FromCameraToImage(const std::vector<Eigen::Vector3f> &vP3Dc, std::vector<Eigen::Vector2f> &vP2D, GeometricCamera* pCamera);
 
@@ -105,10 +113,25 @@ protected:
     // Indices for random selection
     std::vector<size_t> mvAllIndices;
 
+    // Generator of the random sets, own to each solver
+    std::mt19937 mRng;
+
     // Projections
     std::vector<Eigen::Vector2f> mvP1im1;
     std::vector<Eigen::Vector2f> mvP2im2;
 
+    // Correspondences in columns, the hypotheses are scored with vector operations
+    Eigen::Matrix<float,3,Eigen::Dynamic> mX3Dc1;
+    Eigen::Matrix<float,3,Eigen::Dynamic> mX3Dc2;
+    Eigen::Matrix<float,2,Eigen::Dynamic> mP1im1;
+    Eigen::Matrix<float,2,Eigen::Dynamic> mP2im2;
+    Eigen::Array<float,1,Eigen::Dynamic> mMaxError1;
+    Eigen::Array<float,1,Eigen::Dynamic> mMaxError2;
+    // Buffers of CheckInliers
+    Eigen::Matrix<float,3,Eigen::Dynamic> mP3Dc;
+    Eigen::Array<float,1,Eigen::Dynamic> mError1;
+    Eigen::Array<float,1,Eigen::Dynamic> mError2;
+
     // RANSAC probability
     double mRansacProb;
 
@@ -0,0 +1,52 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOCKET_UTILS_H
+#define SOCKET_UTILS_H
+
+#include <cstdint>
+#include <string>
+
+namespace ORB_SLAM3
+{
+
+// Frame of the messages of MapServer and MapStreamer, followed by nSize bytes of payload. nValue is the
+// type of a request or an update, and 0 in the reply to a handled request.
+struct MessageHeader
+{
+    uint32_t nValue;
+    uint32_t nReserved;
+    uint64_t nSize;
+};
+
+// Whole buffer through a socket, false if the connection failed or was closed (no SIGPIPE)
+bool ReadFully(const int fd, char* pData, size_t nSize);
+bool WriteFully(const int fd, const char* pData, size_t nSize);
+
+// Header and payload. A message larger than nMaxSize is rejected (false) without reading it.
+bool WriteMessage(const int fd, const uint32_t nValue, const std::string &strData);
+bool ReadMessage(const int fd, uint32_t &nValue, std::string &strData, const uint64_t nMaxSize);
+
+// Unix domain stream socket at strSocket. ListenSocket replaces the file left by a process that did
+// not finish. They return the descriptor or -1, the errors are printed with strName as prefix.
+int ListenSocket(const std::string &strSocket, const std::string &strName);
+int ConnectSocket(const std::string &strSocket, const std::string &strName);
+
+} //namespace ORB_SLAM3
+
+#endif // SOCKET_UTILS_H
@@ -26,6 +26,7 @@
 #include<stdlib.h>
 #include<string>
 #include<thread>
+#include<memory>
 #include<opencv2/core/core.hpp>
 
 #include "Tracking.h"
@@ -41,6 +42,10 @@
 #include "Settings.h"
 #include "SPDetector.hpp"
 #include "Defs.h"
+#include "TaskScheduler.h"
+#include "AtlasCheckpointer.h"
+#include "MapServer.h"
+#include "MapStreamer.h"
 
 
 namespace ORB_SLAM3
@@ -210,6 +215,16 @@ private:
     bool LoadAtlas(int type);
 
     string CalculateCheckSum(string filename, int type);
+    // MD5 of the vocabulary file, computed once. It is also kept in the user cache folder with the size
+    // and modification time of the file, so it is not computed again while the file does not change.
+    string GetVocabularyChecksum();
+
+    // Loads the vocabulary once per file. It is only read, so all the systems of the process share it.
+    static ORBVocabulary* LoadVocabulary(const string &strVocFile);
+
+    // Worker pool of the process, created by the first system with its settings and shared by the
+    // others. It is stopped and joined when the last system releases it.
+    static std::shared_ptr<TaskScheduler> SharedScheduler(const int nThreads, const bool bPinThreads);
 
     // Input sensor
     eSensor mSensor;
@@ -248,6 +263,28 @@ private:
     std::thread* mptLoopClosing;
     std::thread* mptViewer;
 
+    // Periodic incremental checkpoints of the atlas (System.CheckpointFile), NULL if disabled
+    AtlasCheckpointer* mpCheckpointer;
+    std::thread* mptCheckpointer;
+
+    // Server of the atlas for MapClient queries (System.MapServerSocket), NULL if disabled
+    MapServer* mpMapServer;
+    std::thread* mptMapServer;
+
+    // Connection to the map server of another process for a client System (System.MapServerClient), NULL
+    // otherwise
+    MapTransport* mpMapTransport;
+    MapClient* mpMapClient;
+
+    // Stream of the map changes to a file or socket (Viewer.StreamFile, Viewer.StreamSocket), NULL if disabled
+    MapStreamer* mpMapStreamer;
+    std::thread* mptMapStreamer;
+
+    // Worker pool shared by all the modules for their parallel work (stereo extraction,
+    // keyframe culling, global BA) and by all the systems of the process (SharedScheduler).
+    // Released in Shutdown.
+    std::shared_ptr<TaskScheduler> mpScheduler;
+
     // Reset flag
     std::mutex mMutexReset;
     bool mbReset;
@@ -270,8 +307,12 @@ private:
     //
     string mStrLoadAtlasFromFile;
     string mStrSaveAtlasToFile;
+    // Keep the loaded .osa file mapped and use the keyframe descriptors from it (localization of large maps)
+    bool mbMapAtlasDescriptors;
+    string mStrCheckpointFile;
 
     string mStrVocabularyFilePath;
+    string mStrVocabularyChecksum;
 
     Settings* settings_;
 };
@@ -0,0 +1,105 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+// Pool of worker threads shared by all the modules of the system. Each worker has its own
+// queues (one per priority), tasks submitted from a worker go to its queue and idle workers
+// steal from the others. Higher priority tasks are always taken first, but running tasks are
+// never preempted.
+class TaskScheduler
+{
+public:
+    enum ePriority{
+        TRACKING=0,
+        LOCAL_MAPPING=1,
+        LOOP_CLOSING=2,
+        GLOBAL_BA=3,
+        NUM_PRIORITIES=4
+    };
+
+    // nThreads <= 0 uses all the hardware threads. With bPinThreads each worker is bound to a core.
+    TaskScheduler(const int nThreads = 0, const bool bPinThreads = false);
+    ~TaskScheduler();
+
+    std::future<void> Submit(const std::function<void()> &task, const ePriority priority);
+
+    // Wait for a submitted task. Meanwhile the calling thread runs queued tasks with the same or
+    // higher priority, so it is safe to wait from inside a task.
+    void Wait(std::future<void> &result, const ePriority priority);
+
+    // Call f(i) for every i in [first,last), in chunks of nGrain indices. The calling thread also
+    // runs chunks, the call returns when all of them are done.
+    void ParallelFor(const int first, const int last, const std::function<void(int)> &f,
+                     const ePriority priority, const int nGrain = 1);
+
+    int NumThreads() const;
+
+    static int HardwareThreads();
+
+private:
+    struct Worker
+    {
+        std::mutex mMutex;
+        std::deque<std::function<void()> > mdQueues[NUM_PRIORITIES];
+    };
+
+    void Run(const int idx);
+    // Runs a submitted task and wakes the threads waiting in Wait
+    void RunAndSignal(const std::shared_ptr<std::packaged_task<void()> > &pTask);
+
+    void Push(const std::function<void()> &task, const ePriority priority);
+    // Own queue first (newest task), then steal from the others (oldest task). idx < 0 for
+    // threads out of the pool, which only steal.
+    bool Pop(const int idx, const int maxPriority, std::function<void()> &task);
+
+    int CurrentWorker() const;
+
+    std::vector<Worker*> mvpWorkers;
+    std::vector<std::thread> mvThreads;
+
+    std::atomic<int> mnPending;
+    std::atomic<unsigned int> mnNextQueue;
+
+    std::mutex mMutexSleep;
+    std::condition_variable mCondSleep;
+    bool mbFinish;
+
+    // Tasks finished or queued, under mMutexSleep. Threads in Wait sleep until it changes.
+    unsigned long mnEvents;
+    std::condition_variable mCondEvents;
+};
+
+} //namespace ORB_SLAM3
+
+#endif // TASKSCHEDULER_H
@@ -37,6 +37,8 @@
 #include "System.h"
 #include "ImuTypes.h"
 #include "Settings.h"
+#include "TaskScheduler.h"
+#include "MapServer.h"
 
 #include "GeometricCamera.h"
 
@@ -81,8 +83,16 @@ public:
     void SetLocalMapper(LocalMapping* pLocalMapper);
     void SetLoopClosing(LoopClosing* pLoopClosing);
     void SetViewer(Viewer* pViewer);
+    void SetScheduler(TaskScheduler* pScheduler);
+    void SetParallelRelocalization(bool bSet);
     void SetStepByStep(bool bSet);
     bool GetStepByStep();
+    // Deterministic offline processing: each frame is tracked once Local Mapping and Loop Closing are done
+    // with the previous keyframes, so no keyframe is dropped and the result does not depend on timing
+    void SetOffline(bool bSet);
+    // Client of a map server: the relocalization candidates, the BoW vectors and the local map come from
+    // the served atlas, without vocabulary nor keyframe database. Only in localization mode.
+    void SetMapClient(MapClient* pMapClient);
 
     // Load new settings
     // The focal lenght should be similar or scale prediction will fail when projecting points
@@ -209,12 +219,18 @@ protected:
     void CreateInitialMapMonocular();
 
     void CheckReplacedInLastFrame();
+    // BoW vectors of the current frame, from the map server for a client
+    void ComputeFrameBoW();
     bool TrackReferenceKeyFrame();
     void UpdateLastFrame();
     bool TrackWithMotionModel();
     bool PredictStateIMU();
 
     bool Relocalization();
+    // Each candidate keyframe (BoW matching, MLPnP RANSAC and pose verification) is a task of the scheduler
+    // working on its own copy of the frame. The RANSAC of each candidate has its own seed and a verified
+    // candidate stops the ones after it, so the result is the same as the sequential search.
+    bool RelocalizationParallel(const vector<KeyFrame*> &vpCandidateKFs);
 
     void UpdateLocalMap();
     void UpdateLocalPoints();
@@ -285,6 +301,14 @@ protected:
     
     //Drawers
     Viewer* mpViewer;
+
+    // Shared worker pool, used for the stereo feature extraction
+    TaskScheduler* mpScheduler;
+    // Relocalization candidates evaluated concurrently (needs the scheduler)
+    bool mbParallelRelocalization;
+    // Map server of a client System, NULL otherwise
+    MapClient* mpMapClient;
+    bool mbOffline;
     FrameDrawer* mpFrameDrawer;
     MapDrawer* mpMapDrawer;
     bool bStepByStep;
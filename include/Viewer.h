@@ -27,6 +27,7 @@
 #include "Settings.h"
 
 #include <mutex>
+#include <condition_variable>
 
 namespace ORB_SLAM3
 {
@@ -57,6 +58,9 @@ public:
 
     bool isStopped();
 
+    // Blocks until the viewer has stopped after RequestStop (or has finished)
+    void WaitUntilStopped();
+
     bool isStepByStep();
 
     void Release();
@@ -91,6 +95,8 @@ private:
     bool mbStopped;
     bool mbStopRequested;
     std::mutex mMutexStop;
+    // Notified when mbStopped changes or the viewer finishes
+    std::condition_variable mCondStop;
 
     bool mbStopTrack;
 
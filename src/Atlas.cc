@@ -22,15 +22,18 @@
 #include "GeometricCamera.h"
 #include "Pinhole.h"
 #include "KannalaBrandt8.h"
+#include "AtlasFile.h"
 
 namespace ORB_SLAM3
 {
 
-Atlas::Atlas(){
+Atlas::Atlas(): mnNextFrameId(0), mpKeyFrameDB(static_cast<KeyFrameDatabase*>(NULL)), mpMappedFile(static_cast<MappedFile*>(NULL))
+{
     mpCurrentMap = static_cast<Map*>(NULL);
 }
 
-Atlas::Atlas(int initKFid): mnLastInitKFidMap(initKFid), mHasViewer(false)
+Atlas::Atlas(int initKFid): mnLastInitKFidMap(initKFid), mnNextFrameId(0), mHasViewer(false), mpKeyFrameDB(static_cast<KeyFrameDatabase*>(NULL)),
+    mpMappedFile(static_cast<MappedFile*>(NULL))
 {
     mpCurrentMap = static_cast<Map*>(NULL);
     CreateNewMap();
@@ -53,6 +56,9 @@ Atlas::~Atlas()
             ++it;
 
     }
+
+    // After the maps, their keyframes may point into the file
+    delete mpMappedFile;
 }
 
 void Atlas::CreateNewMap()
@@ -243,7 +249,8 @@ void Atlas::clearAtlas()
     }*/
     mspMaps.clear();
     mpCurrentMap = static_cast<Map*>(NULL);
-    mnLastInitKFidMap = 0;
+    // The keyframe ids are not rewound, other systems may share the counter
+    mnLastInitKFidMap = KeyFrame::nNextId;
 }
 
 Map* Atlas::GetCurrentMap()
@@ -332,7 +339,7 @@ void Atlas::PreSave()
     RemoveBadMaps();
 }
 
-void Atlas::PostLoad()
+void Atlas::PostLoad(TaskScheduler* pScheduler)
 {
     map<unsigned int,GeometricCamera*> mpCams;
     for(GeometricCamera* pCam : mvpCameras)
@@ -342,14 +349,24 @@ void Atlas::PostLoad()
 
     mspMaps.clear();
     unsigned long int numKF = 0, numMP = 0;
+    vector<KeyFrame*> vpKFs;
     for(Map* pMi : mvpBackupMaps)
     {
         mspMaps.insert(pMi);
-        pMi->PostLoad(mpKeyFrameDB, mpORBVocabulary, mpCams);
-        numKF += pMi->GetAllKeyFrames().size();
-        numMP += pMi->GetAllMapPoints().size();
+        pMi->PostLoad(mpKeyFrameDB, mpORBVocabulary, mpCams, pScheduler);
+
+        const vector<KeyFrame*> vpMapKFs = pMi->GetAllKeyFrames();
+        for(KeyFrame* pKFi : vpMapKFs)
+            if(pKFi && !pKFi->isBad())
+                vpKFs.push_back(pKFi);
+        numKF += vpMapKFs.size();
+        numMP += pMi->MapPointsInMap();
     }
     mvpBackupMaps.clear();
+
+    // Relocalization and place recognition in every loaded map from now on
+    mpKeyFrameDB->PostLoad(vpKFs, mBackupInvertedFile);
+    mBackupInvertedFile.clear();
 }
 
 void Atlas::SetKeyFrameDababase(KeyFrameDatabase* pKFDB)
@@ -388,12 +405,33 @@ long unsigned int Atlas::GetNumLivedMP() {
     unique_lock<mutex> lock(mMutexAtlas);
     long unsigned int num = 0;
     for (Map* pMap_i : mspMaps) {
-        num += pMap_i->GetAllMapPoints().size();
+        num += pMap_i->MapPointsInMap();
     }
 
     return num;
 }
 
+long unsigned int Atlas::NewFrameId()
+{
+    return mnNextFrameId++;
+}
+
+long unsigned int Atlas::GetNextFrameId()
+{
+    return mnNextFrameId;
+}
+
+void Atlas::SetNextFrameId(long unsigned int nId)
+{
+    mnNextFrameId = nId;
+}
+
+void Atlas::AdvanceNextId(std::atomic<long unsigned int> &nNextId, long unsigned int nId)
+{
+    long unsigned int nCurrent = nNextId;
+    while(nCurrent < nId && !nNextId.compare_exchange_weak(nCurrent, nId));
+}
+
 map<long unsigned int, KeyFrame*> Atlas::GetAtlasKeyframes()
 {
     map<long unsigned int, KeyFrame*> mpIdKFs;
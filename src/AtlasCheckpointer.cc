@@ -0,0 +1,327 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "AtlasCheckpointer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Atlas.h"
+#include "AtlasFile.h"
+#include "System.h"
+#include "TaskScheduler.h"
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+const size_t AtlasCheckpointer::MIN_COMPACTION_SIZE;
+
+static size_t FileSize(const string &strFile)
+{
+    struct stat st;
+    if(stat(strFile.c_str(), &st) != 0)
+        return 0;
+    return st.st_size;
+}
+
+static string DirectoryOf(const string &strFile)
+{
+    const size_t pos = strFile.find_last_of('/');
+    if(pos == string::npos)
+        return ".";
+    if(pos == 0)
+        return "/";
+    return strFile.substr(0, pos);
+}
+
+AtlasCheckpointer::AtlasCheckpointer(Atlas* pAtlas, const string &strFile, const double period, const string &strVocName,
+                                     const string &strVocChecksum, TaskScheduler* pScheduler, const bool bResume):
+    mpAtlas(pAtlas), mStrFile(strFile), mPeriod(period), mStrVocName(strVocName), mStrVocChecksum(strVocChecksum),
+    mpScheduler(pScheduler), mbFull(!bResume), mptCompaction(static_cast<thread*>(NULL)), mbCompacting(false),
+    mbFinishRequested(false), mbFinished(false)
+{
+    if(bResume)
+    {
+        // The loaded objects are already in the files
+        CollectIds(mmRecordedKeyFrames, mmRecordedMapPoints);
+    }
+    else
+    {
+        remove(mStrFile.c_str());
+        remove(JournalFile(mStrFile).c_str());
+        remove(CompactingFile(mStrFile).c_str());
+    }
+
+    // Changes made while loading are not counted
+    const vector<Map*> vpMaps = mpAtlas->GetAllMaps();
+    for(Map* pMap : vpMaps)
+        pMap->NextCheckpointEpoch();
+}
+
+AtlasCheckpointer::~AtlasCheckpointer()
+{
+    if(mptCompaction)
+    {
+        mptCompaction->join();
+        delete mptCompaction;
+    }
+}
+
+string AtlasCheckpointer::JournalFile(const string &strFile)
+{
+    return strFile + ".journal";
+}
+
+string AtlasCheckpointer::CompactingFile(const string &strFile)
+{
+    return strFile + ".journal.compacting";
+}
+
+Atlas* AtlasCheckpointer::Load(const string &strFile, string &strVocName, string &strVocChecksum, TaskScheduler* pScheduler)
+{
+    // The journal being compacted goes before the current one
+    vector<string> vstrJournals;
+    vstrJournals.push_back(CompactingFile(strFile));
+    vstrJournals.push_back(JournalFile(strFile));
+    return AtlasFile::LoadCheckpoint(strFile, vstrJournals, strVocName, strVocChecksum, pScheduler);
+}
+
+void AtlasCheckpointer::Run()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    while(!mbFinishRequested)
+    {
+        mCondFinish.wait_for(lock, chrono::duration<double>(mPeriod));
+        if(mbFinishRequested)
+            break;
+
+        lock.unlock();
+        Checkpoint();
+        lock.lock();
+    }
+    lock.unlock();
+
+    // Last checkpoint with the final state of the atlas
+    Checkpoint();
+
+    if(mptCompaction)
+    {
+        mptCompaction->join();
+        delete mptCompaction;
+        mptCompaction = static_cast<thread*>(NULL);
+    }
+
+    lock.lock();
+    mbFinished = true;
+}
+
+void AtlasCheckpointer::RequestFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+    mCondFinish.notify_all();
+}
+
+bool AtlasCheckpointer::isFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+void AtlasCheckpointer::CollectIds(IdsByMap &mKeyFrameIds, IdsByMap &mMapPointIds)
+{
+    const vector<Map*> vpMaps = mpAtlas->GetAllMaps();
+    for(Map* pMap : vpMaps)
+    {
+        if(!pMap || pMap->IsBad() || pMap->KeyFramesInMap() == 0)
+            continue;
+
+        vector<unsigned long> &vnKFIds = mKeyFrameIds[pMap->GetId()];
+        const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+        for(KeyFrame* pKF : vpKFs)
+            if(pKF && !pKF->isBad())
+                vnKFIds.push_back(pKF->mnId);
+        sort(vnKFIds.begin(), vnKFIds.end());
+
+        vector<unsigned long> &vnMPIds = mMapPointIds[pMap->GetId()];
+        const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+        for(MapPoint* pMP : vpMPs)
+            if(pMP && !pMP->isBad())
+                vnMPIds.push_back(pMP->mnId);
+        sort(vnMPIds.begin(), vnMPIds.end());
+    }
+}
+
+bool AtlasCheckpointer::Checkpoint()
+{
+    const chrono::steady_clock::time_point time_Start = chrono::steady_clock::now();
+
+    vector<AtlasFile::MapDelta> vDeltas;
+    IdsByMap mKeyFrameIds, mMapPointIds;
+    size_t nKFs = 0, nMPs = 0, nErased = 0;
+
+    const vector<Map*> vpMaps = mpAtlas->GetAllMaps();
+    for(Map* pMap : vpMaps)
+    {
+        if(!pMap || pMap->IsBad() || pMap->KeyFramesInMap() == 0)
+            continue;
+
+        // Changes from now on go to the next checkpoint
+        const unsigned long nEpoch = pMap->NextCheckpointEpoch();
+
+        const unsigned long nMapId = pMap->GetId();
+        vDeltas.push_back(AtlasFile::MapDelta());
+        AtlasFile::MapDelta &delta = vDeltas.back();
+        delta.pMap = pMap;
+
+        vector<unsigned long> &vnKFIds = mKeyFrameIds[nMapId];
+        const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+        for(KeyFrame* pKF : vpKFs)
+        {
+            if(!pKF || pKF->isBad())
+                continue;
+
+            delta.spKeyFrames.insert(pKF);
+            vnKFIds.push_back(pKF->mnId);
+            if(mbFull || pKF->mnChangeEpoch.load(std::memory_order_relaxed) >= nEpoch)
+                delta.vpKeyFrames.push_back(pKF);
+        }
+        sort(vnKFIds.begin(), vnKFIds.end());
+
+        vector<unsigned long> &vnMPIds = mMapPointIds[nMapId];
+        const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+        for(MapPoint* pMP : vpMPs)
+        {
+            if(!pMP || pMP->isBad())
+                continue;
+
+            delta.spMapPoints.insert(pMP);
+            vnMPIds.push_back(pMP->mnId);
+            if(mbFull || pMP->mnChangeEpoch.load(std::memory_order_relaxed) >= nEpoch)
+                delta.vpMapPoints.push_back(pMP);
+        }
+        sort(vnMPIds.begin(), vnMPIds.end());
+
+        const vector<unsigned long> &vnRecordedKFs = mmRecordedKeyFrames[nMapId];
+        set_difference(vnRecordedKFs.begin(), vnRecordedKFs.end(), vnKFIds.begin(), vnKFIds.end(),
+                       back_inserter(delta.vnErasedKeyFrames));
+        const vector<unsigned long> &vnRecordedMPs = mmRecordedMapPoints[nMapId];
+        set_difference(vnRecordedMPs.begin(), vnRecordedMPs.end(), vnMPIds.begin(), vnMPIds.end(),
+                       back_inserter(delta.vnErasedMapPoints));
+
+        nKFs += delta.vpKeyFrames.size();
+        nMPs += delta.vpMapPoints.size();
+        nErased += delta.vnErasedKeyFrames.size() + delta.vnErasedMapPoints.size();
+    }
+
+    // Maps removed or emptied (reset)
+    vector<uint64_t> vnErasedMaps;
+    for(IdsByMap::const_iterator it = mmRecordedKeyFrames.begin(); it != mmRecordedKeyFrames.end(); ++it)
+        if(!mKeyFrameIds.count(it->first))
+            vnErasedMaps.push_back(it->first);
+
+    const string strJournal = JournalFile(mStrFile);
+    const size_t nJournalSize = FileSize(strJournal);
+    if(!AtlasFile::AppendCheckpoint(strJournal, mpAtlas, vDeltas, vnErasedMaps, mStrVocName, mStrVocChecksum, mpScheduler))
+    {
+        // Without the incomplete record, the next one saves everything again
+        if(truncate(strJournal.c_str(), nJournalSize) != 0)
+            cout << "[E] Checkpoint: unable to remove the incomplete record of " << strJournal << endl;
+        cout << "[E] Checkpoint: unable to write " << strJournal << endl;
+        mbFull = true;
+        return false;
+    }
+
+    mmRecordedKeyFrames.swap(mKeyFrameIds);
+    mmRecordedMapPoints.swap(mMapPointIds);
+    mbFull = false;
+
+    const double t = chrono::duration_cast<chrono::duration<double,std::milli> >(chrono::steady_clock::now() - time_Start).count();
+    stringstream ss;
+    ss << "Checkpoint: " << nKFs << " KFs and " << nMPs << " MPs changed, " << nErased << " removed, in " << t << " ms";
+    Verbose::PrintMess(ss.str(), Verbose::VERBOSITY_NORMAL);
+
+    const size_t nSize = FileSize(strJournal);
+    if(nSize > MIN_COMPACTION_SIZE && nSize > FileSize(mStrFile))
+        StartCompaction();
+
+    return true;
+}
+
+void AtlasCheckpointer::StartCompaction()
+{
+    {
+        unique_lock<mutex> lock(mMutexCompaction);
+        if(mbCompacting)
+            return;
+        mbCompacting = true;
+    }
+
+    if(mptCompaction)
+    {
+        mptCompaction->join();
+        delete mptCompaction;
+    }
+
+    // The next records go to a new journal. If the last compaction failed, its journal is
+    // compacted again and this one keeps growing.
+    const string strCompacting = CompactingFile(mStrFile);
+    if(FileSize(strCompacting) == 0 && rename(JournalFile(mStrFile).c_str(), strCompacting.c_str()) == 0)
+        AtlasFile::Sync(DirectoryOf(mStrFile));
+
+    mptCompaction = new thread(&AtlasCheckpointer::Compact, this);
+}
+
+void AtlasCheckpointer::Compact()
+{
+    const chrono::steady_clock::time_point time_Start = chrono::steady_clock::now();
+
+    const string strCompacting = CompactingFile(mStrFile);
+    const string strTmp = mStrFile + ".tmp";
+    const vector<string> vstrJournals(1, strCompacting);
+
+    // The base file is replaced at once, a crash before it leaves the previous one and both journals
+    // The writer syncs the temporary file when it closes it, the directory is synced after the rename
+    if(AtlasFile::Compact(mStrFile, vstrJournals, strTmp, mpScheduler) && rename(strTmp.c_str(), mStrFile.c_str()) == 0)
+    {
+        AtlasFile::Sync(DirectoryOf(mStrFile));
+        remove(strCompacting.c_str());
+        const double t = chrono::duration_cast<chrono::duration<double,std::milli> >(chrono::steady_clock::now() - time_Start).count();
+        Verbose::PrintMess("Checkpoint: journal compacted in " + to_string(t) + " ms", Verbose::VERBOSITY_NORMAL);
+    }
+    else
+    {
+        remove(strTmp.c_str());
+        cout << "[E] Checkpoint: unable to compact " << strCompacting << endl;
+    }
+
+    unique_lock<mutex> lock(mMutexCompaction);
+    mbCompacting = false;
+}
+
+} //namespace ORB_SLAM3
@@ -0,0 +1,1084 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "AtlasFile.h"
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <streambuf>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include "Atlas.h"
+#include "KeyFrameDatabase.h"
+#include "TaskScheduler.h"
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+const char AtlasFile::MAGIC[8] = {'O','S','A','C','H','U','N','K'};
+const uint32_t AtlasFile::VERSION;
+const size_t AtlasFile::SECTION_ALIGNMENT;
+const int AtlasFile::KEYFRAMES_PER_SECTION;
+const int AtlasFile::MAPPOINTS_PER_SECTION;
+
+// Header: magic, version, number of sections and offset of the index table
+static const size_t HEADER_SIZE = sizeof(AtlasFile::MAGIC) + 2*sizeof(uint32_t) + sizeof(uint64_t);
+
+template<class T>
+static void WriteValue(ostream &os, const T &value)
+{
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void WriteHeader(ostream &os, const uint32_t nSections, const uint64_t nIndexOffset)
+{
+    const uint32_t nVersion = AtlasFile::VERSION;
+    os.write(AtlasFile::MAGIC, sizeof(AtlasFile::MAGIC));
+    WriteValue(os, nVersion);
+    WriteValue(os, nSections);
+    WriteValue(os, nIndexOffset);
+}
+
+static size_t Align(const size_t n)
+{
+    return (n + AtlasFile::SECTION_ALIGNMENT-1) / AtlasFile::SECTION_ALIGNMENT * AtlasFile::SECTION_ALIGNMENT;
+}
+
+// Stream over a block of memory (a section of the mapped file), without copying it
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+    MemoryStreamBuf(const char* pData, const size_t nSize)
+    {
+        char* p = const_cast<char*>(pData);
+        setg(p, p, p+nSize);
+    }
+};
+
+// Block of keyframes, descriptors or points of one section
+struct SectionJob
+{
+    AtlasFile::SectionEntry entry;
+    const vector<KeyFrame*>* pvpKFs;
+    const vector<MapPoint*>* pvpMPs;
+    size_t first;
+    size_t last;
+    string* pData;
+
+    // Decoded objects
+    vector<KeyFrame*> vpKFs;
+    vector<MapPoint*> vpMPs;
+    vector<cv::Mat> vDescriptors;
+    vector<uint64_t> vDescriptorKFIds;
+};
+
+template<class T>
+static string* EncodeObjects(const vector<T*> &vpObjects, const size_t first, const size_t last, const unsigned int flags)
+{
+    ostringstream os(ios::binary);
+    {
+        boost::archive::binary_oarchive oa(os, boost::archive::no_header | flags);
+        for(size_t i=first; i<last; i++)
+        {
+            const T &object = *vpObjects[i];
+            oa << object;
+        }
+    }
+    return new string(os.str());
+}
+
+template<class T>
+static void DecodeObjects(const char* pData, const size_t nSize, const size_t nObjects, const unsigned int flags, vector<T*> &vpObjects)
+{
+    MemoryStreamBuf buf(pData, nSize);
+    boost::archive::binary_iarchive ia(buf, boost::archive::no_header | flags);
+    vpObjects.reserve(nObjects);
+    for(size_t i=0; i<nObjects; i++)
+    {
+        T* pObject = new T();
+        ia >> *pObject;
+        vpObjects.push_back(pObject);
+    }
+}
+
+// Table of records and then the matrices, each one aligned
+static string* EncodeDescriptors(const vector<KeyFrame*> &vpKFs, const size_t first, const size_t last)
+{
+    const size_t nKFs = last-first;
+    vector<AtlasFile::DescriptorRecord> vRecords(nKFs);
+    size_t nOffset = Align(nKFs*sizeof(AtlasFile::DescriptorRecord));
+    for(size_t i=0; i<nKFs; i++)
+    {
+        const cv::Mat &desc = vpKFs[first+i]->mDescriptors;
+        AtlasFile::DescriptorRecord &record = vRecords[i];
+        record.nKFId = vpKFs[first+i]->mnId;
+        record.nRows = desc.rows;
+        record.nCols = desc.cols;
+        record.nType = desc.type();
+        record.nReserved = 0;
+        record.nOffset = nOffset;
+        nOffset = Align(nOffset + desc.total()*desc.elemSize());
+    }
+
+    string* pData = new string(nOffset, '\0');
+    memcpy(&(*pData)[0], vRecords.data(), nKFs*sizeof(AtlasFile::DescriptorRecord));
+    for(size_t i=0; i<nKFs; i++)
+    {
+        const cv::Mat &desc = vpKFs[first+i]->mDescriptors;
+        const size_t nRowSize = desc.cols*desc.elemSize();
+        for(int r=0; r<desc.rows; r++)
+            memcpy(&(*pData)[vRecords[i].nOffset + r*nRowSize], desc.ptr(r), nRowSize);
+    }
+    return pData;
+}
+
+static void DecodeDescriptors(const char* pData, const size_t nSize, const size_t nKFs, const bool bInPlace, SectionJob &job)
+{
+    if(nKFs*sizeof(AtlasFile::DescriptorRecord) > nSize)
+        return;
+
+    job.vDescriptors.resize(nKFs);
+    job.vDescriptorKFIds.resize(nKFs);
+    for(size_t i=0; i<nKFs; i++)
+    {
+        AtlasFile::DescriptorRecord record;
+        memcpy(&record, pData + i*sizeof(AtlasFile::DescriptorRecord), sizeof(record));
+        job.vDescriptorKFIds[i] = record.nKFId;
+
+        cv::Mat desc(record.nRows, record.nCols, record.nType, const_cast<char*>(pData + record.nOffset));
+        if(record.nOffset + desc.total()*desc.elemSize() > nSize)
+            continue;
+        job.vDescriptors[i] = bInPlace ? desc : desc.clone();
+    }
+}
+
+static void EncodeSection(vector<SectionJob> &vJobs, const int i)
+{
+    SectionJob &job = vJobs[i];
+    if(job.entry.nType == AtlasFile::KEYFRAMES_SECTION)
+        job.pData = EncodeObjects(*job.pvpKFs, job.first, job.last, ARCHIVE_DESCRIPTORS_APART);
+    else if(job.entry.nType == AtlasFile::DESCRIPTORS_SECTION)
+        job.pData = EncodeDescriptors(*job.pvpKFs, job.first, job.last);
+    else
+        job.pData = EncodeObjects(*job.pvpMPs, job.first, job.last, 0);
+}
+
+static void DecodeSection(const MappedFile &file, const uint32_t nVersion, const bool bInPlace, vector<SectionJob> &vJobs, const int i)
+{
+    SectionJob &job = vJobs[i];
+    const char* pData = file.Data() + job.entry.nOffset;
+
+    // Version 1 keeps the descriptors in the keyframe records
+    const unsigned int flags = nVersion >= 2 ? ARCHIVE_DESCRIPTORS_APART : 0;
+
+    if(job.entry.nType == AtlasFile::KEYFRAMES_SECTION)
+        DecodeObjects(pData, job.entry.nSize, job.entry.nObjects, flags, job.vpKFs);
+    else if(job.entry.nType == AtlasFile::DESCRIPTORS_SECTION)
+        DecodeDescriptors(pData, job.entry.nSize, job.entry.nObjects, bInPlace, job);
+    else
+        DecodeObjects(pData, job.entry.nSize, job.entry.nObjects, 0, job.vpMPs);
+}
+
+static void AddSectionJobs(const AtlasFile::eSectionType type, const unsigned long int nMapId, const size_t nObjects, const size_t nPerSection,
+                           const vector<KeyFrame*>* pvpKFs, const vector<MapPoint*>* pvpMPs, vector<SectionJob> &vJobs)
+{
+    for(size_t first=0; first<nObjects; first+=nPerSection)
+    {
+        SectionJob job;
+        job.entry.nType = type;
+        job.entry.nMapId = nMapId;
+        job.pvpKFs = pvpKFs;
+        job.pvpMPs = pvpMPs;
+        job.first = first;
+        job.last = min(nObjects, first+nPerSection);
+        job.entry.nObjects = job.last-first;
+        job.pData = static_cast<string*>(NULL);
+        vJobs.push_back(job);
+
+        // Descriptors of the block right after it
+        if(type == AtlasFile::KEYFRAMES_SECTION)
+        {
+            job.entry.nType = AtlasFile::DESCRIPTORS_SECTION;
+            vJobs.push_back(job);
+        }
+    }
+}
+
+static bool IsObjectSection(const uint32_t nType)
+{
+    return nType == AtlasFile::KEYFRAMES_SECTION || nType == AtlasFile::MAPPOINTS_SECTION || nType == AtlasFile::DESCRIPTORS_SECTION;
+}
+
+static SectionJob NewDecodeJob(const AtlasFile::SectionEntry &entry)
+{
+    SectionJob job;
+    job.entry = entry;
+    job.pvpKFs = static_cast<vector<KeyFrame*>*>(NULL);
+    job.pvpMPs = static_cast<vector<MapPoint*>*>(NULL);
+    job.first = 0;
+    job.last = 0;
+    job.pData = static_cast<string*>(NULL);
+    return job;
+}
+
+static void EncodeSections(vector<SectionJob> &vJobs, TaskScheduler* pScheduler, const TaskScheduler::ePriority priority)
+{
+    if(pScheduler)
+        pScheduler->ParallelFor(0, vJobs.size(), std::bind(&EncodeSection, std::ref(vJobs), std::placeholders::_1), priority);
+    else
+        for(size_t i=0; i<vJobs.size(); i++)
+            EncodeSection(vJobs, i);
+}
+
+static void DecodeSections(const MappedFile &file, const uint32_t nVersion, const bool bInPlace, vector<SectionJob> &vJobs,
+                           TaskScheduler* pScheduler, const TaskScheduler::ePriority priority)
+{
+    if(pScheduler)
+        pScheduler->ParallelFor(0, vJobs.size(), std::bind(&DecodeSection, std::cref(file), nVersion, bInPlace, std::ref(vJobs),
+                                                           std::placeholders::_1), priority);
+    else
+        for(size_t i=0; i<vJobs.size(); i++)
+            DecodeSection(file, nVersion, bInPlace, vJobs, i);
+}
+
+// A DESCRIPTORS section has the descriptors of the keyframes of the section before it
+static void AttachDescriptors(const SectionJob &kfJob, const SectionJob &descJob)
+{
+    if(kfJob.entry.nType != AtlasFile::KEYFRAMES_SECTION)
+        return;
+
+    const vector<KeyFrame*> &vpKFs = kfJob.vpKFs;
+    for(size_t i=0; i<vpKFs.size() && i<descJob.vDescriptors.size(); i++)
+    {
+        if(vpKFs[i]->mnId == descJob.vDescriptorKFIds[i])
+            const_cast<cv::Mat&>(vpKFs[i]->mDescriptors) = descJob.vDescriptors[i];
+        else
+            cout << "[E] Atlas file: descriptors of KF " << descJob.vDescriptorKFIds[i] << " found for KF " << vpKFs[i]->mnId << endl;
+    }
+}
+
+// Index of the file, or of the journal record, starting at nStart. The offsets are returned from the
+// beginning of the file. Returns false if there is no complete record there.
+static bool ReadIndex(const MappedFile &file, const size_t nStart, uint32_t &nVersion, vector<AtlasFile::SectionEntry> &vIndex, size_t &nEnd)
+{
+    const char* pData = file.Data() + nStart;
+    if(nStart + HEADER_SIZE > file.Size() || memcmp(pData, AtlasFile::MAGIC, sizeof(AtlasFile::MAGIC)) != 0)
+        return false;
+
+    uint32_t nSections;
+    uint64_t nIndexOffset;
+    memcpy(&nVersion, pData + sizeof(AtlasFile::MAGIC), sizeof(nVersion));
+    memcpy(&nSections, pData + sizeof(AtlasFile::MAGIC) + sizeof(nVersion), sizeof(nSections));
+    memcpy(&nIndexOffset, pData + sizeof(AtlasFile::MAGIC) + sizeof(nVersion) + sizeof(nSections), sizeof(nIndexOffset));
+
+    // The header is completed when the record has been written
+    if(nIndexOffset == 0)
+        return false;
+
+    if(nVersion > AtlasFile::VERSION)
+    {
+        cout << "[E] Atlas file version " << nVersion << " is newer than the supported one (" << AtlasFile::VERSION << ")" << endl;
+        return false;
+    }
+
+    if(nStart + nIndexOffset + nSections*sizeof(AtlasFile::SectionEntry) > file.Size())
+    {
+        cout << "[E] Atlas file: the index table is truncated" << endl;
+        return false;
+    }
+
+    vIndex.resize(nSections);
+    memcpy(vIndex.data(), pData + nIndexOffset, nSections*sizeof(AtlasFile::SectionEntry));
+    for(uint32_t i=0; i<nSections; i++)
+    {
+        if(vIndex[i].nOffset + vIndex[i].nSize > nIndexOffset)
+        {
+            cout << "[E] Atlas file: section " << i << " out of the file" << endl;
+            return false;
+        }
+        vIndex[i].nOffset += nStart;
+    }
+
+    nEnd = nStart + nIndexOffset + nSections*sizeof(AtlasFile::SectionEntry);
+    return true;
+}
+
+static string* EncodeIds(const vector<uint64_t> &vnIds)
+{
+    return new string(reinterpret_cast<const char*>(vnIds.data()), vnIds.size()*sizeof(uint64_t));
+}
+
+static vector<uint64_t> DecodeIds(const char* pData, const size_t nSize)
+{
+    vector<uint64_t> vnIds(nSize/sizeof(uint64_t));
+    memcpy(vnIds.data(), pData, vnIds.size()*sizeof(uint64_t));
+    return vnIds;
+}
+
+// Keyframes and points of the checkpoints replayed, by id
+template<class T>
+static void ReplaceObject(map<uint64_t, T*> &mObjects, T* pObject)
+{
+    T* &pOld = mObjects[pObject->mnId];
+    delete pOld;
+    pOld = pObject;
+}
+
+template<class T>
+static void EraseObjects(map<uint64_t, T*> &mObjects, const vector<uint64_t> &vnIds)
+{
+    for(size_t i=0; i<vnIds.size(); i++)
+    {
+        typename map<uint64_t, T*>::iterator it = mObjects.find(vnIds[i]);
+        if(it == mObjects.end())
+            continue;
+        delete it->second;
+        mObjects.erase(it);
+    }
+}
+
+template<class T>
+static void ClearObjects(map<uint64_t, T*> &mObjects)
+{
+    for(typename map<uint64_t, T*>::iterator it = mObjects.begin(); it != mObjects.end(); ++it)
+        delete it->second;
+    mObjects.clear();
+}
+
+bool AtlasFile::IsAtlasFile(const string &strFile)
+{
+    ifstream ifs(strFile.c_str(), ios::binary);
+    char magic[sizeof(MAGIC)];
+    ifs.read(magic, sizeof(MAGIC));
+    return ifs.good() && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool AtlasFile::Sync(const string &strPath)
+{
+    const int fd = open(strPath.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    const bool bOk = fsync(fd) == 0;
+    close(fd);
+    return bOk;
+}
+
+bool AtlasFile::Save(const string &strFile, Atlas* pAtlas, const string &strVocName, const string &strVocChecksum, TaskScheduler* pScheduler)
+{
+    AtlasFileWriter writer;
+    if(!writer.Open(strFile))
+    {
+        cout << "[E] Unable to open the atlas file " << strFile << endl;
+        return false;
+    }
+
+    const vector<Map*> vpMaps = pAtlas->GetAllMaps();
+    vector<GeometricCamera*> vpCameras = pAtlas->GetAllCameras();
+    set<GeometricCamera*> spCams(vpCameras.begin(), vpCameras.end());
+
+    for(Map* pMap : vpMaps)
+    {
+        if(!pMap || pMap->IsBad())
+            continue;
+
+        string* pHeader;
+        vector<SectionJob> vJobs;
+        {
+            unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
+
+            // Empty maps are not saved, as in Atlas::PreSave
+            if(pMap->KeyFramesInMap() == 0)
+                continue;
+
+            pMap->PreSave(spCams);
+
+            ostringstream os(ios::binary);
+            {
+                boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+                pMap->serializeHeader(oa, 0);
+            }
+            pHeader = new string(os.str());
+
+            AddSectionJobs(KEYFRAMES_SECTION, pMap->GetId(), pMap->mvpBackupKeyFrames.size(), KEYFRAMES_PER_SECTION,
+                           &pMap->mvpBackupKeyFrames, static_cast<vector<MapPoint*>*>(NULL), vJobs);
+            AddSectionJobs(MAPPOINTS_SECTION, pMap->GetId(), pMap->mvpBackupMapPoints.size(), MAPPOINTS_PER_SECTION,
+                           static_cast<vector<KeyFrame*>*>(NULL), &pMap->mvpBackupMapPoints, vJobs);
+
+            EncodeSections(vJobs, pScheduler, TaskScheduler::LOCAL_MAPPING);
+        }
+
+        // Written while the next map is encoded
+        writer.Push(MAP_SECTION, pMap->GetId(), 0, pHeader);
+        for(SectionJob &job : vJobs)
+            writer.Push(static_cast<eSectionType>(job.entry.nType), job.entry.nMapId, job.entry.nObjects, job.pData);
+    }
+
+    // Written after the maps, so the keyframes saved are already in it. Keyframes of maps not saved
+    // are skipped when it is loaded.
+    KeyFrameDatabase* pKFDB = pAtlas->GetKeyFrameDatabase();
+    if(pKFDB)
+    {
+        string* pInvertedFile = new string();
+        pKFDB->EncodeInvertedFile(*pInvertedFile);
+        writer.Push(INVERTED_FILE_SECTION, 0, 0, pInvertedFile);
+    }
+
+    // Written after the maps, so the id counters cover every object saved even if the system is running
+    string* pAtlasData = EncodeAtlasSection(pAtlas, strVocName, strVocChecksum);
+    writer.Push(ATLAS_SECTION, 0, pAtlas->GetAllCameras().size(), pAtlasData);
+
+    return writer.Close();
+}
+
+string* AtlasFile::EncodeAtlasSection(Atlas* pAtlas, const string &strVocName, const string &strVocChecksum)
+{
+    Map* pCurrentMap = pAtlas->GetCurrentMap();
+    unsigned long int nLastInitKFidMap = pAtlas->GetLastInitKFid();
+    if(pCurrentMap && pAtlas->CountMaps() > 0 && nLastInitKFidMap < pCurrentMap->GetMaxKFid())
+        nLastInitKFidMap = pCurrentMap->GetMaxKFid()+1; //The init KF is the next of current maximum
+
+    vector<GeometricCamera*> vpCameras = pAtlas->GetAllCameras();
+    ostringstream os(ios::binary);
+    {
+        boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+        oa.register_type<Pinhole>();
+        oa.register_type<KannalaBrandt8>();
+
+        oa << strVocName;
+        oa << strVocChecksum;
+        oa << vpCameras;
+        const long unsigned int nNextMapId = Map::nNextId;
+        const long unsigned int nNextFrameId = pAtlas->GetNextFrameId();
+        const long unsigned int nNextKFId = KeyFrame::nNextId;
+        const long unsigned int nNextMPId = MapPoint::nNextId;
+        const long unsigned int nNextCamId = GeometricCamera::nNextId;
+        oa << nNextMapId;
+        oa << nNextFrameId;
+        oa << nNextKFId;
+        oa << nNextMPId;
+        oa << nNextCamId;
+        oa << nLastInitKFidMap;
+    }
+    return new string(os.str());
+}
+
+void AtlasFile::DecodeAtlasSection(const char* pData, const size_t nSize, Atlas* pAtlas, string &strVocName, string &strVocChecksum)
+{
+    // Id counters at the end, the objects created while loading must not change them
+    MemoryStreamBuf buf(pData, nSize);
+    boost::archive::binary_iarchive ia(buf, boost::archive::no_header);
+    ia.register_type<Pinhole>();
+    ia.register_type<KannalaBrandt8>();
+
+    ia >> strVocName;
+    ia >> strVocChecksum;
+    ia >> pAtlas->mvpCameras;
+    long unsigned int nNextMapId, nNextFrameId, nNextKFId, nNextMPId, nNextCamId;
+    ia >> nNextMapId;
+    ia >> nNextFrameId;
+    ia >> nNextKFId;
+    ia >> nNextMPId;
+    ia >> nNextCamId;
+    ia >> pAtlas->mnLastInitKFidMap;
+
+    Atlas::AdvanceNextId(Map::nNextId, nNextMapId);
+    pAtlas->SetNextFrameId(nNextFrameId);
+    Atlas::AdvanceNextId(KeyFrame::nNextId, nNextKFId);
+    Atlas::AdvanceNextId(MapPoint::nNextId, nNextMPId);
+    Atlas::AdvanceNextId(GeometricCamera::nNextId, nNextCamId);
+}
+
+Atlas* AtlasFile::Load(const string &strFile, string &strVocName, string &strVocChecksum, TaskScheduler* pScheduler, const bool bMapDescriptors)
+{
+    MappedFile* pFile = new MappedFile();
+    if(!pFile->Open(strFile))
+    {
+        cout << "Load file not found" << endl;
+        delete pFile;
+        return static_cast<Atlas*>(NULL);
+    }
+
+    uint32_t nVersion;
+    vector<SectionEntry> vIndex;
+    size_t nEnd;
+    if(!ReadIndex(*pFile, 0, nVersion, vIndex, nEnd))
+    {
+        cout << "[E] " << strFile << " is not a valid chunked atlas file" << endl;
+        delete pFile;
+        return static_cast<Atlas*>(NULL);
+    }
+
+    pFile->AdviseSequential();
+
+    // Maps, the objects are decoded after them
+    const char* pData = pFile->Data();
+    vector<Map*> vpMaps;
+    map<uint64_t, Map*> mpMaps;
+    vector<SectionJob> vJobs;
+    int nAtlasSection = -1, nInvertedFileSection = -1;
+    for(size_t i=0; i<vIndex.size(); i++)
+    {
+        const SectionEntry &entry = vIndex[i];
+        if(entry.nType == ATLAS_SECTION)
+        {
+            nAtlasSection = i;
+        }
+        else if(entry.nType == INVERTED_FILE_SECTION)
+        {
+            nInvertedFileSection = i;
+        }
+        else if(entry.nType == MAP_SECTION)
+        {
+            MemoryStreamBuf buf(pData + entry.nOffset, entry.nSize);
+            boost::archive::binary_iarchive ia(buf, boost::archive::no_header);
+            Map* pMap = new Map();
+            pMap->serializeHeader(ia, 0);
+            vpMaps.push_back(pMap);
+            mpMaps[entry.nMapId] = pMap;
+        }
+        else if(IsObjectSection(entry.nType))
+        {
+            vJobs.push_back(NewDecodeJob(entry));
+        }
+        // Unknown sections (later minor additions) are skipped
+    }
+
+    if(nAtlasSection < 0)
+    {
+        cout << "[E] Atlas file without atlas section" << endl;
+        delete pFile;
+        return static_cast<Atlas*>(NULL);
+    }
+
+    DecodeSections(*pFile, nVersion, bMapDescriptors, vJobs, pScheduler, TaskScheduler::TRACKING);
+
+    // Sections of a map are kept in file order, the descriptors go after their keyframes
+    for(size_t j=0; j<vJobs.size(); j++)
+    {
+        SectionJob &job = vJobs[j];
+        if(job.entry.nType == DESCRIPTORS_SECTION)
+        {
+            if(j > 0)
+                AttachDescriptors(vJobs[j-1], job);
+            continue;
+        }
+
+        map<uint64_t, Map*>::iterator it = mpMaps.find(job.entry.nMapId);
+        if(it == mpMaps.end())
+        {
+            cout << "[E] Atlas file: section of unknown map " << job.entry.nMapId << endl;
+            continue;
+        }
+
+        Map* pMap = it->second;
+        pMap->mvpBackupKeyFrames.insert(pMap->mvpBackupKeyFrames.end(), job.vpKFs.begin(), job.vpKFs.end());
+        pMap->mvpBackupMapPoints.insert(pMap->mvpBackupMapPoints.end(), job.vpMPs.begin(), job.vpMPs.end());
+    }
+
+    Atlas* pAtlas = new Atlas();
+    pAtlas->mvpBackupMaps = vpMaps;
+
+    const SectionEntry &entry = vIndex[nAtlasSection];
+    DecodeAtlasSection(pData + entry.nOffset, entry.nSize, pAtlas, strVocName, strVocChecksum);
+
+    if(nInvertedFileSection >= 0)
+    {
+        const SectionEntry &invEntry = vIndex[nInvertedFileSection];
+        pAtlas->mBackupInvertedFile.assign(pData + invEntry.nOffset, invEntry.nSize);
+    }
+
+    if(bMapDescriptors)
+    {
+        // The descriptors are read one keyframe at a time from now on
+        pFile->AdviseRandom();
+        pAtlas->mpMappedFile = pFile;
+    }
+    else
+    {
+        delete pFile;
+    }
+
+    return pAtlas;
+}
+
+bool AtlasFile::AppendCheckpoint(const string &strJournal, Atlas* pAtlas, vector<MapDelta> &vDeltas, const vector<uint64_t> &vnErasedMaps,
+                                 const string &strVocName, const string &strVocChecksum, TaskScheduler* pScheduler)
+{
+    AtlasFileWriter writer;
+    if(!writer.Open(strJournal, true))
+    {
+        cout << "[E] Unable to open the checkpoint journal " << strJournal << endl;
+        return false;
+    }
+
+    vector<GeometricCamera*> vpCameras = pAtlas->GetAllCameras();
+    set<GeometricCamera*> spCams(vpCameras.begin(), vpCameras.end());
+
+    for(size_t i=0; i<vnErasedMaps.size(); i++)
+        writer.Push(ERASED_MAP_SECTION, vnErasedMaps[i], 0, new string());
+
+    for(MapDelta &delta : vDeltas)
+    {
+        Map* pMap = delta.pMap;
+        string* pHeader;
+        vector<SectionJob> vJobs;
+        {
+            shared_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
+
+            pMap->PreSaveObjects(delta.vpKeyFrames, delta.vpMapPoints, delta.spKeyFrames, delta.spMapPoints, spCams);
+
+            ostringstream os(ios::binary);
+            {
+                boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+                pMap->serializeHeader(oa, 0);
+            }
+            pHeader = new string(os.str());
+
+            AddSectionJobs(KEYFRAMES_SECTION, pMap->GetId(), delta.vpKeyFrames.size(), KEYFRAMES_PER_SECTION,
+                           &delta.vpKeyFrames, static_cast<vector<MapPoint*>*>(NULL), vJobs);
+            AddSectionJobs(MAPPOINTS_SECTION, pMap->GetId(), delta.vpMapPoints.size(), MAPPOINTS_PER_SECTION,
+                           static_cast<vector<KeyFrame*>*>(NULL), &delta.vpMapPoints, vJobs);
+
+            EncodeSections(vJobs, pScheduler, TaskScheduler::LOCAL_MAPPING);
+        }
+
+        writer.Push(MAP_SECTION, pMap->GetId(), 0, pHeader);
+        for(SectionJob &job : vJobs)
+            writer.Push(static_cast<eSectionType>(job.entry.nType), job.entry.nMapId, job.entry.nObjects, job.pData);
+
+        if(!delta.vnErasedKeyFrames.empty())
+            writer.Push(ERASED_KEYFRAMES_SECTION, pMap->GetId(), delta.vnErasedKeyFrames.size(), EncodeIds(delta.vnErasedKeyFrames));
+        if(!delta.vnErasedMapPoints.empty())
+            writer.Push(ERASED_MAPPOINTS_SECTION, pMap->GetId(), delta.vnErasedMapPoints.size(), EncodeIds(delta.vnErasedMapPoints));
+    }
+
+    string* pAtlasData = EncodeAtlasSection(pAtlas, strVocName, strVocChecksum);
+    writer.Push(ATLAS_SECTION, 0, vpCameras.size(), pAtlasData);
+
+    return writer.Close();
+}
+
+struct AtlasFile::AtlasState
+{
+    // Latest MAP section of each map
+    map<uint64_t, string> mMapHeaders;
+    map<uint64_t, map<uint64_t, KeyFrame*> > mKeyFrames;
+    map<uint64_t, map<uint64_t, MapPoint*> > mMapPoints;
+    // Latest ATLAS section
+    string strAtlas;
+};
+
+Atlas* AtlasFile::LoadCheckpoint(const string &strBase, const vector<string> &vstrJournals, string &strVocName, string &strVocChecksum,
+                                 TaskScheduler* pScheduler)
+{
+    AtlasState state;
+    if(!ReadState(strBase, vstrJournals, state, pScheduler, false))
+    {
+        ClearState(state);
+        return static_cast<Atlas*>(NULL);
+    }
+
+    return BuildAtlas(state, strVocName, strVocChecksum);
+}
+
+bool AtlasFile::Compact(const string &strBase, const vector<string> &vstrJournals, const string &strOut, TaskScheduler* pScheduler)
+{
+    AtlasState state;
+    bool bOk = ReadState(strBase, vstrJournals, state, pScheduler, true) && WriteState(strOut, state, pScheduler);
+    ClearState(state);
+    return bOk;
+}
+
+bool AtlasFile::ReadState(const string &strBase, const vector<string> &vstrJournals, AtlasState &state, TaskScheduler* pScheduler,
+                          const bool bBackground)
+{
+    vector<string> vstrFiles;
+    vstrFiles.push_back(strBase);
+    vstrFiles.insert(vstrFiles.end(), vstrJournals.begin(), vstrJournals.end());
+
+    for(size_t i=0; i<vstrFiles.size(); i++)
+    {
+        MappedFile file;
+        if(!file.Open(vstrFiles[i]))
+            continue;
+
+        // The base file is a single record
+        size_t nStart = 0;
+        uint32_t nVersion;
+        vector<SectionEntry> vIndex;
+        size_t nEnd;
+        while(ReadIndex(file, nStart, nVersion, vIndex, nEnd))
+        {
+            ApplyRecord(file, nVersion, vIndex, state, pScheduler, bBackground);
+            nStart = Align(nEnd);
+            if(i == 0)
+                break;
+        }
+
+        if(nStart < file.Size() && i > 0)
+            cout << "[W] Checkpoint journal " << vstrFiles[i] << ": the last " << file.Size()-nStart << " bytes are not a complete record" << endl;
+    }
+
+    return !state.strAtlas.empty();
+}
+
+void AtlasFile::ApplyRecord(const MappedFile &file, const uint32_t nVersion, const vector<SectionEntry> &vIndex, AtlasState &state,
+                            TaskScheduler* pScheduler, const bool bBackground)
+{
+    // Objects decoded in parallel, then applied in file order
+    vector<SectionJob> vJobs;
+    vector<int> vnJobOfSection(vIndex.size(), -1);
+    for(size_t i=0; i<vIndex.size(); i++)
+    {
+        if(IsObjectSection(vIndex[i].nType))
+        {
+            vnJobOfSection[i] = vJobs.size();
+            vJobs.push_back(NewDecodeJob(vIndex[i]));
+        }
+    }
+
+    DecodeSections(file, nVersion, false, vJobs, pScheduler, bBackground ? TaskScheduler::GLOBAL_BA : TaskScheduler::TRACKING);
+
+    for(size_t i=0; i<vIndex.size(); i++)
+    {
+        const SectionEntry &entry = vIndex[i];
+        const char* pData = file.Data() + entry.nOffset;
+        if(entry.nType == ATLAS_SECTION)
+        {
+            state.strAtlas.assign(pData, entry.nSize);
+        }
+        else if(entry.nType == MAP_SECTION)
+        {
+            state.mMapHeaders[entry.nMapId].assign(pData, entry.nSize);
+        }
+        else if(entry.nType == KEYFRAMES_SECTION)
+        {
+            const vector<KeyFrame*> &vpKFs = vJobs[vnJobOfSection[i]].vpKFs;
+            for(size_t k=0; k<vpKFs.size(); k++)
+                ReplaceObject(state.mKeyFrames[entry.nMapId], vpKFs[k]);
+        }
+        else if(entry.nType == DESCRIPTORS_SECTION)
+        {
+            const int j = vnJobOfSection[i];
+            if(j > 0)
+                AttachDescriptors(vJobs[j-1], vJobs[j]);
+        }
+        else if(entry.nType == MAPPOINTS_SECTION)
+        {
+            const vector<MapPoint*> &vpMPs = vJobs[vnJobOfSection[i]].vpMPs;
+            for(size_t k=0; k<vpMPs.size(); k++)
+                ReplaceObject(state.mMapPoints[entry.nMapId], vpMPs[k]);
+        }
+        else if(entry.nType == ERASED_KEYFRAMES_SECTION)
+        {
+            EraseObjects(state.mKeyFrames[entry.nMapId], DecodeIds(pData, entry.nSize));
+        }
+        else if(entry.nType == ERASED_MAPPOINTS_SECTION)
+        {
+            EraseObjects(state.mMapPoints[entry.nMapId], DecodeIds(pData, entry.nSize));
+        }
+        else if(entry.nType == ERASED_MAP_SECTION)
+        {
+            ClearObjects(state.mKeyFrames[entry.nMapId]);
+            ClearObjects(state.mMapPoints[entry.nMapId]);
+            state.mKeyFrames.erase(entry.nMapId);
+            state.mMapPoints.erase(entry.nMapId);
+            state.mMapHeaders.erase(entry.nMapId);
+        }
+    }
+}
+
+Atlas* AtlasFile::BuildAtlas(AtlasState &state, string &strVocName, string &strVocChecksum)
+{
+    Atlas* pAtlas = new Atlas();
+    for(map<uint64_t, string>::iterator it = state.mMapHeaders.begin(); it != state.mMapHeaders.end(); ++it)
+    {
+        MemoryStreamBuf buf(it->second.data(), it->second.size());
+        boost::archive::binary_iarchive ia(buf, boost::archive::no_header);
+        Map* pMap = new Map();
+        pMap->serializeHeader(ia, 0);
+
+        map<uint64_t, KeyFrame*> &mKFs = state.mKeyFrames[it->first];
+        for(map<uint64_t, KeyFrame*>::iterator itKF = mKFs.begin(); itKF != mKFs.end(); ++itKF)
+            pMap->mvpBackupKeyFrames.push_back(itKF->second);
+        mKFs.clear();
+
+        map<uint64_t, MapPoint*> &mMPs = state.mMapPoints[it->first];
+        for(map<uint64_t, MapPoint*>::iterator itMP = mMPs.begin(); itMP != mMPs.end(); ++itMP)
+            pMap->mvpBackupMapPoints.push_back(itMP->second);
+        mMPs.clear();
+
+        pAtlas->mvpBackupMaps.push_back(pMap);
+    }
+
+    // Objects of maps without header
+    ClearState(state);
+
+    DecodeAtlasSection(state.strAtlas.data(), state.strAtlas.size(), pAtlas, strVocName, strVocChecksum);
+    return pAtlas;
+}
+
+bool AtlasFile::WriteState(const string &strFile, AtlasState &state, TaskScheduler* pScheduler)
+{
+    AtlasFileWriter writer;
+    if(!writer.Open(strFile))
+    {
+        cout << "[E] Unable to open the atlas file " << strFile << endl;
+        return false;
+    }
+
+    for(map<uint64_t, string>::iterator it = state.mMapHeaders.begin(); it != state.mMapHeaders.end(); ++it)
+    {
+        const uint64_t nMapId = it->first;
+        vector<KeyFrame*> vpKFs;
+        const map<uint64_t, KeyFrame*> &mKFs = state.mKeyFrames[nMapId];
+        for(map<uint64_t, KeyFrame*>::const_iterator itKF = mKFs.begin(); itKF != mKFs.end(); ++itKF)
+            vpKFs.push_back(itKF->second);
+
+        vector<MapPoint*> vpMPs;
+        const map<uint64_t, MapPoint*> &mMPs = state.mMapPoints[nMapId];
+        for(map<uint64_t, MapPoint*>::const_iterator itMP = mMPs.begin(); itMP != mMPs.end(); ++itMP)
+            vpMPs.push_back(itMP->second);
+
+        // The decoded objects keep the ids of their references, they are encoded again as they are
+        vector<SectionJob> vJobs;
+        AddSectionJobs(KEYFRAMES_SECTION, nMapId, vpKFs.size(), KEYFRAMES_PER_SECTION, &vpKFs, static_cast<vector<MapPoint*>*>(NULL), vJobs);
+        AddSectionJobs(MAPPOINTS_SECTION, nMapId, vpMPs.size(), MAPPOINTS_PER_SECTION, static_cast<vector<KeyFrame*>*>(NULL), &vpMPs, vJobs);
+        EncodeSections(vJobs, pScheduler, TaskScheduler::GLOBAL_BA);
+
+        writer.Push(MAP_SECTION, nMapId, 0, new string(it->second));
+        for(SectionJob &job : vJobs)
+            writer.Push(static_cast<eSectionType>(job.entry.nType), job.entry.nMapId, job.entry.nObjects, job.pData);
+    }
+
+    writer.Push(ATLAS_SECTION, 0, 0, new string(state.strAtlas));
+
+    return writer.Close();
+}
+
+void AtlasFile::ClearState(AtlasState &state)
+{
+    for(map<uint64_t, map<uint64_t, KeyFrame*> >::iterator it = state.mKeyFrames.begin(); it != state.mKeyFrames.end(); ++it)
+        ClearObjects(it->second);
+    for(map<uint64_t, map<uint64_t, MapPoint*> >::iterator it = state.mMapPoints.begin(); it != state.mMapPoints.end(); ++it)
+        ClearObjects(it->second);
+    state.mKeyFrames.clear();
+    state.mMapPoints.clear();
+}
+
+MappedFile::MappedFile(): mpData(static_cast<char*>(NULL)), mnSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const string &strFile)
+{
+    Close();
+
+    const int fd = open(strFile.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file, even if it is replaced by a new save
+    close(fd);
+    if(p == MAP_FAILED)
+        return false;
+
+    mpData = static_cast<char*>(p);
+    mnSize = st.st_size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if(mpData)
+        munmap(mpData, mnSize);
+    mpData = static_cast<char*>(NULL);
+    mnSize = 0;
+}
+
+const char* MappedFile::Data() const
+{
+    return mpData;
+}
+
+size_t MappedFile::Size() const
+{
+    return mnSize;
+}
+
+void MappedFile::AdviseSequential()
+{
+    if(mpData)
+        madvise(mpData, mnSize, MADV_SEQUENTIAL);
+}
+
+void MappedFile::AdviseRandom()
+{
+    if(mpData)
+        madvise(mpData, mnSize, MADV_RANDOM);
+}
+
+AtlasFileWriter::AtlasFileWriter(): mbClosing(false), mnBase(0), mnOffset(0), mbFailed(false)
+{
+}
+
+AtlasFileWriter::~AtlasFileWriter()
+{
+    if(mThread.joinable())
+        Close();
+}
+
+bool AtlasFileWriter::Open(const string &strFile, const bool bAppend)
+{
+    mStrFile = strFile;
+    mnBase = 0;
+    if(bAppend)
+    {
+        // ios::app would write the header of Close at the end
+        mFile.open(strFile.c_str(), ios::binary | ios::in | ios::out);
+        if(!mFile.is_open())
+            mFile.open(strFile.c_str(), ios::binary | ios::trunc);
+        if(!mFile.is_open())
+            return false;
+
+        mFile.seekp(0, ios::end);
+        const uint64_t nSize = mFile.tellp();
+        mnBase = Align(nSize);
+        const string padding(mnBase-nSize, '\0');
+        mFile.write(padding.data(), padding.size());
+    }
+    else
+    {
+        mFile.open(strFile.c_str(), ios::binary | ios::trunc);
+        if(!mFile.is_open())
+            return false;
+    }
+
+    // Placeholder, the header is written again with the index table position in Close
+    WriteHeader(mFile, 0, 0);
+    mnOffset = HEADER_SIZE;
+    mbClosing = false;
+    mbFailed = false;
+    mvIndex.clear();
+    mThread = thread(&AtlasFileWriter::Run, this);
+    return true;
+}
+
+void AtlasFileWriter::Push(const AtlasFile::eSectionType type, const unsigned long int nMapId, const unsigned int nObjects, string* pData)
+{
+    PendingSection section;
+    section.entry.nType = type;
+    section.entry.nObjects = nObjects;
+    section.entry.nMapId = nMapId;
+    section.entry.nOffset = 0;
+    section.entry.nSize = pData->size();
+    section.pData = pData;
+
+    unique_lock<mutex> lock(mMutex);
+    mdPending.push_back(section);
+    mCond.notify_one();
+}
+
+void AtlasFileWriter::Run()
+{
+    const string padding(AtlasFile::SECTION_ALIGNMENT, '\0');
+    while(true)
+    {
+        PendingSection section;
+        {
+            unique_lock<mutex> lock(mMutex);
+            while(mdPending.empty() && !mbClosing)
+                mCond.wait(lock);
+            if(mdPending.empty())
+                return;
+            section = mdPending.front();
+            mdPending.pop_front();
+        }
+
+        const uint64_t nStart = Align(mnOffset);
+        mFile.write(padding.data(), nStart-mnOffset);
+        section.entry.nOffset = nStart;
+        mFile.write(section.pData->data(), section.pData->size());
+        mnOffset = nStart + section.pData->size();
+        delete section.pData;
+
+        if(!mFile.good())
+            mbFailed = true;
+        mvIndex.push_back(section.entry);
+    }
+}
+
+bool AtlasFileWriter::Close()
+{
+    {
+        unique_lock<mutex> lock(mMutex);
+        mbClosing = true;
+        mCond.notify_one();
+    }
+    if(mThread.joinable())
+        mThread.join();
+
+    const uint64_t nIndexOffset = mnOffset;
+    for(size_t i=0; i<mvIndex.size(); i++)
+        WriteValue(mFile, mvIndex[i]);
+
+    // Written last, a record is valid only once it is complete. The sections must be on the disk
+    // before the header that points to them.
+    mFile.flush();
+    bool bGood = mFile.good() && AtlasFile::Sync(mStrFile);
+    mFile.seekp(mnBase);
+    WriteHeader(mFile, mvIndex.size(), nIndexOffset);
+    mFile.flush();
+    bGood = bGood && mFile.good();
+    mFile.close();
+    bGood = bGood && AtlasFile::Sync(mStrFile);
+
+    return bGood && !mbFailed;
+}
+
+} //namespace ORB_SLAM3
@@ -174,6 +174,38 @@ namespace ORB_SLAM3 {
         return JacGood;
     }
 
+    Eigen::Matrix<float, 2, 3> KannalaBrandt8::projectJac(const Eigen::Vector3f &v3D) {
+        const float x2 = v3D[0] * v3D[0], y2 = v3D[1] * v3D[1], z2 = v3D[2] * v3D[2];
+        const float r2 = x2 + y2;
+        const float r = sqrtf(r2);
+        const float r3 = r2 * r;
+        const float theta = atan2f(r, v3D[2]);
+
+        const float theta2 = theta * theta, theta3 = theta2 * theta;
+        const float theta4 = theta2 * theta2, theta5 = theta4 * theta;
+        const float theta6 = theta2 * theta4, theta7 = theta6 * theta;
+        const float theta8 = theta4 * theta4, theta9 = theta8 * theta;
+
+        const float f = theta + theta3 * mvParameters[4] + theta5 * mvParameters[5] + theta7 * mvParameters[6] +
+                        theta9 * mvParameters[7];
+        const float fd = 1 + 3 * mvParameters[4] * theta2 + 5 * mvParameters[5] * theta4 + 7 * mvParameters[6] * theta6 +
+                         9 * mvParameters[7] * theta8;
+
+        Eigen::Matrix<float, 2, 3> JacGood;
+        JacGood(0, 0) = mvParameters[0] * (fd * v3D[2] * x2 / (r2 * (r2 + z2)) + f * y2 / r3);
+        JacGood(1, 0) =
+                mvParameters[1] * (fd * v3D[2] * v3D[1] * v3D[0] / (r2 * (r2 + z2)) - f * v3D[1] * v3D[0] / r3);
+
+        JacGood(0, 1) =
+                mvParameters[0] * (fd * v3D[2] * v3D[1] * v3D[0] / (r2 * (r2 + z2)) - f * v3D[1] * v3D[0] / r3);
+        JacGood(1, 1) = mvParameters[1] * (fd * v3D[2] * y2 / (r2 * (r2 + z2)) + f * x2 / r3);
+
+        JacGood(0, 2) = -mvParameters[0] * fd * v3D[0] / (r2 + z2);
+        JacGood(1, 2) = -mvParameters[1] * fd * v3D[1] / (r2 + z2);
+
+        return JacGood;
+    }
+
     bool KannalaBrandt8::ReconstructWithTwoViews(const std::vector<cv::KeyPoint>& vKeys1, const std::vector<cv::KeyPoint>& vKeys2, const std::vector<int> &vMatches12,
                                           Sophus::SE3f &T21, std::vector<cv::Point3f> &vP3D, std::vector<bool> &vbTriangulated){
         if(!tvr){
@@ -25,7 +25,7 @@
 namespace ORB_SLAM3 {
 //BOOST_CLASS_EXPORT_GUID(Pinhole, "Pinhole")
 
-    long unsigned int GeometricCamera::nNextId=0;
+    std::atomic<long unsigned int> GeometricCamera::nNextId(0);
 
     cv::Point2f Pinhole::project(const cv::Point3f &p3D) {
         return cv::Point2f(mvParameters[0] * p3D.x / p3D.z + mvParameters[2],
@@ -80,6 +80,19 @@ namespace ORB_SLAM3 {
         return Jac;
     }
 
+    Eigen::Matrix<float, 2, 3> Pinhole::projectJac(const Eigen::Vector3f &v3D) {
+        const float invz = 1.f / v3D[2];
+        Eigen::Matrix<float, 2, 3> Jac;
+        Jac(0, 0) = mvParameters[0] * invz;
+        Jac(0, 1) = 0.f;
+        Jac(0, 2) = -mvParameters[0] * v3D[0] * invz * invz;
+        Jac(1, 0) = 0.f;
+        Jac(1, 1) = mvParameters[1] * invz;
+        Jac(1, 2) = -mvParameters[1] * v3D[1] * invz * invz;
+
+        return Jac;
+    }
+
     bool Pinhole::ReconstructWithTwoViews(const std::vector<cv::KeyPoint>& vKeys1, const std::vector<cv::KeyPoint>& vKeys2, const std::vector<int> &vMatches12,
                                  Sophus::SE3f &T21, std::vector<cv::Point3f> &vP3D, std::vector<bool> &vbTriangulated){
         if(!tvr){
@@ -0,0 +1,290 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "DatasetReader.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+DatasetReader::DatasetReader(const int nThreads, const int nBufferSize, const bool bRealTime)
+{
+    Init(nThreads, nBufferSize, bRealTime);
+}
+
+DatasetReader::DatasetReader(const string &strSettingsFile)
+{
+    int nThreads = 2, nBufferSize = 16;
+    bool bRealTime = true;
+
+    cv::FileStorage fsSettings(strSettingsFile.c_str(), cv::FileStorage::READ);
+    if(fsSettings.isOpened())
+    {
+        cv::FileNode node = fsSettings["Dataset.DecodeThreads"];
+        if(!node.empty())
+            nThreads = static_cast<int>(node);
+        node = fsSettings["Dataset.BufferSize"];
+        if(!node.empty())
+            nBufferSize = static_cast<int>(node);
+        // In the offline mode of the system the frames are not paced, unless Dataset.RealTime says so
+        node = fsSettings["System.Offline"];
+        if(!node.empty())
+            bRealTime = static_cast<int>(node) == 0;
+        node = fsSettings["Dataset.RealTime"];
+        if(!node.empty())
+            bRealTime = static_cast<int>(node) != 0;
+    }
+
+    Init(nThreads, nBufferSize, bRealTime);
+}
+
+DatasetReader::~DatasetReader()
+{
+    Stop();
+}
+
+void DatasetReader::Init(const int nThreads, const int nBufferSize, const bool bRealTime)
+{
+    mnThreads = max(1, nThreads);
+    // Enough slots for every thread to decode while the tracking holds one
+    mnBufferSize = max(nBufferSize, mnThreads+1);
+    mbRealTime = bRealTime;
+    mFlags = cv::IMREAD_UNCHANGED;
+    mImageScale = 1.f;
+    mClaheClipLimit = 0.0;
+    mnNextDecode = 0;
+    mnNextReturn = 0;
+    // Stopped until Start
+    mbStop = true;
+
+    if(!mbRealTime)
+        cout << "Dataset reader: frames as fast as they are decoded (Dataset.RealTime: 0)" << endl;
+}
+
+void DatasetReader::SetSequence(const vector<string> &vstrImages, const vector<string> &vstrImages2, const vector<double> &vTimestamps,
+                                const int flags)
+{
+    Stop();
+
+    mvstrImages = vstrImages;
+    mvstrImages2 = vstrImages2;
+    mvTimestamps = vTimestamps;
+    mFlags = flags;
+    mvTimestampsImu.clear();
+    mvAcc.clear();
+    mvGyro.clear();
+}
+
+void DatasetReader::SetImu(const vector<double> &vTimestampsImu, const vector<cv::Point3f> &vAcc, const vector<cv::Point3f> &vGyro)
+{
+    mvTimestampsImu = vTimestampsImu;
+    mvAcc = vAcc;
+    mvGyro = vGyro;
+}
+
+void DatasetReader::SetImageScale(const float scale)
+{
+    mImageScale = scale;
+}
+
+void DatasetReader::SetClahe(const double clipLimit, const cv::Size &tileGridSize)
+{
+    mClaheClipLimit = clipLimit;
+    mClaheTileGridSize = tileGridSize;
+}
+
+void DatasetReader::Start()
+{
+    Stop();
+
+    const int nFrames = mvTimestamps.size();
+
+    // IMU measurements of each frame as the examples took them: none for the first frame, then from the
+    // last one before the first frame up to the one of each frame
+    mvFirstImu.assign(nFrames, 0);
+    mvLastImu.assign(nFrames, 0);
+    const int nImu = min(mvTimestampsImu.size(), min(mvAcc.size(), mvGyro.size()));
+    if(nImu > 0 && nFrames > 0)
+    {
+        int first_imu = 0;
+        while(first_imu < nImu && mvTimestampsImu[first_imu] <= mvTimestamps[0])
+            first_imu++;
+        first_imu = max(first_imu-1, 0);
+
+        for(int ni=1; ni<nFrames; ni++)
+        {
+            mvFirstImu[ni] = first_imu;
+            while(first_imu < nImu && mvTimestampsImu[first_imu] <= mvTimestamps[ni])
+                first_imu++;
+            mvLastImu[ni] = first_imu;
+        }
+    }
+
+    mvBuffer.assign(mnBufferSize, DatasetFrame());
+    mvSlotFrame.assign(mnBufferSize, -1);
+    mnNextDecode = 0;
+    mnNextReturn = 0;
+    mbStop = false;
+
+    for(int i=0; i<mnThreads; i++)
+        mvptWorkers.push_back(new thread(&DatasetReader::Decode, this));
+}
+
+bool DatasetReader::Next(DatasetFrame &frame)
+{
+    const int idx = mnNextReturn;
+    if(idx >= Size())
+        return false;
+
+    {
+        unique_lock<mutex> lock(mMutex);
+        if(mbStop)
+            return false;
+        const int slot = idx % mnBufferSize;
+        while(mvSlotFrame[slot] != idx && !mbStop)
+            mCondDecoded.wait(lock);
+        if(mbStop)
+            return false;
+
+        frame = mvBuffer[slot];
+        mvBuffer[slot] = DatasetFrame();
+        mvSlotFrame[slot] = -1;
+        mnNextReturn++;
+    }
+    mCondReturned.notify_all();
+
+    // The previous frame was returned the time between both timestamps ago at least
+    if(mbRealTime && idx > 0)
+    {
+        const chrono::steady_clock::time_point due = mLastReturn +
+                chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(mvTimestamps[idx]-mvTimestamps[idx-1]));
+        this_thread::sleep_until(due);
+    }
+    mLastReturn = chrono::steady_clock::now();
+
+    return true;
+}
+
+void DatasetReader::Stop()
+{
+    {
+        unique_lock<mutex> lock(mMutex);
+        mbStop = true;
+    }
+    mCondReturned.notify_all();
+    mCondDecoded.notify_all();
+
+    for(thread* pt : mvptWorkers)
+    {
+        pt->join();
+        delete pt;
+    }
+    mvptWorkers.clear();
+}
+
+int DatasetReader::Size() const
+{
+    return mvTimestamps.size();
+}
+
+bool DatasetReader::IsRealTime() const
+{
+    return mbRealTime;
+}
+
+void DatasetReader::Decode()
+{
+    // CLAHE objects keep state, one per thread
+    cv::Ptr<cv::CLAHE> clahe;
+    if(mClaheClipLimit > 0.0)
+        clahe = cv::createCLAHE(mClaheClipLimit, mClaheTileGridSize);
+
+    while(true)
+    {
+        int idx;
+        {
+            unique_lock<mutex> lock(mMutex);
+            // Bounded by the buffer, at most mnBufferSize frames ahead of the tracking
+            while(!mbStop && mnNextDecode < Size() && mnNextDecode >= mnNextReturn + mnBufferSize)
+                mCondReturned.wait(lock);
+            if(mbStop || mnNextDecode >= Size())
+                return;
+            idx = mnNextDecode++;
+        }
+
+        DatasetFrame frame;
+        DecodeFrame(idx, frame, clahe);
+
+        {
+            unique_lock<mutex> lock(mMutex);
+            const int slot = idx % mnBufferSize;
+            mvBuffer[slot] = frame;
+            mvSlotFrame[slot] = idx;
+        }
+        mCondDecoded.notify_all();
+    }
+}
+
+void DatasetReader::DecodeFrame(const int idx, DatasetFrame &frame, cv::Ptr<cv::CLAHE> &clahe)
+{
+    frame.nIndex = idx;
+    frame.timestamp = mvTimestamps[idx];
+    frame.tResize = 0.0;
+
+    frame.im = cv::imread(mvstrImages[idx], mFlags);
+    if(frame.im.empty())
+        frame.strFailed = mvstrImages[idx];
+
+    if(!mvstrImages2.empty())
+    {
+        frame.im2 = cv::imread(mvstrImages2[idx], mFlags);
+        if(frame.im2.empty() && frame.strFailed.empty())
+            frame.strFailed = mvstrImages2[idx];
+    }
+
+    if(!frame.strFailed.empty())
+        return;
+
+    if(mImageScale != 1.f)
+    {
+        const chrono::steady_clock::time_point time_Start = chrono::steady_clock::now();
+        const int width = frame.im.cols * mImageScale;
+        const int height = frame.im.rows * mImageScale;
+        cv::resize(frame.im, frame.im, cv::Size(width, height));
+        if(!frame.im2.empty())
+            cv::resize(frame.im2, frame.im2, cv::Size(width, height));
+        frame.tResize = chrono::duration_cast<chrono::duration<double,std::milli> >(chrono::steady_clock::now() - time_Start).count();
+    }
+
+    if(clahe)
+    {
+        clahe->apply(frame.im, frame.im);
+        if(!frame.im2.empty())
+            clahe->apply(frame.im2, frame.im2);
+    }
+
+    for(int i=mvFirstImu[idx]; i<mvLastImu[idx]; i++)
+        frame.vImuMeas.push_back(IMU::Point(mvAcc[i].x, mvAcc[i].y, mvAcc[i].z, mvGyro[i].x, mvGyro[i].y, mvGyro[i].z, mvTimestampsImu[i]));
+}
+
+} //namespace ORB_SLAM3
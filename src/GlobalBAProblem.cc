@@ -0,0 +1,449 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GlobalBAProblem.h"
+
+#include "KeyFrame.h"
+#include "Map.h"
+#include "OptimizableTypes.h"
+#include "System.h"
+
+#include <sstream>
+
+namespace ORB_SLAM3
+{
+
+GlobalBAProblem::GlobalBAProblem(): mbClearRequested(false), mpMap(static_cast<Map*>(NULL)), mbPartial(false), mbRobust(false),
+    mLinearSolverType(Optimizer::LINEAR_SOLVER_AUTO), mnStamp(0), mnNextVertexId(0), mnIterations(0)
+{
+    mOptimizer.setVerbose(false);
+}
+
+GlobalBAProblem::~GlobalBAProblem()
+{
+    unique_lock<mutex> lock(mMutexProblem);
+    ClearGraph();
+}
+
+void GlobalBAProblem::Clear()
+{
+    mbClearRequested = true;
+}
+
+void GlobalBAProblem::ClearGraph()
+{
+    mOptimizer.clear();
+    mmKeyFrames.clear();
+    mmPoints.clear();
+    mmPointOfVertex.clear();
+    mpMap = static_cast<Map*>(NULL);
+    mbPartial = false;
+    mnNextVertexId = 0;
+    mnIterations = 0;
+}
+
+void GlobalBAProblem::SetLinearSolver(Optimizer::eLinearSolver linearSolverType, const size_t nKFs)
+{
+    if(linearSolverType == Optimizer::LINEAR_SOLVER_AUTO)
+        linearSolverType = nKFs >= Optimizer::PCG_MIN_KEYFRAMES ? Optimizer::LINEAR_SOLVER_PCG_INEXACT : Optimizer::LINEAR_SOLVER_CHOLESKY;
+
+    if(mOptimizer.solver() && linearSolverType == mLinearSolverType)
+        return;
+
+    g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
+
+    linearSolver = Optimizer::CreateLinearSolver<g2o::BlockSolver_6_3>(linearSolverType, nKFs);
+
+    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+
+    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+
+    // The optimizer does not delete the algorithm it is replacing
+    g2o::OptimizationAlgorithm* pOldSolver = mOptimizer.solver();
+    mOptimizer.setAlgorithm(solver);
+    delete pOldSolver;
+
+    mLinearSolverType = linearSolverType;
+}
+
+void GlobalBAProblem::RemovePointEdges(PointEntry &entry)
+{
+    for(size_t i=0; i<entry.vEdges.size(); i++)
+        mOptimizer.removeEdge(entry.vEdges[i]);
+    entry.vEdges.clear();
+}
+
+void GlobalBAProblem::RemoveKeyFrameVertex(KeyFrameEntry &entry)
+{
+    while(!entry.pVertex->edges().empty())
+    {
+        g2o::HyperGraph::Edge* pEdge = *entry.pVertex->edges().begin();
+        std::unordered_map<int, MapPoint*>::iterator itPoint = mmPointOfVertex.find(pEdge->vertex(0)->id());
+        if(itPoint == mmPointOfVertex.end())
+        {
+            mOptimizer.removeEdge(pEdge);
+            continue;
+        }
+        // Removes also pEdge
+        PointEntry &point = mmPoints[itPoint->second];
+        RemovePointEdges(point);
+        point.bDirty = true;
+    }
+    mOptimizer.removeVertex(entry.pVertex);
+}
+
+void GlobalBAProblem::AddPointEdges(MapPoint* pMP, PointEntry &entry, Map* pMap, const bool bRobust)
+{
+    const float thHuber2D = sqrt(5.99);
+    const float thHuber3D = sqrt(7.815);
+
+    const MapPoint::ObservationMap observations = pMP->GetObservations();
+    for(MapPoint::ObservationMap::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+    {
+        KeyFrame* pKF = mit->first;
+        if(pKF->isBad() || pKF->GetMap() != pMap)
+            continue;
+
+        KeyFrameEntryMap::iterator itKF = mmKeyFrames.find(pKF);
+        if(itKF == mmKeyFrames.end())
+            continue;
+        g2o::VertexSE3Expmap* vSE3 = itKF->second.pVertex;
+
+        const int leftIndex = get<0>(mit->second);
+
+        if(leftIndex != -1 && pKF->mvuRight[leftIndex]<0)
+        {
+            const cv::KeyPoint &kpUn = pKF->mvKeysUn[leftIndex];
+
+            Eigen::Matrix<double,2,1> obs;
+            obs << kpUn.pt.x, kpUn.pt.y;
+
+            ORB_SLAM3::EdgeSE3ProjectXYZ* e = new ORB_SLAM3::EdgeSE3ProjectXYZ();
+
+            e->setVertex(0, entry.pVertex);
+            e->setVertex(1, vSE3);
+            e->setMeasurement(obs);
+            const float &invSigma2 = pKF->mvInvLevelSigma2[kpUn.octave];
+            e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+            if(bRobust)
+            {
+                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+                e->setRobustKernel(rk);
+                rk->setDelta(thHuber2D);
+            }
+
+            e->pCamera = pKF->mpCamera;
+
+            mOptimizer.addEdge(e);
+            entry.vEdges.push_back(e);
+        }
+        else if(leftIndex != -1 && pKF->mvuRight[leftIndex] >= 0) //Stereo observation
+        {
+            const cv::KeyPoint &kpUn = pKF->mvKeysUn[leftIndex];
+
+            Eigen::Matrix<double,3,1> obs;
+            const float kp_ur = pKF->mvuRight[leftIndex];
+            obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
+
+            g2o::EdgeStereoSE3ProjectXYZ* e = new g2o::EdgeStereoSE3ProjectXYZ();
+
+            e->setVertex(0, entry.pVertex);
+            e->setVertex(1, vSE3);
+            e->setMeasurement(obs);
+            const float &invSigma2 = pKF->mvInvLevelSigma2[kpUn.octave];
+            e->setInformation(Eigen::Matrix3d::Identity()*invSigma2);
+
+            if(bRobust)
+            {
+                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+                e->setRobustKernel(rk);
+                rk->setDelta(thHuber3D);
+            }
+
+            e->fx = pKF->fx;
+            e->fy = pKF->fy;
+            e->cx = pKF->cx;
+            e->cy = pKF->cy;
+            e->bf = pKF->mbf;
+
+            mOptimizer.addEdge(e);
+            entry.vEdges.push_back(e);
+        }
+
+        if(pKF->mpCamera2){
+            int rightIndex = get<1>(mit->second);
+
+            if(rightIndex != -1 && rightIndex < pKF->mvKeysRight.size()){
+                rightIndex -= pKF->NLeft;
+
+                Eigen::Matrix<double,2,1> obs;
+                cv::KeyPoint kp = pKF->mvKeysRight[rightIndex];
+                obs << kp.pt.x, kp.pt.y;
+
+                ORB_SLAM3::EdgeSE3ProjectXYZToBody *e = new ORB_SLAM3::EdgeSE3ProjectXYZToBody();
+
+                e->setVertex(0, entry.pVertex);
+                e->setVertex(1, vSE3);
+                e->setMeasurement(obs);
+                const float &invSigma2 = pKF->mvInvLevelSigma2[kp.octave];
+                e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+                e->setRobustKernel(rk);
+                rk->setDelta(thHuber2D);
+
+                Sophus::SE3f Trl = pKF-> GetRelativePoseTrl();
+                e->mTrl = g2o::SE3Quat(Trl.unit_quaternion().cast<double>(), Trl.translation().cast<double>());
+
+                e->pCamera = pKF->mpCamera2;
+
+                mOptimizer.addEdge(e);
+                entry.vEdges.push_back(e);
+            }
+        }
+    }
+}
+
+void GlobalBAProblem::Synchronize(Map* pMap, const bool bRobust)
+{
+    mnStamp++;
+
+    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+    const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+
+    // Points first, their partial estimate is moved with the old and new estimate of their reference keyframe
+    int nNewMPs = 0, nMovedMPs = 0;
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+        if(pMP->isBad())
+            continue;
+
+        std::pair<std::unordered_map<MapPoint*, PointEntry>::iterator, bool> inserted = mmPoints.insert(std::make_pair(pMP, PointEntry()));
+        PointEntry &entry = inserted.first->second;
+        entry.nStamp = mnStamp;
+
+        const Eigen::Vector3f Xw = pMP->GetWorldPos();
+        if(inserted.second)
+        {
+            entry.pVertex = new g2o::VertexSBAPointXYZ();
+            entry.pVertex->setId(mnNextVertexId++);
+            entry.pVertex->setMarginalized(true);
+            entry.pVertex->setEstimate(Xw.cast<double>());
+            mOptimizer.addVertex(entry.pVertex);
+            mmPointOfVertex[entry.pVertex->id()] = pMP;
+            entry.nObsVersion = pMP->GetObservationsVersion();
+            entry.bDirty = true;
+            entry.PosSync = Xw;
+            nNewMPs++;
+            continue;
+        }
+
+        const unsigned int nVersion = pMP->GetObservationsVersion();
+        if(nVersion != entry.nObsVersion || bRobust != mbRobust)
+        {
+            entry.nObsVersion = nVersion;
+            entry.bDirty = true;
+        }
+
+        if(!mbPartial)
+            entry.pVertex->setEstimate(Xw.cast<double>());
+        else if(Xw != entry.PosSync)
+        {
+            // Keep the refinement of the stopped run in the frame of the reference keyframe
+            Eigen::Vector3f Xnew = Xw;
+            KeyFrameEntryMap::iterator itRef = mmKeyFrames.find(pMP->GetReferenceKeyFrame());
+            if(itRef != mmKeyFrames.end())
+            {
+                const g2o::SE3Quat &Gcw = itRef->second.pVertex->estimate();
+                const Eigen::Vector3f Xc_est = Gcw.map(entry.pVertex->estimate()).cast<float>();
+                const Eigen::Vector3f Xc_sync = itRef->second.TcwSync * entry.PosSync;
+                Xnew += pMP->GetReferenceKeyFrame()->GetRotation().transpose() * (Xc_est - Xc_sync);
+            }
+            entry.pVertex->setEstimate(Xnew.cast<double>());
+            nMovedMPs++;
+        }
+        entry.PosSync = Xw;
+    }
+
+    // Keyframes. The refinement of the stopped run is kept in the camera frame: G' = G * Tsync^-1 * Tcw
+    int nNewKFs = 0, nMovedKFs = 0;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        if(pKF->isBad())
+            continue;
+
+        std::pair<KeyFrameEntryMap::iterator, bool> inserted = mmKeyFrames.insert(std::make_pair(pKF, KeyFrameEntry()));
+        KeyFrameEntry &entry = inserted.first->second;
+        entry.nStamp = mnStamp;
+
+        const Sophus::SE3f Tcw = pKF->GetPose();
+        const g2o::SE3Quat Tcw_g2o(Tcw.unit_quaternion().cast<double>(),Tcw.translation().cast<double>());
+        if(inserted.second)
+        {
+            entry.pVertex = new g2o::VertexSE3Expmap();
+            entry.pVertex->setId(mnNextVertexId++);
+            entry.pVertex->setEstimate(Tcw_g2o);
+            mOptimizer.addVertex(entry.pVertex);
+            nNewKFs++;
+        }
+        else if(!mbPartial)
+            entry.pVertex->setEstimate(Tcw_g2o);
+        else if(Tcw.matrix() != entry.TcwSync.matrix())
+        {
+            const Sophus::SE3f Tsync = entry.TcwSync;
+            const g2o::SE3Quat Tsync_g2o(Tsync.unit_quaternion().cast<double>(),Tsync.translation().cast<double>());
+            entry.pVertex->setEstimate(entry.pVertex->estimate() * Tsync_g2o.inverse() * Tcw_g2o);
+            nMovedKFs++;
+        }
+        entry.TcwSync = Tcw;
+        entry.pVertex->setFixed(pKF->mnId==pMap->GetInitKFid());
+    }
+
+    // Keyframes and points that are not in the map anymore
+    int nRemovedKFs = 0, nRemovedMPs = 0;
+    for(std::unordered_map<MapPoint*, PointEntry>::iterator it=mmPoints.begin(); it!=mmPoints.end();)
+    {
+        if(it->second.nStamp != mnStamp)
+        {
+            mmPointOfVertex.erase(it->second.pVertex->id());
+            mOptimizer.removeVertex(it->second.pVertex);
+            it = mmPoints.erase(it);
+            nRemovedMPs++;
+        }
+        else
+            it++;
+    }
+    for(KeyFrameEntryMap::iterator it=mmKeyFrames.begin(); it!=mmKeyFrames.end();)
+    {
+        if(it->second.nStamp != mnStamp)
+        {
+            RemoveKeyFrameVertex(it->second);
+            it = mmKeyFrames.erase(it);
+            nRemovedKFs++;
+        }
+        else
+            it++;
+    }
+
+    // Edges of the points whose observations changed
+    int nUpdatedMPs = 0;
+    for(std::unordered_map<MapPoint*, PointEntry>::iterator it=mmPoints.begin(); it!=mmPoints.end(); it++)
+    {
+        if(!it->second.bDirty)
+            continue;
+        RemovePointEdges(it->second);
+        AddPointEdges(it->first, it->second, pMap, bRobust);
+        it->second.bDirty = false;
+        nUpdatedMPs++;
+    }
+    mbRobust = bRobust;
+
+    std::stringstream ss;
+    ss << "GBA: " << (mbPartial ? "resuming" : "starting") << " with " << mmKeyFrames.size() << " KFs and " << mmPoints.size() << " MPs, "
+       << nNewKFs << " new / " << nMovedKFs << " moved / " << nRemovedKFs << " removed KFs, "
+       << nNewMPs << " new / " << nMovedMPs << " moved / " << nRemovedMPs << " removed / " << nUpdatedMPs << " rebuilt MPs";
+    Verbose::PrintMess(ss.str(), Verbose::VERBOSITY_NORMAL);
+}
+
+bool GlobalBAProblem::Optimize(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                               TaskScheduler* pScheduler, Optimizer::eLinearSolver linearSolverType)
+{
+    // A run that was stopped may still be finishing its last iteration
+    unique_lock<mutex> lock(mMutexProblem);
+
+    if(mbClearRequested.exchange(false) || pMap != mpMap)
+    {
+        ClearGraph();
+        mpMap = pMap;
+    }
+
+    SetLinearSolver(linearSolverType, pMap->KeyFramesInMap());
+    Synchronize(pMap, bRobust);
+    if(!mbPartial)
+        mnIterations = 0;
+
+    G2oSchedulerExecutor executor(pScheduler, TaskScheduler::GLOBAL_BA);
+    mOptimizer.setParallelExecutor(pScheduler ? &executor : static_cast<g2o::ParallelExecutor*>(NULL));
+    mOptimizer.setMixedPrecision(Optimizer::MixedPrecision());
+    mOptimizer.setForceStopFlag(pbStopFlag);
+
+    mOptimizer.initializeOptimization();
+    mnIterations += mOptimizer.optimize(nIterations);
+
+    mOptimizer.setParallelExecutor(static_cast<g2o::ParallelExecutor*>(NULL));
+    mOptimizer.setForceStopFlag(static_cast<bool*>(NULL));
+
+    // Stopped, the estimates are the starting point of the next run
+    mbPartial = pbStopFlag && *pbStopFlag;
+    if(mbPartial)
+    {
+        Verbose::PrintMess("GBA: stopped after " + to_string(mnIterations) + " iterations, it will be resumed", Verbose::VERBOSITY_NORMAL);
+        return false;
+    }
+    Verbose::PrintMess("BA: End of the optimization", Verbose::VERBOSITY_NORMAL);
+
+    // Recover optimized data
+    //Keyframes
+    const bool bOrigin = nLoopKF==pMap->GetOriginKF()->mnId;
+    for(KeyFrameEntryMap::iterator it=mmKeyFrames.begin(); it!=mmKeyFrames.end(); it++)
+    {
+        KeyFrame* pKF = it->first;
+        if(pKF->isBad())
+            continue;
+
+        g2o::SE3Quat SE3quat = it->second.pVertex->estimate();
+        if(bOrigin)
+        {
+            pKF->SetPose(Sophus::SE3f(SE3quat.rotation().cast<float>(), SE3quat.translation().cast<float>()));
+        }
+        else
+        {
+            pKF->mTcwGBA = Sophus::SE3d(SE3quat.rotation(),SE3quat.translation()).cast<float>();
+            pKF->mnBAGlobalForKF = nLoopKF;
+        }
+    }
+
+    //Points
+    for(std::unordered_map<MapPoint*, PointEntry>::iterator it=mmPoints.begin(); it!=mmPoints.end(); it++)
+    {
+        MapPoint* pMP = it->first;
+        if(pMP->isBad() || it->second.vEdges.empty())
+            continue;
+
+        if(bOrigin)
+        {
+            pMP->SetWorldPos(it->second.pVertex->estimate().cast<float>());
+            pMP->UpdateNormalAndDepth();
+        }
+        else
+        {
+            pMP->mPosGBA = it->second.pVertex->estimate().cast<float>();
+            pMP->mnBAGlobalForKF = nLoopKF;
+        }
+    }
+
+    // The result is in the map, the graph of the whole map is not kept in memory until the next run
+    ClearGraph();
+
+    return true;
+}
+
+} //namespace ORB_SLAM3
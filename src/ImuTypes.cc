@@ -165,75 +165,180 @@ void Preintegrated::Initialize(const Bias &b_)
     mvMeasurements.clear();
 }
 
+// Covariance of (dR,dV,dP) multiplied by the transition A = [Rt 0 0; Av I 0; Ap dt*I I] on both sides (A*C*A^T).
+// Only the non-trivial 3x3 blocks of A are used.
+static void TransformCovariance(Eigen::Matrix<float,15,15> &C, const Eigen::Matrix3f &Rt, const Eigen::Matrix3f &Av,
+                                const Eigen::Matrix3f &Ap, const float dt)
+{
+    // T = A*C by block rows
+    Eigen::Matrix<float,9,9> T;
+    const Eigen::Matrix<float,3,9> CR = C.block<3,9>(0,0);
+    T.block<3,9>(0,0).noalias() = Rt*CR;
+    T.block<3,9>(3,0) = C.block<3,9>(3,0);
+    T.block<3,9>(3,0).noalias() += Av*CR;
+    T.block<3,9>(6,0) = C.block<3,9>(6,0) + dt*C.block<3,9>(3,0);
+    T.block<3,9>(6,0).noalias() += Ap*CR;
+
+    // C = T*A^T by block columns
+    C.block<9,3>(0,0).noalias() = T.block<9,3>(0,0)*Rt.transpose();
+    C.block<9,3>(0,3) = T.block<9,3>(0,3);
+    C.block<9,3>(0,3).noalias() += T.block<9,3>(0,0)*Av.transpose();
+    C.block<9,3>(0,6) = T.block<9,3>(0,6) + dt*T.block<9,3>(0,3);
+    C.block<9,3>(0,6).noalias() += T.block<9,3>(0,0)*Ap.transpose();
+}
+
+static bool SameBias(const Bias &b1, const Bias &b2)
+{
+    return b1.bax==b2.bax && b1.bay==b2.bay && b1.baz==b2.baz && b1.bwx==b2.bwx && b1.bwy==b2.bwy && b1.bwz==b2.bwz;
+}
+
 void Preintegrated::Reintegrate()
 {
     std::unique_lock<std::mutex> lock(mMutex);
-    const std::vector<integrable> aux = mvMeasurements;
+    std::vector<integrable> aux;
+    aux.swap(mvMeasurements);
     Initialize(bu);
-    for(size_t i=0;i<aux.size();i++)
-        IntegrateNewMeasurement(aux[i].a,aux[i].w,aux[i].t);
+    mvMeasurements.swap(aux);
+    for(size_t i=0;i<mvMeasurements.size();i++)
+        IntegrateMeasurement(mvMeasurements[i].a,mvMeasurements[i].w,mvMeasurements[i].t);
+    C.block<6,6>(9,9) += static_cast<float>(mvMeasurements.size())*Eigen::Matrix<float,6,6>(NgaWalk);
 }
 
 void Preintegrated::IntegrateNewMeasurement(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const float &dt)
 {
     mvMeasurements.push_back(integrable(acceleration,angVel,dt));
+    IntegrateMeasurement(acceleration,angVel,dt);
+    C.block<6,6>(9,9) += NgaWalk;
+}
+
+void Preintegrated::IntegrateNewMeasurements(const std::vector<Eigen::Vector3f> &vAcc, const std::vector<Eigen::Vector3f> &vAngVel,
+                                             const std::vector<float> &vDt)
+{
+    const size_t n = vDt.size();
+    mvMeasurements.reserve(mvMeasurements.size()+n);
+    for(size_t i=0; i<n; i++)
+    {
+        mvMeasurements.push_back(integrable(vAcc[i],vAngVel[i],vDt[i]));
+        IntegrateMeasurement(vAcc[i],vAngVel[i],vDt[i]);
+    }
+
+    // The random walk of the bias is not coupled with the other states
+    C.block<6,6>(9,9) += static_cast<float>(n)*Eigen::Matrix<float,6,6>(NgaWalk);
+}
 
+void Preintegrated::IntegrateMeasurement(const Eigen::Vector3f &acceleration, const Eigen::Vector3f &angVel, const float dt)
+{
     // Position is updated firstly, as it depends on previously computed velocity and rotation.
     // Velocity is updated secondly, as it depends on previously computed rotation.
     // Rotation is the last to be updated.
 
-    //Matrices to compute covariance
-    Eigen::Matrix<float,9,9> A;
-    A.setIdentity();
-    Eigen::Matrix<float,9,6> B;
-    B.setZero();
-
     Eigen::Vector3f acc, accW;
     acc << acceleration(0)-b.bax, acceleration(1)-b.bay, acceleration(2)-b.baz;
     accW << angVel(0)-b.bwx, angVel(1)-b.bwy, angVel(2)-b.bwz;
 
-    avgA = (dT*avgA + dR*acc*dt)/(dT+dt);
+    const Eigen::Vector3f dRacc = dR*acc;
+
+    avgA = (dT*avgA + dRacc*dt)/(dT+dt);
     avgW = (dT*avgW + accW*dt)/(dT+dt);
 
     // Update delta position dP and velocity dV (rely on no-updated delta rotation)
-    dP = dP + dV*dt + 0.5f*dR*acc*dt*dt;
-    dV = dV + dR*acc*dt;
-
-    // Compute velocity and position parts of matrices A and B (rely on non-updated delta rotation)
-    Eigen::Matrix<float,3,3> Wacc = Sophus::SO3f::hat(acc);
-
-    A.block<3,3>(3,0) = -dR*dt*Wacc;
-    A.block<3,3>(6,0) = -0.5f*dR*dt*dt*Wacc;
-    A.block<3,3>(6,3) = Eigen::DiagonalMatrix<float,3>(dt, dt, dt);
-    B.block<3,3>(3,3) = dR*dt;
-    B.block<3,3>(6,3) = 0.5f*dR*dt*dt;
+    dP = dP + dV*dt + 0.5f*dRacc*dt*dt;
+    dV = dV + dRacc*dt;
 
+    // Velocity and position blocks of the transition A and the noise matrix B (rely on non-updated delta rotation)
+    const Eigen::Matrix3f dRWacc = dR*Sophus::SO3f::hat(acc);
+    const Eigen::Matrix3f Av = -dt*dRWacc;
+    const Eigen::Matrix3f Ap = -0.5f*dt*dt*dRWacc;
+    const Eigen::Matrix3f Ba = dR*dt;
 
     // Update position and velocity jacobians wrt bias correction
-    JPa = JPa + JVa*dt -0.5f*dR*dt*dt;
-    JPg = JPg + JVg*dt -0.5f*dR*dt*dt*Wacc*JRg;
-    JVa = JVa - dR*dt;
-    JVg = JVg - dR*dt*Wacc*JRg;
+    JPa = JPa + JVa*dt -0.5f*dt*Ba;
+    JPg = JPg + JVg*dt + Ap*JRg;
+    JVa = JVa - Ba;
+    JVg = JVg + Av*JRg;
 
     // Update delta rotation
     IntegratedRotation dRi(angVel,b,dt);
+    const Eigen::Matrix3f Rt = dRi.deltaR.transpose();
+    const Eigen::Matrix3f Bg = dRi.rightJ*dt;
     dR = NormalizeRotation(dR*dRi.deltaR);
 
-    // Compute rotation parts of matrices A and B
-    A.block<3,3>(0,0) = dRi.deltaR.transpose();
-    B.block<3,3>(0,0) = dRi.rightJ*dt;
-
-    // Update covariance
-    C.block<9,9>(0,0) = A * C.block<9,9>(0,0) * A.transpose() + B*Nga*B.transpose();
-    C.block<6,6>(9,9) += NgaWalk;
+    // Update covariance, C = A*C*A^T + B*Nga*B^T with B = [Bg 0; 0 Ba; 0 0.5*dt*Ba]
+    TransformCovariance(C,Rt,Av,Ap,dt);
+    const Eigen::Matrix3f BgN = Bg*Nga.diagonal().head<3>().asDiagonal();
+    const Eigen::Matrix3f BaN = Ba*Nga.diagonal().tail<3>().asDiagonal();
+    const Eigen::Matrix3f Qa = BaN*Ba.transpose();
+    C.block<3,3>(0,0).noalias() += BgN*Bg.transpose();
+    C.block<3,3>(3,3) += Qa;
+    C.block<3,3>(3,6) += 0.5f*dt*Qa;
+    C.block<3,3>(6,3) += 0.5f*dt*Qa;
+    C.block<3,3>(6,6) += 0.25f*dt*dt*Qa;
 
     // Update rotation jacobian wrt bias correction
-    JRg = dRi.deltaR.transpose()*JRg - dRi.rightJ*dt;
+    JRg = Rt*JRg - Bg;
 
     // Total integrated time
     dT += dt;
 }
 
+void Preintegrated::Compose(Preintegrated* pNext)
+{
+    const Eigen::Matrix3f R1 = dR;
+    const Eigen::Matrix3f Rt2 = pNext->dR.transpose();
+    const float dT2 = pNext->dT;
+
+    const Eigen::Matrix3f Av = -R1*Sophus::SO3f::hat(pNext->dV);
+    const Eigen::Matrix3f Ap = -R1*Sophus::SO3f::hat(pNext->dP);
+
+    avgA = (dT*avgA + dT2*R1*pNext->avgA)/(dT+dT2);
+    avgW = (dT*avgW + dT2*pNext->avgW)/(dT+dT2);
+
+    dP = dP + dV*dT2 + R1*pNext->dP;
+    dV = dV + R1*pNext->dV;
+    dR = NormalizeRotation(R1*pNext->dR);
+
+    JPa = JPa + JVa*dT2 + R1*pNext->JPa;
+    JPg = JPg + JVg*dT2 + Ap*JRg + R1*pNext->JPg;
+    JVa = JVa + R1*pNext->JVa;
+    JVg = JVg + Av*JRg + R1*pNext->JVg;
+    JRg = Rt2*JRg + pNext->JRg;
+
+    // The covariance of the second part is expressed in its first frame, rotated with R1
+    TransformCovariance(C,Rt2,Av,Ap,dT2);
+    Eigen::Matrix<float,9,9> M = Eigen::Matrix<float,9,9>::Identity();
+    M.block<3,3>(3,3) = R1;
+    M.block<3,3>(6,6) = R1;
+    C.block<9,9>(0,0) += M*pNext->C.block<9,9>(0,0)*M.transpose();
+    C.block<6,6>(9,9) += pNext->C.block<6,6>(9,9);
+
+    dT += dT2;
+    mvMeasurements.insert(mvMeasurements.end(),pNext->mvMeasurements.begin(),pNext->mvMeasurements.end());
+}
+
+void Preintegrated::Append(Preintegrated* pNext)
+{
+    if (pNext==this)
+        return;
+
+    std::unique_lock<std::mutex> lock1(mMutex);
+    std::unique_lock<std::mutex> lock2(pNext->mMutex);
+
+    if(SameBias(pNext->b,b))
+    {
+        Compose(pNext);
+        return;
+    }
+
+    const std::vector<integrable> &aux = pNext->mvMeasurements;
+    mvMeasurements.reserve(mvMeasurements.size()+aux.size());
+    for(size_t i=0;i<aux.size();i++)
+    {
+        mvMeasurements.push_back(aux[i]);
+        IntegrateMeasurement(aux[i].a,aux[i].w,aux[i].t);
+    }
+    C.block<6,6>(9,9) += static_cast<float>(aux.size())*Eigen::Matrix<float,6,6>(NgaWalk);
+}
+
 void Preintegrated::MergePrevious(Preintegrated* pPrev)
 {
     if (pPrev==this)
@@ -249,15 +354,29 @@ void Preintegrated::MergePrevious(Preintegrated* pPrev)
     bav.bay = bu.bay;
     bav.baz = bu.baz;
 
-    const std::vector<integrable > aux1 = pPrev->mvMeasurements;
-    const std::vector<integrable> aux2 = mvMeasurements;
+    // Both parts integrated with the updated bias, they are composed without integrating again
+    if(SameBias(pPrev->b,bav) && SameBias(b,bav))
+    {
+        Preintegrated next(this);
+        CopyFrom(pPrev);
+        Compose(&next);
+        b = bav;
+        bu = bav;
+        db.setZero();
+        return;
+    }
 
-    Initialize(bav);
-    for(size_t i=0;i<aux1.size();i++)
-        IntegrateNewMeasurement(aux1[i].a,aux1[i].w,aux1[i].t);
-    for(size_t i=0;i<aux2.size();i++)
-        IntegrateNewMeasurement(aux2[i].a,aux2[i].w,aux2[i].t);
+    std::vector<integrable> aux2;
+    aux2.swap(mvMeasurements);
+    const std::vector<integrable> &aux1 = pPrev->mvMeasurements;
 
+    Initialize(bav);
+    mvMeasurements.reserve(aux1.size()+aux2.size());
+    mvMeasurements.insert(mvMeasurements.end(),aux1.begin(),aux1.end());
+    mvMeasurements.insert(mvMeasurements.end(),aux2.begin(),aux2.end());
+    for(size_t i=0;i<mvMeasurements.size();i++)
+        IntegrateMeasurement(mvMeasurements[i].a,mvMeasurements[i].w,mvMeasurements[i].t);
+    C.block<6,6>(9,9) += static_cast<float>(mvMeasurements.size())*Eigen::Matrix<float,6,6>(NgaWalk);
 }
 
 void Preintegrated::SetNewBias(const Bias &bu_)
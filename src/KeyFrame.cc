@@ -25,7 +25,10 @@
 namespace ORB_SLAM3
 {
 
-long unsigned int KeyFrame::nNextId=0;
+std::atomic<long unsigned int> KeyFrame::nNextId(0);
+LockStats KeyFrame::mStatsMutexPose("KeyFrame::mMutexPose");
+LockStats KeyFrame::mStatsMutexConnections("KeyFrame::mMutexConnections");
+LockStats KeyFrame::mStatsMutexFeatures("KeyFrame::mMutexFeatures");
 
 KeyFrame::KeyFrame():
         mnFrameId(0),  mTimeStamp(0), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
@@ -37,10 +40,11 @@ KeyFrame::KeyFrame():
         mvuRight(static_cast<vector<float> >(NULL)), mvDepth(static_cast<vector<float> >(NULL)), mnScaleLevels(0), mfScaleFactor(0),
         mfLogScaleFactor(0), mvScaleFactors(0), mvLevelSigma2(0), mvInvLevelSigma2(0), mnMinX(0), mnMinY(0), mnMaxX(0),
         mnMaxY(0), mPrevKF(static_cast<KeyFrame*>(NULL)), mNextKF(static_cast<KeyFrame*>(NULL)), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
-        mbToBeErased(false), mbBad(false), mHalfBaseline(0), mbCurrentPlaceRecognition(false), mnMergeCorrectedForKF(0),
-        NLeft(0),NRight(0), mnNumberOfOpt(0), mbHasVelocity(false)
+        mbToBeErased(false), mbBad(false), mHalfBaseline(0), mpMap(static_cast<Map*>(NULL)), mbCurrentPlaceRecognition(false), mnMergeCorrectedForKF(0),
+        NLeft(0),NRight(0), mnNumberOfOpt(0), mbHasVelocity(false),
+    mMutexPose(&mStatsMutexPose), mMutexConnections(&mStatsMutexConnections), mMutexFeatures(&mStatsMutexFeatures)
 {
-
+    mnChangeEpoch.store(0, std::memory_order_relaxed);
 }
 
 KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
@@ -60,9 +64,11 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap), mbCurrentPlaceRecognition(false), mNameFile(F.mNameFile), mnMergeCorrectedForKF(0),
     mpCamera(F.mpCamera), mpCamera2(F.mpCamera2),
     mvLeftToRightMatch(F.mvLeftToRightMatch),mvRightToLeftMatch(F.mvRightToLeftMatch), mTlr(F.GetRelativePoseTlr()),
-    mvKeysRight(F.mvKeysRight), NLeft(F.Nleft), NRight(F.Nright), mTrl(F.GetRelativePoseTrl()), mnNumberOfOpt(0), mbHasVelocity(false)
+    mvKeysRight(F.mvKeysRight), NLeft(F.Nleft), NRight(F.Nright), mTrl(F.GetRelativePoseTrl()), mnNumberOfOpt(0), mbHasVelocity(false),
+    mMutexPose(&mStatsMutexPose), mMutexConnections(&mStatsMutexConnections), mMutexFeatures(&mStatsMutexFeatures)
 {
     mnId=nNextId++;
+    MarkChanged();
 
     mGrid.resize(mnGridCols);
     if(F.Nleft != -1)  mGridRight.resize(mnGridCols);
@@ -113,7 +119,8 @@ void KeyFrame::ComputeBoW()
 
 void KeyFrame::SetPose(const Sophus::SE3f &Tcw)
 {
-    unique_lock<mutex> lock(mMutexPose);
+    MarkChanged();
+    unique_lock<SharedMutex> lock(mMutexPose);
 
     mTcw = Tcw;
     mRcw = mTcw.rotationMatrix();
@@ -128,73 +135,74 @@ void KeyFrame::SetPose(const Sophus::SE3f &Tcw)
 
 void KeyFrame::SetVelocity(const Eigen::Vector3f &Vw)
 {
-    unique_lock<mutex> lock(mMutexPose);
+    MarkChanged();
+    unique_lock<SharedMutex> lock(mMutexPose);
     mVw = Vw;
     mbHasVelocity = true;
 }
 
 Sophus::SE3f KeyFrame::GetPose()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mTcw;
 }
 
 Sophus::SE3f KeyFrame::GetPoseInverse()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mTwc;
 }
 
 Eigen::Vector3f KeyFrame::GetCameraCenter(){
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mTwc.translation();
 }
 
 Eigen::Vector3f KeyFrame::GetImuPosition()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mOwb;
 }
 
 Eigen::Matrix3f KeyFrame::GetImuRotation()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return (mTwc * mImuCalib.mTcb).rotationMatrix();
 }
 
 Sophus::SE3f KeyFrame::GetImuPose()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mTwc * mImuCalib.mTcb;
 }
 
 Eigen::Matrix3f KeyFrame::GetRotation(){
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mRcw;
 }
 
 Eigen::Vector3f KeyFrame::GetTranslation()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mTcw.translation();
 }
 
 Eigen::Vector3f KeyFrame::GetVelocity()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mVw;
 }
 
 bool KeyFrame::isVelocitySet()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mbHasVelocity;
 }
 
 void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
 {
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<SharedMutex> lock(mMutexConnections);
         if(!mConnectedKeyFrameWeights.count(pKF))
             mConnectedKeyFrameWeights[pKF]=weight;
         else if(mConnectedKeyFrameWeights[pKF]!=weight)
@@ -208,10 +216,11 @@ void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
 
 void KeyFrame::UpdateBestCovisibles()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    MarkChanged();
+    unique_lock<SharedMutex> lock(mMutexConnections);
     vector<pair<int,KeyFrame*> > vPairs;
     vPairs.reserve(mConnectedKeyFrameWeights.size());
-    for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
+    for(ConnectionMap::iterator mit=mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
        vPairs.push_back(make_pair(mit->second,mit->first));
 
     sort(vPairs.begin(),vPairs.end());
@@ -232,22 +241,22 @@ void KeyFrame::UpdateBestCovisibles()
 
 set<KeyFrame*> KeyFrame::GetConnectedKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    shared_lock<SharedMutex> lock(mMutexConnections);
     set<KeyFrame*> s;
-    for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin();mit!=mConnectedKeyFrameWeights.end();mit++)
+    for(ConnectionMap::iterator mit=mConnectedKeyFrameWeights.begin();mit!=mConnectedKeyFrameWeights.end();mit++)
         s.insert(mit->first);
     return s;
 }
 
 vector<KeyFrame*> KeyFrame::GetVectorCovisibleKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    shared_lock<SharedMutex> lock(mMutexConnections);
     return mvpOrderedConnectedKeyFrames;
 }
 
 vector<KeyFrame*> KeyFrame::GetBestCovisibilityKeyFrames(const int &N)
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    shared_lock<SharedMutex> lock(mMutexConnections);
     if((int)mvpOrderedConnectedKeyFrames.size()<N)
         return mvpOrderedConnectedKeyFrames;
     else
@@ -257,7 +266,7 @@ vector<KeyFrame*> KeyFrame::GetBestCovisibilityKeyFrames(const int &N)
 
 vector<KeyFrame*> KeyFrame::GetCovisiblesByWeight(const int &w)
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    shared_lock<SharedMutex> lock(mMutexConnections);
 
     if(mvpOrderedConnectedKeyFrames.empty())
     {
@@ -279,16 +288,17 @@ vector<KeyFrame*> KeyFrame::GetCovisiblesByWeight(const int &w)
 
 int KeyFrame::GetWeight(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexConnections);
-    if(mConnectedKeyFrameWeights.count(pKF))
-        return mConnectedKeyFrameWeights[pKF];
+    shared_lock<SharedMutex> lock(mMutexConnections);
+    ConnectionMap::const_iterator it = mConnectedKeyFrameWeights.find(pKF);
+    if(it != mConnectedKeyFrameWeights.end())
+        return it->second;
     else
         return 0;
 }
 
 int KeyFrame::GetNumberMPs()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     int numberMPs = 0;
     for(size_t i=0, iend=mvpMapPoints.size(); i<iend; i++)
     {
@@ -301,18 +311,21 @@ int KeyFrame::GetNumberMPs()
 
 void KeyFrame::AddMapPoint(MapPoint *pMP, const size_t &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    MarkChanged();
+    unique_lock<SharedMutex> lock(mMutexFeatures);
     mvpMapPoints[idx]=pMP;
 }
 
 void KeyFrame::EraseMapPointMatch(const int &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    MarkChanged();
+    unique_lock<SharedMutex> lock(mMutexFeatures);
     mvpMapPoints[idx]=static_cast<MapPoint*>(NULL);
 }
 
 void KeyFrame::EraseMapPointMatch(MapPoint* pMP)
 {
+    MarkChanged();
     tuple<size_t,size_t> indexes = pMP->GetIndexInKeyFrame(this);
     size_t leftIndex = get<0>(indexes), rightIndex = get<1>(indexes);
     if(leftIndex != -1)
@@ -324,12 +337,13 @@ void KeyFrame::EraseMapPointMatch(MapPoint* pMP)
 
 void KeyFrame::ReplaceMapPointMatch(const int &idx, MapPoint* pMP)
 {
+    MarkChanged();
     mvpMapPoints[idx]=pMP;
 }
 
 set<MapPoint*> KeyFrame::GetMapPoints()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     set<MapPoint*> s;
     for(size_t i=0, iend=mvpMapPoints.size(); i<iend; i++)
     {
@@ -344,7 +358,7 @@ set<MapPoint*> KeyFrame::GetMapPoints()
 
 int KeyFrame::TrackedMapPoints(const int &minObs)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
 
     int nPoints=0;
     const bool bCheckObs = minObs>0;
@@ -371,24 +385,25 @@ int KeyFrame::TrackedMapPoints(const int &minObs)
 
 vector<MapPoint*> KeyFrame::GetMapPointMatches()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return mvpMapPoints;
 }
 
 MapPoint* KeyFrame::GetMapPoint(const size_t &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return mvpMapPoints[idx];
 }
 
 void KeyFrame::UpdateConnections(bool upParent)
 {
-    map<KeyFrame*,int> KFcounter;
+    MarkChanged();
+    ConnectionMap KFcounter;
 
     vector<MapPoint*> vpMP;
 
     {
-        unique_lock<mutex> lockMPs(mMutexFeatures);
+        unique_lock<SharedMutex> lockMPs(mMutexFeatures);
         vpMP = mvpMapPoints;
     }
 
@@ -404,9 +419,9 @@ void KeyFrame::UpdateConnections(bool upParent)
         if(pMP->isBad())
             continue;
 
-        map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
+        const MapPoint::ObservationMap observations = pMP->GetObservations();
 
-        for(map<KeyFrame*,tuple<int,int>>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             if(mit->first->mnId==mnId || mit->first->isBad() || mit->first->GetMap() != mpMap)
                 continue;
@@ -429,7 +444,7 @@ void KeyFrame::UpdateConnections(bool upParent)
     vPairs.reserve(KFcounter.size());
     if(!upParent)
         cout << "UPDATE_CONN: current KF " << mnId << endl;
-    for(map<KeyFrame*,int>::iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
+    for(ConnectionMap::iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
     {
         if(!upParent)
             cout << "  UPDATE_CONN: KF " << mit->first->mnId << " ; num matches: " << mit->second << endl;
@@ -461,7 +476,7 @@ void KeyFrame::UpdateConnections(bool upParent)
     }
 
     {
-        unique_lock<mutex> lockCon(mMutexConnections);
+        unique_lock<SharedMutex> lockCon(mMutexConnections);
 
         mConnectedKeyFrameWeights = KFcounter;
         mvpOrderedConnectedKeyFrames = vector<KeyFrame*>(lKFs.begin(),lKFs.end());
@@ -480,19 +495,22 @@ void KeyFrame::UpdateConnections(bool upParent)
 
 void KeyFrame::AddChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    MarkChanged();
+    unique_lock<SharedMutex> lockCon(mMutexConnections);
     mspChildrens.insert(pKF);
 }
 
 void KeyFrame::EraseChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    MarkChanged();
+    unique_lock<SharedMutex> lockCon(mMutexConnections);
     mspChildrens.erase(pKF);
 }
 
 void KeyFrame::ChangeParent(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    MarkChanged();
+    unique_lock<SharedMutex> lockCon(mMutexConnections);
     if(pKF == this)
     {
         cout << "ERROR: Change parent KF, the parent and child are the same KF" << endl;
@@ -503,66 +521,68 @@ void KeyFrame::ChangeParent(KeyFrame *pKF)
     pKF->AddChild(this);
 }
 
-set<KeyFrame*> KeyFrame::GetChilds()
+KeyFrame::EdgeSet KeyFrame::GetChilds()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    shared_lock<SharedMutex> lockCon(mMutexConnections);
     return mspChildrens;
 }
 
 KeyFrame* KeyFrame::GetParent()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    shared_lock<SharedMutex> lockCon(mMutexConnections);
     return mpParent;
 }
 
 bool KeyFrame::hasChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    shared_lock<SharedMutex> lockCon(mMutexConnections);
     return mspChildrens.count(pKF);
 }
 
 void KeyFrame::SetFirstConnection(bool bFirst)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<SharedMutex> lockCon(mMutexConnections);
     mbFirstConnection=bFirst;
 }
 
 void KeyFrame::AddLoopEdge(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    MarkChanged();
+    unique_lock<SharedMutex> lockCon(mMutexConnections);
     mbNotErase = true;
     mspLoopEdges.insert(pKF);
 }
 
-set<KeyFrame*> KeyFrame::GetLoopEdges()
+KeyFrame::EdgeSet KeyFrame::GetLoopEdges()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    shared_lock<SharedMutex> lockCon(mMutexConnections);
     return mspLoopEdges;
 }
 
 void KeyFrame::AddMergeEdge(KeyFrame* pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    MarkChanged();
+    unique_lock<SharedMutex> lockCon(mMutexConnections);
     mbNotErase = true;
     mspMergeEdges.insert(pKF);
 }
 
-set<KeyFrame*> KeyFrame::GetMergeEdges()
+KeyFrame::EdgeSet KeyFrame::GetMergeEdges()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    shared_lock<SharedMutex> lockCon(mMutexConnections);
     return mspMergeEdges;
 }
 
 void KeyFrame::SetNotErase()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<SharedMutex> lock(mMutexConnections);
     mbNotErase = true;
 }
 
 void KeyFrame::SetErase()
 {
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<SharedMutex> lock(mMutexConnections);
         if(mspLoopEdges.empty())
         {
             mbNotErase = false;
@@ -577,8 +597,9 @@ void KeyFrame::SetErase()
 
 void KeyFrame::SetBadFlag()
 {
+    MarkChanged();
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<SharedMutex> lock(mMutexConnections);
         if(mnId==mpMap->GetInitKFid())
         {
             return;
@@ -590,7 +611,7 @@ void KeyFrame::SetBadFlag()
         }
     }
 
-    for(map<KeyFrame*,int>::iterator mit = mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
+    for(ConnectionMap::iterator mit = mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
     {
         mit->first->EraseConnection(this);
     }
@@ -604,8 +625,8 @@ void KeyFrame::SetBadFlag()
     }
 
     {
-        unique_lock<mutex> lock(mMutexConnections);
-        unique_lock<mutex> lock1(mMutexFeatures);
+        unique_lock<SharedMutex> lock(mMutexConnections);
+        unique_lock<SharedMutex> lock1(mMutexFeatures);
 
         mConnectedKeyFrameWeights.clear();
         mvpOrderedConnectedKeyFrames.clear();
@@ -625,7 +646,7 @@ void KeyFrame::SetBadFlag()
             KeyFrame* pC;
             KeyFrame* pP;
 
-            for(set<KeyFrame*>::iterator sit=mspChildrens.begin(), send=mspChildrens.end(); sit!=send; sit++)
+            for(EdgeSet::const_iterator sit=mspChildrens.begin(), send=mspChildrens.end(); sit!=send; sit++)
             {
                 KeyFrame* pKF = *sit;
                 if(pKF->isBad())
@@ -665,7 +686,7 @@ void KeyFrame::SetBadFlag()
         // If a children has no covisibility links with any parent candidate, assign to the original parent of this KF
         if(!mspChildrens.empty())
         {
-            for(set<KeyFrame*>::iterator sit=mspChildrens.begin(); sit!=mspChildrens.end(); sit++)
+            for(EdgeSet::const_iterator sit=mspChildrens.begin(); sit!=mspChildrens.end(); sit++)
             {
                 (*sit)->ChangeParent(mpParent);
             }
@@ -685,7 +706,7 @@ void KeyFrame::SetBadFlag()
 
 bool KeyFrame::isBad()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    shared_lock<SharedMutex> lock(mMutexConnections);
     return mbBad;
 }
 
@@ -693,7 +714,7 @@ void KeyFrame::EraseConnection(KeyFrame* pKF)
 {
     bool bUpdate = false;
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<SharedMutex> lock(mMutexConnections);
         if(mConnectedKeyFrameWeights.count(pKF))
         {
             mConnectedKeyFrameWeights.erase(pKF);
@@ -768,7 +789,7 @@ bool KeyFrame::UnprojectStereo(int i, Eigen::Vector3f &x3D)
         const float y = (v-cy)*z*invfy;
         Eigen::Vector3f x3Dc(x, y, z);
 
-        unique_lock<mutex> lock(mMutexPose);
+        shared_lock<SharedMutex> lock(mMutexPose);
         x3D = mRwc * x3Dc + mTwc.translation();
         return true;
     }
@@ -785,8 +806,8 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
     Eigen::Matrix3f Rcw;
     Eigen::Vector3f tcw;
     {
-        unique_lock<mutex> lock(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPose);
+        shared_lock<SharedMutex> lock(mMutexFeatures);
+        shared_lock<SharedMutex> lock2(mMutexPose);
         vpMapPoints = mvpMapPoints;
         tcw = mTcw.translation();
         Rcw = mRcw;
@@ -813,7 +834,8 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
 
 void KeyFrame::SetNewBias(const IMU::Bias &b)
 {
-    unique_lock<mutex> lock(mMutexPose);
+    MarkChanged();
+    unique_lock<SharedMutex> lock(mMutexPose);
     mImuBias = b;
     if(mpImuPreintegrated)
         mpImuPreintegrated->SetNewBias(b);
@@ -821,19 +843,19 @@ void KeyFrame::SetNewBias(const IMU::Bias &b)
 
 Eigen::Vector3f KeyFrame::GetGyroBias()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return Eigen::Vector3f(mImuBias.bwx, mImuBias.bwy, mImuBias.bwz);
 }
 
 Eigen::Vector3f KeyFrame::GetAccBias()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return Eigen::Vector3f(mImuBias.bax, mImuBias.bay, mImuBias.baz);
 }
 
 IMU::Bias KeyFrame::GetImuBias()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mImuBias;
 }
 
@@ -845,12 +867,20 @@ Map* KeyFrame::GetMap()
 
 void KeyFrame::UpdateMap(Map* pMap)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mpMap = pMap;
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        mpMap = pMap;
+    }
+    // With the epoch of the new map
+    MarkChanged();
 }
 
 void KeyFrame::PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP, set<GeometricCamera*>& spCam)
 {
+    // Exclusive, the checkpoints fill the backup members while the other threads read the keyframe
+    unique_lock<SharedMutex> lockCon(mMutexConnections);
+    unique_lock<SharedMutex> lockFeat(mMutexFeatures);
+
     // Save the id of each MapPoint in this KF, there can be null pointer in the vector
     mvBackupMapPointsId.clear();
     mvBackupMapPointsId.reserve(N);
@@ -864,7 +894,7 @@ void KeyFrame::PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP, set<GeometricC
     }
     // Save the id of each connected KF with it weight
     mBackupConnectedKeyFrameIdWeights.clear();
-    for(std::map<KeyFrame*,int>::const_iterator it = mConnectedKeyFrameWeights.begin(), end = mConnectedKeyFrameWeights.end(); it != end; ++it)
+    for(ConnectionMap::const_iterator it = mConnectedKeyFrameWeights.begin(), end = mConnectedKeyFrameWeights.end(); it != end; ++it)
     {
         if(spKF.find(it->first) != spKF.end())
             mBackupConnectedKeyFrameIdWeights[it->first->mnId] = it->second;
@@ -924,7 +954,14 @@ void KeyFrame::PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP, set<GeometricC
         mBackupImuPreintegrated.CopyFrom(mpImuPreintegrated);
 }
 
-void KeyFrame::PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsigned int, MapPoint*>& mpMPid, map<unsigned int, GeometricCamera*>& mpCamId){
+void KeyFrame::MarkChanged()
+{
+    Map* pMap = GetMap();
+    if(pMap)
+        mnChangeEpoch.store(pMap->GetCheckpointEpoch(), std::memory_order_relaxed);
+}
+
+void KeyFrame::PostLoad(const IdTable<KeyFrame>& KFTable, const IdTable<MapPoint>& MPTable, map<unsigned int, GeometricCamera*>& mpCamId){
     // Rebuild the empty variables
 
     // Pose
@@ -939,7 +976,7 @@ void KeyFrame::PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsi
     for(int i=0; i<N; ++i)
     {
         if(mvBackupMapPointsId[i] != -1)
-            mvpMapPoints[i] = mpMPid[mvBackupMapPointsId[i]];
+            mvpMapPoints[i] = MPTable.Get(mvBackupMapPointsId[i]);
         else
             mvpMapPoints[i] = static_cast<MapPoint*>(NULL);
     }
@@ -949,33 +986,33 @@ void KeyFrame::PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsi
     for(map<long unsigned int, int>::const_iterator it = mBackupConnectedKeyFrameIdWeights.begin(), end = mBackupConnectedKeyFrameIdWeights.end();
         it != end; ++it)
     {
-        KeyFrame* pKFi = mpKFid[it->first];
+        KeyFrame* pKFi = KFTable.Get(it->first);
         mConnectedKeyFrameWeights[pKFi] = it->second;
     }
 
     // Restore parent KeyFrame
     if(mBackupParentId>=0)
-        mpParent = mpKFid[mBackupParentId];
+        mpParent = KFTable.Get(mBackupParentId);
 
     // KeyFrame childrens
     mspChildrens.clear();
     for(vector<long unsigned int>::const_iterator it = mvBackupChildrensId.begin(), end = mvBackupChildrensId.end(); it!=end; ++it)
     {
-        mspChildrens.insert(mpKFid[*it]);
+        mspChildrens.insert(KFTable.Get(*it));
     }
 
     // Loop edge KeyFrame
     mspLoopEdges.clear();
     for(vector<long unsigned int>::const_iterator it = mvBackupLoopEdgesId.begin(), end = mvBackupLoopEdgesId.end(); it != end; ++it)
     {
-        mspLoopEdges.insert(mpKFid[*it]);
+        mspLoopEdges.insert(KFTable.Get(*it));
     }
 
     // Merge edge KeyFrame
     mspMergeEdges.clear();
     for(vector<long unsigned int>::const_iterator it = mvBackupMergeEdgesId.begin(), end = mvBackupMergeEdgesId.end(); it != end; ++it)
     {
-        mspMergeEdges.insert(mpKFid[*it]);
+        mspMergeEdges.insert(KFTable.Get(*it));
     }
 
     //Camera data
@@ -995,11 +1032,11 @@ void KeyFrame::PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsi
     //Inertial data
     if(mBackupPrevKFId != -1)
     {
-        mPrevKF = mpKFid[mBackupPrevKFId];
+        mPrevKF = KFTable.Get(mBackupPrevKFId);
     }
     if(mBackupNextKFId != -1)
     {
-        mNextKF = mpKFid[mBackupNextKFId];
+        mNextKF = KFTable.Get(mBackupNextKFId);
     }
     mpImuPreintegrated = &mBackupImuPreintegrated;
 
@@ -1112,42 +1149,42 @@ bool KeyFrame::ProjectPointUnDistort(MapPoint* pMP, cv::Point2f &kp, float &u, f
 
 Sophus::SE3f KeyFrame::GetRelativePoseTrl()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mTrl;
 }
 
 Sophus::SE3f KeyFrame::GetRelativePoseTlr()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return mTlr;
 }
 
 Sophus::SE3<float> KeyFrame::GetRightPose() {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
 
     return mTrl * mTcw;
 }
 
 Sophus::SE3<float> KeyFrame::GetRightPoseInverse() {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
 
     return mTwc * mTlr;
 }
 
 Eigen::Vector3f KeyFrame::GetRightCameraCenter() {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
 
     return (mTwc * mTlr).translation();
 }
 
 Eigen::Matrix<float,3,3> KeyFrame::GetRightRotation() {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
 
     return (mTrl.so3() * mTcw.so3()).matrix();
 }
 
 Eigen::Vector3f KeyFrame::GetRightTranslation() {
-    unique_lock<mutex> lock(mMutexPose);
+    shared_lock<SharedMutex> lock(mMutexPose);
     return (mTrl * mTcw).translation();
 }
 
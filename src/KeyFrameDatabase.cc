@@ -19,13 +19,17 @@
 #include "Defs.h"
 #include "KeyFrameDatabase.h"
 #include "KeyFrame.h"
+#include "IdTable.h"
 #ifdef USE_DBOW2
     #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 #else
     #include "Thirdparty/DBow3/src/BowVector.h"
 #endif
 
+#include<algorithm>
+#include<iostream>
 #include<mutex>
+#include<unordered_map>
 
 using namespace std;
 
@@ -760,41 +764,44 @@ void KeyFrameDatabase::DetectNBestCandidates(KeyFrame *pKF, vector<KeyFrame*> &v
 
 vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map* pMap)
 {
-    list<KeyFrame*> lKFsSharingWords;
+    return DetectRelocalizationCandidates(F->mBowVec, pMap);
+}
+
+vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(const BowVector &vBowVec, Map* pMap)
+{
+    // Words shared with each keyframe and its score, -1 if it was not scored
+    vector<KeyFrame*> vpKFsSharingWords;
+    unordered_map<KeyFrame*, pair<int,float> > mRelocWords;
 
     // Search all keyframes that share a word with current frame
     {
         unique_lock<mutex> lock(mMutex);
-#ifdef USE_DBOW2
-        for(DBoW2::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++)
-#else
-        for(DBoW3::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++)
-#endif
+        for(BowVector::const_iterator vit=vBowVec.begin(), vend=vBowVec.end(); vit != vend; vit++)
         {
             list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
 
             for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
             {
                 KeyFrame* pKFi=*lit;
-                if(pKFi->mnRelocQuery!=F->mnId)
+                pair<int,float> &words = mRelocWords[pKFi];
+                if(words.first==0)
                 {
-                    pKFi->mnRelocWords=0;
-                    pKFi->mnRelocQuery=F->mnId;
-                    lKFsSharingWords.push_back(pKFi);
+                    words.second = -1.f;
+                    vpKFsSharingWords.push_back(pKFi);
                 }
-                pKFi->mnRelocWords++;
+                words.first++;
             }
         }
     }
-    if(lKFsSharingWords.empty())
+    if(vpKFsSharingWords.empty())
         return vector<KeyFrame*>();
 
     // Only compare against those keyframes that share enough words
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(KeyFrame* pKFi : vpKFsSharingWords)
     {
-        if((*lit)->mnRelocWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnRelocWords;
+        if(mRelocWords[pKFi].first>maxCommonWords)
+            maxCommonWords=mRelocWords[pKFi].first;
     }
 
     int minCommonWords = maxCommonWords*0.8f;
@@ -804,15 +811,14 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map
     int nscores=0;
 
     // Compute similarity score.
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(KeyFrame* pKFi : vpKFsSharingWords)
     {
-        KeyFrame* pKFi = *lit;
-
-        if(pKFi->mnRelocWords>minCommonWords)
+        pair<int,float> &words = mRelocWords[pKFi];
+        if(words.first>minCommonWords)
         {
             nscores++;
-            float si = mpVoc->score(F->mBowVec,pKFi->mBowVec);
-            pKFi->mRelocScore=si;
+            float si = mpVoc->score(vBowVec,pKFi->mBowVec);
+            words.second=si;
             lScoreAndMatch.push_back(make_pair(si,pKFi));
         }
     }
@@ -835,14 +841,15 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
             KeyFrame* pKF2 = *vit;
-            if(pKF2->mnRelocQuery!=F->mnId)
+            unordered_map<KeyFrame*, pair<int,float> >::const_iterator itWords = mRelocWords.find(pKF2);
+            if(itWords == mRelocWords.end() || itWords->second.second < 0.f)
                 continue;
 
-            accScore+=pKF2->mRelocScore;
-            if(pKF2->mRelocScore>bestScore)
+            accScore+=itWords->second.second;
+            if(itWords->second.second>bestScore)
             {
                 pBestKF=pKF2;
-                bestScore = pKF2->mRelocScore;
+                bestScore = itWords->second.second;
             }
 
         }
@@ -862,7 +869,7 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map
         if(si>minScoreToRetain)
         {
             KeyFrame* pKFi = it->second;
-            if (pKFi->GetMap() != pMap)
+            if (pMap && pKFi->GetMap() != pMap)
                 continue;
             if(!spAlreadyAddedKF.count(pKFi))
             {
@@ -875,6 +882,156 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map
     return vpRelocCandidates;
 }
 
+static void PutVarint(string &strData, unsigned long value)
+{
+    while(value >= 0x80)
+    {
+        strData.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    strData.push_back(static_cast<char>(value));
+}
+
+// Returns false at the end of the data or with a malformed value
+static bool GetVarint(const unsigned char* &pData, const unsigned char* pEnd, unsigned long &value)
+{
+    value = 0;
+    for(int shift=0; pData<pEnd && shift<64; shift+=7)
+    {
+        const unsigned char byte = *pData++;
+        value |= static_cast<unsigned long>(byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void PutIds(string &strData, vector<unsigned long> &vnIds)
+{
+    sort(vnIds.begin(), vnIds.end());
+    PutVarint(strData, vnIds.size());
+    unsigned long last = 0;
+    for(size_t i=0; i<vnIds.size(); i++)
+    {
+        PutVarint(strData, vnIds[i]-last);
+        last = vnIds[i];
+    }
+}
+
+void KeyFrameDatabase::EncodeInvertedFile(string &strData)
+{
+    unique_lock<mutex> lock(mMutex);
+
+    strData.clear();
+    PutVarint(strData, mvInvertedFile.size());
+
+    set<KeyFrame*> spKFs;
+    size_t nWords = 0;
+    for(size_t i=0; i<mvInvertedFile.size(); i++)
+    {
+        if(mvInvertedFile[i].empty())
+            continue;
+        spKFs.insert(mvInvertedFile[i].begin(), mvInvertedFile[i].end());
+        nWords++;
+    }
+
+    vector<unsigned long> vnIds;
+    vnIds.reserve(spKFs.size());
+    for(KeyFrame* pKFi : spKFs)
+        vnIds.push_back(pKFi->mnId);
+    PutIds(strData, vnIds);
+
+    PutVarint(strData, nWords);
+    size_t lastWord = 0;
+    for(size_t i=0; i<mvInvertedFile.size(); i++)
+    {
+        const list<KeyFrame*> &lKFs = mvInvertedFile[i];
+        if(lKFs.empty())
+            continue;
+
+        PutVarint(strData, i-lastWord);
+        lastWord = i;
+
+        vnIds.clear();
+        for(list<KeyFrame*>::const_iterator lit=lKFs.begin(), lend=lKFs.end(); lit!=lend; lit++)
+            vnIds.push_back((*lit)->mnId);
+        PutIds(strData, vnIds);
+    }
+}
+
+void KeyFrameDatabase::PostLoad(const vector<KeyFrame*> &vpKFs, const string &strInvertedFile)
+{
+    IdTable<KeyFrame> KFTable;
+    KFTable.Build(vpKFs);
+
+    const unsigned char* pData = reinterpret_cast<const unsigned char*>(strInvertedFile.data());
+    const unsigned char* pEnd = pData + strInvertedFile.size();
+
+    // Keyframes of the data, they have their words in it
+    unsigned long nVocSize = 0, nKFs = 0;
+    vector<unsigned long> vnIndexedIds;
+    bool bValid = GetVarint(pData, pEnd, nVocSize) && nVocSize == mpVoc->size() && GetVarint(pData, pEnd, nKFs);
+    if(bValid)
+    {
+        vnIndexedIds.reserve(nKFs);
+        unsigned long id = 0, delta;
+        for(unsigned long i=0; i<nKFs && bValid; i++)
+        {
+            bValid = GetVarint(pData, pEnd, delta);
+            id += delta;
+            vnIndexedIds.push_back(id);
+        }
+    }
+
+    // Word of each entry, they are added at the end so a malformed data does not leave a partial index
+    vector<pair<unsigned long, KeyFrame*> > vEntries;
+    if(bValid)
+    {
+        unsigned long nWords = 0, word = 0, delta, nIds, id;
+        bValid = GetVarint(pData, pEnd, nWords);
+        for(unsigned long i=0; i<nWords && bValid; i++)
+        {
+            bValid = GetVarint(pData, pEnd, delta) && GetVarint(pData, pEnd, nIds);
+            word += delta;
+            if(!bValid || word >= mvInvertedFile.size())
+            {
+                bValid = false;
+                break;
+            }
+
+            id = 0;
+            for(unsigned long j=0; j<nIds && bValid; j++)
+            {
+                bValid = GetVarint(pData, pEnd, delta);
+                id += delta;
+                // Keyframes of maps not loaded are skipped
+                KeyFrame* pKFi = KFTable.Get(id);
+                if(pKFi)
+                    vEntries.push_back(make_pair(word, pKFi));
+            }
+        }
+    }
+
+    if(!bValid)
+    {
+        if(!strInvertedFile.empty())
+            cout << "[W] KeyFrameDatabase: the saved inverted file is not valid for this vocabulary, it is built again" << endl;
+        vnIndexedIds.clear();
+    }
+    else
+    {
+        unique_lock<mutex> lock(mMutex);
+        for(size_t i=0; i<vEntries.size(); i++)
+            mvInvertedFile[vEntries[i].first].push_back(vEntries[i].second);
+    }
+
+    for(KeyFrame* pKFi : vpKFs)
+    {
+        if(!binary_search(vnIndexedIds.begin(), vnIndexedIds.end(), pKFi->mnId))
+            add(pKFi);
+    }
+}
+
 void KeyFrameDatabase::SetORBVocabulary(ORBVocabulary* pORBVoc)
 {
     ORBVocabulary** ptr;
@@ -0,0 +1,475 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LocalBAProblem.h"
+
+#include "KeyFrame.h"
+#include "Map.h"
+#include "Optimizer.h"
+#include "OptimizableTypes.h"
+#include "System.h"
+
+#include <sstream>
+
+namespace ORB_SLAM3
+{
+
+LocalBAProblem::LocalBAProblem(): mpMap(static_cast<Map*>(NULL)), mnWindow(0), mnNextVertexId(0)
+{
+    g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
+
+    // The symbolic decomposition is kept while the pattern of the Schur complement does not change
+    linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+
+    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+
+    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    mOptimizer.setAlgorithm(solver);
+    mOptimizer.setVerbose(false);
+}
+
+LocalBAProblem::~LocalBAProblem()
+{
+    Clear();
+}
+
+void LocalBAProblem::Clear()
+{
+    mOptimizer.clear();
+    mmKeyFrames.clear();
+    mmPoints.clear();
+    mmPointOfVertex.clear();
+    mpMap = static_cast<Map*>(NULL);
+    mnNextVertexId = 0;
+}
+
+void LocalBAProblem::RemovePointEdges(PointEntry &entry)
+{
+    for(size_t i=0; i<entry.vEdges.size(); i++)
+        mOptimizer.removeEdge(entry.vEdges[i].pEdge);
+    entry.vEdges.clear();
+}
+
+void LocalBAProblem::RemoveKeyFrameVertex(KeyFrameEntry &entry)
+{
+    // Every observation of a point in the window comes from a keyframe in the window, so only points
+    // whose observations were not read again (e.g. the keyframe went to another map) get here
+    while(!entry.pVertex->edges().empty())
+    {
+        g2o::HyperGraph::Edge* pEdge = *entry.pVertex->edges().begin();
+        std::unordered_map<int, MapPoint*>::iterator itPoint = mmPointOfVertex.find(pEdge->vertex(0)->id());
+        if(itPoint == mmPointOfVertex.end())
+        {
+            mOptimizer.removeEdge(pEdge);
+            continue;
+        }
+        // Removes also pEdge
+        PointEntry &point = mmPoints[itPoint->second];
+        RemovePointEdges(point);
+        point.bDirty = true;
+    }
+    mOptimizer.removeVertex(entry.pVertex);
+}
+
+void LocalBAProblem::AddPointEdges(MapPoint* pMP, PointEntry &entry, Map* pMap)
+{
+    const float thHuberMono = sqrt(5.991);
+    const float thHuberStereo = sqrt(7.815);
+
+    for(MapPoint::ObservationMap::const_iterator mit=entry.observations.begin(), mend=entry.observations.end(); mit!=mend; mit++)
+    {
+        KeyFrame* pKFi = mit->first;
+        if(pKFi->isBad() || pKFi->GetMap() != pMap)
+            continue;
+
+        std::unordered_map<KeyFrame*, KeyFrameEntry>::iterator itKF = mmKeyFrames.find(pKFi);
+        if(itKF == mmKeyFrames.end())
+            continue;
+        g2o::VertexSE3Expmap* vSE3 = itKF->second.pVertex;
+
+        const int leftIndex = get<0>(mit->second);
+
+        // Monocular observation
+        if(leftIndex != -1 && pKFi->mvuRight[leftIndex]<0)
+        {
+            const cv::KeyPoint &kpUn = pKFi->mvKeysUn[leftIndex];
+            Eigen::Matrix<double,2,1> obs;
+            obs << kpUn.pt.x, kpUn.pt.y;
+
+            ORB_SLAM3::EdgeSE3ProjectXYZ* e = new ORB_SLAM3::EdgeSE3ProjectXYZ();
+
+            e->setVertex(0, entry.pVertex);
+            e->setVertex(1, vSE3);
+            e->setMeasurement(obs);
+            const float &invSigma2 = pKFi->mvInvLevelSigma2[kpUn.octave];
+            e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+            e->setRobustKernel(rk);
+            rk->setDelta(thHuberMono);
+
+            e->pCamera = pKFi->mpCamera;
+
+            mOptimizer.addEdge(e);
+            ObservationEdge edge = {e, pKFi, MONOCULAR};
+            entry.vEdges.push_back(edge);
+        }
+        else if(leftIndex != -1 && pKFi->mvuRight[leftIndex]>=0)// Stereo observation
+        {
+            const cv::KeyPoint &kpUn = pKFi->mvKeysUn[leftIndex];
+            Eigen::Matrix<double,3,1> obs;
+            const float kp_ur = pKFi->mvuRight[leftIndex];
+            obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
+
+            g2o::EdgeStereoSE3ProjectXYZ* e = new g2o::EdgeStereoSE3ProjectXYZ();
+
+            e->setVertex(0, entry.pVertex);
+            e->setVertex(1, vSE3);
+            e->setMeasurement(obs);
+            const float &invSigma2 = pKFi->mvInvLevelSigma2[kpUn.octave];
+            e->setInformation(Eigen::Matrix3d::Identity()*invSigma2);
+
+            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+            e->setRobustKernel(rk);
+            rk->setDelta(thHuberStereo);
+
+            e->fx = pKFi->fx;
+            e->fy = pKFi->fy;
+            e->cx = pKFi->cx;
+            e->cy = pKFi->cy;
+            e->bf = pKFi->mbf;
+
+            mOptimizer.addEdge(e);
+            ObservationEdge edge = {e, pKFi, STEREO};
+            entry.vEdges.push_back(edge);
+        }
+
+        if(pKFi->mpCamera2){
+            int rightIndex = get<1>(mit->second);
+
+            if(rightIndex != -1 ){
+                rightIndex -= pKFi->NLeft;
+
+                Eigen::Matrix<double,2,1> obs;
+                cv::KeyPoint kp = pKFi->mvKeysRight[rightIndex];
+                obs << kp.pt.x, kp.pt.y;
+
+                ORB_SLAM3::EdgeSE3ProjectXYZToBody *e = new ORB_SLAM3::EdgeSE3ProjectXYZToBody();
+
+                e->setVertex(0, entry.pVertex);
+                e->setVertex(1, vSE3);
+                e->setMeasurement(obs);
+                const float &invSigma2 = pKFi->mvInvLevelSigma2[kp.octave];
+                e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+                e->setRobustKernel(rk);
+                rk->setDelta(thHuberMono);
+
+                Sophus::SE3f Trl = pKFi-> GetRelativePoseTrl();
+                e->mTrl = g2o::SE3Quat(Trl.unit_quaternion().cast<double>(), Trl.translation().cast<double>());
+
+                e->pCamera = pKFi->mpCamera2;
+
+                mOptimizer.addEdge(e);
+                ObservationEdge edge = {e, pKFi, MONOCULAR_RIGHT};
+                entry.vEdges.push_back(edge);
+            }
+        }
+    }
+}
+
+void LocalBAProblem::Optimize(KeyFrame *pKF, bool* pbStopFlag, Map* pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges,
+                              TaskScheduler* pScheduler)
+{
+    Map* pCurrentMap = pKF->GetMap();
+    const int nBigChangeIdx = pMap->GetLastBigChangeIdx();
+    if(pCurrentMap != mpMap)
+    {
+        Clear();
+        mpMap = pCurrentMap;
+    }
+    mnWindow++;
+
+    // Local KeyFrames: First Breath Search from Current Keyframe
+    vector<KeyFrame*> vpLocalKeyFrames;
+
+    vpLocalKeyFrames.push_back(pKF);
+    pKF->mnBALocalForKF = pKF->mnId;
+
+    const vector<KeyFrame*> vNeighKFs = pKF->GetVectorCovisibleKeyFrames();
+    for(int i=0, iend=vNeighKFs.size(); i<iend; i++)
+    {
+        KeyFrame* pKFi = vNeighKFs[i];
+        pKFi->mnBALocalForKF = pKF->mnId;
+        if(!pKFi->isBad() && pKFi->GetMap() == pCurrentMap)
+            vpLocalKeyFrames.push_back(pKFi);
+    }
+
+    // Local MapPoints seen in Local KeyFrames. The observations are only copied again if they changed.
+    num_fixedKF = 0;
+    vector<MapPoint*> vpLocalMapPoints;
+    int nUpdatedMPs = 0;
+    for(size_t i=0; i<vpLocalKeyFrames.size(); i++)
+    {
+        KeyFrame* pKFi = vpLocalKeyFrames[i];
+        if(pKFi->mnId==pMap->GetInitKFid())
+        {
+            num_fixedKF = 1;
+        }
+        vector<MapPoint*> vpMPs = pKFi->GetMapPointMatches();
+        for(vector<MapPoint*>::iterator vit=vpMPs.begin(), vend=vpMPs.end(); vit!=vend; vit++)
+        {
+            MapPoint* pMP = *vit;
+            if(pMP)
+                if(!pMP->isBad() && pMP->GetMap() == pCurrentMap)
+                {
+                    if(pMP->mnBALocalForKF!=pKF->mnId)
+                    {
+                        vpLocalMapPoints.push_back(pMP);
+                        pMP->mnBALocalForKF=pKF->mnId;
+
+                        std::pair<std::unordered_map<MapPoint*, PointEntry>::iterator, bool> inserted = mmPoints.insert(std::make_pair(pMP, PointEntry()));
+                        PointEntry &entry = inserted.first->second;
+                        if(inserted.second)
+                            entry.pVertex = static_cast<g2o::VertexSBAPointXYZ*>(NULL);
+                        entry.nWindow = mnWindow;
+
+                        const unsigned int nVersion = pMP->GetObservationsVersion();
+                        if(inserted.second || nVersion != entry.nObsVersion)
+                        {
+                            entry.observations = pMP->GetObservations();
+                            entry.nObsVersion = nVersion;
+                            entry.bDirty = true;
+                            nUpdatedMPs++;
+                        }
+                    }
+                }
+        }
+    }
+
+    // Fixed Keyframes. Keyframes that see Local MapPoints but that are not Local Keyframes
+    vector<KeyFrame*> vpFixedCameras;
+    for(size_t i=0; i<vpLocalMapPoints.size(); i++)
+    {
+        const MapPoint::ObservationMap &observations = mmPoints[vpLocalMapPoints[i]].observations;
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        {
+            KeyFrame* pKFi = mit->first;
+
+            if(pKFi->mnBALocalForKF!=pKF->mnId && pKFi->mnBAFixedForKF!=pKF->mnId )
+            {
+                pKFi->mnBAFixedForKF=pKF->mnId;
+                if(!pKFi->isBad() && pKFi->GetMap() == pCurrentMap)
+                    vpFixedCameras.push_back(pKFi);
+            }
+        }
+    }
+    num_fixedKF = vpFixedCameras.size() + num_fixedKF;
+
+    if(num_fixedKF == 0)
+    {
+        Verbose::PrintMess("LM-LBA: There are 0 fixed KF in the optimizations, LBA aborted", Verbose::VERBOSITY_NORMAL);
+        return;
+    }
+
+    // Points that left the window, with their edges
+    int nRemovedMPs = 0;
+    for(std::unordered_map<MapPoint*, PointEntry>::iterator it=mmPoints.begin(); it!=mmPoints.end();)
+    {
+        if(it->second.nWindow != mnWindow)
+        {
+            if(it->second.pVertex)
+            {
+                mmPointOfVertex.erase(it->second.pVertex->id());
+                mOptimizer.removeVertex(it->second.pVertex);
+            }
+            it = mmPoints.erase(it);
+            nRemovedMPs++;
+        }
+        else
+            it++;
+    }
+
+    // Keyframes of the window, the vertices of the new ones are created
+    int nNewKFs = 0;
+    for(size_t i=0, iend=vpLocalKeyFrames.size()+vpFixedCameras.size(); i<iend; i++)
+    {
+        const bool bLocal = i < vpLocalKeyFrames.size();
+        KeyFrame* pKFi = bLocal ? vpLocalKeyFrames[i] : vpFixedCameras[i-vpLocalKeyFrames.size()];
+
+        std::pair<std::unordered_map<KeyFrame*, KeyFrameEntry>::iterator, bool> inserted = mmKeyFrames.insert(std::make_pair(pKFi, KeyFrameEntry()));
+        KeyFrameEntry &entry = inserted.first->second;
+        if(inserted.second)
+        {
+            entry.pVertex = new g2o::VertexSE3Expmap();
+            entry.pVertex->setId(mnNextVertexId++);
+            mOptimizer.addVertex(entry.pVertex);
+            nNewKFs++;
+        }
+        entry.nWindow = mnWindow;
+
+        // Warm start from the map, which has the result of the previous optimization unless other thread changed it
+        Sophus::SE3<float> Tcw = pKFi->GetPose();
+        entry.pVertex->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(), Tcw.translation().cast<double>()));
+        entry.pVertex->setFixed(bLocal ? pKFi->mnId==pMap->GetInitKFid() : true);
+    }
+    num_OptKF = vpLocalKeyFrames.size();
+
+    // DEBUG LBA
+    pCurrentMap->msOptKFs.clear();
+    pCurrentMap->msFixedKFs.clear();
+    for(size_t i=0; i<vpLocalKeyFrames.size(); i++)
+        pCurrentMap->msOptKFs.insert(vpLocalKeyFrames[i]->mnId);
+    for(size_t i=0; i<vpFixedCameras.size(); i++)
+        pCurrentMap->msFixedKFs.insert(vpFixedCameras[i]->mnId);
+
+    // Keyframes that left the window
+    int nRemovedKFs = 0;
+    for(std::unordered_map<KeyFrame*, KeyFrameEntry>::iterator it=mmKeyFrames.begin(); it!=mmKeyFrames.end();)
+    {
+        if(it->second.nWindow != mnWindow)
+        {
+            RemoveKeyFrameVertex(it->second);
+            it = mmKeyFrames.erase(it);
+            nRemovedKFs++;
+        }
+        else
+            it++;
+    }
+
+    // Vertices of the new points and edges of the points whose observations changed
+    for(size_t i=0; i<vpLocalMapPoints.size(); i++)
+    {
+        MapPoint* pMP = vpLocalMapPoints[i];
+        PointEntry &entry = mmPoints[pMP];
+        if(!entry.pVertex)
+        {
+            entry.pVertex = new g2o::VertexSBAPointXYZ();
+            entry.pVertex->setId(mnNextVertexId++);
+            entry.pVertex->setMarginalized(true);
+            mOptimizer.addVertex(entry.pVertex);
+            mmPointOfVertex[entry.pVertex->id()] = pMP;
+        }
+        if(entry.bDirty)
+        {
+            RemovePointEdges(entry);
+            AddPointEdges(pMP, entry, pCurrentMap);
+            entry.bDirty = false;
+        }
+        entry.pVertex->setEstimate(pMP->GetWorldPos().cast<double>());
+    }
+    num_MPs = vpLocalMapPoints.size();
+    num_edges = mOptimizer.edges().size();
+
+    std::stringstream ss;
+    ss << "LM-LBA: window of " << num_OptKF << "+" << vpFixedCameras.size() << " KFs and " << num_MPs << " MPs, "
+       << nNewKFs << " new / " << nRemovedKFs << " removed KFs, " << nUpdatedMPs << " updated / " << nRemovedMPs << " removed MPs";
+    Verbose::PrintMess(ss.str(), Verbose::VERBOSITY_DEBUG);
+
+    if(pbStopFlag)
+        if(*pbStopFlag)
+            return;
+
+    g2o::OptimizationAlgorithmLevenberg* solver = static_cast<g2o::OptimizationAlgorithmLevenberg*>(mOptimizer.solver());
+    solver->setUserLambdaInit(pMap->IsInertial() ? 100.0 : 0.0);
+    mOptimizer.setForceStopFlag(pbStopFlag);
+
+    G2oSchedulerExecutor executor(pScheduler, TaskScheduler::LOCAL_MAPPING);
+    mOptimizer.setParallelExecutor(pScheduler ? &executor : static_cast<g2o::ParallelExecutor*>(NULL));
+    mOptimizer.setMixedPrecision(Optimizer::MixedPrecision());
+
+    mOptimizer.initializeOptimization();
+    mOptimizer.optimize(10);
+
+    mOptimizer.setParallelExecutor(static_cast<g2o::ParallelExecutor*>(NULL));
+    mOptimizer.setForceStopFlag(static_cast<bool*>(NULL));
+
+    vector<pair<KeyFrame*,MapPoint*> > vToErase;
+
+    // Check inlier observations
+    for(size_t i=0; i<vpLocalMapPoints.size(); i++)
+    {
+        MapPoint* pMP = vpLocalMapPoints[i];
+        if(pMP->isBad())
+            continue;
+
+        const vector<ObservationEdge> &vEdges = mmPoints[pMP].vEdges;
+        for(size_t j=0; j<vEdges.size(); j++)
+        {
+            const ObservationEdge &edge = vEdges[j];
+            bool bOutlier;
+            if(edge.type == MONOCULAR)
+            {
+                ORB_SLAM3::EdgeSE3ProjectXYZ* e = static_cast<ORB_SLAM3::EdgeSE3ProjectXYZ*>(edge.pEdge);
+                bOutlier = e->chi2()>5.991 || !e->isDepthPositive();
+            }
+            else if(edge.type == MONOCULAR_RIGHT)
+            {
+                ORB_SLAM3::EdgeSE3ProjectXYZToBody* e = static_cast<ORB_SLAM3::EdgeSE3ProjectXYZToBody*>(edge.pEdge);
+                bOutlier = e->chi2()>5.991 || !e->isDepthPositive();
+            }
+            else
+            {
+                g2o::EdgeStereoSE3ProjectXYZ* e = static_cast<g2o::EdgeStereoSE3ProjectXYZ*>(edge.pEdge);
+                bOutlier = e->chi2()>7.815 || !e->isDepthPositive();
+            }
+
+            if(bOutlier)
+                vToErase.push_back(make_pair(edge.pKF,pMP));
+        }
+    }
+
+    // Get Map Mutex
+    unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
+
+    // The map was corrected while optimizing (e.g. a global BA was published), the result is outdated
+    if(pMap->GetLastBigChangeIdx() != nBigChangeIdx)
+        return;
+
+    // The points lose these observations, their edges are built again in the next window
+    for(size_t i=0;i<vToErase.size();i++)
+    {
+        KeyFrame* pKFi = vToErase[i].first;
+        MapPoint* pMPi = vToErase[i].second;
+        pKFi->EraseMapPointMatch(pMPi);
+        pMPi->EraseObservation(pKFi);
+    }
+
+    // Recover optimized data
+    //Keyframes
+    for(size_t i=0; i<vpLocalKeyFrames.size(); i++)
+    {
+        KeyFrame* pKFi = vpLocalKeyFrames[i];
+        g2o::SE3Quat SE3quat = mmKeyFrames[pKFi].pVertex->estimate();
+        Sophus::SE3f Tiw(SE3quat.rotation().cast<float>(), SE3quat.translation().cast<float>());
+        pKFi->SetPose(Tiw);
+    }
+
+    //Points
+    for(size_t i=0; i<vpLocalMapPoints.size(); i++)
+    {
+        MapPoint* pMP = vpLocalMapPoints[i];
+        pMP->SetWorldPos(mmPoints[pMP].pVertex->estimate().cast<float>());
+        pMP->UpdateNormalAndDepth();
+    }
+
+    pMap->IncreaseChangeIndex();
+}
+
+} //namespace ORB_SLAM3
@@ -23,22 +23,143 @@
 #include "Optimizer.h"
 #include "Converter.h"
 #include "GeometricTools.h"
+#include "LocalBAProblem.h"
 
 #include<mutex>
 #include<chrono>
+#include<unordered_map>
 
 namespace ORB_SLAM3
 {
 
+// Snapshot of the observations used to check the redundancy of the candidates of KeyFrameCulling. The
+// observations of each point are stored once with the scale level at which each keyframe sees it. A cull
+// only changes the points of the culled keyframe, they are read again.
+struct RedundancySnapshot
+{
+    // For each candidate, its close points (index in the point table) and their level in the keyframe
+    vector<vector<pair<int,int> > > vvKFPoints;
+
+    // Point table. The observations are empty for the points with too few of them to be redundant.
+    vector<MapPoint*> vpPoints;
+    unordered_map<MapPoint*,int> mPointIdx;
+    vector<vector<pair<KeyFrame*,int> > > vvPointObs;
+    vector<char> vbPointBad;
+};
+
+static int ObservationScaleLevel(KeyFrame* pKF, const tuple<int,int> &indexes)
+{
+    const int leftIndex = get<0>(indexes), rightIndex = get<1>(indexes);
+    int scaleLevel = -1;
+    if(pKF->NLeft == -1)
+        scaleLevel = pKF->mvKeysUn[leftIndex].octave;
+    else {
+        if (leftIndex != -1) {
+            scaleLevel = pKF->mvKeys[leftIndex].octave;
+        }
+        if (rightIndex != -1) {
+            int rightLevel = pKF->mvKeysRight[rightIndex - pKF->NLeft].octave;
+            scaleLevel = (scaleLevel == -1 || scaleLevel > rightLevel) ? rightLevel
+                                                                       : scaleLevel;
+        }
+    }
+    return scaleLevel;
+}
+
+// Close points of the keyframe vIdx[n] and their level in it
+static void ReadKeyFramePoints(const vector<KeyFrame*> &vpKFs, const vector<int> &vIdx, const bool bMonocular,
+                               vector<vector<pair<MapPoint*,int> > > &vvKFMatches, const int n)
+{
+    const int k = vIdx[n];
+    KeyFrame* pKF = vpKFs[k];
+    const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
+    vector<pair<MapPoint*,int> > &vMatches = vvKFMatches[k];
+    vMatches.reserve(vpMapPoints.size());
+    for(size_t i=0, iend=vpMapPoints.size(); i<iend; i++)
+    {
+        MapPoint* pMP = vpMapPoints[i];
+        if(!pMP || pMP->isBad())
+            continue;
+
+        // We only consider close stereo points
+        if(!bMonocular)
+        {
+            if(pKF->mvDepth[i]>pKF->mThDepth || pKF->mvDepth[i]<0)
+                continue;
+        }
+
+        const int scaleLevel = (pKF -> NLeft == -1) ? pKF->mvKeysUn[i].octave
+                                                     : (i < static_cast<size_t>(pKF -> NLeft)) ? pKF -> mvKeys[i].octave
+                                                                                               : pKF -> mvKeysRight[i - pKF -> NLeft].octave;
+        vMatches.push_back(make_pair(pMP, scaleLevel));
+    }
+}
+
+// Current state of the point vIdx[n] of the table
+static void ReadPointObservations(RedundancySnapshot &snapshot, const vector<int> &vIdx, const int thObs, const int n)
+{
+    const int idx = vIdx[n];
+    MapPoint* pMP = snapshot.vpPoints[idx];
+    vector<pair<KeyFrame*,int> > &vObs = snapshot.vvPointObs[idx];
+    vObs.clear();
+    snapshot.vbPointBad[idx] = pMP->isBad();
+    if(snapshot.vbPointBad[idx] || pMP->Observations()<=thObs)
+        return;
+
+    MapPoint::ObservationsView observations = pMP->GetObservationsView();
+    vObs.reserve(observations.size());
+    for(MapPoint::ObservationMap::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        vObs.push_back(make_pair(mit->first, ObservationScaleLevel(mit->first, mit->second)));
+}
+
+// Evaluates the candidate vIdx[n] of the snapshot. Only reads the snapshot.
+static void CountRedundantObservationsKF(const vector<KeyFrame*> &vpKFs, const RedundancySnapshot &snapshot, const vector<int> &vIdx,
+                                         const int thObs, vector<int> &vnRedundantObs, vector<int> &vnMPs, const int n)
+{
+    const int k = vIdx[n];
+    KeyFrame* pKF = vpKFs[k];
+    const vector<pair<int,int> > &vKFPoints = snapshot.vvKFPoints[k];
+    int nRedundantObservations=0;
+    int nMPs=0;
+    for(size_t i=0, iend=vKFPoints.size(); i<iend; i++)
+    {
+        const int idx = vKFPoints[i].first;
+        if(snapshot.vbPointBad[idx])
+            continue;
+        nMPs++;
+
+        const int scaleLevel = vKFPoints[i].second;
+        const vector<pair<KeyFrame*,int> > &vObs = snapshot.vvPointObs[idx];
+        int nObs=0;
+        for(size_t j=0, jend=vObs.size(); j<jend; j++)
+        {
+            if(vObs[j].first==pKF)
+                continue;
+            if(vObs[j].second<=scaleLevel+1)
+            {
+                nObs++;
+                if(nObs>thObs)
+                    break;
+            }
+        }
+        if(nObs>thObs)
+            nRedundantObservations++;
+    }
+    vnRedundantObs[k] = nRedundantObservations;
+    vnMPs[k] = nMPs;
+}
+
 LocalMapping::LocalMapping(System* pSys, Atlas *pAtlas, const float bMonocular, bool bInertial, const string &_strSeqName):
-    mpSystem(pSys), mbMonocular(bMonocular), mbInertial(bInertial), mbResetRequested(false), mbResetRequestedActiveMap(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas), bInitializing(false),
-    mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true),
+    mpSystem(pSys), mpScheduler(static_cast<TaskScheduler*>(NULL)), mbParallelBA(true), mbMonocular(bMonocular), mbInertial(bInertial), mbResetRequested(false), mbResetRequestedActiveMap(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas), bInitializing(false),
+    mbWakeUp(false), mbIdle(false), mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true),
     mIdxInit(0), mScale(1.0), mInitSect(0), mbNotBA1(true), mbNotBA2(true), mIdxIteration(0), infoInertial(Eigen::MatrixXd::Zero(9,9))
 {
     mnMatchesInliers = 0;
 
     mbBadImu = false;
 
+    mpLocalBAProblem.reset(new LocalBAProblem());
+
     mTinit = 0.f;
 
     mNumLM = 0;
@@ -51,6 +172,10 @@ LocalMapping::LocalMapping(System* pSys, Atlas *pAtlas, const float bMonocular,
 
 }
 
+LocalMapping::~LocalMapping()
+{
+}
+
 void LocalMapping::SetLoopCloser(LoopClosing* pLoopCloser)
 {
     mpLoopCloser = pLoopCloser;
@@ -61,6 +186,21 @@ void LocalMapping::SetTracker(Tracking *pTracker)
     mpTracker=pTracker;
 }
 
+void LocalMapping::SetScheduler(TaskScheduler *pScheduler)
+{
+    mpScheduler=pScheduler;
+}
+
+void LocalMapping::SetParallelBA(const bool bSet)
+{
+    mbParallelBA = bSet;
+}
+
+TaskScheduler* LocalMapping::BAScheduler()
+{
+    return mbParallelBA ? mpScheduler : static_cast<TaskScheduler*>(NULL);
+}
+
 void LocalMapping::Run()
 {
     mbFinished = false;
@@ -86,6 +226,9 @@ void LocalMapping::Run()
 
             double timeProcessKF = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndProcessKF - time_StartProcessKF).count();
             vdKFInsert_ms.push_back(timeProcessKF);
+
+            double timeKFQueue = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_StartProcessKF - mpCurrentKeyFrame->mTimeInsertLM).count();
+            vdKFQueue_ms.push_back(timeKFQueue);
 #endif
 
             // Check recent MapPoints
@@ -146,12 +289,12 @@ void LocalMapping::Run()
                         }
 
                         bool bLarge = ((mpTracker->GetMatchesInliers()>75)&&mbMonocular)||((mpTracker->GetMatchesInliers()>100)&&!mbMonocular);
-                        Optimizer::LocalInertialBA(mpCurrentKeyFrame, &mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA, bLarge, !mpCurrentKeyFrame->GetMap()->GetIniertialBA2());
+                        Optimizer::LocalInertialBA(mpCurrentKeyFrame, &mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA, bLarge, !mpCurrentKeyFrame->GetMap()->GetIniertialBA2(), BAScheduler());
                         b_doneLBA = true;
                     }
                     else
                     {
-                        Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA);
+                        mpLocalBAProblem->Optimize(mpCurrentKeyFrame,&mbAbortBA, mpCurrentKeyFrame->GetMap(),num_FixedKF_BA,num_OptKF_BA,num_MPs_BA,num_edges_BA, BAScheduler());
                         b_doneLBA = true;
                     }
 
@@ -164,6 +307,9 @@ void LocalMapping::Run()
                     timeLBA_ms = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndLBA - time_EndMPCreation).count();
                     vdLBA_ms.push_back(timeLBA_ms);
 
+                    double timeKFToLBA = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndMPCreation - mpCurrentKeyFrame->mTimeInsertLM).count();
+                    vdKFToLBA_ms.push_back(timeKFToLBA);
+
                     nLBA_exec += 1;
                     if(mbAbortBA)
                     {
@@ -258,10 +404,16 @@ void LocalMapping::Run()
         }
         else if(Stop() && !mbBadImu)
         {
-            // Safe area to stop
+            // Safe area to stop, until Release or RequestFinish wake it up
             while(isStopped() && !CheckFinish())
             {
-                usleep(3000);
+                unique_lock<mutex> lock(mMutexNewKFs);
+                mbIdle = true;
+                mCondNewKFs.notify_all();
+                while(!mbWakeUp)
+                    mCondNewKFs.wait(lock);
+                mbWakeUp = false;
+                mbIdle = false;
             }
             if(CheckFinish())
                 break;
@@ -275,17 +427,47 @@ void LocalMapping::Run()
         if(CheckFinish())
             break;
 
-        usleep(3000);
+        // Wait for a new keyframe or a request
+        {
+            unique_lock<mutex> lock(mMutexNewKFs);
+            mbIdle = true;
+            mCondNewKFs.notify_all();
+            while(mlNewKeyFrames.empty() && !mbWakeUp)
+                mCondNewKFs.wait(lock);
+            mbWakeUp = false;
+            mbIdle = false;
+        }
     }
 
     SetFinish();
+
+    // Nothing is mapped anymore
+    WakeUp();
 }
 
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutexNewKFs);
+#ifdef REGISTER_TIMES
+    pKF->mTimeInsertLM = std::chrono::steady_clock::now();
+#endif
     mlNewKeyFrames.push_back(pKF);
     mbAbortBA=true;
+    mCondNewKFs.notify_all();
+}
+
+void LocalMapping::WakeUp()
+{
+    unique_lock<mutex> lock(mMutexNewKFs);
+    mbWakeUp = true;
+    mCondNewKFs.notify_all();
+}
+
+void LocalMapping::WaitUntilIdle()
+{
+    unique_lock<mutex> lock(mMutexNewKFs);
+    while(!(mbIdle && mlNewKeyFrames.empty()) && !isFinished())
+        mCondNewKFs.wait(lock);
 }
 
 
@@ -828,6 +1010,8 @@ void LocalMapping::RequestStop()
     mbStopRequested = true;
     unique_lock<mutex> lock2(mMutexNewKFs);
     mbAbortBA = true;
+    mbWakeUp = true;
+    mCondNewKFs.notify_all();
 }
 
 bool LocalMapping::Stop()
@@ -836,6 +1020,7 @@ bool LocalMapping::Stop()
     if(mbStopRequested && !mbNotStop)
     {
         mbStopped = true;
+        mCondStop.notify_all();
         cout << "Local Mapping STOP" << endl;
         return true;
     }
@@ -843,6 +1028,14 @@ bool LocalMapping::Stop()
     return false;
 }
 
+void LocalMapping::WaitUntilStopped()
+{
+    // SetFinish also sets mbStopped
+    unique_lock<mutex> lock(mMutexStop);
+    while(!mbStopped)
+        mCondStop.wait(lock);
+}
+
 bool LocalMapping::isStopped()
 {
     unique_lock<mutex> lock(mMutexStop);
@@ -857,15 +1050,18 @@ bool LocalMapping::stopRequested()
 
 void LocalMapping::Release()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    unique_lock<mutex> lock2(mMutexFinish);
-    if(mbFinished)
-        return;
-    mbStopped = false;
-    mbStopRequested = false;
-    for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
-        delete *lit;
-    mlNewKeyFrames.clear();
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        unique_lock<mutex> lock2(mMutexFinish);
+        if(mbFinished)
+            return;
+        mbStopped = false;
+        mbStopRequested = false;
+        for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
+            delete *lit;
+        mlNewKeyFrames.clear();
+    }
+    WakeUp();
 
     cout << "Local Mapping RELEASE" << endl;
 }
@@ -884,12 +1080,18 @@ void LocalMapping::SetAcceptKeyFrames(bool flag)
 
 bool LocalMapping::SetNotStop(bool flag)
 {
-    unique_lock<mutex> lock(mMutexStop);
+    {
+        unique_lock<mutex> lock(mMutexStop);
 
-    if(flag && mbStopped)
-        return false;
+        if(flag && mbStopped)
+            return false;
+
+        mbNotStop = flag;
+    }
 
-    mbNotStop = flag;
+    // A stop requested meanwhile is done now
+    if(!flag)
+        WakeUp();
 
     return true;
 }
@@ -936,85 +1138,55 @@ void LocalMapping::KeyFrameCulling()
 
 
 
+    // Candidates, evaluated in chunks on a snapshot of their observations. The first chunk goes up to the
+    // first check of mbAbortBA.
+    vector<KeyFrame*> vpCandidates;
+    vector<int> vnCount;
+    vpCandidates.reserve(vpLocalKeyFrames.size());
     for(vector<KeyFrame*>::iterator vit=vpLocalKeyFrames.begin(), vend=vpLocalKeyFrames.end(); vit!=vend; vit++)
     {
         count++;
         KeyFrame* pKF = *vit;
-
+        if(count>101)
+            break;
         if((pKF->mnId==pKF->GetMap()->GetInitKFid()) || pKF->isBad())
             continue;
-        const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
-
-        int nObs = 3;
-        const int thObs=nObs;
-        int nRedundantObservations=0;
-        int nMPs=0;
-        for(size_t i=0, iend=vpMapPoints.size(); i<iend; i++)
-        {
-            MapPoint* pMP = vpMapPoints[i];
-            if(pMP)
-            {
-                if(!pMP->isBad())
-                {
-                    if(!mbMonocular)
-                    {
-                        if(pKF->mvDepth[i]>pKF->mThDepth || pKF->mvDepth[i]<0)
-                            continue;
-                    }
+        vpCandidates.push_back(pKF);
+        vnCount.push_back(count);
+    }
 
-                    nMPs++;
-                    if(pMP->Observations()>thObs)
-                    {
-                        const int &scaleLevel = (pKF -> NLeft == -1) ? pKF->mvKeysUn[i].octave
-                                                                     : (i < pKF -> NLeft) ? pKF -> mvKeys[i].octave
-                                                                                          : pKF -> mvKeysRight[i].octave;
-                        const map<KeyFrame*, tuple<int,int>> observations = pMP->GetObservations();
-                        int nObs=0;
-                        for(map<KeyFrame*, tuple<int,int>>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
-                        {
-                            KeyFrame* pKFi = mit->first;
-                            if(pKFi==pKF)
-                                continue;
-                            tuple<int,int> indexes = mit->second;
-                            int leftIndex = get<0>(indexes), rightIndex = get<1>(indexes);
-                            int scaleLeveli = -1;
-                            if(pKFi -> NLeft == -1)
-                                scaleLeveli = pKFi->mvKeysUn[leftIndex].octave;
-                            else {
-                                if (leftIndex != -1) {
-                                    scaleLeveli = pKFi->mvKeys[leftIndex].octave;
-                                }
-                                if (rightIndex != -1) {
-                                    int rightLevel = pKFi->mvKeysRight[rightIndex - pKFi->NLeft].octave;
-                                    scaleLeveli = (scaleLeveli == -1 || scaleLeveli > rightLevel) ? rightLevel
-                                                                                                  : scaleLeveli;
-                                }
-                            }
+    const int nChunk = 20;
+    RedundancySnapshot snapshot;
+    vector<int> vnRedundantObs(vpCandidates.size(), 0), vnMPs(vpCandidates.size(), 0);
+    size_t nEvaluated = 0;
+    for(size_t k=0; k<vpCandidates.size(); k++)
+    {
+        KeyFrame* pKF = vpCandidates[k];
+        count = vnCount[k];
 
-                            if(scaleLeveli<=scaleLevel+1)
-                            {
-                                nObs++;
-                                if(nObs>thObs)
-                                    break;
-                            }
-                        }
-                        if(nObs>thObs)
-                        {
-                            nRedundantObservations++;
-                        }
-                    }
-                }
-            }
+        if(k==nEvaluated)
+        {
+            const int lastCount = count<=nChunk+1 ? nChunk+1 : count+nChunk-1;
+            while(nEvaluated<vpCandidates.size() && vnCount[nEvaluated]<=lastCount)
+                nEvaluated++;
+            AddToRedundancySnapshot(vpCandidates, k, nEvaluated, snapshot, vnRedundantObs, vnMPs);
         }
 
+        int nRedundantObservations = vnRedundantObs[k];
+        int nMPs = vnMPs[k];
+
         if(nRedundantObservations>redundant_th*nMPs)
         {
+            // A cull removes the observations of these points from the snapshot
+            const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
+
             if (mbInertial)
             {
                 if (mpAtlas->KeyFramesInMap()<=Nd)
                     continue;
 
-                if(pKF->mnId>(mpCurrentKeyFrame->mnId-2))
+                // The keyframe before the current one, by link: the ids of other systems in the process interleave
+                if(pKF==mpCurrentKeyFrame->mPrevKF)
                     continue;
 
                 if(pKF->mPrevKF && pKF->mNextKF)
@@ -1024,6 +1196,8 @@ void LocalMapping::KeyFrameCulling()
                     if((bInitImu && (pKF->mnId<last_ID) && t<3.) || (t<0.5))
                     {
                         pKF->mNextKF->mpImuPreintegrated->MergePrevious(pKF->mpImuPreintegrated);
+                        pKF->mNextKF->MarkChanged();
+                        pKF->mPrevKF->MarkChanged();
                         pKF->mNextKF->mPrevKF = pKF->mPrevKF;
                         pKF->mPrevKF->mNextKF = pKF->mNextKF;
                         pKF->mNextKF = NULL;
@@ -1033,6 +1207,8 @@ void LocalMapping::KeyFrameCulling()
                     else if(!mpCurrentKeyFrame->GetMap()->GetIniertialBA2() && ((pKF->GetImuPosition()-pKF->mPrevKF->GetImuPosition()).norm()<0.02) && (t<3))
                     {
                         pKF->mNextKF->mpImuPreintegrated->MergePrevious(pKF->mpImuPreintegrated);
+                        pKF->mNextKF->MarkChanged();
+                        pKF->mPrevKF->MarkChanged();
                         pKF->mNextKF->mPrevKF = pKF->mPrevKF;
                         pKF->mPrevKF->mNextKF = pKF->mNextKF;
                         pKF->mNextKF = NULL;
@@ -1045,6 +1221,9 @@ void LocalMapping::KeyFrameCulling()
             {
                 pKF->SetBadFlag();
             }
+
+            if(pKF->isBad())
+                UpdateRedundancySnapshot(vpCandidates, vpMapPoints, k+1, nEvaluated, snapshot, vnRedundantObs, vnMPs);
         }
         if((count > 20 && mbAbortBA) || count>100)
         {
@@ -1053,6 +1232,110 @@ void LocalMapping::KeyFrameCulling()
     }
 }
 
+void LocalMapping::ParallelForCulling(const int n, const std::function<void(int)> &f)
+{
+    if(mpScheduler)
+        mpScheduler->ParallelFor(0, n, f, TaskScheduler::LOCAL_MAPPING, 4);
+    else
+    {
+        for(int i=0; i<n; i++)
+            f(i);
+    }
+}
+
+void LocalMapping::AddToRedundancySnapshot(const vector<KeyFrame*> &vpKFs, const int first, const int last, RedundancySnapshot &snapshot,
+                                           vector<int> &vnRedundantObs, vector<int> &vnMPs)
+{
+    const int thObs = 3;
+    snapshot.vvKFPoints.resize(last);
+
+    // Close points of the candidates, in parallel
+    vector<vector<pair<MapPoint*,int> > > vvKFMatches(last);
+    vector<int> vKFIdx;
+    for(int k=first; k<last; k++)
+        vKFIdx.push_back(k);
+    ParallelForCulling(vKFIdx.size(), std::bind(ReadKeyFramePoints, std::cref(vpKFs), std::cref(vKFIdx), mbMonocular,
+                                                std::ref(vvKFMatches), std::placeholders::_1));
+
+    // Points are shared by many keyframes, they get one entry in the table
+    vector<int> vNewPoints;
+    for(int k=first; k<last; k++)
+    {
+        const vector<pair<MapPoint*,int> > &vMatches = vvKFMatches[k];
+        vector<pair<int,int> > &vKFPoints = snapshot.vvKFPoints[k];
+        vKFPoints.reserve(vMatches.size());
+        for(size_t i=0, iend=vMatches.size(); i<iend; i++)
+        {
+            MapPoint* pMP = vMatches[i].first;
+            unordered_map<MapPoint*,int>::iterator it = snapshot.mPointIdx.find(pMP);
+            int idx;
+            if(it != snapshot.mPointIdx.end())
+                idx = it->second;
+            else
+            {
+                idx = snapshot.vpPoints.size();
+                snapshot.mPointIdx[pMP] = idx;
+                snapshot.vpPoints.push_back(pMP);
+                vNewPoints.push_back(idx);
+            }
+            vKFPoints.push_back(make_pair(idx, vMatches[i].second));
+        }
+    }
+
+    // Observations of the new points, in parallel
+    snapshot.vvPointObs.resize(snapshot.vpPoints.size());
+    snapshot.vbPointBad.resize(snapshot.vpPoints.size(), 0);
+    ParallelForCulling(vNewPoints.size(), std::bind(ReadPointObservations, std::ref(snapshot), std::cref(vNewPoints), thObs,
+                                                    std::placeholders::_1));
+
+    // Each candidate is evaluated independently on the snapshot
+    ParallelForCulling(vKFIdx.size(), std::bind(CountRedundantObservationsKF, std::cref(vpKFs), std::cref(snapshot), std::cref(vKFIdx),
+                                                thObs, std::ref(vnRedundantObs), std::ref(vnMPs), std::placeholders::_1));
+}
+
+void LocalMapping::UpdateRedundancySnapshot(const vector<KeyFrame*> &vpKFs, const vector<MapPoint*> &vpCulledMPs, const int first,
+                                            const int last, RedundancySnapshot &snapshot, vector<int> &vnRedundantObs, vector<int> &vnMPs)
+{
+    const int thObs = 3;
+
+    // The points of the culled keyframe lost an observation or became bad
+    vector<int> vChangedPoints;
+    vector<char> vbChanged(snapshot.vpPoints.size(), 0);
+    for(size_t i=0, iend=vpCulledMPs.size(); i<iend; i++)
+    {
+        if(!vpCulledMPs[i])
+            continue;
+        unordered_map<MapPoint*,int>::iterator it = snapshot.mPointIdx.find(vpCulledMPs[i]);
+        if(it == snapshot.mPointIdx.end() || vbChanged[it->second])
+            continue;
+        vbChanged[it->second] = 1;
+        vChangedPoints.push_back(it->second);
+    }
+    if(vChangedPoints.empty())
+        return;
+
+    ParallelForCulling(vChangedPoints.size(), std::bind(ReadPointObservations, std::ref(snapshot), std::cref(vChangedPoints), thObs,
+                                                        std::placeholders::_1));
+
+    // Only the remaining candidates that see one of them are counted again
+    vector<int> vKFIdx;
+    for(int k=first; k<last; k++)
+    {
+        const vector<pair<int,int> > &vKFPoints = snapshot.vvKFPoints[k];
+        for(size_t i=0, iend=vKFPoints.size(); i<iend; i++)
+        {
+            if(vbChanged[vKFPoints[i].first])
+            {
+                vKFIdx.push_back(k);
+                break;
+            }
+        }
+    }
+
+    ParallelForCulling(vKFIdx.size(), std::bind(CountRedundantObservationsKF, std::cref(vpKFs), std::cref(snapshot), std::cref(vKFIdx),
+                                                thObs, std::ref(vnRedundantObs), std::ref(vnMPs), std::placeholders::_1));
+}
+
 void LocalMapping::RequestReset()
 {
     {
@@ -1060,16 +1343,13 @@ void LocalMapping::RequestReset()
         cout << "LM: Map reset recieved" << endl;
         mbResetRequested = true;
     }
+    WakeUp();
     cout << "LM: Map reset, waiting..." << endl;
 
-    while(1)
     {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetRequested)
-                break;
-        }
-        usleep(3000);
+        unique_lock<mutex> lock2(mMutexReset);
+        while(mbResetRequested)
+            mCondReset.wait(lock2);
     }
     cout << "LM: Map reset, Done!!!" << endl;
 }
@@ -1082,16 +1362,13 @@ void LocalMapping::RequestResetActiveMap(Map* pMap)
         mbResetRequestedActiveMap = true;
         mpMapToReset = pMap;
     }
+    WakeUp();
     cout << "LM: Active map reset, waiting..." << endl;
 
-    while(1)
     {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetRequestedActiveMap)
-                break;
-        }
-        usleep(3000);
+        unique_lock<mutex> lock2(mMutexReset);
+        while(mbResetRequestedActiveMap)
+            mCondReset.wait(lock2);
     }
     cout << "LM: Active map reset, Done!!!" << endl;
 }
@@ -1119,6 +1396,9 @@ void LocalMapping::ResetIfRequested()
 
             mIdxInit=0;
 
+            // The keyframes and points of the local BA graph may be deleted
+            mpLocalBAProblem->Clear();
+
             cout << "LM: End reseting Local Mapping..." << endl;
         }
 
@@ -1136,8 +1416,14 @@ void LocalMapping::ResetIfRequested()
 
             mbResetRequested = false;
             mbResetRequestedActiveMap = false;
+            // The keyframes and points of the local BA graph may be deleted
+            mpLocalBAProblem->Clear();
+
             cout << "LM: End reseting Local Mapping..." << endl;
         }
+
+        if(executed_reset)
+            mCondReset.notify_all();
     }
     if(executed_reset)
         cout << "LM: Reset free the mutex" << endl;
@@ -1146,8 +1432,11 @@ void LocalMapping::ResetIfRequested()
 
 void LocalMapping::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    WakeUp();
 }
 
 bool LocalMapping::CheckFinish()
@@ -1160,8 +1449,10 @@ void LocalMapping::SetFinish()
 {
     unique_lock<mutex> lock(mMutexFinish);
     mbFinished = true;    
+    mCondFinish.notify_all();
     unique_lock<mutex> lock2(mMutexStop);
     mbStopped = true;
+    mCondStop.notify_all();
 }
 
 bool LocalMapping::isFinished()
@@ -1170,6 +1461,13 @@ bool LocalMapping::isFinished()
     return mbFinished;
 }
 
+void LocalMapping::WaitUntilFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    while(!mbFinished)
+        mCondFinish.wait(lock);
+}
+
 void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
 {
     if (mbResetRequested)
@@ -1277,7 +1575,7 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
 
     // Before this line we are not changing the map
     {
-        unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+        unique_lock<SharedMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
         if ((fabs(mScale - 1.f) > 0.00001) || !mbMonocular) {
             Sophus::SE3f Twg(mRwg.cast<float>().transpose(), Eigen::Vector3f::Zero());
             mpAtlas->GetCurrentMap()->ApplyScaledRotation(Twg, mScale, true);
@@ -1304,9 +1602,9 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
     if (bFIBA)
     {
         if (priorA!=0.f)
-            Optimizer::FullInertialBA(mpAtlas->GetCurrentMap(), 100, false, mpCurrentKeyFrame->mnId, NULL, true, priorG, priorA);
+            Optimizer::FullInertialBA(mpAtlas->GetCurrentMap(), 100, false, mpCurrentKeyFrame->mnId, NULL, true, priorG, priorA, NULL, NULL, BAScheduler());
         else
-            Optimizer::FullInertialBA(mpAtlas->GetCurrentMap(), 100, false, mpCurrentKeyFrame->mnId, NULL, false);
+            Optimizer::FullInertialBA(mpAtlas->GetCurrentMap(), 100, false, mpCurrentKeyFrame->mnId, NULL, false, 1e2, 1e6, NULL, NULL, BAScheduler());
     }
 
     std::chrono::steady_clock::time_point t5 = std::chrono::steady_clock::now();
@@ -1314,7 +1612,7 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
     Verbose::PrintMess("Global Bundle Adjustment finished\nUpdating map ...", Verbose::VERBOSITY_NORMAL);
 
     // Get Map Mutex
-    unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
 
     unsigned long GBAid = mpCurrentKeyFrame->mnId;
 
@@ -1332,9 +1630,9 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA)
     while(!lpKFtoCheck.empty())
     {
         KeyFrame* pKF = lpKFtoCheck.front();
-        const set<KeyFrame*> sChilds = pKF->GetChilds();
+        const KeyFrame::EdgeSet sChilds = pKF->GetChilds();
         Sophus::SE3f Twc = pKF->GetPoseInverse();
-        for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+        for(KeyFrame::EdgeSet::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
         {
             KeyFrame* pChild = *sit;
             if(!pChild || pChild->isBad())
@@ -1470,7 +1768,7 @@ void LocalMapping::ScaleRefinement()
     
     Sophus::SO3d so3wg(mRwg);
     // Before this line we are not changing the map
-    unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
     std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
     if ((fabs(mScale-1.f)>0.002)||!mbMonocular)
     {
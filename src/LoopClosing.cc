@@ -24,6 +24,7 @@
 #include "Optimizer.h"
 #include "ORBmatcher.h"
 #include "G2oTypes.h"
+#include "GlobalBAProblem.h"
 
 #include<mutex>
 #include<thread>
@@ -35,11 +36,13 @@ namespace ORB_SLAM3
 LoopClosing::LoopClosing(Atlas *pAtlas, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale, const bool bActiveLC):
     mbResetRequested(false), mbResetActiveMapRequested(false), mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas),
     mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
-    mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0), mnLoopNumCoincidences(0), mnMergeNumCoincidences(0),
-    mbLoopDetected(false), mbMergeDetected(false), mnLoopNumNotFound(0), mnMergeNumNotFound(0), mbActiveLC(bActiveLC)
+    mbStopGBA(false), mpThreadGBA(NULL), mpScheduler(static_cast<TaskScheduler*>(NULL)), mbParallelBA(true), mnBoWCacheKFId(0), mbParallelPlaceRecognition(true), mbNonBlockingGBAUpdate(true), mbFixScale(bFixScale), mnFullBAIdx(0), mnLoopNumCoincidences(0), mnMergeNumCoincidences(0),
+    mbLoopDetected(false), mbMergeDetected(false), mnLoopNumNotFound(0), mnMergeNumNotFound(0), mbActiveLC(bActiveLC),
+    mbWakeUp(false), mbIdle(false)
 {
     mnCovisibilityConsistencyTh = 3;
     mpLastCurrentKF = static_cast<KeyFrame*>(NULL);
+    mpGlobalBAProblem.reset(new GlobalBAProblem());
 
 #ifdef REGISTER_TIMES
 
@@ -63,6 +66,7 @@ LoopClosing::LoopClosing(Atlas *pAtlas, KeyFrameDatabase *pDB, ORBVocabulary *pV
 
     vdGBA_ms.clear();
     vdUpdateMap_ms.clear();
+    vdGBAPublish_ms.clear();
     vdFGBATotal_ms.clear();
     vnGBAKFs.clear();
     vnGBAMPs.clear();
@@ -76,6 +80,15 @@ LoopClosing::LoopClosing(Atlas *pAtlas, KeyFrameDatabase *pDB, ORBVocabulary *pV
     mnCorrectionGBA = 0;
 }
 
+LoopClosing::~LoopClosing()
+{
+    // A Global BA still running uses the problem
+    unique_lock<mutex> lock(mMutexGBA);
+    mbStopGBA = true;
+    while(mbRunningGBA)
+        mCondGBA.wait(lock);
+}
+
 void LoopClosing::SetTracker(Tracking *pTracker)
 {
     mpTracker=pTracker;
@@ -86,6 +99,20 @@ void LoopClosing::SetLocalMapper(LocalMapping *pLocalMapper)
     mpLocalMapper=pLocalMapper;
 }
 
+void LoopClosing::SetScheduler(TaskScheduler *pScheduler)
+{
+    mpScheduler=pScheduler;
+}
+
+void LoopClosing::LaunchGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoopKF)
+{
+    if(mpScheduler)
+        mGBAResult = mpScheduler->Submit(std::bind(&LoopClosing::RunGlobalBundleAdjustment, this, pActiveMap, nLoopKF),
+                                         TaskScheduler::GLOBAL_BA);
+    else
+        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, pActiveMap, nLoopKF);
+}
+
 
 void LoopClosing::Run()
 {
@@ -302,10 +329,22 @@ void LoopClosing::Run()
             break;
         }
 
-        usleep(5000);
+        // Wait for a new keyframe or a request
+        {
+            unique_lock<mutex> lock(mMutexLoopQueue);
+            mbIdle = true;
+            mCondLoopQueue.notify_all();
+            while(mlpLoopKeyFrameQueue.empty() && !mbWakeUp)
+                mCondLoopQueue.wait(lock);
+            mbWakeUp = false;
+            mbIdle = false;
+        }
     }
 
     SetFinish();
+
+    // Nothing is closed anymore
+    WakeUp();
 }
 
 void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
@@ -313,6 +352,28 @@ void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
     unique_lock<mutex> lock(mMutexLoopQueue);
     if(pKF->mnId!=0)
         mlpLoopKeyFrameQueue.push_back(pKF);
+    mCondLoopQueue.notify_all();
+}
+
+void LoopClosing::WakeUp()
+{
+    unique_lock<mutex> lock(mMutexLoopQueue);
+    mbWakeUp = true;
+    mCondLoopQueue.notify_all();
+}
+
+void LoopClosing::WaitUntilIdle()
+{
+    {
+        unique_lock<mutex> lock(mMutexLoopQueue);
+        while(!(mbIdle && mlpLoopKeyFrameQueue.empty()) && !isFinished())
+            mCondLoopQueue.wait(lock);
+    }
+
+    // A stopped Global BA is not waited, it is discarded
+    unique_lock<mutex> lock(mMutexGBA);
+    while(mbRunningGBA && !mbStopGBA)
+        mCondGBA.wait(lock);
 }
 
 bool LoopClosing::CheckNewKeyFrames()
@@ -577,6 +638,84 @@ bool LoopClosing::DetectAndReffineSim3FromLastKF(KeyFrame* pCurrentKF, KeyFrame*
 
 bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<KeyFrame*> &vpBowCand, KeyFrame* &pMatchedKF2, KeyFrame* &pLastCurrentKF, g2o::Sim3 &g2oScw,
                                              int &nNumCoincidences, std::vector<MapPoint*> &vpMPs, std::vector<MapPoint*> &vpMatchedMPs)
+{
+    set<KeyFrame*> spConnectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
+
+    {
+        // The BoW matches of the previous query keyframe are not valid for this one
+        unique_lock<mutex> lock(mMutexBoWCache);
+        if(mnBoWCacheKFId != mpCurrentKF->mnId)
+        {
+            mmBoWMatchesCache.clear();
+            mnBoWCacheKFId = mpCurrentKF->mnId;
+        }
+    }
+
+    const int numCandidates = vpBowCand.size();
+    BoWCandidateResults vResults(numCandidates);
+
+    //Verbose::PrintMess("BoW candidates: There are " + to_string(vpBowCand.size()) + " possible candidates ", Verbose::VERBOSITY_DEBUG);
+    if(mbParallelPlaceRecognition && mpScheduler && mpScheduler->NumThreads()>1 && numCandidates>1)
+    {
+        mpScheduler->ParallelFor(0, numCandidates, std::bind(&LoopClosing::VerifyBoWCandidateAt, this, std::cref(vpBowCand),
+                                                             std::cref(spConnectedKeyFrames), std::ref(vResults), std::placeholders::_1),
+                                 TaskScheduler::LOOP_CLOSING);
+    }
+    else
+    {
+        for(int i=0; i<numCandidates; i++)
+            VerifyBoWCandidateAt(vpBowCand, spConnectedKeyFrames, vResults, i);
+    }
+
+    // Candidate with most matches after the refinement, the first one in the list on ties as in the sequential search
+    int nBest = -1;
+    int nBestMatchesReproj = 0;
+    for(int i=0; i<numCandidates; i++)
+    {
+        if(nBestMatchesReproj < vResults[i].nProjOptMatches)
+        {
+            nBestMatchesReproj = vResults[i].nProjOptMatches;
+            nBest = i;
+        }
+    }
+
+    if(nBest >= 0)
+    {
+        BoWCandidateResult &best = vResults[nBest];
+        pLastCurrentKF = mpCurrentKF;
+        nNumCoincidences = best.nNumCoincidences;
+        pMatchedKF2 = best.pMatchedKF;
+        pMatchedKF2->SetNotErase();
+        g2oScw = best.g2oScw;
+        vpMPs.swap(best.vpMapPoints);
+        vpMatchedMPs.swap(best.vpMatchedMapPoints);
+
+        return nNumCoincidences >= 3;
+    }
+    else
+    {
+        int maxStage = -1;
+        int maxMatched;
+        for(int i=0; i<numCandidates; ++i)
+        {
+            if(vResults[i].nStage > maxStage)
+            {
+                maxStage = vResults[i].nStage;
+                maxMatched = vResults[i].nMatchesStage;
+            }
+        }
+    }
+    return false;
+}
+
+void LoopClosing::VerifyBoWCandidateAt(const std::vector<KeyFrame*> &vpBowCand, const std::set<KeyFrame*> &spConnectedKeyFrames,
+                                       BoWCandidateResults &vResults, const int i)
+{
+    VerifyBoWCandidate(vpBowCand[i], spConnectedKeyFrames, vResults[i], static_cast<unsigned int>(mpCurrentKF->mnId)*1000u + i);
+}
+
+void LoopClosing::VerifyBoWCandidate(KeyFrame* pKFi, const std::set<KeyFrame*> &spConnectedKeyFrames, BoWCandidateResult &result,
+                                     const unsigned int nSeed)
 {
     int nBoWMatches = 20;
     int nBoWInliers = 15;
@@ -584,315 +723,287 @@ bool LoopClosing::DetectCommonRegionsFromBoW(std::vector<KeyFrame*> &vpBowCand,
     int nProjMatches = 50;
     int nProjOptMatches = 80;
 
-    set<KeyFrame*> spConnectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
-
     int nNumCovisibles = 10;
 
     ORBmatcher matcherBoW(0.9, true);
     ORBmatcher matcher(0.75, true);
 
-    // Varibles to select the best numbe
-    KeyFrame* pBestMatchedKF;
-    int nBestMatchesReproj = 0;
-    int nBestNumCoindicendes = 0;
-    g2o::Sim3 g2oBestScw;
-    std::vector<MapPoint*> vpBestMapPoints;
-    std::vector<MapPoint*> vpBestMatchedMapPoints;
-
-    int numCandidates = vpBowCand.size();
-    vector<int> vnStage(numCandidates, 0);
-    vector<int> vnMatchesStage(numCandidates, 0);
+    if(!pKFi || pKFi->isBad())
+        return;
 
-    int index = 0;
-    //Verbose::PrintMess("BoW candidates: There are " + to_string(vpBowCand.size()) + " possible candidates ", Verbose::VERBOSITY_DEBUG);
-    for(KeyFrame* pKFi : vpBowCand)
+    // std::cout << "KF candidate: " << pKFi->mnId << std::endl;
+    // Current KF against KF with covisibles version
+    std::vector<KeyFrame*> vpCovKFi = pKFi->GetBestCovisibilityKeyFrames(nNumCovisibles);
+    if(vpCovKFi.empty())
     {
-        if(!pKFi || pKFi->isBad())
-            continue;
+        std::cout << "Covisible list empty" << std::endl;
+        vpCovKFi.push_back(pKFi);
+    }
+    else
+    {
+        vpCovKFi.push_back(vpCovKFi[0]);
+        vpCovKFi[0] = pKFi;
+    }
 
-        // std::cout << "KF candidate: " << pKFi->mnId << std::endl;
-        // Current KF against KF with covisibles version
-        std::vector<KeyFrame*> vpCovKFi = pKFi->GetBestCovisibilityKeyFrames(nNumCovisibles);
-        if(vpCovKFi.empty())
-        {
-            std::cout << "Covisible list empty" << std::endl;
-            vpCovKFi.push_back(pKFi);
-        }
-        else
+
+    bool bAbortByNearKF = false;
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        if(spConnectedKeyFrames.find(vpCovKFi[j]) != spConnectedKeyFrames.end())
         {
-            vpCovKFi.push_back(vpCovKFi[0]);
-            vpCovKFi[0] = pKFi;
+            bAbortByNearKF = true;
+            break;
         }
+    }
+    if(bAbortByNearKF)
+    {
+        //std::cout << "Check BoW aborted because is close to the matched one " << std::endl;
+        return;
+    }
+    //std::cout << "Check BoW continue because is far to the matched one " << std::endl;
 
 
-        bool bAbortByNearKF = false;
-        for(int j=0; j<vpCovKFi.size(); ++j)
-        {
-            if(spConnectedKeyFrames.find(vpCovKFi[j]) != spConnectedKeyFrames.end())
-            {
-                bAbortByNearKF = true;
-                break;
-            }
-        }
-        if(bAbortByNearKF)
-        {
-            //std::cout << "Check BoW aborted because is close to the matched one " << std::endl;
-            continue;
-        }
-        //std::cout << "Check BoW continue because is far to the matched one " << std::endl;
+    std::vector<std::vector<MapPoint*> > vvpMatchedMPs;
+    vvpMatchedMPs.resize(vpCovKFi.size());
+    std::set<MapPoint*> spMatchedMPi;
+    int numBoWMatches = 0;
 
+    KeyFrame* pMostBoWMatchesKF = pKFi;
+    int nMostBoWNumMatches = 0;
 
-        std::vector<std::vector<MapPoint*> > vvpMatchedMPs;
-        vvpMatchedMPs.resize(vpCovKFi.size());
-        std::set<MapPoint*> spMatchedMPi;
-        int numBoWMatches = 0;
+    std::vector<MapPoint*> vpMatchedPoints = std::vector<MapPoint*>(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
+    std::vector<KeyFrame*> vpKeyFrameMatchedMP = std::vector<KeyFrame*>(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFrame*>(NULL));
 
-        KeyFrame* pMostBoWMatchesKF = pKFi;
-        int nMostBoWNumMatches = 0;
+    int nIndexMostBoWMatchesKF=0;
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        if(!vpCovKFi[j] || vpCovKFi[j]->isBad())
+            continue;
 
-        std::vector<MapPoint*> vpMatchedPoints = std::vector<MapPoint*>(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
-        std::vector<KeyFrame*> vpKeyFrameMatchedMP = std::vector<KeyFrame*>(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFrame*>(NULL));
+        int num = SearchByBoWCached(matcherBoW, vpCovKFi[j], vvpMatchedMPs[j]);
+        if (num > nMostBoWNumMatches)
+        {
+            nMostBoWNumMatches = num;
+            nIndexMostBoWMatchesKF = j;
+        }
+    }
 
-        int nIndexMostBoWMatchesKF=0;
-        for(int j=0; j<vpCovKFi.size(); ++j)
+    for(int j=0; j<vpCovKFi.size(); ++j)
+    {
+        for(int k=0; k < vvpMatchedMPs[j].size(); ++k)
         {
-            if(!vpCovKFi[j] || vpCovKFi[j]->isBad())
+            MapPoint* pMPi_j = vvpMatchedMPs[j][k];
+            if(!pMPi_j || pMPi_j->isBad())
                 continue;
 
-            int num = matcherBoW.SearchByBoW(mpCurrentKF, vpCovKFi[j], vvpMatchedMPs[j]);
-            if (num > nMostBoWNumMatches)
+            if(spMatchedMPi.find(pMPi_j) == spMatchedMPi.end())
             {
-                nMostBoWNumMatches = num;
-                nIndexMostBoWMatchesKF = j;
+                spMatchedMPi.insert(pMPi_j);
+                numBoWMatches++;
+
+                vpMatchedPoints[k]= pMPi_j;
+                vpKeyFrameMatchedMP[k] = vpCovKFi[j];
             }
         }
+    }
 
-        for(int j=0; j<vpCovKFi.size(); ++j)
-        {
-            for(int k=0; k < vvpMatchedMPs[j].size(); ++k)
-            {
-                MapPoint* pMPi_j = vvpMatchedMPs[j][k];
-                if(!pMPi_j || pMPi_j->isBad())
-                    continue;
-
-                if(spMatchedMPi.find(pMPi_j) == spMatchedMPi.end())
-                {
-                    spMatchedMPi.insert(pMPi_j);
-                    numBoWMatches++;
+    //pMostBoWMatchesKF = vpCovKFi[pMostBoWMatchesKF];
 
-                    vpMatchedPoints[k]= pMPi_j;
-                    vpKeyFrameMatchedMP[k] = vpCovKFi[j];
-                }
-            }
-        }
+    if(numBoWMatches >= nBoWMatches) // TODO pick a good threshold
+    {
+        // Geometric validation
+        bool bFixedScale = mbFixScale;
+        if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
+            bFixedScale=false;
 
-        //pMostBoWMatchesKF = vpCovKFi[pMostBoWMatchesKF];
+        Sim3Solver solver = Sim3Solver(mpCurrentKF, pMostBoWMatchesKF, vpMatchedPoints, bFixedScale, vpKeyFrameMatchedMP);
+        solver.SetRansacParameters(0.99, nBoWInliers, 300); // at least 15 inliers
+        solver.SetSeed(nSeed);
 
-        if(numBoWMatches >= nBoWMatches) // TODO pick a good threshold
+        bool bNoMore = false;
+        vector<bool> vbInliers;
+        int nInliers;
+        bool bConverge = false;
+        Eigen::Matrix4f mTcm;
+        while(!bConverge && !bNoMore)
         {
-            // Geometric validation
-            bool bFixedScale = mbFixScale;
-            if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
-                bFixedScale=false;
-
-            Sim3Solver solver = Sim3Solver(mpCurrentKF, pMostBoWMatchesKF, vpMatchedPoints, bFixedScale, vpKeyFrameMatchedMP);
-            solver.SetRansacParameters(0.99, nBoWInliers, 300); // at least 15 inliers
-
-            bool bNoMore = false;
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bConverge = false;
-            Eigen::Matrix4f mTcm;
-            while(!bConverge && !bNoMore)
-            {
-                mTcm = solver.iterate(20,bNoMore, vbInliers, nInliers, bConverge);
-                //Verbose::PrintMess("BoW guess: Solver achieve " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
-            }
+            mTcm = solver.iterate(20,bNoMore, vbInliers, nInliers, bConverge);
+            //Verbose::PrintMess("BoW guess: Solver achieve " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
+        }
 
-            if(bConverge)
-            {
-                //std::cout << "Check BoW: SolverSim3 converged" << std::endl;
+        if(bConverge)
+        {
+            //std::cout << "Check BoW: SolverSim3 converged" << std::endl;
 
-                //Verbose::PrintMess("BoW guess: Convergende with " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
-                // Match by reprojection
-                vpCovKFi.clear();
-                vpCovKFi = pMostBoWMatchesKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
-                vpCovKFi.push_back(pMostBoWMatchesKF);
-                set<KeyFrame*> spCheckKFs(vpCovKFi.begin(), vpCovKFi.end());
+            //Verbose::PrintMess("BoW guess: Convergende with " + to_string(nInliers) + " geometrical inliers among " + to_string(nBoWInliers) + " BoW matches", Verbose::VERBOSITY_DEBUG);
+            // Match by reprojection
+            vpCovKFi.clear();
+            vpCovKFi = pMostBoWMatchesKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
+            vpCovKFi.push_back(pMostBoWMatchesKF);
+            set<KeyFrame*> spCheckKFs(vpCovKFi.begin(), vpCovKFi.end());
 
-                //std::cout << "There are " << vpCovKFi.size() <<" near KFs" << std::endl;
+            //std::cout << "There are " << vpCovKFi.size() <<" near KFs" << std::endl;
 
-                set<MapPoint*> spMapPoints;
-                vector<MapPoint*> vpMapPoints;
-                vector<KeyFrame*> vpKeyFrames;
-                for(KeyFrame* pCovKFi : vpCovKFi)
+            set<MapPoint*> spMapPoints;
+            vector<MapPoint*> vpMapPoints;
+            vector<KeyFrame*> vpKeyFrames;
+            for(KeyFrame* pCovKFi : vpCovKFi)
+            {
+                for(MapPoint* pCovMPij : pCovKFi->GetMapPointMatches())
                 {
-                    for(MapPoint* pCovMPij : pCovKFi->GetMapPointMatches())
-                    {
-                        if(!pCovMPij || pCovMPij->isBad())
-                            continue;
+                    if(!pCovMPij || pCovMPij->isBad())
+                        continue;
 
-                        if(spMapPoints.find(pCovMPij) == spMapPoints.end())
-                        {
-                            spMapPoints.insert(pCovMPij);
-                            vpMapPoints.push_back(pCovMPij);
-                            vpKeyFrames.push_back(pCovKFi);
-                        }
+                    if(spMapPoints.find(pCovMPij) == spMapPoints.end())
+                    {
+                        spMapPoints.insert(pCovMPij);
+                        vpMapPoints.push_back(pCovMPij);
+                        vpKeyFrames.push_back(pCovKFi);
                     }
                 }
+            }
 
-                //std::cout << "There are " << vpKeyFrames.size() <<" KFs which view all the mappoints" << std::endl;
+            //std::cout << "There are " << vpKeyFrames.size() <<" KFs which view all the mappoints" << std::endl;
 
-                g2o::Sim3 gScm(solver.GetEstimatedRotation().cast<double>(),solver.GetEstimatedTranslation().cast<double>(), (double) solver.GetEstimatedScale());
-                g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
-                g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
-                Sophus::Sim3f mScw = Converter::toSophus(gScw);
+            g2o::Sim3 gScm(solver.GetEstimatedRotation().cast<double>(),solver.GetEstimatedTranslation().cast<double>(), (double) solver.GetEstimatedScale());
+            g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
+            g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
+            Sophus::Sim3f mScw = Converter::toSophus(gScw);
 
-                vector<MapPoint*> vpMatchedMP;
-                vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
-                vector<KeyFrame*> vpMatchedKF;
-                vpMatchedKF.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFrame*>(NULL));
-                int numProjMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpKeyFrames, vpMatchedMP, vpMatchedKF, 8, 1.5);
-                //cout <<"BoW: " << numProjMatches << " matches between " << vpMapPoints.size() << " points with coarse Sim3" << endl;
+            vector<MapPoint*> vpMatchedMP;
+            vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
+            vector<KeyFrame*> vpMatchedKF;
+            vpMatchedKF.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<KeyFrame*>(NULL));
+            int numProjMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpKeyFrames, vpMatchedMP, vpMatchedKF, 8, 1.5);
+            //cout <<"BoW: " << numProjMatches << " matches between " << vpMapPoints.size() << " points with coarse Sim3" << endl;
 
-                if(numProjMatches >= nProjMatches)
-                {
-                    // Optimize Sim3 transformation with every matches
-                    Eigen::Matrix<double, 7, 7> mHessian7x7;
+            if(numProjMatches >= nProjMatches)
+            {
+                // Optimize Sim3 transformation with every matches
+                Eigen::Matrix<double, 7, 7> mHessian7x7;
 
-                    bool bFixedScale = mbFixScale;
-                    if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
-                        bFixedScale=false;
+                bool bFixedScale = mbFixScale;
+                if(mpTracker->mSensor==System::IMU_MONOCULAR && !mpCurrentKF->GetMap()->GetIniertialBA2())
+                    bFixedScale=false;
 
-                    int numOptMatches = Optimizer::OptimizeSim3(mpCurrentKF, pKFi, vpMatchedMP, gScm, 10, mbFixScale, mHessian7x7, true);
+                int numOptMatches = Optimizer::OptimizeSim3(mpCurrentKF, pKFi, vpMatchedMP, gScm, 10, mbFixScale, mHessian7x7, true);
 
-                    if(numOptMatches >= nSim3Inliers)
-                    {
-                        g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
-                        g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
-                        Sophus::Sim3f mScw = Converter::toSophus(gScw);
+                if(numOptMatches >= nSim3Inliers)
+                {
+                    g2o::Sim3 gSmw(pMostBoWMatchesKF->GetRotation().cast<double>(),pMostBoWMatchesKF->GetTranslation().cast<double>(),1.0);
+                    g2o::Sim3 gScw = gScm*gSmw; // Similarity matrix of current from the world position
+                    Sophus::Sim3f mScw = Converter::toSophus(gScw);
 
-                        vector<MapPoint*> vpMatchedMP;
-                        vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
-                        int numProjOptMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpMatchedMP, 5, 1.0);
+                    vector<MapPoint*> vpMatchedMP;
+                    vpMatchedMP.resize(mpCurrentKF->GetMapPointMatches().size(), static_cast<MapPoint*>(NULL));
+                    int numProjOptMatches = matcher.SearchByProjection(mpCurrentKF, mScw, vpMapPoints, vpMatchedMP, 5, 1.0);
 
-                        if(numProjOptMatches >= nProjOptMatches)
+                    if(numProjOptMatches >= nProjOptMatches)
+                    {
+                        int max_x = -1, min_x = 1000000;
+                        int max_y = -1, min_y = 1000000;
+                        for(MapPoint* pMPi : vpMatchedMP)
                         {
-                            int max_x = -1, min_x = 1000000;
-                            int max_y = -1, min_y = 1000000;
-                            for(MapPoint* pMPi : vpMatchedMP)
+                            if(!pMPi || pMPi->isBad())
+                            {
+                                continue;
+                            }
+
+                            tuple<size_t,size_t> indexes = pMPi->GetIndexInKeyFrame(pKFi);
+                            int index = get<0>(indexes);
+                            if(index >= 0)
                             {
-                                if(!pMPi || pMPi->isBad())
+                                int coord_x = pKFi->mvKeysUn[index].pt.x;
+                                if(coord_x < min_x)
                                 {
-                                    continue;
+                                    min_x = coord_x;
                                 }
-
-                                tuple<size_t,size_t> indexes = pMPi->GetIndexInKeyFrame(pKFi);
-                                int index = get<0>(indexes);
-                                if(index >= 0)
+                                if(coord_x > max_x)
                                 {
-                                    int coord_x = pKFi->mvKeysUn[index].pt.x;
-                                    if(coord_x < min_x)
-                                    {
-                                        min_x = coord_x;
-                                    }
-                                    if(coord_x > max_x)
-                                    {
-                                        max_x = coord_x;
-                                    }
-                                    int coord_y = pKFi->mvKeysUn[index].pt.y;
-                                    if(coord_y < min_y)
-                                    {
-                                        min_y = coord_y;
-                                    }
-                                    if(coord_y > max_y)
-                                    {
-                                        max_y = coord_y;
-                                    }
+                                    max_x = coord_x;
                                 }
-                            }
-
-                            int nNumKFs = 0;
-                            //vpMatchedMPs = vpMatchedMP;
-                            //vpMPs = vpMapPoints;
-                            // Check the Sim3 transformation with the current KeyFrame covisibles
-                            vector<KeyFrame*> vpCurrentCovKFs = mpCurrentKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
-
-                            int j = 0;
-                            while(nNumKFs < 3 && j<vpCurrentCovKFs.size())
-                            {
-                                KeyFrame* pKFj = vpCurrentCovKFs[j];
-                                Sophus::SE3d mTjc = (pKFj->GetPose() * mpCurrentKF->GetPoseInverse()).cast<double>();
-                                g2o::Sim3 gSjc(mTjc.unit_quaternion(),mTjc.translation(),1.0);
-                                g2o::Sim3 gSjw = gSjc * gScw;
-                                int numProjMatches_j = 0;
-                                vector<MapPoint*> vpMatchedMPs_j;
-                                bool bValid = DetectCommonRegionsFromLastKF(pKFj,pMostBoWMatchesKF, gSjw,numProjMatches_j, vpMapPoints, vpMatchedMPs_j);
-
-                                if(bValid)
+                                int coord_y = pKFi->mvKeysUn[index].pt.y;
+                                if(coord_y < min_y)
                                 {
-                                    Sophus::SE3f Tc_w = mpCurrentKF->GetPose();
-                                    Sophus::SE3f Tw_cj = pKFj->GetPoseInverse();
-                                    Sophus::SE3f Tc_cj = Tc_w * Tw_cj;
-                                    Eigen::Vector3f vector_dist = Tc_cj.translation();
-                                    nNumKFs++;
+                                    min_y = coord_y;
+                                }
+                                if(coord_y > max_y)
+                                {
+                                    max_y = coord_y;
                                 }
-                                j++;
                             }
+                        }
 
-                            if(nNumKFs < 3)
-                            {
-                                vnStage[index] = 8;
-                                vnMatchesStage[index] = nNumKFs;
-                            }
+                        int nNumKFs = 0;
+                        //vpMatchedMPs = vpMatchedMP;
+                        //vpMPs = vpMapPoints;
+                        // Check the Sim3 transformation with the current KeyFrame covisibles
+                        vector<KeyFrame*> vpCurrentCovKFs = mpCurrentKF->GetBestCovisibilityKeyFrames(nNumCovisibles);
 
-                            if(nBestMatchesReproj < numProjOptMatches)
+                        int j = 0;
+                        while(nNumKFs < 3 && j<vpCurrentCovKFs.size())
+                        {
+                            KeyFrame* pKFj = vpCurrentCovKFs[j];
+                            Sophus::SE3d mTjc = (pKFj->GetPose() * mpCurrentKF->GetPoseInverse()).cast<double>();
+                            g2o::Sim3 gSjc(mTjc.unit_quaternion(),mTjc.translation(),1.0);
+                            g2o::Sim3 gSjw = gSjc * gScw;
+                            int numProjMatches_j = 0;
+                            vector<MapPoint*> vpMatchedMPs_j;
+                            bool bValid = DetectCommonRegionsFromLastKF(pKFj,pMostBoWMatchesKF, gSjw,numProjMatches_j, vpMapPoints, vpMatchedMPs_j);
+
+                            if(bValid)
                             {
-                                nBestMatchesReproj = numProjOptMatches;
-                                nBestNumCoindicendes = nNumKFs;
-                                pBestMatchedKF = pMostBoWMatchesKF;
-                                g2oBestScw = gScw;
-                                vpBestMapPoints = vpMapPoints;
-                                vpBestMatchedMapPoints = vpMatchedMP;
+                                Sophus::SE3f Tc_w = mpCurrentKF->GetPose();
+                                Sophus::SE3f Tw_cj = pKFj->GetPoseInverse();
+                                Sophus::SE3f Tc_cj = Tc_w * Tw_cj;
+                                Eigen::Vector3f vector_dist = Tc_cj.translation();
+                                nNumKFs++;
                             }
+                            j++;
                         }
+
+                        if(nNumKFs < 3)
+                        {
+                            result.nStage = 8;
+                            result.nMatchesStage = nNumKFs;
+                        }
+
+                        result.nProjOptMatches = numProjOptMatches;
+                        result.nNumCoincidences = nNumKFs;
+                        result.pMatchedKF = pMostBoWMatchesKF;
+                        result.g2oScw = gScw;
+                        result.vpMapPoints = vpMapPoints;
+                        result.vpMatchedMapPoints = vpMatchedMP;
                     }
                 }
             }
-            /*else
-            {
-                Verbose::PrintMess("BoW candidate: it don't match with the current one", Verbose::VERBOSITY_DEBUG);
-            }*/
         }
-        index++;
+        /*else
+        {
+            Verbose::PrintMess("BoW candidate: it don't match with the current one", Verbose::VERBOSITY_DEBUG);
+        }*/
     }
+}
 
-    if(nBestMatchesReproj > 0)
-    {
-        pLastCurrentKF = mpCurrentKF;
-        nNumCoincidences = nBestNumCoindicendes;
-        pMatchedKF2 = pBestMatchedKF;
-        pMatchedKF2->SetNotErase();
-        g2oScw = g2oBestScw;
-        vpMPs = vpBestMapPoints;
-        vpMatchedMPs = vpBestMatchedMapPoints;
-
-        return nNumCoincidences >= 3;
-    }
-    else
+int LoopClosing::SearchByBoWCached(ORBmatcher &matcher, KeyFrame* pKF, std::vector<MapPoint*> &vpMatches)
+{
     {
-        int maxStage = -1;
-        int maxMatched;
-        for(int i=0; i<vnStage.size(); ++i)
+        unique_lock<mutex> lock(mMutexBoWCache);
+        map<KeyFrame*,BoWMatches>::const_iterator it = mmBoWMatchesCache.find(pKF);
+        if(it != mmBoWMatchesCache.end())
         {
-            if(vnStage[i] > maxStage)
-            {
-                maxStage = vnStage[i];
-                maxMatched = vnMatchesStage[i];
-            }
+            vpMatches = it->second.vpMatches;
+            return it->second.nMatches;
         }
     }
-    return false;
+
+    const int nMatches = matcher.SearchByBoW(mpCurrentKF, pKF, vpMatches);
+
+    unique_lock<mutex> lock(mMutexBoWCache);
+    BoWMatches &entry = mmBoWMatchesCache[pKF];
+    entry.nMatches = nMatches;
+    entry.vpMatches = vpMatches;
+    return nMatches;
 }
 
 bool LoopClosing::DetectCommonRegionsFromLastKF(KeyFrame* pCurrentKF, KeyFrame* pMatchedKF, g2o::Sim3 &gScw, int &nNumProjMatches,
@@ -993,10 +1104,7 @@ void LoopClosing::CorrectLoop()
     }
 
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
 
     // Ensure current keyframe is updated
     //cout << "Start updating connections" << endl;
@@ -1038,7 +1146,7 @@ void LoopClosing::CorrectLoop()
 
     {
         // Get Map Mutex
-        unique_lock<mutex> lock(pLoopMap->mMutexMapUpdate);
+        unique_lock<SharedMutex> lock(pLoopMap->mMutexMapUpdate);
 
         const bool bImuInit = pLoopMap->isImuInitialized();
 
@@ -1203,7 +1311,7 @@ void LoopClosing::CorrectLoop()
         mbStopGBA = false;
         mnCorrectionGBA = mnNumCorrection;
 
-        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, pLoopMap, mpCurrentKF->mnId);
+        LaunchGlobalBundleAdjustment(pLoopMap, mpCurrentKF->mnId);
     }
 
     // Loop closed. Release Local Mapping.
@@ -1247,10 +1355,7 @@ void LoopClosing::MergeLocal()
     //cout << "Request Stop Local Mapping" << endl;
     mpLocalMapper->RequestStop();
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
     //cout << "Local Map stopped" << endl;
 
     mpLocalMapper->EmptyQueue();
@@ -1504,8 +1609,8 @@ void LoopClosing::MergeLocal()
     }*/
 
     {
-        unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
-        unique_lock<mutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
+        unique_lock<SharedMutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
+        unique_lock<SharedMutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
 
         //std::cout << "Merge local window: " << spLocalWindowKFs.size() << std::endl;
         //std::cout << "[Merge]: init merging maps " << std::endl;
@@ -1646,7 +1751,7 @@ void LoopClosing::MergeLocal()
     else {
         if(mpTracker->mSensor == System::MONOCULAR)
         {
-            unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
+            unique_lock<SharedMutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
 
             for(KeyFrame* pKFi : vpCurrentMapKFs)
             {
@@ -1706,10 +1811,7 @@ void LoopClosing::MergeLocal()
 
         mpLocalMapper->RequestStop();
         // Wait until Local Mapping has effectively stopped
-        while(!mpLocalMapper->isStopped())
-        {
-            usleep(1000);
-        }
+        mpLocalMapper->WaitUntilStopped();
 
         // Optimize graph (and update the loop position for each element form the begining to the end)
         if(mpTracker->mSensor != System::MONOCULAR)
@@ -1720,8 +1822,8 @@ void LoopClosing::MergeLocal()
 
         {
             // Get Merge Map Mutex
-            unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
-            unique_lock<mutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
+            unique_lock<SharedMutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
+            unique_lock<SharedMutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
 
             //std::cout << "Merge outside KFs: " << vpCurrentMapKFs.size() << std::endl;
             for(KeyFrame* pKFi : vpCurrentMapKFs)
@@ -1766,7 +1868,7 @@ void LoopClosing::MergeLocal()
         mbRunningGBA = true;
         mbFinishedGBA = false;
         mbStopGBA = false;
-        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this, pMergeMap, mpCurrentKF->mnId);
+        LaunchGlobalBundleAdjustment(pMergeMap, mpCurrentKF->mnId);
     }
 
     mpMergeMatchedKF->AddMergeEdge(mpCurrentKF);
@@ -1820,10 +1922,7 @@ void LoopClosing::MergeLocal2()
     //cout << "Request Stop Local Mapping" << endl;
     mpLocalMapper->RequestStop();
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
     //cout << "Local Map stopped" << endl;
 
     Map* pCurrentMap = mpCurrentKF->GetMap();
@@ -1833,7 +1932,7 @@ void LoopClosing::MergeLocal2()
         float s_on = mSold_new.scale();
         Sophus::SE3f T_on(mSold_new.rotation().cast<float>(), mSold_new.translation().cast<float>());
 
-        unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+        unique_lock<SharedMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
 
         //cout << "KFs before empty: " << mpAtlas->GetCurrentMap()->KeyFramesInMap() << endl;
         mpLocalMapper->EmptyQueue();
@@ -1862,7 +1961,7 @@ void LoopClosing::MergeLocal2()
         ba << 0., 0., 0.;
         Optimizer::InertialOptimization(pCurrentMap,bg,ba);
         IMU::Bias b (ba[0],ba[1],ba[2],bg[0],bg[1],bg[2]);
-        unique_lock<mutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
+        unique_lock<SharedMutex> lock(mpAtlas->GetCurrentMap()->mMutexMapUpdate);
         mpTracker->UpdateFrameIMU(1.0f,b,mpTracker->GetLastKeyFrame());
 
         // Set map initialized
@@ -1879,8 +1978,8 @@ void LoopClosing::MergeLocal2()
     //cout << "updating current map" << endl;
     {
         // Get Merge Map Mutex (This section stops tracking!!)
-        unique_lock<mutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
-        unique_lock<mutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
+        unique_lock<SharedMutex> currentLock(pCurrentMap->mMutexMapUpdate); // We update the current map with the Merge information
+        unique_lock<SharedMutex> mergeLock(pMergeMap->mMutexMapUpdate); // We remove the Kfs and MPs in the merged area from the old map
 
 
         vector<KeyFrame*> vpMergeMapKFs = pMergeMap->GetAllKeyFrames();
@@ -2077,7 +2176,7 @@ void LoopClosing::CheckObservations(set<KeyFrame*> &spKFsMap1, set<KeyFrame*> &s
                 continue;
             }
 
-            map<KeyFrame*, tuple<int,int>> mMPijObs = pMPij->GetObservations();
+            MapPoint::ObservationMap mMPijObs = pMPij->GetObservations();
             for(KeyFrame* pKFi2 : spKFsMap2)
             {
                 if(mMPijObs.find(pKFi2) != mMPijObs.end())
@@ -2133,7 +2232,7 @@ void LoopClosing::SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap, vector
         int numFused = matcher.Fuse(pKFi,Scw,vpMapPoints,4,vpReplacePoints);
 
         // Get Map Mutex
-        unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+        unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
         const int nLP = vpMapPoints.size();
         for(int i=0; i<nLP;i++)
         {
@@ -2178,7 +2277,7 @@ void LoopClosing::SearchAndFuse(const vector<KeyFrame*> &vConectedKFs, vector<Ma
         matcher.Fuse(pKF,Scw,vpMapPoints,4,vpReplacePoints);
 
         // Get Map Mutex
-        unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+        unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
         const int nLP = vpMapPoints.size();
         for(int i=0; i<nLP;i++)
         {
@@ -2203,16 +2302,11 @@ void LoopClosing::RequestReset()
         unique_lock<mutex> lock(mMutexReset);
         mbResetRequested = true;
     }
+    WakeUp();
 
-    while(1)
-    {
-        {
-        unique_lock<mutex> lock2(mMutexReset);
-        if(!mbResetRequested)
-            break;
-        }
-        usleep(5000);
-    }
+    unique_lock<mutex> lock2(mMutexReset);
+    while(mbResetRequested)
+        mCondReset.wait(lock2);
 }
 
 void LoopClosing::RequestResetActiveMap(Map *pMap)
@@ -2222,16 +2316,11 @@ void LoopClosing::RequestResetActiveMap(Map *pMap)
         mbResetActiveMapRequested = true;
         mpMapToReset = pMap;
     }
+    WakeUp();
 
-    while(1)
-    {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetActiveMapRequested)
-                break;
-        }
-        usleep(3000);
-    }
+    unique_lock<mutex> lock2(mMutexReset);
+    while(mbResetActiveMapRequested)
+        mCondReset.wait(lock2);
 }
 
 void LoopClosing::ResetIfRequested()
@@ -2242,8 +2331,11 @@ void LoopClosing::ResetIfRequested()
         cout << "Loop closer reset requested..." << endl;
         mlpLoopKeyFrameQueue.clear();
         mLastLoopKFid=0;  //TODO old variable, it is not use in the new algorithm
+        mpGlobalBAProblem->Clear();
+        mmBoWMatchesCache.clear();
         mbResetRequested=false;
         mbResetActiveMapRequested = false;
+        mCondReset.notify_all();
     }
     else if(mbResetActiveMapRequested)
     {
@@ -2260,8 +2352,10 @@ void LoopClosing::ResetIfRequested()
         }
 
         mLastLoopKFid=mpAtlas->GetLastInitKFid(); //TODO old variable, it is not use in the new algorithm
+        mpGlobalBAProblem->Clear();
+        mmBoWMatchesCache.clear();
         mbResetActiveMapRequested=false;
-
+        mCondReset.notify_all();
     }
 }
 
@@ -2279,11 +2373,14 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
 #endif
 
     const bool bImuInit = pActiveMap->isImuInitialized();
+    TaskScheduler* pBAScheduler = mbParallelBA ? mpScheduler : static_cast<TaskScheduler*>(NULL);
 
+    // Large maps are solved with inexact PCG, the Cholesky factor of their reduced camera system gets dense.
+    // A visual GBA stopped by a new loop keeps its estimates and the next one resumes from them.
     if(!bImuInit)
-        Optimizer::GlobalBundleAdjustemnt(pActiveMap,10,&mbStopGBA,nLoopKF,false);
+        mpGlobalBAProblem->Optimize(pActiveMap,10,&mbStopGBA,nLoopKF,false,pBAScheduler,Optimizer::LINEAR_SOLVER_AUTO);
     else
-        Optimizer::FullInertialBA(pActiveMap,7,false,nLoopKF,&mbStopGBA);
+        Optimizer::FullInertialBA(pActiveMap,7,false,nLoopKF,&mbStopGBA,false,1e2,1e6,NULL,NULL,pBAScheduler,Optimizer::LINEAR_SOLVER_AUTO);
 
 #ifdef REGISTER_TIMES
     std::chrono::steady_clock::time_point time_EndGBA = std::chrono::steady_clock::now();
@@ -2300,6 +2397,11 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
     int idx =  mnFullBAIdx;
     // Optimizer::GlobalBundleAdjustemnt(mpMap,10,&mbStopGBA,nLoopKF,false);
 
+    // The corrected poses are computed before stopping anything, they are published below
+    GBAUpdate update;
+    const bool bPrepared = mbNonBlockingGBAUpdate && !mbStopGBA && (bImuInit || !pActiveMap->isImuInitialized()) &&
+            PrepareGBAUpdate(pActiveMap, nLoopKF, idx, update);
+
     // Update all MapPoints and KeyFrames
     // Local Mapping was active during BA, that means that there might be new keyframes
     // not included in the Global BA and they are not consistent with the updated map.
@@ -2310,9 +2412,25 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
             return;
 
         if(!bImuInit && pActiveMap->isImuInitialized())
-            return;
+        {
+            // The IMU was initialized during the visual GBA, its result is discarded
+        }
+        else if(!mbStopGBA && bPrepared)
+        {
+            PublishGBAUpdate(pActiveMap, nLoopKF, update);
 
-        if(!mbStopGBA)
+#ifdef REGISTER_TIMES
+            std::chrono::steady_clock::time_point time_EndUpdateMap = std::chrono::steady_clock::now();
+
+            double timeUpdateMap = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndUpdateMap - time_EndGBA).count();
+            vdUpdateMap_ms.push_back(timeUpdateMap);
+
+            double timeFGBA = std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndUpdateMap - time_StartFGBA).count();
+            vdFGBATotal_ms.push_back(timeFGBA);
+#endif
+            Verbose::PrintMess("Map updated!", Verbose::VERBOSITY_NORMAL);
+        }
+        else if(!mbStopGBA)
         {
             Verbose::PrintMess("Global Bundle Adjustment finished", Verbose::VERBOSITY_NORMAL);
             Verbose::PrintMess("Updating map ...", Verbose::VERBOSITY_NORMAL);
@@ -2320,13 +2438,10 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
             mpLocalMapper->RequestStop();
             // Wait until Local Mapping has effectively stopped
 
-            while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             // Get Map Mutex
-            unique_lock<mutex> lock(pActiveMap->mMutexMapUpdate);
+            unique_lock<SharedMutex> lock(pActiveMap->mMutexMapUpdate);
             // cout << "LC: Update Map Mutex adquired" << endl;
 
             //pActiveMap->PrintEssentialGraph();
@@ -2336,13 +2451,13 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
             while(!lpKFtoCheck.empty())
             {
                 KeyFrame* pKF = lpKFtoCheck.front();
-                const set<KeyFrame*> sChilds = pKF->GetChilds();
+                const KeyFrame::EdgeSet sChilds = pKF->GetChilds();
                 //cout << "---Updating KF " << pKF->mnId << " with " << sChilds.size() << " childs" << endl;
                 //cout << " KF mnBAGlobalForKF: " << pKF->mnBAGlobalForKF << endl;
                 Sophus::SE3f Twc = pKF->GetPoseInverse();
                 //cout << "Twc: " << Twc << endl;
                 //cout << "GBA: Correct KeyFrames" << endl;
-                for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+                for(KeyFrame::EdgeSet::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
                 {
                     KeyFrame* pChild = *sit;
                     if(!pChild || pChild->isBad())
@@ -2507,14 +2622,239 @@ void LoopClosing::RunGlobalBundleAdjustment(Map* pActiveMap, unsigned long nLoop
 
         mbFinishedGBA = true;
         mbRunningGBA = false;
+        mCondGBA.notify_all();
     }
 }
 
+bool LoopClosing::PrepareGBAUpdate(Map* pActiveMap, unsigned long nLoopKF, int nFullBAIdx, GBAUpdate &update)
+{
+    update.vKeyFrames.clear();
+    update.vMapPoints.clear();
+    update.nFirstNewKFid = KeyFrame::nNextId;
+    update.nFirstNewMPid = MapPoint::nNextId;
+
+    // Correct keyframes starting at map first keyframe, the ones not included in the GBA get the
+    // correction of their parent
+    list<KeyFrame*> lpKFtoCheck(pActiveMap->mvpKeyFrameOrigins.begin(),pActiveMap->mvpKeyFrameOrigins.end());
+
+    while(!lpKFtoCheck.empty())
+    {
+        if(mbStopGBA || nFullBAIdx!=mnFullBAIdx)
+            return false;
+
+        KeyFrame* pKF = lpKFtoCheck.front();
+        const KeyFrame::EdgeSet sChilds = pKF->GetChilds();
+        const Sophus::SE3f Tcw = pKF->GetPose();
+        const Sophus::SE3f Twc = Tcw.inverse();
+        for(KeyFrame::EdgeSet::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+        {
+            KeyFrame* pChild = *sit;
+            if(!pChild || pChild->isBad())
+                continue;
+
+            if(pChild->mnBAGlobalForKF!=nLoopKF)
+            {
+                Sophus::SE3f Tchildc = pChild->GetPose() * Twc;
+                pChild->mTcwGBA = Tchildc * pKF->mTcwGBA;
+
+                Sophus::SO3f Rcor = pChild->mTcwGBA.so3().inverse() * pChild->GetPose().so3();
+                if(pChild->isVelocitySet()){
+                    pChild->mVwbGBA = Rcor * pChild->GetVelocity();
+                }
+                else
+                    Verbose::PrintMess("Child velocity empty!! ", Verbose::VERBOSITY_NORMAL);
+
+                pChild->mBiasGBA = pChild->GetImuBias();
+
+                pChild->mnBAGlobalForKF = nLoopKF;
+            }
+            lpKFtoCheck.push_back(pChild);
+        }
+
+        GBAKeyFrameUpdate kfUpdate;
+        kfUpdate.pKF = pKF;
+        kfUpdate.TcwPrepared = Tcw;
+        update.vKeyFrames.push_back(kfUpdate);
+
+        lpKFtoCheck.pop_front();
+    }
+
+    // MapPoints, the ones created from now on are corrected when publishing
+    const vector<MapPoint*> vpMPs = pActiveMap->GetAllMapPoints();
+    update.vMapPoints.reserve(vpMPs.size());
+
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+
+        if(pMP->isBad() || pMP->mnId >= update.nFirstNewMPid)
+            continue;
+
+        GBAMapPointUpdate mpUpdate;
+        mpUpdate.pMP = pMP;
+        mpUpdate.PosPrepared = pMP->GetWorldPos();
+
+        if(pMP->mnBAGlobalForKF==nLoopKF)
+        {
+            // If optimized by Global BA, just update
+            mpUpdate.PosCorrected = pMP->mPosGBA;
+        }
+        else
+        {
+            // Update according to the correction of its reference keyframe
+            KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+
+            if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                continue;
+
+            Eigen::Vector3f Xc = pRefKF->GetPose() * mpUpdate.PosPrepared;
+            mpUpdate.PosCorrected = pRefKF->mTcwGBA.inverse() * Xc;
+        }
+        update.vMapPoints.push_back(mpUpdate);
+    }
+
+    return !mbStopGBA && nFullBAIdx==mnFullBAIdx;
+}
+
+void LoopClosing::PublishGBAUpdate(Map* pActiveMap, unsigned long nLoopKF, const GBAUpdate &update)
+{
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_StartPublish = std::chrono::steady_clock::now();
+#endif
+
+    // Get Map Mutex. Local Mapping keeps running, a local BA started before this point discards its
+    // result because the big change index of the map changes.
+    unique_lock<SharedMutex> lock(pActiveMap->mMutexMapUpdate);
+
+    // Keyframes of the spanning tree. If Local Mapping moved one after the update was prepared,
+    // the same world correction is applied to its current pose.
+    for(size_t i=0; i<update.vKeyFrames.size(); i++)
+    {
+        KeyFrame* pKF = update.vKeyFrames[i].pKF;
+        if(pKF->isBad())
+            continue;
+
+        pKF->mTcwBefGBA = pKF->GetPose();
+        pKF->SetPose(pKF->mTcwBefGBA * update.vKeyFrames[i].TcwPrepared.inverse() * pKF->mTcwGBA);
+
+        if(pKF->bImu)
+        {
+            pKF->mVwbBefGBA = pKF->GetVelocity();
+            pKF->SetVelocity(pKF->mVwbGBA);
+            pKF->SetNewBias(pKF->mBiasGBA);
+        }
+    }
+
+    // Keyframes created or attached to the tree while preparing, parents before children
+    const vector<KeyFrame*> vpKFs = pActiveMap->GetAllKeyFrames();
+    vector<KeyFrame*> vpNewKFs;
+    vector<KeyFrame*> vpKFsWithNewMPs;
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        if(pKF->isBad())
+            continue;
+        if(pKF->mnBAGlobalForKF!=nLoopKF)
+            vpNewKFs.push_back(pKF);
+        if(pKF->mnId >= update.nFirstNewKFid)
+            vpKFsWithNewMPs.push_back(pKF);
+    }
+    sort(vpNewKFs.begin(),vpNewKFs.end(),KeyFrame::lId);
+
+    for(size_t i=0; i<vpNewKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpNewKFs[i];
+        KeyFrame* pParent = pKF->GetParent();
+        if(!pParent || pParent->mnBAGlobalForKF!=nLoopKF)
+            continue;
+
+        Sophus::SE3f Tchildc = pKF->GetPose() * pParent->mTcwBefGBA.inverse();
+        pKF->mTcwBefGBA = pKF->GetPose();
+        pKF->mTcwGBA = Tchildc * pParent->GetPose();
+        pKF->SetPose(pKF->mTcwGBA);
+
+        if(pKF->bImu && pKF->isVelocitySet())
+        {
+            Sophus::SO3f Rcor = pKF->mTcwGBA.so3().inverse() * pKF->mTcwBefGBA.so3();
+            pKF->mVwbBefGBA = pKF->GetVelocity();
+            pKF->SetVelocity(Rcor * pKF->mVwbBefGBA);
+        }
+        pKF->mnBAGlobalForKF = nLoopKF;
+    }
+
+    // MapPoints of the update. If Local Mapping moved one, it is corrected with its reference keyframe.
+    for(size_t i=0; i<update.vMapPoints.size(); i++)
+    {
+        MapPoint* pMP = update.vMapPoints[i].pMP;
+        if(pMP->isBad())
+            continue;
+
+        const Eigen::Vector3f Xw = pMP->GetWorldPos();
+        if(Xw == update.vMapPoints[i].PosPrepared)
+        {
+            pMP->SetWorldPos(update.vMapPoints[i].PosCorrected);
+            continue;
+        }
+
+        KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+        if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+            continue;
+        pMP->SetWorldPos(pRefKF->GetPoseInverse() * (pRefKF->mTcwBefGBA * Xw));
+    }
+
+    // MapPoints created while preparing, all of them are seen by keyframes created meanwhile
+    set<MapPoint*> spNewMPs;
+    for(size_t i=0; i<vpKFsWithNewMPs.size(); i++)
+    {
+        const vector<MapPoint*> vpMPs = vpKFsWithNewMPs[i]->GetMapPointMatches();
+        for(size_t j=0; j<vpMPs.size(); j++)
+        {
+            MapPoint* pMP = vpMPs[j];
+            if(!pMP || pMP->isBad() || pMP->mnId < update.nFirstNewMPid || pMP->GetMap() != pActiveMap)
+                continue;
+            if(!spNewMPs.insert(pMP).second)
+                continue;
+
+            KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+            if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                continue;
+            pMP->SetWorldPos(pRefKF->GetPoseInverse() * (pRefKF->mTcwBefGBA * pMP->GetWorldPos()));
+        }
+    }
+
+    // New epoch of the map: the readers that check it (viewer, local BA) take the corrected state
+    pActiveMap->InformNewBigChange();
+    pActiveMap->IncreaseChangeIndex();
+
+#ifdef REGISTER_TIMES
+    std::chrono::steady_clock::time_point time_EndPublish = std::chrono::steady_clock::now();
+    vdGBAPublish_ms.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(time_EndPublish - time_StartPublish).count());
+#endif
+}
+
+void LoopClosing::SetNonBlockingGBAUpdate(const bool bNonBlocking)
+{
+    mbNonBlockingGBAUpdate = bNonBlocking;
+}
+
+void LoopClosing::SetParallelPlaceRecognition(const bool bSet)
+{
+    mbParallelPlaceRecognition = bSet;
+}
+
+void LoopClosing::SetParallelBA(const bool bSet)
+{
+    mbParallelBA = bSet;
+}
+
 void LoopClosing::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    // cout << "LC: Finish requested" << endl;
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        // cout << "LC: Finish requested" << endl;
+        mbFinishRequested = true;
+    }
+    WakeUp();
 }
 
 bool LoopClosing::CheckFinish()
@@ -2527,6 +2867,7 @@ void LoopClosing::SetFinish()
 {
     unique_lock<mutex> lock(mMutexFinish);
     mbFinished = true;
+    mCondFinish.notify_all();
 }
 
 bool LoopClosing::isFinished()
@@ -2535,5 +2876,19 @@ bool LoopClosing::isFinished()
     return mbFinished;
 }
 
+void LoopClosing::WaitUntilFinished()
+{
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        while(!mbFinished)
+            mCondFinish.wait(lock);
+    }
+
+    // A Global BA launched before the end still updates the map, a stopped one until it returns
+    unique_lock<mutex> lock(mMutexGBA);
+    while(mbRunningGBA)
+        mCondGBA.wait(lock);
+}
+
 
 } //namespace ORB_SLAM
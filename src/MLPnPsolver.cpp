@@ -96,6 +96,10 @@ namespace ORB_SLAM3 {
         SetRansacParameters();
     }
 
+    void MLPnPsolver::SetSeed(const unsigned int seed){
+        mRng.seed(seed);
+    }
+
     //RANSAC methods
     bool MLPnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInliers, int &nInliers, Eigen::Matrix4f &Tout){
         Tout.setIdentity();
@@ -127,7 +131,7 @@ namespace ORB_SLAM3 {
 	        // Get min set of points
 	        for(short i = 0; i < mRansacMinSet; ++i)
 	        {
-	            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+	            int randi = std::uniform_int_distribution<int>(0, vAvailableIndices.size()-1)(mRng);
 
 	            int idx = vAvailableIndices[randi];
 
@@ -257,38 +261,50 @@ namespace ORB_SLAM3 {
 	    mvMaxError.resize(mvSigma2.size());
 	    for(size_t i=0; i<mvSigma2.size(); i++)
 	        mvMaxError[i] = mvSigma2[i]*th2;
-	}
-
-    void MLPnPsolver::CheckInliers(){
-        mnInliersi=0;
 
+        mP3Dw.resize(3,N);
+        mP2D.resize(2,N);
+        mMaxError.resize(N);
         for(int i=0; i<N; i++)
         {
-            point_t p = mvP3Dw[i];
-            cv::Point3f P3Dw(p(0),p(1),p(2));
-            cv::Point2f P2D = mvP2D[i];
-
-            float xc = mRi[0][0]*P3Dw.x+mRi[0][1]*P3Dw.y+mRi[0][2]*P3Dw.z+mti[0];
-            float yc = mRi[1][0]*P3Dw.x+mRi[1][1]*P3Dw.y+mRi[1][2]*P3Dw.z+mti[1];
-            float zc = mRi[2][0]*P3Dw.x+mRi[2][1]*P3Dw.y+mRi[2][2]*P3Dw.z+mti[2];
+            mP3Dw.col(i) = mvP3Dw[i].cast<float>();
+            mP2D(0,i) = mvP2D[i].x;
+            mP2D(1,i) = mvP2D[i].y;
+            mMaxError(i) = mvMaxError[i];
+        }
+	}
 
-            cv::Point3f P3Dc(xc,yc,zc);
-            cv::Point2f uv = mpCamera->project(P3Dc);
+    void MLPnPsolver::CheckInliers(){
+        const Eigen::Matrix3f Rcw = Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> >(mRi[0]).cast<float>();
+        const Eigen::Vector3f tcw = Eigen::Map<const Eigen::Vector3d>(mti).cast<float>();
 
-            float distX = P2D.x-uv.x;
-            float distY = P2D.y-uv.y;
+        mP3Dc.noalias() = Rcw*mP3Dw;
+        mP3Dc.colwise() += tcw;
 
-            float error2 = distX*distX+distY*distY;
+        if(mpCamera->GetType() == GeometricCamera::CAM_PINHOLE)
+        {
+            const float fx = mpCamera->getParameter(0);
+            const float fy = mpCamera->getParameter(1);
+            const float cx = mpCamera->getParameter(2);
+            const float cy = mpCamera->getParameter(3);
+
+            const Eigen::Array<float,1,Eigen::Dynamic> invZ = mP3Dc.row(2).array().inverse();
+            mError2 = (mP2D.row(0).array() - (fx*mP3Dc.row(0).array()*invZ + cx)).square() +
+                      (mP2D.row(1).array() - (fy*mP3Dc.row(1).array()*invZ + cy)).square();
+        }
+        else
+        {
+            mError2.resize(N);
+            for(int i=0; i<N; i++)
+                mError2(i) = (mP2D.col(i) - mpCamera->project(Eigen::Vector3f(mP3Dc.col(i)))).squaredNorm();
+        }
 
-            if(error2<mvMaxError[i])
-            {
-                mvbInliersi[i]=true;
+        mnInliersi=0;
+        for(int i=0; i<N; i++)
+        {
+            mvbInliersi[i] = mError2(i)<mMaxError(i);
+            if(mvbInliersi[i])
                 mnInliersi++;
-            }
-            else
-            {
-                mvbInliersi[i]=false;
-            }
         }
     }
 
@@ -18,16 +18,19 @@
 
 
 #include "Map.h"
+#include "TaskScheduler.h"
 
 #include<mutex>
 
 namespace ORB_SLAM3
 {
 
-long unsigned int Map::nNextId=0;
+std::atomic<long unsigned int> Map::nNextId(0);
+LockStats Map::mStatsMutexMapUpdate("Map::mMutexMapUpdate");
 
 Map::Map():mnMaxKFid(0),mnBigChangeIdx(0), mbImuInitialized(false), mnMapChange(0), mpFirstRegionKF(static_cast<KeyFrame*>(NULL)),
-mbFail(false), mIsInUse(false), mHasTumbnail(false), mbBad(false), mnMapChangeNotified(0), mbIsInertial(false), mbIMU_BA1(false), mbIMU_BA2(false)
+mbFail(false), mIsInUse(false), mHasTumbnail(false), mbBad(false), mnMapChangeNotified(0), mbIsInertial(false), mbIMU_BA1(false), mbIMU_BA2(false),
+mMutexMapUpdate(&mStatsMutexMapUpdate), mnCheckpointEpoch(1)
 {
     mnId=nNextId++;
     mThumbnail = static_cast<GLubyte*>(NULL);
@@ -35,7 +38,8 @@ mbFail(false), mIsInUse(false), mHasTumbnail(false), mbBad(false), mnMapChangeNo
 
 Map::Map(int initKFid):mnInitKFid(initKFid), mnMaxKFid(initKFid),/*mnLastLoopKFid(initKFid),*/ mnBigChangeIdx(0), mIsInUse(false),
                        mHasTumbnail(false), mbBad(false), mbImuInitialized(false), mpFirstRegionKF(static_cast<KeyFrame*>(NULL)),
-                       mnMapChange(0), mbFail(false), mnMapChangeNotified(0), mbIsInertial(false), mbIMU_BA1(false), mbIMU_BA2(false)
+                       mnMapChange(0), mbFail(false), mnMapChangeNotified(0), mbIsInertial(false), mbIMU_BA1(false), mbIMU_BA2(false),
+                       mMutexMapUpdate(&mStatsMutexMapUpdate), mnCheckpointEpoch(1)
 {
     mnId=nNextId++;
     mThumbnail = static_cast<GLubyte*>(NULL);
@@ -44,7 +48,7 @@ Map::Map(int initKFid):mnInitKFid(initKFid), mnMaxKFid(initKFid),/*mnLastLoopKFi
 Map::~Map()
 {
     //TODO: erase all points from memory
-    mspMapPoints.clear();
+    mPointStore.Clear();
 
     //TODO: erase all keyframes from memory
     mspKeyFrames.clear();
@@ -79,8 +83,8 @@ void Map::AddKeyFrame(KeyFrame *pKF)
 
 void Map::AddMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.insert(pMP);
+    // The store locks the point, keep it out of the map mutex
+    mPointStore.Add(pMP);
 }
 
 void Map::SetImuInitialized()
@@ -97,8 +101,7 @@ bool Map::isImuInitialized()
 
 void Map::EraseMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.erase(pMP);
+    mPointStore.Erase(pMP);
 
     // TODO: This only erase the pointer.
     // Delete the MapPoint
@@ -152,14 +155,17 @@ vector<KeyFrame*> Map::GetAllKeyFrames()
 
 vector<MapPoint*> Map::GetAllMapPoints()
 {
-    unique_lock<mutex> lock(mMutexMap);
-    return vector<MapPoint*>(mspMapPoints.begin(),mspMapPoints.end());
+    return mPointStore.GetAllMapPoints();
+}
+
+MapPointStore* Map::GetMapPointStore()
+{
+    return &mPointStore;
 }
 
 long unsigned int Map::MapPointsInMap()
 {
-    unique_lock<mutex> lock(mMutexMap);
-    return mspMapPoints.size();
+    return mPointStore.Size();
 }
 
 long unsigned int Map::KeyFramesInMap()
@@ -178,6 +184,17 @@ long unsigned int Map::GetId()
 {
     return mnId;
 }
+
+unsigned long Map::GetCheckpointEpoch()
+{
+    return mnCheckpointEpoch.load(std::memory_order_relaxed);
+}
+
+unsigned long Map::NextCheckpointEpoch()
+{
+    return mnCheckpointEpoch.fetch_add(1);
+}
+
 long unsigned int Map::GetInitKFid()
 {
     unique_lock<mutex> lock(mMutexMap);
@@ -223,8 +240,8 @@ void Map::clear()
 //        delete *sit;
     }
 
-    mspMapPoints.clear();
     mspKeyFrames.clear();
+    mPointStore.Clear();
     mnMaxKFid = mnInitKFid;
     mbImuInitialized = false;
     mvpReferenceMapPoints.clear();
@@ -273,9 +290,10 @@ void Map::ApplyScaledRotation(const Sophus::SE3f &T, const float s, const bool b
             pKF->SetVelocity(Ryw*Vw*s);
 
     }
-    for(set<MapPoint*>::iterator sit=mspMapPoints.begin(); sit!=mspMapPoints.end(); sit++)
+    const vector<MapPoint*> vpMPs = mPointStore.GetAllMapPoints();
+    for(vector<MapPoint*>::const_iterator vit=vpMPs.begin(); vit!=vpMPs.end(); vit++)
     {
-        MapPoint* pMP = *sit;
+        MapPoint* pMP = *vit;
         pMP->SetWorldPos(s * Ryw * pMP->GetWorldPos() + tyw);
         pMP->UpdateNormalAndDepth();
     }
@@ -358,8 +376,11 @@ void Map::SetLastMapChange(int currentChangeId)
 
 void Map::PreSave(std::set<GeometricCamera*> &spCams)
 {
+    const vector<MapPoint*> vpMPs = mPointStore.GetAllMapPoints();
+    set<MapPoint*> spMPs(vpMPs.begin(), vpMPs.end());
+
     int nMPWithoutObs = 0;
-    for(MapPoint* pMPi : mspMapPoints)
+    for(MapPoint* pMPi : vpMPs)
     {
         if(!pMPi || pMPi->isBad())
             continue;
@@ -368,8 +389,8 @@ void Map::PreSave(std::set<GeometricCamera*> &spCams)
         {
             nMPWithoutObs++;
         }
-        map<KeyFrame*, std::tuple<int,int>> mpObs = pMPi->GetObservations();
-        for(map<KeyFrame*, std::tuple<int,int>>::iterator it= mpObs.begin(), end=mpObs.end(); it!=end; ++it)
+        MapPoint::ObservationMap mpObs = pMPi->GetObservations();
+        for(MapPoint::ObservationMap::iterator it= mpObs.begin(), end=mpObs.end(); it!=end; ++it)
         {
             if(it->first->GetMap() != this || it->first->isBad())
             {
@@ -379,24 +400,17 @@ void Map::PreSave(std::set<GeometricCamera*> &spCams)
         }
     }
 
-    // Saves the id of KF origins
-    mvBackupKeyFrameOriginsId.clear();
-    mvBackupKeyFrameOriginsId.reserve(mvpKeyFrameOrigins.size());
-    for(int i = 0, numEl = mvpKeyFrameOrigins.size(); i < numEl; ++i)
-    {
-        mvBackupKeyFrameOriginsId.push_back(mvpKeyFrameOrigins[i]->mnId);
-    }
-
+    PreSaveHeader();
 
     // Backup of MapPoints
     mvpBackupMapPoints.clear();
-    for(MapPoint* pMPi : mspMapPoints)
+    for(MapPoint* pMPi : vpMPs)
     {
         if(!pMPi || pMPi->isBad())
             continue;
 
         mvpBackupMapPoints.push_back(pMPi);
-        pMPi->PreSave(mspKeyFrames,mspMapPoints);
+        pMPi->PreSave(mspKeyFrames,spMPs);
     }
 
     // Backup of KeyFrames
@@ -407,7 +421,18 @@ void Map::PreSave(std::set<GeometricCamera*> &spCams)
             continue;
 
         mvpBackupKeyFrames.push_back(pKFi);
-        pKFi->PreSave(mspKeyFrames,mspMapPoints, spCams);
+        pKFi->PreSave(mspKeyFrames,spMPs, spCams);
+    }
+}
+
+void Map::PreSaveHeader()
+{
+    // Saves the id of KF origins
+    mvBackupKeyFrameOriginsId.clear();
+    mvBackupKeyFrameOriginsId.reserve(mvpKeyFrameOrigins.size());
+    for(int i = 0, numEl = mvpKeyFrameOrigins.size(); i < numEl; ++i)
+    {
+        mvBackupKeyFrameOriginsId.push_back(mvpKeyFrameOrigins[i]->mnId);
     }
 
     mnBackupKFinitialID = -1;
@@ -421,25 +446,52 @@ void Map::PreSave(std::set<GeometricCamera*> &spCams)
     {
         mnBackupKFlowerID = mpKFlowerID->mnId;
     }
+}
+
+void Map::PreSaveObjects(const vector<KeyFrame*> &vpKFs, const vector<MapPoint*> &vpMPs, set<KeyFrame*> &spKFs,
+                         set<MapPoint*> &spMPs, set<GeometricCamera*> &spCams)
+{
+    PreSaveHeader();
+
+    // The observations of keyframes out of the map are kept, Local Mapping adds the keyframe to the
+    // map after its observations
+    for(MapPoint* pMPi : vpMPs)
+        pMPi->PreSave(spKFs, spMPs, false);
+
+    for(KeyFrame* pKFi : vpKFs)
+        pKFi->PreSave(spKFs, spMPs, spCams);
+}
+
+static void PostLoadMapPoint(const vector<MapPoint*> &vpMPs, const IdTable<KeyFrame> &KFTable, const IdTable<MapPoint> &MPTable, const int i)
+{
+    vpMPs[i]->PostLoad(KFTable, MPTable);
+}
 
+static void PostLoadKeyFrame(const vector<KeyFrame*> &vpKFs, const IdTable<KeyFrame> &KFTable, const IdTable<MapPoint> &MPTable,
+                             map<unsigned int, GeometricCamera*> &mpCams, const int i)
+{
+    vpKFs[i]->PostLoad(KFTable, MPTable, mpCams);
 }
 
-void Map::PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long unsigned int, KeyFrame*>& mpKeyFrameId*/, map<unsigned int, GeometricCamera*> &mpCams)
+void Map::PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long unsigned int, KeyFrame*>& mpKeyFrameId*/, map<unsigned int, GeometricCamera*> &mpCams,
+                   TaskScheduler* pScheduler)
 {
-    std::copy(mvpBackupMapPoints.begin(), mvpBackupMapPoints.end(), std::inserter(mspMapPoints, mspMapPoints.begin()));
     std::copy(mvpBackupKeyFrames.begin(), mvpBackupKeyFrames.end(), std::inserter(mspKeyFrames, mspKeyFrames.begin()));
 
-    map<long unsigned int,MapPoint*> mpMapPointId;
-    for(MapPoint* pMPi : mspMapPoints)
+    // Only the good points are added to the map (the store), the bad ones are not referenced
+    vector<MapPoint*> vpMPs;
+    vpMPs.reserve(mvpBackupMapPoints.size());
+    for(MapPoint* pMPi : mvpBackupMapPoints)
     {
         if(!pMPi || pMPi->isBad())
             continue;
 
         pMPi->UpdateMap(this);
-        mpMapPointId[pMPi->mnId] = pMPi;
+        vpMPs.push_back(pMPi);
     }
 
-    map<long unsigned int, KeyFrame*> mpKeyFrameId;
+    vector<KeyFrame*> vpKFs;
+    vpKFs.reserve(mspKeyFrames.size());
     for(KeyFrame* pKFi : mspKeyFrames)
     {
         if(!pKFi || pKFi->isBad())
@@ -448,43 +500,48 @@ void Map::PostLoad(KeyFrameDatabase* pKFDB, ORBVocabulary* pORBVoc/*, map<long u
         pKFi->UpdateMap(this);
         pKFi->SetORBVocabulary(pORBVoc);
         pKFi->SetKeyFrameDatabase(pKFDB);
-        mpKeyFrameId[pKFi->mnId] = pKFi;
+        vpKFs.push_back(pKFi);
     }
 
-    // References reconstruction between different instances
-    for(MapPoint* pMPi : mspMapPoints)
-    {
-        if(!pMPi || pMPi->isBad())
-            continue;
+    IdTable<MapPoint> MPTable;
+    MPTable.Build(vpMPs);
+    IdTable<KeyFrame> KFTable;
+    KFTable.Build(vpKFs);
 
-        pMPi->PostLoad(mpKeyFrameId, mpMapPointId);
+    // References reconstruction between different instances, each object only changes its own members
+    if(pScheduler)
+    {
+        pScheduler->ParallelFor(0, vpMPs.size(), std::bind(&PostLoadMapPoint, std::cref(vpMPs), std::cref(KFTable), std::cref(MPTable),
+                                                           std::placeholders::_1), TaskScheduler::TRACKING, 256);
+        pScheduler->ParallelFor(0, vpKFs.size(), std::bind(&PostLoadKeyFrame, std::cref(vpKFs), std::cref(KFTable), std::cref(MPTable),
+                                                           std::ref(mpCams), std::placeholders::_1), TaskScheduler::TRACKING, 16);
     }
-
-    for(KeyFrame* pKFi : mspKeyFrames)
+    else
     {
-        if(!pKFi || pKFi->isBad())
-            continue;
-
-        pKFi->PostLoad(mpKeyFrameId, mpMapPointId, mpCams);
-        pKFDB->add(pKFi);
+        for(size_t i=0; i<vpMPs.size(); i++)
+            PostLoadMapPoint(vpMPs, KFTable, MPTable, i);
+        for(size_t i=0; i<vpKFs.size(); i++)
+            PostLoadKeyFrame(vpKFs, KFTable, MPTable, mpCams, i);
     }
 
+    for(MapPoint* pMPi : vpMPs)
+        mPointStore.Add(pMPi);
 
     if(mnBackupKFinitialID != -1)
     {
-        mpKFinitial = mpKeyFrameId[mnBackupKFinitialID];
+        mpKFinitial = KFTable.Get(mnBackupKFinitialID);
     }
 
     if(mnBackupKFlowerID != -1)
     {
-        mpKFlowerID = mpKeyFrameId[mnBackupKFlowerID];
+        mpKFlowerID = KFTable.Get(mnBackupKFlowerID);
     }
 
     mvpKeyFrameOrigins.clear();
     mvpKeyFrameOrigins.reserve(mvBackupKeyFrameOriginsId.size());
     for(int i = 0; i < mvBackupKeyFrameOriginsId.size(); ++i)
     {
-        mvpKeyFrameOrigins.push_back(mpKeyFrameId[mvBackupKeyFrameOriginsId[i]]);
+        mvpKeyFrameOrigins.push_back(KFTable.Get(mvBackupKeyFrameOriginsId[i]));
     }
 
     mvpBackupMapPoints.clear();
@@ -19,6 +19,7 @@
 #include "MapDrawer.h"
 #include "MapPoint.h"
 #include "KeyFrame.h"
+#include "MapRenderer.h"
 #include <pangolin/pangolin.h>
 #include <mutex>
 
@@ -26,7 +27,8 @@ namespace ORB_SLAM3
 {
 
 
-MapDrawer::MapDrawer(Atlas* pAtlas, const string &strSettingPath, Settings* settings):mpAtlas(pAtlas)
+MapDrawer::MapDrawer(Atlas* pAtlas, const string &strSettingPath, Settings* settings):mpAtlas(pAtlas),
+    mpRenderer(static_cast<MapRenderer*>(NULL))
 {
     if(settings){
         newParameterLoader(settings);
@@ -138,26 +140,35 @@ void MapDrawer::DrawMapPoints()
     if(!pActiveMap)
         return;
 
-    const vector<MapPoint*> &vpMPs = pActiveMap->GetAllMapPoints();
+    if(mpRenderer)
+    {
+        mpRenderer->DrawMapPoints(mPointSize);
+        return;
+    }
+
     const vector<MapPoint*> &vpRefMPs = pActiveMap->GetReferenceMapPoints();
 
     set<MapPoint*> spRefMPs(vpRefMPs.begin(), vpRefMPs.end());
 
-    if(vpMPs.empty())
-        return;
+    {
+        // Read the positions column of the map storage, bad points are removed from it
+        MapPointStore::View points = pActiveMap->GetMapPointStore()->GetView();
+        if(points.size() == 0)
+            return;
 
-    glPointSize(mPointSize);
-    glBegin(GL_POINTS);
-    glColor3f(0.0,0.0,0.0);
+        glPointSize(mPointSize);
+        glBegin(GL_POINTS);
+        glColor3f(0.0,0.0,0.0);
 
-    for(size_t i=0, iend=vpMPs.size(); i<iend;i++)
-    {
-        if(vpMPs[i]->isBad() || spRefMPs.count(vpMPs[i]))
-            continue;
-        Eigen::Matrix<float,3,1> pos = vpMPs[i]->GetWorldPos();
-        glVertex3f(pos(0),pos(1),pos(2));
+        for(size_t i=0, iend=points.slots(); i<iend;i++)
+        {
+            if(!points.point(i) || spRefMPs.count(points.point(i)))
+                continue;
+            const Eigen::Vector3f pos = points.position(i);
+            glVertex3f(pos(0),pos(1),pos(2));
+        }
+        glEnd();
     }
-    glEnd();
 
     glPointSize(mPointSize);
     glBegin(GL_POINTS);
@@ -189,148 +200,155 @@ void MapDrawer::DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph, const b
     if(!pActiveMap)
         return;
 
-    const vector<KeyFrame*> vpKFs = pActiveMap->GetAllKeyFrames();
-
-    if(bDrawKF)
+    if(mpRenderer)
     {
-        for(size_t i=0; i<vpKFs.size(); i++)
+        mpRenderer->DrawKeyFrames(bDrawKF, bDrawGraph, bDrawInertialGraph, bDrawOptLba, mKeyFrameLineWidth, mGraphLineWidth);
+    }
+    else
+    {
+        const vector<KeyFrame*> vpKFs = pActiveMap->GetAllKeyFrames();
+
+        if(bDrawKF)
         {
-            KeyFrame* pKF = vpKFs[i];
-            Eigen::Matrix4f Twc = pKF->GetPoseInverse().matrix();
-            unsigned int index_color = pKF->mnOriginMapId;
+            for(size_t i=0; i<vpKFs.size(); i++)
+            {
+                KeyFrame* pKF = vpKFs[i];
+                Eigen::Matrix4f Twc = pKF->GetPoseInverse().matrix();
+                unsigned int index_color = pKF->mnOriginMapId;
 
-            glPushMatrix();
+                glPushMatrix();
 
-            glMultMatrixf((GLfloat*)Twc.data());
+                glMultMatrixf((GLfloat*)Twc.data());
 
-            if(!pKF->GetParent()) // It is the first KF in the map
-            {
-                glLineWidth(mKeyFrameLineWidth*5);
-                glColor3f(1.0f,0.0f,0.0f);
-                glBegin(GL_LINES);
-            }
-            else
-            {
-                //cout << "Child KF: " << vpKFs[i]->mnId << endl;
-                glLineWidth(mKeyFrameLineWidth);
-                if (bDrawOptLba) {
-                    if(sOptKFs.find(pKF->mnId) != sOptKFs.end())
-                    {
-                        glColor3f(0.0f,1.0f,0.0f); // Green -> Opt KFs
-                    }
-                    else if(sFixedKFs.find(pKF->mnId) != sFixedKFs.end())
-                    {
-                        glColor3f(1.0f,0.0f,0.0f); // Red -> Fixed KFs
+                if(!pKF->GetParent()) // It is the first KF in the map
+                {
+                    glLineWidth(mKeyFrameLineWidth*5);
+                    glColor3f(1.0f,0.0f,0.0f);
+                    glBegin(GL_LINES);
+                }
+                else
+                {
+                    //cout << "Child KF: " << vpKFs[i]->mnId << endl;
+                    glLineWidth(mKeyFrameLineWidth);
+                    if (bDrawOptLba) {
+                        if(sOptKFs.find(pKF->mnId) != sOptKFs.end())
+                        {
+                            glColor3f(0.0f,1.0f,0.0f); // Green -> Opt KFs
+                        }
+                        else if(sFixedKFs.find(pKF->mnId) != sFixedKFs.end())
+                        {
+                            glColor3f(1.0f,0.0f,0.0f); // Red -> Fixed KFs
+                        }
+                        else
+                        {
+                            glColor3f(0.0f,0.0f,1.0f); // Basic color
+                        }
                     }
                     else
                     {
                         glColor3f(0.0f,0.0f,1.0f); // Basic color
                     }
+                    glBegin(GL_LINES);
                 }
-                else
-                {
-                    glColor3f(0.0f,0.0f,1.0f); // Basic color
-                }
-                glBegin(GL_LINES);
-            }
 
-            glVertex3f(0,0,0);
-            glVertex3f(w,h,z);
-            glVertex3f(0,0,0);
-            glVertex3f(w,-h,z);
-            glVertex3f(0,0,0);
-            glVertex3f(-w,-h,z);
-            glVertex3f(0,0,0);
-            glVertex3f(-w,h,z);
+                glVertex3f(0,0,0);
+                glVertex3f(w,h,z);
+                glVertex3f(0,0,0);
+                glVertex3f(w,-h,z);
+                glVertex3f(0,0,0);
+                glVertex3f(-w,-h,z);
+                glVertex3f(0,0,0);
+                glVertex3f(-w,h,z);
 
-            glVertex3f(w,h,z);
-            glVertex3f(w,-h,z);
+                glVertex3f(w,h,z);
+                glVertex3f(w,-h,z);
 
-            glVertex3f(-w,h,z);
-            glVertex3f(-w,-h,z);
+                glVertex3f(-w,h,z);
+                glVertex3f(-w,-h,z);
 
-            glVertex3f(-w,h,z);
-            glVertex3f(w,h,z);
+                glVertex3f(-w,h,z);
+                glVertex3f(w,h,z);
 
-            glVertex3f(-w,-h,z);
-            glVertex3f(w,-h,z);
-            glEnd();
+                glVertex3f(-w,-h,z);
+                glVertex3f(w,-h,z);
+                glEnd();
 
-            glPopMatrix();
+                glPopMatrix();
 
-            glEnd();
+                glEnd();
+            }
         }
-    }
 
-    if(bDrawGraph)
-    {
-        glLineWidth(mGraphLineWidth);
-        glColor4f(0.0f,1.0f,0.0f,0.6f);
-        glBegin(GL_LINES);
-
-        // cout << "-----------------Draw graph-----------------" << endl;
-        for(size_t i=0; i<vpKFs.size(); i++)
+        if(bDrawGraph)
         {
-            // Covisibility Graph
-            const vector<KeyFrame*> vCovKFs = vpKFs[i]->GetCovisiblesByWeight(100);
-            Eigen::Vector3f Ow = vpKFs[i]->GetCameraCenter();
-            if(!vCovKFs.empty())
+            glLineWidth(mGraphLineWidth);
+            glColor4f(0.0f,1.0f,0.0f,0.6f);
+            glBegin(GL_LINES);
+
+            // cout << "-----------------Draw graph-----------------" << endl;
+            for(size_t i=0; i<vpKFs.size(); i++)
             {
-                for(vector<KeyFrame*>::const_iterator vit=vCovKFs.begin(), vend=vCovKFs.end(); vit!=vend; vit++)
+                // Covisibility Graph
+                const vector<KeyFrame*> vCovKFs = vpKFs[i]->GetCovisiblesByWeight(100);
+                Eigen::Vector3f Ow = vpKFs[i]->GetCameraCenter();
+                if(!vCovKFs.empty())
                 {
-                    if((*vit)->mnId<vpKFs[i]->mnId)
-                        continue;
-                    Eigen::Vector3f Ow2 = (*vit)->GetCameraCenter();
+                    for(vector<KeyFrame*>::const_iterator vit=vCovKFs.begin(), vend=vCovKFs.end(); vit!=vend; vit++)
+                    {
+                        if((*vit)->mnId<vpKFs[i]->mnId)
+                            continue;
+                        Eigen::Vector3f Ow2 = (*vit)->GetCameraCenter();
+                        glVertex3f(Ow(0),Ow(1),Ow(2));
+                        glVertex3f(Ow2(0),Ow2(1),Ow2(2));
+                    }
+                }
+
+                // Spanning tree
+                KeyFrame* pParent = vpKFs[i]->GetParent();
+                if(pParent)
+                {
+                    Eigen::Vector3f Owp = pParent->GetCameraCenter();
                     glVertex3f(Ow(0),Ow(1),Ow(2));
-                    glVertex3f(Ow2(0),Ow2(1),Ow2(2));
+                    glVertex3f(Owp(0),Owp(1),Owp(2));
                 }
-            }
 
-            // Spanning tree
-            KeyFrame* pParent = vpKFs[i]->GetParent();
-            if(pParent)
-            {
-                Eigen::Vector3f Owp = pParent->GetCameraCenter();
-                glVertex3f(Ow(0),Ow(1),Ow(2));
-                glVertex3f(Owp(0),Owp(1),Owp(2));
+                // Loops
+                const KeyFrame::EdgeSet sLoopKFs = vpKFs[i]->GetLoopEdges();
+                for(KeyFrame::EdgeSet::const_iterator sit=sLoopKFs.begin(), send=sLoopKFs.end(); sit!=send; sit++)
+                {
+                    if((*sit)->mnId<vpKFs[i]->mnId)
+                        continue;
+                    Eigen::Vector3f Owl = (*sit)->GetCameraCenter();
+                    glVertex3f(Ow(0),Ow(1),Ow(2));
+                    glVertex3f(Owl(0),Owl(1),Owl(2));
+                }
             }
 
-            // Loops
-            set<KeyFrame*> sLoopKFs = vpKFs[i]->GetLoopEdges();
-            for(set<KeyFrame*>::iterator sit=sLoopKFs.begin(), send=sLoopKFs.end(); sit!=send; sit++)
-            {
-                if((*sit)->mnId<vpKFs[i]->mnId)
-                    continue;
-                Eigen::Vector3f Owl = (*sit)->GetCameraCenter();
-                glVertex3f(Ow(0),Ow(1),Ow(2));
-                glVertex3f(Owl(0),Owl(1),Owl(2));
-            }
+            glEnd();
         }
 
-        glEnd();
-    }
-
-    if(bDrawInertialGraph && pActiveMap->isImuInitialized())
-    {
-        glLineWidth(mGraphLineWidth);
-        glColor4f(1.0f,0.0f,0.0f,0.6f);
-        glBegin(GL_LINES);
-
-        //Draw inertial links
-        for(size_t i=0; i<vpKFs.size(); i++)
+        if(bDrawInertialGraph && pActiveMap->isImuInitialized())
         {
-            KeyFrame* pKFi = vpKFs[i];
-            Eigen::Vector3f Ow = pKFi->GetCameraCenter();
-            KeyFrame* pNext = pKFi->mNextKF;
-            if(pNext)
+            glLineWidth(mGraphLineWidth);
+            glColor4f(1.0f,0.0f,0.0f,0.6f);
+            glBegin(GL_LINES);
+
+            //Draw inertial links
+            for(size_t i=0; i<vpKFs.size(); i++)
             {
-                Eigen::Vector3f Owp = pNext->GetCameraCenter();
-                glVertex3f(Ow(0),Ow(1),Ow(2));
-                glVertex3f(Owp(0),Owp(1),Owp(2));
+                KeyFrame* pKFi = vpKFs[i];
+                Eigen::Vector3f Ow = pKFi->GetCameraCenter();
+                KeyFrame* pNext = pKFi->mNextKF;
+                if(pNext)
+                {
+                    Eigen::Vector3f Owp = pNext->GetCameraCenter();
+                    glVertex3f(Ow(0),Ow(1),Ow(2));
+                    glVertex3f(Owp(0),Owp(1),Owp(2));
+                }
             }
-        }
 
-        glEnd();
+            glEnd();
+        }
     }
 
     vector<Map*> vpMaps = mpAtlas->GetAllMaps();
@@ -444,6 +462,24 @@ void MapDrawer::SetCurrentCameraPose(const Sophus::SE3f &Tcw)
     mCameraPose = Tcw.inverse();
 }
 
+Sophus::SE3f MapDrawer::GetCurrentCameraPose()
+{
+    unique_lock<mutex> lock(mMutexCamera);
+    return mCameraPose;
+}
+
+void MapDrawer::EnableVertexBuffers()
+{
+    if(!mpRenderer)
+        mpRenderer = new MapRenderer(mpAtlas, mKeyFrameSize);
+}
+
+void MapDrawer::UpdateVertexBuffers()
+{
+    if(mpRenderer)
+        mpRenderer->Update();
+}
+
 void MapDrawer::GetCurrentOpenGLCameraMatrix(pangolin::OpenGlMatrix &M, pangolin::OpenGlMatrix &MOw)
 {
     Eigen::Matrix4f Twc;
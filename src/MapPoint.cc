@@ -24,28 +24,35 @@
 namespace ORB_SLAM3
 {
 
-long unsigned int MapPoint::nNextId=0;
+std::atomic<long unsigned int> MapPoint::nNextId(0);
 mutex MapPoint::mGlobalMutex;
+LockStats MapPoint::mStatsMutexPos("MapPoint::mMutexPos");
+LockStats MapPoint::mStatsMutexFeatures("MapPoint::mMutexFeatures");
 
 MapPoint::MapPoint():
     mnFirstKFid(0), mnFirstFrame(0), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-    mnCorrectedReference(0), mnBAGlobalForKF(0), mnVisible(1), mnFound(1), mbBad(false),
-    mpReplaced(static_cast<MapPoint*>(NULL))
+    mnCorrectedReference(0), mnBAGlobalForKF(0), mnObsVersion(0), mnVisible(1), mnFound(1), mbBad(false),
+    mpReplaced(static_cast<MapPoint*>(NULL)), mpMap(static_cast<Map*>(NULL)), mpStore(static_cast<MapPointStore*>(NULL)),
+    mfOwnMinDistance(0), mfOwnMaxDistance(0), mMutexPos(&mStatsMutexPos), mMutexFeatures(&mStatsMutexFeatures)
 {
+    UseOwnData();
     mpReplaced = static_cast<MapPoint*>(NULL);
+    mnChangeEpoch.store(0, std::memory_order_relaxed);
 }
 
 MapPoint::MapPoint(const Eigen::Vector3f &Pos, KeyFrame *pRefKF, Map* pMap):
     mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-    mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
-    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap),
+    mnCorrectedReference(0), mnBAGlobalForKF(0), mnObsVersion(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
+    mpReplaced(static_cast<MapPoint*>(NULL)), mpMap(pMap), mpStore(static_cast<MapPointStore*>(NULL)),
+    mfOwnMinDistance(0), mfOwnMaxDistance(0), mMutexPos(&mStatsMutexPos), mMutexFeatures(&mStatsMutexFeatures),
     mnOriginMapId(pMap->GetId())
 {
+    UseOwnData();
     SetWorldPos(Pos);
 
-    mNormalVector.setZero();
+    mOwnNormalVector.setZero();
 
     mbTrackInViewR = false;
     mbTrackInView = false;
@@ -58,16 +65,19 @@ MapPoint::MapPoint(const Eigen::Vector3f &Pos, KeyFrame *pRefKF, Map* pMap):
 MapPoint::MapPoint(const double invDepth, cv::Point2f uv_init, KeyFrame* pRefKF, KeyFrame* pHostKF, Map* pMap):
     mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-    mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
-    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap),
+    mnCorrectedReference(0), mnBAGlobalForKF(0), mnObsVersion(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
+    mpReplaced(static_cast<MapPoint*>(NULL)), mpMap(pMap), mpStore(static_cast<MapPointStore*>(NULL)),
+    mfOwnMinDistance(0), mfOwnMaxDistance(0), mMutexPos(&mStatsMutexPos), mMutexFeatures(&mStatsMutexFeatures),
     mnOriginMapId(pMap->GetId())
 {
+    UseOwnData();
+    MarkChanged();
     mInvDepth=invDepth;
     mInitU=(double)uv_init.x;
     mInitV=(double)uv_init.y;
     mpHostKF = pHostKF;
 
-    mNormalVector.setZero();
+    mOwnNormalVector.setZero();
 
     // Worldpos is not set
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
@@ -78,9 +88,12 @@ MapPoint::MapPoint(const double invDepth, cv::Point2f uv_init, KeyFrame* pRefKF,
 MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map* pMap, Frame* pFrame, const int &idxF):
     mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0), mnTrackReferenceForFrame(0), mnLastFrameSeen(0),
     mnBALocalForKF(0), mnFuseCandidateForKF(0),mnLoopPointForKF(0), mnCorrectedByKF(0),
-    mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
-    mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap), mnOriginMapId(pMap->GetId())
+    mnCorrectedReference(0), mnBAGlobalForKF(0), mnObsVersion(0), mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
+    mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap), mpStore(static_cast<MapPointStore*>(NULL)),
+    mfOwnMinDistance(0), mfOwnMaxDistance(0), mMutexPos(&mStatsMutexPos), mMutexFeatures(&mStatsMutexFeatures),
+    mnOriginMapId(pMap->GetId())
 {
+    UseOwnData();
     SetWorldPos(Pos);
 
     Eigen::Vector3f Ow;
@@ -94,10 +107,10 @@ MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map* pMap, Frame* pFrame, const i
 
         Ow = Rwl * tlr + twl;
     }
-    mNormalVector = mWorldPos - Ow;
-    mNormalVector = mNormalVector / mNormalVector.norm();
+    mOwnNormalVector = Pos - Ow;
+    mOwnNormalVector = mOwnNormalVector / mOwnNormalVector.norm();
 
-    Eigen::Vector3f PC = mWorldPos - Ow;
+    Eigen::Vector3f PC = Pos - Ow;
     const float dist = PC.norm();
     const int level = (pFrame -> Nleft == -1) ? pFrame->mvKeysUn[idxF].octave
                                               : (idxF < pFrame -> Nleft) ? pFrame->mvKeys[idxF].octave
@@ -105,8 +118,8 @@ MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map* pMap, Frame* pFrame, const i
     const float levelScaleFactor =  pFrame->mvScaleFactors[level];
     const int nLevels = pFrame->mnScaleLevels;
 
-    mfMaxDistance = dist*levelScaleFactor;
-    mfMinDistance = mfMaxDistance/pFrame->mvScaleFactors[nLevels-1];
+    mfOwnMaxDistance = dist*levelScaleFactor;
+    mfOwnMinDistance = mfOwnMaxDistance/pFrame->mvScaleFactors[nLevels-1];
 
     pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
 
@@ -116,31 +129,56 @@ MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map* pMap, Frame* pFrame, const i
 }
 
 void MapPoint::SetWorldPos(const Eigen::Vector3f &Pos) {
+    MarkChanged();
     unique_lock<mutex> lock2(mGlobalMutex);
-    unique_lock<mutex> lock(mMutexPos);
-    mWorldPos = Pos;
+    unique_lock<SharedMutex> lock(mMutexPos);
+    mpWorldPos.load()->Store(Pos.data());
+    if(mpStore)
+    {
+        // Only the first move after a listener took its changes goes through the lock of the store
+        const unsigned int nNotified = mpnStoreNotified->exchange(0xFFFFFFFF);
+        if(nNotified != 0xFFFFFFFF)
+            mpStore->NotifyMoved(mStoreHandle, ~nNotified);
+    }
 }
 
 Eigen::Vector3f MapPoint::GetWorldPos() {
-    unique_lock<mutex> lock(mMutexPos);
-    return mWorldPos;
+    Eigen::Vector3f pos;
+#ifdef MAP_SHARED_LOCKS
+    // Lock-free read. The slot of a point is released after the point moves its data out of it,
+    // the read is valid if the point still uses the same storage after it.
+    SeqLockedFloats<3>* pWorldPos = mpWorldPos.load();
+    while(true)
+    {
+        pWorldPos->Load(pos.data());
+        SeqLockedFloats<3>* pCurrentWorldPos = mpWorldPos.load();
+        if(pCurrentWorldPos == pWorldPos)
+            break;
+        pWorldPos = pCurrentWorldPos;
+    }
+#else
+    shared_lock<SharedMutex> lock(mMutexPos);
+    mpWorldPos.load()->Load(pos.data());
+#endif
+    return pos;
 }
 
 Eigen::Vector3f MapPoint::GetNormal() {
-    unique_lock<mutex> lock(mMutexPos);
-    return mNormalVector;
+    shared_lock<SharedMutex> lock(mMutexPos);
+    return *mpNormalVector;
 }
 
 
 KeyFrame* MapPoint::GetReferenceKeyFrame()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return mpRefKF;
 }
 
 void MapPoint::AddObservation(KeyFrame* pKF, int idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    MarkChanged();
+    unique_lock<SharedMutex> lock(mMutexFeatures);
     tuple<int,int> indexes;
 
     if(mObservations.count(pKF)){
@@ -158,6 +196,7 @@ void MapPoint::AddObservation(KeyFrame* pKF, int idx)
     }
 
     mObservations[pKF]=indexes;
+    mnObsVersion++;
 
     if(!pKF->mpCamera2 && pKF->mvuRight[idx]>=0)
         nObs+=2;
@@ -167,9 +206,10 @@ void MapPoint::AddObservation(KeyFrame* pKF, int idx)
 
 void MapPoint::EraseObservation(KeyFrame* pKF)
 {
+    MarkChanged();
     bool bBad=false;
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<SharedMutex> lock(mMutexFeatures);
         if(mObservations.count(pKF))
         {
             tuple<int,int> indexes = mObservations[pKF];
@@ -186,6 +226,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
             }
 
             mObservations.erase(pKF);
+            mnObsVersion++;
 
             if(mpRefKF==pKF)
                 mpRefKF=mObservations.begin()->first;
@@ -201,29 +242,42 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 }
 
 
-std::map<KeyFrame*, std::tuple<int,int>>  MapPoint::GetObservations()
+MapPoint::ObservationMap MapPoint::GetObservations()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return mObservations;
 }
 
+MapPoint::ObservationsView MapPoint::GetObservationsView()
+{
+    return ObservationsView(mMutexFeatures, mObservations);
+}
+
+unsigned int MapPoint::GetObservationsVersion()
+{
+    shared_lock<SharedMutex> lock(mMutexFeatures);
+    return mnObsVersion;
+}
+
 int MapPoint::Observations()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return nObs;
 }
 
 void MapPoint::SetBadFlag()
 {
-    map<KeyFrame*, tuple<int,int>> obs;
+    MarkChanged();
+    ObservationMap obs;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<SharedMutex> lock1(mMutexFeatures);
+        unique_lock<SharedMutex> lock2(mMutexPos);
         mbBad=true;
         obs = mObservations;
         mObservations.clear();
+        mnObsVersion++;
     }
-    for(map<KeyFrame*, tuple<int,int>>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
+    for(ObservationMap::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
         int leftIndex = get<0>(mit -> second), rightIndex = get<1>(mit -> second);
@@ -240,30 +294,32 @@ void MapPoint::SetBadFlag()
 
 MapPoint* MapPoint::GetReplaced()
 {
-    unique_lock<mutex> lock1(mMutexFeatures);
-    unique_lock<mutex> lock2(mMutexPos);
+    // Written with both mutexes held, any of them is enough to read it
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return mpReplaced;
 }
 
 void MapPoint::Replace(MapPoint* pMP)
 {
+    MarkChanged();
     if(pMP->mnId==this->mnId)
         return;
 
     int nvisible, nfound;
-    map<KeyFrame*,tuple<int,int>> obs;
+    ObservationMap obs;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<SharedMutex> lock1(mMutexFeatures);
+        unique_lock<SharedMutex> lock2(mMutexPos);
         obs=mObservations;
         mObservations.clear();
+        mnObsVersion++;
         mbBad=true;
         nvisible = mnVisible;
         nfound = mnFound;
         mpReplaced = pMP;
     }
 
-    for(map<KeyFrame*,tuple<int,int>>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
+    for(ObservationMap::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
     {
         // Replace measurement in keyframe
         KeyFrame* pKF = mit->first;
@@ -301,40 +357,39 @@ void MapPoint::Replace(MapPoint* pMP)
 
 bool MapPoint::isBad()
 {
-    unique_lock<mutex> lock1(mMutexFeatures,std::defer_lock);
-    unique_lock<mutex> lock2(mMutexPos,std::defer_lock);
-    lock(lock1, lock2);
-
+    // Written with both mutexes held, any of them is enough to read it
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return mbBad;
 }
 
 void MapPoint::IncreaseVisible(int n)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<SharedMutex> lock(mMutexFeatures);
     mnVisible+=n;
 }
 
 void MapPoint::IncreaseFound(int n)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<SharedMutex> lock(mMutexFeatures);
     mnFound+=n;
 }
 
 float MapPoint::GetFoundRatio()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return static_cast<float>(mnFound)/mnVisible;
 }
 
 void MapPoint::ComputeDistinctiveDescriptors()
 {
+    MarkChanged();
     // Retrieve all observed descriptors
     vector<cv::Mat> vDescriptors;
 
-    map<KeyFrame*,tuple<int,int>> observations;
+    ObservationMap observations;
 
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
+        shared_lock<SharedMutex> lock1(mMutexFeatures);
         if(mbBad)
             return;
         observations=mObservations;
@@ -345,7 +400,7 @@ void MapPoint::ComputeDistinctiveDescriptors()
 
     vDescriptors.reserve(observations.size());
 
-    for(map<KeyFrame*,tuple<int,int>>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+    for(ObservationMap::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
 
@@ -397,45 +452,50 @@ void MapPoint::ComputeDistinctiveDescriptors()
     }
 
     {
-        unique_lock<mutex> lock(mMutexFeatures);
-        mDescriptor = vDescriptors[BestIdx].clone();
+        unique_lock<SharedMutex> lock(mMutexFeatures);
+        // The first descriptor of a point in a map gets its row in the store, it is copied in place after it
+        if(mDescriptor.empty() && mpStore)
+            mDescriptor = mpStore->GetDescriptorRow(mStoreHandle, vDescriptors[BestIdx].cols, vDescriptors[BestIdx].type());
+        vDescriptors[BestIdx].copyTo(mDescriptor);
     }
 }
 
 cv::Mat MapPoint::GetDescriptor()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return mDescriptor.clone();
 }
 
 tuple<int,int> MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    if(mObservations.count(pKF))
-        return mObservations[pKF];
+    shared_lock<SharedMutex> lock(mMutexFeatures);
+    ObservationMap::const_iterator it = mObservations.find(pKF);
+    if(it != mObservations.end())
+        return it->second;
     else
         return tuple<int,int>(-1,-1);
 }
 
 bool MapPoint::IsInKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    shared_lock<SharedMutex> lock(mMutexFeatures);
     return (mObservations.count(pKF));
 }
 
 void MapPoint::UpdateNormalAndDepth()
 {
-    map<KeyFrame*,tuple<int,int>> observations;
+    MarkChanged();
+    ObservationMap observations;
     KeyFrame* pRefKF;
     Eigen::Vector3f Pos;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        shared_lock<SharedMutex> lock1(mMutexFeatures);
+        shared_lock<SharedMutex> lock2(mMutexPos);
         if(mbBad)
             return;
         observations = mObservations;
         pRefKF = mpRefKF;
-        Pos = mWorldPos;
+        mpWorldPos.load()->Load(Pos.data());
     }
 
     if(observations.empty())
@@ -444,7 +504,7 @@ void MapPoint::UpdateNormalAndDepth()
     Eigen::Vector3f normal;
     normal.setZero();
     int n=0;
-    for(map<KeyFrame*,tuple<int,int>>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+    for(ObservationMap::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
 
@@ -486,37 +546,38 @@ void MapPoint::UpdateNormalAndDepth()
     const int nLevels = pRefKF->mnScaleLevels;
 
     {
-        unique_lock<mutex> lock3(mMutexPos);
-        mfMaxDistance = dist*levelScaleFactor;
-        mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactors[nLevels-1];
-        mNormalVector = normal/n;
+        unique_lock<SharedMutex> lock3(mMutexPos);
+        *mpfMaxDistance = dist*levelScaleFactor;
+        *mpfMinDistance = *mpfMaxDistance/pRefKF->mvScaleFactors[nLevels-1];
+        *mpNormalVector = normal/n;
     }
 }
 
 void MapPoint::SetNormalVector(const Eigen::Vector3f& normal)
 {
-    unique_lock<mutex> lock3(mMutexPos);
-    mNormalVector = normal;
+    MarkChanged();
+    unique_lock<SharedMutex> lock3(mMutexPos);
+    *mpNormalVector = normal;
 }
 
 float MapPoint::GetMinDistanceInvariance()
 {
-    unique_lock<mutex> lock(mMutexPos);
-    return 0.8f * mfMinDistance;
+    shared_lock<SharedMutex> lock(mMutexPos);
+    return 0.8f * (*mpfMinDistance);
 }
 
 float MapPoint::GetMaxDistanceInvariance()
 {
-    unique_lock<mutex> lock(mMutexPos);
-    return 1.2f * mfMaxDistance;
+    shared_lock<SharedMutex> lock(mMutexPos);
+    return 1.2f * (*mpfMaxDistance);
 }
 
 int MapPoint::PredictScale(const float &currentDist, KeyFrame* pKF)
 {
     float ratio;
     {
-        unique_lock<mutex> lock(mMutexPos);
-        ratio = mfMaxDistance/currentDist;
+        shared_lock<SharedMutex> lock(mMutexPos);
+        ratio = *mpfMaxDistance/currentDist;
     }
 
     int nScale = ceil(log(ratio)/pKF->mfLogScaleFactor);
@@ -532,8 +593,8 @@ int MapPoint::PredictScale(const float &currentDist, Frame* pF)
 {
     float ratio;
     {
-        unique_lock<mutex> lock(mMutexPos);
-        ratio = mfMaxDistance/currentDist;
+        shared_lock<SharedMutex> lock(mMutexPos);
+        ratio = *mpfMaxDistance/currentDist;
     }
 
     int nScale = ceil(log(ratio)/pF->mfLogScaleFactor);
@@ -548,7 +609,7 @@ int MapPoint::PredictScale(const float &currentDist, Frame* pF)
 void MapPoint::PrintObservations()
 {
     cout << "MP_OBS: MP " << mnId << endl;
-    for(map<KeyFrame*,tuple<int,int>>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+    for(ObservationMap::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
     {
         KeyFrame* pKFi = mit->first;
         tuple<int,int> indexes = mit->second;
@@ -565,20 +626,101 @@ Map* MapPoint::GetMap()
 
 void MapPoint::UpdateMap(Map* pMap)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mpMap = pMap;
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        mpMap = pMap;
+    }
+    // With the epoch of the new map
+    MarkChanged();
 }
 
-void MapPoint::PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP)
+void MapPoint::UseOwnData()
 {
+    mpWorldPos.store(&mOwnWorldPos);
+    mpNormalVector = &mOwnNormalVector;
+    mpfMinDistance = &mfOwnMinDistance;
+    mpfMaxDistance = &mfOwnMaxDistance;
+    mpnStoreNotified = static_cast<std::atomic<unsigned int>*>(NULL);
+}
+
+MapPointStore::Handle MapPoint::AttachToStore(MapPointStore* pStore)
+{
+    unique_lock<SharedMutex> lock1(mMutexFeatures);
+    unique_lock<SharedMutex> lock2(mMutexPos);
+
+    Eigen::Vector3f pos;
+    mpWorldPos.load()->Load(pos.data());
+
+    MapPointStore::SlotData slot;
+    MapPointStore::Handle handle = pStore->Insert(this, pos, mDescriptor, slot);
+
+    if(slot.pPosition != mpWorldPos.load())
+    {
+        // From the own copy or from the slot in the store of other map (still reserved until that
+        // store erases the point)
+        *slot.pNormal = *mpNormalVector;
+        *slot.pMinDistance = *mpfMinDistance;
+        *slot.pMaxDistance = *mpfMaxDistance;
+        mpNormalVector = slot.pNormal;
+        mpfMinDistance = slot.pMinDistance;
+        mpfMaxDistance = slot.pMaxDistance;
+        mpWorldPos.store(slot.pPosition);
+    }
+    mpnStoreNotified = slot.pnNotified;
+    // A descriptor with other layout than the rest of the store stays in the point
+    mDescriptor = slot.descriptor.empty() ? mDescriptor.clone() : slot.descriptor;
+
+    mpStore = pStore;
+    mStoreHandle = handle;
+    return handle;
+}
+
+void MapPoint::DetachFromStore(MapPointStore* pStore)
+{
+    unique_lock<SharedMutex> lock1(mMutexFeatures);
+    unique_lock<SharedMutex> lock2(mMutexPos);
+    if(mpStore == pStore)
+    {
+        // Take back the data before the slot is released
+        Eigen::Vector3f pos;
+        mpWorldPos.load()->Load(pos.data());
+        mOwnWorldPos.Store(pos.data());
+        mOwnNormalVector = *mpNormalVector;
+        mfOwnMinDistance = *mpfMinDistance;
+        mfOwnMaxDistance = *mpfMaxDistance;
+        mDescriptor = mDescriptor.clone();
+        UseOwnData();
+
+        mpStore = static_cast<MapPointStore*>(NULL);
+        mStoreHandle = MapPointStore::Handle();
+    }
+
+    // The point may have been moved to other map in the meantime, the slot is released in any case
+    pStore->Remove(this);
+}
+
+MapPointStore::Handle MapPoint::GetStoreHandle()
+{
+    shared_lock<SharedMutex> lock(mMutexPos);
+    return mStoreHandle;
+}
+
+void MapPoint::PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP, const bool bEraseUnsaved)
+{
+    // Read through the locked getters, the checkpoints save the points while the other threads change them
+    MapPoint* pReplaced = GetReplaced();
+    KeyFrame* pRefKF = GetReferenceKeyFrame();
+
     mBackupReplacedId = -1;
-    if(mpReplaced && spMP.find(mpReplaced) != spMP.end())
-        mBackupReplacedId = mpReplaced->mnId;
+    if(pReplaced && spMP.find(pReplaced) != spMP.end())
+        mBackupReplacedId = pReplaced->mnId;
 
     mBackupObservationsId1.clear();
     mBackupObservationsId2.clear();
     // Save the id and position in each KF who view it
-    for(std::map<KeyFrame*,std::tuple<int,int> >::const_iterator it = mObservations.begin(), end = mObservations.end(); it != end; ++it)
+    // Iterate over a copy, observations from KFs which are not saved are erased in the loop
+    const ObservationMap observations = GetObservations();
+    for(ObservationMap::const_iterator it = observations.begin(), end = observations.end(); it != end; ++it)
     {
         KeyFrame* pKFi = it->first;
         if(spKF.find(pKFi) != spKF.end())
@@ -586,39 +728,42 @@ void MapPoint::PreSave(set<KeyFrame*>& spKF,set<MapPoint*>& spMP)
             mBackupObservationsId1[it->first->mnId] = get<0>(it->second);
             mBackupObservationsId2[it->first->mnId] = get<1>(it->second);
         }
-        else
+        else if(bEraseUnsaved)
         {
             EraseObservation(pKFi);
         }
     }
 
     // Save the id of the reference KF
-    if(spKF.find(mpRefKF) != spKF.end())
+    if(spKF.find(pRefKF) != spKF.end())
     {
-        mBackupRefKFId = mpRefKF->mnId;
+        mBackupRefKFId = pRefKF->mnId;
     }
 }
 
-void MapPoint::PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsigned int, MapPoint*>& mpMPid)
+void MapPoint::MarkChanged()
 {
-    mpRefKF = mpKFid[mBackupRefKFId];
+    Map* pMap = GetMap();
+    if(pMap)
+        mnChangeEpoch.store(pMap->GetCheckpointEpoch(), std::memory_order_relaxed);
+}
+
+void MapPoint::PostLoad(const IdTable<KeyFrame>& KFTable, const IdTable<MapPoint>& MPTable)
+{
+    mpRefKF = KFTable.Get(mBackupRefKFId);
     if(!mpRefKF)
     {
         cout << "ERROR: MP without KF reference " << mBackupRefKFId << "; Num obs: " << nObs << endl;
     }
     mpReplaced = static_cast<MapPoint*>(NULL);
     if(mBackupReplacedId>=0)
-    {
-        map<long unsigned int, MapPoint*>::iterator it = mpMPid.find(mBackupReplacedId);
-        if (it != mpMPid.end())
-            mpReplaced = it->second;
-    }
+        mpReplaced = MPTable.Get(mBackupReplacedId);
 
     mObservations.clear();
 
     for(map<long unsigned int, int>::const_iterator it = mBackupObservationsId1.begin(), end = mBackupObservationsId1.end(); it != end; ++it)
     {
-        KeyFrame* pKFi = mpKFid[it->first];
+        KeyFrame* pKFi = KFTable.Get(it->first);
         map<long unsigned int, int>::const_iterator it2 = mBackupObservationsId2.find(it->first);
         std::tuple<int, int> indexes = tuple<int,int>(it->second,it2->second);
         if(pKFi)
@@ -629,6 +774,7 @@ void MapPoint::PostLoad(map<long unsigned int, KeyFrame*>& mpKFid, map<long unsi
 
     mBackupObservationsId1.clear();
     mBackupObservationsId2.clear();
+    mnObsVersion++;
 }
 
 } //namespace ORB_SLAM
@@ -0,0 +1,324 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MapPointStore.h"
+#include "MapPoint.h"
+
+namespace ORB_SLAM3
+{
+
+const unsigned int MapPointStore::INVALID_IDX;
+const int MapPointStore::MAX_LISTENERS;
+const unsigned int MapPointStore::BLOCK_BITS;
+const unsigned int MapPointStore::BLOCK_SIZE;
+
+Eigen::Vector3f MapPointStore::View::position(size_t i) const
+{
+    Eigen::Vector3f pos;
+    mStore.mvpBlocks[i >> BLOCK_BITS]->vPositions[i & (BLOCK_SIZE-1)].Load(pos.data());
+    return pos;
+}
+
+MapPointStore::MapPointStore(): mnDescriptorCols(-1), mnDescriptorType(-1), mnNumPoints(0)
+{
+    for(int i=0; i<MAX_LISTENERS; i++)
+    {
+        mListeners[i].bActive = false;
+        mListeners[i].bFull = true;
+    }
+}
+
+MapPointStore::~MapPointStore()
+{
+    Clear();
+}
+
+MapPointStore::Handle MapPointStore::Add(MapPoint* pMP)
+{
+    // The point locks itself and inserts its data
+    return pMP->AttachToStore(this);
+}
+
+void MapPointStore::Erase(MapPoint* pMP)
+{
+    // The point locks itself, takes back its data (if it is still in this store) and removes its slot
+    pMP->DetachFromStore(this);
+}
+
+void MapPointStore::Clear()
+{
+    vector<MapPoint*> vpMPs = GetAllMapPoints();
+    for(MapPoint* pMP : vpMPs)
+        pMP->DetachFromStore(this);
+
+    unique_lock<mutex> lock(mMutexStore);
+    for(int i=0; i<MAX_LISTENERS; i++)
+    {
+        mListeners[i].bFull = true;
+        mListeners[i].vnChangedSlots.clear();
+        mListeners[i].vbQueued.clear();
+    }
+}
+
+MapPointStore::Handle MapPointStore::Insert(MapPoint* pMP, const Eigen::Vector3f &pos, const cv::Mat &descriptor, SlotData &slot)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    unsigned int idx;
+    std::unordered_map<MapPoint*, unsigned int>::iterator it = mmPointSlot.find(pMP);
+    if(it != mmPointSlot.end())
+        idx = it->second;
+    else
+    {
+        if(!mvFreeSlots.empty())
+        {
+            idx = mvFreeSlots.back();
+            mvFreeSlots.pop_back();
+        }
+        else
+        {
+            idx = mvpPoints.size();
+            if((idx >> BLOCK_BITS) >= mvpBlocks.size())
+                mvpBlocks.push_back(std::unique_ptr<Block>(new Block()));
+            mvpPoints.push_back(static_cast<MapPoint*>(NULL));
+            mvGenerations.push_back(0);
+        }
+
+        mvpPoints[idx] = pMP;
+        mmPointSlot[pMP] = idx;
+        mnNumPoints++;
+    }
+
+    Block* pBlock = mvpBlocks[idx >> BLOCK_BITS].get();
+    const unsigned int off = idx & (BLOCK_SIZE-1);
+
+    // The position is written before the bulk readers can see the slot
+    pBlock->vPositions[off].Store(pos.data());
+
+    slot.pPosition = &pBlock->vPositions[off];
+    slot.pNormal = &pBlock->vNormals[off];
+    slot.pMinDistance = &pBlock->vMinDistances[off];
+    slot.pMaxDistance = &pBlock->vMaxDistances[off];
+    slot.pnNotified = &pBlock->vnNotified[off];
+    slot.descriptor = cv::Mat();
+    if(!descriptor.empty())
+    {
+        slot.descriptor = GetDescriptorRowNoLock(idx, descriptor.cols, descriptor.type());
+        if(!slot.descriptor.empty() && slot.descriptor.data != descriptor.data)
+            descriptor.copyTo(slot.descriptor);
+    }
+
+    // Every listener gets the slot, each clears its bit of the mask when it takes it
+    pBlock->vnNotified[off].store(0xFFFFFFFF);
+    QueueNoLock(idx, 0xFFFFFFFF);
+
+    return Handle(idx, mvGenerations[idx]);
+}
+
+void MapPointStore::Remove(MapPoint* pMP)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    std::unordered_map<MapPoint*, unsigned int>::iterator it = mmPointSlot.find(pMP);
+    if(it == mmPointSlot.end())
+        return;
+
+    const unsigned int idx = it->second;
+    mvpPoints[idx] = static_cast<MapPoint*>(NULL);
+    mvGenerations[idx]++;
+    mvFreeSlots.push_back(idx);
+    QueueNoLock(idx, 0xFFFFFFFF);
+    mmPointSlot.erase(it);
+    mnNumPoints--;
+}
+
+cv::Mat MapPointStore::GetDescriptorRow(const Handle &handle, const int cols, const int type)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    if(!IsValidNoLock(handle))
+        return cv::Mat();
+    return GetDescriptorRowNoLock(handle.mnIdx, cols, type);
+}
+
+cv::Mat MapPointStore::GetDescriptorRowNoLock(const unsigned int idx, const int cols, const int type)
+{
+    if(mnDescriptorCols < 0)
+    {
+        mnDescriptorCols = cols;
+        mnDescriptorType = type;
+    }
+    if(cols != mnDescriptorCols || type != mnDescriptorType)
+        return cv::Mat();
+
+    Block* pBlock = mvpBlocks[idx >> BLOCK_BITS].get();
+    if(pBlock->descriptors.empty())
+        pBlock->descriptors.create(BLOCK_SIZE, mnDescriptorCols, mnDescriptorType);
+
+    // The header keeps a reference to the block data
+    return pBlock->descriptors.row(idx & (BLOCK_SIZE-1));
+}
+
+bool MapPointStore::IsValidNoLock(const Handle &handle) const
+{
+    return !handle.IsNull() && handle.mnIdx < mvpPoints.size() &&
+            mvGenerations[handle.mnIdx] == handle.mnGeneration && mvpPoints[handle.mnIdx];
+}
+
+bool MapPointStore::IsValid(const Handle &handle)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    return IsValidNoLock(handle);
+}
+
+MapPoint* MapPointStore::GetMapPoint(const Handle &handle)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    if(!IsValidNoLock(handle))
+        return static_cast<MapPoint*>(NULL);
+    return mvpPoints[handle.mnIdx];
+}
+
+size_t MapPointStore::Size()
+{
+    unique_lock<mutex> lock(mMutexStore);
+    return mnNumPoints;
+}
+
+vector<MapPoint*> MapPointStore::GetAllMapPoints()
+{
+    unique_lock<mutex> lock(mMutexStore);
+    vector<MapPoint*> vpMPs;
+    vpMPs.reserve(mnNumPoints);
+    for(size_t i=0, iend=mvpPoints.size(); i<iend; i++)
+    {
+        if(mvpPoints[i])
+            vpMPs.push_back(mvpPoints[i]);
+    }
+    return vpMPs;
+}
+
+MapPointStore::View MapPointStore::GetView()
+{
+    return View(mMutexStore, *this);
+}
+
+int MapPointStore::AddListener()
+{
+    unique_lock<mutex> lock(mMutexStore);
+    for(int i=0; i<MAX_LISTENERS; i++)
+    {
+        if(mListeners[i].bActive)
+            continue;
+
+        mListeners[i].bActive = true;
+        mListeners[i].bFull = true;
+        mListeners[i].vnChangedSlots.clear();
+        mListeners[i].vbQueued.clear();
+        return i;
+    }
+    return -1;
+}
+
+void MapPointStore::RemoveListener(const int nListener)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    Listener &listener = mListeners[nListener];
+    listener.bActive = false;
+    listener.vnChangedSlots.clear();
+    listener.vbQueued.clear();
+}
+
+void MapPointStore::QueueNoLock(const unsigned int idx, const unsigned int nListeners)
+{
+    for(int i=0; i<MAX_LISTENERS; i++)
+    {
+        Listener &listener = mListeners[i];
+        // A listener waiting for all the slots does not need the changes
+        if(!listener.bActive || listener.bFull || !(nListeners & (1u << i)))
+            continue;
+
+        if(listener.vbQueued.size() <= idx)
+            listener.vbQueued.resize(mvpPoints.size(), false);
+        if(listener.vbQueued[idx])
+            continue;
+
+        listener.vbQueued[idx] = true;
+        listener.vnChangedSlots.push_back(idx);
+    }
+}
+
+void MapPointStore::NotifyMoved(const Handle &handle, const unsigned int nListeners)
+{
+    unique_lock<mutex> lock(mMutexStore);
+    if(IsValidNoLock(handle))
+        QueueNoLock(handle.mnIdx, nListeners);
+}
+
+bool MapPointStore::TakeChanges(const int nListener, const bool bAll, vector<unsigned int> &vnSlots,
+                                vector<bool> &vbValid, vector<Eigen::Vector3f> &vPositions, size_t &nSlots)
+{
+    vnSlots.clear();
+    vbValid.clear();
+    vPositions.clear();
+
+    unique_lock<mutex> lock(mMutexStore);
+    Listener &listener = mListeners[nListener];
+    const bool bFull = bAll || listener.bFull;
+    nSlots = mvpPoints.size();
+
+    if(bFull)
+    {
+        vnSlots.reserve(mnNumPoints);
+        for(size_t i=0; i<mvpPoints.size(); i++)
+        {
+            if(mvpPoints[i])
+                vnSlots.push_back(i);
+        }
+        listener.bFull = false;
+        listener.vnChangedSlots.clear();
+        listener.vbQueued.assign(mvpPoints.size(), false);
+    }
+    else
+    {
+        vnSlots.swap(listener.vnChangedSlots);
+        for(size_t i=0; i<vnSlots.size(); i++)
+            listener.vbQueued[vnSlots[i]] = false;
+    }
+
+    // The next move of each point notifies the listener again. The position is read after clearing
+    // the bit, a move between both is in the next changes.
+    const unsigned int nBit = 1u << nListener;
+    vbValid.reserve(vnSlots.size());
+    vPositions.reserve(vnSlots.size());
+    for(size_t i=0; i<vnSlots.size(); i++)
+    {
+        const unsigned int idx = vnSlots[i];
+        vbValid.push_back(mvpPoints[idx] != static_cast<MapPoint*>(NULL));
+        Eigen::Vector3f pos = Eigen::Vector3f::Zero();
+        if(mvpPoints[idx])
+        {
+            Block* pBlock = mvpBlocks[idx >> BLOCK_BITS].get();
+            const unsigned int off = idx & (BLOCK_SIZE-1);
+            pBlock->vnNotified[off].fetch_and(~nBit);
+            pBlock->vPositions[off].Load(pos.data());
+        }
+        vPositions.push_back(pos);
+    }
+
+    return bFull;
+}
+
+} //namespace ORB_SLAM3
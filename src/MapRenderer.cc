@@ -0,0 +1,285 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "MapRenderer.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+// Initial number of point slots of the buffer
+static const size_t MIN_POINT_CAPACITY = 1024;
+
+// Upload the vertices, the buffer is reallocated if they do not fit
+static void UploadVertices(pangolin::GlBuffer &buffer, const vector<Eigen::Vector3f> &vVertices)
+{
+    if(vVertices.empty())
+        return;
+
+    if(!buffer.IsValid() || buffer.num_elements < vVertices.size())
+        buffer.Reinitialise(pangolin::GlArrayBuffer, vVertices.size(), GL_FLOAT, 3, GL_DYNAMIC_DRAW);
+    buffer.Upload(vVertices[0].data(), vVertices.size()*sizeof(Eigen::Vector3f));
+}
+
+static void DrawLines(pangolin::GlBuffer &buffer, const size_t nVertices)
+{
+    if(nVertices == 0)
+        return;
+
+    buffer.Bind();
+    glVertexPointer(3, GL_FLOAT, 0, 0);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glDrawArrays(GL_LINES, 0, nVertices);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    buffer.Unbind();
+}
+
+MapRenderer::MapRenderer(Atlas* pAtlas, const float keyFrameSize): mCollector(pAtlas), mKeyFrameSize(keyFrameSize),
+    mnPointIndices(0), mnKeyFrameVertices(0), mnGraphVertices(0), mnInertialVertices(0), mbImuInitialized(false)
+{
+}
+
+void MapRenderer::Update()
+{
+    if(!mCollector.Collect(mUpdate))
+        return;
+
+    UpdatePoints();
+    if(mUpdate.bKeyFrames)
+        UpdateKeyFrames();
+    mvReferencePoints.swap(mUpdate.vReferencePoints);
+}
+
+void MapRenderer::UpdatePoints()
+{
+    bool bIndicesChanged = false;
+    if(mUpdate.bFull)
+    {
+        mvPointPositions.clear();
+        mvbPointValid.clear();
+        bIndicesChanged = true;
+    }
+
+    const size_t nSlots = mUpdate.nPointSlots;
+    if(mvPointPositions.size() < nSlots)
+    {
+        mvPointPositions.resize(nSlots, Eigen::Vector3f::Zero());
+        mvbPointValid.resize(nSlots, false);
+    }
+
+    // Range of slots to upload
+    size_t nFirst = nSlots, nLast = 0;
+    for(size_t i=0; i<mUpdate.vnPointSlots.size(); i++)
+    {
+        const size_t idx = mUpdate.vnPointSlots[i];
+        mvPointPositions[idx] = mUpdate.vPointPositions[i];
+        if(mvbPointValid[idx] != mUpdate.vbPointValid[i])
+        {
+            mvbPointValid[idx] = mUpdate.vbPointValid[i];
+            bIndicesChanged = true;
+        }
+        nFirst = min(nFirst, idx);
+        nLast = max(nLast, idx);
+    }
+
+    if(nSlots == 0)
+    {
+        mnPointIndices = 0;
+        return;
+    }
+
+    if(!mPointBuffer.IsValid() || mPointBuffer.num_elements < nSlots)
+    {
+        // New slots in a full buffer, the copy is uploaded again to a buffer with twice the capacity
+        size_t nCapacity = max(MIN_POINT_CAPACITY, static_cast<size_t>(mPointBuffer.IsValid() ? 2*mPointBuffer.num_elements : 0));
+        while(nCapacity < nSlots)
+            nCapacity *= 2;
+        mPointBuffer.Reinitialise(pangolin::GlArrayBuffer, nCapacity, GL_FLOAT, 3, GL_DYNAMIC_DRAW);
+        mPointBuffer.Upload(mvPointPositions[0].data(), nSlots*sizeof(Eigen::Vector3f));
+    }
+    else if(nFirst <= nLast)
+    {
+        mPointBuffer.Upload(mvPointPositions[nFirst].data(), (nLast-nFirst+1)*sizeof(Eigen::Vector3f),
+                            nFirst*sizeof(Eigen::Vector3f));
+    }
+
+    if(bIndicesChanged)
+    {
+        vector<GLuint> vIndices;
+        vIndices.reserve(nSlots);
+        for(size_t i=0; i<nSlots; i++)
+        {
+            if(mvbPointValid[i])
+                vIndices.push_back(i);
+        }
+
+        mnPointIndices = vIndices.size();
+        if(!vIndices.empty())
+        {
+            if(!mPointIndexBuffer.IsValid() || mPointIndexBuffer.num_elements < vIndices.size())
+                mPointIndexBuffer.Reinitialise(pangolin::GlElementArrayBuffer, mPointBuffer.num_elements, GL_UNSIGNED_INT, 1, GL_DYNAMIC_DRAW);
+            mPointIndexBuffer.Upload(vIndices.data(), vIndices.size()*sizeof(GLuint));
+        }
+    }
+}
+
+void MapRenderer::UpdateKeyFrames()
+{
+    const float &w = mKeyFrameSize;
+    const float h = w*0.75;
+    const float z = w*0.6;
+
+    // Lines of the frustum in camera coordinates
+    const Eigen::Vector3f vFrustum[16] = {
+        Eigen::Vector3f(0,0,0), Eigen::Vector3f(w,h,z),
+        Eigen::Vector3f(0,0,0), Eigen::Vector3f(w,-h,z),
+        Eigen::Vector3f(0,0,0), Eigen::Vector3f(-w,-h,z),
+        Eigen::Vector3f(0,0,0), Eigen::Vector3f(-w,h,z),
+        Eigen::Vector3f(w,h,z), Eigen::Vector3f(w,-h,z),
+        Eigen::Vector3f(-w,h,z), Eigen::Vector3f(-w,-h,z),
+        Eigen::Vector3f(-w,h,z), Eigen::Vector3f(w,h,z),
+        Eigen::Vector3f(-w,-h,z), Eigen::Vector3f(w,-h,z)};
+
+    vector<Eigen::Vector3f> vVertices, vColors;
+    vVertices.reserve(16*mUpdate.vKeyFramePoses.size());
+    vColors.reserve(16*mUpdate.vKeyFramePoses.size());
+    mvFirstKeyFrameLines.clear();
+
+    for(size_t i=0; i<mUpdate.vKeyFramePoses.size(); i++)
+    {
+        const Eigen::Matrix4f &Twc = mUpdate.vKeyFramePoses[i];
+        const Eigen::Matrix3f Rwc = Twc.block<3,3>(0,0);
+        const Eigen::Vector3f twc = Twc.block<3,1>(0,3);
+
+        const int nType = mUpdate.vnKeyFrameTypes[i];
+        Eigen::Vector3f color(0.0f,0.0f,1.0f); // Basic color
+        if(nType == MapUpdate::KF_LBA_OPTIMIZED)
+            color = Eigen::Vector3f(0.0f,1.0f,0.0f); // Green -> Opt KFs
+        else if(nType == MapUpdate::KF_LBA_FIXED)
+            color = Eigen::Vector3f(1.0f,0.0f,0.0f); // Red -> Fixed KFs
+
+        for(int j=0; j<16; j++)
+        {
+            const Eigen::Vector3f x3Dw = Rwc*vFrustum[j]+twc;
+            if(nType == MapUpdate::KF_FIRST)
+            {
+                mvFirstKeyFrameLines.push_back(x3Dw);
+            }
+            else
+            {
+                vVertices.push_back(x3Dw);
+                vColors.push_back(color);
+            }
+        }
+    }
+
+    UploadVertices(mKeyFrameBuffer, vVertices);
+    UploadVertices(mKeyFrameColorBuffer, vColors);
+    mnKeyFrameVertices = vVertices.size();
+
+    UploadVertices(mGraphBuffer, mUpdate.vGraphLines);
+    mnGraphVertices = mUpdate.vGraphLines.size();
+
+    UploadVertices(mInertialBuffer, mUpdate.vInertialLines);
+    mnInertialVertices = mUpdate.vInertialLines.size();
+    mbImuInitialized = mUpdate.bImuInitialized;
+}
+
+void MapRenderer::DrawMapPoints(const float pointSize)
+{
+    glPointSize(pointSize);
+
+    // The reference points go first, the black copy of them in the buffer fails the depth test
+    glBegin(GL_POINTS);
+    glColor3f(1.0,0.0,0.0);
+    for(size_t i=0; i<mvReferencePoints.size(); i++)
+    {
+        const Eigen::Vector3f &pos = mvReferencePoints[i];
+        glVertex3f(pos(0),pos(1),pos(2));
+    }
+    glEnd();
+
+    if(mnPointIndices == 0)
+        return;
+
+    glColor3f(0.0,0.0,0.0);
+    mPointBuffer.Bind();
+    glVertexPointer(3, GL_FLOAT, 0, 0);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    mPointIndexBuffer.Bind();
+    glDrawElements(GL_POINTS, mnPointIndices, GL_UNSIGNED_INT, 0);
+    mPointIndexBuffer.Unbind();
+    glDisableClientState(GL_VERTEX_ARRAY);
+    mPointBuffer.Unbind();
+}
+
+void MapRenderer::DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph, const bool bDrawInertialGraph, const bool bDrawOptLba,
+                                const float keyFrameLineWidth, const float graphLineWidth)
+{
+    if(bDrawKF)
+    {
+        if(!mvFirstKeyFrameLines.empty())
+        {
+            glLineWidth(keyFrameLineWidth*5);
+            glColor3f(1.0f,0.0f,0.0f);
+            glBegin(GL_LINES);
+            for(size_t i=0; i<mvFirstKeyFrameLines.size(); i++)
+            {
+                const Eigen::Vector3f &x3Dw = mvFirstKeyFrameLines[i];
+                glVertex3f(x3Dw(0),x3Dw(1),x3Dw(2));
+            }
+            glEnd();
+        }
+
+        glLineWidth(keyFrameLineWidth);
+        if(bDrawOptLba && mnKeyFrameVertices > 0)
+        {
+            mKeyFrameColorBuffer.Bind();
+            glColorPointer(3, GL_FLOAT, 0, 0);
+            glEnableClientState(GL_COLOR_ARRAY);
+            mKeyFrameColorBuffer.Unbind();
+        }
+        else
+        {
+            glColor3f(0.0f,0.0f,1.0f); // Basic color
+        }
+        DrawLines(mKeyFrameBuffer, mnKeyFrameVertices);
+        glDisableClientState(GL_COLOR_ARRAY);
+    }
+
+    if(bDrawGraph)
+    {
+        glLineWidth(graphLineWidth);
+        glColor4f(0.0f,1.0f,0.0f,0.6f);
+        DrawLines(mGraphBuffer, mnGraphVertices);
+    }
+
+    if(bDrawInertialGraph && mbImuInitialized)
+    {
+        glLineWidth(graphLineWidth);
+        glColor4f(1.0f,0.0f,0.0f,0.6f);
+        DrawLines(mInertialBuffer, mnInertialVertices);
+    }
+}
+
+} //namespace ORB_SLAM3
@@ -0,0 +1,856 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "MapServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/map.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include "Atlas.h"
+#include "Converter.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "Map.h"
+#include "MapPoint.h"
+#include "SerializationUtils.h"
+#include "SocketUtils.h"
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+// Time between the checks of the finish request while waiting for clients or requests
+static const int POLL_TIMEOUT_MS = 200;
+
+// Covisible keyframes of a keyframe record
+static const int RECORD_COVISIBLES = 10;
+
+// Largest message accepted from the other end, a larger size closes the connection. A request has
+// the descriptors of one frame, a reply can have the keyframes and points of a whole map.
+static const uint64_t MAX_REQUEST_SIZE = 64ull << 20;
+static const uint64_t MAX_REPLY_SIZE = 4ull << 30;
+
+template<class Archive>
+void KeyFrameRecord::serialize(Archive &ar, const unsigned int version)
+{
+    ar & nId & nMapId;
+    serializeSophusSE3(ar, Tcw, version);
+    serializeVectorKeyPoints(ar, vKeysUn, version);
+    serializeMatrix(ar, descriptors, version);
+    ar & featVec;
+    ar & vnMapPointIds;
+    ar & vnCovisibleIds;
+}
+
+template<class Archive>
+void MapPointRecord::serialize(Archive &ar, const unsigned int version)
+{
+    ar & nId & nMapId;
+    ar & boost::serialization::make_array(pos.data(), pos.size());
+    ar & boost::serialization::make_array(normal.data(), normal.size());
+    serializeMatrix(ar, descriptor, version);
+    ar & fMinDistance & fMaxDistance;
+}
+
+// Archives of the requests and replies, defined here for the code that decodes them elsewhere (tests)
+template void KeyFrameRecord::serialize(boost::archive::binary_iarchive &ar, const unsigned int version);
+template void KeyFrameRecord::serialize(boost::archive::binary_oarchive &ar, const unsigned int version);
+template void MapPointRecord::serialize(boost::archive::binary_iarchive &ar, const unsigned int version);
+template void MapPointRecord::serialize(boost::archive::binary_oarchive &ar, const unsigned int version);
+
+static KeyFrameRecord MakeRecord(KeyFrame* pKF)
+{
+    KeyFrameRecord record;
+    record.nId = pKF->mnId;
+    Map* pMap = pKF->GetMap();
+    record.nMapId = pMap ? pMap->GetId() : 0;
+    record.Tcw = pKF->GetPose();
+    record.vKeysUn = pKF->mvKeysUn;
+    record.descriptors = pKF->mDescriptors;
+    record.featVec = pKF->mFeatVec;
+
+    const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
+    record.vnMapPointIds.resize(vpMPs.size(), -1);
+    for(size_t i=0; i<vpMPs.size(); i++)
+        if(vpMPs[i] && !vpMPs[i]->isBad())
+            record.vnMapPointIds[i] = vpMPs[i]->mnId;
+
+    const vector<KeyFrame*> vpCovisibles = pKF->GetBestCovisibilityKeyFrames(RECORD_COVISIBLES);
+    for(KeyFrame* pKFi : vpCovisibles)
+        if(pKFi && !pKFi->isBad())
+            record.vnCovisibleIds.push_back(pKFi->mnId);
+
+    return record;
+}
+
+static MapPointRecord MakeRecord(MapPoint* pMP)
+{
+    MapPointRecord record;
+    record.nId = pMP->mnId;
+    Map* pMap = pMP->GetMap();
+    record.nMapId = pMap ? pMap->GetId() : 0;
+    record.pos = pMP->GetWorldPos();
+    record.normal = pMP->GetNormal();
+    record.descriptor = pMP->GetDescriptor();
+    record.fMinDistance = pMP->GetMinDistanceInvariance();
+    record.fMaxDistance = pMP->GetMaxDistanceInvariance();
+    return record;
+}
+
+MapServer::MapServer(Atlas* pAtlas, ORBVocabulary* pVoc, KeyFrameDatabase* pKFDB):
+    mpAtlas(pAtlas), mpVoc(pVoc), mpKeyFrameDB(pKFDB), mnMaxIndexedId(0), mnListenFd(-1), mbFinishRequested(false), mbFinished(false)
+{
+    UpdateKeyFrameIndex();
+}
+
+MapServer::~MapServer()
+{
+    if(mnListenFd >= 0)
+    {
+        close(mnListenFd);
+        unlink(mStrSocket.c_str());
+    }
+}
+
+bool MapServer::HandleRequest(Session &session, const uint32_t nType, const string &strRequest, string &strReply)
+{
+    try
+    {
+        istringstream is(strRequest, ios::binary);
+        ostringstream os(ios::binary);
+        {
+            boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+
+            if(nType == MAPS_REQUEST)
+            {
+                vector<MapInfo> vMaps;
+                GetMaps(vMaps);
+                oa << vMaps;
+            }
+            else if(nType == RELOCALIZATION_REQUEST)
+            {
+                boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+                cv::Mat descriptors;
+                long nMapId;
+                serializeMatrix(ia, descriptors, 0);
+                ia >> nMapId;
+
+                vector<unsigned long> vnCandidates;
+                BowVector bowVec;
+                FeatureVector featVec;
+                DetectRelocalizationCandidates(descriptors, nMapId, vnCandidates, bowVec, featVec);
+
+                // The candidates with their points, the matching and PnP need them
+                vector<unsigned long> vnLocalKFs, vnLocalMPs;
+                vector<KeyFrameRecord> vKeyFrames;
+                vector<MapPointRecord> vMapPoints;
+                GetLocalMap(session, vnCandidates, 0, vnLocalKFs, vnLocalMPs, vKeyFrames, vMapPoints);
+
+                oa << vnCandidates;
+                oa << bowVec;
+                oa << featVec;
+                oa << vKeyFrames;
+                oa << vMapPoints;
+            }
+            else if(nType == LOCAL_MAP_REQUEST)
+            {
+                boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+                vector<unsigned long> vnKFIds;
+                int nCovisibles;
+                ia >> vnKFIds;
+                ia >> nCovisibles;
+
+                vector<unsigned long> vnLocalKFs, vnLocalMPs;
+                vector<KeyFrameRecord> vKeyFrames;
+                vector<MapPointRecord> vMapPoints;
+                GetLocalMap(session, vnKFIds, nCovisibles, vnLocalKFs, vnLocalMPs, vKeyFrames, vMapPoints);
+
+                oa << vnLocalKFs;
+                oa << vnLocalMPs;
+                oa << vKeyFrames;
+                oa << vMapPoints;
+            }
+            else if(nType == BOW_REQUEST)
+            {
+                boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+                cv::Mat descriptors;
+                serializeMatrix(ia, descriptors, 0);
+
+                BowVector bowVec;
+                FeatureVector featVec;
+                if(!descriptors.empty())
+                {
+                    vector<cv::Mat> vDesc = Converter::toDescriptorVector(descriptors);
+                    mpVoc->transform(vDesc, bowVec, featVec, DBOW_LEVELS);
+                }
+
+                oa << bowVec;
+                oa << featVec;
+            }
+            else
+            {
+                cout << "[E] Map server: unknown request " << nType << endl;
+                return false;
+            }
+        }
+        strReply = os.str();
+    }
+    catch(const std::exception &e)
+    {
+        cout << "[E] Map server: malformed request (" << e.what() << ")" << endl;
+        return false;
+    }
+    return true;
+}
+
+void MapServer::GetMaps(vector<MapInfo> &vMaps)
+{
+    const vector<Map*> vpMaps = mpAtlas->GetAllMaps();
+    for(Map* pMap : vpMaps)
+    {
+        if(!pMap || pMap->IsBad() || pMap->KeyFramesInMap() == 0)
+            continue;
+
+        MapInfo info;
+        info.nId = pMap->GetId();
+        info.nKeyFrames = pMap->KeyFramesInMap();
+        info.nMapPoints = pMap->MapPointsInMap();
+        vMaps.push_back(info);
+    }
+}
+
+void MapServer::DetectRelocalizationCandidates(const cv::Mat &descriptors, const long nMapId, vector<unsigned long> &vnCandidates,
+                                               BowVector &bowVec, FeatureVector &featVec)
+{
+    if(descriptors.empty())
+        return;
+
+    vector<cv::Mat> vDesc = Converter::toDescriptorVector(descriptors);
+    mpVoc->transform(vDesc, bowVec, featVec, DBOW_LEVELS);
+
+    Map* pMap = static_cast<Map*>(NULL);
+    if(nMapId >= 0)
+    {
+        pMap = GetMap(nMapId);
+        if(!pMap)
+            return;
+    }
+
+    const vector<KeyFrame*> vpCandidates = mpKeyFrameDB->DetectRelocalizationCandidates(bowVec, pMap);
+    for(KeyFrame* pKFi : vpCandidates)
+        vnCandidates.push_back(pKFi->mnId);
+}
+
+void MapServer::GetLocalMap(Session &session, const vector<unsigned long> &vnKFIds, const int nCovisibles,
+                            vector<unsigned long> &vnLocalKFs, vector<unsigned long> &vnLocalMPs,
+                            vector<KeyFrameRecord> &vKeyFrames, vector<MapPointRecord> &vMapPoints)
+{
+    vector<KeyFrame*> vpLocalKFs;
+    set<KeyFrame*> spLocalKFs;
+    bool bIndexUpdated = false;
+    for(const unsigned long nId : vnKFIds)
+    {
+        KeyFrame* pKF = GetKeyFrame(nId, bIndexUpdated);
+        if(!pKF || pKF->isBad())
+            continue;
+
+        if(spLocalKFs.insert(pKF).second)
+            vpLocalKFs.push_back(pKF);
+
+        if(nCovisibles <= 0)
+            continue;
+
+        const vector<KeyFrame*> vpNeighs = pKF->GetBestCovisibilityKeyFrames(nCovisibles);
+        for(KeyFrame* pKFi : vpNeighs)
+            if(pKFi && !pKFi->isBad() && spLocalKFs.insert(pKFi).second)
+                vpLocalKFs.push_back(pKFi);
+    }
+
+    set<MapPoint*> spLocalMPs;
+    for(KeyFrame* pKF : vpLocalKFs)
+    {
+        // Pose of the keyframe and positions of its points from the same map state, not in the
+        // middle of a BA write-back or a loop correction. Shared with Tracking.
+        shared_lock<SharedMutex> lock(pKF->GetMap()->mMutexMapUpdate);
+
+        vnLocalKFs.push_back(pKF->mnId);
+        if(session.spKeyFrameIds.insert(pKF->mnId).second)
+            vKeyFrames.push_back(MakeRecord(pKF));
+
+        const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
+        for(MapPoint* pMP : vpMPs)
+        {
+            if(!pMP || pMP->isBad() || !spLocalMPs.insert(pMP).second)
+                continue;
+
+            vnLocalMPs.push_back(pMP->mnId);
+            if(session.spMapPointIds.insert(pMP->mnId).second)
+                vMapPoints.push_back(MakeRecord(pMP));
+        }
+    }
+}
+
+KeyFrame* MapServer::GetKeyFrame(const unsigned long nId, bool &bIndexUpdated)
+{
+    unique_lock<mutex> lock(mMutexIndex);
+    map<unsigned long, KeyFrame*>::const_iterator it = mmKeyFrames.find(nId);
+    if(it != mmKeyFrames.end())
+        return it->second;
+
+    // An id below the largest indexed is an erased keyframe, not a new one
+    if(bIndexUpdated || nId <= mnMaxIndexedId)
+        return static_cast<KeyFrame*>(NULL);
+
+    bIndexUpdated = true;
+    lock.unlock();
+    UpdateKeyFrameIndex();
+    lock.lock();
+
+    it = mmKeyFrames.find(nId);
+    return it != mmKeyFrames.end() ? it->second : static_cast<KeyFrame*>(NULL);
+}
+
+Map* MapServer::GetMap(const long nId)
+{
+    const vector<Map*> vpMaps = mpAtlas->GetAllMaps();
+    for(Map* pMap : vpMaps)
+        if(pMap && !pMap->IsBad() && static_cast<long>(pMap->GetId()) == nId)
+            return pMap;
+    return static_cast<Map*>(NULL);
+}
+
+void MapServer::UpdateKeyFrameIndex()
+{
+    map<unsigned long, KeyFrame*> mKeyFrames;
+    const vector<Map*> vpMaps = mpAtlas->GetAllMaps();
+    for(Map* pMap : vpMaps)
+    {
+        if(!pMap || pMap->IsBad())
+            continue;
+
+        const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+        for(KeyFrame* pKFi : vpKFs)
+            if(pKFi)
+                mKeyFrames[pKFi->mnId] = pKFi;
+    }
+
+    unique_lock<mutex> lock(mMutexIndex);
+    mmKeyFrames.swap(mKeyFrames);
+    if(!mmKeyFrames.empty())
+        mnMaxIndexedId = max(mnMaxIndexedId, mmKeyFrames.rbegin()->first);
+}
+
+bool MapServer::Listen(const string &strSocket)
+{
+    mnListenFd = ListenSocket(strSocket, "Map server");
+    if(mnListenFd < 0)
+        return false;
+
+    mStrSocket = strSocket;
+    cout << "Map server listening on " << strSocket << endl;
+    return true;
+}
+
+void MapServer::Run()
+{
+    while(mnListenFd >= 0)
+    {
+        {
+            unique_lock<mutex> lock(mMutexFinish);
+            if(mbFinishRequested)
+                break;
+        }
+
+        JoinFinishedClients();
+
+        pollfd pfd;
+        pfd.fd = mnListenFd;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, POLL_TIMEOUT_MS) <= 0)
+            continue;
+
+        const int fd = accept(mnListenFd, static_cast<sockaddr*>(NULL), static_cast<socklen_t*>(NULL));
+        if(fd < 0)
+            continue;
+
+        mvptClients.push_back(new thread(&MapServer::ServeClient, this, fd));
+    }
+
+    for(thread* pt : mvptClients)
+    {
+        pt->join();
+        delete pt;
+    }
+    mvptClients.clear();
+    {
+        unique_lock<mutex> lock(mMutexClients);
+        msFinishedClients.clear();
+    }
+
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+void MapServer::ServeClient(int fd)
+{
+    Session session;
+    string strRequest, strReply;
+    while(true)
+    {
+        {
+            unique_lock<mutex> lock(mMutexFinish);
+            if(mbFinishRequested)
+                break;
+        }
+
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        const int nReady = poll(&pfd, 1, POLL_TIMEOUT_MS);
+        if(nReady == 0 || (nReady < 0 && errno == EINTR))
+            continue;
+
+        uint32_t nType;
+        if(nReady < 0 || !ReadMessage(fd, nType, strRequest, MAX_REQUEST_SIZE))
+            break;
+
+        strReply.clear();
+        const bool bHandled = HandleRequest(session, nType, strRequest, strReply);
+        if(!WriteMessage(fd, bHandled ? 0 : 1, strReply))
+            break;
+    }
+    close(fd);
+
+    unique_lock<mutex> lock(mMutexClients);
+    msFinishedClients.insert(this_thread::get_id());
+}
+
+void MapServer::JoinFinishedClients()
+{
+    set<thread::id> sFinished;
+    {
+        unique_lock<mutex> lock(mMutexClients);
+        sFinished.swap(msFinishedClients);
+    }
+    if(sFinished.empty())
+        return;
+
+    vector<thread*> vptRunning;
+    for(thread* pt : mvptClients)
+    {
+        if(sFinished.count(pt->get_id()))
+        {
+            pt->join();
+            delete pt;
+        }
+        else
+            vptRunning.push_back(pt);
+    }
+    mvptClients.swap(vptRunning);
+}
+
+void MapServer::RequestFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+}
+
+bool MapServer::isFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+LocalMapTransport::LocalMapTransport(MapServer* pServer): mpServer(pServer)
+{
+}
+
+bool LocalMapTransport::Request(const uint32_t nType, const string &strRequest, string &strReply)
+{
+    return mpServer->HandleRequest(mSession, nType, strRequest, strReply);
+}
+
+SocketMapTransport::SocketMapTransport(): mnFd(-1)
+{
+}
+
+SocketMapTransport::~SocketMapTransport()
+{
+    Close();
+}
+
+bool SocketMapTransport::Connect(const string &strSocket)
+{
+    Close();
+
+    mnFd = ConnectSocket(strSocket, "Map client");
+    return mnFd >= 0;
+}
+
+void SocketMapTransport::Close()
+{
+    if(mnFd >= 0)
+        close(mnFd);
+    mnFd = -1;
+}
+
+bool SocketMapTransport::Request(const uint32_t nType, const string &strRequest, string &strReply)
+{
+    if(mnFd < 0)
+        return false;
+
+    uint32_t nStatus;
+    if(!WriteMessage(mnFd, nType, strRequest) || !ReadMessage(mnFd, nStatus, strReply, MAX_REPLY_SIZE))
+    {
+        // The session of the server is lost with the connection
+        Close();
+        return false;
+    }
+    return nStatus == 0;
+}
+
+MapClient::MapClient(MapTransport* pTransport): mpTransport(pTransport)
+{
+}
+
+bool MapClient::GetMaps(vector<MapInfo> &vMaps)
+{
+    string strReply;
+    if(!mpTransport->Request(MapServer::MAPS_REQUEST, string(), strReply))
+        return false;
+
+    try
+    {
+        istringstream is(strReply, ios::binary);
+        boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+        ia >> vMaps;
+    }
+    catch(const std::exception &e)
+    {
+        cout << "[E] Map client: malformed reply (" << e.what() << ")" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool MapClient::DetectRelocalizationCandidates(const cv::Mat &descriptors, const long nMapId, vector<const KeyFrameRecord*> &vpCandidates,
+                                               BowVector &bowVec, FeatureVector &featVec)
+{
+    ostringstream os(ios::binary);
+    {
+        boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+        serializeMatrix(oa, descriptors, 0);
+        oa << nMapId;
+    }
+
+    string strReply;
+    if(!mpTransport->Request(MapServer::RELOCALIZATION_REQUEST, os.str(), strReply))
+        return false;
+
+    vector<unsigned long> vnCandidates;
+    vector<KeyFrameRecord> vKeyFrames;
+    vector<MapPointRecord> vMapPoints;
+    try
+    {
+        istringstream is(strReply, ios::binary);
+        boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+        ia >> vnCandidates;
+        ia >> bowVec;
+        ia >> featVec;
+        ia >> vKeyFrames;
+        ia >> vMapPoints;
+    }
+    catch(const std::exception &e)
+    {
+        cout << "[E] Map client: malformed reply (" << e.what() << ")" << endl;
+        return false;
+    }
+
+    StoreRecords(vKeyFrames, vMapPoints);
+
+    vpCandidates.clear();
+    for(const unsigned long nId : vnCandidates)
+        if(const KeyFrameRecord* pRecord = GetKeyFrame(nId))
+            vpCandidates.push_back(pRecord);
+    return true;
+}
+
+bool MapClient::GetLocalMap(const vector<unsigned long> &vnKFIds, const int nCovisibles, vector<const KeyFrameRecord*> &vpKeyFrames,
+                            vector<const MapPointRecord*> &vpMapPoints)
+{
+    ostringstream os(ios::binary);
+    {
+        boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+        oa << vnKFIds;
+        oa << nCovisibles;
+    }
+
+    string strReply;
+    if(!mpTransport->Request(MapServer::LOCAL_MAP_REQUEST, os.str(), strReply))
+        return false;
+
+    vector<unsigned long> vnLocalKFs, vnLocalMPs;
+    vector<KeyFrameRecord> vKeyFrames;
+    vector<MapPointRecord> vMapPoints;
+    try
+    {
+        istringstream is(strReply, ios::binary);
+        boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+        ia >> vnLocalKFs;
+        ia >> vnLocalMPs;
+        ia >> vKeyFrames;
+        ia >> vMapPoints;
+    }
+    catch(const std::exception &e)
+    {
+        cout << "[E] Map client: malformed reply (" << e.what() << ")" << endl;
+        return false;
+    }
+
+    StoreRecords(vKeyFrames, vMapPoints);
+
+    vpKeyFrames.clear();
+    for(const unsigned long nId : vnLocalKFs)
+        if(const KeyFrameRecord* pRecord = GetKeyFrame(nId))
+            vpKeyFrames.push_back(pRecord);
+
+    vpMapPoints.clear();
+    for(const unsigned long nId : vnLocalMPs)
+        if(const MapPointRecord* pRecord = GetMapPoint(nId))
+            vpMapPoints.push_back(pRecord);
+    return true;
+}
+
+void MapClient::StoreRecords(vector<KeyFrameRecord> &vKeyFrames, vector<MapPointRecord> &vMapPoints)
+{
+    for(KeyFrameRecord &record : vKeyFrames)
+        swap(mmKeyFrames[record.nId], record);
+    for(MapPointRecord &record : vMapPoints)
+        swap(mmMapPoints[record.nId], record);
+}
+
+const KeyFrameRecord* MapClient::GetKeyFrame(const unsigned long nId) const
+{
+    map<unsigned long, KeyFrameRecord>::const_iterator it = mmKeyFrames.find(nId);
+    return it != mmKeyFrames.end() ? &it->second : static_cast<const KeyFrameRecord*>(NULL);
+}
+
+const MapPointRecord* MapClient::GetMapPoint(const unsigned long nId) const
+{
+    map<unsigned long, MapPointRecord>::const_iterator it = mmMapPoints.find(nId);
+    return it != mmMapPoints.end() ? &it->second : static_cast<const MapPointRecord*>(NULL);
+}
+
+bool MapClient::ComputeBoW(const cv::Mat &descriptors, BowVector &bowVec, FeatureVector &featVec)
+{
+    ostringstream os(ios::binary);
+    {
+        boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+        serializeMatrix(oa, descriptors, 0);
+    }
+
+    string strReply;
+    if(!mpTransport->Request(MapServer::BOW_REQUEST, os.str(), strReply))
+        return false;
+
+    try
+    {
+        istringstream is(strReply, ios::binary);
+        boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+        ia >> bowVec;
+        ia >> featVec;
+    }
+    catch(const std::exception &e)
+    {
+        cout << "[E] Map client: malformed reply (" << e.what() << ")" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool MapClient::ComputeBoW(Frame &F)
+{
+    if(!F.mBowVec.empty())
+        return true;
+    return ComputeBoW(F.mDescriptors, F.mBowVec, F.mFeatVec);
+}
+
+bool MapClient::DetectRelocalizationCandidates(Frame &F, Map* pMap, vector<KeyFrame*> &vpCandidates)
+{
+    vector<const KeyFrameRecord*> vpRecords;
+    BowVector bowVec;
+    FeatureVector featVec;
+    if(!DetectRelocalizationCandidates(F.mDescriptors, -1, vpRecords, bowVec, featVec))
+        return false;
+
+    if(F.mBowVec.empty())
+    {
+        F.mBowVec = bowVec;
+        F.mFeatVec = featVec;
+    }
+
+    vpCandidates.clear();
+    for(const KeyFrameRecord* pRecord : vpRecords)
+        if(KeyFrame* pKF = GetKeyFrameObject(pRecord->nId, F, pMap))
+            vpCandidates.push_back(pKF);
+    return true;
+}
+
+bool MapClient::GetCovisibles(const vector<KeyFrame*> &vpKFs, const int nCovisibles, Frame &F, Map* pMap,
+                              vector<vector<KeyFrame*> > &vvpCovisibles)
+{
+    // Covisibles not received yet
+    vector<unsigned long> vnMissing;
+    set<unsigned long> spMissing;
+    for(KeyFrame* pKF : vpKFs)
+    {
+        const KeyFrameRecord* pRecord = GetKeyFrame(pKF->mnId);
+        if(!pRecord)
+            continue;
+
+        const int nIds = min(nCovisibles, static_cast<int>(pRecord->vnCovisibleIds.size()));
+        for(int i=0; i<nIds; i++)
+        {
+            const unsigned long nId = pRecord->vnCovisibleIds[i];
+            if(!mmKeyFrames.count(nId) && spMissing.insert(nId).second)
+                vnMissing.push_back(nId);
+        }
+    }
+
+    bool bOK = true;
+    if(!vnMissing.empty())
+    {
+        vector<const KeyFrameRecord*> vpRecords;
+        vector<const MapPointRecord*> vpMPRecords;
+        bOK = GetLocalMap(vnMissing, 0, vpRecords, vpMPRecords);
+    }
+
+    vvpCovisibles.assign(vpKFs.size(), vector<KeyFrame*>());
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        const KeyFrameRecord* pRecord = GetKeyFrame(vpKFs[i]->mnId);
+        if(!pRecord)
+            continue;
+
+        const int nIds = min(nCovisibles, static_cast<int>(pRecord->vnCovisibleIds.size()));
+        for(int j=0; j<nIds; j++)
+            if(KeyFrame* pKFj = GetKeyFrameObject(pRecord->vnCovisibleIds[j], F, pMap))
+                vvpCovisibles[i].push_back(pKFj);
+    }
+    return bOK;
+}
+
+void MapClient::ClearObjects()
+{
+    mmpKeyFrames.clear();
+    mmpMapPoints.clear();
+}
+
+KeyFrame* MapClient::GetKeyFrameObject(const unsigned long nId, Frame &F, Map* pMap)
+{
+    map<unsigned long, KeyFrame*>::const_iterator it = mmpKeyFrames.find(nId);
+    if(it != mmpKeyFrames.end())
+        return it->second;
+
+    const KeyFrameRecord* pRecord = GetKeyFrame(nId);
+    if(!pRecord)
+        return static_cast<KeyFrame*>(NULL);
+
+    // Frame with the keypoints of the record and the camera and scale levels of F. The depth of the
+    // keypoints is not sent, they are monocular observations.
+    Frame frame(F);
+    frame.N = pRecord->vKeysUn.size();
+    frame.mvKeys = pRecord->vKeysUn;
+    frame.mvKeysUn = pRecord->vKeysUn;
+    frame.mvKeysRight.clear();
+    frame.mvuRight = vector<float>(frame.N,-1);
+    frame.mvDepth = vector<float>(frame.N,-1);
+    frame.mDescriptors = pRecord->descriptors;
+    frame.mDescriptorsRight = cv::Mat();
+    frame.mBowVec.clear();
+    frame.mFeatVec = pRecord->featVec;
+    frame.mvpMapPoints = vector<MapPoint*>(frame.N,static_cast<MapPoint*>(NULL));
+    frame.mvbOutlier = vector<bool>(frame.N,false);
+    frame.Nleft = -1;
+    frame.Nright = -1;
+    frame.mvLeftToRightMatch.clear();
+    frame.mvRightToLeftMatch.clear();
+    frame.mpCamera2 = static_cast<GeometricCamera*>(NULL);
+    frame.mpImuPreintegrated = static_cast<IMU::Preintegrated*>(NULL);
+    for(int i=0; i<FRAME_GRID_COLS; i++)
+        for(int j=0; j<FRAME_GRID_ROWS; j++)
+            frame.mGrid[i][j].clear();
+
+    KeyFrame* pKF = new KeyFrame(frame, pMap, static_cast<KeyFrameDatabase*>(NULL));
+    pKF->mnId = pRecord->nId;
+    pKF->SetPose(pRecord->Tcw);
+    mmpKeyFrames[nId] = pKF;
+
+    const int nPoints = min(frame.N, static_cast<int>(pRecord->vnMapPointIds.size()));
+    for(int i=0; i<nPoints; i++)
+    {
+        if(pRecord->vnMapPointIds[i] < 0)
+            continue;
+
+        const MapPointRecord* pMPRecord = GetMapPoint(pRecord->vnMapPointIds[i]);
+        if(!pMPRecord)
+            continue;
+
+        MapPoint* pMP = GetMapPointObject(*pMPRecord, pKF, pMap);
+        pKF->AddMapPoint(pMP, i);
+        pMP->AddObservation(pKF, i);
+    }
+
+    pMap->AddKeyFrame(pKF);
+    return pKF;
+}
+
+MapPoint* MapClient::GetMapPointObject(const MapPointRecord &record, KeyFrame* pRefKF, Map* pMap)
+{
+    map<unsigned long, MapPoint*>::const_iterator it = mmpMapPoints.find(record.nId);
+    if(it != mmpMapPoints.end())
+        return it->second;
+
+    MapPoint* pMP = new MapPoint(record.pos, pRefKF, pMap);
+    pMP->mnId = record.nId;
+    // Not in a map yet, the data goes to the own copy of the point
+    *pMP->mpNormalVector = record.normal;
+    pMP->mDescriptor = record.descriptor.clone();
+    *pMP->mpfMinDistance = record.fMinDistance;
+    *pMP->mpfMaxDistance = record.fMaxDistance;
+    mmpMapPoints[record.nId] = pMP;
+
+    pMap->AddMapPoint(pMP);
+    return pMP;
+}
+
+} //namespace ORB_SLAM3
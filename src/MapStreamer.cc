@@ -0,0 +1,183 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "MapStreamer.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/archive/binary_oarchive.hpp>
+
+#include "MapDrawer.h"
+#include "SerializationUtils.h"
+#include "SocketUtils.h"
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+MapStreamer::MapStreamer(Atlas* pAtlas, MapDrawer* pMapDrawer, const double period): mpMapDrawer(pMapDrawer),
+    mCollector(pAtlas), mPeriod(period), mnListenFd(-1), mbFinishRequested(false), mbFinished(false)
+{
+}
+
+MapStreamer::~MapStreamer()
+{
+    for(size_t i=0; i<mvnClientFds.size(); i++)
+        close(mvnClientFds[i]);
+
+    if(mnListenFd >= 0)
+    {
+        close(mnListenFd);
+        unlink(mStrSocket.c_str());
+    }
+}
+
+bool MapStreamer::OpenFile(const string &strFile)
+{
+    mFile.open(strFile.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!mFile.is_open())
+    {
+        cout << "[E] Map streamer: unable to open " << strFile << endl;
+        return false;
+    }
+
+    cout << "Map streamed to " << strFile << endl;
+    return true;
+}
+
+bool MapStreamer::Listen(const string &strSocket)
+{
+    mnListenFd = ListenSocket(strSocket, "Map streamer");
+    if(mnListenFd < 0)
+        return false;
+
+    mStrSocket = strSocket;
+    cout << "Map streamed on " << strSocket << endl;
+    return true;
+}
+
+void MapStreamer::AcceptClients()
+{
+    if(mnListenFd < 0)
+        return;
+
+    while(true)
+    {
+        pollfd pfd;
+        pfd.fd = mnListenFd;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, 0) <= 0)
+            break;
+
+        const int fd = accept(mnListenFd, static_cast<sockaddr*>(NULL), static_cast<socklen_t*>(NULL));
+        if(fd < 0)
+            break;
+
+        mvnClientFds.push_back(fd);
+        // The new client needs the whole map
+        mCollector.Reset();
+    }
+}
+
+void MapStreamer::Send(const MapUpdate &update)
+{
+    Sophus::SE3f Twc = mpMapDrawer->GetCurrentCameraPose();
+
+    ostringstream os(ios::binary);
+    {
+        boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+        oa << update;
+        serializeSophusSE3(oa, Twc, 0);
+    }
+    const string strData = os.str();
+
+    const uint32_t nType = update.bFull ? FULL_UPDATE : INCREMENTAL_UPDATE;
+
+    if(mFile.is_open())
+    {
+        MessageHeader header;
+        header.nValue = nType;
+        header.nReserved = 0;
+        header.nSize = strData.size();
+        mFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        mFile.write(strData.data(), strData.size());
+        mFile.flush();
+    }
+
+    for(size_t i=0; i<mvnClientFds.size();)
+    {
+        const int fd = mvnClientFds[i];
+        if(WriteMessage(fd, nType, strData))
+        {
+            i++;
+            continue;
+        }
+
+        // Client gone
+        close(fd);
+        mvnClientFds.erase(mvnClientFds.begin()+i);
+    }
+}
+
+void MapStreamer::Run()
+{
+    MapUpdate update;
+
+    unique_lock<mutex> lock(mMutexFinish);
+    while(!mbFinishRequested)
+    {
+        mCondFinish.wait_for(lock, chrono::duration<double>(mPeriod));
+        if(mbFinishRequested)
+            break;
+
+        lock.unlock();
+        AcceptClients();
+        // Nothing to send without receivers, the collector keeps the changes pending. The camera pose
+        // is sent even if the map did not change.
+        if((mFile.is_open() || !mvnClientFds.empty()) && mCollector.Collect(update))
+            Send(update);
+        lock.lock();
+    }
+
+    mbFinished = true;
+}
+
+void MapStreamer::RequestFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+    mCondFinish.notify_all();
+}
+
+bool MapStreamer::isFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+} //namespace ORB_SLAM3
@@ -0,0 +1,263 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "MapUpdate.h"
+
+#include <iostream>
+#include <set>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/array.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include "Atlas.h"
+#include "KeyFrame.h"
+#include "Map.h"
+#include "MapPoint.h"
+#include "MapPointStore.h"
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+// Minimum weight of the covisibility edges drawn (as MapDrawer::DrawKeyFrames)
+static const int GRAPH_MIN_WEIGHT = 100;
+
+template<class Archive>
+static void serializeVectorPoints(Archive &ar, vector<Eigen::Vector3f> &vPoints)
+{
+    unsigned long nSize = vPoints.size();
+    ar & nSize;
+    if(Archive::is_loading::value)
+        vPoints.resize(nSize);
+    for(size_t i=0; i<vPoints.size(); i++)
+        ar & boost::serialization::make_array(vPoints[i].data(), vPoints[i].size());
+}
+
+MapUpdate::MapUpdate()
+{
+    Clear();
+}
+
+void MapUpdate::Clear()
+{
+    nMapId = -1;
+    bFull = false;
+    nPointSlots = 0;
+    vnPointSlots.clear();
+    vPointPositions.clear();
+    vbPointValid.clear();
+    vReferencePoints.clear();
+    bKeyFrames = false;
+    vnKeyFrameIds.clear();
+    vKeyFramePoses.clear();
+    vnKeyFrameTypes.clear();
+    vGraphLines.clear();
+    vInertialLines.clear();
+    bImuInitialized = false;
+}
+
+template<class Archive>
+void MapUpdate::serialize(Archive &ar, const unsigned int version)
+{
+    ar & nMapId & bFull;
+    ar & nPointSlots;
+    ar & vnPointSlots;
+    serializeVectorPoints(ar, vPointPositions);
+    ar & vbPointValid;
+    serializeVectorPoints(ar, vReferencePoints);
+    ar & bKeyFrames;
+    ar & vnKeyFrameIds;
+    unsigned long nPoses = vKeyFramePoses.size();
+    ar & nPoses;
+    if(Archive::is_loading::value)
+        vKeyFramePoses.resize(nPoses);
+    for(size_t i=0; i<vKeyFramePoses.size(); i++)
+        ar & boost::serialization::make_array(vKeyFramePoses[i].data(), vKeyFramePoses[i].size());
+    ar & vnKeyFrameTypes;
+    serializeVectorPoints(ar, vGraphLines);
+    serializeVectorPoints(ar, vInertialLines);
+    ar & bImuInitialized;
+}
+
+template void MapUpdate::serialize(boost::archive::binary_oarchive &ar, const unsigned int version);
+template void MapUpdate::serialize(boost::archive::binary_iarchive &ar, const unsigned int version);
+
+MapUpdateCollector::MapUpdateCollector(Atlas* pAtlas): mpAtlas(pAtlas), mbFull(true), mnLastMapId(-1),
+    mpStore(static_cast<MapPointStore*>(NULL)), mnListener(-1), mnLastChangeIdx(0), mnLastBigChangeIdx(0),
+    mnLastKeyFrames(0), mnLastMaxKFid(0), mbLastImuInitialized(false)
+{
+}
+
+MapUpdateCollector::~MapUpdateCollector()
+{
+    if(mpStore && mnListener >= 0)
+        mpStore->RemoveListener(mnListener);
+}
+
+void MapUpdateCollector::Reset()
+{
+    mbFull = true;
+}
+
+bool MapUpdateCollector::Collect(MapUpdate &update)
+{
+    update.Clear();
+
+    Map* pMap = mpAtlas->GetCurrentMap();
+    if(!pMap)
+        return false;
+
+    update.nMapId = pMap->GetId();
+    if(update.nMapId != mnLastMapId)
+        mbFull = true;
+    mnLastMapId = update.nMapId;
+
+    CollectPoints(pMap, update);
+    CollectKeyFrames(pMap, update);
+    mbFull = false;
+
+    // Reference points of the tracking, sent complete
+    const vector<MapPoint*> vpRefMPs = pMap->GetReferenceMapPoints();
+    update.vReferencePoints.reserve(vpRefMPs.size());
+    for(size_t i=0; i<vpRefMPs.size(); i++)
+    {
+        if(!vpRefMPs[i] || vpRefMPs[i]->isBad())
+            continue;
+        update.vReferencePoints.push_back(vpRefMPs[i]->GetWorldPos());
+    }
+
+    return true;
+}
+
+void MapUpdateCollector::CollectPoints(Map* pMap, MapUpdate &update)
+{
+    // Maps are not deleted, the listener in the store of the previous map can be removed
+    MapPointStore* pStore = pMap->GetMapPointStore();
+    if(pStore != mpStore)
+    {
+        if(mpStore && mnListener >= 0)
+            mpStore->RemoveListener(mnListener);
+        mpStore = pStore;
+        mnListener = mpStore->AddListener();
+        if(mnListener < 0)
+            cout << "[E] Map update: too many listeners of the map points" << endl;
+    }
+    if(mnListener < 0)
+    {
+        update.bFull = mbFull;
+        return;
+    }
+
+    // The changed slots and their positions are read from the columns of the store, without locking the points
+    size_t nSlots;
+    if(mpStore->TakeChanges(mnListener, mbFull, update.vnPointSlots, update.vbPointValid, update.vPointPositions, nSlots))
+        mbFull = true;
+    update.bFull = mbFull;
+    update.nPointSlots = nSlots;
+}
+
+void MapUpdateCollector::CollectKeyFrames(Map* pMap, MapUpdate &update)
+{
+    // Keyframe poses only change in the optimizations, which increase the change index of the map
+    const int nChangeIdx = pMap->GetMapChangeIndex();
+    const int nBigChangeIdx = pMap->GetLastBigChangeIdx();
+    const unsigned long nKeyFrames = pMap->KeyFramesInMap();
+    const unsigned long nMaxKFid = pMap->GetMaxKFid();
+    const bool bImuInitialized = pMap->isImuInitialized();
+
+    if(!mbFull && nChangeIdx == mnLastChangeIdx && nBigChangeIdx == mnLastBigChangeIdx &&
+       nKeyFrames == mnLastKeyFrames && nMaxKFid == mnLastMaxKFid && bImuInitialized == mbLastImuInitialized)
+        return;
+
+    mnLastChangeIdx = nChangeIdx;
+    mnLastBigChangeIdx = nBigChangeIdx;
+    mnLastKeyFrames = nKeyFrames;
+    mnLastMaxKFid = nMaxKFid;
+    mbLastImuInitialized = bImuInitialized;
+
+    update.bKeyFrames = true;
+    update.bImuInitialized = bImuInitialized;
+
+    // DEBUG LBA
+    const set<long unsigned int> sOptKFs = pMap->msOptKFs;
+    const set<long unsigned int> sFixedKFs = pMap->msFixedKFs;
+
+    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+    update.vnKeyFrameIds.reserve(vpKFs.size());
+    update.vKeyFramePoses.reserve(vpKFs.size());
+    update.vnKeyFrameTypes.reserve(vpKFs.size());
+
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        update.vnKeyFrameIds.push_back(pKF->mnId);
+        update.vKeyFramePoses.push_back(pKF->GetPoseInverse().matrix());
+
+        int nType = MapUpdate::KF_OTHER;
+        if(!pKF->GetParent()) // It is the first KF in the map
+            nType = MapUpdate::KF_FIRST;
+        else if(sOptKFs.count(pKF->mnId))
+            nType = MapUpdate::KF_LBA_OPTIMIZED;
+        else if(sFixedKFs.count(pKF->mnId))
+            nType = MapUpdate::KF_LBA_FIXED;
+        update.vnKeyFrameTypes.push_back(nType);
+
+        // Covisibility Graph
+        const Eigen::Vector3f Ow = pKF->GetCameraCenter();
+        const vector<KeyFrame*> vCovKFs = pKF->GetCovisiblesByWeight(GRAPH_MIN_WEIGHT);
+        for(vector<KeyFrame*>::const_iterator vit=vCovKFs.begin(), vend=vCovKFs.end(); vit!=vend; vit++)
+        {
+            if((*vit)->mnId<pKF->mnId)
+                continue;
+            update.vGraphLines.push_back(Ow);
+            update.vGraphLines.push_back((*vit)->GetCameraCenter());
+        }
+
+        // Spanning tree
+        KeyFrame* pParent = pKF->GetParent();
+        if(pParent)
+        {
+            update.vGraphLines.push_back(Ow);
+            update.vGraphLines.push_back(pParent->GetCameraCenter());
+        }
+
+        // Loops
+        const KeyFrame::EdgeSet sLoopKFs = pKF->GetLoopEdges();
+        for(KeyFrame::EdgeSet::const_iterator sit=sLoopKFs.begin(), send=sLoopKFs.end(); sit!=send; sit++)
+        {
+            if((*sit)->mnId<pKF->mnId)
+                continue;
+            update.vGraphLines.push_back(Ow);
+            update.vGraphLines.push_back((*sit)->GetCameraCenter());
+        }
+
+        // Inertial links
+        if(bImuInitialized && pKF->mNextKF)
+        {
+            update.vInertialLines.push_back(Ow);
+            update.vInertialLines.push_back(pKF->mNextKF->GetCameraCenter());
+        }
+    }
+}
+
+} //namespace ORB_SLAM3
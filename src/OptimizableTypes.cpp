@@ -159,6 +159,30 @@ namespace ORB_SLAM3 {
         _jacobianOplusXj = projectJac * SE3deriv;
     }
 
+    bool EdgeSE3ProjectXYZ::linearizeOplusFloat(Eigen::Matrix<float,2,3> &A, Eigen::Matrix<float,2,6> &B) {
+        const g2o::VertexSE3Expmap * vj = static_cast<const g2o::VertexSE3Expmap *>(_vertices[1]);
+        const g2o::SE3Quat &T = vj->estimate();
+        const g2o::VertexSBAPointXYZ* vi = static_cast<const g2o::VertexSBAPointXYZ*>(_vertices[0]);
+        const Eigen::Matrix3f R = T.rotation().toRotationMatrix().cast<float>();
+        const Eigen::Vector3f xyz_trans = R * vi->estimate().cast<float>() + T.translation().cast<float>();
+
+        const float x = xyz_trans[0];
+        const float y = xyz_trans[1];
+        const float z = xyz_trans[2];
+
+        const Eigen::Matrix<float,2,3> projectJac = -pCamera->projectJac(xyz_trans);
+
+        A = projectJac * R;
+
+        Eigen::Matrix<float,3,6> SE3deriv;
+        SE3deriv << 0.f, z,   -y, 1.f, 0.f, 0.f,
+                -z , 0.f, x, 0.f, 1.f, 0.f,
+                y ,  -x , 0.f, 0.f, 0.f, 1.f;
+
+        B = projectJac * SE3deriv;
+        return true;
+    }
+
     EdgeSE3ProjectXYZToBody::EdgeSE3ProjectXYZToBody() : BaseBinaryEdge<2, Eigen::Vector2d, g2o::VertexSBAPointXYZ, g2o::VertexSE3Expmap>() {
     }
 
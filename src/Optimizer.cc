@@ -38,27 +38,47 @@
 #include "Converter.h"
 
 #include<mutex>
+#include<atomic>
+#include<fstream>
+#include<iomanip>
 
 #include "OptimizableTypes.h"
+#include "PoseSolver.h"
 
 
 namespace ORB_SLAM3
 {
+
 bool sortByVal(const pair<MapPoint*, int> &a, const pair<MapPoint*, int> &b)
 {
     return (a.second < b.second);
 }
 
-void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+// Process-wide, read by the mapping threads of every system
+static std::atomic<bool> sbMixedPrecision(false);
+
+void Optimizer::SetMixedPrecision(const bool bMixedPrecision)
+{
+    sbMixedPrecision.store(bMixedPrecision, std::memory_order_relaxed);
+}
+
+bool Optimizer::MixedPrecision()
+{
+    return sbMixedPrecision.load(std::memory_order_relaxed);
+}
+
+void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust, TaskScheduler* pScheduler,
+                                       eLinearSolver linearSolverType)
 {
     vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
     vector<MapPoint*> vpMP = pMap->GetAllMapPoints();
-    BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust);
+    BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust, pScheduler, linearSolverType);
 }
 
 
 void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<MapPoint *> &vpMP,
-                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust, TaskScheduler* pScheduler,
+                                 eLinearSolver linearSolverType)
 {
     vector<bool> vbNotIncludedMP;
     vbNotIncludedMP.resize(vpMP.size());
@@ -68,7 +88,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     g2o::SparseOptimizer optimizer;
     g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
 
-    linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    linearSolver = CreateLinearSolver<g2o::BlockSolver_6_3>(linearSolverType, vpKFs.size());
 
     g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
 
@@ -76,6 +96,11 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     optimizer.setAlgorithm(solver);
     optimizer.setVerbose(false);
 
+    G2oSchedulerExecutor executor(pScheduler, TaskScheduler::GLOBAL_BA);
+    if(pScheduler)
+        optimizer.setParallelExecutor(&executor);
+    optimizer.setMixedPrecision(MixedPrecision());
+
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
 
@@ -144,11 +169,11 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-       const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
+       const MapPoint::ObservationMap observations = pMP->GetObservations();
 
         int nEdges = 0;
         //SET EDGES
-        for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
         {
             KeyFrame* pKF = mit->first;
             if(pKF->isBad() || pKF->mnId>maxKFid)
@@ -389,7 +414,8 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     }
 }
 
-void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const long unsigned int nLoopId, bool *pbStopFlag, bool bInit, float priorG, float priorA, Eigen::VectorXd *vSingVal, bool *bHess)
+void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const long unsigned int nLoopId, bool *pbStopFlag, bool bInit, float priorG, float priorA, Eigen::VectorXd *vSingVal, bool *bHess, TaskScheduler* pScheduler,
+                               eLinearSolver linearSolverType)
 {
     long unsigned int maxKFid = pMap->GetMaxKFid();
     const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
@@ -399,7 +425,7 @@ void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const l
     g2o::SparseOptimizer optimizer;
     g2o::BlockSolverX::LinearSolverType * linearSolver;
 
-    linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
+    linearSolver = CreateLinearSolver<g2o::BlockSolverX>(linearSolverType, vpKFs.size());
 
     g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
 
@@ -408,6 +434,11 @@ void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const l
     optimizer.setAlgorithm(solver);
     optimizer.setVerbose(false);
 
+    G2oSchedulerExecutor executor(pScheduler, TaskScheduler::GLOBAL_BA);
+    if(pScheduler)
+        optimizer.setParallelExecutor(&executor);
+    optimizer.setMixedPrecision(MixedPrecision());
+
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
 
@@ -606,13 +637,13 @@ void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const l
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-        const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
+        const MapPoint::ObservationMap observations = pMP->GetObservations();
 
 
         bool bAllFixed = true;
 
         //Set edges
-        for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -811,46 +842,89 @@ void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal, const l
 }
 
 
-int Optimizer::PoseOptimization(Frame *pFrame)
+#ifdef REGISTER_POSE_FRAMES
+// Appends the problem of PoseOptimization (initial pose and observations) to PoseFrames.txt, replayed by
+// Tests/BenchPoseSolver. One block per frame:
+//   frame <observations> <fx> <fy> <cx> <cy> <bf>
+//   camera <type> <parameters> <p0> <p1> ...
+//   camera2 <type> <parameters> <p0> <p1> ... <Trl: qx qy qz qw tx ty tz>    (rig only)
+//   pose <Tcw: qx qy qz qw tx ty tz>
+//   <type as in PoseSolver> <invSigma2> <u> <v> <ur> <X> <Y> <Z>           (one line per observation)
+static void WritePoseFrame(Frame *pFrame)
 {
-    g2o::SparseOptimizer optimizer;
-    g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
+    static mutex mMutexFile;
+    static ofstream f("PoseFrames.txt");
 
-    linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
+    vector<int> vIdx;
+    for(int i=0; i<pFrame->N; i++)
+        if(pFrame->mvpMapPoints[i])
+            vIdx.push_back(i);
 
-    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    unique_lock<mutex> lock(mMutexFile);
+    f << setprecision(9);
+    f << "frame " << vIdx.size() << " " << pFrame->fx << " " << pFrame->fy << " " << pFrame->cx << " " << pFrame->cy << " " << pFrame->mbf << endl;
 
-    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-    optimizer.setAlgorithm(solver);
+    GeometricCamera* vpCameras[2] = {pFrame->mpCamera, pFrame->mpCamera2};
+    for(int c=0; c<2 && vpCameras[c]; c++)
+    {
+        f << (c==0 ? "camera " : "camera2 ") << vpCameras[c]->GetType() << " " << vpCameras[c]->size();
+        for(size_t j=0; j<vpCameras[c]->size(); j++)
+            f << " " << vpCameras[c]->getParameter(j);
+        if(c==1)
+        {
+            const Sophus::SE3f Trl = pFrame->GetRelativePoseTrl();
+            const Eigen::Quaternionf q = Trl.unit_quaternion();
+            f << " " << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << " " << Trl.translation().transpose();
+        }
+        f << endl;
+    }
 
-    int nInitialCorrespondences=0;
+    const Sophus::SE3f Tcw = pFrame->GetPose();
+    const Eigen::Quaternionf q = Tcw.unit_quaternion();
+    f << "pose " << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << " " << Tcw.translation().transpose() << endl;
 
-    // Set Frame vertex
-    g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-    Sophus::SE3<float> Tcw = pFrame->GetPose();
-    vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),Tcw.translation().cast<double>()));
-    vSE3->setId(0);
-    vSE3->setFixed(false);
-    optimizer.addVertex(vSE3);
+    for(size_t j=0; j<vIdx.size(); j++)
+    {
+        const int i = vIdx[j];
+        int type;
+        float ur = -1;
+        const cv::KeyPoint* pKP;
+        if(!pFrame->mpCamera2)
+        {
+            pKP = &pFrame->mvKeysUn[i];
+            ur = pFrame->mvuRight[i];
+            type = ur<0 ? PoseSolver::MONOCULAR : PoseSolver::STEREO;
+        }
+        else if(i < pFrame->Nleft)
+        {
+            pKP = &pFrame->mvKeys[i];
+            type = PoseSolver::MONOCULAR;
+        }
+        else
+        {
+            pKP = &pFrame->mvKeysRight[i - pFrame->Nleft];
+            type = PoseSolver::MONOCULAR_RIGHT;
+        }
 
-    // Set MapPoint vertices
-    const int N = pFrame->N;
+        f << type << " " << pFrame->mvInvLevelSigma2[pKP->octave] << " " << pKP->pt.x << " " << pKP->pt.y << " " << ur << " "
+          << pFrame->mvpMapPoints[i]->GetWorldPos().transpose() << endl;
+    }
+}
+#endif
 
-    vector<ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose*> vpEdgesMono;
-    vector<ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody *> vpEdgesMono_FHR;
-    vector<size_t> vnIndexEdgeMono, vnIndexEdgeRight;
-    vpEdgesMono.reserve(N);
-    vpEdgesMono_FHR.reserve(N);
-    vnIndexEdgeMono.reserve(N);
-    vnIndexEdgeRight.reserve(N);
+int Optimizer::PoseOptimization(Frame *pFrame)
+{
+    // The solver keeps its buffers from one frame to the next
+    static thread_local PoseSolver solver;
+    solver.Clear();
+    solver.SetCalibration(pFrame->mpCamera, pFrame->fx, pFrame->fy, pFrame->cx, pFrame->cy, pFrame->mbf);
+    if(pFrame->mpCamera2)
+        solver.SetRightCamera(pFrame->mpCamera2, pFrame->GetRelativePoseTrl());
+    solver.SetHuberDeltas(sqrt(5.991), sqrt(7.815));
 
-    vector<g2o::EdgeStereoSE3ProjectXYZOnlyPose*> vpEdgesStereo;
-    vector<size_t> vnIndexEdgeStereo;
-    vpEdgesStereo.reserve(N);
-    vnIndexEdgeStereo.reserve(N);
+    int nInitialCorrespondences=0;
 
-    const float deltaMono = sqrt(5.991);
-    const float deltaStereo = sqrt(7.815);
+    const int N = pFrame->N;
 
     {
     unique_lock<mutex> lock(MapPoint::mGlobalMutex);
@@ -858,139 +932,43 @@ int Optimizer::PoseOptimization(Frame *pFrame)
     for(int i=0; i<N; i++)
     {
         MapPoint* pMP = pFrame->mvpMapPoints[i];
-        if(pMP)
-        {
-            //Conventional SLAM
-            if(!pFrame->mpCamera2){
-                // Monocular observation
-                if(pFrame->mvuRight[i]<0)
-                {
-                    nInitialCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
-
-                    Eigen::Matrix<double,2,1> obs;
-                    const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-                    obs << kpUn.pt.x, kpUn.pt.y;
-
-                    ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose* e = new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose();
-
-                    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-                    e->setMeasurement(obs);
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                    e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
-
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(deltaMono);
-
-                    e->pCamera = pFrame->mpCamera;
-                    e->Xw = pMP->GetWorldPos().cast<double>();
-
-                    optimizer.addEdge(e);
-
-                    vpEdgesMono.push_back(e);
-                    vnIndexEdgeMono.push_back(i);
-                }
-                else  // Stereo observation
-                {
-                    nInitialCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
-
-                    Eigen::Matrix<double,3,1> obs;
-                    const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-                    const float &kp_ur = pFrame->mvuRight[i];
-                    obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-                    g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
-
-                    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-                    e->setMeasurement(obs);
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                    Eigen::Matrix3d Info = Eigen::Matrix3d::Identity()*invSigma2;
-                    e->setInformation(Info);
-
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(deltaStereo);
-
-                    e->fx = pFrame->fx;
-                    e->fy = pFrame->fy;
-                    e->cx = pFrame->cx;
-                    e->cy = pFrame->cy;
-                    e->bf = pFrame->mbf;
-                    e->Xw = pMP->GetWorldPos().cast<double>();
+        if(!pMP)
+            continue;
 
-                    optimizer.addEdge(e);
+        nInitialCorrespondences++;
+        pFrame->mvbOutlier[i] = false;
 
-                    vpEdgesStereo.push_back(e);
-                    vnIndexEdgeStereo.push_back(i);
-                }
+        //Conventional SLAM
+        if(!pFrame->mpCamera2)
+        {
+            const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
+
+            // Monocular observation
+            if(pFrame->mvuRight[i]<0)
+                solver.AddMonocular(pMP->GetWorldPos(), kpUn.pt.x, kpUn.pt.y, invSigma2, i);
+            else  // Stereo observation
+                solver.AddStereo(pMP->GetWorldPos(), kpUn.pt.x, kpUn.pt.y, pFrame->mvuRight[i], invSigma2, i);
+        }
+        //SLAM with respect a rigid body
+        else
+        {
+            if(i < pFrame->Nleft)    //Left camera observation
+            {
+                const cv::KeyPoint &kp = pFrame->mvKeys[i];
+                solver.AddMonocular(pMP->GetWorldPos(), kp.pt.x, kp.pt.y, pFrame->mvInvLevelSigma2[kp.octave], i);
             }
-            //SLAM with respect a rigid body
-            else{
-                nInitialCorrespondences++;
-
-                cv::KeyPoint kpUn;
-
-                if (i < pFrame->Nleft) {    //Left camera observation
-                    kpUn = pFrame->mvKeys[i];
-
-                    pFrame->mvbOutlier[i] = false;
-
-                    Eigen::Matrix<double, 2, 1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y;
-
-                    ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose *e = new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose();
-
-                    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(optimizer.vertex(0)));
-                    e->setMeasurement(obs);
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                    e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
-
-                    g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(deltaMono);
-
-                    e->pCamera = pFrame->mpCamera;
-                    e->Xw = pMP->GetWorldPos().cast<double>();
-
-                    optimizer.addEdge(e);
-
-                    vpEdgesMono.push_back(e);
-                    vnIndexEdgeMono.push_back(i);
-                }
-                else {
-                    kpUn = pFrame->mvKeysRight[i - pFrame->Nleft];
-
-                    Eigen::Matrix<double, 2, 1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y;
-
-                    pFrame->mvbOutlier[i] = false;
-
-                    ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody *e = new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody();
-
-                    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(optimizer.vertex(0)));
-                    e->setMeasurement(obs);
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                    e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
-
-                    g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(deltaMono);
-
-                    e->pCamera = pFrame->mpCamera2;
-                    e->Xw = pMP->GetWorldPos().cast<double>();
-
-                    e->mTrl = g2o::SE3Quat(pFrame->GetRelativePoseTrl().unit_quaternion().cast<double>(), pFrame->GetRelativePoseTrl().translation().cast<double>());
-
-                    optimizer.addEdge(e);
-
-                    vpEdgesMono_FHR.push_back(e);
-                    vnIndexEdgeRight.push_back(i);
-                }
+            else
+            {
+                const cv::KeyPoint &kp = pFrame->mvKeysRight[i - pFrame->Nleft];
+                solver.AddMonocularRight(pMP->GetWorldPos(), kp.pt.x, kp.pt.y, pFrame->mvInvLevelSigma2[kp.octave], i);
             }
         }
     }
+
+#ifdef REGISTER_POSE_FRAMES
+    WritePoseFrame(pFrame);
+#endif
     }
 
     if(nInitialCorrespondences<3)
@@ -1000,121 +978,34 @@ int Optimizer::PoseOptimization(Frame *pFrame)
     // At the next optimization, outliers are not included, but at the end they can be classified as inliers again.
     const float chi2Mono[4]={5.991,5.991,5.991,5.991};
     const float chi2Stereo[4]={7.815,7.815,7.815, 7.815};
-    const int its[4]={10,10,10,10};    
+    const int its[4]={10,10,10,10};
+
+    const Sophus::SE3f Tcw = pFrame->GetPose();
+    Sophus::SE3d Tcw_opt;
 
     int nBad=0;
     for(size_t it=0; it<4; it++)
     {
-        Tcw = pFrame->GetPose();
-        vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),Tcw.translation().cast<double>()));
-
-        optimizer.initializeOptimization(0);
-        optimizer.optimize(its[it]);
-
-        nBad=0;
-        for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
-        {
-            ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose* e = vpEdgesMono[i];
-
-            const size_t idx = vnIndexEdgeMono[i];
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-
-            if(chi2>chi2Mono[it])
-            {                
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBad++;
-            }
-            else
-            {
-                pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
-            }
-
-            if(it==2)
-                e->setRobustKernel(0);
-        }
-
-        for(size_t i=0, iend=vpEdgesMono_FHR.size(); i<iend; i++)
-        {
-            ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody* e = vpEdgesMono_FHR[i];
-
-            const size_t idx = vnIndexEdgeRight[i];
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-
-            if(chi2>chi2Mono[it])
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBad++;
-            }
-            else
-            {
-                pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
-            }
-
-            if(it==2)
-                e->setRobustKernel(0);
-        }
-
-        for(size_t i=0, iend=vpEdgesStereo.size(); i<iend; i++)
-        {
-            g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = vpEdgesStereo[i];
-
-            const size_t idx = vnIndexEdgeStereo[i];
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-
-            if(chi2>chi2Stereo[it])
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBad++;
-            }
-            else
-            {                
-                e->setLevel(0);
-                pFrame->mvbOutlier[idx]=false;
-            }
+        // Every optimization starts from the initial pose, the robust kernel is removed in the last one
+        Tcw_opt = Tcw.cast<double>();
+        solver.Optimize(Tcw_opt, its[it], it<3);
 
-            if(it==2)
-                e->setRobustKernel(0);
-        }
+        nBad = solver.ClassifyOutliers(Tcw_opt, chi2Mono[it], chi2Stereo[it], pFrame->mvbOutlier);
 
-        if(optimizer.edges().size()<10)
+        if(solver.Size()<10)
             break;
-    }    
+    }
 
     // Recover optimized pose and return number of inliers
-    g2o::VertexSE3Expmap* vSE3_recov = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(0));
-    g2o::SE3Quat SE3quat_recov = vSE3_recov->estimate();
-    Sophus::SE3<float> pose(SE3quat_recov.rotation().cast<float>(),
-            SE3quat_recov.translation().cast<float>());
-    pFrame->SetPose(pose);
+    pFrame->SetPose(Tcw_opt.cast<float>());
 
     return nInitialCorrespondences-nBad;
 }
 
-void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges)
+void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, TaskScheduler* pScheduler)
 {
+    const int nBigChangeIdx = pMap->GetLastBigChangeIdx();
+
     // Local KeyFrames: First Breath Search from Current Keyframe
     list<KeyFrame*> lLocalKeyFrames;
 
@@ -1163,8 +1054,8 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     list<KeyFrame*> lFixedCameras;
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
     {
-        map<KeyFrame*,tuple<int,int>> observations = (*lit)->GetObservations();
-        for(map<KeyFrame*,tuple<int,int>>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        MapPoint::ObservationMap observations = (*lit)->GetObservations();
+        for(MapPoint::ObservationMap::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -1200,6 +1091,11 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     optimizer.setAlgorithm(solver);
     optimizer.setVerbose(false);
 
+    G2oSchedulerExecutor executor(pScheduler, TaskScheduler::LOCAL_MAPPING);
+    if(pScheduler)
+        optimizer.setParallelExecutor(&executor);
+    optimizer.setMixedPrecision(MixedPrecision());
+
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
 
@@ -1290,10 +1186,10 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
         optimizer.addVertex(vPoint);
         nPoints++;
 
-        const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
+        const MapPoint::ObservationMap observations = pMP->GetObservations();
 
         //Set edges
-        for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -1461,7 +1357,11 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 
 
     // Get Map Mutex
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
+
+    // The map was corrected while optimizing (e.g. a global BA was published), the result is outdated
+    if(pMap->GetLastBigChangeIdx() != nBigChangeIdx)
+        return;
 
     if(!vToErase.empty())
     {
@@ -1501,13 +1401,14 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections, const bool &bFixScale)
+                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections, const bool &bFixScale,
+                                       eLinearSolver linearSolverType)
 {   
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
     optimizer.setVerbose(false);
     g2o::BlockSolver_7_3::LinearSolverType * linearSolver =
-           new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
+           CreateLinearSolver<g2o::BlockSolver_7_3>(linearSolverType, pMap->KeyFramesInMap());
     g2o::BlockSolver_7_3 * solver_ptr= new g2o::BlockSolver_7_3(linearSolver);
     g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
 
@@ -1647,8 +1548,8 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
         }
 
         // Loop edges
-        const set<KeyFrame*> sLoopEdges = pKF->GetLoopEdges();
-        for(set<KeyFrame*>::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
+        const KeyFrame::EdgeSet sLoopEdges = pKF->GetLoopEdges();
+        for(KeyFrame::EdgeSet::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
         {
             KeyFrame* pLKF = *sit;
             if(pLKF->mnId<pKF->mnId)
@@ -1730,7 +1631,7 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
     optimizer.computeActiveErrors();
     optimizer.optimize(20);
     optimizer.computeActiveErrors();
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
 
     // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
     for(size_t i=0;i<vpKFs.size();i++)
@@ -1969,8 +1870,8 @@ void Optimizer::OptimizeEssentialGraph(KeyFrame* pCurKF, vector<KeyFrame*> &vpFi
         }
 
         // Loop edges
-        const set<KeyFrame*> sLoopEdges = pKFi->GetLoopEdges();
-        for(set<KeyFrame*>::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
+        const KeyFrame::EdgeSet sLoopEdges = pKFi->GetLoopEdges();
+        for(KeyFrame::EdgeSet::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
         {
             KeyFrame* pLKF = *sit;
             if(spKFs.find(pLKF) != spKFs.end() && pLKF->mnId<pKFi->mnId)
@@ -2054,7 +1955,7 @@ void Optimizer::OptimizeEssentialGraph(KeyFrame* pCurKF, vector<KeyFrame*> &vpFi
     optimizer.initializeOptimization();
     optimizer.optimize(20);
 
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
 
     // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
     for(KeyFrame* pKFi : vpNonFixedKFs)
@@ -2380,9 +2281,10 @@ int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
     return nIn;
 }
 
-void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge, bool bRecInit)
+void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int& num_fixedKF, int& num_OptKF, int& num_MPs, int& num_edges, bool bLarge, bool bRecInit, TaskScheduler* pScheduler)
 {
     Map* pCurrentMap = pKF->GetMap();
+    const int nBigChangeIdx = pMap->GetLastBigChangeIdx();
 
     int maxOpt=10;
     int opt_it=10;
@@ -2482,8 +2384,8 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
 
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
     {
-        map<KeyFrame*,tuple<int,int>> observations = (*lit)->GetObservations();
-        for(map<KeyFrame*,tuple<int,int>>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        MapPoint::ObservationMap observations = (*lit)->GetObservations();
+        for(MapPoint::ObservationMap::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -2523,6 +2425,10 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
         optimizer.setAlgorithm(solver);
     }
 
+    G2oSchedulerExecutor executor(pScheduler, TaskScheduler::LOCAL_MAPPING);
+    if(pScheduler)
+        optimizer.setParallelExecutor(&executor);
+    optimizer.setMixedPrecision(MixedPrecision());
 
     // Set Local temporal KeyFrame vertices
     N=vpOptimizableKFs.size();
@@ -2715,10 +2621,10 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
         vPoint->setId(id);
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
-        const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
+        const MapPoint::ObservationMap observations = pMP->GetObservations();
 
         // Create visual constraints
-        for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -2884,8 +2790,11 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap, int&
     }
 
     // Get Map Mutex and erase outliers
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
 
+    // The map was corrected while optimizing (e.g. a global BA was published), the result is outdated
+    if(pMap->GetLastBigChangeIdx() != nBigChangeIdx)
+        return;
 
     // TODO: Some convergence problems have been detected here
     if((2*err < err_end || isnan(err) || isnan(err_end)) && !bLarge) //bGN)
@@ -3638,10 +3547,10 @@ void Optimizer::LocalBundleAdjustment(KeyFrame* pMainKF,vector<KeyFrame*> vpAdju
         optimizer.addVertex(vPoint);
 
 
-        const map<KeyFrame*,tuple<int,int>> observations = pMPi->GetObservations();
+        const MapPoint::ObservationMap observations = pMPi->GetObservations();
         int nEdges = 0;
         //SET EDGES
-        for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
         {
             KeyFrame* pKF = mit->first;
             if(pKF->isBad() || pKF->mnId>maxKFid || pKF->mnBALocalForMerge != pMainKF->mnId || !pKF->GetMapPoint(get<0>(mit->second)))
@@ -3822,7 +3731,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame* pMainKF,vector<KeyFrame*> vpAdju
     Verbose::PrintMess("[BA]: Second optimization, there are " + to_string(badMonoMP) + " monocular and " + to_string(badStereoMP) + " sterero bad edges", Verbose::VERBOSITY_DEBUG);
 
     // Get Map Mutex
-    unique_lock<mutex> lock(pMainKF->GetMap()->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(pMainKF->GetMap()->mMutexMapUpdate);
 
     if(!vToErase.empty())
     {
@@ -3840,8 +3749,8 @@ void Optimizer::LocalBundleAdjustment(KeyFrame* pMainKF,vector<KeyFrame*> vpAdju
         if(pMPi->isBad())
             continue;
 
-        const map<KeyFrame*,tuple<int,int>> observations = pMPi->GetObservations();
-        for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+        const MapPoint::ObservationMap observations = pMPi->GetObservations();
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
         {
             KeyFrame* pKF = mit->first;
             if(pKF->isBad() || pKF->mnId>maxKFid || pKF->mnBALocalForKF != pMainKF->mnId || !pKF->GetMapPoint(get<0>(mit->second)))
@@ -4068,10 +3977,10 @@ void Optimizer::MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbS
     int i=0;
     for(vector<pair<MapPoint*,int>>::iterator lit=pairs.begin(), lend=pairs.end(); lit!=lend; lit++, i++)
     {
-        map<KeyFrame*,tuple<int,int>> observations = lit->first->GetObservations();
+        MapPoint::ObservationMap observations = lit->first->GetObservations();
         if(i>=maxCovKF)
             break;
-        for(map<KeyFrame*,tuple<int,int>>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPoint::ObservationMap::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -4294,10 +4203,10 @@ void Optimizer::MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbS
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-        const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
+        const MapPoint::ObservationMap observations = pMP->GetObservations();
 
         // Create visual constraints
-        for(map<KeyFrame*,tuple<int,int>>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPoint::ObservationMap::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -4413,7 +4322,7 @@ void Optimizer::MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbS
     }
 
     // Get Map Mutex and erase outliers
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
     if(!vToErase.empty())
     {
         for(size_t i=0;i<vToErase.size();i++)
@@ -4488,610 +4397,171 @@ void Optimizer::MergeInertialBA(KeyFrame* pCurrKF, KeyFrame* pMergeKF, bool *pbS
     pMap->IncreaseChangeIndex();
 }
 
-int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame, bool bRecInit)
+// Visual observations of the frame for the InertialPoseSolver, the same as the edges of the g2o version
+static int AddInertialPoseObservations(Frame *pFrame, InertialPoseSolver &solver)
 {
-    g2o::SparseOptimizer optimizer;
-    g2o::BlockSolverX::LinearSolverType * linearSolver;
-
-    linearSolver = new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
-
-    g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
-
-    g2o::OptimizationAlgorithmGaussNewton* solver = new g2o::OptimizationAlgorithmGaussNewton(solver_ptr);
-    optimizer.setVerbose(false);
-    optimizer.setAlgorithm(solver);
-
-    int nInitialMonoCorrespondences=0;
-    int nInitialStereoCorrespondences=0;
-    int nInitialCorrespondences=0;
-
-    // Set Frame vertex
-    VertexPose* VP = new VertexPose(pFrame);
-    VP->setId(0);
-    VP->setFixed(false);
-    optimizer.addVertex(VP);
-    VertexVelocity* VV = new VertexVelocity(pFrame);
-    VV->setId(1);
-    VV->setFixed(false);
-    optimizer.addVertex(VV);
-    VertexGyroBias* VG = new VertexGyroBias(pFrame);
-    VG->setId(2);
-    VG->setFixed(false);
-    optimizer.addVertex(VG);
-    VertexAccBias* VA = new VertexAccBias(pFrame);
-    VA->setId(3);
-    VA->setFixed(false);
-    optimizer.addVertex(VA);
-
-    // Set MapPoint vertices
     const int N = pFrame->N;
     const int Nleft = pFrame->Nleft;
     const bool bRight = (Nleft!=-1);
 
-    vector<EdgeMonoOnlyPose*> vpEdgesMono;
-    vector<EdgeStereoOnlyPose*> vpEdgesStereo;
-    vector<size_t> vnIndexEdgeMono;
-    vector<size_t> vnIndexEdgeStereo;
-    vpEdgesMono.reserve(N);
-    vpEdgesStereo.reserve(N);
-    vnIndexEdgeMono.reserve(N);
-    vnIndexEdgeStereo.reserve(N);
+    int nInitialCorrespondences = 0;
 
-    const float thHuberMono = sqrt(5.991);
-    const float thHuberStereo = sqrt(7.815);
+    unique_lock<mutex> lock(MapPoint::mGlobalMutex);
 
+    for(int i=0; i<N; i++)
     {
-        unique_lock<mutex> lock(MapPoint::mGlobalMutex);
-
-        for(int i=0; i<N; i++)
-        {
-            MapPoint* pMP = pFrame->mvpMapPoints[i];
-            if(pMP)
-            {
-                cv::KeyPoint kpUn;
-
-                // Left monocular observation
-                if((!bRight && pFrame->mvuRight[i]<0) || i < Nleft)
-                {
-                    if(i < Nleft) // pair left-right
-                        kpUn = pFrame->mvKeys[i];
-                    else
-                        kpUn = pFrame->mvKeysUn[i];
-
-                    nInitialMonoCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
-
-                    Eigen::Matrix<double,2,1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y;
-
-                    EdgeMonoOnlyPose* e = new EdgeMonoOnlyPose(pMP->GetWorldPos(),0);
-
-                    e->setVertex(0,VP);
-                    e->setMeasurement(obs);
-
-                    // Add here uncerteinty
-                    const float unc2 = pFrame->mpCamera->uncertainty2(obs);
-
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/unc2;
-                    e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
-
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(thHuberMono);
-
-                    optimizer.addEdge(e);
-
-                    vpEdgesMono.push_back(e);
-                    vnIndexEdgeMono.push_back(i);
-                }
-                // Stereo observation
-                else if(!bRight)
-                {
-                    nInitialStereoCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
-
-                    kpUn = pFrame->mvKeysUn[i];
-                    const float kp_ur = pFrame->mvuRight[i];
-                    Eigen::Matrix<double,3,1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-                    EdgeStereoOnlyPose* e = new EdgeStereoOnlyPose(pMP->GetWorldPos());
-
-                    e->setVertex(0, VP);
-                    e->setMeasurement(obs);
-
-                    // Add here uncerteinty
-                    const float unc2 = pFrame->mpCamera->uncertainty2(obs.head(2));
-
-                    const float &invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/unc2;
-                    e->setInformation(Eigen::Matrix3d::Identity()*invSigma2);
-
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(thHuberStereo);
-
-                    optimizer.addEdge(e);
-
-                    vpEdgesStereo.push_back(e);
-                    vnIndexEdgeStereo.push_back(i);
-                }
-
-                // Right monocular observation
-                if(bRight && i >= Nleft)
-                {
-                    nInitialMonoCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
-
-                    kpUn = pFrame->mvKeysRight[i - Nleft];
-                    Eigen::Matrix<double,2,1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y;
+        MapPoint* pMP = pFrame->mvpMapPoints[i];
+        if(!pMP)
+            continue;
 
-                    EdgeMonoOnlyPose* e = new EdgeMonoOnlyPose(pMP->GetWorldPos(),1);
+        nInitialCorrespondences++;
+        pFrame->mvbOutlier[i] = false;
 
-                    e->setVertex(0,VP);
-                    e->setMeasurement(obs);
+        const bool bClose = pMP->mTrackDepth<10.f;
 
-                    // Add here uncerteinty
-                    const float unc2 = pFrame->mpCamera->uncertainty2(obs);
+        // Left monocular observation
+        if((!bRight && pFrame->mvuRight[i]<0) || i < Nleft)
+        {
+            const cv::KeyPoint &kpUn = i < Nleft ? pFrame->mvKeys[i] : pFrame->mvKeysUn[i];
+            const Eigen::Vector2d obs(kpUn.pt.x, kpUn.pt.y);
+            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/pFrame->mpCamera->uncertainty2(obs);
+            solver.AddMonocular(pMP->GetWorldPos(), kpUn.pt.x, kpUn.pt.y, invSigma2, 0, bClose, i);
+        }
+        // Stereo observation
+        else if(!bRight)
+        {
+            const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+            const Eigen::Vector2d obs(kpUn.pt.x, kpUn.pt.y);
+            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/pFrame->mpCamera->uncertainty2(obs);
+            solver.AddStereo(pMP->GetWorldPos(), kpUn.pt.x, kpUn.pt.y, pFrame->mvuRight[i], invSigma2, i);
+        }
+        // Right monocular observation
+        else
+        {
+            const cv::KeyPoint &kpUn = pFrame->mvKeysRight[i - Nleft];
+            const Eigen::Vector2d obs(kpUn.pt.x, kpUn.pt.y);
+            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/pFrame->mpCamera->uncertainty2(obs);
+            solver.AddMonocular(pMP->GetWorldPos(), kpUn.pt.x, kpUn.pt.y, invSigma2, 1, bClose, i);
+        }
+    }
 
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/unc2;
-                    e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+    return nInitialCorrespondences;
+}
 
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(thHuberMono);
+// Cameras of the frame and its state as the initial estimate
+static void SetupInertialPoseSolver(Frame *pFrame, InertialPoseSolver &solver)
+{
+    solver.Clear();
+    solver.SetCamera(pFrame->mpCamera, pFrame->mImuCalib.mTcb, pFrame->mbf);
+    if(pFrame->mpCamera2)
+        solver.SetRightCamera(pFrame->mpCamera2, pFrame->GetRelativePoseTrl());
+    solver.SetHuberDeltas(sqrt(5.991), sqrt(7.815), 5.f);
+
+    InertialPoseSolver::State state;
+    state.Rwb = pFrame->GetImuRotation().cast<double>();
+    state.twb = pFrame->GetImuPosition().cast<double>();
+    state.vwb = pFrame->GetVelocity().cast<double>();
+    state.bg << pFrame->mImuBias.bwx, pFrame->mImuBias.bwy, pFrame->mImuBias.bwz;
+    state.ba << pFrame->mImuBias.bax, pFrame->mImuBias.bay, pFrame->mImuBias.baz;
+    solver.SetState(state);
+}
 
-                    optimizer.addEdge(e);
+static void RecoverInertialPoseSolution(Frame *pFrame, const InertialPoseSolver &solver)
+{
+    const InertialPoseSolver::State &state = solver.GetState();
+    pFrame->SetImuPoseVelocity(state.Rwb.cast<float>(), state.twb.cast<float>(), state.vwb.cast<float>());
+    pFrame->mImuBias = IMU::Bias(state.ba[0],state.ba[1],state.ba[2],state.bg[0],state.bg[1],state.bg[2]);
+}
 
-                    vpEdgesMono.push_back(e);
-                    vnIndexEdgeMono.push_back(i);
-                }
-            }
-        }
-    }
-    nInitialCorrespondences = nInitialMonoCorrespondences + nInitialStereoCorrespondences;
+int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame, bool bRecInit)
+{
+    // The solver keeps its buffers from one frame to the next
+    static thread_local InertialPoseSolver solver;
+    SetupInertialPoseSolver(pFrame, solver);
+    const int nInitialCorrespondences = AddInertialPoseObservations(pFrame, solver);
 
+    // The keyframe state is fixed, the preintegration goes from the keyframe to this frame
     KeyFrame* pKF = pFrame->mpLastKeyFrame;
-    VertexPose* VPk = new VertexPose(pKF);
-    VPk->setId(4);
-    VPk->setFixed(true);
-    optimizer.addVertex(VPk);
-    VertexVelocity* VVk = new VertexVelocity(pKF);
-    VVk->setId(5);
-    VVk->setFixed(true);
-    optimizer.addVertex(VVk);
-    VertexGyroBias* VGk = new VertexGyroBias(pKF);
-    VGk->setId(6);
-    VGk->setFixed(true);
-    optimizer.addVertex(VGk);
-    VertexAccBias* VAk = new VertexAccBias(pKF);
-    VAk->setId(7);
-    VAk->setFixed(true);
-    optimizer.addVertex(VAk);
-
-    EdgeInertial* ei = new EdgeInertial(pFrame->mpImuPreintegrated);
-
-    ei->setVertex(0, VPk);
-    ei->setVertex(1, VVk);
-    ei->setVertex(2, VGk);
-    ei->setVertex(3, VAk);
-    ei->setVertex(4, VP);
-    ei->setVertex(5, VV);
-    optimizer.addEdge(ei);
-
-    EdgeGyroRW* egr = new EdgeGyroRW();
-    egr->setVertex(0,VGk);
-    egr->setVertex(1,VG);
-    Eigen::Matrix3d InfoG = pFrame->mpImuPreintegrated->C.block<3,3>(9,9).cast<double>().inverse();
-    egr->setInformation(InfoG);
-    optimizer.addEdge(egr);
-
-    EdgeAccRW* ear = new EdgeAccRW();
-    ear->setVertex(0,VAk);
-    ear->setVertex(1,VA);
-    Eigen::Matrix3d InfoA = pFrame->mpImuPreintegrated->C.block<3,3>(12,12).cast<double>().inverse();
-    ear->setInformation(InfoA);
-    optimizer.addEdge(ear);
+    InertialPoseSolver::State stateKF;
+    stateKF.Rwb = pKF->GetImuRotation().cast<double>();
+    stateKF.twb = pKF->GetImuPosition().cast<double>();
+    stateKF.vwb = pKF->GetVelocity().cast<double>();
+    stateKF.bg = pKF->GetGyroBias().cast<double>();
+    stateKF.ba = pKF->GetAccBias().cast<double>();
+    solver.SetPrevious(stateKF);
+    const Eigen::Matrix3d InfoG = pFrame->mpImuPreintegrated->C.block<3,3>(9,9).cast<double>().inverse();
+    const Eigen::Matrix3d InfoA = pFrame->mpImuPreintegrated->C.block<3,3>(12,12).cast<double>().inverse();
+    solver.SetInertial(pFrame->mpImuPreintegrated, InfoG, InfoA);
 
     // We perform 4 optimizations, after each optimization we classify observation as inlier/outlier
     // At the next optimization, outliers are not included, but at the end they can be classified as inliers again.
-    float chi2Mono[4]={12,7.5,5.991,5.991};
-    float chi2Stereo[4]={15.6,9.8,7.815,7.815};
+    const float chi2Mono[4]={12,7.5,5.991,5.991};
+    const float chi2Stereo[4]={15.6,9.8,7.815,7.815};
+    const int its[4]={10,10,10,10};
 
-    int its[4]={10,10,10,10};
+    // Visual edges plus the inertial and bias random walk edges of the g2o graph
+    const size_t nEdges = solver.Size() + 3;
 
     int nBad = 0;
-    int nBadMono = 0;
-    int nBadStereo = 0;
-    int nInliersMono = 0;
-    int nInliersStereo = 0;
     int nInliers = 0;
     for(size_t it=0; it<4; it++)
     {
-        optimizer.initializeOptimization(0);
-        optimizer.optimize(its[it]);
-
-        nBad = 0;
-        nBadMono = 0;
-        nBadStereo = 0;
-        nInliers = 0;
-        nInliersMono = 0;
-        nInliersStereo = 0;
-        float chi2close = 1.5*chi2Mono[it];
-
-        // For monocular observations
-        for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
-        {
-            EdgeMonoOnlyPose* e = vpEdgesMono[i];
-
-            const size_t idx = vnIndexEdgeMono[i];
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-            bool bClose = pFrame->mvpMapPoints[idx]->mTrackDepth<10.f;
-
-            if((chi2>chi2Mono[it]&&!bClose)||(bClose && chi2>chi2close)||!e->isDepthPositive())
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBadMono++;
-            }
-            else
-            {
-                pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
-                nInliersMono++;
-            }
-
-            if (it==2)
-                e->setRobustKernel(0);
-        }
-
-        // For stereo observations
-        for(size_t i=0, iend=vpEdgesStereo.size(); i<iend; i++)
-        {
-            EdgeStereoOnlyPose* e = vpEdgesStereo[i];
-
-            const size_t idx = vnIndexEdgeStereo[i];
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-
-            if(chi2>chi2Stereo[it])
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1); // not included in next optimization
-                nBadStereo++;
-            }
-            else
-            {
-                pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
-                nInliersStereo++;
-            }
-
-            if(it==2)
-                e->setRobustKernel(0);
-        }
+        // The robust kernel is removed in the last optimization
+        solver.Optimize(its[it], it<3);
 
-        nInliers = nInliersMono + nInliersStereo;
-        nBad = nBadMono + nBadStereo;
+        nBad = solver.ClassifyOutliers(chi2Mono[it], 1.5f*chi2Mono[it], chi2Stereo[it], pFrame->mvbOutlier);
+        nInliers = solver.Size() - nBad;
 
-        if(optimizer.edges().size()<10)
-        {
+        if(nEdges<10)
             break;
-        }
-
     }
 
     // If not too much tracks, recover not too bad points
     if ((nInliers<30) && !bRecInit)
-    {
-        nBad=0;
-        const float chi2MonoOut = 18.f;
-        const float chi2StereoOut = 24.f;
-        EdgeMonoOnlyPose* e1;
-        EdgeStereoOnlyPose* e2;
-        for(size_t i=0, iend=vnIndexEdgeMono.size(); i<iend; i++)
-        {
-            const size_t idx = vnIndexEdgeMono[i];
-            e1 = vpEdgesMono[i];
-            e1->computeError();
-            if (e1->chi2()<chi2MonoOut)
-                pFrame->mvbOutlier[idx]=false;
-            else
-                nBad++;
-        }
-        for(size_t i=0, iend=vnIndexEdgeStereo.size(); i<iend; i++)
-        {
-            const size_t idx = vnIndexEdgeStereo[i];
-            e2 = vpEdgesStereo[i];
-            e2->computeError();
-            if (e2->chi2()<chi2StereoOut)
-                pFrame->mvbOutlier[idx]=false;
-            else
-                nBad++;
-        }
-    }
+        nBad = solver.RecoverOutliers(18.f, 24.f, pFrame->mvbOutlier);
 
     // Recover optimized pose, velocity and biases
-    pFrame->SetImuPoseVelocity(VP->estimate().Rwb.cast<float>(), VP->estimate().twb.cast<float>(), VV->estimate().cast<float>());
-    Vector6d b;
-    b << VG->estimate(), VA->estimate();
-    pFrame->mImuBias = IMU::Bias(b[3],b[4],b[5],b[0],b[1],b[2]);
+    RecoverInertialPoseSolution(pFrame, solver);
 
-    // Recover Hessian, marginalize keyFframe states and generate new prior for frame
-    Eigen::Matrix<double,15,15> H;
-    H.setZero();
-
-    H.block<9,9>(0,0)+= ei->GetHessian2();
-    H.block<3,3>(9,9) += egr->GetHessian2();
-    H.block<3,3>(12,12) += ear->GetHessian2();
-
-    int tot_in = 0, tot_out = 0;
-    for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
-    {
-        EdgeMonoOnlyPose* e = vpEdgesMono[i];
-
-        const size_t idx = vnIndexEdgeMono[i];
-
-        if(!pFrame->mvbOutlier[idx])
-        {
-            H.block<6,6>(0,0) += e->GetHessian();
-            tot_in++;
-        }
-        else
-            tot_out++;
-    }
-
-    for(size_t i=0, iend=vpEdgesStereo.size(); i<iend; i++)
-    {
-        EdgeStereoOnlyPose* e = vpEdgesStereo[i];
-
-        const size_t idx = vnIndexEdgeStereo[i];
-
-        if(!pFrame->mvbOutlier[idx])
-        {
-            H.block<6,6>(0,0) += e->GetHessian();
-            tot_in++;
-        }
-        else
-            tot_out++;
-    }
-
-    pFrame->mpcpi = new ConstraintPoseImu(VP->estimate().Rwb,VP->estimate().twb,VV->estimate(),VG->estimate(),VA->estimate(),H);
+    // Hessian of the frame state without the keyframe (fixed), prior for the next frame
+    const InertialPoseSolver::State &state = solver.GetState();
+    const Eigen::Matrix<double,15,15> H = solver.GetHessian();
+    pFrame->mpcpi = new ConstraintPoseImu(state.Rwb,state.twb,state.vwb,state.bg,state.ba,H);
 
     return nInitialCorrespondences-nBad;
 }
 
 int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit)
 {
-    g2o::SparseOptimizer optimizer;
-    g2o::BlockSolverX::LinearSolverType * linearSolver;
-
-    linearSolver = new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
-
-    g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
-
-    g2o::OptimizationAlgorithmGaussNewton* solver = new g2o::OptimizationAlgorithmGaussNewton(solver_ptr);
-    optimizer.setAlgorithm(solver);
-    optimizer.setVerbose(false);
-
-    int nInitialMonoCorrespondences=0;
-    int nInitialStereoCorrespondences=0;
-    int nInitialCorrespondences=0;
-
-    // Set Current Frame vertex
-    VertexPose* VP = new VertexPose(pFrame);
-    VP->setId(0);
-    VP->setFixed(false);
-    optimizer.addVertex(VP);
-    VertexVelocity* VV = new VertexVelocity(pFrame);
-    VV->setId(1);
-    VV->setFixed(false);
-    optimizer.addVertex(VV);
-    VertexGyroBias* VG = new VertexGyroBias(pFrame);
-    VG->setId(2);
-    VG->setFixed(false);
-    optimizer.addVertex(VG);
-    VertexAccBias* VA = new VertexAccBias(pFrame);
-    VA->setId(3);
-    VA->setFixed(false);
-    optimizer.addVertex(VA);
-
-    // Set MapPoint vertices
-    const int N = pFrame->N;
-    const int Nleft = pFrame->Nleft;
-    const bool bRight = (Nleft!=-1);
-
-    vector<EdgeMonoOnlyPose*> vpEdgesMono;
-    vector<EdgeStereoOnlyPose*> vpEdgesStereo;
-    vector<size_t> vnIndexEdgeMono;
-    vector<size_t> vnIndexEdgeStereo;
-    vpEdgesMono.reserve(N);
-    vpEdgesStereo.reserve(N);
-    vnIndexEdgeMono.reserve(N);
-    vnIndexEdgeStereo.reserve(N);
-
-    const float thHuberMono = sqrt(5.991);
-    const float thHuberStereo = sqrt(7.815);
-
-    {
-        unique_lock<mutex> lock(MapPoint::mGlobalMutex);
-
-        for(int i=0; i<N; i++)
-        {
-            MapPoint* pMP = pFrame->mvpMapPoints[i];
-            if(pMP)
-            {
-                cv::KeyPoint kpUn;
-                // Left monocular observation
-                if((!bRight && pFrame->mvuRight[i]<0) || i < Nleft)
-                {
-                    if(i < Nleft) // pair left-right
-                        kpUn = pFrame->mvKeys[i];
-                    else
-                        kpUn = pFrame->mvKeysUn[i];
-
-                    nInitialMonoCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
-
-                    Eigen::Matrix<double,2,1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y;
-
-                    EdgeMonoOnlyPose* e = new EdgeMonoOnlyPose(pMP->GetWorldPos(),0);
-
-                    e->setVertex(0,VP);
-                    e->setMeasurement(obs);
-
-                    // Add here uncerteinty
-                    const float unc2 = pFrame->mpCamera->uncertainty2(obs);
-
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/unc2;
-                    e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+    static thread_local InertialPoseSolver solver;
+    SetupInertialPoseSolver(pFrame, solver);
+    const int nInitialCorrespondences = AddInertialPoseObservations(pFrame, solver);
 
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(thHuberMono);
-
-                    optimizer.addEdge(e);
-
-                    vpEdgesMono.push_back(e);
-                    vnIndexEdgeMono.push_back(i);
-                }
-                // Stereo observation
-                else if(!bRight)
-                {
-                    nInitialStereoCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
-
-                    kpUn = pFrame->mvKeysUn[i];
-                    const float kp_ur = pFrame->mvuRight[i];
-                    Eigen::Matrix<double,3,1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-                    EdgeStereoOnlyPose* e = new EdgeStereoOnlyPose(pMP->GetWorldPos());
-
-                    e->setVertex(0, VP);
-                    e->setMeasurement(obs);
-
-                    // Add here uncerteinty
-                    const float unc2 = pFrame->mpCamera->uncertainty2(obs.head(2));
-
-                    const float &invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/unc2;
-                    e->setInformation(Eigen::Matrix3d::Identity()*invSigma2);
-
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(thHuberStereo);
-
-                    optimizer.addEdge(e);
-
-                    vpEdgesStereo.push_back(e);
-                    vnIndexEdgeStereo.push_back(i);
-                }
-
-                // Right monocular observation
-                if(bRight && i >= Nleft)
-                {
-                    nInitialMonoCorrespondences++;
-                    pFrame->mvbOutlier[i] = false;
-
-                    kpUn = pFrame->mvKeysRight[i - Nleft];
-                    Eigen::Matrix<double,2,1> obs;
-                    obs << kpUn.pt.x, kpUn.pt.y;
-
-                    EdgeMonoOnlyPose* e = new EdgeMonoOnlyPose(pMP->GetWorldPos(),1);
-
-                    e->setVertex(0,VP);
-                    e->setMeasurement(obs);
-
-                    // Add here uncerteinty
-                    const float unc2 = pFrame->mpCamera->uncertainty2(obs);
-
-                    const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave]/unc2;
-                    e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
-
-                    g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                    e->setRobustKernel(rk);
-                    rk->setDelta(thHuberMono);
-
-                    optimizer.addEdge(e);
-
-                    vpEdgesMono.push_back(e);
-                    vnIndexEdgeMono.push_back(i);
-                }
-            }
-        }
-    }
-
-    nInitialCorrespondences = nInitialMonoCorrespondences + nInitialStereoCorrespondences;
-
-    // Set Previous Frame Vertex
+    // The previous frame is optimized too, with the prior of its own optimization
     Frame* pFp = pFrame->mpPrevFrame;
-
-    VertexPose* VPk = new VertexPose(pFp);
-    VPk->setId(4);
-    VPk->setFixed(false);
-    optimizer.addVertex(VPk);
-    VertexVelocity* VVk = new VertexVelocity(pFp);
-    VVk->setId(5);
-    VVk->setFixed(false);
-    optimizer.addVertex(VVk);
-    VertexGyroBias* VGk = new VertexGyroBias(pFp);
-    VGk->setId(6);
-    VGk->setFixed(false);
-    optimizer.addVertex(VGk);
-    VertexAccBias* VAk = new VertexAccBias(pFp);
-    VAk->setId(7);
-    VAk->setFixed(false);
-    optimizer.addVertex(VAk);
-
-    EdgeInertial* ei = new EdgeInertial(pFrame->mpImuPreintegratedFrame);
-
-    ei->setVertex(0, VPk);
-    ei->setVertex(1, VVk);
-    ei->setVertex(2, VGk);
-    ei->setVertex(3, VAk);
-    ei->setVertex(4, VP);
-    ei->setVertex(5, VV);
-    optimizer.addEdge(ei);
-
-    EdgeGyroRW* egr = new EdgeGyroRW();
-    egr->setVertex(0,VGk);
-    egr->setVertex(1,VG);
-    Eigen::Matrix3d InfoG = pFrame->mpImuPreintegrated->C.block<3,3>(9,9).cast<double>().inverse();
-    egr->setInformation(InfoG);
-    optimizer.addEdge(egr);
-
-    EdgeAccRW* ear = new EdgeAccRW();
-    ear->setVertex(0,VAk);
-    ear->setVertex(1,VA);
-    Eigen::Matrix3d InfoA = pFrame->mpImuPreintegrated->C.block<3,3>(12,12).cast<double>().inverse();
-    ear->setInformation(InfoA);
-    optimizer.addEdge(ear);
+    InertialPoseSolver::State stateFp;
+    stateFp.Rwb = pFp->GetImuRotation().cast<double>();
+    stateFp.twb = pFp->GetImuPosition().cast<double>();
+    stateFp.vwb = pFp->GetVelocity().cast<double>();
+    stateFp.bg << pFp->mImuBias.bwx, pFp->mImuBias.bwy, pFp->mImuBias.bwz;
+    stateFp.ba << pFp->mImuBias.bax, pFp->mImuBias.bay, pFp->mImuBias.baz;
+    solver.SetPrevious(stateFp);
+    const Eigen::Matrix3d InfoG = pFrame->mpImuPreintegrated->C.block<3,3>(9,9).cast<double>().inverse();
+    const Eigen::Matrix3d InfoA = pFrame->mpImuPreintegrated->C.block<3,3>(12,12).cast<double>().inverse();
+    solver.SetInertial(pFrame->mpImuPreintegratedFrame, InfoG, InfoA);
 
     if (!pFp->mpcpi)
         Verbose::PrintMess("pFp->mpcpi does not exist!!!\nPrevious Frame " + to_string(pFp->mnId), Verbose::VERBOSITY_NORMAL);
-
-    EdgePriorPoseImu* ep = new EdgePriorPoseImu(pFp->mpcpi);
-
-    ep->setVertex(0,VPk);
-    ep->setVertex(1,VVk);
-    ep->setVertex(2,VGk);
-    ep->setVertex(3,VAk);
-    g2o::RobustKernelHuber* rkp = new g2o::RobustKernelHuber;
-    ep->setRobustKernel(rkp);
-    rkp->setDelta(5);
-    optimizer.addEdge(ep);
+    else
+    {
+        InertialPoseSolver::State prior;
+        prior.Rwb = pFp->mpcpi->Rwb;
+        prior.twb = pFp->mpcpi->twb;
+        prior.vwb = pFp->mpcpi->vwb;
+        prior.bg = pFp->mpcpi->bg;
+        prior.ba = pFp->mpcpi->ba;
+        solver.SetPrior(prior, pFp->mpcpi->H);
+    }
 
     // We perform 4 optimizations, after each optimization we classify observation as inlier/outlier
     // At the next optimization, outliers are not included, but at the end they can be classified as inliers again.
@@ -5099,190 +4569,39 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit)
     const float chi2Stereo[4]={15.6f,9.8f,7.815f,7.815f};
     const int its[4]={10,10,10,10};
 
-    int nBad=0;
-    int nBadMono = 0;
-    int nBadStereo = 0;
-    int nInliersMono = 0;
-    int nInliersStereo = 0;
-    int nInliers=0;
+    // Visual edges plus the inertial, bias random walk and prior edges of the g2o graph
+    const size_t nEdges = solver.Size() + 4;
+
+    int nBad = 0;
+    int nInliers = 0;
     for(size_t it=0; it<4; it++)
     {
-        optimizer.initializeOptimization(0);
-        optimizer.optimize(its[it]);
-
-        nBad=0;
-        nBadMono = 0;
-        nBadStereo = 0;
-        nInliers=0;
-        nInliersMono=0;
-        nInliersStereo=0;
-        float chi2close = 1.5*chi2Mono[it];
-
-        for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
-        {
-            EdgeMonoOnlyPose* e = vpEdgesMono[i];
-
-            const size_t idx = vnIndexEdgeMono[i];
-            bool bClose = pFrame->mvpMapPoints[idx]->mTrackDepth<10.f;
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-
-            if((chi2>chi2Mono[it]&&!bClose)||(bClose && chi2>chi2close)||!e->isDepthPositive())
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBadMono++;
-            }
-            else
-            {
-                pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
-                nInliersMono++;
-            }
-
-            if (it==2)
-                e->setRobustKernel(0);
-
-        }
-
-        for(size_t i=0, iend=vpEdgesStereo.size(); i<iend; i++)
-        {
-            EdgeStereoOnlyPose* e = vpEdgesStereo[i];
-
-            const size_t idx = vnIndexEdgeStereo[i];
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-
-            if(chi2>chi2Stereo[it])
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBadStereo++;
-            }
-            else
-            {
-                pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
-                nInliersStereo++;
-            }
-
-            if(it==2)
-                e->setRobustKernel(0);
-        }
+        solver.Optimize(its[it], it<3);
 
-        nInliers = nInliersMono + nInliersStereo;
-        nBad = nBadMono + nBadStereo;
+        nBad = solver.ClassifyOutliers(chi2Mono[it], 1.5f*chi2Mono[it], chi2Stereo[it], pFrame->mvbOutlier);
+        nInliers = solver.Size() - nBad;
 
-        if(optimizer.edges().size()<10)
-        {
+        if(nEdges<10)
             break;
-        }
     }
 
-
     if ((nInliers<30) && !bRecInit)
-    {
-        nBad=0;
-        const float chi2MonoOut = 18.f;
-        const float chi2StereoOut = 24.f;
-        EdgeMonoOnlyPose* e1;
-        EdgeStereoOnlyPose* e2;
-        for(size_t i=0, iend=vnIndexEdgeMono.size(); i<iend; i++)
-        {
-            const size_t idx = vnIndexEdgeMono[i];
-            e1 = vpEdgesMono[i];
-            e1->computeError();
-            if (e1->chi2()<chi2MonoOut)
-                pFrame->mvbOutlier[idx]=false;
-            else
-                nBad++;
-
-        }
-        for(size_t i=0, iend=vnIndexEdgeStereo.size(); i<iend; i++)
-        {
-            const size_t idx = vnIndexEdgeStereo[i];
-            e2 = vpEdgesStereo[i];
-            e2->computeError();
-            if (e2->chi2()<chi2StereoOut)
-                pFrame->mvbOutlier[idx]=false;
-            else
-                nBad++;
-        }
-    }
-
-    nInliers = nInliersMono + nInliersStereo;
-
+        nBad = solver.RecoverOutliers(18.f, 24.f, pFrame->mvbOutlier);
 
     // Recover optimized pose, velocity and biases
-    pFrame->SetImuPoseVelocity(VP->estimate().Rwb.cast<float>(), VP->estimate().twb.cast<float>(), VV->estimate().cast<float>());
-    Vector6d b;
-    b << VG->estimate(), VA->estimate();
-    pFrame->mImuBias = IMU::Bias(b[3],b[4],b[5],b[0],b[1],b[2]);
-
-    // Recover Hessian, marginalize previous frame states and generate new prior for frame
-    Eigen::Matrix<double,30,30> H;
-    H.setZero();
-
-    H.block<24,24>(0,0)+= ei->GetHessian();
+    RecoverInertialPoseSolution(pFrame, solver);
 
-    Eigen::Matrix<double,6,6> Hgr = egr->GetHessian();
-    H.block<3,3>(9,9) += Hgr.block<3,3>(0,0);
-    H.block<3,3>(9,24) += Hgr.block<3,3>(0,3);
-    H.block<3,3>(24,9) += Hgr.block<3,3>(3,0);
-    H.block<3,3>(24,24) += Hgr.block<3,3>(3,3);
-
-    Eigen::Matrix<double,6,6> Har = ear->GetHessian();
-    H.block<3,3>(12,12) += Har.block<3,3>(0,0);
-    H.block<3,3>(12,27) += Har.block<3,3>(0,3);
-    H.block<3,3>(27,12) += Har.block<3,3>(3,0);
-    H.block<3,3>(27,27) += Har.block<3,3>(3,3);
-
-    H.block<15,15>(0,0) += ep->GetHessian();
-
-    int tot_in = 0, tot_out = 0;
-    for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
-    {
-        EdgeMonoOnlyPose* e = vpEdgesMono[i];
-
-        const size_t idx = vnIndexEdgeMono[i];
-
-        if(!pFrame->mvbOutlier[idx])
-        {
-            H.block<6,6>(15,15) += e->GetHessian();
-            tot_in++;
-        }
-        else
-            tot_out++;
-    }
-
-    for(size_t i=0, iend=vpEdgesStereo.size(); i<iend; i++)
+    // Marginalize the previous frame states and generate the new prior for the frame
+    Eigen::MatrixXd H = solver.GetHessian();
+    if(H.rows() == 30)
     {
-        EdgeStereoOnlyPose* e = vpEdgesStereo[i];
-
-        const size_t idx = vnIndexEdgeStereo[i];
-
-        if(!pFrame->mvbOutlier[idx])
-        {
-            H.block<6,6>(15,15) += e->GetHessian();
-            tot_in++;
-        }
-        else
-            tot_out++;
+        const Eigen::MatrixXd Hm = Marginalize(H,0,14);
+        H = Hm.block<15,15>(15,15);
     }
 
-    H = Marginalize(H,0,14);
+    const InertialPoseSolver::State &state = solver.GetState();
+    pFrame->mpcpi = new ConstraintPoseImu(state.Rwb,state.twb,state.vwb,state.bg,state.ba,H);
 
-    pFrame->mpcpi = new ConstraintPoseImu(VP->estimate().Rwb,VP->estimate().twb,VV->estimate(),VG->estimate(),VA->estimate(),H.block<15,15>(15,15));
     delete pFp->mpcpi;
     pFp->mpcpi = NULL;
 
@@ -5292,7 +4611,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit)
 void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections)
+                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections, eLinearSolver linearSolverType)
 {
     typedef g2o::BlockSolver< g2o::BlockSolverTraits<4, 4> > BlockSolver_4_4;
 
@@ -5300,7 +4619,7 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFram
     g2o::SparseOptimizer optimizer;
     optimizer.setVerbose(false);
     g2o::BlockSolverX::LinearSolverType * linearSolver =
-            new g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>();
+            CreateLinearSolver<g2o::BlockSolverX>(linearSolverType, pMap->KeyFramesInMap());
     g2o::BlockSolverX * solver_ptr = new g2o::BlockSolverX(linearSolver);
 
     g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
@@ -5473,8 +4792,8 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFram
         }
 
         // 1.2 Loop edges
-        const set<KeyFrame*> sLoopEdges = pKF->GetLoopEdges();
-        for(set<KeyFrame*>::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
+        const KeyFrame::EdgeSet sLoopEdges = pKF->GetLoopEdges();
+        for(KeyFrame::EdgeSet::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
         {
             KeyFrame* pLKF = *sit;
             if(pLKF->mnId<pKF->mnId)
@@ -5542,7 +4861,7 @@ void Optimizer::OptimizeEssentialGraph4DoF(Map* pMap, KeyFrame* pLoopKF, KeyFram
     optimizer.computeActiveErrors();
     optimizer.optimize(20);
 
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    unique_lock<SharedMutex> lock(pMap->mMutexMapUpdate);
 
     // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
     for(size_t i=0;i<vpKFs.size();i++)
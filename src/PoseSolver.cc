@@ -0,0 +1,773 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PoseSolver.h"
+#include "CameraModels/GeometricCamera.h"
+#include "ImuTypes.h"
+#include "G2oTypes.h"
+
+#include <cmath>
+#include <Eigen/Cholesky>
+
+namespace ORB_SLAM3
+{
+
+// Derivative of a point in the camera frame w.r.t. the left increment [omega, upsilon] of the pose
+static inline Eigen::Matrix<double,3,6> PointDerivative(const Eigen::Vector3d &Xc)
+{
+    Eigen::Matrix<double,3,6> dXc;
+    dXc << 0.0, Xc[2], -Xc[1], 1.0, 0.0, 0.0,
+           -Xc[2], 0.0, Xc[0], 0.0, 1.0, 0.0,
+           Xc[1], -Xc[0], 0.0, 0.0, 0.0, 1.0;
+    return dXc;
+}
+
+// Same exponential map as g2o::SE3Quat, the increment is [omega, upsilon]
+static inline Sophus::SE3d LeftUpdate(const PoseSolver::Vector6d &dx, const Sophus::SE3d &T)
+{
+    Sophus::SE3d::Tangent xi;
+    xi << dx.tail<3>(), dx.head<3>();
+    return Sophus::SE3d::exp(xi) * T;
+}
+
+PoseSolver::PoseSolver(): mnActive(0), mpCamera(static_cast<GeometricCamera*>(NULL)),
+    mpCamera2(static_cast<GeometricCamera*>(NULL)), mRrl(Eigen::Matrix3d::Identity()), mtrl(Eigen::Vector3d::Zero()),
+    fx(0), fy(0), cx(0), cy(0), mbf(0), mDeltaMono(std::sqrt(5.991)), mDeltaStereo(std::sqrt(7.815))
+{
+}
+
+void PoseSolver::Clear()
+{
+    mvXw.clear();
+    mvObs.clear();
+    mvInvSigma2.clear();
+    mvType.clear();
+    mvbInlier.clear();
+    mvIdx.clear();
+    mnActive = 0;
+}
+
+void PoseSolver::SetCalibration(GeometricCamera* pCamera, const float fx_, const float fy_, const float cx_, const float cy_, const float bf)
+{
+    mpCamera = pCamera;
+    fx = fx_;
+    fy = fy_;
+    cx = cx_;
+    cy = cy_;
+    mbf = bf;
+}
+
+void PoseSolver::SetRightCamera(GeometricCamera* pCamera, const Sophus::SE3f &Trl)
+{
+    mpCamera2 = pCamera;
+    mRrl = Trl.rotationMatrix().cast<double>();
+    mtrl = Trl.translation().cast<double>();
+}
+
+void PoseSolver::SetHuberDeltas(const float deltaMono, const float deltaStereo)
+{
+    mDeltaMono = deltaMono;
+    mDeltaStereo = deltaStereo;
+}
+
+void PoseSolver::Add(const eObservationType type, const Eigen::Vector3f &Xw, const float u, const float v, const float ur,
+                     const float invSigma2, const int idx)
+{
+    mvXw.push_back(Xw.cast<double>());
+    mvObs.push_back(Eigen::Vector3d(u, v, ur));
+    mvInvSigma2.push_back(invSigma2);
+    mvType.push_back(type);
+    mvbInlier.push_back(true);
+    mvIdx.push_back(idx);
+}
+
+void PoseSolver::AddMonocular(const Eigen::Vector3f &Xw, const float u, const float v, const float invSigma2, const int idx)
+{
+    Add(MONOCULAR, Xw, u, v, 0.f, invSigma2, idx);
+}
+
+void PoseSolver::AddStereo(const Eigen::Vector3f &Xw, const float u, const float v, const float ur, const float invSigma2, const int idx)
+{
+    Add(STEREO, Xw, u, v, ur, invSigma2, idx);
+}
+
+void PoseSolver::AddMonocularRight(const Eigen::Vector3f &Xw, const float u, const float v, const float invSigma2, const int idx)
+{
+    Add(MONOCULAR_RIGHT, Xw, u, v, 0.f, invSigma2, idx);
+}
+
+size_t PoseSolver::Size() const
+{
+    return mvXw.size();
+}
+
+void PoseSolver::ComputeError(const size_t i, const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw, Eigen::Vector3d &e) const
+{
+    const Eigen::Vector3d Xc = Rcw * mvXw[i] + tcw;
+    const Eigen::Vector3d &obs = mvObs[i];
+
+    if(mvType[i] == STEREO)
+    {
+        const double invz = 1.0/Xc[2];
+        const double u = Xc[0]*invz*fx + cx;
+        e << obs[0] - u, obs[1] - (Xc[1]*invz*fy + cy), obs[2] - (u - mbf*invz);
+    }
+    else if(mvType[i] == MONOCULAR)
+    {
+        const Eigen::Vector2d p = mpCamera->project(Xc);
+        e << obs[0] - p[0], obs[1] - p[1], 0.0;
+    }
+    else
+    {
+        const Eigen::Vector2d p = mpCamera2->project(Eigen::Vector3d(mRrl * Xc + mtrl));
+        e << obs[0] - p[0], obs[1] - p[1], 0.0;
+    }
+}
+
+void PoseSolver::ComputeErrorAndJacobian(const size_t i, const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw,
+                                         Eigen::Vector3d &e, Matrix36d &J) const
+{
+    const Eigen::Vector3d Xc = Rcw * mvXw[i] + tcw;
+    const Eigen::Vector3d &obs = mvObs[i];
+
+    if(mvType[i] == STEREO)
+    {
+        const double x = Xc[0];
+        const double y = Xc[1];
+        const double invz = 1.0/Xc[2];
+        const double invz_2 = invz*invz;
+
+        const double u = x*invz*fx + cx;
+        e << obs[0] - u, obs[1] - (y*invz*fy + cy), obs[2] - (u - mbf*invz);
+
+        J(0,0) = x*y*invz_2*fx;
+        J(0,1) = -(1+(x*x*invz_2))*fx;
+        J(0,2) = y*invz*fx;
+        J(0,3) = -invz*fx;
+        J(0,4) = 0;
+        J(0,5) = x*invz_2*fx;
+
+        J(1,0) = (1+y*y*invz_2)*fy;
+        J(1,1) = -x*y*invz_2*fy;
+        J(1,2) = -x*invz*fy;
+        J(1,3) = 0;
+        J(1,4) = -invz*fy;
+        J(1,5) = y*invz_2*fy;
+
+        J(2,0) = J(0,0)-mbf*y*invz_2;
+        J(2,1) = J(0,1)+mbf*x*invz_2;
+        J(2,2) = J(0,2);
+        J(2,3) = J(0,3);
+        J(2,4) = 0;
+        J(2,5) = J(0,5)-mbf*invz_2;
+    }
+    else if(mvType[i] == MONOCULAR)
+    {
+        const Eigen::Vector2d p = mpCamera->project(Xc);
+        e << obs[0] - p[0], obs[1] - p[1], 0.0;
+        J.topRows<2>().noalias() = -mpCamera->projectJac(Xc) * PointDerivative(Xc);
+        J.row(2).setZero();
+    }
+    else
+    {
+        const Eigen::Vector3d Xr = mRrl * Xc + mtrl;
+        const Eigen::Vector2d p = mpCamera2->project(Xr);
+        e << obs[0] - p[0], obs[1] - p[1], 0.0;
+        J.topRows<2>().noalias() = -mpCamera2->projectJac(Xr) * mRrl * PointDerivative(Xc);
+        J.row(2).setZero();
+    }
+}
+
+double PoseSolver::RobustWeight(const size_t i, const double chi2, double &rho) const
+{
+    // Huber kernel as in g2o::RobustKernelHuber, chi2 is already weighted by the information
+    const double delta = mvType[i] == STEREO ? mDeltaStereo : mDeltaMono;
+    if(chi2 <= delta*delta)
+    {
+        rho = chi2;
+        return 1.0;
+    }
+    const double sqrtChi2 = std::sqrt(chi2);
+    rho = 2*sqrtChi2*delta - delta*delta;
+    return delta/sqrtChi2;
+}
+
+double PoseSolver::Linearize(const Sophus::SE3d &Tcw, const bool bRobust)
+{
+    const Eigen::Matrix3d Rcw = Tcw.rotationMatrix();
+    const Eigen::Vector3d tcw = Tcw.translation();
+
+    const size_t N = mvXw.size();
+    if(mvJ.size() < N)
+    {
+        mvJ.resize(N);
+        mvE.resize(N);
+        mvW.resize(N);
+    }
+
+    double chi2Total = 0;
+    size_t k = 0;
+    for(size_t i=0; i<N; i++)
+    {
+        if(!mvbInlier[i])
+            continue;
+
+        ComputeErrorAndJacobian(i, Rcw, tcw, mvE[k], mvJ[k]);
+        const double chi2 = mvE[k].squaredNorm() * mvInvSigma2[i];
+        double rho = chi2;
+        const double w = bRobust ? RobustWeight(i, chi2, rho) : 1.0;
+        mvW[k] = w * mvInvSigma2[i];
+        chi2Total += rho;
+        k++;
+    }
+    mnActive = k;
+
+    return chi2Total;
+}
+
+void PoseSolver::BuildSystem(Matrix6d &H, Vector6d &b) const
+{
+    H.setZero();
+    b.setZero();
+    for(size_t k=0; k<mnActive; k++)
+    {
+        const Matrix36d &J = mvJ[k];
+        H.noalias() += mvW[k] * (J.transpose() * J);
+        b.noalias() -= mvW[k] * (J.transpose() * mvE[k]);
+    }
+}
+
+double PoseSolver::RobustChi2(const Sophus::SE3d &Tcw, const bool bRobust) const
+{
+    const Eigen::Matrix3d Rcw = Tcw.rotationMatrix();
+    const Eigen::Vector3d tcw = Tcw.translation();
+
+    double chi2Total = 0;
+    Eigen::Vector3d e;
+    for(size_t i=0, iend=mvXw.size(); i<iend; i++)
+    {
+        if(!mvbInlier[i])
+            continue;
+
+        ComputeError(i, Rcw, tcw, e);
+        const double chi2 = e.squaredNorm() * mvInvSigma2[i];
+        double rho = chi2;
+        if(bRobust)
+            RobustWeight(i, chi2, rho);
+        chi2Total += rho;
+    }
+    return chi2Total;
+}
+
+bool PoseSolver::Optimize(Sophus::SE3d &Tcw, const int nIterations, const bool bRobust)
+{
+    double chi2 = Linearize(Tcw, bRobust);
+    if(mnActive == 0)
+        return false;
+
+    Matrix6d H;
+    Vector6d b;
+
+    // Damping and stop criteria as in g2o::OptimizationAlgorithmLevenberg
+    const int nMaxTrials = 10;
+    double lambda = 0;
+    double ni = 2;
+    int nBadIts = 0;
+
+    for(int it=0; it<nIterations; it++)
+    {
+        if(it > 0)
+            chi2 = Linearize(Tcw, bRobust);
+        BuildSystem(H, b);
+
+        if(it == 0)
+            lambda = 1e-5 * H.diagonal().cwiseAbs().maxCoeff();
+
+        const double iniChi2 = chi2;
+        double rho = 0;
+        int nTrials = 0;
+        do
+        {
+            Matrix6d Hl = H;
+            Hl.diagonal().array() += lambda;
+            const Vector6d dx = Hl.ldlt().solve(b);
+
+            const Sophus::SE3d Tnew = LeftUpdate(dx, Tcw);
+            const double newChi2 = RobustChi2(Tnew, bRobust);
+
+            rho = (chi2 - newChi2) / (dx.dot(lambda*dx + b) + 1e-3);
+            if(rho > 0 && std::isfinite(newChi2))
+            {
+                const double alpha = std::min(1.0 - std::pow(2*rho - 1, 3), 2.0/3.0);
+                lambda *= std::max(1.0/3.0, alpha);
+                ni = 2;
+                chi2 = newChi2;
+                Tcw = Tnew;
+            }
+            else
+            {
+                lambda *= ni;
+                ni *= 2;
+            }
+            nTrials++;
+        } while(rho < 0 && nTrials < nMaxTrials);
+
+        if(nTrials == nMaxTrials || rho == 0)
+            break;
+
+        if((iniChi2 - chi2)*1e3 < iniChi2)
+            nBadIts++;
+        else
+            nBadIts = 0;
+
+        if(nBadIts >= 3)
+            break;
+    }
+
+    return true;
+}
+
+int PoseSolver::ClassifyOutliers(const Sophus::SE3d &Tcw, const float chi2Mono, const float chi2Stereo, std::vector<bool> &vbOutlier)
+{
+    const Eigen::Matrix3d Rcw = Tcw.rotationMatrix();
+    const Eigen::Vector3d tcw = Tcw.translation();
+
+    int nBad = 0;
+    Eigen::Vector3d e;
+    for(size_t i=0, iend=mvXw.size(); i<iend; i++)
+    {
+        ComputeError(i, Rcw, tcw, e);
+        const double chi2 = e.squaredNorm() * mvInvSigma2[i];
+        const float th = mvType[i] == STEREO ? chi2Stereo : chi2Mono;
+
+        const bool bOutlier = chi2 > th;
+        mvbInlier[i] = !bOutlier;
+        vbOutlier[mvIdx[i]] = bOutlier;
+        if(bOutlier)
+            nBad++;
+    }
+    return nBad;
+}
+
+InertialPoseSolver::InertialPoseSolver(): mnCameras(1), mbf(0), mDeltaMono(std::sqrt(5.991)),
+    mDeltaStereo(std::sqrt(7.815)), mDeltaPrior(5.0), mpInt(static_cast<IMU::Preintegrated*>(NULL)), mbPrevFixed(true)
+{
+    mpCameras[0] = mpCameras[1] = static_cast<GeometricCamera*>(NULL);
+    for(int c=0; c<2; c++)
+    {
+        mRcb[c] = mRcw[c] = Eigen::Matrix3d::Identity();
+        mtcb[c] = mtcw[c] = Eigen::Vector3d::Zero();
+    }
+    mInfoInertial.setZero();
+    mInfoG.setZero();
+    mInfoA.setZero();
+    mInfoPrior.setZero();
+}
+
+void InertialPoseSolver::Clear()
+{
+    mvXw.clear();
+    mvObs.clear();
+    mvInvSigma2.clear();
+    mvType.clear();
+    mvCam.clear();
+    mvbClose.clear();
+    mvbInlier.clear();
+    mvIdx.clear();
+    mpInt = static_cast<IMU::Preintegrated*>(NULL);
+    mbPrevFixed = true;
+}
+
+void InertialPoseSolver::SetCamera(GeometricCamera* pCamera, const Sophus::SE3f &Tcb, const float bf)
+{
+    mnCameras = 1;
+    mpCameras[0] = pCamera;
+    mRcb[0] = Tcb.rotationMatrix().cast<double>();
+    mtcb[0] = Tcb.translation().cast<double>();
+    mbf = bf;
+}
+
+void InertialPoseSolver::SetRightCamera(GeometricCamera* pCamera, const Sophus::SE3f &Trl)
+{
+    const Eigen::Matrix3d Rrl = Trl.rotationMatrix().cast<double>();
+    mnCameras = 2;
+    mpCameras[1] = pCamera;
+    mRcb[1] = Rrl * mRcb[0];
+    mtcb[1] = Rrl * mtcb[0] + Trl.translation().cast<double>();
+}
+
+void InertialPoseSolver::SetHuberDeltas(const float deltaMono, const float deltaStereo, const float deltaPrior)
+{
+    mDeltaMono = deltaMono;
+    mDeltaStereo = deltaStereo;
+    mDeltaPrior = deltaPrior;
+}
+
+void InertialPoseSolver::AddMonocular(const Eigen::Vector3f &Xw, const float u, const float v, const float invSigma2,
+                                      const int cam, const bool bClose, const int idx)
+{
+    mvXw.push_back(Xw.cast<double>());
+    mvObs.push_back(Eigen::Vector3d(u, v, 0.0));
+    mvInvSigma2.push_back(invSigma2);
+    mvType.push_back(cam == 0 ? PoseSolver::MONOCULAR : PoseSolver::MONOCULAR_RIGHT);
+    mvCam.push_back(cam);
+    mvbClose.push_back(bClose);
+    mvbInlier.push_back(true);
+    mvIdx.push_back(idx);
+}
+
+void InertialPoseSolver::AddStereo(const Eigen::Vector3f &Xw, const float u, const float v, const float ur,
+                                   const float invSigma2, const int idx)
+{
+    mvXw.push_back(Xw.cast<double>());
+    mvObs.push_back(Eigen::Vector3d(u, v, ur));
+    mvInvSigma2.push_back(invSigma2);
+    mvType.push_back(PoseSolver::STEREO);
+    mvCam.push_back(0);
+    mvbClose.push_back(false);
+    mvbInlier.push_back(true);
+    mvIdx.push_back(idx);
+}
+
+void InertialPoseSolver::SetInertial(IMU::Preintegrated* pInt, const Eigen::Matrix3d &InfoG, const Eigen::Matrix3d &InfoA)
+{
+    mpInt = pInt;
+    mInfoG = InfoG;
+    mInfoA = InfoA;
+
+    // Same information as EdgeInertial
+    Matrix9d Info = pInt->C.block<9,9>(0,0).cast<double>().inverse();
+    Info = (Info+Info.transpose())/2;
+    Eigen::SelfAdjointEigenSolver<Matrix9d> es(Info);
+    Eigen::Matrix<double,9,1> eigs = es.eigenvalues();
+    for(int i=0;i<9;i++)
+        if(eigs[i]<1e-12)
+            eigs[i]=0;
+    mInfoInertial = es.eigenvectors()*eigs.asDiagonal()*es.eigenvectors().transpose();
+}
+
+void InertialPoseSolver::SetPrevious(const State &prevState)
+{
+    mPrevState = prevState;
+    mbPrevFixed = true;
+}
+
+void InertialPoseSolver::SetPrior(const State &priorState, const Matrix15d &H)
+{
+    mPriorState = priorState;
+    mInfoPrior = H;
+    mbPrevFixed = false;
+}
+
+void InertialPoseSolver::SetState(const State &state)
+{
+    mState = state;
+    UpdateCameraPoses();
+}
+
+const InertialPoseSolver::State& InertialPoseSolver::GetState() const
+{
+    return mState;
+}
+
+size_t InertialPoseSolver::Size() const
+{
+    return mvXw.size();
+}
+
+void InertialPoseSolver::UpdateCameraPoses()
+{
+    const Eigen::Matrix3d Rbw = mState.Rwb.transpose();
+    const Eigen::Vector3d tbw = -Rbw * mState.twb;
+    for(int c=0; c<mnCameras; c++)
+    {
+        mRcw[c] = mRcb[c] * Rbw;
+        mtcw[c] = mRcb[c] * tbw + mtcb[c];
+    }
+}
+
+void InertialPoseSolver::Update(const Eigen::Matrix<double,15,1> &dx, State &state)
+{
+    // Increment in the IMU frame as ImuCamPose::Update
+    state.twb += state.Rwb * dx.segment<3>(3);
+    state.Rwb = state.Rwb * ExpSO3(Eigen::Vector3d(dx.segment<3>(0)));
+    state.vwb += dx.segment<3>(6);
+    state.bg += dx.segment<3>(9);
+    state.ba += dx.segment<3>(12);
+}
+
+void InertialPoseSolver::ComputeError(const size_t i, Eigen::Vector3d &e) const
+{
+    const int c = mvCam[i];
+    const Eigen::Vector3d Xc = mRcw[c] * mvXw[i] + mtcw[c];
+    const Eigen::Vector3d &obs = mvObs[i];
+    const Eigen::Vector2d p = mpCameras[c]->project(Xc);
+
+    if(mvType[i] == PoseSolver::STEREO)
+        e << obs[0] - p[0], obs[1] - p[1], obs[2] - (p[0] - mbf/Xc[2]);
+    else
+        e << obs[0] - p[0], obs[1] - p[1], 0.0;
+}
+
+void InertialPoseSolver::ComputeErrorAndJacobian(const size_t i, Eigen::Vector3d &e, Matrix36d &J) const
+{
+    const int c = mvCam[i];
+    const Eigen::Vector3d Xc = mRcw[c] * mvXw[i] + mtcw[c];
+    const Eigen::Vector3d Xb = mRcb[c].transpose() * (Xc - mtcb[c]);
+    const Eigen::Vector3d &obs = mvObs[i];
+    const Eigen::Vector2d p = mpCameras[c]->project(Xc);
+
+    Eigen::Matrix3d projJac;
+    projJac.topRows<2>() = mpCameras[c]->projectJac(Xc);
+
+    if(mvType[i] == PoseSolver::STEREO)
+    {
+        e << obs[0] - p[0], obs[1] - p[1], obs[2] - (p[0] - mbf/Xc[2]);
+        projJac.row(2) = projJac.row(0);
+        projJac(2,2) += mbf/(Xc[2]*Xc[2]);
+        J.noalias() = projJac * mRcb[c] * PointDerivative(Xb);
+    }
+    else
+    {
+        e << obs[0] - p[0], obs[1] - p[1], 0.0;
+        J.topRows<2>().noalias() = projJac.topRows<2>() * mRcb[c] * PointDerivative(Xb);
+        J.row(2).setZero();
+    }
+}
+
+bool InertialPoseSolver::IsDepthPositive(const size_t i) const
+{
+    const int c = mvCam[i];
+    return mRcw[c].row(2).dot(mvXw[i]) + mtcw[c][2] > 0.0;
+}
+
+void InertialPoseSolver::InertialError(Eigen::Matrix<double,9,1> &e, Eigen::Matrix<double,9,30> &J) const
+{
+    // EdgeInertial between the previous state (columns 0-14) and the frame (columns 15-29)
+    const State &s1 = mPrevState;
+    const State &s2 = mState;
+    const Eigen::Vector3d g(0, 0, -IMU::GRAVITY_VALUE);
+    const double dt = mpInt->dT;
+
+    const IMU::Bias b1(s1.ba[0], s1.ba[1], s1.ba[2], s1.bg[0], s1.bg[1], s1.bg[2]);
+    const IMU::Bias db = mpInt->GetDeltaBias(b1);
+    const Eigen::Vector3d dbg(db.bwx, db.bwy, db.bwz);
+    const Eigen::Matrix3d dR = mpInt->GetDeltaRotation(b1).cast<double>();
+    const Eigen::Vector3d dV = mpInt->GetDeltaVelocity(b1).cast<double>();
+    const Eigen::Vector3d dP = mpInt->GetDeltaPosition(b1).cast<double>();
+    const Eigen::Matrix3d JRg = mpInt->JRg.cast<double>();
+
+    const Eigen::Matrix3d Rbw1 = s1.Rwb.transpose();
+    const Eigen::Matrix3d eR = dR.transpose()*Rbw1*s2.Rwb;
+    const Eigen::Vector3d er = LogSO3(eR);
+    const Eigen::Matrix3d invJr = InverseRightJacobianSO3(er);
+    const Eigen::Vector3d dv = s2.vwb - s1.vwb - g*dt;
+    const Eigen::Vector3d dp = s2.twb - s1.twb - s1.vwb*dt - 0.5*g*dt*dt;
+
+    e << er, Rbw1*dv - dV, Rbw1*dp - dP;
+
+    J.setZero();
+    J.block<3,3>(0,0) = -invJr*s2.Rwb.transpose()*s1.Rwb;
+    J.block<3,3>(3,0) = Sophus::SO3d::hat(Rbw1*dv);
+    J.block<3,3>(6,0) = Sophus::SO3d::hat(Rbw1*dp);
+    J.block<3,3>(6,3) = -Eigen::Matrix3d::Identity();
+    J.block<3,3>(3,6) = -Rbw1;
+    J.block<3,3>(6,6) = -Rbw1*dt;
+    J.block<3,3>(0,9) = -invJr*eR.transpose()*RightJacobianSO3(Eigen::Vector3d(JRg*dbg))*JRg;
+    J.block<3,3>(3,9) = -mpInt->JVg.cast<double>();
+    J.block<3,3>(6,9) = -mpInt->JPg.cast<double>();
+    J.block<3,3>(3,12) = -mpInt->JVa.cast<double>();
+    J.block<3,3>(6,12) = -mpInt->JPa.cast<double>();
+    J.block<3,3>(0,15) = invJr;
+    J.block<3,3>(6,18) = Rbw1*s2.Rwb;
+    J.block<3,3>(3,21) = Rbw1;
+}
+
+void InertialPoseSolver::PriorError(Eigen::Matrix<double,15,1> &e, Matrix15d &J) const
+{
+    // EdgePriorPoseImu on the previous state
+    const State &s = mPrevState;
+    const Eigen::Vector3d er = LogSO3(mPriorState.Rwb.transpose()*s.Rwb);
+    e << er, mPriorState.Rwb.transpose()*(s.twb-mPriorState.twb), s.vwb-mPriorState.vwb,
+         s.bg-mPriorState.bg, s.ba-mPriorState.ba;
+
+    J.setZero();
+    J.block<3,3>(0,0) = InverseRightJacobianSO3(er);
+    J.block<3,3>(3,3) = mPriorState.Rwb.transpose()*s.Rwb;
+    J.block<9,9>(6,6).setIdentity();
+}
+
+void InertialPoseSolver::BuildSystem(Matrix30d &H, Vector30d &b, const bool bRobust, const bool bRobustPrior) const
+{
+    H.setZero();
+    b.setZero();
+
+    // Visual inliers, only the pose of the frame
+    Matrix6d Hv = Matrix6d::Zero();
+    Eigen::Matrix<double,6,1> bv = Eigen::Matrix<double,6,1>::Zero();
+    Eigen::Vector3d e;
+    Matrix36d J;
+    for(size_t i=0, iend=mvXw.size(); i<iend; i++)
+    {
+        if(!mvbInlier[i])
+            continue;
+
+        ComputeErrorAndJacobian(i, e, J);
+        double w = mvInvSigma2[i];
+        if(bRobust)
+        {
+            // Huber kernel as in g2o::RobustKernelHuber
+            const double chi2 = e.squaredNorm() * mvInvSigma2[i];
+            const double delta = mvType[i] == PoseSolver::STEREO ? mDeltaStereo : mDeltaMono;
+            if(chi2 > delta*delta)
+                w *= delta/std::sqrt(chi2);
+        }
+        Hv.noalias() += w * (J.transpose() * J);
+        bv.noalias() -= w * (J.transpose() * e);
+    }
+    H.block<6,6>(15,15) += Hv;
+    b.segment<6>(15) += bv;
+
+    // Preintegration
+    Eigen::Matrix<double,9,1> ei;
+    Eigen::Matrix<double,9,30> Ji;
+    InertialError(ei, Ji);
+    const Eigen::Matrix<double,30,9> JiT_Info = Ji.transpose() * mInfoInertial;
+    H.noalias() += JiT_Info * Ji;
+    b.noalias() -= JiT_Info * ei;
+
+    // Bias random walks, the error is the frame bias minus the previous one
+    const Eigen::Vector3d ebg = mState.bg - mPrevState.bg;
+    const Eigen::Vector3d eba = mState.ba - mPrevState.ba;
+    H.block<3,3>(9,9) += mInfoG;
+    H.block<3,3>(24,24) += mInfoG;
+    H.block<3,3>(9,24) -= mInfoG;
+    H.block<3,3>(24,9) -= mInfoG;
+    b.segment<3>(9) += mInfoG*ebg;
+    b.segment<3>(24) -= mInfoG*ebg;
+    H.block<3,3>(12,12) += mInfoA;
+    H.block<3,3>(27,27) += mInfoA;
+    H.block<3,3>(12,27) -= mInfoA;
+    H.block<3,3>(27,12) -= mInfoA;
+    b.segment<3>(12) += mInfoA*eba;
+    b.segment<3>(27) -= mInfoA*eba;
+
+    // Prior of the previous state when it is optimized
+    if(!mbPrevFixed)
+    {
+        Eigen::Matrix<double,15,1> ep;
+        Matrix15d Jp;
+        PriorError(ep, Jp);
+        double w = 1.0;
+        if(bRobustPrior)
+        {
+            const double chi2 = ep.dot(mInfoPrior*ep);
+            if(chi2 > mDeltaPrior*mDeltaPrior)
+                w = mDeltaPrior/std::sqrt(chi2);
+        }
+        const Matrix15d JpT_Info = w * (Jp.transpose() * mInfoPrior);
+        H.block<15,15>(0,0).noalias() += JpT_Info * Jp;
+        b.segment<15>(0).noalias() -= JpT_Info * ep;
+    }
+}
+
+bool InertialPoseSolver::Optimize(const int nIterations, const bool bRobust)
+{
+    Matrix30d H;
+    Vector30d b;
+
+    // Plain Gauss-Newton steps as g2o::OptimizationAlgorithmGaussNewton
+    for(int it=0; it<nIterations; it++)
+    {
+        BuildSystem(H, b, bRobust, true);
+
+        if(mbPrevFixed)
+        {
+            const Eigen::LDLT<Matrix15d> ldlt(H.bottomRightCorner<15,15>());
+            if(!ldlt.isPositive())
+                return false;
+            Update(ldlt.solve(b.tail<15>()), mState);
+        }
+        else
+        {
+            const Eigen::LDLT<Matrix30d> ldlt(H);
+            if(!ldlt.isPositive())
+                return false;
+            const Vector30d dx = ldlt.solve(b);
+            Update(dx.head<15>(), mPrevState);
+            Update(dx.tail<15>(), mState);
+        }
+        UpdateCameraPoses();
+    }
+
+    return true;
+}
+
+int InertialPoseSolver::ClassifyOutliers(const float chi2Mono, const float chi2Close, const float chi2Stereo, std::vector<bool> &vbOutlier)
+{
+    int nBad = 0;
+    Eigen::Vector3d e;
+    for(size_t i=0, iend=mvXw.size(); i<iend; i++)
+    {
+        ComputeError(i, e);
+        const double chi2 = e.squaredNorm() * mvInvSigma2[i];
+
+        bool bOutlier;
+        if(mvType[i] == PoseSolver::STEREO)
+            bOutlier = chi2 > chi2Stereo;
+        else
+            bOutlier = chi2 > (mvbClose[i] ? chi2Close : chi2Mono) || !IsDepthPositive(i);
+
+        mvbInlier[i] = !bOutlier;
+        vbOutlier[mvIdx[i]] = bOutlier;
+        if(bOutlier)
+            nBad++;
+    }
+    return nBad;
+}
+
+int InertialPoseSolver::RecoverOutliers(const float chi2Mono, const float chi2Stereo, std::vector<bool> &vbOutlier)
+{
+    int nBad = 0;
+    Eigen::Vector3d e;
+    for(size_t i=0, iend=mvXw.size(); i<iend; i++)
+    {
+        ComputeError(i, e);
+        const double chi2 = e.squaredNorm() * mvInvSigma2[i];
+        if(chi2 < (mvType[i] == PoseSolver::STEREO ? chi2Stereo : chi2Mono))
+        {
+            mvbInlier[i] = true;
+            vbOutlier[mvIdx[i]] = false;
+        }
+        else
+            nBad++;
+    }
+    return nBad;
+}
+
+Eigen::MatrixXd InertialPoseSolver::GetHessian() const
+{
+    Matrix30d H;
+    Vector30d b;
+    BuildSystem(H, b, false, false);
+    if(mbPrevFixed)
+        return H.bottomRightCorner<15,15>();
+    return H;
+}
+
+} //namespace ORB_SLAM3
@@ -48,29 +48,46 @@ void NMS(cv::Mat det, cv::Mat conf, cv::Mat desc, std::vector<cv::KeyPoint>& pts
 void NMS2(std::vector<cv::KeyPoint> det, cv::Mat conf, std::vector<cv::KeyPoint>& pts,
             int border, int dist_thresh, int img_width, int img_height);
 
-// SPDetector::SPDetector(std::shared_ptr<SuperPoint::SuperPoint> _model) : model(_model) 
-// {
-// }
-
 SPDetector::SPDetector(std::string _weight_dir, bool _use_cuda)
-    :   mDeviceType((_use_cuda) ? c10::kCUDA : c10::kCPU),
+    :   SPDetector(LoadModel(_weight_dir, _use_cuda), _use_cuda)
+{
+}
+
+SPDetector::SPDetector(std::shared_ptr<SuperPoint> _model, bool _use_cuda)
+    :   model(_model),
+        mDeviceType((_use_cuda) ? c10::kCUDA : c10::kCPU),
         mDevice(c10::Device(mDeviceType))
 {   
-    /* SuperPoint model loading */
-    model = std::make_shared<SuperPoint>();
-    torch::load(model, _weight_dir);
-    
     /* This option should be done exactly as below */
     tensor_opts = c10::TensorOptions()
                         .dtype(torch::kFloat32)
                         .layout(c10::kStrided)
                         .requires_grad(false);
+}
+
+std::shared_ptr<SuperPoint> SPDetector::LoadModel(const std::string &_weight_dir, bool _use_cuda)
+{
+    static std::mutex mutexModels;
+    static std::map<std::pair<std::string, bool>, std::weak_ptr<SuperPoint> > models;
+
+    std::lock_guard<std::mutex> lock(mutexModels);
+    std::weak_ptr<SuperPoint> &cached = models[std::make_pair(_weight_dir, _use_cuda)];
+    std::shared_ptr<SuperPoint> model = cached.lock();
+    if (model)
+        return model;
+
+    /* SuperPoint model loading */
+    model = std::make_shared<SuperPoint>();
+    torch::load(model, _weight_dir);
 
     // bool is_cuda_available = _use_cuda && torch::cuda::is_available();
 
     if (_use_cuda)
-        model->to(mDevice);
+        model->to(c10::Device(c10::kCUDA));
     model->eval();
+
+    cached = model;
+    return model;
 }
 
 void SPDetector::detect(cv::InputArray _image, std::vector<cv::KeyPoint>& _keypoints,
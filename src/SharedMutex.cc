@@ -0,0 +1,99 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SharedMutex.h"
+
+#include <chrono>
+#include <vector>
+
+namespace ORB_SLAM3
+{
+
+static std::mutex& RegistryMutex()
+{
+    static std::mutex mutexRegistry;
+    return mutexRegistry;
+}
+
+static std::vector<LockStats*>& Registry()
+{
+    static std::vector<LockStats*> vpStats;
+    return vpStats;
+}
+
+LockStats::LockStats(const std::string &name): mName(name), mnContendedExclusive(0), mnContendedShared(0),
+    mnWaitNs(0), mnMaxWaitNs(0)
+{
+    std::unique_lock<std::mutex> lock(RegistryMutex());
+    Registry().push_back(this);
+}
+
+void LockStats::AddWait(const bool bShared, const unsigned long long nWaitNs)
+{
+    if(bShared)
+        mnContendedShared.fetch_add(1, std::memory_order_relaxed);
+    else
+        mnContendedExclusive.fetch_add(1, std::memory_order_relaxed);
+    mnWaitNs.fetch_add(nWaitNs, std::memory_order_relaxed);
+
+    unsigned long long nMax = mnMaxWaitNs.load(std::memory_order_relaxed);
+    while(nWaitNs > nMax && !mnMaxWaitNs.compare_exchange_weak(nMax, nWaitNs, std::memory_order_relaxed));
+}
+
+void LockStats::Reset()
+{
+    mnContendedExclusive = 0;
+    mnContendedShared = 0;
+    mnWaitNs = 0;
+    mnMaxWaitNs = 0;
+}
+
+void LockStats::PrintAll(std::ostream &os)
+{
+    std::unique_lock<std::mutex> lock(RegistryMutex());
+    os << "Lock contention (contended exclusive / contended shared / total wait ms / max wait ms)" << std::endl;
+    for(LockStats* pStats : Registry())
+    {
+        os << pStats->mName << ": " << pStats->mnContendedExclusive << " / " << pStats->mnContendedShared << " / "
+           << pStats->mnWaitNs * 1e-6 << " / " << pStats->mnMaxWaitNs * 1e-6 << std::endl;
+    }
+}
+
+void LockStats::ResetAll()
+{
+    std::unique_lock<std::mutex> lock(RegistryMutex());
+    for(LockStats* pStats : Registry())
+        pStats->Reset();
+}
+
+void SharedMutex::LockSlow(const bool bShared)
+{
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    if(bShared)
+        mMutex.lock_shared();
+    else
+        mMutex.lock();
+
+    if(mpStats)
+    {
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        mpStats->AddWait(bShared, std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+}
+
+} //namespace ORB_SLAM3
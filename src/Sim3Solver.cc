@@ -26,7 +26,6 @@
 #include "KeyFrame.h"
 #include "ORBmatcher.h"
 
-#include "Thirdparty/DUtils/Random.h"
 
 namespace ORB_SLAM3
 {
@@ -117,9 +116,31 @@ Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *>
     FromCameraToImage(mvX3Dc1,mvP1im1,pCamera1);
     FromCameraToImage(mvX3Dc2,mvP2im2,pCamera2);
 
+    const int nMatches = mvX3Dc1.size();
+    mX3Dc1.resize(3,nMatches);
+    mX3Dc2.resize(3,nMatches);
+    mP1im1.resize(2,nMatches);
+    mP2im2.resize(2,nMatches);
+    mMaxError1.resize(nMatches);
+    mMaxError2.resize(nMatches);
+    for(int i=0; i<nMatches; i++)
+    {
+        mX3Dc1.col(i) = mvX3Dc1[i];
+        mX3Dc2.col(i) = mvX3Dc2[i];
+        mP1im1.col(i) = mvP1im1[i];
+        mP2im2.col(i) = mvP2im2[i];
+        mMaxError1(i) = mvnMaxError1[i];
+        mMaxError2(i) = mvnMaxError2[i];
+    }
+
     SetRansacParameters();
 }
 
+void Sim3Solver::SetSeed(const unsigned int seed)
+{
+    mRng.seed(seed);
+}
+
 void Sim3Solver::SetRansacParameters(double probability, int minInliers, int maxIterations)
 {
     mRansacProb = probability;
@@ -174,7 +195,7 @@ Eigen::Matrix4f Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool>
         // Get min set of points
         for(short i = 0; i < 3; ++i)
         {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+            int randi = std::uniform_int_distribution<int>(0, vAvailableIndices.size()-1)(mRng);
 
             int idx = vAvailableIndices[randi];
 
@@ -247,7 +268,7 @@ Eigen::Matrix4f Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool>
         // Get min set of points
         for(short i = 0; i < 3; ++i)
         {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+            int randi = std::uniform_int_distribution<int>(0, vAvailableIndices.size()-1)(mRng);
 
             int idx = vAvailableIndices[randi];
 
@@ -414,27 +435,44 @@ void Sim3Solver::ComputeSim3(Eigen::Matrix3f &P1, Eigen::Matrix3f &P2)
 
 void Sim3Solver::CheckInliers()
 {
-    vector<Eigen::Vector2f> vP1im2, vP2im1;
-    Project(mvX3Dc2,vP2im1,mT12i,pCamera1);
-    Project(mvX3Dc1,vP1im2,mT21i,pCamera2);
+    // Points of KF2 in KF1 and points of KF1 in KF2
+    mP3Dc.noalias() = mT12i.block<3,3>(0,0)*mX3Dc2;
+    mP3Dc.colwise() += mT12i.block<3,1>(0,3);
+    ReprojectionErrors(mP3Dc,mP1im1,pCamera1,mError1);
 
-    mnInliersi=0;
+    mP3Dc.noalias() = mT21i.block<3,3>(0,0)*mX3Dc1;
+    mP3Dc.colwise() += mT21i.block<3,1>(0,3);
+    ReprojectionErrors(mP3Dc,mP2im2,pCamera2,mError2);
 
-    for(size_t i=0; i<mvP1im1.size(); i++)
+    mnInliersi=0;
+    for(int i=0; i<N; i++)
     {
-        Eigen::Vector2f dist1 = mvP1im1[i] - vP2im1[i];
-        Eigen::Vector2f dist2 = vP1im2[i] - mvP2im2[i];
-
-        const float err1 = dist1.dot(dist1);
-        const float err2 = dist2.dot(dist2);
-
-        if(err1<mvnMaxError1[i] && err2<mvnMaxError2[i])
-        {
-            mvbInliersi[i]=true;
+        mvbInliersi[i] = mError1(i)<mMaxError1(i) && mError2(i)<mMaxError2(i);
+        if(mvbInliersi[i])
             mnInliersi++;
-        }
-        else
-            mvbInliersi[i]=false;
+    }
+}
+
+void Sim3Solver::ReprojectionErrors(const Eigen::Matrix<float,3,Eigen::Dynamic> &P3Dc, const Eigen::Matrix<float,2,Eigen::Dynamic> &P2D,
+                                    GeometricCamera* pCamera, Eigen::Array<float,1,Eigen::Dynamic> &error2)
+{
+    if(pCamera->GetType() == GeometricCamera::CAM_PINHOLE)
+    {
+        const float fx = pCamera->getParameter(0);
+        const float fy = pCamera->getParameter(1);
+        const float cx = pCamera->getParameter(2);
+        const float cy = pCamera->getParameter(3);
+
+        const Eigen::Array<float,1,Eigen::Dynamic> invZ = P3Dc.row(2).array().inverse();
+        error2 = (P2D.row(0).array() - (fx*P3Dc.row(0).array()*invZ + cx)).square() +
+                 (P2D.row(1).array() - (fy*P3Dc.row(1).array()*invZ + cy)).square();
+    }
+    else
+    {
+        const int n = P3Dc.cols();
+        error2.resize(n);
+        for(int i=0; i<n; i++)
+            error2(i) = (P2D.col(i) - pCamera->project(Eigen::Vector3f(P3Dc.col(i)))).squaredNorm();
     }
 }
 
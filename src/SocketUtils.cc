@@ -0,0 +1,143 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SocketUtils.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM3
+{
+
+bool ReadFully(const int fd, char* pData, size_t nSize)
+{
+    while(nSize > 0)
+    {
+        const ssize_t n = read(fd, pData, nSize);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        pData += n;
+        nSize -= n;
+    }
+    return true;
+}
+
+bool WriteFully(const int fd, const char* pData, size_t nSize)
+{
+    while(nSize > 0)
+    {
+        // A closed connection gives an error and not SIGPIPE
+        const ssize_t n = send(fd, pData, nSize, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        pData += n;
+        nSize -= n;
+    }
+    return true;
+}
+
+bool WriteMessage(const int fd, const uint32_t nValue, const string &strData)
+{
+    MessageHeader header;
+    header.nValue = nValue;
+    header.nReserved = 0;
+    header.nSize = strData.size();
+    return WriteFully(fd, reinterpret_cast<const char*>(&header), sizeof(header)) && WriteFully(fd, strData.data(), strData.size());
+}
+
+bool ReadMessage(const int fd, uint32_t &nValue, string &strData, const uint64_t nMaxSize)
+{
+    MessageHeader header;
+    if(!ReadFully(fd, reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    if(header.nSize > nMaxSize)
+    {
+        cout << "[E] Map connection: message of " << header.nSize << " bytes rejected" << endl;
+        return false;
+    }
+    nValue = header.nValue;
+    strData.resize(header.nSize);
+    return header.nSize == 0 || ReadFully(fd, &strData[0], header.nSize);
+}
+
+static bool MakeAddress(const string &strSocket, const string &strName, sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strSocket.empty() || strSocket.size() >= sizeof(addr.sun_path))
+    {
+        cout << "[E] " << strName << ": invalid socket path " << strSocket << endl;
+        return false;
+    }
+    strncpy(addr.sun_path, strSocket.c_str(), sizeof(addr.sun_path)-1);
+    return true;
+}
+
+int ListenSocket(const string &strSocket, const string &strName)
+{
+    sockaddr_un addr;
+    if(!MakeAddress(strSocket, strName, addr))
+        return -1;
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        cout << "[E] " << strName << ": unable to create the socket (" << strerror(errno) << ")" << endl;
+        return -1;
+    }
+
+    // Socket left by a process that did not finish
+    unlink(strSocket.c_str());
+    if(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0)
+    {
+        cout << "[E] " << strName << ": unable to listen on " << strSocket << " (" << strerror(errno) << ")" << endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ConnectSocket(const string &strSocket, const string &strName)
+{
+    sockaddr_un addr;
+    if(!MakeAddress(strSocket, strName, addr))
+        return -1;
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        cout << "[E] " << strName << ": unable to connect to " << strSocket << " (" << strerror(errno) << ")" << endl;
+        if(fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} //namespace ORB_SLAM3
@@ -20,10 +20,14 @@
 #include "Defs.h"
 #include "System.h"
 #include "Converter.h"
+#include "Optimizer.h"
+#include "AtlasFile.h"
 #include <thread>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string>
+#include <sstream>
+#include <cstdlib>
 #include <pangolin/pangolin.h>
 #include <iomanip>
 #include <openssl/md5.h>
@@ -117,37 +121,114 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
 
     mStrVocabularyFilePath = strVocFile;
 
-    bool loadedAtlas = false;
+    // Cap on the worker threads (0 = all the cores) and pinning of each worker to a core
+    int nThreads = 0;
+    node = fsSettings["System.Threads"];
+    if(!node.empty())
+        nThreads = static_cast<int>(node);
+    bool bPinThreads = false;
+    node = fsSettings["System.PinThreads"];
+    if(!node.empty())
+        bPinThreads = static_cast<int>(node) != 0;
 
-    if(mStrLoadAtlasFromFile.empty())
-    {
-        //Load ORB Vocabulary
-        cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+    // Keyframe descriptors of a loaded atlas used from the mapped file instead of memory
+    mbMapAtlasDescriptors = false;
+    node = fsSettings["System.MapAtlasDescriptors"];
+    if(!node.empty())
+        mbMapAtlasDescriptors = static_cast<int>(node) != 0;
+
+    // Incremental checkpoints of the atlas every System.CheckpointPeriod seconds. Loading the same file
+    // (System.LoadAtlasFromFile) resumes from the last checkpoint.
+    double checkpointPeriod = 30.0;
+    node = fsSettings["System.CheckpointFile"];
+    if(!node.empty() && node.isString())
+        mStrCheckpointFile = (string)node;
+    node = fsSettings["System.CheckpointPeriod"];
+    if(!node.empty())
+        checkpointPeriod = node.real();
+
+    // Serve the atlas, vocabulary and keyframe database to the MapClient queries of other processes (MapServer)
+    string strMapServerSocket;
+    node = fsSettings["System.MapServerSocket"];
+    if(!node.empty() && node.isString())
+        strMapServerSocket = (string)node;
+
+    // Client of the map server of another process: localization in the served atlas, without vocabulary,
+    // keyframe database nor atlas of its own (no atlas file, checkpoints or map server)
+    string strMapServerClient;
+    node = fsSettings["System.MapServerClient"];
+    if(!node.empty() && node.isString())
+        strMapServerClient = (string)node;
+
+    // Viewer drawing the active map from vertex buffers updated with the changes of the map, and stream of
+    // these changes every Viewer.StreamPeriod seconds for a viewer in another process
+    bool bVertexBuffers = false;
+    node = fsSettings["Viewer.VertexBuffers"];
+    if(!node.empty())
+        bVertexBuffers = static_cast<int>(node) != 0;
+    string strStreamFile, strStreamSocket;
+    double streamPeriod = 0.1;
+    node = fsSettings["Viewer.StreamFile"];
+    if(!node.empty() && node.isString())
+        strStreamFile = (string)node;
+    node = fsSettings["Viewer.StreamSocket"];
+    if(!node.empty() && node.isString())
+        strStreamSocket = (string)node;
+    node = fsSettings["Viewer.StreamPeriod"];
+    if(!node.empty())
+        streamPeriod = node.real();
 
-        mpVocabulary = new ORBVocabulary();
+    // Offline batch processing: headless, tracking waits for the mapping instead of dropping keyframes and
+    // the trajectory does not depend on the speed of the machine
+    bool bOffline = false;
+    node = fsSettings["System.Offline"];
+    if(!node.empty())
+        bOffline = static_cast<int>(node) != 0;
 
-#ifdef USE_DBOW2
+    // Hessian blocks of the bundle adjustments in float (reduced system in double), for the whole process
+    node = fsSettings["Optimizer.MixedPrecision"];
+    if(!node.empty())
+        Optimizer::SetMixedPrecision(static_cast<int>(node) != 0);
+
+    mpScheduler = SharedScheduler(nThreads, bPinThreads);
+
+    bool loadedAtlas = false;
 
-        bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
-        if(!bVocLoad)
+    mpMapTransport = static_cast<MapTransport*>(NULL);
+    mpMapClient = static_cast<MapClient*>(NULL);
+    if(!strMapServerClient.empty())
+    {
+        if(mSensor==IMU_STEREO || mSensor==IMU_MONOCULAR || mSensor==IMU_RGBD)
         {
-            cerr << "Wrong path to vocabulary. " << endl;
-            cerr << "Falied to open at: " << strVocFile << endl;
+            cerr << "A client of a map server does not support inertial sensors" << endl;
             exit(-1);
         }
-        cout << "Vocabulary loaded!" << endl << endl;
-
-#else
 
-        try{
-            cout << "!!!LOADING VOCABULARY!!!" << endl << endl;
-            mpVocabulary->load(strVocFile);
-            cout << "!!!LOADED!!!" << endl << endl;
-        }catch(std::exception &ex){
-            cerr<<ex.what()<<endl;
+        SocketMapTransport* pTransport = new SocketMapTransport();
+        if(!pTransport->Connect(strMapServerClient))
+        {
+            cerr << "Failed to connect to the map server at: " << strMapServerClient << endl;
+            exit(-1);
         }
+        mpMapTransport = pTransport;
+        mpMapClient = new MapClient(mpMapTransport);
 
-#endif
+        mpVocabulary = static_cast<ORBVocabulary*>(NULL);
+        mpKeyFrameDatabase = static_cast<KeyFrameDatabase*>(NULL);
+
+        // Holds the keyframes and points received from the server
+        cout << "Client of the map server at " << strMapServerClient << endl;
+        mpAtlas = new Atlas(0);
+
+        mStrLoadAtlasFromFile.clear();
+        mStrSaveAtlasToFile.clear();
+        mStrCheckpointFile.clear();
+        strMapServerSocket.clear();
+    }
+    else if(mStrLoadAtlasFromFile.empty())
+    {
+        //Load ORB Vocabulary
+        mpVocabulary = LoadVocabulary(strVocFile);
 
         cout << "Vocabulary loaded, creating KeyFrameDatabase! " << endl;
 
@@ -157,33 +238,12 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
         //Create the Atlas
         cout << "Initialization of Atlas from scratch " << endl;
         mpAtlas = new Atlas(0);
+        mpAtlas->SetKeyFrameDababase(mpKeyFrameDatabase);
     }
     else
     {
         //Load ORB Vocabulary
-        cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
-
-        mpVocabulary = new ORBVocabulary();
-
-#ifdef USE_DBOW2
-
-        bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
-        if(!bVocLoad)
-        {
-            cerr << "Wrong path to vocabulary. " << endl;
-            cerr << "Falied to open at: " << strVocFile << endl;
-            exit(-1);
-        }
-        
-#else 
-
-        try{
-            mpVocabulary->load(strVocFile);
-        }catch(std::exception &ex){
-            cerr<<ex.what()<<endl;
-        }
-
-#endif
+        mpVocabulary = LoadVocabulary(strVocFile);
 
         cout << "Vocabulary loaded, creating KeyFrameDatabase!" << endl << endl;
 
@@ -225,16 +285,27 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     //Create Drawers. These are used by the Viewer
     mpFrameDrawer = new FrameDrawer(mpAtlas);
     mpMapDrawer = new MapDrawer(mpAtlas, strSettingsFile, settings_);
+    if(bVertexBuffers)
+        mpMapDrawer->EnableVertexBuffers();
 
     //Initialize the Tracking thread
     //(it will live in the main thread of execution, the one that called this constructor)
     cout << "Seq. Name: " << strSequence << endl;
     mpTracker = new Tracking(this, mpVocabulary, mpFrameDrawer, mpMapDrawer,
                              mpAtlas, mpKeyFrameDatabase, strSettingsFile, mSensor, settings_, strSequence);
+    mpTracker->SetScheduler(mpScheduler.get());
+    mpTracker->SetOffline(bOffline);
+    if(mpMapClient)
+    {
+        // Local Mapping is stopped with the first frame, a client does not extend the served map
+        mpTracker->SetMapClient(mpMapClient);
+        ActivateLocalizationMode();
+    }
 
     //Initialize the Local Mapping thread and launch
     mpLocalMapper = new LocalMapping(this, mpAtlas, mSensor==MONOCULAR || mSensor==IMU_MONOCULAR,
                                      mSensor==IMU_MONOCULAR || mSensor==IMU_STEREO || mSensor==IMU_RGBD, strSequence);
+    mpLocalMapper->SetScheduler(mpScheduler.get());
     mptLocalMapping = new thread(&ORB_SLAM3::LocalMapping::Run,mpLocalMapper);
     mpLocalMapper->mInitFr = initFr;
     if(settings_)
@@ -252,8 +323,62 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     //Initialize the Loop Closing thread and launch
     // mSensor!=MONOCULAR && mSensor!=IMU_MONOCULAR
     mpLoopCloser = new LoopClosing(mpAtlas, mpKeyFrameDatabase, mpVocabulary, mSensor!=MONOCULAR, activeLC); // mSensor!=MONOCULAR);
+    mpLoopCloser->SetScheduler(mpScheduler.get());
     mptLoopClosing = new thread(&ORB_SLAM3::LoopClosing::Run, mpLoopCloser);
 
+    //Initialize the Checkpointer thread and launch
+    mpCheckpointer = static_cast<AtlasCheckpointer*>(NULL);
+    mptCheckpointer = static_cast<thread*>(NULL);
+    if(!mStrCheckpointFile.empty())
+    {
+        string strVocabularyChecksum = GetVocabularyChecksum();
+        std::size_t found = mStrVocabularyFilePath.find_last_of("/\\");
+        string strVocabularyName = mStrVocabularyFilePath.substr(found+1);
+
+        mpCheckpointer = new AtlasCheckpointer(mpAtlas, "./" + mStrCheckpointFile + ".osa", checkpointPeriod, strVocabularyName,
+                                               strVocabularyChecksum, mpScheduler.get(), loadedAtlas && mStrLoadAtlasFromFile == mStrCheckpointFile);
+        mptCheckpointer = new thread(&ORB_SLAM3::AtlasCheckpointer::Run, mpCheckpointer);
+    }
+
+    //Initialize the Map server thread and launch
+    mpMapServer = static_cast<MapServer*>(NULL);
+    mptMapServer = static_cast<thread*>(NULL);
+    if(!strMapServerSocket.empty())
+    {
+        mpMapServer = new MapServer(mpAtlas, mpVocabulary, mpKeyFrameDatabase);
+        if(mpMapServer->Listen(strMapServerSocket))
+        {
+            mptMapServer = new thread(&ORB_SLAM3::MapServer::Run, mpMapServer);
+        }
+        else
+        {
+            delete mpMapServer;
+            mpMapServer = static_cast<MapServer*>(NULL);
+        }
+    }
+
+    //Initialize the Map streamer thread and launch
+    mpMapStreamer = static_cast<MapStreamer*>(NULL);
+    mptMapStreamer = static_cast<thread*>(NULL);
+    if(!strStreamFile.empty() || !strStreamSocket.empty())
+    {
+        mpMapStreamer = new MapStreamer(mpAtlas, mpMapDrawer, streamPeriod);
+        bool bStreamOpen = false;
+        if(!strStreamFile.empty() && mpMapStreamer->OpenFile(strStreamFile))
+            bStreamOpen = true;
+        if(!strStreamSocket.empty() && mpMapStreamer->Listen(strStreamSocket))
+            bStreamOpen = true;
+        if(bStreamOpen)
+        {
+            mptMapStreamer = new thread(&ORB_SLAM3::MapStreamer::Run, mpMapStreamer);
+        }
+        else
+        {
+            delete mpMapStreamer;
+            mpMapStreamer = static_cast<MapStreamer*>(NULL);
+        }
+    }
+
     //Set pointers between threads
     mpTracker->SetLocalMapper(mpLocalMapper);
     mpTracker->SetLoopClosing(mpLoopCloser);
@@ -267,7 +392,17 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     //usleep(10*1000*1000);
 
     //Initialize the Viewer thread and launch
-    if(bUseViewer)
+    // Offline the relocalization and place recognition candidates are verified in order and the bundle
+    // adjustments build their system serially, so the trajectory is the same in every run
+    if(bOffline)
+    {
+        mpTracker->SetParallelRelocalization(false);
+        mpLocalMapper->SetParallelBA(false);
+        mpLoopCloser->SetParallelPlaceRecognition(false);
+        mpLoopCloser->SetParallelBA(false);
+        cout << "Offline mode: deterministic, without viewer" << endl;
+    }
+    if(bUseViewer && !bOffline)
     //if(false) // TODO
     {
         mpViewer = new Viewer(this, mpFrameDrawer,mpMapDrawer,mpTracker,strSettingsFile,settings_);
@@ -330,10 +465,7 @@ Sophus::SE3f System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -405,10 +537,7 @@ Sophus::SE3f System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -489,10 +618,7 @@ Sophus::SE3f System::TrackMonocular(const cv::Mat &im, const double &timestamp,
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -552,6 +678,12 @@ void System::ActivateLocalizationMode()
 
 void System::DeactivateLocalizationMode()
 {
+    if(mpMapClient)
+    {
+        Verbose::PrintMess("A client of a map server only tracks in localization mode", Verbose::VERBOSITY_NORMAL);
+        return;
+    }
+
     unique_lock<mutex> lock(mMutexMode);
     mbDeactivateLocalizationMode = true;
 }
@@ -599,20 +731,29 @@ void System::Shutdown()
             usleep(5000);
     }*/
 
-    // Wait until all thread have effectively stopped
-    /*while(!mpLocalMapper->isFinished() || !mpLoopCloser->isFinished() || mpLoopCloser->isRunningGBA())
-    {
-        if(!mpLocalMapper->isFinished())
-            cout << "mpLocalMapper is not finished" << endl;*/
-        /*if(!mpLoopCloser->isFinished())
-            cout << "mpLoopCloser is not finished" << endl;
-        if(mpLoopCloser->isRunningGBA()){
-            cout << "mpLoopCloser is running GBA" << endl;
-            cout << "break anyway..." << endl;
-            break;
-        }*/
-        /*usleep(5000);
-    }*/
+    // Wait until all thread have effectively stopped, the checkpoint and the atlas file are written
+    // from the final map (Local Mapping edits the covisibility graph outside the map lock)
+    mpLocalMapper->WaitUntilFinished();
+    mpLoopCloser->WaitUntilFinished();
+
+    if(mpMapServer)
+    {
+        mpMapServer->RequestFinish();
+        mptMapServer->join();
+    }
+
+    if(mpMapStreamer)
+    {
+        mpMapStreamer->RequestFinish();
+        mptMapStreamer->join();
+    }
+
+    if(mpCheckpointer)
+    {
+        // Last checkpoint
+        mpCheckpointer->RequestFinish();
+        mptCheckpointer->join();
+    }
 
     if(!mStrSaveAtlasToFile.empty())
     {
@@ -627,7 +768,12 @@ void System::Shutdown()
     mpTracker->PrintTimeStats();
 #endif
 
-
+    // All the threads using the workers are done. The last system of the process stops and joins them,
+    // tracking runs without them from now on.
+    mpTracker->SetScheduler(static_cast<TaskScheduler*>(NULL));
+    mpLocalMapper->SetScheduler(static_cast<TaskScheduler*>(NULL));
+    mpLoopCloser->SetScheduler(static_cast<TaskScheduler*>(NULL));
+    mpScheduler.reset();
 }
 
 bool System::isShutDown() {
@@ -1481,19 +1627,19 @@ void System::SaveAtlas(int type){
     {
         //clock_t start = clock();
 
-        // Save the current session
-        mpAtlas->PreSave();
-
         string pathSaveFileName = "./";
         pathSaveFileName = pathSaveFileName.append(mStrSaveAtlasToFile);
         pathSaveFileName = pathSaveFileName.append(".osa");
 
-        string strVocabularyChecksum = CalculateCheckSum(mStrVocabularyFilePath,TEXT_FILE);
+        string strVocabularyChecksum = GetVocabularyChecksum();
         std::size_t found = mStrVocabularyFilePath.find_last_of("/\\");
         string strVocabularyName = mStrVocabularyFilePath.substr(found+1);
 
         if(type == TEXT_FILE) // File text
         {
+            // Save the current session
+            mpAtlas->PreSave();
+
             cout << "Starting to write the save text file " << endl;
             std::remove(pathSaveFileName.c_str());
             std::ofstream ofs(pathSaveFileName, std::ios::binary);
@@ -1506,13 +1652,11 @@ void System::SaveAtlas(int type){
         }
         else if(type == BINARY_FILE) // File binary
         {
+            // Chunked format, the maps are converted and encoded one by one (AtlasFile)
             cout << "Starting to write the save binary file" << endl;
             std::remove(pathSaveFileName.c_str());
-            std::ofstream ofs(pathSaveFileName, std::ios::binary);
-            boost::archive::binary_oarchive oa(ofs);
-            oa << strVocabularyName;
-            oa << strVocabularyChecksum;
-            oa << mpAtlas;
+            if(!AtlasFile::Save(pathSaveFileName, mpAtlas, strVocabularyName, strVocabularyChecksum, mpScheduler.get()))
+                cout << "[E] Error writing the atlas file " << pathSaveFileName << endl;
             cout << "End to write save binary file" << endl;
         }
     }
@@ -1543,7 +1687,25 @@ bool System::LoadAtlas(int type)
         cout << "End to load the save text file " << endl;
         isRead = true;
     }
-    else if(type == BINARY_FILE) // File binary
+    else if(type == BINARY_FILE && !mStrCheckpointFile.empty() && mStrLoadAtlasFromFile == mStrCheckpointFile) // Last checkpoint
+    {
+        cout << "Starting to read the checkpoint files" << endl;
+        mpAtlas = AtlasCheckpointer::Load(pathLoadFileName, strFileVoc, strVocChecksum, mpScheduler.get());
+        if(!mpAtlas)
+            return false;
+        cout << "End to load the checkpoint files" << endl;
+        isRead = true;
+    }
+    else if(type == BINARY_FILE && AtlasFile::IsAtlasFile(pathLoadFileName)) // Chunked binary file
+    {
+        cout << "Starting to read the save binary file"  << endl;
+        mpAtlas = AtlasFile::Load(pathLoadFileName, strFileVoc, strVocChecksum, mpScheduler.get(), mbMapAtlasDescriptors);
+        if(!mpAtlas)
+            return false;
+        cout << "End to load the save binary file" << endl;
+        isRead = true;
+    }
+    else if(type == BINARY_FILE) // File binary of previous versions (single boost archive)
     {
         cout << "Starting to read the save binary file"  << endl;
         std::ifstream ifs(pathLoadFileName, std::ios::binary);
@@ -1563,7 +1725,7 @@ bool System::LoadAtlas(int type)
     if(isRead)
     {
         //Check if the vocabulary is the same
-        string strInputVocabularyChecksum = CalculateCheckSum(mStrVocabularyFilePath,TEXT_FILE);
+        string strInputVocabularyChecksum = GetVocabularyChecksum();
 
         if(strInputVocabularyChecksum.compare(strVocChecksum) != 0)
         {
@@ -1574,13 +1736,159 @@ bool System::LoadAtlas(int type)
 
         mpAtlas->SetKeyFrameDababase(mpKeyFrameDatabase);
         mpAtlas->SetORBVocabulary(mpVocabulary);
-        mpAtlas->PostLoad();
+        mpAtlas->PostLoad(mpScheduler.get());
 
         return true;
     }
     return false;
 }
 
+ORBVocabulary* System::LoadVocabulary(const string &strVocFile)
+{
+    static mutex mutexVocabularies;
+    static map<string, ORBVocabulary*> mVocabularies;
+
+    // Other systems of this process wait here while the first one loads the file
+    unique_lock<mutex> lock(mutexVocabularies);
+    map<string, ORBVocabulary*>::iterator it = mVocabularies.find(strVocFile);
+    if(it != mVocabularies.end())
+    {
+        cout << endl << "Using the ORB Vocabulary already loaded from " << strVocFile << endl;
+        return it->second;
+    }
+
+    cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+
+    ORBVocabulary* pVocabulary = new ORBVocabulary();
+
+#ifdef USE_DBOW2
+
+    bool bVocLoad = pVocabulary->loadFromTextFile(strVocFile);
+    if(!bVocLoad)
+    {
+        cerr << "Wrong path to vocabulary. " << endl;
+        cerr << "Falied to open at: " << strVocFile << endl;
+        exit(-1);
+    }
+    cout << "Vocabulary loaded!" << endl << endl;
+
+#else
+
+    try{
+        cout << "!!!LOADING VOCABULARY!!!" << endl << endl;
+        pVocabulary->load(strVocFile);
+        cout << "!!!LOADED!!!" << endl << endl;
+    }catch(std::exception &ex){
+        cerr<<ex.what()<<endl;
+    }
+
+#endif
+
+    // As before, the vocabulary lives until the process ends
+    mVocabularies[strVocFile] = pVocabulary;
+    return pVocabulary;
+}
+
+std::shared_ptr<TaskScheduler> System::SharedScheduler(const int nThreads, const bool bPinThreads)
+{
+    static mutex mutexScheduler;
+    static std::weak_ptr<TaskScheduler> wpScheduler;
+
+    unique_lock<mutex> lock(mutexScheduler);
+    std::shared_ptr<TaskScheduler> pScheduler = wpScheduler.lock();
+    if(pScheduler)
+    {
+        cout << "Using the task scheduler of the process, with " << pScheduler->NumThreads() << " threads" << endl;
+        return pScheduler;
+    }
+
+    pScheduler = std::make_shared<TaskScheduler>(nThreads, bPinThreads);
+    wpScheduler = pScheduler;
+    cout << "Task scheduler with " << pScheduler->NumThreads() << " threads" << (bPinThreads ? " (pinned)" : "") << endl;
+
+    // Avoid that the OpenCV and libtorch pools oversubscribe the cores on top of the scheduler. They
+    // are process-wide, so they are only set with the scheduler.
+    cv::setNumThreads(pScheduler->NumThreads());
+    torch::set_num_threads(pScheduler->NumThreads());
+
+    return pScheduler;
+}
+
+// Folder for the checksums of the vocabularies, empty if there is no home
+static string VocabularyCacheFolder()
+{
+    const char* pCache = getenv("XDG_CACHE_HOME");
+    if(pCache && pCache[0] == '/')
+        return string(pCache) + "/orbslam3";
+    const char* pHome = getenv("HOME");
+    if(pHome && pHome[0] == '/')
+        return string(pHome) + "/.cache/orbslam3";
+    return "";
+}
+
+string System::GetVocabularyChecksum()
+{
+    if(!mStrVocabularyChecksum.empty())
+        return mStrVocabularyChecksum;
+
+    struct stat st;
+    if(stat(mStrVocabularyFilePath.c_str(), &st) != 0)
+        return CalculateCheckSum(mStrVocabularyFilePath,TEXT_FILE);
+
+    // Checksums of this process and of previous runs, valid while the file has the same size and
+    // modification time. Nothing is written next to the vocabulary.
+    static mutex mutexChecksums;
+    static map<string, string> mChecksums;
+    stringstream ssKey;
+    ssKey << static_cast<long long>(st.st_size) << " " << static_cast<long long>(st.st_mtime) << " " << mStrVocabularyFilePath;
+    const string strKey = ssKey.str();
+
+    unique_lock<mutex> lock(mutexChecksums);
+    map<string, string>::iterator it = mChecksums.find(strKey);
+    if(it != mChecksums.end())
+    {
+        mStrVocabularyChecksum = it->second;
+        return mStrVocabularyChecksum;
+    }
+
+    // One line per vocabulary: checksum, size, modification time and path
+    const string strFolder = VocabularyCacheFolder();
+    const string strCacheFile = strFolder + "/vocabulary_checksums";
+    if(!strFolder.empty())
+    {
+        ifstream ifs(strCacheFile.c_str());
+        string strChecksum, strLineKey;
+        while(ifs >> strChecksum && getline(ifs, strLineKey))
+        {
+            if(!strLineKey.empty() && strLineKey[0] == ' ')
+                strLineKey.erase(0, 1);
+            mChecksums[strLineKey] = strChecksum;
+        }
+        it = mChecksums.find(strKey);
+        if(it != mChecksums.end())
+        {
+            mStrVocabularyChecksum = it->second;
+            return mStrVocabularyChecksum;
+        }
+    }
+
+    mStrVocabularyChecksum = CalculateCheckSum(mStrVocabularyFilePath,TEXT_FILE);
+    if(!mStrVocabularyChecksum.empty())
+    {
+        mChecksums[strKey] = mStrVocabularyChecksum;
+
+        // Without a writable cache folder the checksum is computed in every run
+        if(!strFolder.empty())
+        {
+            mkdir((strFolder.substr(0, strFolder.find_last_of('/'))).c_str(), 0755);
+            mkdir(strFolder.c_str(), 0755);
+            ofstream ofs(strCacheFile.c_str(), ios::app);
+            ofs << mStrVocabularyChecksum << " " << strKey << endl;
+        }
+    }
+    return mStrVocabularyChecksum;
+}
+
 string System::CalculateCheckSum(string filename, int type)
 {
     string checksum = "";
@@ -0,0 +1,272 @@
+/**
+* This file is part of ORB-SLAM3
+*
+* Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+* Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+*
+* ORB-SLAM3 is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+* the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with ORB-SLAM3.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TaskScheduler.h"
+
+#include <iostream>
+#include <memory>
+#include <pthread.h>
+
+namespace ORB_SLAM3
+{
+
+// Scheduler and index of the worker running in this thread (if any)
+static thread_local const TaskScheduler* tlpScheduler = static_cast<TaskScheduler*>(NULL);
+static thread_local int tlnWorker = -1;
+
+// Shared state of a ParallelFor, every runner takes chunks until there are none left
+struct ParallelForChunks
+{
+    std::function<void(int)> mFunction;
+    std::atomic<int> mnNext;
+    int mnLast;
+    int mnGrain;
+
+    void Run()
+    {
+        while(true)
+        {
+            const int first = mnNext.fetch_add(mnGrain);
+            if(first >= mnLast)
+                break;
+            const int last = std::min(first + mnGrain, mnLast);
+            for(int i=first; i<last; i++)
+                mFunction(i);
+        }
+    }
+};
+
+static void RunChunks(const std::shared_ptr<ParallelForChunks> &pChunks)
+{
+    pChunks->Run();
+}
+
+TaskScheduler::TaskScheduler(const int nThreads, const bool bPinThreads): mnPending(0), mnNextQueue(0), mbFinish(false),
+    mnEvents(0)
+{
+    const int nHwThreads = HardwareThreads();
+    const int nWorkers = nThreads > 0 ? nThreads : nHwThreads;
+
+    for(int i=0; i<nWorkers; i++)
+        mvpWorkers.push_back(new Worker());
+
+    for(int i=0; i<nWorkers; i++)
+    {
+        mvThreads.push_back(std::thread(&TaskScheduler::Run, this, i));
+
+        if(bPinThreads)
+        {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(i % nHwThreads, &cpuset);
+            if(pthread_setaffinity_np(mvThreads.back().native_handle(), sizeof(cpu_set_t), &cpuset) != 0)
+                std::cerr << "TaskScheduler: worker " << i << " could not be pinned to core " << i % nHwThreads << std::endl;
+        }
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexSleep);
+        mbFinish = true;
+    }
+    mCondSleep.notify_all();
+
+    for(size_t i=0; i<mvThreads.size(); i++)
+        mvThreads[i].join();
+
+    for(size_t i=0; i<mvpWorkers.size(); i++)
+        delete mvpWorkers[i];
+}
+
+int TaskScheduler::HardwareThreads()
+{
+    return std::max<unsigned int>(1, std::thread::hardware_concurrency());
+}
+
+int TaskScheduler::NumThreads() const
+{
+    return mvThreads.size();
+}
+
+int TaskScheduler::CurrentWorker() const
+{
+    return tlpScheduler == this ? tlnWorker : -1;
+}
+
+std::future<void> TaskScheduler::Submit(const std::function<void()> &task, const ePriority priority)
+{
+    std::shared_ptr<std::packaged_task<void()> > pTask = std::make_shared<std::packaged_task<void()> >(task);
+    std::future<void> result = pTask->get_future();
+    Push(std::bind(&TaskScheduler::RunAndSignal, this, pTask), priority);
+    return result;
+}
+
+void TaskScheduler::RunAndSignal(const std::shared_ptr<std::packaged_task<void()> > &pTask)
+{
+    (*pTask)();
+
+    {
+        std::unique_lock<std::mutex> lock(mMutexSleep);
+        mnEvents++;
+    }
+    mCondEvents.notify_all();
+}
+
+void TaskScheduler::Push(const std::function<void()> &task, const ePriority priority)
+{
+    int idx = CurrentWorker();
+    if(idx < 0)
+        idx = mnNextQueue.fetch_add(1) % mvpWorkers.size();
+
+    {
+        std::unique_lock<std::mutex> lock(mvpWorkers[idx]->mMutex);
+        mvpWorkers[idx]->mdQueues[priority].push_back(task);
+    }
+    mnPending++;
+
+    {
+        // Workers check the counter with this mutex, taking it avoids missing the notification
+        std::unique_lock<std::mutex> lock(mMutexSleep);
+        mnEvents++;
+    }
+    mCondSleep.notify_one();
+    // A waiting thread can run the new task
+    mCondEvents.notify_all();
+}
+
+bool TaskScheduler::Pop(const int idx, const int maxPriority, std::function<void()> &task)
+{
+    const int nWorkers = mvpWorkers.size();
+    for(int p=0; p<=maxPriority; p++)
+    {
+        if(idx >= 0)
+        {
+            Worker* pWorker = mvpWorkers[idx];
+            std::unique_lock<std::mutex> lock(pWorker->mMutex);
+            if(!pWorker->mdQueues[p].empty())
+            {
+                task = pWorker->mdQueues[p].back();
+                pWorker->mdQueues[p].pop_back();
+                mnPending--;
+                return true;
+            }
+        }
+
+        const int start = idx >= 0 ? idx+1 : 0;
+        for(int i=0; i<nWorkers; i++)
+        {
+            const int victim = (start + i) % nWorkers;
+            if(victim == idx)
+                continue;
+            Worker* pWorker = mvpWorkers[victim];
+            std::unique_lock<std::mutex> lock(pWorker->mMutex);
+            if(!pWorker->mdQueues[p].empty())
+            {
+                task = pWorker->mdQueues[p].front();
+                pWorker->mdQueues[p].pop_front();
+                mnPending--;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::Run(const int idx)
+{
+    tlpScheduler = this;
+    tlnWorker = idx;
+
+    std::function<void()> task;
+    while(true)
+    {
+        if(Pop(idx, NUM_PRIORITIES-1, task))
+        {
+            task();
+            task = std::function<void()>();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutexSleep);
+        while(mnPending == 0 && !mbFinish)
+            mCondSleep.wait(lock);
+        if(mbFinish && mnPending == 0)
+            break;
+    }
+}
+
+void TaskScheduler::Wait(std::future<void> &result, const ePriority priority)
+{
+    const int idx = CurrentWorker();
+    std::function<void()> task;
+    while(true)
+    {
+        unsigned long nEvents;
+        {
+            std::unique_lock<std::mutex> lock(mMutexSleep);
+            nEvents = mnEvents;
+        }
+
+        if(result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            break;
+
+        if(Pop(idx, priority, task))
+        {
+            task();
+            task = std::function<void()>();
+            continue;
+        }
+
+        // Nothing to run: sleep until a task finishes or a new one is queued since the checks above
+        std::unique_lock<std::mutex> lock(mMutexSleep);
+        while(mnEvents == nEvents)
+            mCondEvents.wait(lock);
+    }
+    result.get();
+}
+
+void TaskScheduler::ParallelFor(const int first, const int last, const std::function<void(int)> &f,
+                                const ePriority priority, const int nGrain)
+{
+    if(last <= first)
+        return;
+
+    std::shared_ptr<ParallelForChunks> pChunks = std::make_shared<ParallelForChunks>();
+    pChunks->mFunction = f;
+    pChunks->mnNext = first;
+    pChunks->mnLast = last;
+    pChunks->mnGrain = std::max(1, nGrain);
+
+    // One helper per extra chunk, up to the number of workers
+    const int nChunks = (last - first + pChunks->mnGrain - 1) / pChunks->mnGrain;
+    const int nHelpers = std::min(nChunks - 1, NumThreads());
+
+    std::vector<std::future<void> > vResults;
+    vResults.reserve(nHelpers);
+    for(int i=0; i<nHelpers; i++)
+        vResults.push_back(Submit(std::bind(RunChunks, pChunks), priority));
+
+    pChunks->Run();
+
+    for(size_t i=0; i<vResults.size(); i++)
+        Wait(vResults[i], priority);
+}
+
+} //namespace ORB_SLAM3
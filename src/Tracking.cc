@@ -34,6 +34,7 @@
 #include <iostream>
 
 #include <mutex>
+#include <atomic>
 #include <chrono>
 
 
@@ -46,7 +47,7 @@ namespace ORB_SLAM3
 Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer, MapDrawer *pMapDrawer, Atlas *pAtlas, KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor, Settings* settings, const string &_nameSeq):
     mState(NO_IMAGES_YET), mSensor(sensor), mTrackedFr(0), mbStep(false),
     mbOnlyTracking(false), mbMapUpdated(false), mbVO(false), mpORBVocabulary(pVoc), mpKeyFrameDB(pKFDB),
-    mbReadyToInitializate(false), mpSystem(pSys), mpViewer(NULL), bStepByStep(false),
+    mbReadyToInitializate(false), mpSystem(pSys), mpViewer(NULL), mpScheduler(static_cast<TaskScheduler*>(NULL)), mbParallelRelocalization(true), mpMapClient(static_cast<MapClient*>(NULL)), mbOffline(false), bStepByStep(false),
     mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpAtlas(pAtlas), mnLastRelocFrameId(0), time_recently_lost(5.0),
     mnInitialFrameId(0), mbCreatedMap(false), mnFirstFrameId(0), mpCamera2(nullptr), mpLastKeyFrame(static_cast<KeyFrame*>(NULL))
 {
@@ -183,6 +184,19 @@ double calcDeviation(vector<int> v_values, double average)
     return sqrt(accum / total);
 }
 
+// Peak resident set size of the process in MB (VmHWM), -1 if it can not be read
+double getPeakRSS_MB()
+{
+    ifstream f("/proc/self/status");
+    string line;
+    while(getline(f, line))
+    {
+        if(line.compare(0, 6, "VmHWM:") == 0)
+            return atof(line.c_str() + 6) / 1024.0;
+    }
+    return -1.0;
+}
+
 void Tracking::LocalMapStats2File()
 {
     ofstream f;
@@ -349,6 +363,16 @@ void Tracking::PrintTimeStats()
     std::cout << "KF Insertion: " << average << "$\\pm$" << deviation << std::endl;
     f << "KF Insertion: " << average << "$\\pm$" << deviation << std::endl;
 
+    average = calcAverage(mpLocalMapper->vdKFQueue_ms);
+    deviation = calcDeviation(mpLocalMapper->vdKFQueue_ms, average);
+    std::cout << "KF Queue Wait: " << average << "$\\pm$" << deviation << std::endl;
+    f << "KF Queue Wait: " << average << "$\\pm$" << deviation << std::endl;
+
+    average = calcAverage(mpLocalMapper->vdKFToLBA_ms);
+    deviation = calcDeviation(mpLocalMapper->vdKFToLBA_ms, average);
+    std::cout << "KF to LBA: " << average << "$\\pm$" << deviation << std::endl;
+    f << "KF to LBA: " << average << "$\\pm$" << deviation << std::endl;
+
     average = calcAverage(mpLocalMapper->vdMPCulling_ms);
     deviation = calcDeviation(mpLocalMapper->vdMPCulling_ms, average);
     std::cout << "MP Culling: " << average << "$\\pm$" << deviation << std::endl;
@@ -425,6 +449,9 @@ void Tracking::PrintTimeStats()
     f << "KFs in map: " << pBestMap->GetAllKeyFrames().size() << std::endl;
     f << "MPs in map: " << pBestMap->GetAllMapPoints().size() << std::endl;
 
+    std::cout << "Peak RSS (MB): " << getPeakRSS_MB() << std::endl;
+    f << "Peak RSS (MB): " << getPeakRSS_MB() << std::endl;
+
     f << "---------------------------" << std::endl;
     f << std::endl << "Place Recognition (mean$\\pm$std)" << std::endl;
     std::cout << "---------------------------" << std::endl;
@@ -504,6 +531,10 @@ void Tracking::PrintTimeStats()
     deviation = calcDeviation(mpLoopClosing->vdUpdateMap_ms, average);
     f << "Map Update: " << average << "$\\pm$" << deviation << std::endl;
     std::cout << "Map Update: " << average << "$\\pm$" << deviation << std::endl;
+    average = calcAverage(mpLoopClosing->vdGBAPublish_ms);
+    deviation = calcDeviation(mpLoopClosing->vdGBAPublish_ms, average);
+    f << "Map Update (locked): " << average << "$\\pm$" << deviation << std::endl;
+    std::cout << "Map Update (locked): " << average << "$\\pm$" << deviation << std::endl;
     average = calcAverage(mpLoopClosing->vdFGBATotal_ms);
     deviation = calcDeviation(mpLoopClosing->vdFGBATotal_ms, average);
     f << "Total Full GBA: " << average << "$\\pm$" << deviation << std::endl << std::endl;
@@ -522,6 +553,11 @@ void Tracking::PrintTimeStats()
     f << "Number of MPs: " << average << "$\\pm$" << deviation << std::endl;
     std::cout << "Number of MPs: " << average << "$\\pm$" << deviation << std::endl;
 
+    f << "---------------------------" << std::endl << std::endl;
+    std::cout << "---------------------------" << std::endl << std::endl;
+    LockStats::PrintAll(f);
+    LockStats::PrintAll(std::cout);
+
     f.close();
 
 }
@@ -1455,6 +1491,16 @@ void Tracking::SetViewer(Viewer *pViewer)
     mpViewer=pViewer;
 }
 
+void Tracking::SetScheduler(TaskScheduler *pScheduler)
+{
+    mpScheduler=pScheduler;
+}
+
+void Tracking::SetParallelRelocalization(bool bSet)
+{
+    mbParallelRelocalization = bSet;
+}
+
 void Tracking::SetStepByStep(bool bSet)
 {
     bStepByStep = bSet;
@@ -1465,6 +1511,16 @@ bool Tracking::GetStepByStep()
     return bStepByStep;
 }
 
+void Tracking::SetOffline(bool bSet)
+{
+    mbOffline = bSet;
+}
+
+void Tracking::SetMapClient(MapClient* pMapClient)
+{
+    mpMapClient = pMapClient;
+}
+
 
 
 Sophus::SE3f Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRectRight, const double &timestamp, string filename)
@@ -1507,16 +1563,17 @@ Sophus::SE3f Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat
     //cout << "Incoming frame creation" << endl;
 
     if (mSensor == System::STEREO && !mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera);
+        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,static_cast<Frame*>(NULL),IMU::Calib(),mpScheduler);
     else if(mSensor == System::STEREO && mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr);
+        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr,static_cast<Frame*>(NULL),IMU::Calib(),mpScheduler);
     else if(mSensor == System::IMU_STEREO && !mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,&mLastFrame,*mpImuCalib);
+        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,&mLastFrame,*mpImuCalib,mpScheduler);
     else if(mSensor == System::IMU_STEREO && mpCamera2)
-        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr,&mLastFrame,*mpImuCalib);
+        mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mpCamera,mpCamera2,mTlr,&mLastFrame,*mpImuCalib,mpScheduler);
 
     //cout << "Incoming frame ended" << endl;
 
+    mCurrentFrame.mnId = mpAtlas->NewFrameId();
     mCurrentFrame.mNameFile = filename;
     mCurrentFrame.mnDataset = mnNumDataset;
 
@@ -1566,6 +1623,7 @@ Sophus::SE3f Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, co
 
 
 
+    mCurrentFrame.mnId = mpAtlas->NewFrameId();
     mCurrentFrame.mNameFile = filename;
     mCurrentFrame.mnDataset = mnNumDataset;
 
@@ -1625,6 +1683,7 @@ Sophus::SE3f Tracking::GrabImageMonocular(const cv::Mat &im, const double &times
     if (mState==NO_IMAGES_YET)
         t0=timestamp;
 
+    mCurrentFrame.mnId = mpAtlas->NewFrameId();
     mCurrentFrame.mNameFile = filename;
     mCurrentFrame.mnDataset = mnNumDataset;
 
@@ -1725,6 +1784,10 @@ void Tracking::PreintegrateIMU()
 
     IMU::Preintegrated* pImuPreintegratedFromLastFrame = new IMU::Preintegrated(mLastFrame.mImuBias,mCurrentFrame.mImuCalib);
 
+    // Measurements interpolated at the frame timestamps, integrated as one block
+    vector<Eigen::Vector3f> vAcc(n), vAngVel(n);
+    vector<float> vTstep(n);
+
     for(int i=0; i<n; i++)
     {
         float tstep;
@@ -1762,12 +1825,18 @@ void Tracking::PreintegrateIMU()
             tstep = mCurrentFrame.mTimeStamp-mCurrentFrame.mpPrevFrame->mTimeStamp;
         }
 
-        if (!mpImuPreintegratedFromLastKF)
-            cout << "mpImuPreintegratedFromLastKF does not exist" << endl;
-        mpImuPreintegratedFromLastKF->IntegrateNewMeasurement(acc,angVel,tstep);
-        pImuPreintegratedFromLastFrame->IntegrateNewMeasurement(acc,angVel,tstep);
+        vAcc[i] = acc;
+        vAngVel[i] = angVel;
+        vTstep[i] = tstep;
     }
 
+    // The preintegration from the last keyframe is composed with the one from the last frame
+    // (integrated again only if their biases differ)
+    pImuPreintegratedFromLastFrame->IntegrateNewMeasurements(vAcc,vAngVel,vTstep);
+    if (!mpImuPreintegratedFromLastKF)
+        cout << "mpImuPreintegratedFromLastKF does not exist" << endl;
+    mpImuPreintegratedFromLastKF->Append(pImuPreintegratedFromLastFrame);
+
     mCurrentFrame.mpImuPreintegratedFrame = pImuPreintegratedFromLastFrame;
     mCurrentFrame.mpImuPreintegrated = mpImuPreintegratedFromLastKF;
     mCurrentFrame.mpLastKeyFrame = mpLastKeyFrame;
@@ -1853,6 +1922,13 @@ void Tracking::Track()
         mbStep = false;
     }
 
+    // Back-pressure instead of dropping keyframes: the map is the same whatever the speed of the machine
+    if(mbOffline)
+    {
+        mpLocalMapper->WaitUntilIdle();
+        mpLoopClosing->WaitUntilIdle();
+    }
+
     if(mpLocalMapper->mbBadImu)
     {
         cout << "TRACK: Reset map because local mapper set the bad imu flag " << endl;
@@ -1917,7 +1993,8 @@ void Tracking::Track()
 
     if(mState==NO_IMAGES_YET)
     {
-        mState = NOT_INITIALIZED;
+        // A client of a map server does not initialize a map, it relocalizes in the served one
+        mState = mpMapClient ? LOST : NOT_INITIALIZED;
     }
 
     mLastProcessedState=mState;
@@ -1938,8 +2015,14 @@ void Tracking::Track()
     }
     mbCreatedMap = false;
 
-    // Get Map Mutex -> Map cannot be changed
-    unique_lock<mutex> lock(pCurrentMap->mMutexMapUpdate);
+    // Get Map Mutex -> Map cannot be changed. Shared while the frame is tracked, exclusive when Track
+    // writes the map (initialization, new keyframe with its points) so the shared readers see it whole.
+    shared_lock<SharedMutex> lock(pCurrentMap->mMutexMapUpdate, defer_lock);
+    unique_lock<SharedMutex> lockWrite(pCurrentMap->mMutexMapUpdate, defer_lock);
+    if(mState==NOT_INITIALIZED)
+        lockWrite.lock();
+    else
+        lock.lock();
 
     mbMapUpdated = false;
 
@@ -2312,7 +2395,14 @@ void Tracking::Track()
             // if(bNeedKF && bOK)
             if(bNeedKF && (bOK || (mInsertKFsLost && mState==RECENTLY_LOST &&
                                    (mSensor == System::IMU_MONOCULAR || mSensor == System::IMU_STEREO || mSensor == System::IMU_RGBD))))
-                CreateNewKeyFrame();
+            {
+                // The shared lock is traded for the exclusive one. If a loop or merge correction ran in
+                // between, the frame was tracked on the old map and the keyframe is left to the next frame.
+                lock.unlock();
+                lockWrite.lock();
+                if(pCurrentMap->GetMapChangeIndex()==nCurMapChangeIndex && mpAtlas->GetCurrentMap()==pCurrentMap)
+                    CreateNewKeyFrame();
+            }
 
 #ifdef REGISTER_TIMES
             std::chrono::steady_clock::time_point time_EndNewKF = std::chrono::steady_clock::now();
@@ -2332,8 +2422,9 @@ void Tracking::Track()
             }
         }
 
-        // Reset if the camera get lost soon after initialization
-        if(mState==LOST)
+        // Reset if the camera get lost soon after initialization. A client of a map server keeps
+        // relocalizing in the served map.
+        if(mState==LOST && !mpMapClient)
         {
             if(pCurrentMap->KeyFramesInMap()<=10)
             {
@@ -2646,7 +2737,8 @@ void Tracking::CreateInitialMapMonocular()
 
     // Bundle Adjustment
     Verbose::PrintMess("New Map created with " + to_string(mpAtlas->MapPointsInMap()) + " points", Verbose::VERBOSITY_QUIET);
-    Optimizer::GlobalBundleAdjustemnt(mpAtlas->GetCurrentMap(),20);
+    // Offline the system is built serially, the parallel sums change their order from run to run
+    Optimizer::GlobalBundleAdjustemnt(mpAtlas->GetCurrentMap(),20,NULL,0,true,mbOffline ? static_cast<TaskScheduler*>(NULL) : mpScheduler);
 
     float medianDepth = pKFini->ComputeSceneMedianDepth(2);
     float invMedianDepth;
@@ -2786,10 +2878,18 @@ void Tracking::CheckReplacedInLastFrame()
 }
 
 
+void Tracking::ComputeFrameBoW()
+{
+    if(mpMapClient)
+        mpMapClient->ComputeBoW(mCurrentFrame);
+    else
+        mCurrentFrame.ComputeBoW();
+}
+
 bool Tracking::TrackReferenceKeyFrame()
 {
     // Compute Bag of Words vector
-    mCurrentFrame.ComputeBoW();
+    ComputeFrameBoW();
 
     // We perform first an ORB matching with the reference keyframe
     // If enough matches are found we setup a PnP solver
@@ -3168,8 +3268,8 @@ bool Tracking::NeedNewKeyFrame()
         nMinObs=2;
     int nRefMatches = mpReferenceKF->TrackedMapPoints(nMinObs);
 
-    // Local Mapping accept keyframes?
-    bool bLocalMappingIdle = mpLocalMapper->AcceptKeyFrames();
+    // Local Mapping accept keyframes? Offline it has finished the previous ones
+    bool bLocalMappingIdle = mbOffline || mpLocalMapper->AcceptKeyFrames();
 
     // Check how many "close" points are being tracked and how many could be potentially created.
     int nNonTrackedClose = 0;
@@ -3303,6 +3403,7 @@ void Tracking::CreateNewKeyFrame()
     {
         pKF->mPrevKF = mpLastKeyFrame;
         mpLastKeyFrame->mNextKF = pKF;
+        mpLastKeyFrame->MarkChanged();
     }
     else
         Verbose::PrintMess("No last KF in KF creation!!", Verbose::VERBOSITY_NORMAL);
@@ -3526,7 +3627,7 @@ void Tracking::UpdateLocalPoints()
 void Tracking::UpdateLocalKeyFrames()
 {
     // Each map point vote for the keyframes in which it has been observed
-    map<KeyFrame*,int> keyframeCounter;
+    KeyFrame::ConnectionMap keyframeCounter;
     if(!mpAtlas->isImuInitialized() || (mCurrentFrame.mnId<mnLastRelocFrameId+2))
     {
         for(int i=0; i<mCurrentFrame.N; i++)
@@ -3536,8 +3637,8 @@ void Tracking::UpdateLocalKeyFrames()
             {
                 if(!pMP->isBad())
                 {
-                    const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
-                    for(map<KeyFrame*,tuple<int,int>>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
+                    const MapPoint::ObservationsView observations = pMP->GetObservationsView();
+                    for(MapPoint::ObservationMap::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
                         keyframeCounter[it->first]++;
                 }
                 else
@@ -3559,8 +3660,8 @@ void Tracking::UpdateLocalKeyFrames()
                     continue;
                 if(!pMP->isBad())
                 {
-                    const map<KeyFrame*,tuple<int,int>> observations = pMP->GetObservations();
-                    for(map<KeyFrame*,tuple<int,int>>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
+                    const MapPoint::ObservationsView observations = pMP->GetObservationsView();
+                    for(MapPoint::ObservationMap::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
                         keyframeCounter[it->first]++;
                 }
                 else
@@ -3580,7 +3681,7 @@ void Tracking::UpdateLocalKeyFrames()
     mvpLocalKeyFrames.reserve(3*keyframeCounter.size());
 
     // All keyframes that observe a map point are included in the local map. Also check which keyframe shares most points
-    for(map<KeyFrame*,int>::const_iterator it=keyframeCounter.begin(), itEnd=keyframeCounter.end(); it!=itEnd; it++)
+    for(KeyFrame::ConnectionMap::const_iterator it=keyframeCounter.begin(), itEnd=keyframeCounter.end(); it!=itEnd; it++)
     {
         KeyFrame* pKF = it->first;
 
@@ -3598,23 +3699,22 @@ void Tracking::UpdateLocalKeyFrames()
     }
 
     // Include also some not-already-included keyframes that are neighbors to already-included keyframes
-    for(vector<KeyFrame*>::const_iterator itKF=mvpLocalKeyFrames.begin(), itEndKF=mvpLocalKeyFrames.end(); itKF!=itEndKF; itKF++)
+    if(mpMapClient)
     {
-        // Limit the number of keyframes
-        if(mvpLocalKeyFrames.size()>80) // 80
-            break;
-
-        KeyFrame* pKF = *itKF;
-
-        const vector<KeyFrame*> vNeighs = pKF->GetBestCovisibilityKeyFrames(10);
-
+        // The keyframes of a client have no covisibility graph nor spanning tree, the covisibles are the
+        // ones of the served atlas
+        vector<vector<KeyFrame*> > vvpNeighs;
+        mpMapClient->GetCovisibles(mvpLocalKeyFrames, 10, mCurrentFrame, mpAtlas->GetCurrentMap(), vvpNeighs);
 
-        for(vector<KeyFrame*>::const_iterator itNeighKF=vNeighs.begin(), itEndNeighKF=vNeighs.end(); itNeighKF!=itEndNeighKF; itNeighKF++)
+        for(size_t i=0; i<vvpNeighs.size(); i++)
         {
-            KeyFrame* pNeighKF = *itNeighKF;
-            if(!pNeighKF->isBad())
+            // Limit the number of keyframes
+            if(mvpLocalKeyFrames.size()>80) // 80
+                break;
+
+            for(KeyFrame* pNeighKF : vvpNeighs[i])
             {
-                if(pNeighKF->mnTrackReferenceForFrame!=mCurrentFrame.mnId)
+                if(!pNeighKF->isBad() && pNeighKF->mnTrackReferenceForFrame!=mCurrentFrame.mnId)
                 {
                     mvpLocalKeyFrames.push_back(pNeighKF);
                     pNeighKF->mnTrackReferenceForFrame=mCurrentFrame.mnId;
@@ -3622,30 +3722,58 @@ void Tracking::UpdateLocalKeyFrames()
                 }
             }
         }
-
-        const set<KeyFrame*> spChilds = pKF->GetChilds();
-        for(set<KeyFrame*>::const_iterator sit=spChilds.begin(), send=spChilds.end(); sit!=send; sit++)
+    }
+    else
+    {
+        for(vector<KeyFrame*>::const_iterator itKF=mvpLocalKeyFrames.begin(), itEndKF=mvpLocalKeyFrames.end(); itKF!=itEndKF; itKF++)
         {
-            KeyFrame* pChildKF = *sit;
-            if(!pChildKF->isBad())
+            // Limit the number of keyframes
+            if(mvpLocalKeyFrames.size()>80) // 80
+                break;
+
+            KeyFrame* pKF = *itKF;
+
+            const vector<KeyFrame*> vNeighs = pKF->GetBestCovisibilityKeyFrames(10);
+
+
+            for(vector<KeyFrame*>::const_iterator itNeighKF=vNeighs.begin(), itEndNeighKF=vNeighs.end(); itNeighKF!=itEndNeighKF; itNeighKF++)
             {
-                if(pChildKF->mnTrackReferenceForFrame!=mCurrentFrame.mnId)
+                KeyFrame* pNeighKF = *itNeighKF;
+                if(!pNeighKF->isBad())
                 {
-                    mvpLocalKeyFrames.push_back(pChildKF);
-                    pChildKF->mnTrackReferenceForFrame=mCurrentFrame.mnId;
-                    break;
+                    if(pNeighKF->mnTrackReferenceForFrame!=mCurrentFrame.mnId)
+                    {
+                        mvpLocalKeyFrames.push_back(pNeighKF);
+                        pNeighKF->mnTrackReferenceForFrame=mCurrentFrame.mnId;
+                        break;
+                    }
                 }
             }
-        }
 
-        KeyFrame* pParent = pKF->GetParent();
-        if(pParent)
-        {
-            if(pParent->mnTrackReferenceForFrame!=mCurrentFrame.mnId)
+            const KeyFrame::EdgeSet spChilds = pKF->GetChilds();
+            for(KeyFrame::EdgeSet::const_iterator sit=spChilds.begin(), send=spChilds.end(); sit!=send; sit++)
             {
-                mvpLocalKeyFrames.push_back(pParent);
-                pParent->mnTrackReferenceForFrame=mCurrentFrame.mnId;
-                break;
+                KeyFrame* pChildKF = *sit;
+                if(!pChildKF->isBad())
+                {
+                    if(pChildKF->mnTrackReferenceForFrame!=mCurrentFrame.mnId)
+                    {
+                        mvpLocalKeyFrames.push_back(pChildKF);
+                        pChildKF->mnTrackReferenceForFrame=mCurrentFrame.mnId;
+                        break;
+                    }
+                }
+            }
+
+            KeyFrame* pParent = pKF->GetParent();
+            if(pParent)
+            {
+                if(pParent->mnTrackReferenceForFrame!=mCurrentFrame.mnId)
+                {
+                    mvpLocalKeyFrames.push_back(pParent);
+                    pParent->mnTrackReferenceForFrame=mCurrentFrame.mnId;
+                    break;
+                }
             }
         }
     }
@@ -3675,21 +3803,184 @@ void Tracking::UpdateLocalKeyFrames()
     }
 }
 
+// Optimizes the pose of F from a RANSAC hypothesis with its inliers, searching more matches by projection in the
+// candidate keyframe if there are few. Returns the number of inliers of the final pose.
+static int VerifyRelocalizationPose(Frame &F, KeyFrame* pKF, const vector<MapPoint*> &vpMapPointMatches,
+                                    const vector<bool> &vbInliers, const Eigen::Matrix4f &eigTcw, ORBmatcher &matcher)
+{
+    Sophus::SE3f Tcw(eigTcw);
+    F.SetPose(Tcw);
+
+    set<MapPoint*> sFound;
+
+    const int np = vbInliers.size();
+
+    for(int j=0; j<np; j++)
+    {
+        if(vbInliers[j])
+        {
+            F.mvpMapPoints[j]=vpMapPointMatches[j];
+            sFound.insert(vpMapPointMatches[j]);
+        }
+        else
+            F.mvpMapPoints[j]=NULL;
+    }
+
+    int nGood = Optimizer::PoseOptimization(&F);
+
+    if(nGood<10)
+        return nGood;
+
+    for(int io =0; io<F.N; io++)
+        if(F.mvbOutlier[io])
+            F.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
+
+    // If few inliers, search by projection in a coarse window and optimize again
+    if(nGood<50)
+    {
+        int nadditional =matcher.SearchByProjection(F,pKF,sFound,10,100);
+
+        if(nadditional+nGood>=50)
+        {
+            nGood = Optimizer::PoseOptimization(&F);
+
+            // If many inliers but still not enough, search by projection again in a narrower window
+            // the camera has been already optimized with many points
+            if(nGood>30 && nGood<50)
+            {
+                sFound.clear();
+                for(int ip =0; ip<F.N; ip++)
+                    if(F.mvpMapPoints[ip])
+                        sFound.insert(F.mvpMapPoints[ip]);
+                nadditional =matcher.SearchByProjection(F,pKF,sFound,3,64);
+
+                // Final optimization
+                if(nGood+nadditional>=50)
+                {
+                    nGood = Optimizer::PoseOptimization(&F);
+
+                    for(int io =0; io<F.N; io++)
+                        if(F.mvbOutlier[io])
+                            F.mvpMapPoints[io]=NULL;
+                }
+            }
+        }
+    }
+
+    return nGood;
+}
+
+// Seed of the RANSAC of candidate i, the same in the sequential and the parallel search
+static unsigned int RelocalizationSeed(const Frame &F, const int i)
+{
+    return static_cast<unsigned int>(F.mnId)*1000u + i;
+}
+
+// Shared state of a parallel relocalization. The sequential search runs 5 RANSAC iterations per
+// candidate in turns and stops at the first verified pose, so the result is the candidate
+// verified in the earliest turn, the lowest index among those verified in that turn.
+struct RelocalizationSearch
+{
+    const Frame* pFrame;
+    const vector<KeyFrame*>* pvpCandidateKFs;
+
+    std::mutex mMutex;
+    Sophus::SE3f mTcw;
+    vector<MapPoint*> mvpMapPoints;
+    vector<bool> mvbOutlier;
+    int mnTurn;
+    int mnCandidate;
+
+    // True if a verified candidate comes before candidate i at its turn nTurn
+    bool Preceded(const int nTurn, const int i)
+    {
+        unique_lock<mutex> lock(mMutex);
+        return mnCandidate>=0 && (mnTurn<nTurn || (mnTurn==nTurn && mnCandidate<i));
+    }
+};
+
+// BoW matching, MLPnP RANSAC and verification of one candidate keyframe on a copy of the frame
+static void RelocalizeCandidate(RelocalizationSearch* pSearch, const int i)
+{
+    KeyFrame* pKF = (*pSearch->pvpCandidateKFs)[i];
+    if(pKF->isBad() || pSearch->Preceded(0, i))
+        return;
+
+    Frame F(*pSearch->pFrame);
+
+    ORBmatcher matcher(0.75,true);
+    vector<MapPoint*> vpMapPointMatches;
+    if(matcher.SearchByBoW(pKF,F,vpMapPointMatches)<15)
+        return;
+
+    MLPnPsolver solver(F,vpMapPointMatches);
+    solver.SetRansacParameters(0.99,10,300,6,0.5,5.991);  //This solver needs at least 6 points
+    solver.SetSeed(RelocalizationSeed(F,i));
+
+    ORBmatcher matcher2(0.9,true);
+    bool bNoMore = false;
+
+    // Same 5 iterations per turn as the sequential search, it stops when a candidate that goes before
+    // this one has been verified
+    for(int nTurn=0; !bNoMore && !pSearch->Preceded(nTurn, i); nTurn++)
+    {
+        vector<bool> vbInliers;
+        int nInliers;
+        Eigen::Matrix4f eigTcw;
+        if(!solver.iterate(5,bNoMore,vbInliers,nInliers,eigTcw))
+            continue;
+
+        if(VerifyRelocalizationPose(F,pKF,vpMapPointMatches,vbInliers,eigTcw,matcher2)<50)
+            continue;
+
+        unique_lock<mutex> lock(pSearch->mMutex);
+        if(pSearch->mnCandidate<0 || nTurn<pSearch->mnTurn || (nTurn==pSearch->mnTurn && i<pSearch->mnCandidate))
+        {
+            pSearch->mTcw = F.GetPose();
+            pSearch->mvpMapPoints = F.mvpMapPoints;
+            pSearch->mvbOutlier = F.mvbOutlier;
+            pSearch->mnTurn = nTurn;
+            pSearch->mnCandidate = i;
+        }
+        return;
+    }
+}
+
 bool Tracking::Relocalization()
 {
     Verbose::PrintMess("Starting relocalization", Verbose::VERBOSITY_NORMAL);
-    // Compute Bag of Words Vector
-    mCurrentFrame.ComputeBoW();
+    vector<KeyFrame*> vpCandidateKFs;
+    if(mpMapClient)
+    {
+        // The map server computes the BoW vectors and queries its keyframe database (in every served map)
+        if(!mpMapClient->DetectRelocalizationCandidates(mCurrentFrame, mpAtlas->GetCurrentMap(), vpCandidateKFs))
+            Verbose::PrintMess("Map server not available", Verbose::VERBOSITY_NORMAL);
+    }
+    else
+    {
+        // Compute Bag of Words Vector
+        mCurrentFrame.ComputeBoW();
 
-    // Relocalization is performed when tracking is lost
-    // Track Lost: Query KeyFrame Database for keyframe candidates for relocalisation
-    vector<KeyFrame*> vpCandidateKFs = mpKeyFrameDB->DetectRelocalizationCandidates(&mCurrentFrame, mpAtlas->GetCurrentMap());
+        // Relocalization is performed when tracking is lost
+        // Track Lost: Query KeyFrame Database for keyframe candidates for relocalisation
+        vpCandidateKFs = mpKeyFrameDB->DetectRelocalizationCandidates(&mCurrentFrame, mpAtlas->GetCurrentMap());
+    }
 
     if(vpCandidateKFs.empty()) {
         Verbose::PrintMess("There are not candidates", Verbose::VERBOSITY_NORMAL);
         return false;
     }
 
+    if(mbParallelRelocalization && mpScheduler && mpScheduler->NumThreads()>1)
+    {
+        if(!RelocalizationParallel(vpCandidateKFs))
+            return false;
+
+        mnLastRelocFrameId = mCurrentFrame.mnId;
+        cout << "Relocalized!!" << endl;
+        return true;
+    }
+
     const int nKFs = vpCandidateKFs.size();
 
     // We perform first an ORB matching with each candidate
@@ -3724,6 +4015,7 @@ bool Tracking::Relocalization()
             {
                 MLPnPsolver* pSolver = new MLPnPsolver(mCurrentFrame,vvpMapPointMatches[i]);
                 pSolver->SetRansacParameters(0.99,10,300,6,0.5,5.991);  //This solver needs at least 6 points
+                pSolver->SetSeed(RelocalizationSeed(mCurrentFrame,i));
                 vpMLPnPsolvers[i] = pSolver;
                 nCandidates++;
             }
@@ -3761,69 +4053,8 @@ bool Tracking::Relocalization()
             // If a Camera Pose is computed, optimize
             if(bTcw)
             {
-                Sophus::SE3f Tcw(eigTcw);
-                mCurrentFrame.SetPose(Tcw);
-                // Tcw.copyTo(mCurrentFrame.mTcw);
-
-                set<MapPoint*> sFound;
-
-                const int np = vbInliers.size();
-
-                for(int j=0; j<np; j++)
-                {
-                    if(vbInliers[j])
-                    {
-                        mCurrentFrame.mvpMapPoints[j]=vvpMapPointMatches[i][j];
-                        sFound.insert(vvpMapPointMatches[i][j]);
-                    }
-                    else
-                        mCurrentFrame.mvpMapPoints[j]=NULL;
-                }
-
-                int nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-                if(nGood<10)
-                    continue;
-
-                for(int io =0; io<mCurrentFrame.N; io++)
-                    if(mCurrentFrame.mvbOutlier[io])
-                        mCurrentFrame.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
-
-                // If few inliers, search by projection in a coarse window and optimize again
-                if(nGood<50)
-                {
-                    int nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,10,100);
-
-                    if(nadditional+nGood>=50)
-                    {
-                        nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-                        // If many inliers but still not enough, search by projection again in a narrower window
-                        // the camera has been already optimized with many points
-                        if(nGood>30 && nGood<50)
-                        {
-                            sFound.clear();
-                            for(int ip =0; ip<mCurrentFrame.N; ip++)
-                                if(mCurrentFrame.mvpMapPoints[ip])
-                                    sFound.insert(mCurrentFrame.mvpMapPoints[ip]);
-                            nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,3,64);
-
-                            // Final optimization
-                            if(nGood+nadditional>=50)
-                            {
-                                nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-                                for(int io =0; io<mCurrentFrame.N; io++)
-                                    if(mCurrentFrame.mvbOutlier[io])
-                                        mCurrentFrame.mvpMapPoints[io]=NULL;
-                            }
-                        }
-                    }
-                }
-
-
                 // If the pose is supported by enough inliers stop ransacs and continue
-                if(nGood>=50)
+                if(VerifyRelocalizationPose(mCurrentFrame,vpCandidateKFs[i],vvpMapPointMatches[i],vbInliers,eigTcw,matcher2)>=50)
                 {
                     bMatch = true;
                     break;
@@ -3845,6 +4076,28 @@ bool Tracking::Relocalization()
 
 }
 
+bool Tracking::RelocalizationParallel(const vector<KeyFrame*> &vpCandidateKFs)
+{
+    RelocalizationSearch search;
+    search.pFrame = &mCurrentFrame;
+    search.pvpCandidateKFs = &vpCandidateKFs;
+    search.mnTurn = 0;
+    search.mnCandidate = -1;
+
+    const std::function<void(int)> relocalize = std::bind(RelocalizeCandidate, &search, std::placeholders::_1);
+    mpScheduler->ParallelFor(0, vpCandidateKFs.size(), relocalize, TaskScheduler::TRACKING, 1);
+
+    if(search.mnCandidate<0)
+        return false;
+
+    mCurrentFrame.SetPose(search.mTcw);
+    mCurrentFrame.mvpMapPoints = search.mvpMapPoints;
+    mCurrentFrame.mvbOutlier = search.mvbOutlier;
+
+    Verbose::PrintMess("Relocalized with candidate " + to_string(search.mnCandidate) + " of " + to_string(vpCandidateKFs.size()), Verbose::VERBOSITY_DEBUG);
+    return true;
+}
+
 void Tracking::Reset(bool bLocMap)
 {
     Verbose::PrintMess("System Reseting", Verbose::VERBOSITY_NORMAL);
@@ -3852,8 +4105,7 @@ void Tracking::Reset(bool bLocMap)
     if(mpViewer)
     {
         mpViewer->RequestStop();
-        while(!mpViewer->isStopped())
-            usleep(3000);
+        mpViewer->WaitUntilStopped();
     }
 
     // Reset Local Mapping
@@ -3872,18 +4124,21 @@ void Tracking::Reset(bool bLocMap)
 
     // Clear BoW Database
     Verbose::PrintMess("Reseting Database...", Verbose::VERBOSITY_NORMAL);
-    mpKeyFrameDB->clear();
+    if(mpKeyFrameDB)
+        mpKeyFrameDB->clear();
     Verbose::PrintMess("done", Verbose::VERBOSITY_NORMAL);
 
     // Clear Map (this erase MapPoints and KeyFrames)
     mpAtlas->clearAtlas();
+    // The objects of a client are built again from the records
+    if(mpMapClient)
+        mpMapClient->ClearObjects();
     mpAtlas->CreateNewMap();
     if (mSensor==System::IMU_STEREO || mSensor == System::IMU_MONOCULAR || mSensor == System::IMU_RGBD)
         mpAtlas->SetInertialSensor();
     mnInitialFrameId = 0;
 
-    KeyFrame::nNextId = 0;
-    Frame::nNextId = 0;
+    mpAtlas->SetNextFrameId(0);
     mState = NO_IMAGES_YET;
 
     mbReadyToInitializate = false;
@@ -3912,8 +4167,7 @@ void Tracking::ResetActiveMap(bool bLocMap)
     if(mpViewer)
     {
         mpViewer->RequestStop();
-        while(!mpViewer->isStopped())
-            usleep(3000);
+        mpViewer->WaitUntilStopped();
     }
 
     Map* pMap = mpAtlas->GetCurrentMap();
@@ -3932,16 +4186,19 @@ void Tracking::ResetActiveMap(bool bLocMap)
 
     // Clear BoW Database
     Verbose::PrintMess("Reseting Database", Verbose::VERBOSITY_NORMAL);
-    mpKeyFrameDB->clearMap(pMap); // Only clear the active map references
+    if(mpKeyFrameDB)
+        mpKeyFrameDB->clearMap(pMap); // Only clear the active map references
     Verbose::PrintMess("done", Verbose::VERBOSITY_NORMAL);
 
     // Clear Map (this erase MapPoints and KeyFrames)
     mpAtlas->clearMap();
+    if(mpMapClient)
+        mpMapClient->ClearObjects();
 
 
     //KeyFrame::nNextId = mpAtlas->GetLastInitKFid();
     //Frame::nNextId = mnLastInitFrameId;
-    mnLastInitFrameId = Frame::nNextId;
+    mnLastInitFrameId = mpAtlas->GetNextFrameId();
     //mnLastRelocFrameId = mnLastInitFrameId;
     mState = NO_IMAGES_YET; //NOT_INITIALIZED;
 
@@ -4037,8 +4294,6 @@ void Tracking::ChangeCalibration(const string &strSettingPath)
     DistCoef.copyTo(mDistCoef);
 
     mbf = fSettings["Camera.bf"];
-
-    Frame::mbInitialComputations = true;
 }
 
 void Tracking::InformOnlyTracking(const bool &flag)
@@ -309,6 +309,7 @@ void Viewer::Run()
 
         d_cam.Activate(s_cam);
         glClearColor(1.0f,1.0f,1.0f,1.0f);
+        mpMapDrawer->UpdateVertexBuffers();
         mpMapDrawer->DrawCurrentCamera(Twc);
         if(menuShowKeyFrames || menuShowGraph || menuShowInertialGraph || menuShowOptLba)
             mpMapDrawer->DrawKeyFrames(menuShowKeyFrames,menuShowGraph, menuShowInertialGraph, menuShowOptLba);
@@ -370,10 +371,10 @@ void Viewer::Run()
 
         if(Stop())
         {
-            while(isStopped())
-            {
-                usleep(3000);
-            }
+            // Safe area to stop, until Release
+            unique_lock<mutex> lock(mMutexStop);
+            while(mbStopped)
+                mCondStop.wait(lock);
         }
 
         if(CheckFinish())
@@ -397,8 +398,12 @@ bool Viewer::CheckFinish()
 
 void Viewer::SetFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinished = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinished = true;
+    }
+    unique_lock<mutex> lock(mMutexStop);
+    mCondStop.notify_all();
 }
 
 bool Viewer::isFinished()
@@ -420,6 +425,13 @@ bool Viewer::isStopped()
     return mbStopped;
 }
 
+void Viewer::WaitUntilStopped()
+{
+    unique_lock<mutex> lock(mMutexStop);
+    while(!mbStopped && !isFinished())
+        mCondStop.wait(lock);
+}
+
 bool Viewer::Stop()
 {
     unique_lock<mutex> lock(mMutexStop);
@@ -431,6 +443,7 @@ bool Viewer::Stop()
     {
         mbStopped = true;
         mbStopRequested = false;
+        mCondStop.notify_all();
         return true;
     }
 
@@ -442,6 +455,7 @@ void Viewer::Release()
 {
     unique_lock<mutex> lock(mMutexStop);
     mbStopped = false;
+    mCondStop.notify_all();
 }
 
 /*void Viewer::SetTrackingPause()